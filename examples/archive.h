@@ -0,0 +1,92 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DCTOOL_ARCHIVE_H
+#define DCTOOL_ARCHIVE_H
+
+#include <libdivecomputer/common.h>
+#include <libdivecomputer/datetime.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#define DCTOOL_ARCHIVE_FINGERPRINT 32
+
+typedef struct dctool_archive_t dctool_archive_t;
+
+typedef struct dctool_archive_entry_t {
+	unsigned long long offset;
+	unsigned int size;
+	unsigned int checksum;
+	dc_family_t family;
+	unsigned int model;
+	dc_datetime_t datetime;
+	unsigned char fingerprint[DCTOOL_ARCHIVE_FINGERPRINT];
+	unsigned int fsize;
+} dctool_archive_entry_t;
+
+/*
+ * Open an existing archive for reading. Returns DC_STATUS_DATAFORMAT if
+ * the file is not an archive.
+ */
+dc_status_t
+dctool_archive_open (dctool_archive_t **archive, const char *filename);
+
+/*
+ * Open an archive for appending new dives, or create a new one if the
+ * file doesn't exist yet. The checksums are only enabled for new files;
+ * an existing archive keeps its own setting.
+ */
+dc_status_t
+dctool_archive_create (dctool_archive_t **archive, const char *filename, unsigned int checksums);
+
+unsigned int
+dctool_archive_get_count (dctool_archive_t *archive);
+
+const dctool_archive_entry_t *
+dctool_archive_get_entry (dctool_archive_t *archive, unsigned int idx);
+
+/*
+ * Get the raw data of a dive, without copying it, and verify its
+ * checksum. Only available for an archive opened for reading.
+ */
+dc_status_t
+dctool_archive_get_data (dctool_archive_t *archive, unsigned int idx, const unsigned char **data, unsigned int *size);
+
+/*
+ * Append a dive. The offset, size and checksum of the entry are filled
+ * in by the archive.
+ */
+dc_status_t
+dctool_archive_append (dctool_archive_t *archive, const dctool_archive_entry_t *entry, const unsigned char data[], unsigned int size);
+
+/*
+ * Close the archive. For an archive opened for appending, this writes
+ * the index of all dives.
+ */
+dc_status_t
+dctool_archive_close (dctool_archive_t *archive);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DCTOOL_ARCHIVE_H */
@@ -19,12 +19,19 @@
  * MA 02110-1301 USA
  */
 
+#include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
 #ifdef _WIN32
 #include <io.h>
 #include <fcntl.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
 #endif
 
 #include "common.h"
@@ -157,9 +164,14 @@ dctool_event_cb (dc_device_t *device, dc_event_type_t event, const void *data, v
 		message ("Event: waiting for user action\n");
 		break;
 	case DC_EVENT_PROGRESS:
-		message ("Event: progress %3.2f%% (%u/%u)\n",
+		message ("Event: progress %3.2f%% (%u/%u)",
 			100.0 * (double) progress->current / (double) progress->maximum,
 			progress->current, progress->maximum);
+		if (progress->version >= 1 && progress->rate) {
+			message (", %u bytes/s, eta %.1f s",
+				progress->rate, progress->eta / 1000.0);
+		}
+		message ("\n");
 		break;
 	case DC_EVENT_DEVINFO:
 		message ("Event: model=%u (0x%08x), firmware=%u (0x%08x), serial=%u (0x%08x)\n",
@@ -324,10 +336,29 @@ dctool_file_read (const char *filename)
 	if (fp == NULL)
 		return NULL;
 
+	// Get the file size (if possible).
+	long length = -1;
+	if (fp != stdin && fseek (fp, 0, SEEK_END) == 0) {
+		length = ftell (fp);
+		if (fseek (fp, 0, SEEK_SET) != 0)
+			length = -1;
+	}
+
 	// Allocate a memory buffer.
-	dc_buffer_t *buffer = dc_buffer_new (0);
+	dc_buffer_t *buffer = dc_buffer_new (length > 0 ? length : 0);
+	if (buffer == NULL) {
+		fclose (fp);
+		return NULL;
+	}
+
+	// Read the file directly into the buffer, without growing the
+	// buffer and copying the data block by block.
+	if (length > 0 && dc_buffer_resize (buffer, length)) {
+		size_t nbytes = fread (dc_buffer_get_data (buffer), 1, length, fp);
+		dc_buffer_resize (buffer, nbytes);
+	}
 
-	// Read the entire file into the buffer.
+	// Read the (remainder of the) file into the buffer.
 	size_t n = 0;
 	unsigned char block[1024] = {0};
 	while ((n = fread (block, 1, sizeof (block), fp)) > 0) {
@@ -339,3 +370,88 @@ dctool_file_read (const char *filename)
 
 	return buffer;
 }
+
+const unsigned char *
+dctool_file_map (const char *filename, size_t *size)
+{
+	// An empty file can't be mapped.
+	static const unsigned char empty[1] = {0};
+
+	if (filename == NULL || size == NULL)
+		return NULL;
+
+#ifdef _WIN32
+	FILE *fp = fopen (filename, "rb");
+	if (fp == NULL)
+		return NULL;
+
+	long length = -1;
+	if (fseek (fp, 0, SEEK_END) == 0)
+		length = ftell (fp);
+	if (length < 0 || fseek (fp, 0, SEEK_SET) != 0) {
+		fclose (fp);
+		return NULL;
+	}
+
+	if (length == 0) {
+		fclose (fp);
+		*size = 0;
+		return empty;
+	}
+
+	unsigned char *data = (unsigned char *) malloc (length);
+	if (data == NULL) {
+		fclose (fp);
+		return NULL;
+	}
+
+	size_t nbytes = fread (data, 1, length, fp);
+	fclose (fp);
+	if (nbytes != (size_t) length) {
+		free (data);
+		return NULL;
+	}
+
+	*size = length;
+
+	return data;
+#else
+	int fd = open (filename, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+
+	struct stat st;
+	if (fstat (fd, &st) != 0 || !S_ISREG (st.st_mode)) {
+		close (fd);
+		return NULL;
+	}
+
+	if (st.st_size == 0) {
+		close (fd);
+		*size = 0;
+		return empty;
+	}
+
+	void *data = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close (fd);
+	if (data == MAP_FAILED)
+		return NULL;
+
+	*size = st.st_size;
+
+	return (const unsigned char *) data;
+#endif
+}
+
+void
+dctool_file_unmap (const unsigned char *data, size_t size)
+{
+	if (data == NULL || size == 0)
+		return;
+
+#ifdef _WIN32
+	free ((void *) data);
+#else
+	munmap ((void *) data, size);
+#endif
+}
@@ -22,6 +22,8 @@
 #ifndef DCTOOL_COMMON_H
 #define DCTOOL_COMMON_H
 
+#include <stddef.h>
+
 #include <libdivecomputer/context.h>
 #include <libdivecomputer/descriptor.h>
 #include <libdivecomputer/device.h>
@@ -57,6 +59,16 @@ dctool_file_write (const char *filename, dc_buffer_t *buffer);
 dc_buffer_t *
 dctool_file_read (const char *filename);
 
+/*
+ * Map a file into memory for reading, or read the entire file on systems
+ * without mmap. Returns NULL on failure.
+ */
+const unsigned char *
+dctool_file_map (const char *filename, size_t *size);
+
+void
+dctool_file_unmap (const unsigned char *data, size_t size);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -42,6 +42,8 @@
 #include "dctool.h"
 #include "utils.h"
 
+#define C_ARRAY_SIZE(array) (sizeof (array) / sizeof *(array))
+
 #if defined(__GLIBC__) || defined(__MINGW32__)
 #define RESET 0
 #else
@@ -61,9 +63,13 @@ static const dctool_command_t *g_commands[] = {
 	&dctool_download,
 	&dctool_dump,
 	&dctool_parse,
+	&dctool_verify,
+	&dctool_extract,
+	&dctool_bench,
 	&dctool_read,
 	&dctool_write,
 	&dctool_fwupdate,
+	&dctool_serve,
 	NULL
 };
 
@@ -109,16 +115,26 @@ dctool_command_showhelp (const dctool_command_t *command)
 			"   -f, --family <family>     Device family type\n"
 			"   -m, --model <model>       Device model number\n"
 			"   -l, --logfile <logfile>   Logfile\n"
+			"   -r, --record <filename>   Record a serial transcript\n"
+			"   -p, --replay <filename>   Replay a serial transcript\n"
+			"   -t, --iothread <prio,cpu> Receive on a real-time I/O thread\n"
 			"   -q, --quiet               Quiet mode\n"
 			"   -v, --verbose             Verbose mode\n"
+			"   -a, --async               Log from a background thread\n"
+			"   -c, --category <list>     Loglevel per category\n"
 #else
 			"   -h             Show help message\n"
 			"   -d <device>    Device name\n"
 			"   -f <family>    Family type\n"
 			"   -m <model>     Model number\n"
 			"   -l <logfile>   Logfile\n"
+			"   -r <filename>  Record a serial transcript\n"
+			"   -p <filename>  Replay a serial transcript\n"
+			"   -t <prio,cpu>  Receive on a real-time I/O thread\n"
 			"   -q             Quiet mode\n"
 			"   -v             Verbose mode\n"
+			"   -a             Log from a background thread\n"
+			"   -c <list>      Loglevel per category\n"
 #endif
 			"\n"
 			"Available commands:\n");
@@ -160,6 +176,50 @@ logfunc (dc_context_t *context, dc_loglevel_t loglevel, const char *file, unsign
 	}
 }
 
+/*
+ * Apply a comma separated list of category=level pairs, for example
+ * "transport=info,parser=none".
+ */
+static int
+logcategories (dc_context_t *context, const char *list)
+{
+	const char *categories[] = {"transport", "protocol", "parser", "firmware"};
+	const char *loglevels[] = {"none", "error", "warning", "info", "debug", "all"};
+
+	const char *p = list;
+	while (*p) {
+		size_t length = strcspn (p, ",");
+		const char *separator = memchr (p, '=', length);
+		if (separator == NULL) {
+			message ("Invalid log category: %.*s\n", (int) length, p);
+			return -1;
+		}
+
+		size_t nlength = separator - p;
+		size_t vlength = length - nlength - 1;
+
+		unsigned int category = 0, loglevel = 0;
+		while (category < C_ARRAY_SIZE (categories) &&
+			(strlen (categories[category]) != nlength || strncmp (categories[category], p, nlength) != 0))
+			category++;
+		while (loglevel < C_ARRAY_SIZE (loglevels) &&
+			(strlen (loglevels[loglevel]) != vlength || strncmp (loglevels[loglevel], separator + 1, vlength) != 0))
+			loglevel++;
+		if (category == C_ARRAY_SIZE (categories) || loglevel == C_ARRAY_SIZE (loglevels)) {
+			message ("Invalid log category: %.*s\n", (int) length, p);
+			return -1;
+		}
+
+		dc_context_set_logcategory (context, (dc_logcategory_t) category, (dc_loglevel_t) loglevel);
+
+		p += length;
+		if (*p == ',')
+			p++;
+	}
+
+	return 0;
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -172,6 +232,11 @@ main (int argc, char *argv[])
 	unsigned int help = 0;
 	dc_loglevel_t loglevel = DC_LOGLEVEL_WARNING;
 	const char *logfile = NULL;
+	unsigned int logasync = 0;
+	const char *categories = NULL;
+	const char *record = NULL;
+	const char *replay = NULL;
+	const char *iothread = NULL;
 	const char *device = NULL;
 	dc_family_t family = DC_FAMILY_NULL;
 	unsigned int model = 0;
@@ -179,7 +244,7 @@ main (int argc, char *argv[])
 
 	// Parse the command-line options.
 	int opt = 0;
-	const char *optstring = NOPERMUTATION "hd:f:m:l:qv";
+	const char *optstring = NOPERMUTATION "hd:f:m:l:r:p:t:qvac:";
 #ifdef HAVE_GETOPT_LONG
 	struct option options[] = {
 		{"help",        no_argument,       0, 'h'},
@@ -187,8 +252,13 @@ main (int argc, char *argv[])
 		{"family",      required_argument, 0, 'f'},
 		{"model",       required_argument, 0, 'm'},
 		{"logfile",     required_argument, 0, 'l'},
+		{"record",      required_argument, 0, 'r'},
+		{"replay",      required_argument, 0, 'p'},
+		{"iothread",    required_argument, 0, 't'},
 		{"quiet",       no_argument,       0, 'q'},
 		{"verbose",     no_argument,       0, 'v'},
+		{"async",       no_argument,       0, 'a'},
+		{"category",    required_argument, 0, 'c'},
 		{0,             0,                 0,  0 }
 	};
 	while ((opt = getopt_long (argc, argv, optstring, options, NULL)) != -1) {
@@ -213,12 +283,27 @@ main (int argc, char *argv[])
 		case 'l':
 			logfile = optarg;
 			break;
+		case 'r':
+			record = optarg;
+			break;
+		case 'p':
+			replay = optarg;
+			break;
+		case 't':
+			iothread = optarg;
+			break;
 		case 'q':
 			loglevel = DC_LOGLEVEL_NONE;
 			break;
 		case 'v':
 			loglevel++;
 			break;
+		case 'a':
+			logasync = 1;
+			break;
+		case 'c':
+			categories = optarg;
+			break;
 		default:
 			return EXIT_FAILURE;
 		}
@@ -273,6 +358,37 @@ main (int argc, char *argv[])
 	// Setup the logging.
 	dc_context_set_loglevel (context, loglevel);
 	dc_context_set_logfunc (context, logfunc, NULL);
+	if (categories && logcategories (context, categories) != 0) {
+		exitcode = EXIT_FAILURE;
+		goto cleanup;
+	}
+	if (logasync && dc_context_set_logasync (context, 1024 * 1024) != DC_STATUS_SUCCESS) {
+		exitcode = EXIT_FAILURE;
+		goto cleanup;
+	}
+
+	// Setup the serial transcripts.
+	if (dc_context_set_record (context, record) != DC_STATUS_SUCCESS ||
+		dc_context_set_replay (context, replay) != DC_STATUS_SUCCESS) {
+		exitcode = EXIT_FAILURE;
+		goto cleanup;
+	}
+
+	// Setup the I/O thread, with the real-time priority and the
+	// processor separated by a comma.
+	if (iothread) {
+		char *end = NULL;
+		dc_iothread_t options = {0, -1, 0};
+		options.priority = strtol (iothread, &end, 0);
+		if (*end == ',')
+			options.cpu = strtol (end + 1, &end, 0);
+		if (*end != 0 || options.priority < 0) {
+			message ("Invalid I/O thread options: %s\n", iothread);
+			exitcode = EXIT_FAILURE;
+			goto cleanup;
+		}
+		dc_context_set_iothread (context, &options);
+	}
 
 	if (command->config & DCTOOL_CONFIG_DESCRIPTOR) {
 		// Check mandatory arguments.
@@ -48,9 +48,13 @@ extern const dctool_command_t dctool_list;
 extern const dctool_command_t dctool_download;
 extern const dctool_command_t dctool_dump;
 extern const dctool_command_t dctool_parse;
+extern const dctool_command_t dctool_verify;
+extern const dctool_command_t dctool_extract;
+extern const dctool_command_t dctool_bench;
 extern const dctool_command_t dctool_read;
 extern const dctool_command_t dctool_write;
 extern const dctool_command_t dctool_fwupdate;
+extern const dctool_command_t dctool_serve;
 
 const dctool_command_t *
 dctool_command_find (const char *name);
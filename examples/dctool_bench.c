@@ -0,0 +1,310 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef HAVE_GETOPT_H
+#include <getopt.h>
+#endif
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
+
+#include <libdivecomputer/context.h>
+#include <libdivecomputer/descriptor.h>
+#include <libdivecomputer/parser.h>
+
+#include "dctool.h"
+#include "common.h"
+#include "utils.h"
+
+typedef struct bench_result_t {
+	unsigned int ndives;
+	unsigned int nsamples;
+	unsigned long long nbytes;
+	double fields;
+	double samples;
+} bench_result_t;
+
+static double
+bench_now (void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER now, frequency;
+	QueryPerformanceFrequency (&frequency);
+	QueryPerformanceCounter (&now);
+	return (double) now.QuadPart / frequency.QuadPart;
+#else
+	struct timeval now;
+	gettimeofday (&now, NULL);
+	return now.tv_sec + now.tv_usec / 1000000.0;
+#endif
+}
+
+static void
+bench_sample_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
+{
+	unsigned int *nsamples = (unsigned int *) userdata;
+
+	if (type == DC_SAMPLE_TIME)
+		(*nsamples)++;
+}
+
+static void
+bench_fields (dc_parser_t *parser)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+	unsigned int value = 0;
+	double number = 0.0;
+	dc_gasmix_t gasmix;
+	dc_tank_t tank;
+	dc_salinity_t salinity;
+	dc_divemode_t divemode;
+	dc_field_string_t string;
+
+	dc_parser_get_field (parser, DC_FIELD_DIVETIME, 0, &value);
+	dc_parser_get_field (parser, DC_FIELD_MAXDEPTH, 0, &number);
+	dc_parser_get_field (parser, DC_FIELD_AVGDEPTH, 0, &number);
+	dc_parser_get_field (parser, DC_FIELD_SALINITY, 0, &salinity);
+	dc_parser_get_field (parser, DC_FIELD_ATMOSPHERIC, 0, &number);
+	dc_parser_get_field (parser, DC_FIELD_TEMPERATURE_SURFACE, 0, &number);
+	dc_parser_get_field (parser, DC_FIELD_TEMPERATURE_MINIMUM, 0, &number);
+	dc_parser_get_field (parser, DC_FIELD_TEMPERATURE_MAXIMUM, 0, &number);
+	dc_parser_get_field (parser, DC_FIELD_DIVEMODE, 0, &divemode);
+
+	unsigned int ngases = 0;
+	rc = dc_parser_get_field (parser, DC_FIELD_GASMIX_COUNT, 0, &ngases);
+	for (unsigned int i = 0; rc == DC_STATUS_SUCCESS && i < ngases; ++i) {
+		dc_parser_get_field (parser, DC_FIELD_GASMIX, i, &gasmix);
+	}
+
+	unsigned int ntanks = 0;
+	rc = dc_parser_get_field (parser, DC_FIELD_TANK_COUNT, 0, &ntanks);
+	for (unsigned int i = 0; rc == DC_STATUS_SUCCESS && i < ntanks; ++i) {
+		dc_parser_get_field (parser, DC_FIELD_TANK, i, &tank);
+	}
+
+	for (unsigned int i = 0; ; ++i) {
+		memset (&string, 0, sizeof (string));
+		rc = dc_parser_get_field (parser, DC_FIELD_STRING, i, &string);
+		if (rc != DC_STATUS_SUCCESS || string.desc == NULL)
+			break;
+	}
+}
+
+static dc_status_t
+bench (dc_buffer_t *buffer, dc_context_t *context, dc_descriptor_t *descriptor, unsigned int devtime, dc_ticks_t systime, unsigned int iterations, bench_result_t *result)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+	dc_parser_t *parser = NULL;
+	unsigned char *data = dc_buffer_get_data (buffer);
+	unsigned int size = dc_buffer_get_size (buffer);
+	unsigned int nsamples = 0;
+
+	// Create the parser.
+	rc = dc_parser_new2 (&parser, context, descriptor, devtime, systime);
+	if (rc != DC_STATUS_SUCCESS) {
+		ERROR ("Error creating the parser.");
+		goto cleanup;
+	}
+
+	for (unsigned int i = 0; i < iterations; ++i) {
+		double start = bench_now ();
+
+		// Register the data.
+		rc = dc_parser_set_data (parser, data, size);
+		if (rc != DC_STATUS_SUCCESS) {
+			ERROR ("Error registering the data.");
+			goto cleanup;
+		}
+
+		// Parse the summary fields.
+		bench_fields (parser);
+
+		double middle = bench_now ();
+
+		// Parse the samples.
+		nsamples = 0;
+		rc = dc_parser_samples_foreach (parser, bench_sample_cb, &nsamples);
+		if (rc != DC_STATUS_SUCCESS) {
+			ERROR ("Error parsing the sample data.");
+			goto cleanup;
+		}
+
+		double end = bench_now ();
+
+		result->fields += middle - start;
+		result->samples += end - middle;
+		result->nsamples += nsamples;
+		result->nbytes += size;
+		result->ndives++;
+	}
+
+cleanup:
+	dc_parser_destroy (parser);
+	return rc;
+}
+
+static void
+bench_report (const char *name, const bench_result_t *result)
+{
+	double total = result->fields + result->samples;
+
+	message ("%s: %u dives, %u samples, %.1f us/dive (fields), %.1f ns/sample, %.2f MB/s\n",
+		name, result->ndives, result->nsamples,
+		result->ndives ? result->fields * 1e6 / result->ndives : 0.0,
+		result->nsamples ? result->samples * 1e9 / result->nsamples : 0.0,
+		total > 0.0 ? result->nbytes / total / 1e6 : 0.0);
+}
+
+static int
+dctool_bench_run (int argc, char *argv[], dc_context_t *context, dc_descriptor_t *descriptor)
+{
+	// Default values.
+	int exitcode = EXIT_SUCCESS;
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_buffer_t *buffer = NULL;
+	bench_result_t total = {0};
+
+	// Default option values.
+	unsigned int help = 0;
+	unsigned int iterations = 100;
+	unsigned int verbose = 0;
+	unsigned int devtime = 0;
+	dc_ticks_t systime = 0;
+
+	// Parse the command-line options.
+	int opt = 0;
+	const char *optstring = "hn:vd:s:";
+#ifdef HAVE_GETOPT_LONG
+	struct option options[] = {
+		{"help",        no_argument,       0, 'h'},
+		{"iterations",  required_argument, 0, 'n'},
+		{"verbose",     no_argument,       0, 'v'},
+		{"devtime",     required_argument, 0, 'd'},
+		{"systime",     required_argument, 0, 's'},
+		{0,             0,                 0,  0 }
+	};
+	while ((opt = getopt_long (argc, argv, optstring, options, NULL)) != -1) {
+#else
+	while ((opt = getopt (argc, argv, optstring)) != -1) {
+#endif
+		switch (opt) {
+		case 'h':
+			help = 1;
+			break;
+		case 'n':
+			iterations = strtoul (optarg, NULL, 0);
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		case 'd':
+			devtime = strtoul (optarg, NULL, 0);
+			break;
+		case 's':
+			systime = strtoll (optarg, NULL, 0);
+			break;
+		default:
+			return EXIT_FAILURE;
+		}
+	}
+
+	argc -= optind;
+	argv += optind;
+
+	// Show help message.
+	if (help) {
+		dctool_command_showhelp (&dctool_bench);
+		return EXIT_SUCCESS;
+	}
+
+	for (unsigned int i = 0; i < argc; ++i) {
+		bench_result_t result = {0};
+
+		// Read the input file.
+		buffer = dctool_file_read (argv[i]);
+		if (buffer == NULL) {
+			message ("Failed to open the input file.\n");
+			exitcode = EXIT_FAILURE;
+			goto cleanup;
+		}
+
+		// Benchmark the dive.
+		status = bench (buffer, context, descriptor, devtime, systime, iterations, &result);
+		if (status != DC_STATUS_SUCCESS) {
+			message ("ERROR: %s: %s\n", argv[i], dctool_errmsg (status));
+			exitcode = EXIT_FAILURE;
+			goto cleanup;
+		}
+
+		if (verbose)
+			bench_report (argv[i], &result);
+
+		total.ndives += result.ndives;
+		total.nsamples += result.nsamples;
+		total.nbytes += result.nbytes;
+		total.fields += result.fields;
+		total.samples += result.samples;
+
+		// Cleanup.
+		dc_buffer_free (buffer);
+		buffer = NULL;
+	}
+
+	bench_report (dctool_family_name (dc_descriptor_get_type (descriptor)), &total);
+
+cleanup:
+	dc_buffer_free (buffer);
+	return exitcode;
+}
+
+const dctool_command_t dctool_bench = {
+	dctool_bench_run,
+	DCTOOL_CONFIG_DESCRIPTOR,
+	"bench",
+	"Benchmark the parser with previously downloaded dives",
+	"Usage:\n"
+	"   dctool bench [options] <filename>...\n"
+	"\n"
+	"Options:\n"
+#ifdef HAVE_GETOPT_LONG
+	"   -h, --help                 Show help message\n"
+	"   -n, --iterations <count>   Number of iterations per dive\n"
+	"   -v, --verbose              Report the results per dive\n"
+	"   -d, --devtime <timestamp>  Device time\n"
+	"   -s, --systime <timestamp>  System time\n"
+#else
+	"   -h              Show help message\n"
+	"   -n <count>      Number of iterations per dive\n"
+	"   -v              Report the results per dive\n"
+	"   -d <devtime>    Device time\n"
+	"   -s <systime>    System time\n"
+#endif
+};
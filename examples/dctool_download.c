@@ -23,6 +23,7 @@
 #include "config.h"
 #endif
 
+#include <stddef.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <stdio.h>
@@ -30,29 +31,218 @@
 #ifdef HAVE_GETOPT_H
 #include <getopt.h>
 #endif
+#ifndef _WIN32
+#include <pthread.h>
+#define HAVE_PIPELINE
+#endif
 
 #include <libdivecomputer/context.h>
 #include <libdivecomputer/descriptor.h>
 #include <libdivecomputer/device.h>
+#include <libdivecomputer/custom.h>
 #include <libdivecomputer/parser.h>
+#include <libdivecomputer/syncstore.h>
 
 #include "dctool.h"
 #include "common.h"
 #include "output.h"
 #include "utils.h"
 
-typedef struct event_data_t {
-	const char *cachedir;
-	dc_event_devinfo_t devinfo;
-} event_data_t;
+#ifdef HAVE_PIPELINE
+typedef struct pipeline_item_t {
+	struct pipeline_item_t *next;
+	unsigned int number;
+	dc_parser_t *parser;
+	unsigned char *data;
+	unsigned int size;
+	unsigned char *fingerprint;
+	unsigned int fsize;
+} pipeline_item_t;
+
+typedef struct pipeline_t {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	pipeline_item_t *head, *tail;
+	unsigned int count, capacity;
+	unsigned int queued, written;
+	unsigned int finished;
+	dctool_output_t *output;
+	pthread_t *threads;
+	unsigned int nthreads;
+} pipeline_t;
+#endif
 
 typedef struct dive_data_t {
 	dc_device_t *device;
-	dc_buffer_t **fingerprint;
 	unsigned int number;
 	dctool_output_t *output;
+#ifdef HAVE_PIPELINE
+	pipeline_t *pipeline;
+#endif
 } dive_data_t;
 
+#ifdef HAVE_PIPELINE
+static void
+pipeline_item_free (pipeline_item_t *item)
+{
+	if (item == NULL)
+		return;
+
+	dc_parser_destroy (item->parser);
+	free (item->data);
+	free (item->fingerprint);
+	free (item);
+}
+
+static void *
+pipeline_worker (void *userdata)
+{
+	pipeline_t *pipeline = (pipeline_t *) userdata;
+
+	while (1) {
+		// Take the next dive from the queue.
+		pthread_mutex_lock (&pipeline->mutex);
+		while (pipeline->head == NULL && !pipeline->finished)
+			pthread_cond_wait (&pipeline->cond, &pipeline->mutex);
+		pipeline_item_t *item = pipeline->head;
+		if (item == NULL) {
+			pthread_mutex_unlock (&pipeline->mutex);
+			break;
+		}
+		pipeline->head = item->next;
+		if (pipeline->head == NULL)
+			pipeline->tail = NULL;
+		pipeline->count--;
+		pthread_cond_broadcast (&pipeline->cond);
+		pthread_mutex_unlock (&pipeline->mutex);
+
+		// Register the data. This runs concurrently with the other
+		// workers and with the download itself.
+		dc_status_t rc = dc_parser_set_data (item->parser, item->data, item->size);
+		if (rc != DC_STATUS_SUCCESS) {
+			ERROR ("Error registering the data.");
+		}
+
+		// Wait until all previous dives have been written, to
+		// preserve the order of the dives in the output.
+		pthread_mutex_lock (&pipeline->mutex);
+		while (pipeline->written + 1 != item->number)
+			pthread_cond_wait (&pipeline->cond, &pipeline->mutex);
+		pthread_mutex_unlock (&pipeline->mutex);
+
+		// Parse the dive data.
+		if (rc == DC_STATUS_SUCCESS) {
+			rc = dctool_output_write (pipeline->output, item->parser, item->data, item->size, item->fingerprint, item->fsize);
+			if (rc != DC_STATUS_SUCCESS) {
+				ERROR ("Error parsing the dive data.");
+			}
+		}
+
+		pthread_mutex_lock (&pipeline->mutex);
+		pipeline->written++;
+		pthread_cond_broadcast (&pipeline->cond);
+		pthread_mutex_unlock (&pipeline->mutex);
+
+		pipeline_item_free (item);
+	}
+
+	return NULL;
+}
+
+static void
+pipeline_free (pipeline_t *pipeline)
+{
+	if (pipeline == NULL)
+		return;
+
+	// Let the workers drain the queue and wait for them to finish.
+	pthread_mutex_lock (&pipeline->mutex);
+	pipeline->finished = 1;
+	pthread_cond_broadcast (&pipeline->cond);
+	pthread_mutex_unlock (&pipeline->mutex);
+
+	for (unsigned int i = 0; i < pipeline->nthreads; ++i) {
+		pthread_join (pipeline->threads[i], NULL);
+	}
+
+	pthread_cond_destroy (&pipeline->cond);
+	pthread_mutex_destroy (&pipeline->mutex);
+	free (pipeline->threads);
+	free (pipeline);
+}
+
+static pipeline_t *
+pipeline_new (dctool_output_t *output, unsigned int nthreads)
+{
+	pipeline_t *pipeline = (pipeline_t *) calloc (1, sizeof (pipeline_t));
+	if (pipeline == NULL)
+		return NULL;
+
+	pipeline->threads = (pthread_t *) calloc (nthreads, sizeof (pthread_t));
+	if (pipeline->threads == NULL) {
+		free (pipeline);
+		return NULL;
+	}
+
+	pthread_mutex_init (&pipeline->mutex, NULL);
+	pthread_cond_init (&pipeline->cond, NULL);
+	pipeline->capacity = 4 * nthreads;
+	pipeline->output = output;
+
+	for (unsigned int i = 0; i < nthreads; ++i) {
+		if (pthread_create (&pipeline->threads[i], NULL, pipeline_worker, pipeline) != 0) {
+			pipeline_free (pipeline);
+			return NULL;
+		}
+		pipeline->nthreads++;
+	}
+
+	return pipeline;
+}
+
+static int
+pipeline_push (pipeline_t *pipeline, dc_parser_t *parser, const unsigned char *data, unsigned int size, const unsigned char *fingerprint, unsigned int fsize)
+{
+	pipeline_item_t *item = (pipeline_item_t *) calloc (1, sizeof (pipeline_item_t));
+	if (item == NULL) {
+		dc_parser_destroy (parser);
+		return 0;
+	}
+
+	item->parser = parser;
+	item->data = (unsigned char *) malloc (size ? size : 1);
+	item->fingerprint = (unsigned char *) malloc (fsize ? fsize : 1);
+	if (item->data == NULL || item->fingerprint == NULL) {
+		pipeline_item_free (item);
+		return 0;
+	}
+	memcpy (item->data, data, size);
+	memcpy (item->fingerprint, fingerprint, fsize);
+	item->size = size;
+	item->fsize = fsize;
+
+	// Wait for free space in the queue. This limits the amount of
+	// memory in use when the download is faster than the parsing.
+	pthread_mutex_lock (&pipeline->mutex);
+	while (pipeline->count >= pipeline->capacity)
+		pthread_cond_wait (&pipeline->cond, &pipeline->mutex);
+	// The sequence number is only assigned to a queued dive. A dive that
+	// failed before this point would otherwise leave a gap, and stall the
+	// workers waiting for their turn to write.
+	item->number = ++pipeline->queued;
+	if (pipeline->tail)
+		pipeline->tail->next = item;
+	else
+		pipeline->head = item;
+	pipeline->tail = item;
+	pipeline->count++;
+	pthread_cond_broadcast (&pipeline->cond);
+	pthread_mutex_unlock (&pipeline->mutex);
+
+	return 1;
+}
+#endif
+
 static int
 dive_cb (const unsigned char *data, unsigned int size, const unsigned char *fingerprint, unsigned int fsize, void *userdata)
 {
@@ -67,15 +257,6 @@ dive_cb (const unsigned char *data, unsigned int size, const unsigned char *fing
 		message ("%02X", fingerprint[i]);
 	message ("\n");
 
-	// Keep a copy of the most recent fingerprint. Because dives are
-	// guaranteed to be downloaded in reverse order, the most recent
-	// dive is always the first dive.
-	if (divedata->number == 1) {
-		dc_buffer_t *fp = dc_buffer_new (fsize);
-		dc_buffer_append (fp, fingerprint, fsize);
-		*divedata->fingerprint = fp;
-	}
-
 	// Create the parser.
 	message ("Creating the parser.\n");
 	rc = dc_parser_new (&parser, divedata->device);
@@ -84,6 +265,16 @@ dive_cb (const unsigned char *data, unsigned int size, const unsigned char *fing
 		goto cleanup;
 	}
 
+#ifdef HAVE_PIPELINE
+	// Hand the dive over to the worker threads.
+	if (divedata->pipeline) {
+		if (!pipeline_push (divedata->pipeline, parser, data, size, fingerprint, fsize)) {
+			ERROR ("Error queueing the dive data.");
+		}
+		return 1;
+	}
+#endif
+
 	// Register the data.
 	message ("Registering the data.\n");
 	rc = dc_parser_set_data (parser, data, size);
@@ -105,82 +296,97 @@ cleanup:
 	return 1;
 }
 
-static void
-event_cb (dc_device_t *device, dc_event_type_t event, const void *data, void *userdata)
+static int
+parse_impairment (const char *spec, dc_impairment_t *impairment)
 {
-	const dc_event_devinfo_t *devinfo = (const dc_event_devinfo_t *) data;
-
-	event_data_t *eventdata = (event_data_t *) userdata;
-
-	// Forward to the default event handler.
-	dctool_event_cb (device, event, data, userdata);
-
-	switch (event) {
-	case DC_EVENT_DEVINFO:
-		// Load the fingerprint from the cache. If there is no
-		// fingerprint present in the cache, a NULL buffer is returned,
-		// and the registered fingerprint will be cleared.
-		if (eventdata->cachedir) {
-			char filename[1024] = {0};
-			dc_family_t family = DC_FAMILY_NULL;
-			dc_buffer_t *fingerprint = NULL;
-
-			// Generate the fingerprint filename.
-			family = dc_device_get_type (device);
-			snprintf (filename, sizeof (filename), "%s/%s-%08X.bin",
-				eventdata->cachedir, dctool_family_name (family), devinfo->serial);
-
-			// Read the fingerprint file.
-			fingerprint = dctool_file_read (filename);
-
-			// Register the fingerprint data.
-			dc_device_set_fingerprint (device,
-				dc_buffer_get_data (fingerprint),
-				dc_buffer_get_size (fingerprint));
-
-			// Free the buffer again.
-			dc_buffer_free (fingerprint);
-		}
+	static const struct {
+		const char *name;
+		size_t offset;
+	} keys[] = {
+		{"bandwidth", offsetof (dc_impairment_t, bandwidth)},
+		{"latency",   offsetof (dc_impairment_t, latency)},
+		{"jitter",    offsetof (dc_impairment_t, jitter)},
+		{"drop",      offsetof (dc_impairment_t, drop)},
+		{"corrupt",   offsetof (dc_impairment_t, corrupt)},
+		{"seed",      offsetof (dc_impairment_t, seed)},
+	};
 
-		// Keep a copy of the event data. It will be used for generating
-		// the fingerprint filename again after a (successful) download.
-		eventdata->devinfo = *devinfo;
-		break;
-	default:
-		break;
+	memset (impairment, 0, sizeof (*impairment));
+
+	// A comma separated list of name=value pairs.
+	const char *p = spec;
+	while (*p) {
+		const char *eq = strchr (p, '=');
+		if (eq == NULL)
+			return -1;
+
+		size_t i = 0, n = sizeof (keys) / sizeof (keys[0]);
+		while (i < n && (strlen (keys[i].name) != (size_t) (eq - p) ||
+			strncmp (keys[i].name, p, eq - p) != 0))
+			i++;
+		if (i == n)
+			return -1;
+
+		char *end = NULL;
+		unsigned long value = strtoul (eq + 1, &end, 0);
+		if (end == eq + 1 || (*end != ',' && *end != 0))
+			return -1;
+		*(unsigned int *) ((char *) impairment + keys[i].offset) = value;
+
+		p = (*end == ',' ? end + 1 : end);
 	}
+
+	return 0;
 }
 
 static dc_status_t
-download (dc_context_t *context, dc_descriptor_t *descriptor, const char *devname, const char *cachedir, dc_buffer_t *fingerprint, dctool_output_t *output)
+download (dc_context_t *context, dc_descriptor_t *descriptor, const char *devname, const char *cachedir, dc_buffer_t *image, const dc_impairment_t *impairment, dc_buffer_t *fingerprint, dctool_output_t *output, unsigned int jobs)
 {
 	dc_status_t rc = DC_STATUS_SUCCESS;
 	dc_device_t *device = NULL;
-	dc_buffer_t *ofingerprint = NULL;
+	dc_syncstore_t *store = NULL;
+
+	// Create the sync store, and register it for the connection settings.
+	if (cachedir) {
+		rc = dc_syncstore_new (&store, context, cachedir);
+		if (rc != DC_STATUS_SUCCESS) {
+			ERROR ("Error creating the fingerprint store.");
+			goto cleanup;
+		}
+
+		dc_context_set_syncstore (context, store);
+	}
 
-	// Open the device.
+	// Collect the parser statistics for the report.
+	if (dc_context_is_enabled (context, DC_LOGLEVEL_INFO)) {
+		dc_context_set_parser_stats (context, 1);
+	}
+
+	// Open the device, or an emulated device serving the memory image.
 	message ("Opening the device (%s %s, %s).\n",
 		dc_descriptor_get_vendor (descriptor),
 		dc_descriptor_get_product (descriptor),
-		devname ? devname : "null");
-	rc = dc_device_open (&device, context, descriptor, devname);
+		image ? "emulated" : devname ? devname : "null");
+	if (image) {
+		dc_serial_t *serial = NULL;
+		rc = dc_serial_emulator_open (&serial, context, descriptor,
+			dc_buffer_get_data (image), dc_buffer_get_size (image));
+		if (rc == DC_STATUS_SUCCESS && impairment)
+			rc = dc_serial_impair_open (&serial, context, serial, impairment);
+		if (rc == DC_STATUS_SUCCESS)
+			rc = dc_device_custom_open (&device, context, descriptor, serial);
+	} else {
+		rc = dc_device_open (&device, context, descriptor, devname);
+	}
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR ("Error opening the device.");
 		goto cleanup;
 	}
 
-	// Initialize the event data.
-	event_data_t eventdata = {0};
-	if (fingerprint) {
-		eventdata.cachedir = NULL;
-	} else {
-		eventdata.cachedir = cachedir;
-	}
-
 	// Register the event handler.
 	message ("Registering the event handler.\n");
 	int events = DC_EVENT_WAITING | DC_EVENT_PROGRESS | DC_EVENT_DEVINFO | DC_EVENT_CLOCK | DC_EVENT_VENDOR;
-	rc = dc_device_set_events (device, events, event_cb, &eventdata);
+	rc = dc_device_set_events (device, events, dctool_event_cb, NULL);
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR ("Error registering the event handler.");
 		goto cleanup;
@@ -194,6 +400,25 @@ download (dc_context_t *context, dc_descriptor_t *descriptor, const char *devnam
 		goto cleanup;
 	}
 
+	// Register the memory cache.
+	if (cachedir) {
+		rc = dc_device_set_cachedir (device, cachedir);
+		if (rc != DC_STATUS_SUCCESS) {
+			ERROR ("Error registering the cache directory.");
+			goto cleanup;
+		}
+	}
+
+	// Register the fingerprint store. An explicit fingerprint takes
+	// precedence over the stored fingerprint.
+	if (store && fingerprint == NULL) {
+		rc = dc_device_set_syncstore (device, store);
+		if (rc != DC_STATUS_SUCCESS && rc != DC_STATUS_UNSUPPORTED) {
+			ERROR ("Error registering the fingerprint store.");
+			goto cleanup;
+		}
+	}
+
 	// Register the fingerprint data.
 	if (fingerprint) {
 		message ("Registering the fingerprint data.\n");
@@ -207,35 +432,67 @@ download (dc_context_t *context, dc_descriptor_t *descriptor, const char *devnam
 	// Initialize the dive data.
 	dive_data_t divedata = {0};
 	divedata.device = device;
-	divedata.fingerprint = &ofingerprint;
 	divedata.number = 0;
 	divedata.output = output;
 
+#ifdef HAVE_PIPELINE
+	// Start the worker threads.
+	if (jobs) {
+		message ("Starting %u worker thread(s).\n", jobs);
+		divedata.pipeline = pipeline_new (output, jobs);
+		if (divedata.pipeline == NULL) {
+			ERROR ("Error starting the worker threads.");
+			rc = DC_STATUS_NOMEMORY;
+			goto cleanup;
+		}
+	}
+#endif
+
 	// Download the dives.
 	message ("Downloading the dives.\n");
 	rc = dc_device_foreach (device, dive_cb, &divedata);
+#ifdef HAVE_PIPELINE
+	pipeline_free (divedata.pipeline);
+#endif
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR ("Error downloading the dives.");
 		goto cleanup;
 	}
 
-	// Store the fingerprint data.
-	if (cachedir && ofingerprint) {
-		char filename[1024] = {0};
-		dc_family_t family = DC_FAMILY_NULL;
-
-		// Generate the fingerprint filename.
-		family = dc_device_get_type (device);
-		snprintf (filename, sizeof (filename), "%s/%s-%08X.bin",
-			cachedir, dctool_family_name (family), eventdata.devinfo.serial);
+	// Report the time spent in each phase of the download.
+	if (dc_context_is_enabled (context, DC_LOGLEVEL_INFO)) {
+		static const char *names[DC_DEVICE_STATS_NPHASES] = {
+			"handshake", "logbook", "profile"};
+		dc_device_stats_t stats;
+		if (dc_device_get_stats (device, &stats) == DC_STATUS_SUCCESS) {
+			for (unsigned int i = 0; i < DC_DEVICE_STATS_NPHASES; ++i) {
+				const dc_device_phase_t *phase = stats.phases + i;
+				message ("Phase %-9s: wall=%llu.%03llu ms, io=%llu.%03llu ms, callback=%llu.%03llu ms\n",
+					names[i],
+					phase->walltime / 1000, phase->walltime % 1000,
+					phase->iotime / 1000, phase->iotime % 1000,
+					phase->callbacktime / 1000, phase->callbacktime % 1000);
+			}
+		}
 
-		// Write the fingerprint file.
-		dctool_file_write (filename, ofingerprint);
+		dc_parser_stats_t pstats;
+		if (dc_context_get_parser_stats (context, dc_descriptor_get_type (descriptor), &pstats) == DC_STATUS_SUCCESS) {
+			unsigned long long nsamples = 0;
+			for (unsigned int i = 0; i < DC_PARSER_STATS_NSAMPLES; ++i)
+				nsamples += pstats.nsamples[i];
+			message ("Parser: dives=%u, bytes=%llu, fields=%llu, samples=%llu, allocations=%u\n",
+				pstats.ndives, pstats.nbytes, pstats.nfields, nsamples, pstats.nallocations);
+			message ("Parser: set_data=%llu.%03llu ms, get_field=%llu.%03llu ms, samples_foreach=%llu.%03llu ms\n",
+				pstats.setdatatime / 1000, pstats.setdatatime % 1000,
+				pstats.fieldtime / 1000, pstats.fieldtime % 1000,
+				pstats.samplestime / 1000, pstats.samplestime % 1000);
+		}
 	}
 
 cleanup:
-	dc_buffer_free (ofingerprint);
 	dc_device_close (device);
+	dc_context_set_syncstore (context, NULL);
+	dc_syncstore_free (store);
 	return rc;
 }
 
@@ -245,6 +502,7 @@ dctool_download_run (int argc, char *argv[], dc_context_t *context, dc_descripto
 	int exitcode = EXIT_SUCCESS;
 	dc_status_t status = DC_STATUS_SUCCESS;
 	dc_buffer_t *fingerprint = NULL;
+	dc_buffer_t *image = NULL;
 	dctool_output_t *output = NULL;
 	dctool_units_t units = DCTOOL_UNITS_METRIC;
 
@@ -253,19 +511,26 @@ dctool_download_run (int argc, char *argv[], dc_context_t *context, dc_descripto
 	const char *fphex = NULL;
 	const char *filename = NULL;
 	const char *cachedir = NULL;
+	const char *emulate = NULL;
+	const char *impair = NULL;
+	dc_impairment_t impairment;
 	const char *format = "xml";
+	unsigned int jobs = 0;
 
 	// Parse the command-line options.
 	int opt = 0;
-	const char *optstring = "ho:p:c:f:u:";
+	const char *optstring = "ho:p:c:e:i:f:u:j:";
 #ifdef HAVE_GETOPT_LONG
 	struct option options[] = {
 		{"help",        no_argument,       0, 'h'},
 		{"output",      required_argument, 0, 'o'},
 		{"fingerprint", required_argument, 0, 'p'},
 		{"cache",       required_argument, 0, 'c'},
+		{"emulate",     required_argument, 0, 'e'},
+		{"impair",      required_argument, 0, 'i'},
 		{"format",      required_argument, 0, 'f'},
 		{"units",       required_argument, 0, 'u'},
+		{"jobs",        required_argument, 0, 'j'},
 		{0,             0,                 0,  0 }
 	};
 	while ((opt = getopt_long (argc, argv, optstring, options, NULL)) != -1) {
@@ -285,6 +550,12 @@ dctool_download_run (int argc, char *argv[], dc_context_t *context, dc_descripto
 		case 'c':
 			cachedir = optarg;
 			break;
+		case 'e':
+			emulate = optarg;
+			break;
+		case 'i':
+			impair = optarg;
+			break;
 		case 'f':
 			format = optarg;
 			break;
@@ -294,6 +565,9 @@ dctool_download_run (int argc, char *argv[], dc_context_t *context, dc_descripto
 			if (strcmp (optarg, "imperial") == 0)
 				units = DCTOOL_UNITS_IMPERIAL;
 			break;
+		case 'j':
+			jobs = strtoul (optarg, NULL, 0);
+			break;
 		default:
 			return EXIT_FAILURE;
 		}
@@ -311,16 +585,26 @@ dctool_download_run (int argc, char *argv[], dc_context_t *context, dc_descripto
 	// Convert the fingerprint to binary.
 	fingerprint = dctool_convert_hex2bin (fphex);
 
-	// Create the output.
-	if (strcasecmp(format, "raw") == 0) {
-		output = dctool_raw_output_new (filename);
-	} else if (strcasecmp(format, "xml") == 0) {
-		output = dctool_xml_output_new (filename, units);
-	} else {
-		message ("Unknown output format: %s\n", format);
+	// Parse the link impairments, which are simulated on top of the
+	// emulated device only.
+	if (impair && (!emulate || parse_impairment (impair, &impairment) != 0)) {
+		message ("Invalid link impairments: %s\n", impair);
 		exitcode = EXIT_FAILURE;
 		goto cleanup;
 	}
+
+	// Read the memory image for the emulated device.
+	if (emulate) {
+		image = dctool_file_read (emulate);
+		if (image == NULL) {
+			message ("Failed to read the memory image.\n");
+			exitcode = EXIT_FAILURE;
+			goto cleanup;
+		}
+	}
+
+	// Create the output.
+	output = dctool_output_new (format, filename, units, dc_descriptor_get_model (descriptor));
 	if (output == NULL) {
 		message ("Failed to create the output.\n");
 		exitcode = EXIT_FAILURE;
@@ -328,7 +612,7 @@ dctool_download_run (int argc, char *argv[], dc_context_t *context, dc_descripto
 	}
 
 	// Download the dives.
-	status = download (context, descriptor, argv[0], cachedir, fingerprint, output);
+	status = download (context, descriptor, argv[0], cachedir, image, impair ? &impairment : NULL, fingerprint, output, jobs);
 	if (status != DC_STATUS_SUCCESS) {
 		message ("ERROR: %s\n", dctool_errmsg (status));
 		exitcode = EXIT_FAILURE;
@@ -337,6 +621,7 @@ dctool_download_run (int argc, char *argv[], dc_context_t *context, dc_descripto
 
 cleanup:
 	dctool_output_free (output);
+	dc_buffer_free (image);
 	dc_buffer_free (fingerprint);
 	return exitcode;
 }
@@ -355,15 +640,21 @@ const dctool_command_t dctool_download = {
 	"   -o, --output <filename>    Output filename\n"
 	"   -p, --fingerprint <data>   Fingerprint data (hexadecimal)\n"
 	"   -c, --cache <directory>    Cache directory\n"
+	"   -e, --emulate <filename>   Emulate the device from a memory dump\n"
+	"   -i, --impair <list>        Simulate link impairments (emulation only)\n"
 	"   -f, --format <format>      Output format\n"
 	"   -u, --units <units>        Set units (metric or imperial)\n"
+	"   -j, --jobs <count>         Number of parser threads\n"
 #else
 	"   -h                 Show help message\n"
 	"   -o <filename>      Output filename\n"
 	"   -p <fingerprint>   Fingerprint data (hexadecimal)\n"
 	"   -c <directory>     Cache directory\n"
+	"   -e <filename>      Emulate the device from a memory dump\n"
+	"   -i <list>          Simulate link impairments (emulation only)\n"
 	"   -f <format>        Output format\n"
 	"   -u <units>         Set units (metric or imperial)\n"
+	"   -j <count>         Number of parser threads\n"
 #endif
 	"\n"
 	"Supported output formats:\n"
@@ -378,6 +669,39 @@ const dctool_command_t dctool_download = {
 	"      files, the filename is interpreted as a template and should\n"
 	"      contain one or more placeholders.\n"
 	"\n"
+	"   COLUMNAR\n"
+	"\n"
+	"      All dives are exported to a single binary file, with the time,\n"
+	"      depth, temperature and pressure samples stored as compressed\n"
+	"      columns and an index for random access to each dive. Values are\n"
+	"      always stored in metric units.\n"
+	"\n"
+	"   JSON, JSON-COLUMNS\n"
+	"\n"
+	"      All dives are exported to a single file, with one JSON object\n"
+	"      per line for each dive. The samples are written as an array of\n"
+	"      objects, or with json-columns as one array per sample type.\n"
+	"      Values are always stored in metric units.\n"
+	"\n"
+	"   ARCHIVE\n"
+	"\n"
+	"      All dives are appended to a single binary file, as raw data with\n"
+	"      an index of their fingerprint, date/time, family, model and\n"
+	"      checksum. The archive can be read back with dctool parse.\n"
+	"\n"
+	"Several formats are written at once, with a comma separated list of\n"
+	"formats and a matching list of filenames (e.g. -f xml,json -o a.xml,\n"
+	"a.json). The samples of each dive are decoded only once for all of\n"
+	"them.\n"
+	"\n"
+	"With a non-zero number of parser threads, the dives are parsed in the\n"
+	"background while the download continues. The order of the dives in\n"
+	"the output is preserved.\n"
+	"\n"
+	"The link impairments are a comma separated list of name=value pairs:\n"
+	"bandwidth (bytes per second), latency and jitter (milliseconds), drop\n"
+	"and corrupt (probability per byte, in parts per million) and seed.\n"
+	"\n"
 	"Supported template placeholders:\n"
 	"\n"
 	"   %f   Fingerprint (hexadecimal format)\n"
@@ -0,0 +1,444 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef HAVE_GETOPT_H
+#include <getopt.h>
+#endif
+#ifndef _WIN32
+#include <pthread.h>
+#define HAVE_WORKERS
+#endif
+
+#include <libdivecomputer/context.h>
+#include <libdivecomputer/descriptor.h>
+#include <libdivecomputer/device.h>
+#include <libdivecomputer/parser.h>
+
+#include "dctool.h"
+#include "common.h"
+#include "output.h"
+#include "filelist.h"
+#include "utils.h"
+
+typedef struct extract_t {
+#ifdef HAVE_WORKERS
+	pthread_mutex_t mutex;
+#endif
+	dc_context_t *context;
+	dc_descriptor_t *descriptor;
+	const dctool_filelist_t *files;
+	const char *format;
+	const char *filename;
+	dctool_units_t units;
+	size_t next;
+	unsigned int ndives;
+	unsigned int nerrors;
+} extract_t;
+
+typedef struct extract_job_t {
+	extract_t *extract;
+	dc_parser_t *parser;
+	dctool_output_t *output;
+	const char *filename;
+	unsigned int number;
+	unsigned int ndives;
+	unsigned int nerrors;
+} extract_job_t;
+
+static void
+extract_lock (extract_t *extract)
+{
+#ifdef HAVE_WORKERS
+	pthread_mutex_lock (&extract->mutex);
+#endif
+}
+
+static void
+extract_unlock (extract_t *extract)
+{
+#ifdef HAVE_WORKERS
+	pthread_mutex_unlock (&extract->mutex);
+#endif
+}
+
+static void
+extract_report (extract_job_t *job, unsigned int dive, dc_status_t status)
+{
+	extract_lock (job->extract);
+	if (dive)
+		message ("ERROR: %s: dive %u: %s\n", job->filename, dive - 1, dctool_errmsg (status));
+	else
+		message ("ERROR: %s: %s\n", job->filename, dctool_errmsg (status));
+	extract_unlock (job->extract);
+
+	job->nerrors++;
+}
+
+static int
+mkfilename (char *buffer, size_t size, const char *template, const char *dumpname)
+{
+	// Strip the directory and the extension of the dump.
+	const char *name = dumpname;
+	for (const char *p = dumpname; *p; ++p) {
+#ifdef _WIN32
+		if (*p == '\\')
+			name = p + 1;
+#endif
+		if (*p == '/')
+			name = p + 1;
+	}
+	size_t length = strlen (name);
+	const char *dot = strrchr (name, '.');
+	if (dot && dot != name)
+		length = dot - name;
+
+	// Only the %b placeholder is replaced. All other placeholders are
+	// left for the output itself.
+	size_t n = 0;
+	const char *p = template;
+	while (*p) {
+		if (p[0] == '%' && p[1] == 'b') {
+			if (n + length >= size)
+				return -1;
+			memcpy (buffer + n, name, length);
+			n += length;
+			p += 2;
+			continue;
+		}
+
+		size_t count = (p[0] == '%' && p[1] != 0) ? 2 : 1;
+		if (n + count >= size)
+			return -1;
+		memcpy (buffer + n, p, count);
+		n += count;
+		p += count;
+	}
+
+	buffer[n] = 0;
+
+	return n;
+}
+
+static int
+extract_dive_cb (const unsigned char *data, unsigned int size, const unsigned char *fingerprint, unsigned int fsize, void *userdata)
+{
+	extract_job_t *job = (extract_job_t *) userdata;
+
+	job->number++;
+	job->ndives++;
+
+	dc_status_t rc = dc_parser_set_data (job->parser, data, size);
+	if (rc == DC_STATUS_SUCCESS)
+		rc = dctool_output_write (job->output, job->parser, data, size, fingerprint, fsize);
+	if (rc != DC_STATUS_SUCCESS)
+		extract_report (job, job->number, rc);
+
+	return 1;
+}
+
+static void
+extract_file (extract_job_t *job)
+{
+	extract_t *extract = job->extract;
+	char filename[1024];
+
+	job->number = 0;
+
+	if (mkfilename (filename, sizeof (filename), extract->filename, job->filename) < 0) {
+		extract_report (job, 0, DC_STATUS_INVALIDARGS);
+		return;
+	}
+
+	// The dump is mapped into memory, and never copied.
+	size_t size = 0;
+	const unsigned char *data = dctool_file_map (job->filename, &size);
+	if (data == NULL) {
+		extract_report (job, 0, DC_STATUS_IO);
+		return;
+	}
+
+	if (size > (unsigned int) -1) {
+		extract_report (job, 0, DC_STATUS_DATAFORMAT);
+		goto cleanup;
+	}
+
+	job->output = dctool_output_new (extract->format, filename, extract->units, dc_descriptor_get_model (extract->descriptor));
+	if (job->output == NULL) {
+		extract_report (job, 0, DC_STATUS_IO);
+		goto cleanup;
+	}
+
+	dc_status_t status = dc_device_extract_dives (extract->descriptor, data, size, extract_dive_cb, job);
+	if (status != DC_STATUS_SUCCESS)
+		extract_report (job, 0, status);
+
+	status = dctool_output_free (job->output);
+	if (status != DC_STATUS_SUCCESS)
+		extract_report (job, 0, status);
+	job->output = NULL;
+
+cleanup:
+	dctool_file_unmap (data, size);
+}
+
+static void *
+extract_worker (void *userdata)
+{
+	extract_t *extract = (extract_t *) userdata;
+	extract_job_t job = {extract, NULL, NULL, NULL, 0, 0, 0};
+
+	// Every worker has its own parser.
+	dc_status_t rc = dc_parser_new2 (&job.parser, extract->context, extract->descriptor, 0, 0);
+	if (rc != DC_STATUS_SUCCESS) {
+		extract_lock (extract);
+		message ("ERROR: Failed to create the parser: %s\n", dctool_errmsg (rc));
+		extract->nerrors++;
+		extract_unlock (extract);
+		return NULL;
+	}
+
+	while (1) {
+		// Take the next file from the list.
+		extract_lock (extract);
+		size_t idx = extract->next;
+		if (idx < extract->files->count)
+			extract->next++;
+		extract_unlock (extract);
+		if (idx >= extract->files->count)
+			break;
+
+		job.filename = extract->files->names[idx];
+		extract_file (&job);
+	}
+
+	dc_parser_destroy (job.parser);
+
+	extract_lock (extract);
+	extract->ndives += job.ndives;
+	extract->nerrors += job.nerrors;
+	extract_unlock (extract);
+
+	return NULL;
+}
+
+static int
+dctool_extract_run (int argc, char *argv[], dc_context_t *context, dc_descriptor_t *descriptor)
+{
+	// Default values.
+	int exitcode = EXIT_SUCCESS;
+	dctool_filelist_t files = {NULL, 0, 0};
+	dctool_units_t units = DCTOOL_UNITS_METRIC;
+
+	// Default option values.
+	unsigned int help = 0;
+	unsigned int jobs = 0;
+	const char *filename = NULL;
+	const char *listfile = NULL;
+	const char *format = "archive";
+
+	// Parse the command-line options.
+	int opt = 0;
+	const char *optstring = "ho:l:f:j:u:";
+#ifdef HAVE_GETOPT_LONG
+	struct option options[] = {
+		{"help",        no_argument,       0, 'h'},
+		{"output",      required_argument, 0, 'o'},
+		{"list",        required_argument, 0, 'l'},
+		{"format",      required_argument, 0, 'f'},
+		{"jobs",        required_argument, 0, 'j'},
+		{"units",       required_argument, 0, 'u'},
+		{0,             0,                 0,  0 }
+	};
+	while ((opt = getopt_long (argc, argv, optstring, options, NULL)) != -1) {
+#else
+	while ((opt = getopt (argc, argv, optstring)) != -1) {
+#endif
+		switch (opt) {
+		case 'h':
+			help = 1;
+			break;
+		case 'o':
+			filename = optarg;
+			break;
+		case 'l':
+			listfile = optarg;
+			break;
+		case 'f':
+			format = optarg;
+			break;
+		case 'j':
+			jobs = strtoul (optarg, NULL, 0);
+			break;
+		case 'u':
+			if (strcmp (optarg, "metric") == 0)
+				units = DCTOOL_UNITS_METRIC;
+			if (strcmp (optarg, "imperial") == 0)
+				units = DCTOOL_UNITS_IMPERIAL;
+			break;
+		default:
+			return EXIT_FAILURE;
+		}
+	}
+
+	argc -= optind;
+	argv += optind;
+
+	// Show help message.
+	if (help) {
+		dctool_command_showhelp (&dctool_extract);
+		return EXIT_SUCCESS;
+	}
+
+	if (filename == NULL) {
+		message ("No output filename specified.\n");
+		return EXIT_FAILURE;
+	}
+
+	// Collect the input files.
+	for (unsigned int i = 0; i < argc; ++i) {
+		int rc = 0;
+		if (dctool_filelist_is_directory (argv[i]))
+			rc = dctool_filelist_add_directory (&files, argv[i]);
+		else
+			rc = dctool_filelist_add (&files, argv[i], strlen (argv[i]));
+		if (rc != 0) {
+			message ("Failed to read the input directory '%s'.\n", argv[i]);
+			exitcode = EXIT_FAILURE;
+			goto cleanup;
+		}
+	}
+
+	if (listfile && dctool_filelist_add_listfile (&files, listfile) != 0) {
+		message ("Failed to read the input list '%s'.\n", listfile);
+		exitcode = EXIT_FAILURE;
+		goto cleanup;
+	}
+
+	// Each dump needs its own output file.
+	if (files.count > 1 && strstr (filename, "%b") == NULL) {
+		message ("The output filename should contain the %%b placeholder.\n");
+		exitcode = EXIT_FAILURE;
+		goto cleanup;
+	}
+
+	extract_t extract;
+	extract.context = context;
+	extract.descriptor = descriptor;
+	extract.files = &files;
+	extract.format = format;
+	extract.filename = filename;
+	extract.units = units;
+	extract.next = 0;
+	extract.ndives = 0;
+	extract.nerrors = 0;
+
+#ifdef HAVE_WORKERS
+	// Use one worker per processor by default.
+	if (jobs == 0) {
+		long ncpus = sysconf (_SC_NPROCESSORS_ONLN);
+		jobs = ncpus > 0 ? ncpus : 1;
+	}
+	if (jobs > files.count)
+		jobs = files.count;
+
+	pthread_t *threads = NULL;
+	if (jobs > 1) {
+		threads = (pthread_t *) malloc (jobs * sizeof (pthread_t));
+		if (threads == NULL) {
+			message ("Failed to allocate memory.\n");
+			exitcode = EXIT_FAILURE;
+			goto cleanup;
+		}
+	}
+
+	pthread_mutex_init (&extract.mutex, NULL);
+
+	// The current thread is the last worker, and no threads are started
+	// for a single job.
+	unsigned int nthreads = 0;
+	while (nthreads + 1 < jobs) {
+		if (pthread_create (&threads[nthreads], NULL, extract_worker, &extract) != 0)
+			break;
+		nthreads++;
+	}
+
+	extract_worker (&extract);
+
+	for (unsigned int i = 0; i < nthreads; ++i)
+		pthread_join (threads[i], NULL);
+
+	pthread_mutex_destroy (&extract.mutex);
+	free (threads);
+#else
+	extract_worker (&extract);
+#endif
+
+	message ("Extracted %u files, %u dives, %u errors.\n",
+		(unsigned int) files.count, extract.ndives, extract.nerrors);
+
+	if (extract.nerrors)
+		exitcode = EXIT_FAILURE;
+
+cleanup:
+	dctool_filelist_free (&files);
+	return exitcode;
+}
+
+const dctool_command_t dctool_extract = {
+	dctool_extract_run,
+	DCTOOL_CONFIG_DESCRIPTOR,
+	"extract",
+	"Extract the dives from previously downloaded memory dumps",
+	"Usage:\n"
+	"   dctool extract [options] -o <filename> <filename|directory> ...\n"
+	"\n"
+	"Each file contains a memory dump (see dctool dump). The dives of\n"
+	"every dump are written to a separate output file, with the %b\n"
+	"placeholder in the output filename replaced by the name of the dump\n"
+	"without its extension. The dumps are processed in parallel.\n"
+	"\n"
+	"Options:\n"
+#ifdef HAVE_GETOPT_LONG
+	"   -h, --help                 Show help message\n"
+	"   -o, --output <filename>    Output filename\n"
+	"   -l, --list <filename>      Read input filenames from a file (- for stdin)\n"
+	"   -f, --format <format>      Output format (see dctool download)\n"
+	"   -j, --jobs <count>         Number of dumps extracted in parallel\n"
+	"   -u, --units <units>        Set units (metric or imperial)\n"
+#else
+	"   -h              Show help message\n"
+	"   -o <filename>   Output filename\n"
+	"   -l <filename>   Read input filenames from a file (- for stdin)\n"
+	"   -f <format>     Output format (see dctool download)\n"
+	"   -j <count>      Number of dumps extracted in parallel\n"
+	"   -u <units>      Set units (metric or imperial)\n"
+#endif
+	"\n"
+	"The default output format is archive.\n"
+};
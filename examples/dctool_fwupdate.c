@@ -33,6 +33,7 @@
 #include <libdivecomputer/context.h>
 #include <libdivecomputer/descriptor.h>
 #include <libdivecomputer/device.h>
+#include <libdivecomputer/session.h>
 #include <libdivecomputer/hw_ostc.h>
 #include <libdivecomputer/hw_ostc3.h>
 
@@ -77,12 +78,14 @@ fwupdate (dc_context_t *context, dc_descriptor_t *descriptor, const char *devnam
 	// Update the firmware.
 	message ("Updating the firmware.\n");
 	switch (dc_device_get_type (device)) {
+#ifdef ENABLE_BACKEND_HW
 	case DC_FAMILY_HW_OSTC:
 		rc = hw_ostc_device_fwupdate (device, hexfile);
 		break;
 	case DC_FAMILY_HW_OSTC3:
 		rc = hw_ostc3_device_fwupdate (device, hexfile);
 		break;
+#endif
 	default:
 		rc = DC_STATUS_UNSUPPORTED;
 		break;
@@ -97,6 +100,117 @@ cleanup:
 	return rc;
 }
 
+typedef struct fwupdate_batch_t {
+	char **names;
+#ifdef ENABLE_BACKEND_HW
+	hw_ostc_firmware_t *ostc;
+	hw_ostc3_firmware_t *ostc3;
+#endif
+} fwupdate_batch_t;
+
+static void
+fwupdate_event_cb (unsigned int index, dc_device_t *device, dc_event_type_t event, const void *data, void *userdata)
+{
+	fwupdate_batch_t *batch = (fwupdate_batch_t *) userdata;
+
+	message ("[%s] ", batch->names[index]);
+	dctool_event_cb (device, event, data, NULL);
+}
+
+static dc_status_t
+fwupdate_device_cb (unsigned int index, dc_device_t *device, void *userdata)
+{
+	fwupdate_batch_t *batch = (fwupdate_batch_t *) userdata;
+
+	// All devices share the same read-only image.
+	switch (dc_device_get_type (device)) {
+#ifdef ENABLE_BACKEND_HW
+	case DC_FAMILY_HW_OSTC:
+		return hw_ostc_device_fwupdate_image (device, batch->ostc);
+	case DC_FAMILY_HW_OSTC3:
+		return hw_ostc3_device_fwupdate_image (device, batch->ostc3);
+#endif
+	default:
+		return DC_STATUS_UNSUPPORTED;
+	}
+}
+
+static dc_status_t
+fwupdate_batch (dc_context_t *context, dc_descriptor_t *descriptor, char *names[], unsigned int count, unsigned int jobs, const char *hexfile)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+	dc_session_t *session = NULL;
+	fwupdate_batch_t batch = {names};
+
+	// Parse and decrypt the firmware only once.
+	message ("Loading the firmware.\n");
+	switch (dc_descriptor_get_type (descriptor)) {
+#ifdef ENABLE_BACKEND_HW
+	case DC_FAMILY_HW_OSTC:
+		rc = hw_ostc_firmware_load (&batch.ostc, context, hexfile);
+		break;
+	case DC_FAMILY_HW_OSTC3:
+		rc = hw_ostc3_firmware_load (&batch.ostc3, context, hexfile);
+		break;
+#endif
+	default:
+		rc = DC_STATUS_UNSUPPORTED;
+		break;
+	}
+	if (rc != DC_STATUS_SUCCESS) {
+		ERROR ("Error loading the firmware.");
+		goto cleanup;
+	}
+
+	// Updating a firmware is mostly waiting for the device, so use a
+	// thread for every concurrent update.
+	if (jobs == 0 || jobs > count)
+		jobs = count;
+	dc_context_set_threads (context, jobs - 1);
+
+	rc = dc_session_new (&session, context, jobs);
+	if (rc != DC_STATUS_SUCCESS) {
+		ERROR ("Error creating the session.");
+		goto cleanup;
+	}
+
+	for (unsigned int i = 0; i < count; ++i) {
+		message ("[%s] Adding the device (%s %s).\n", names[i],
+			dc_descriptor_get_vendor (descriptor),
+			dc_descriptor_get_product (descriptor));
+		rc = dc_session_add (session, descriptor, names[i], NULL, 0);
+		if (rc != DC_STATUS_SUCCESS) {
+			ERROR ("Error adding the device.");
+			goto cleanup;
+		}
+	}
+
+	dc_session_set_events (session, DC_EVENT_PROGRESS, fwupdate_event_cb, &batch);
+
+	// Update the firmware.
+	message ("Updating the firmware of %u devices, %u at a time.\n", count, jobs);
+	rc = dc_session_run_custom (session, fwupdate_device_cb, &batch);
+
+	for (unsigned int i = 0; i < count; ++i) {
+		dc_status_t status = DC_STATUS_SUCCESS;
+		dc_session_get_status (session, i, &status);
+		message ("[%s] Finished: %s\n", names[i], dctool_errmsg (status));
+	}
+
+	if (rc != DC_STATUS_SUCCESS) {
+		ERROR ("Error updating the firmware.");
+		goto cleanup;
+	}
+
+cleanup:
+	dc_session_free (session);
+#ifdef ENABLE_BACKEND_HW
+	hw_ostc3_firmware_free (batch.ostc3);
+	hw_ostc_firmware_free (batch.ostc);
+#endif
+	return rc;
+}
+
 static int
 dctool_fwupdate_run (int argc, char *argv[], dc_context_t *context, dc_descriptor_t *descriptor)
 {
@@ -105,15 +219,17 @@ dctool_fwupdate_run (int argc, char *argv[], dc_context_t *context, dc_descripto
 
 	// Default option values.
 	unsigned int help = 0;
+	unsigned int jobs = 0;
 	const char *filename = NULL;
 
 	// Parse the command-line options.
 	int opt = 0;
-	const char *optstring = "hf:";
+	const char *optstring = "hf:j:";
 #ifdef HAVE_GETOPT_LONG
 	struct option options[] = {
 		{"help",        no_argument,       0, 'h'},
 		{"firmware",    required_argument, 0, 'f'},
+		{"jobs",        required_argument, 0, 'j'},
 		{0,             0,                 0,  0 }
 	};
 	while ((opt = getopt_long (argc, argv, optstring, options, NULL)) != -1) {
@@ -124,6 +240,9 @@ dctool_fwupdate_run (int argc, char *argv[], dc_context_t *context, dc_descripto
 		case 'f':
 			filename = optarg;
 			break;
+		case 'j':
+			jobs = strtoul (optarg, NULL, 0);
+			break;
 		case 'h':
 			help = 1;
 			break;
@@ -149,7 +268,11 @@ dctool_fwupdate_run (int argc, char *argv[], dc_context_t *context, dc_descripto
 	}
 
 	// Update the firmware.
-	status = fwupdate (context, descriptor, argv[0], filename);
+	if (argc > 1) {
+		status = fwupdate_batch (context, descriptor, argv, argc, jobs, filename);
+	} else {
+		status = fwupdate (context, descriptor, argv[0], filename);
+	}
 	if (status != DC_STATUS_SUCCESS) {
 		message ("ERROR: %s\n", dctool_errmsg (status));
 		exitcode = EXIT_FAILURE;
@@ -166,14 +289,19 @@ const dctool_command_t dctool_fwupdate = {
 	"fwupdate",
 	"Update the firmware",
 	"Usage:\n"
-	"   dctool fwupdate [options]\n"
+	"   dctool fwupdate [options] [<devname>...]\n"
+	"\n"
+	"With several devices, the firmware is loaded once, and the\n"
+	"devices are updated concurrently.\n"
 	"\n"
 	"Options:\n"
 #ifdef HAVE_GETOPT_LONG
 	"   -h, --help                  Show help message\n"
 	"   -f, --firmware <filename>   Firmware filename\n"
+	"   -j, --jobs <count>          Number of concurrent updates\n"
 #else
 	"   -h              Show help message\n"
 	"   -f <filename>   Firmware filename\n"
+	"   -j <count>      Number of concurrent updates\n"
 #endif
 };
@@ -51,46 +51,69 @@
 
 #include "dctool.h"
 #include "output.h"
+#include "archive.h"
 #include "common.h"
 #include "utils.h"
+#include "filelist.h"
 
 #define REACTPROWHITE 0x4354
 
 static dc_status_t
-parse (dc_buffer_t *buffer, dc_context_t *context, dc_descriptor_t *descriptor, unsigned int devtime, dc_ticks_t systime, dctool_output_t *output)
+parse (dc_parser_t *parser, const unsigned char data[], unsigned int size, const unsigned char fingerprint[], unsigned int fsize, dctool_output_t *output)
 {
 	dc_status_t rc = DC_STATUS_SUCCESS;
-	dc_parser_t *parser = NULL;
-	unsigned char *data = dc_buffer_get_data (buffer);
-	unsigned int size = dc_buffer_get_size (buffer);
-
-	// Create the parser.
-	message ("Creating the parser.\n");
-	rc = dc_parser_new2 (&parser, context, descriptor, devtime, systime);
-	if (rc != DC_STATUS_SUCCESS) {
-		ERROR ("Error creating the parser.");
-		goto cleanup;
-	}
 
 	// Register the data.
 	message ("Registering the data.\n");
 	rc = dc_parser_set_data (parser, data, size);
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR ("Error registering the data.");
-		goto cleanup;
+		return rc;
 	}
 
 	// Parse the dive data.
 	message ("Parsing the dive data.\n");
-	rc = dctool_output_write (output, parser, data, size, NULL, 0);
+	rc = dctool_output_write (output, parser, data, size, fingerprint, fsize);
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR ("Error parsing the dive data.");
-		goto cleanup;
+		return rc;
 	}
 
-cleanup:
-	dc_parser_destroy (parser);
-	return rc;
+	return DC_STATUS_SUCCESS;
+}
+
+static unsigned int
+parse_archive (dc_parser_t *parser, dctool_archive_t *archive, const char *filename, dctool_output_t *output, unsigned int *ndives)
+{
+	dc_family_t family = dc_parser_get_type (parser);
+	unsigned int count = dctool_archive_get_count (archive);
+	unsigned int nerrors = 0;
+
+	for (unsigned int i = 0; i < count; ++i) {
+		const dctool_archive_entry_t *entry = dctool_archive_get_entry (archive, i);
+		const unsigned char *data = NULL;
+		unsigned int size = 0;
+
+		(*ndives)++;
+
+		// Skip the dives of other families.
+		if (entry->family != family) {
+			message ("ERROR: %s: dive %u: Unexpected family %s.\n",
+				filename, i, dctool_family_name (entry->family));
+			nerrors++;
+			continue;
+		}
+
+		dc_status_t status = dctool_archive_get_data (archive, i, &data, &size);
+		if (status == DC_STATUS_SUCCESS)
+			status = parse (parser, data, size, entry->fingerprint, entry->fsize, output);
+		if (status != DC_STATUS_SUCCESS) {
+			message ("ERROR: %s: dive %u: %s\n", filename, i, dctool_errmsg (status));
+			nerrors++;
+		}
+	}
+
+	return nerrors;
 }
 
 static int
@@ -100,22 +123,30 @@ dctool_parse_run (int argc, char *argv[], dc_context_t *context, dc_descriptor_t
 	int exitcode = EXIT_SUCCESS;
 	dc_status_t status = DC_STATUS_SUCCESS;
 	dc_buffer_t *buffer = NULL;
+	dc_parser_t *parser = NULL;
 	dctool_output_t *output = NULL;
+	dctool_filelist_t files = {NULL, 0, 0};
+	unsigned int nerrors = 0;
+	unsigned int ndives = 0;
 	dctool_units_t units = DCTOOL_UNITS_METRIC;
 
 	// Default option values.
 	unsigned int help = 0;
 	const char *filename = NULL;
+	const char *listfile = NULL;
+	const char *format = "xml";
 	unsigned int devtime = 0;
 	dc_ticks_t systime = 0;
 
 	// Parse the command-line options.
 	int opt = 0;
-	const char *optstring = "ho:d:s:u:";
+	const char *optstring = "ho:l:f:d:s:u:";
 #ifdef HAVE_GETOPT_LONG
 	struct option options[] = {
 		{"help",        no_argument,       0, 'h'},
 		{"output",      required_argument, 0, 'o'},
+		{"list",        required_argument, 0, 'l'},
+		{"format",      required_argument, 0, 'f'},
 		{"devtime",     required_argument, 0, 'd'},
 		{"systime",     required_argument, 0, 's'},
 		{"units",       required_argument, 0, 'u'},
@@ -132,6 +163,12 @@ dctool_parse_run (int argc, char *argv[], dc_context_t *context, dc_descriptor_t
 		case 'o':
 			filename = optarg;
 			break;
+		case 'l':
+			listfile = optarg;
+			break;
+		case 'f':
+			format = optarg;
+			break;
 		case 'd':
 			devtime = strtoul (optarg, NULL, 0);
 			break;
@@ -159,28 +196,68 @@ dctool_parse_run (int argc, char *argv[], dc_context_t *context, dc_descriptor_t
 	}
 
 	// Create the output.
-	output = dctool_xml_output_new (filename, units);
+	output = dctool_output_new (format, filename, units, dc_descriptor_get_model (descriptor));
 	if (output == NULL) {
 		message ("Failed to create the output.\n");
 		exitcode = EXIT_FAILURE;
 		goto cleanup;
 	}
 
+	// Collect the input files.
 	for (unsigned int i = 0; i < argc; ++i) {
-		// Read the input file.
-		buffer = dctool_file_read (argv[i]);
-		if (buffer == NULL) {
-			message ("Failed to open the input file.\n");
+		int rc = 0;
+		if (dctool_filelist_is_directory (argv[i]))
+			rc = dctool_filelist_add_directory (&files, argv[i]);
+		else
+			rc = dctool_filelist_add (&files, argv[i], strlen (argv[i]));
+		if (rc != 0) {
+			message ("Failed to read the input directory '%s'.\n", argv[i]);
 			exitcode = EXIT_FAILURE;
 			goto cleanup;
 		}
+	}
+
+	if (listfile && dctool_filelist_add_listfile (&files, listfile) != 0) {
+		message ("Failed to read the input list '%s'.\n", listfile);
+		exitcode = EXIT_FAILURE;
+		goto cleanup;
+	}
+
+	// Create the parser. A single parser is reused for all files.
+	message ("Creating the parser.\n");
+	status = dc_parser_new2 (&parser, context, descriptor, devtime, systime);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR ("Error creating the parser.");
+		message ("ERROR: %s\n", dctool_errmsg (status));
+		exitcode = EXIT_FAILURE;
+		goto cleanup;
+	}
+
+	for (size_t i = 0; i < files.count; ++i) {
+		// Parse all dives of an archive.
+		dctool_archive_t *archive = NULL;
+		status = dctool_archive_open (&archive, files.names[i]);
+		if (status == DC_STATUS_SUCCESS) {
+			nerrors += parse_archive (parser, archive, files.names[i], output, &ndives);
+			dctool_archive_close (archive);
+			continue;
+		}
+
+		ndives++;
+
+		// Read the input file.
+		buffer = dctool_file_read (files.names[i]);
+		if (buffer == NULL) {
+			message ("Failed to open the input file '%s'.\n", files.names[i]);
+			nerrors++;
+			continue;
+		}
 
 		// Parse the dive.
-		status = parse (buffer, context, descriptor, devtime, systime, output);
+		status = parse (parser, dc_buffer_get_data (buffer), dc_buffer_get_size (buffer), NULL, 0, output);
 		if (status != DC_STATUS_SUCCESS) {
-			message ("ERROR: %s\n", dctool_errmsg (status));
-			exitcode = EXIT_FAILURE;
-			goto cleanup;
+			message ("ERROR: %s: %s\n", files.names[i], dctool_errmsg (status));
+			nerrors++;
 		}
 
 		// Cleanup.
@@ -188,8 +265,16 @@ dctool_parse_run (int argc, char *argv[], dc_context_t *context, dc_descriptor_t
 		buffer = NULL;
 	}
 
+	// Keep going when a dive fails, but report the failure.
+	if (nerrors) {
+		message ("Failed to parse %u of %u dives.\n", nerrors, ndives);
+		exitcode = EXIT_FAILURE;
+	}
+
 cleanup:
 	dc_buffer_free (buffer);
+	dc_parser_destroy (parser);
+	dctool_filelist_free (&files);
 	dctool_output_free (output);
 	return exitcode;
 }
@@ -200,18 +285,25 @@ const dctool_command_t dctool_parse = {
 	"parse",
 	"Parse previously downloaded dives",
 	"Usage:\n"
-	"   dctool parse [options] <filename>\n"
+	"   dctool parse [options] <filename|directory> ...\n"
+	"\n"
+	"Each file contains a single raw dive, or an archive with multiple\n"
+	"dives (see the archive output format of dctool download).\n"
 	"\n"
 	"Options:\n"
 #ifdef HAVE_GETOPT_LONG
 	"   -h, --help                 Show help message\n"
 	"   -o, --output <filename>    Output filename\n"
+	"   -l, --list <filename>      Read input filenames from a file (- for stdin)\n"
+	"   -f, --format <format>      Output format (see dctool download)\n"
 	"   -d, --devtime <timestamp>  Device time\n"
 	"   -s, --systime <timestamp>  System time\n"
 	"   -u, --units <units>        Set units (metric or imperial)\n"
 #else
 	"   -h              Show help message\n"
 	"   -o <filename>   Output filename\n"
+	"   -l <filename>   Read input filenames from a file (- for stdin)\n"
+	"   -f <format>     Output format (see dctool download)\n"
 	"   -d <devtime>    Device time\n"
 	"   -s <systime>    System time\n"
 	"   -u <units>      Set units (metric or imperial)\n"
@@ -0,0 +1,577 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef HAVE_GETOPT_H
+#include <getopt.h>
+#endif
+#ifndef _WIN32
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#define HAVE_SERVE
+#endif
+
+#include <libdivecomputer/context.h>
+#include <libdivecomputer/descriptor.h>
+#include <libdivecomputer/device.h>
+#include <libdivecomputer/parser.h>
+#include <libdivecomputer/syncstore.h>
+#include <libdivecomputer/hotplug.h>
+#include <libdivecomputer/session.h>
+
+#include "dctool.h"
+#include "common.h"
+#include "output.h"
+#include "utils.h"
+
+#define POLL_TIMEOUT 250
+
+#ifdef HAVE_SERVE
+typedef struct serve_t serve_t;
+
+typedef struct serve_job_t {
+	struct serve_job_t *next;
+	serve_t *serve;
+	pthread_t thread;
+	dc_session_t *session;
+	char **names;
+	unsigned int count;
+	unsigned int finished;
+} serve_job_t;
+
+struct serve_t {
+	dc_context_t *context;
+	dc_descriptor_t *descriptor;
+	dc_syncstore_t *store;
+	dctool_output_t *output;
+	unsigned int jobs;
+	unsigned int vid, pid;
+	// The mutex protects the output, the dive counter and the list of
+	// running jobs, which are shared with the job threads.
+	pthread_mutex_t mutex;
+	serve_job_t *running;
+	unsigned int number;
+	// The ports added since the last job was started. Only used from
+	// the main thread.
+	char **pending;
+	unsigned int npending;
+};
+
+static void
+serve_names_free (char **names, unsigned int count)
+{
+	for (unsigned int i = 0; i < count; ++i)
+		free (names[i]);
+	free (names);
+}
+
+static int
+serve_is_active (serve_t *serve, const char *name)
+{
+	int active = 0;
+
+	for (unsigned int i = 0; i < serve->npending; ++i) {
+		if (strcmp (serve->pending[i], name) == 0)
+			return 1;
+	}
+
+	pthread_mutex_lock (&serve->mutex);
+	for (serve_job_t *job = serve->running; job && !active; job = job->next) {
+		for (unsigned int i = 0; i < job->count; ++i) {
+			if (!job->finished && strcmp (job->names[i], name) == 0) {
+				active = 1;
+				break;
+			}
+		}
+	}
+	pthread_mutex_unlock (&serve->mutex);
+
+	return active;
+}
+
+static void
+serve_hotplug_cb (dc_hotplug_event_t event, const dc_hotplug_port_t *port, void *userdata)
+{
+	serve_t *serve = (serve_t *) userdata;
+
+	if (event == DC_HOTPLUG_REMOVED) {
+		message ("Removed: %s\n", port->name);
+		return;
+	}
+
+	// Only react to the configured usb device, if any.
+	if ((serve->vid && port->vid != serve->vid) ||
+		(serve->pid && port->pid != serve->pid))
+		return;
+
+	message ("Added: %s (%04x:%04x)\n", port->name, port->vid, port->pid);
+
+	// A device that is still downloading is not started twice.
+	if (serve_is_active (serve, port->name))
+		return;
+
+	char **pending = (char **) realloc (serve->pending, (serve->npending + 1) * sizeof (char *));
+	if (pending == NULL) {
+		ERROR ("Error allocating memory.");
+		return;
+	}
+	serve->pending = pending;
+
+	serve->pending[serve->npending] = strdup (port->name);
+	if (serve->pending[serve->npending] == NULL) {
+		ERROR ("Error allocating memory.");
+		return;
+	}
+	serve->npending++;
+}
+
+static void
+serve_event_cb (unsigned int index, dc_device_t *device, dc_event_type_t event, const void *data, void *userdata)
+{
+	serve_job_t *job = (serve_job_t *) userdata;
+
+	message ("[%s] ", job->names[index]);
+	dctool_event_cb (device, event, data, NULL);
+}
+
+static int
+serve_dive_cb (unsigned int index, dc_device_t *device, const unsigned char *data, unsigned int size, const unsigned char *fingerprint, unsigned int fsize, void *userdata)
+{
+	serve_job_t *job = (serve_job_t *) userdata;
+	serve_t *serve = job->serve;
+	dc_status_t rc = DC_STATUS_SUCCESS;
+	dc_parser_t *parser = NULL;
+
+	// The callbacks of one session never run concurrently, but those of
+	// several sessions do, and they all share the same output.
+	pthread_mutex_lock (&serve->mutex);
+
+	serve->number++;
+
+	message ("[%s] Dive: number=%u, size=%u, fingerprint=", job->names[index], serve->number, size);
+	for (unsigned int i = 0; i < fsize; ++i)
+		message ("%02X", fingerprint[i]);
+	message ("\n");
+
+	rc = dc_parser_new (&parser, device);
+	if (rc != DC_STATUS_SUCCESS) {
+		ERROR ("Error creating the parser.");
+		goto cleanup;
+	}
+
+	rc = dc_parser_set_data (parser, data, size);
+	if (rc != DC_STATUS_SUCCESS) {
+		ERROR ("Error registering the data.");
+		goto cleanup;
+	}
+
+	rc = dctool_output_write (serve->output, parser, data, size, fingerprint, fsize);
+	if (rc != DC_STATUS_SUCCESS) {
+		ERROR ("Error parsing the dive data.");
+		goto cleanup;
+	}
+
+cleanup:
+	pthread_mutex_unlock (&serve->mutex);
+	dc_parser_destroy (parser);
+	return 1;
+}
+
+static void *
+serve_job_run (void *userdata)
+{
+	serve_job_t *job = (serve_job_t *) userdata;
+
+	dc_session_run (job->session, serve_dive_cb, job);
+
+	for (unsigned int i = 0; i < job->count; ++i) {
+		dc_status_t status = DC_STATUS_SUCCESS;
+		dc_session_get_status (job->session, i, &status);
+		message ("[%s] Finished: %s\n", job->names[i], dctool_errmsg (status));
+	}
+
+	pthread_mutex_lock (&job->serve->mutex);
+	job->finished = 1;
+	pthread_mutex_unlock (&job->serve->mutex);
+
+	return NULL;
+}
+
+static void
+serve_job_free (serve_job_t *job)
+{
+	if (job == NULL)
+		return;
+
+	dc_session_free (job->session);
+	serve_names_free (job->names, job->count);
+	free (job);
+}
+
+static dc_status_t
+serve_job_start (serve_t *serve)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+
+	serve_job_t *job = (serve_job_t *) calloc (1, sizeof (serve_job_t));
+	if (job == NULL) {
+		ERROR ("Error allocating memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	// The job takes over the pending ports.
+	job->serve = serve;
+	job->names = serve->pending;
+	job->count = serve->npending;
+	serve->pending = NULL;
+	serve->npending = 0;
+
+	rc = dc_session_new (&job->session, serve->context, serve->jobs);
+	if (rc != DC_STATUS_SUCCESS) {
+		ERROR ("Error creating the session.");
+		goto error;
+	}
+
+	for (unsigned int i = 0; i < job->count; ++i) {
+		message ("[%s] Starting the download (%s %s).\n", job->names[i],
+			dc_descriptor_get_vendor (serve->descriptor),
+			dc_descriptor_get_product (serve->descriptor));
+		rc = dc_session_add (job->session, serve->descriptor, job->names[i], NULL, 0);
+		if (rc != DC_STATUS_SUCCESS) {
+			ERROR ("Error adding the device.");
+			goto error;
+		}
+	}
+
+	int events = DC_EVENT_WAITING | DC_EVENT_DEVINFO | DC_EVENT_CLOCK;
+	dc_session_set_events (job->session, events, serve_event_cb, job);
+
+	if (serve->store) {
+		dc_session_set_syncstore (job->session, serve->store);
+	}
+
+	if (pthread_create (&job->thread, NULL, serve_job_run, job) != 0) {
+		ERROR ("Error starting the download thread.");
+		rc = DC_STATUS_NOMEMORY;
+		goto error;
+	}
+
+	pthread_mutex_lock (&serve->mutex);
+	job->next = serve->running;
+	serve->running = job;
+	pthread_mutex_unlock (&serve->mutex);
+
+	return DC_STATUS_SUCCESS;
+
+error:
+	serve_job_free (job);
+	return rc;
+}
+
+static void
+serve_job_reap (serve_t *serve, int all)
+{
+	serve_job_t *finished = NULL;
+
+	// Unlink the finished jobs, or all of them.
+	pthread_mutex_lock (&serve->mutex);
+	serve_job_t **link = &serve->running;
+	while (*link) {
+		serve_job_t *job = *link;
+		if (all || job->finished) {
+			*link = job->next;
+			job->next = finished;
+			finished = job;
+		} else {
+			link = &job->next;
+		}
+	}
+	pthread_mutex_unlock (&serve->mutex);
+
+	while (finished) {
+		serve_job_t *job = finished;
+		finished = job->next;
+		pthread_join (job->thread, NULL);
+		serve_job_free (job);
+	}
+}
+
+static void
+serve_job_cancel (serve_t *serve)
+{
+	pthread_mutex_lock (&serve->mutex);
+	for (serve_job_t *job = serve->running; job; job = job->next) {
+		dc_session_cancel (job->session);
+	}
+	pthread_mutex_unlock (&serve->mutex);
+}
+
+static dc_status_t
+serve_loop (serve_t *serve)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+	dc_hotplug_t *hotplug = NULL;
+	int fd = -1;
+
+	// Start monitoring. The ports that are present already are reported
+	// as added, and synced right away.
+	rc = dc_hotplug_start (&hotplug, serve->context);
+	if (rc != DC_STATUS_SUCCESS) {
+		ERROR ("Error starting the hotplug monitor.");
+		return rc;
+	}
+
+	// Without a file descriptor, the events are dispatched periodically.
+	if (dc_hotplug_get_fd (hotplug, &fd) != DC_STATUS_SUCCESS)
+		fd = -1;
+
+	message ("Waiting for devices (%s %s).\n",
+		dc_descriptor_get_vendor (serve->descriptor),
+		dc_descriptor_get_product (serve->descriptor));
+
+	while (!dctool_cancel_cb (NULL)) {
+		struct pollfd pfd = {fd, POLLIN, 0};
+		if (poll (&pfd, fd >= 0 ? 1 : 0, POLL_TIMEOUT) < 0)
+			continue;
+
+		rc = dc_hotplug_dispatch (hotplug, serve_hotplug_cb, serve);
+		if (rc != DC_STATUS_SUCCESS) {
+			ERROR ("Error dispatching the hotplug events.");
+			break;
+		}
+
+		// All ports added in the same batch share one session, and
+		// every batch runs concurrently with the others.
+		if (serve->npending) {
+			serve_job_start (serve);
+		}
+
+		serve_job_reap (serve, 0);
+	}
+
+	// Abort the downloads still in progress.
+	serve_job_cancel (serve);
+	serve_job_reap (serve, 1);
+
+	serve_names_free (serve->pending, serve->npending);
+	serve->pending = NULL;
+	serve->npending = 0;
+
+	dc_hotplug_close (hotplug);
+
+	return rc;
+}
+#endif
+
+static int
+dctool_serve_run (int argc, char *argv[], dc_context_t *context, dc_descriptor_t *descriptor)
+{
+	int exitcode = EXIT_SUCCESS;
+#ifdef HAVE_SERVE
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_syncstore_t *store = NULL;
+	dctool_output_t *output = NULL;
+	dctool_units_t units = DCTOOL_UNITS_METRIC;
+#endif
+
+	// Default option values.
+	unsigned int help = 0;
+	const char *filename = NULL;
+	const char *cachedir = NULL;
+	const char *format = "xml";
+	const char *usbid = NULL;
+	unsigned int jobs = 4;
+
+	// Parse the command-line options.
+	int opt = 0;
+	const char *optstring = "ho:c:f:u:j:i:";
+#ifdef HAVE_GETOPT_LONG
+	struct option options[] = {
+		{"help",        no_argument,       0, 'h'},
+		{"output",      required_argument, 0, 'o'},
+		{"cache",       required_argument, 0, 'c'},
+		{"format",      required_argument, 0, 'f'},
+		{"units",       required_argument, 0, 'u'},
+		{"jobs",        required_argument, 0, 'j'},
+		{"id",          required_argument, 0, 'i'},
+		{0,             0,                 0,  0 }
+	};
+	while ((opt = getopt_long (argc, argv, optstring, options, NULL)) != -1) {
+#else
+	while ((opt = getopt (argc, argv, optstring)) != -1) {
+#endif
+		switch (opt) {
+		case 'h':
+			help = 1;
+			break;
+		case 'o':
+			filename = optarg;
+			break;
+		case 'c':
+			cachedir = optarg;
+			break;
+		case 'f':
+			format = optarg;
+			break;
+		case 'u':
+#ifdef HAVE_SERVE
+			if (strcmp (optarg, "metric") == 0)
+				units = DCTOOL_UNITS_METRIC;
+			if (strcmp (optarg, "imperial") == 0)
+				units = DCTOOL_UNITS_IMPERIAL;
+#endif
+			break;
+		case 'j':
+			jobs = strtoul (optarg, NULL, 0);
+			break;
+		case 'i':
+			usbid = optarg;
+			break;
+		default:
+			return EXIT_FAILURE;
+		}
+	}
+
+	// Show help message.
+	if (help) {
+		dctool_command_showhelp (&dctool_serve);
+		return EXIT_SUCCESS;
+	}
+
+#ifdef HAVE_SERVE
+	serve_t data = {0};
+	data.context = context;
+	data.descriptor = descriptor;
+	data.jobs = jobs ? jobs : 1;
+
+	// Parse the usb vendor and product id.
+	if (usbid) {
+		char *end = NULL;
+		data.vid = strtoul (usbid, &end, 16);
+		if (*end == ':')
+			data.pid = strtoul (end + 1, &end, 16);
+		if (*end != 0) {
+			message ("Invalid usb id: %s\n", usbid);
+			return EXIT_FAILURE;
+		}
+	}
+
+	// Create the output. It remains open for all downloads.
+	if (strcasecmp(format, "raw") == 0) {
+		output = dctool_raw_output_new (filename);
+	} else if (strcasecmp(format, "xml") == 0) {
+		output = dctool_xml_output_new (filename, units);
+	} else if (strcasecmp(format, "columnar") == 0) {
+		output = dctool_columnar_output_new (filename);
+	} else if (strcasecmp(format, "json") == 0) {
+		output = dctool_json_output_new (filename, 0);
+	} else if (strcasecmp(format, "json-columns") == 0) {
+		output = dctool_json_output_new (filename, 1);
+	} else if (strcasecmp(format, "archive") == 0) {
+		output = dctool_archive_output_new (filename, dc_descriptor_get_model (descriptor));
+	} else {
+		message ("Unknown output format: %s\n", format);
+		exitcode = EXIT_FAILURE;
+		goto cleanup;
+	}
+	if (output == NULL) {
+		message ("Failed to create the output.\n");
+		exitcode = EXIT_FAILURE;
+		goto cleanup;
+	}
+
+	// Create the sync store. It is shared by all downloads.
+	if (cachedir) {
+		status = dc_syncstore_new (&store, context, cachedir);
+		if (status != DC_STATUS_SUCCESS) {
+			ERROR ("Error creating the fingerprint store.");
+			exitcode = EXIT_FAILURE;
+			goto cleanup;
+		}
+
+		dc_context_set_syncstore (context, store);
+	}
+
+	data.store = store;
+	data.output = output;
+	pthread_mutex_init (&data.mutex, NULL);
+
+	status = serve_loop (&data);
+	pthread_mutex_destroy (&data.mutex);
+	if (status != DC_STATUS_SUCCESS) {
+		message ("ERROR: %s\n", dctool_errmsg (status));
+		exitcode = EXIT_FAILURE;
+		goto cleanup;
+	}
+
+cleanup:
+	dctool_output_free (output);
+	dc_context_set_syncstore (context, NULL);
+	dc_syncstore_free (store);
+#else
+	message ("The serve command is not supported on this system.\n");
+	exitcode = EXIT_FAILURE;
+#endif
+	return exitcode;
+}
+
+const dctool_command_t dctool_serve = {
+	dctool_serve_run,
+	DCTOOL_CONFIG_DESCRIPTOR,
+	"serve",
+	"Download the dives whenever a device is plugged in",
+	"Usage:\n"
+	"   dctool serve [options]\n"
+	"\n"
+	"Options:\n"
+#ifdef HAVE_GETOPT_LONG
+	"   -h, --help                 Show help message\n"
+	"   -o, --output <filename>    Output filename\n"
+	"   -c, --cache <directory>    Cache directory\n"
+	"   -f, --format <format>      Output format\n"
+	"   -u, --units <units>        Set units (metric or imperial)\n"
+	"   -j, --jobs <count>         Number of concurrent downloads\n"
+	"   -i, --id <vid[:pid]>       Only react to this usb device\n"
+#else
+	"   -h                 Show help message\n"
+	"   -o <filename>      Output filename\n"
+	"   -c <directory>     Cache directory\n"
+	"   -f <format>        Output format\n"
+	"   -u <units>         Set units (metric or imperial)\n"
+	"   -j <count>         Number of concurrent downloads\n"
+	"   -i <vid[:pid]>     Only react to this usb device\n"
+#endif
+	"\n"
+	"The serial ports are monitored until the command is interrupted. The\n"
+	"ports that are present at startup, and every port that appears later,\n"
+	"are downloaded with the selected device type. The library context,\n"
+	"the fingerprint store and the output remain open between downloads,\n"
+	"and several devices are downloaded at the same time. The dives of all\n"
+	"devices are written to the same output. See 'dctool help download'\n"
+	"for the supported output formats.\n"
+};
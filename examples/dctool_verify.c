@@ -0,0 +1,383 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef HAVE_GETOPT_H
+#include <getopt.h>
+#endif
+#ifndef _WIN32
+#include <pthread.h>
+#define HAVE_WORKERS
+#endif
+
+#include <libdivecomputer/context.h>
+#include <libdivecomputer/descriptor.h>
+#include <libdivecomputer/device.h>
+#include <libdivecomputer/parser.h>
+
+#include "dctool.h"
+#include "common.h"
+#include "archive.h"
+#include "filelist.h"
+#include "utils.h"
+
+typedef struct verify_t {
+#ifdef HAVE_WORKERS
+	pthread_mutex_t mutex;
+#endif
+	dc_context_t *context;
+	dc_descriptor_t *descriptor;
+	const dctool_filelist_t *files;
+	size_t next;
+	unsigned int dumps;
+	unsigned int ndives;
+	unsigned int nerrors;
+} verify_t;
+
+typedef struct verify_job_t {
+	verify_t *verify;
+	dc_parser_t *parser;
+	const char *filename;
+	unsigned int number;
+	unsigned int ndives;
+	unsigned int nerrors;
+} verify_job_t;
+
+static void
+verify_lock (verify_t *verify)
+{
+#ifdef HAVE_WORKERS
+	pthread_mutex_lock (&verify->mutex);
+#endif
+}
+
+static void
+verify_unlock (verify_t *verify)
+{
+#ifdef HAVE_WORKERS
+	pthread_mutex_unlock (&verify->mutex);
+#endif
+}
+
+static void
+verify_report (verify_job_t *job, unsigned int dive, dc_status_t status)
+{
+	verify_lock (job->verify);
+	if (dive)
+		message ("ERROR: %s: dive %u: %s\n", job->filename, dive - 1, dctool_errmsg (status));
+	else
+		message ("ERROR: %s: %s\n", job->filename, dctool_errmsg (status));
+	verify_unlock (job->verify);
+
+	job->nerrors++;
+}
+
+static int
+verify_dive_cb (const unsigned char *data, unsigned int size, const unsigned char *fingerprint, unsigned int fsize, void *userdata)
+{
+	verify_job_t *job = (verify_job_t *) userdata;
+
+	job->number++;
+	job->ndives++;
+
+	dc_status_t rc = dc_parser_verify (job->parser, data, size);
+	if (rc != DC_STATUS_SUCCESS)
+		verify_report (job, job->number, rc);
+
+	return 1;
+}
+
+static void
+verify_archive (verify_job_t *job, dctool_archive_t *archive)
+{
+	dc_family_t family = dc_parser_get_type (job->parser);
+	unsigned int count = dctool_archive_get_count (archive);
+
+	for (unsigned int i = 0; i < count; ++i) {
+		const dctool_archive_entry_t *entry = dctool_archive_get_entry (archive, i);
+		const unsigned char *data = NULL;
+		unsigned int size = 0;
+
+		job->ndives++;
+
+		if (entry->family != family) {
+			verify_report (job, i + 1, DC_STATUS_DATAFORMAT);
+			continue;
+		}
+
+		// The checksum of the archive entry is verified first.
+		dc_status_t status = dctool_archive_get_data (archive, i, &data, &size);
+		if (status == DC_STATUS_SUCCESS)
+			status = dc_parser_verify (job->parser, data, size);
+		if (status != DC_STATUS_SUCCESS)
+			verify_report (job, i + 1, status);
+	}
+}
+
+static void
+verify_file (verify_job_t *job)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (!job->verify->dumps) {
+		dctool_archive_t *archive = NULL;
+		status = dctool_archive_open (&archive, job->filename);
+		if (status == DC_STATUS_SUCCESS) {
+			verify_archive (job, archive);
+			dctool_archive_close (archive);
+			return;
+		}
+	}
+
+	job->number = 0;
+
+	size_t size = 0;
+	const unsigned char *data = dctool_file_map (job->filename, &size);
+	if (data == NULL) {
+		verify_report (job, 0, DC_STATUS_IO);
+		return;
+	}
+
+	if (size > (unsigned int) -1) {
+		verify_report (job, 0, DC_STATUS_DATAFORMAT);
+	} else if (job->verify->dumps) {
+		status = dc_device_extract_dives (job->verify->descriptor, data, size, verify_dive_cb, job);
+		if (status != DC_STATUS_SUCCESS)
+			verify_report (job, 0, status);
+	} else {
+		job->ndives++;
+		status = dc_parser_verify (job->parser, data, size);
+		if (status != DC_STATUS_SUCCESS)
+			verify_report (job, 0, status);
+	}
+
+	dctool_file_unmap (data, size);
+}
+
+static void *
+verify_worker (void *userdata)
+{
+	verify_t *verify = (verify_t *) userdata;
+	verify_job_t job = {verify, NULL, NULL, 0, 0, 0};
+
+	// Every worker has its own parser.
+	dc_status_t rc = dc_parser_new2 (&job.parser, verify->context, verify->descriptor, 0, 0);
+	if (rc != DC_STATUS_SUCCESS) {
+		verify_lock (verify);
+		message ("ERROR: Failed to create the parser: %s\n", dctool_errmsg (rc));
+		verify->nerrors++;
+		verify_unlock (verify);
+		return NULL;
+	}
+
+	while (1) {
+		// Take the next file from the list.
+		verify_lock (verify);
+		size_t idx = verify->next;
+		if (idx < verify->files->count)
+			verify->next++;
+		verify_unlock (verify);
+		if (idx >= verify->files->count)
+			break;
+
+		job.filename = verify->files->names[idx];
+		verify_file (&job);
+	}
+
+	dc_parser_destroy (job.parser);
+
+	verify_lock (verify);
+	verify->ndives += job.ndives;
+	verify->nerrors += job.nerrors;
+	verify_unlock (verify);
+
+	return NULL;
+}
+
+static int
+dctool_verify_run (int argc, char *argv[], dc_context_t *context, dc_descriptor_t *descriptor)
+{
+	// Default values.
+	int exitcode = EXIT_SUCCESS;
+	dctool_filelist_t files = {NULL, 0, 0};
+
+	// Default option values.
+	unsigned int help = 0;
+	unsigned int dumps = 0;
+	unsigned int jobs = 0;
+	const char *listfile = NULL;
+
+	// Parse the command-line options.
+	int opt = 0;
+	const char *optstring = "hdj:l:";
+#ifdef HAVE_GETOPT_LONG
+	struct option options[] = {
+		{"help",        no_argument,       0, 'h'},
+		{"dump",        no_argument,       0, 'd'},
+		{"jobs",        required_argument, 0, 'j'},
+		{"list",        required_argument, 0, 'l'},
+		{0,             0,                 0,  0 }
+	};
+	while ((opt = getopt_long (argc, argv, optstring, options, NULL)) != -1) {
+#else
+	while ((opt = getopt (argc, argv, optstring)) != -1) {
+#endif
+		switch (opt) {
+		case 'h':
+			help = 1;
+			break;
+		case 'd':
+			dumps = 1;
+			break;
+		case 'j':
+			jobs = strtoul (optarg, NULL, 0);
+			break;
+		case 'l':
+			listfile = optarg;
+			break;
+		default:
+			return EXIT_FAILURE;
+		}
+	}
+
+	argc -= optind;
+	argv += optind;
+
+	// Show help message.
+	if (help) {
+		dctool_command_showhelp (&dctool_verify);
+		return EXIT_SUCCESS;
+	}
+
+	// Collect the input files.
+	for (unsigned int i = 0; i < argc; ++i) {
+		int rc = 0;
+		if (dctool_filelist_is_directory (argv[i]))
+			rc = dctool_filelist_add_directory (&files, argv[i]);
+		else
+			rc = dctool_filelist_add (&files, argv[i], strlen (argv[i]));
+		if (rc != 0) {
+			message ("Failed to read the input directory '%s'.\n", argv[i]);
+			exitcode = EXIT_FAILURE;
+			goto cleanup;
+		}
+	}
+
+	if (listfile && dctool_filelist_add_listfile (&files, listfile) != 0) {
+		message ("Failed to read the input list '%s'.\n", listfile);
+		exitcode = EXIT_FAILURE;
+		goto cleanup;
+	}
+
+	verify_t verify;
+	verify.context = context;
+	verify.descriptor = descriptor;
+	verify.files = &files;
+	verify.next = 0;
+	verify.dumps = dumps;
+	verify.ndives = 0;
+	verify.nerrors = 0;
+
+#ifdef HAVE_WORKERS
+	// Use one worker per processor by default.
+	if (jobs == 0) {
+		long ncpus = sysconf (_SC_NPROCESSORS_ONLN);
+		jobs = ncpus > 0 ? ncpus : 1;
+	}
+	if (jobs > files.count)
+		jobs = files.count;
+
+	pthread_t *threads = NULL;
+	if (jobs > 1) {
+		threads = (pthread_t *) malloc (jobs * sizeof (pthread_t));
+		if (threads == NULL) {
+			message ("Failed to allocate memory.\n");
+			exitcode = EXIT_FAILURE;
+			goto cleanup;
+		}
+	}
+
+	pthread_mutex_init (&verify.mutex, NULL);
+
+	// The current thread is the last worker, and no threads are started
+	// for a single job.
+	unsigned int nthreads = 0;
+	while (nthreads + 1 < jobs) {
+		if (pthread_create (&threads[nthreads], NULL, verify_worker, &verify) != 0)
+			break;
+		nthreads++;
+	}
+
+	verify_worker (&verify);
+
+	for (unsigned int i = 0; i < nthreads; ++i)
+		pthread_join (threads[i], NULL);
+
+	pthread_mutex_destroy (&verify.mutex);
+	free (threads);
+#else
+	verify_worker (&verify);
+#endif
+
+	message ("Verified %u files, %u dives, %u errors.\n",
+		(unsigned int) files.count, verify.ndives, verify.nerrors);
+
+	if (verify.nerrors)
+		exitcode = EXIT_FAILURE;
+
+cleanup:
+	dctool_filelist_free (&files);
+	return exitcode;
+}
+
+const dctool_command_t dctool_verify = {
+	dctool_verify_run,
+	DCTOOL_CONFIG_DESCRIPTOR,
+	"verify",
+	"Verify the integrity of previously downloaded data",
+	"Usage:\n"
+	"   dctool verify [options] <filename|directory> ...\n"
+	"\n"
+	"Each file contains a single raw dive, an archive with multiple dives,\n"
+	"or with the dump option, a memory dump (see dctool dump). Only the\n"
+	"checksums and the structure of the data are checked, without parsing\n"
+	"the samples.\n"
+	"\n"
+	"Options:\n"
+#ifdef HAVE_GETOPT_LONG
+	"   -h, --help                 Show help message\n"
+	"   -d, --dump                 The files are memory dumps\n"
+	"   -j, --jobs <count>         Number of files verified in parallel\n"
+	"   -l, --list <filename>      Read input filenames from a file (- for stdin)\n"
+#else
+	"   -h              Show help message\n"
+	"   -d              The files are memory dumps\n"
+	"   -j <count>      Number of files verified in parallel\n"
+	"   -l <filename>   Read input filenames from a file (- for stdin)\n"
+#endif
+};
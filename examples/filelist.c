@@ -0,0 +1,183 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#endif
+
+#include "filelist.h"
+
+int
+dctool_filelist_add (dctool_filelist_t *list, const char *name, size_t length)
+{
+	if (list->count >= list->capacity) {
+		size_t capacity = list->capacity ? list->capacity * 2 : 64;
+		char **names = (char **) realloc (list->names, capacity * sizeof (char *));
+		if (names == NULL)
+			return -1;
+		list->names = names;
+		list->capacity = capacity;
+	}
+
+	char *copy = (char *) malloc (length + 1);
+	if (copy == NULL)
+		return -1;
+	memcpy (copy, name, length);
+	copy[length] = 0;
+
+	list->names[list->count++] = copy;
+
+	return 0;
+}
+
+void
+dctool_filelist_free (dctool_filelist_t *list)
+{
+	for (size_t i = 0; i < list->count; ++i)
+		free (list->names[i]);
+	free (list->names);
+}
+
+static int
+dctool_filelist_compare (const void *a, const void *b)
+{
+	return strcmp (*(char * const *) a, *(char * const *) b);
+}
+
+static int
+dctool_filelist_add_path (dctool_filelist_t *list, const char *dirname, const char *name)
+{
+	char path[1024];
+
+	int n = snprintf (path, sizeof (path), "%s/%s", dirname, name);
+	if (n < 0 || (size_t) n >= sizeof (path))
+		return -1;
+
+	return dctool_filelist_add (list, path, n);
+}
+
+int
+dctool_filelist_add_directory (dctool_filelist_t *list, const char *dirname)
+{
+	size_t first = list->count;
+
+#ifdef _WIN32
+	char pattern[1024];
+	WIN32_FIND_DATAA entry;
+
+	int n = snprintf (pattern, sizeof (pattern), "%s\\*", dirname);
+	if (n < 0 || (size_t) n >= sizeof (pattern))
+		return -1;
+
+	HANDLE handle = FindFirstFileA (pattern, &entry);
+	if (handle == INVALID_HANDLE_VALUE)
+		return -1;
+
+	do {
+		if (entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			continue;
+		if (dctool_filelist_add_path (list, dirname, entry.cFileName) != 0) {
+			FindClose (handle);
+			return -1;
+		}
+	} while (FindNextFileA (handle, &entry));
+
+	FindClose (handle);
+#else
+	DIR *dir = opendir (dirname);
+	if (dir == NULL)
+		return -1;
+
+	struct dirent *entry = NULL;
+	while ((entry = readdir (dir)) != NULL) {
+		if (entry->d_name[0] == '.')
+			continue;
+		if (dctool_filelist_add_path (list, dirname, entry->d_name) != 0) {
+			closedir (dir);
+			return -1;
+		}
+	}
+
+	closedir (dir);
+#endif
+
+	// Process the files in a predictable order.
+	qsort (list->names + first, list->count - first, sizeof (char *), dctool_filelist_compare);
+
+	return 0;
+}
+
+int
+dctool_filelist_is_directory (const char *name)
+{
+#ifdef _WIN32
+	DWORD attributes = GetFileAttributesA (name);
+	return attributes != INVALID_FILE_ATTRIBUTES &&
+		(attributes & FILE_ATTRIBUTE_DIRECTORY);
+#else
+	struct stat st;
+	return stat (name, &st) == 0 && S_ISDIR (st.st_mode);
+#endif
+}
+
+int
+dctool_filelist_add_listfile (dctool_filelist_t *list, const char *filename)
+{
+	char line[1024];
+	FILE *fp = NULL;
+
+	if (strcmp (filename, "-") == 0) {
+		fp = stdin;
+	} else {
+		fp = fopen (filename, "r");
+		if (fp == NULL)
+			return -1;
+	}
+
+	while (fgets (line, sizeof (line), fp) != NULL) {
+		size_t length = strlen (line);
+		while (length && (line[length - 1] == '\n' || line[length - 1] == '\r'))
+			length--;
+		if (length == 0)
+			continue;
+		if (dctool_filelist_add (list, line, length) != 0) {
+			if (fp != stdin)
+				fclose (fp);
+			return -1;
+		}
+	}
+
+	if (fp != stdin)
+		fclose (fp);
+
+	return 0;
+}
@@ -0,0 +1,63 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DCTOOL_FILELIST_H
+#define DCTOOL_FILELIST_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+typedef struct dctool_filelist_t {
+	char **names;
+	size_t count;
+	size_t capacity;
+} dctool_filelist_t;
+
+int
+dctool_filelist_add (dctool_filelist_t *list, const char *name, size_t length);
+
+/*
+ * Add all regular files of a directory, sorted by name, to process them
+ * in a predictable order. Hidden files are skipped.
+ */
+int
+dctool_filelist_add_directory (dctool_filelist_t *list, const char *dirname);
+
+/*
+ * Add the names listed in a text file, one per line, or read from the
+ * standard input for "-".
+ */
+int
+dctool_filelist_add_listfile (dctool_filelist_t *list, const char *filename);
+
+int
+dctool_filelist_is_directory (const char *name);
+
+void
+dctool_filelist_free (dctool_filelist_t *list);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DCTOOL_FILELIST_H */
@@ -44,6 +44,20 @@ struct dctool_output_vtable_t {
 	dc_status_t (*write) (dctool_output_t *output, dc_parser_t *parser, const unsigned char data[], unsigned int size, const unsigned char fingerprint[], unsigned int fsize);
 
 	dc_status_t (*free) (dctool_output_t *output);
+
+	/*
+	 * Optional split of the write function for the outputs with the
+	 * samples: the part before the samples, the sample callback (with
+	 * the output as userdata) and the part after them. The end function
+	 * is always called, also when a previous step failed, and returns
+	 * the final status. This allows several outputs to share a single
+	 * pass over the samples.
+	 */
+	dc_status_t (*begin) (dctool_output_t *output, dc_parser_t *parser, const unsigned char data[], unsigned int size, const unsigned char fingerprint[], unsigned int fsize);
+
+	dc_sample_callback_t sample;
+
+	dc_status_t (*end) (dctool_output_t *output, dc_status_t status);
 };
 
 dctool_output_t *
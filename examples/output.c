@@ -20,9 +20,34 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 
 #include "output-private.h"
+#include "utils.h"
+
+#define MAXOUTPUTS 8
+
+/*
+ * Copy the next element of a comma separated list, and return the rest
+ * of the list, or NULL if the element doesn't fit.
+ */
+static const char *
+list_next (const char *list, char buffer[], size_t size)
+{
+	size_t length = strcspn (list, ",");
+	if (length >= size)
+		return NULL;
+
+	memcpy (buffer, list, length);
+	buffer[length] = 0;
+
+	list += length;
+	if (*list == ',')
+		list++;
+
+	return list;
+}
 
 dctool_output_t *
 dctool_output_allocate (const dctool_output_vtable_t *vtable)
@@ -50,15 +75,105 @@ dctool_output_deallocate (dctool_output_t *output)
 	free (output);
 }
 
+dctool_output_t *
+dctool_output_new (const char *format, const char *filename, dctool_units_t units, unsigned int model)
+{
+	dctool_output_t *outputs[MAXOUTPUTS];
+	unsigned int count = 0;
+
+	while (1) {
+		if (count >= MAXOUTPUTS) {
+			message ("Too many output formats.\n");
+			goto error;
+		}
+
+		// Take the next format and filename from the lists.
+		char fmt[32], name[1024];
+		const char *next = list_next (format, fmt, sizeof (fmt));
+		const char *nextname = filename ? list_next (filename, name, sizeof (name)) : NULL;
+		if (next == NULL || (filename && nextname == NULL)) {
+			message ("Invalid output format or filename.\n");
+			goto error;
+		}
+
+		dctool_output_t *output = NULL;
+		const char *fname = filename ? name : NULL;
+		if (strcasecmp (fmt, "raw") == 0) {
+			output = dctool_raw_output_new (fname);
+		} else if (strcasecmp (fmt, "xml") == 0) {
+			output = dctool_xml_output_new (fname, units);
+		} else if (strcasecmp (fmt, "columnar") == 0) {
+			output = dctool_columnar_output_new (fname);
+		} else if (strcasecmp (fmt, "json") == 0) {
+			output = dctool_json_output_new (fname, 0);
+		} else if (strcasecmp (fmt, "json-columns") == 0) {
+			output = dctool_json_output_new (fname, 1);
+		} else if (strcasecmp (fmt, "archive") == 0) {
+			output = dctool_archive_output_new (fname, model);
+		} else {
+			message ("Unknown output format: %s\n", fmt);
+			goto error;
+		}
+		if (output == NULL)
+			goto error;
+		outputs[count++] = output;
+
+		format = next;
+		filename = nextname;
+		if (*format == 0)
+			break;
+		if (filename && *filename == 0) {
+			message ("Missing output filename for format %s.\n", format);
+			goto error;
+		}
+	}
+
+	if (filename && *filename) {
+		message ("Too many output filenames.\n");
+		goto error;
+	}
+
+	if (count == 1)
+		return outputs[0];
+
+	dctool_output_t *output = dctool_multi_output_new (outputs, count);
+	if (output == NULL)
+		goto error;
+
+	return output;
+
+error:
+	for (unsigned int i = 0; i < count; ++i)
+		dctool_output_free (outputs[i]);
+	return NULL;
+}
+
 dc_status_t
 dctool_output_write (dctool_output_t *output, dc_parser_t *parser, const unsigned char data[], unsigned int size, const unsigned char fingerprint[], unsigned int fsize)
 {
-	if (output == NULL || output->vtable->write == NULL)
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (output == NULL)
 		return DC_STATUS_SUCCESS;
 
 	output->number++;
 
-	return output->vtable->write (output, parser, data, size, fingerprint, fsize);
+	if (output->vtable->write)
+		return output->vtable->write (output, parser, data, size, fingerprint, fsize);
+
+	if (output->vtable->begin == NULL)
+		return DC_STATUS_SUCCESS;
+
+	status = output->vtable->begin (output, parser, data, size, fingerprint, fsize);
+	if (status == DC_STATUS_SUCCESS) {
+		message ("Parsing the sample data.\n");
+		status = dc_parser_samples_foreach (parser, output->vtable->sample, output);
+		if (status != DC_STATUS_SUCCESS) {
+			ERROR ("Error parsing the sample data.");
+		}
+	}
+
+	return output->vtable->end (output, status);
 }
 
 dc_status_t
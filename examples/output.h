@@ -42,6 +42,31 @@ dctool_xml_output_new (const char *filename, dctool_units_t units);
 dctool_output_t *
 dctool_raw_output_new (const char *template);
 
+dctool_output_t *
+dctool_columnar_output_new (const char *filename);
+
+dctool_output_t *
+dctool_archive_output_new (const char *filename, unsigned int model);
+
+dctool_output_t *
+dctool_json_output_new (const char *filename, unsigned int columns);
+
+/*
+ * Combine several outputs, which receive every dive in the order of the
+ * array, with a single pass over the samples for all of them. The
+ * outputs are owned by the combined output.
+ */
+dctool_output_t *
+dctool_multi_output_new (dctool_output_t *outputs[], unsigned int count);
+
+/*
+ * Create the output for a format (see dctool download), or a combined
+ * output for a comma separated list of formats. The filename is then a
+ * comma separated list as well, with a filename for every format.
+ */
+dctool_output_t *
+dctool_output_new (const char *format, const char *filename, dctool_units_t units, unsigned int model);
+
 dc_status_t
 dctool_output_write (dctool_output_t *output, dc_parser_t *parser, const unsigned char data[], unsigned int size, const unsigned char fingerprint[], unsigned int fsize);
 
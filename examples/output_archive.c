@@ -0,0 +1,117 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "output-private.h"
+#include "archive.h"
+#include "utils.h"
+
+static dc_status_t dctool_archive_output_write (dctool_output_t *output, dc_parser_t *parser, const unsigned char data[], unsigned int size, const unsigned char fingerprint[], unsigned int fsize);
+static dc_status_t dctool_archive_output_free (dctool_output_t *output);
+
+typedef struct dctool_archive_output_t {
+	dctool_output_t base;
+	dctool_archive_t *archive;
+	unsigned int model;
+} dctool_archive_output_t;
+
+static const dctool_output_vtable_t archive_vtable = {
+	sizeof(dctool_archive_output_t), /* size */
+	dctool_archive_output_write, /* write */
+	dctool_archive_output_free, /* free */
+	NULL, /* begin */
+	NULL, /* sample */
+	NULL, /* end */
+};
+
+dctool_output_t *
+dctool_archive_output_new (const char *filename, unsigned int model)
+{
+	dctool_archive_output_t *output = NULL;
+
+	if (filename == NULL)
+		goto error_exit;
+
+	// Allocate memory.
+	output = (dctool_archive_output_t *) dctool_output_allocate (&archive_vtable);
+	if (output == NULL) {
+		goto error_exit;
+	}
+
+	output->model = model;
+
+	// Open the archive, and append to it if it already exists.
+	dc_status_t rc = dctool_archive_create (&output->archive, filename, 1);
+	if (rc != DC_STATUS_SUCCESS) {
+		ERROR ("Failed to open the archive.");
+		goto error_free;
+	}
+
+	return (dctool_output_t *) output;
+
+error_free:
+	dctool_output_deallocate ((dctool_output_t *) output);
+error_exit:
+	return NULL;
+}
+
+static dc_status_t
+dctool_archive_output_write (dctool_output_t *abstract, dc_parser_t *parser, const unsigned char data[], unsigned int size, const unsigned char fingerprint[], unsigned int fsize)
+{
+	dctool_archive_output_t *output = (dctool_archive_output_t *) abstract;
+	dctool_archive_entry_t entry;
+
+	memset (&entry, 0, sizeof (entry));
+	entry.family = dc_parser_get_type (parser);
+	entry.model = output->model;
+
+	// The datetime is only informational. Store the raw data anyway if
+	// it can't be parsed.
+	if (dc_parser_get_datetime (parser, &entry.datetime) != DC_STATUS_SUCCESS)
+		memset (&entry.datetime, 0, sizeof (entry.datetime));
+
+	if (fsize > sizeof (entry.fingerprint)) {
+		ERROR ("Fingerprint too large.");
+		return DC_STATUS_INVALIDARGS;
+	}
+	if (fsize)
+		memcpy (entry.fingerprint, fingerprint, fsize);
+	entry.fsize = fsize;
+
+	dc_status_t rc = dctool_archive_append (output->archive, &entry, data, size);
+	if (rc != DC_STATUS_SUCCESS) {
+		ERROR ("Failed to write the archive.");
+		return rc;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dctool_archive_output_free (dctool_output_t *abstract)
+{
+	dctool_archive_output_t *output = (dctool_archive_output_t *) abstract;
+
+	return dctool_archive_close (output->archive);
+}
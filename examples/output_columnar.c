@@ -0,0 +1,429 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+/*
+ * All values are stored in little endian byte order.
+ *
+ * The file starts with an 8 byte header: the magic "DCCF" and a 32 bit
+ * version number. The dives follow, and the file ends with an index and a
+ * 16 byte trailer: the 64 bit offset of the index, the 32 bit number of
+ * dives and the magic "DCCX". Each index entry is 16 bytes: the 64 bit
+ * offset and the 32 bit size of the dive, and 4 reserved bytes. Any dive
+ * can be located by reading only the trailer and its index entry.
+ *
+ * Each dive starts with a fixed 64 byte header:
+ *
+ *    0  number (u32)
+ *    4  raw data size (u32)
+ *    8  year (u16), month, day, hour, minute, second (u8), reserved (u8)
+ *   16  divetime in seconds (u32)
+ *   20  maximum depth in millimeters (s32)
+ *   24  number of sample rows (u32)
+ *   28  number of columns (u32)
+ *   32  column directory: count (u32) and size in bytes (u32) per column
+ *
+ * The column data follows the header, in the order of the directory:
+ * time, depth, temperature and pressure. Every time sample starts a new
+ * row. The time column holds one entry per row, with the difference to
+ * the previous time in seconds. The other columns hold an entry for
+ * each sample, with the difference to the row of the previous entry and
+ * the difference to the value of the previous entry. The pressure
+ * entries store the tank number between those two fields. Depths are in
+ * millimeters, temperatures in hundredths of a degree Celsius and
+ * pressures in hundredths of a bar. All numbers in the columns are
+ * variable length integers with 7 bits per byte, and the value
+ * differences are zigzag encoded.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+#include <libdivecomputer/buffer.h>
+
+#include "output-private.h"
+#include "utils.h"
+
+#define VERSION 1
+
+#define SZ_HEADER  8
+#define SZ_TRAILER 16
+#define SZ_DIVE    64
+#define SZ_INDEX   16
+
+#define COLUMN_TIME        0
+#define COLUMN_DEPTH       1
+#define COLUMN_TEMPERATURE 2
+#define COLUMN_PRESSURE    3
+#define NCOLUMNS           4
+
+static dc_status_t dctool_columnar_output_begin (dctool_output_t *output, dc_parser_t *parser, const unsigned char data[], unsigned int size, const unsigned char fingerprint[], unsigned int fsize);
+static void dctool_columnar_output_sample (dc_sample_type_t type, dc_sample_value_t value, void *userdata);
+static dc_status_t dctool_columnar_output_end (dctool_output_t *output, dc_status_t status);
+static dc_status_t dctool_columnar_output_free (dctool_output_t *output);
+
+typedef struct column_t {
+	dc_buffer_t *buffer;
+	unsigned int count;
+	unsigned int row;
+	long value;
+} column_t;
+
+typedef struct dctool_columnar_output_t {
+	dctool_output_t base;
+	FILE *ostream;
+	unsigned long long offset;
+	dc_buffer_t *index;
+	unsigned int ndives;
+	column_t columns[NCOLUMNS];
+	unsigned int nrows;
+	int error;
+	// Header of the current dive.
+	unsigned int size;
+	dc_datetime_t datetime;
+	unsigned int divetime;
+	double maxdepth;
+} dctool_columnar_output_t;
+
+static const dctool_output_vtable_t columnar_vtable = {
+	sizeof(dctool_columnar_output_t), /* size */
+	NULL, /* write */
+	dctool_columnar_output_free, /* free */
+	dctool_columnar_output_begin, /* begin */
+	dctool_columnar_output_sample, /* sample */
+	dctool_columnar_output_end, /* end */
+};
+
+static void
+put_u16 (unsigned char data[], unsigned int value)
+{
+	data[0] = value & 0xFF;
+	data[1] = (value >> 8) & 0xFF;
+}
+
+static void
+put_u32 (unsigned char data[], unsigned int value)
+{
+	for (unsigned int i = 0; i < 4; ++i)
+		data[i] = (value >> (8 * i)) & 0xFF;
+}
+
+static void
+put_u64 (unsigned char data[], unsigned long long value)
+{
+	for (unsigned int i = 0; i < 8; ++i)
+		data[i] = (value >> (8 * i)) & 0xFF;
+}
+
+static void
+column_varint (dctool_columnar_output_t *output, column_t *column, unsigned long value)
+{
+	unsigned char data[10];
+	unsigned int n = 0;
+
+	while (value >= 0x80) {
+		data[n++] = (value & 0x7F) | 0x80;
+		value >>= 7;
+	}
+	data[n++] = value;
+
+	if (!dc_buffer_append (column->buffer, data, n))
+		output->error = 1;
+}
+
+static void
+column_append (dctool_columnar_output_t *output, column_t *column, long value)
+{
+	long delta = value - column->value;
+	unsigned long zigzag = delta < 0 ?
+		~((unsigned long) delta << 1) : (unsigned long) delta << 1;
+
+	column_varint (output, column, zigzag);
+
+	column->value = value;
+	column->count++;
+}
+
+static void
+column_row (dctool_columnar_output_t *output, column_t *column)
+{
+	unsigned int row = output->nrows ? output->nrows - 1 : 0;
+
+	column_varint (output, column, row - column->row);
+
+	column->row = row;
+}
+
+static void
+column_reset (column_t *column)
+{
+	dc_buffer_clear (column->buffer);
+	column->count = 0;
+	column->row = 0;
+	column->value = 0;
+}
+
+static long
+fixed (double value, double scale)
+{
+	return lround (value * scale);
+}
+
+static void
+dctool_columnar_output_sample (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
+{
+	dctool_columnar_output_t *output = (dctool_columnar_output_t *) userdata;
+	column_t *column = NULL;
+
+	switch (type) {
+	case DC_SAMPLE_TIME:
+		output->nrows++;
+		column_append (output, &output->columns[COLUMN_TIME], value.time);
+		break;
+	case DC_SAMPLE_DEPTH:
+		column = &output->columns[COLUMN_DEPTH];
+		column_row (output, column);
+		column_append (output, column, fixed (value.depth, 1000.0));
+		break;
+	case DC_SAMPLE_TEMPERATURE:
+		column = &output->columns[COLUMN_TEMPERATURE];
+		column_row (output, column);
+		column_append (output, column, fixed (value.temperature, 100.0));
+		break;
+	case DC_SAMPLE_PRESSURE:
+		column = &output->columns[COLUMN_PRESSURE];
+		column_row (output, column);
+		column_varint (output, column, value.pressure.tank);
+		column_append (output, column, fixed (value.pressure.value, 100.0));
+		break;
+	default:
+		break;
+	}
+}
+
+static int
+output_write (dctool_columnar_output_t *output, const void *data, size_t size)
+{
+	if (size && fwrite (data, 1, size, output->ostream) != size)
+		return -1;
+
+	output->offset += size;
+
+	return 0;
+}
+
+dctool_output_t *
+dctool_columnar_output_new (const char *filename)
+{
+	dctool_columnar_output_t *output = NULL;
+	unsigned char header[SZ_HEADER] = {'D', 'C', 'C', 'F'};
+
+	if (filename == NULL)
+		goto error_exit;
+
+	// Allocate memory.
+	output = (dctool_columnar_output_t *) dctool_output_allocate (&columnar_vtable);
+	if (output == NULL) {
+		goto error_exit;
+	}
+
+	output->offset = 0;
+	output->ndives = 0;
+	output->nrows = 0;
+	output->error = 0;
+	output->index = dc_buffer_new (0);
+	for (unsigned int i = 0; i < NCOLUMNS; ++i) {
+		output->columns[i].buffer = dc_buffer_new (0);
+		column_reset (&output->columns[i]);
+	}
+
+	if (output->index == NULL) {
+		goto error_free;
+	}
+
+	for (unsigned int i = 0; i < NCOLUMNS; ++i) {
+		if (output->columns[i].buffer == NULL)
+			goto error_free;
+	}
+
+	// Open the output file.
+	output->ostream = fopen (filename, "wb");
+	if (output->ostream == NULL) {
+		goto error_free;
+	}
+
+	put_u32 (header + 4, VERSION);
+	if (output_write (output, header, sizeof (header)) != 0) {
+		goto error_close;
+	}
+
+	return (dctool_output_t *) output;
+
+error_close:
+	fclose (output->ostream);
+error_free:
+	for (unsigned int i = 0; i < NCOLUMNS; ++i)
+		dc_buffer_free (output->columns[i].buffer);
+	dc_buffer_free (output->index);
+	dctool_output_deallocate ((dctool_output_t *) output);
+error_exit:
+	return NULL;
+}
+
+static dc_status_t
+dctool_columnar_output_begin (dctool_output_t *abstract, dc_parser_t *parser, const unsigned char data[], unsigned int size, const unsigned char fingerprint[], unsigned int fsize)
+{
+	dctool_columnar_output_t *output = (dctool_columnar_output_t *) abstract;
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	// Reset the columns.
+	for (unsigned int i = 0; i < NCOLUMNS; ++i)
+		column_reset (&output->columns[i]);
+	output->nrows = 0;
+	output->error = 0;
+	output->size = size;
+
+	// Parse the datetime.
+	message ("Parsing the datetime.\n");
+	dc_datetime_t dt = {0};
+	status = dc_parser_get_datetime (parser, &dt);
+	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+		ERROR ("Error parsing the datetime.");
+		return status;
+	}
+	output->datetime = dt;
+
+	// Parse the divetime.
+	message ("Parsing the divetime.\n");
+	unsigned int divetime = 0;
+	status = dc_parser_get_field (parser, DC_FIELD_DIVETIME, 0, &divetime);
+	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+		ERROR ("Error parsing the divetime.");
+		return status;
+	}
+	output->divetime = divetime;
+
+	// Parse the maxdepth.
+	message ("Parsing the maxdepth.\n");
+	double maxdepth = 0.0;
+	status = dc_parser_get_field (parser, DC_FIELD_MAXDEPTH, 0, &maxdepth);
+	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+		ERROR ("Error parsing the maxdepth.");
+		return status;
+	}
+	output->maxdepth = maxdepth;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dctool_columnar_output_end (dctool_output_t *abstract, dc_status_t status)
+{
+	dctool_columnar_output_t *output = (dctool_columnar_output_t *) abstract;
+	const dc_datetime_t *dt = &output->datetime;
+	unsigned char header[SZ_DIVE] = {0};
+	unsigned char entry[SZ_INDEX] = {0};
+
+	// A failed dive is not written at all.
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	if (output->error) {
+		ERROR ("Insufficient buffer space available.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	// Build the dive header.
+	put_u32 (header + 0, abstract->number);
+	put_u32 (header + 4, output->size);
+	put_u16 (header + 8, dt->year);
+	header[10] = dt->month;
+	header[11] = dt->day;
+	header[12] = dt->hour;
+	header[13] = dt->minute;
+	header[14] = dt->second;
+	put_u32 (header + 16, output->divetime);
+	put_u32 (header + 20, (unsigned int) fixed (output->maxdepth, 1000.0));
+	put_u32 (header + 24, output->nrows);
+	put_u32 (header + 28, NCOLUMNS);
+
+	unsigned int length = SZ_DIVE;
+	for (unsigned int i = 0; i < NCOLUMNS; ++i) {
+		unsigned int nbytes = dc_buffer_get_size (output->columns[i].buffer);
+		put_u32 (header + 32 + i * 8, output->columns[i].count);
+		put_u32 (header + 36 + i * 8, nbytes);
+		length += nbytes;
+	}
+
+	// Add the index entry.
+	put_u64 (entry + 0, output->offset);
+	put_u32 (entry + 8, length);
+	if (!dc_buffer_append (output->index, entry, sizeof (entry))) {
+		ERROR ("Insufficient buffer space available.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	// Write the dive.
+	int rc = output_write (output, header, sizeof (header));
+	for (unsigned int i = 0; i < NCOLUMNS && rc == 0; ++i) {
+		rc = output_write (output,
+			dc_buffer_get_data (output->columns[i].buffer),
+			dc_buffer_get_size (output->columns[i].buffer));
+	}
+	if (rc != 0) {
+		ERROR ("Failed to write the output file.");
+		dc_buffer_slice (output->index, 0, dc_buffer_get_size (output->index) - sizeof (entry));
+		return DC_STATUS_IO;
+	}
+
+	output->ndives++;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dctool_columnar_output_free (dctool_output_t *abstract)
+{
+	dctool_columnar_output_t *output = (dctool_columnar_output_t *) abstract;
+	dc_status_t status = DC_STATUS_SUCCESS;
+	unsigned char trailer[SZ_TRAILER] = {0};
+
+	// Write the index and the trailer.
+	put_u64 (trailer + 0, output->offset);
+	put_u32 (trailer + 8, output->ndives);
+	memcpy (trailer + 12, "DCCX", 4);
+
+	if (output_write (output, dc_buffer_get_data (output->index), dc_buffer_get_size (output->index)) != 0 ||
+		output_write (output, trailer, sizeof (trailer)) != 0) {
+		ERROR ("Failed to write the output file.");
+		status = DC_STATUS_IO;
+	}
+
+	if (fclose (output->ostream) != 0)
+		status = DC_STATUS_IO;
+
+	for (unsigned int i = 0; i < NCOLUMNS; ++i)
+		dc_buffer_free (output->columns[i].buffer);
+	dc_buffer_free (output->index);
+
+	return status;
+}
@@ -0,0 +1,888 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+#include <libdivecomputer/buffer.h>
+
+#include "output-private.h"
+#include "writer.h"
+#include "utils.h"
+
+#define C_ARRAY_SIZE(array) (sizeof (array) / sizeof *(array))
+
+#define NTANKS 32
+
+#define SAMPLE_TIME        0x0001
+#define SAMPLE_DEPTH       0x0002
+#define SAMPLE_TEMPERATURE 0x0004
+#define SAMPLE_RBT         0x0008
+#define SAMPLE_HEARTBEAT   0x0010
+#define SAMPLE_BEARING     0x0020
+#define SAMPLE_SETPOINT    0x0040
+#define SAMPLE_PPO2        0x0080
+#define SAMPLE_CNS         0x0100
+#define SAMPLE_DECO        0x0200
+#define SAMPLE_GASMIX      0x0400
+
+static dc_status_t dctool_json_output_begin (dctool_output_t *output, dc_parser_t *parser, const unsigned char data[], unsigned int size, const unsigned char fingerprint[], unsigned int fsize);
+static void dctool_json_output_sample (dc_sample_type_t type, dc_sample_value_t value, void *userdata);
+static dc_status_t dctool_json_output_end (dctool_output_t *output, dc_status_t status);
+static dc_status_t dctool_json_output_free (dctool_output_t *output);
+
+typedef struct row_t {
+	unsigned int present;
+	unsigned int tanks;
+	unsigned int time;
+	double depth;
+	double temperature;
+	double pressure[NTANKS];
+	unsigned int rbt;
+	unsigned int heartbeat;
+	unsigned int bearing;
+	double setpoint;
+	double ppo2;
+	double cns;
+	unsigned int decotype;
+	unsigned int decotime;
+	double decodepth;
+	unsigned int gasmix;
+} row_t;
+
+typedef struct event_t {
+	unsigned int row;
+	unsigned int type;
+	unsigned int time;
+	unsigned int flags;
+	unsigned int value;
+} event_t;
+
+typedef struct dctool_json_output_t {
+	dctool_output_t base;
+	FILE *ostream;
+	unsigned int columns;
+	dc_buffer_t *rows;
+	dc_buffer_t *events;
+	dc_buffer_t *vendor;
+	row_t row;
+	unsigned int nrows;
+	unsigned int samples;
+	int error;
+	dctool_writer_t writer;
+} dctool_json_output_t;
+
+static const dctool_output_vtable_t json_vtable = {
+	sizeof(dctool_json_output_t), /* size */
+	NULL, /* write */
+	dctool_json_output_free, /* free */
+	dctool_json_output_begin, /* begin */
+	dctool_json_output_sample, /* sample */
+	dctool_json_output_end, /* end */
+};
+
+static const char *g_events[] = {
+	"none", "deco", "rbt", "ascent", "ceiling", "workload", "transmitter",
+	"violation", "bookmark", "surface", "safety stop", "gaschange",
+	"safety stop (voluntary)", "safety stop (mandatory)", "deepstop",
+	"ceiling (safety stop)", "floor", "divetime", "maxdepth",
+	"OLF", "PO2", "airtime", "rgbm", "heading", "tissue level warning",
+	"gaschange2"};
+
+static const char *g_decostop[] = {
+	"ndl", "safety", "deco", "deep"};
+
+static void
+json_string (dctool_writer_t *writer, const char *str)
+{
+	static const char hex[] = "0123456789abcdef";
+	const char *begin = str;
+
+	dctool_writer_puts (writer, "\"");
+	for (const char *p = str; *p; ++p) {
+		unsigned char c = *p;
+		if (c >= 0x20 && c != '"' && c != '\\')
+			continue;
+
+		dctool_writer_write (writer, begin, p - begin);
+		if (c == '"') {
+			dctool_writer_puts (writer, "\\\"");
+		} else if (c == '\\') {
+			dctool_writer_puts (writer, "\\\\");
+		} else {
+			char escape[] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0x0F]};
+			dctool_writer_write (writer, escape, sizeof (escape));
+		}
+		begin = p + 1;
+	}
+	dctool_writer_puts (writer, begin);
+	dctool_writer_puts (writer, "\"");
+}
+
+static void
+json_number (dctool_writer_t *writer, double value, unsigned int decimals)
+{
+	if (isfinite (value))
+		dctool_writer_fixed (writer, value, decimals);
+	else
+		dctool_writer_puts (writer, "null");
+}
+
+static void
+json_key (dctool_writer_t *writer, const char *key, unsigned int *count)
+{
+	if ((*count)++)
+		dctool_writer_puts (writer, ",");
+	dctool_writer_puts (writer, "\"");
+	dctool_writer_puts (writer, key);
+	dctool_writer_puts (writer, "\":");
+}
+
+static void
+json_event (dctool_writer_t *writer, const event_t *event, int row)
+{
+	const char *name = event->type < C_ARRAY_SIZE(g_events) ? g_events[event->type] : "unknown";
+
+	dctool_writer_puts (writer, "{");
+	if (row) {
+		dctool_writer_puts (writer, "\"row\":");
+		dctool_writer_uint (writer, event->row, 1);
+		dctool_writer_puts (writer, ",");
+	}
+	dctool_writer_puts (writer, "\"type\":");
+	dctool_writer_uint (writer, event->type, 1);
+	dctool_writer_puts (writer, ",\"time\":");
+	dctool_writer_uint (writer, event->time, 1);
+	dctool_writer_puts (writer, ",\"flags\":");
+	dctool_writer_uint (writer, event->flags, 1);
+	dctool_writer_puts (writer, ",\"value\":");
+	dctool_writer_uint (writer, event->value, 1);
+	dctool_writer_puts (writer, ",\"name\":");
+	json_string (writer, name);
+	dctool_writer_puts (writer, "}");
+}
+
+static void
+json_row (dctool_json_output_t *output, const row_t *row)
+{
+	dctool_writer_t *writer = &output->writer;
+	unsigned int count = 0;
+
+	if (output->nrows)
+		dctool_writer_puts (writer, ",");
+
+	dctool_writer_puts (writer, "{");
+	if (row->present & SAMPLE_TIME) {
+		json_key (writer, "time", &count);
+		dctool_writer_uint (writer, row->time, 1);
+	}
+	if (row->present & SAMPLE_DEPTH) {
+		json_key (writer, "depth", &count);
+		json_number (writer, row->depth, 2);
+	}
+	if (row->present & SAMPLE_TEMPERATURE) {
+		json_key (writer, "temperature", &count);
+		json_number (writer, row->temperature, 2);
+	}
+	if (row->tanks) {
+		unsigned int n = 0;
+		json_key (writer, "pressure", &count);
+		dctool_writer_puts (writer, "[");
+		for (unsigned int i = 0; i < NTANKS; ++i) {
+			if ((row->tanks & (1u << i)) == 0)
+				continue;
+			dctool_writer_puts (writer, n++ ? ",{\"tank\":" : "{\"tank\":");
+			dctool_writer_uint (writer, i, 1);
+			dctool_writer_puts (writer, ",\"value\":");
+			json_number (writer, row->pressure[i], 2);
+			dctool_writer_puts (writer, "}");
+		}
+		dctool_writer_puts (writer, "]");
+	}
+	if (row->present & SAMPLE_RBT) {
+		json_key (writer, "rbt", &count);
+		dctool_writer_uint (writer, row->rbt, 1);
+	}
+	if (row->present & SAMPLE_HEARTBEAT) {
+		json_key (writer, "heartbeat", &count);
+		dctool_writer_uint (writer, row->heartbeat, 1);
+	}
+	if (row->present & SAMPLE_BEARING) {
+		json_key (writer, "bearing", &count);
+		dctool_writer_uint (writer, row->bearing, 1);
+	}
+	if (row->present & SAMPLE_SETPOINT) {
+		json_key (writer, "setpoint", &count);
+		json_number (writer, row->setpoint, 2);
+	}
+	if (row->present & SAMPLE_PPO2) {
+		json_key (writer, "ppo2", &count);
+		json_number (writer, row->ppo2, 2);
+	}
+	if (row->present & SAMPLE_CNS) {
+		json_key (writer, "cns", &count);
+		json_number (writer, row->cns * 100.0, 1);
+	}
+	if (row->present & SAMPLE_DECO) {
+		json_key (writer, "deco", &count);
+		dctool_writer_puts (writer, "{\"type\":");
+		json_string (writer, row->decotype < C_ARRAY_SIZE(g_decostop) ? g_decostop[row->decotype] : "unknown");
+		dctool_writer_puts (writer, ",\"time\":");
+		dctool_writer_uint (writer, row->decotime, 1);
+		dctool_writer_puts (writer, ",\"depth\":");
+		json_number (writer, row->decodepth, 2);
+		dctool_writer_puts (writer, "}");
+	}
+	if (row->present & SAMPLE_GASMIX) {
+		json_key (writer, "gasmix", &count);
+		dctool_writer_uint (writer, row->gasmix, 1);
+	}
+
+	// Events.
+	const event_t *events = (const event_t *) dc_buffer_get_data (output->events);
+	size_t nevents = dc_buffer_get_size (output->events) / sizeof (event_t);
+	if (nevents) {
+		json_key (writer, "events", &count);
+		dctool_writer_puts (writer, "[");
+		for (size_t i = 0; i < nevents; ++i) {
+			if (i)
+				dctool_writer_puts (writer, ",");
+			json_event (writer, events + i, 0);
+		}
+		dctool_writer_puts (writer, "]");
+	}
+
+	// Vendor data, stored as a type, a size and the raw bytes.
+	const unsigned char *vendor = dc_buffer_get_data (output->vendor);
+	size_t nvendor = dc_buffer_get_size (output->vendor);
+	if (nvendor) {
+		size_t offset = 0;
+		json_key (writer, "vendor", &count);
+		dctool_writer_puts (writer, "[");
+		while (offset + 2 * sizeof (unsigned int) <= nvendor) {
+			unsigned int header[2];
+			memcpy (header, vendor + offset, sizeof (header));
+			offset += sizeof (header);
+			dctool_writer_puts (writer, offset > sizeof (header) ? ",{\"type\":" : "{\"type\":");
+			dctool_writer_uint (writer, header[0], 1);
+			dctool_writer_puts (writer, ",\"data\":\"");
+			dctool_writer_hex (writer, vendor + offset, header[1]);
+			dctool_writer_puts (writer, "\"}");
+			offset += header[1];
+		}
+		dctool_writer_puts (writer, "]");
+	}
+
+	dctool_writer_puts (writer, "}");
+}
+
+static void
+sample_flush (dctool_json_output_t *output)
+{
+	row_t *row = &output->row;
+
+	if (row->present == 0 && row->tanks == 0 &&
+		dc_buffer_get_size (output->events) == 0 &&
+		dc_buffer_get_size (output->vendor) == 0)
+		return;
+
+	if (output->columns) {
+		// Keep the row for the columns, which are written at the end.
+		if (!dc_buffer_append (output->rows, (const unsigned char *) row, sizeof (row_t)))
+			output->error = 1;
+	} else {
+		json_row (output, row);
+		dc_buffer_clear (output->events);
+		dc_buffer_clear (output->vendor);
+	}
+
+	output->nrows++;
+
+	memset (row, 0, sizeof (row_t));
+}
+
+static void
+dctool_json_output_sample (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
+{
+	dctool_json_output_t *output = (dctool_json_output_t *) userdata;
+	row_t *row = &output->row;
+	event_t event = {0};
+	unsigned int header[2];
+
+	switch (type) {
+	case DC_SAMPLE_TIME:
+		sample_flush (output);
+		row->present |= SAMPLE_TIME;
+		row->time = value.time;
+		break;
+	case DC_SAMPLE_DEPTH:
+		row->present |= SAMPLE_DEPTH;
+		row->depth = value.depth;
+		break;
+	case DC_SAMPLE_PRESSURE:
+		if (value.pressure.tank >= NTANKS) {
+			WARNING ("Tank number out of range.");
+			break;
+		}
+		row->tanks |= 1u << value.pressure.tank;
+		row->pressure[value.pressure.tank] = value.pressure.value;
+		break;
+	case DC_SAMPLE_TEMPERATURE:
+		row->present |= SAMPLE_TEMPERATURE;
+		row->temperature = value.temperature;
+		break;
+	case DC_SAMPLE_EVENT:
+		if (value.event.type == SAMPLE_EVENT_GASCHANGE || value.event.type == SAMPLE_EVENT_GASCHANGE2)
+			break;
+		event.row = output->nrows;
+		event.type = value.event.type;
+		event.time = value.event.time;
+		event.flags = value.event.flags;
+		event.value = value.event.value;
+		if (!dc_buffer_append (output->events, (const unsigned char *) &event, sizeof (event)))
+			output->error = 1;
+		break;
+	case DC_SAMPLE_RBT:
+		row->present |= SAMPLE_RBT;
+		row->rbt = value.rbt;
+		break;
+	case DC_SAMPLE_HEARTBEAT:
+		row->present |= SAMPLE_HEARTBEAT;
+		row->heartbeat = value.heartbeat;
+		break;
+	case DC_SAMPLE_BEARING:
+		row->present |= SAMPLE_BEARING;
+		row->bearing = value.bearing;
+		break;
+	case DC_SAMPLE_VENDOR:
+		// The vendor data is only valid during the callback.
+		if (output->columns)
+			break;
+		header[0] = value.vendor.type;
+		header[1] = value.vendor.size;
+		if (!dc_buffer_append (output->vendor, (const unsigned char *) header, sizeof (header)) ||
+			!dc_buffer_append (output->vendor, (const unsigned char *) value.vendor.data, value.vendor.size))
+			output->error = 1;
+		break;
+	case DC_SAMPLE_SETPOINT:
+		row->present |= SAMPLE_SETPOINT;
+		row->setpoint = value.setpoint;
+		break;
+	case DC_SAMPLE_PPO2:
+		row->present |= SAMPLE_PPO2;
+		row->ppo2 = value.ppo2;
+		break;
+	case DC_SAMPLE_CNS:
+		row->present |= SAMPLE_CNS;
+		row->cns = value.cns;
+		break;
+	case DC_SAMPLE_DECO:
+		row->present |= SAMPLE_DECO;
+		row->decotype = value.deco.type;
+		row->decotime = value.deco.time;
+		row->decodepth = value.deco.depth;
+		break;
+	case DC_SAMPLE_GASMIX:
+		row->present |= SAMPLE_GASMIX;
+		row->gasmix = value.gasmix;
+		break;
+	default:
+		break;
+	}
+}
+
+static void
+json_column (dctool_json_output_t *output, const char *key, unsigned int mask, unsigned int *count)
+{
+	dctool_writer_t *writer = &output->writer;
+	const row_t *rows = (const row_t *) dc_buffer_get_data (output->rows);
+	unsigned int present = 0;
+
+	for (unsigned int i = 0; i < output->nrows; ++i)
+		present |= rows[i].present;
+	if ((present & mask) == 0)
+		return;
+
+	json_key (writer, key, count);
+	dctool_writer_puts (writer, "[");
+	for (unsigned int i = 0; i < output->nrows; ++i) {
+		const row_t *row = rows + i;
+		if (i)
+			dctool_writer_puts (writer, ",");
+		if ((row->present & mask) == 0) {
+			dctool_writer_puts (writer, "null");
+			continue;
+		}
+		switch (mask) {
+		case SAMPLE_TIME:
+			dctool_writer_uint (writer, row->time, 1);
+			break;
+		case SAMPLE_DEPTH:
+			json_number (writer, row->depth, 2);
+			break;
+		case SAMPLE_TEMPERATURE:
+			json_number (writer, row->temperature, 2);
+			break;
+		case SAMPLE_RBT:
+			dctool_writer_uint (writer, row->rbt, 1);
+			break;
+		case SAMPLE_HEARTBEAT:
+			dctool_writer_uint (writer, row->heartbeat, 1);
+			break;
+		case SAMPLE_BEARING:
+			dctool_writer_uint (writer, row->bearing, 1);
+			break;
+		case SAMPLE_SETPOINT:
+			json_number (writer, row->setpoint, 2);
+			break;
+		case SAMPLE_PPO2:
+			json_number (writer, row->ppo2, 2);
+			break;
+		case SAMPLE_CNS:
+			json_number (writer, row->cns * 100.0, 1);
+			break;
+		case SAMPLE_GASMIX:
+			dctool_writer_uint (writer, row->gasmix, 1);
+			break;
+		default:
+			dctool_writer_puts (writer, "null");
+			break;
+		}
+	}
+	dctool_writer_puts (writer, "]");
+}
+
+static void
+json_columns (dctool_json_output_t *output)
+{
+	dctool_writer_t *writer = &output->writer;
+	const row_t *rows = (const row_t *) dc_buffer_get_data (output->rows);
+	unsigned int count = 0;
+
+	dctool_writer_puts (writer, "{");
+
+	json_column (output, "time", SAMPLE_TIME, &count);
+	json_column (output, "depth", SAMPLE_DEPTH, &count);
+	json_column (output, "temperature", SAMPLE_TEMPERATURE, &count);
+
+	// One column per tank.
+	unsigned int tanks = 0;
+	for (unsigned int i = 0; i < output->nrows; ++i)
+		tanks |= rows[i].tanks;
+	if (tanks) {
+		unsigned int n = 0;
+		json_key (writer, "pressure", &count);
+		dctool_writer_puts (writer, "[");
+		for (unsigned int t = 0; t < NTANKS; ++t) {
+			if ((tanks & (1u << t)) == 0)
+				continue;
+			dctool_writer_puts (writer, n++ ? ",{\"tank\":" : "{\"tank\":");
+			dctool_writer_uint (writer, t, 1);
+			dctool_writer_puts (writer, ",\"values\":[");
+			for (unsigned int i = 0; i < output->nrows; ++i) {
+				if (i)
+					dctool_writer_puts (writer, ",");
+				if (rows[i].tanks & (1u << t))
+					json_number (writer, rows[i].pressure[t], 2);
+				else
+					dctool_writer_puts (writer, "null");
+			}
+			dctool_writer_puts (writer, "]}");
+		}
+		dctool_writer_puts (writer, "]");
+	}
+
+	json_column (output, "rbt", SAMPLE_RBT, &count);
+	json_column (output, "heartbeat", SAMPLE_HEARTBEAT, &count);
+	json_column (output, "bearing", SAMPLE_BEARING, &count);
+	json_column (output, "setpoint", SAMPLE_SETPOINT, &count);
+	json_column (output, "ppo2", SAMPLE_PPO2, &count);
+	json_column (output, "cns", SAMPLE_CNS, &count);
+	json_column (output, "gasmix", SAMPLE_GASMIX, &count);
+
+	// The events refer to their row.
+	const event_t *events = (const event_t *) dc_buffer_get_data (output->events);
+	size_t nevents = dc_buffer_get_size (output->events) / sizeof (event_t);
+	if (nevents) {
+		json_key (writer, "events", &count);
+		dctool_writer_puts (writer, "[");
+		for (size_t i = 0; i < nevents; ++i) {
+			if (i)
+				dctool_writer_puts (writer, ",");
+			json_event (writer, events + i, 1);
+		}
+		dctool_writer_puts (writer, "]");
+	}
+
+	dctool_writer_puts (writer, "}");
+}
+
+dctool_output_t *
+dctool_json_output_new (const char *filename, unsigned int columns)
+{
+	dctool_json_output_t *output = NULL;
+
+	if (filename == NULL)
+		goto error_exit;
+
+	// Allocate memory.
+	output = (dctool_json_output_t *) dctool_output_allocate (&json_vtable);
+	if (output == NULL) {
+		goto error_exit;
+	}
+
+	output->columns = columns;
+	output->rows = dc_buffer_new (0);
+	output->events = dc_buffer_new (0);
+	output->vendor = dc_buffer_new (0);
+	if (output->rows == NULL || output->events == NULL || output->vendor == NULL) {
+		goto error_free;
+	}
+
+	// Open the output file.
+	output->ostream = fopen (filename, "w");
+	if (output->ostream == NULL) {
+		goto error_free;
+	}
+
+	dctool_writer_init (&output->writer, output->ostream);
+
+	return (dctool_output_t *) output;
+
+error_free:
+	dc_buffer_free (output->vendor);
+	dc_buffer_free (output->events);
+	dc_buffer_free (output->rows);
+	dctool_output_deallocate ((dctool_output_t *) output);
+error_exit:
+	return NULL;
+}
+
+static dc_status_t
+dctool_json_output_begin (dctool_output_t *abstract, dc_parser_t *parser, const unsigned char data[], unsigned int size, const unsigned char fingerprint[], unsigned int fsize)
+{
+	dctool_json_output_t *output = (dctool_json_output_t *) abstract;
+	dctool_writer_t *writer = &output->writer;
+	dc_status_t status = DC_STATUS_SUCCESS;
+	unsigned int count = 0;
+
+	// Reset the sample data.
+	memset (&output->row, 0, sizeof (row_t));
+	dc_buffer_clear (output->rows);
+	dc_buffer_clear (output->events);
+	dc_buffer_clear (output->vendor);
+	output->nrows = 0;
+	output->samples = 0;
+	output->error = 0;
+
+	dctool_writer_puts (writer, "{");
+
+	json_key (writer, "number", &count);
+	dctool_writer_uint (writer, abstract->number, 1);
+	json_key (writer, "size", &count);
+	dctool_writer_uint (writer, size, 1);
+
+	if (fingerprint) {
+		json_key (writer, "fingerprint", &count);
+		dctool_writer_puts (writer, "\"");
+		dctool_writer_hex (writer, fingerprint, fsize);
+		dctool_writer_puts (writer, "\"");
+	}
+
+	// Parse the datetime.
+	message ("Parsing the datetime.\n");
+	dc_datetime_t dt = {0};
+	status = dc_parser_get_datetime (parser, &dt);
+	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+		ERROR ("Error parsing the datetime.");
+		return status;
+	}
+
+	char datetime[32];
+	snprintf (datetime, sizeof (datetime), "%04i-%02i-%02iT%02i:%02i:%02i",
+		dt.year, dt.month, dt.day,
+		dt.hour, dt.minute, dt.second);
+	json_key (writer, "datetime", &count);
+	json_string (writer, datetime);
+
+	// Parse the divetime.
+	message ("Parsing the divetime.\n");
+	unsigned int divetime = 0;
+	status = dc_parser_get_field (parser, DC_FIELD_DIVETIME, 0, &divetime);
+	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+		ERROR ("Error parsing the divetime.");
+		return status;
+	}
+
+	json_key (writer, "divetime", &count);
+	dctool_writer_uint (writer, divetime, 1);
+
+	// Parse the maxdepth.
+	message ("Parsing the maxdepth.\n");
+	double maxdepth = 0.0;
+	status = dc_parser_get_field (parser, DC_FIELD_MAXDEPTH, 0, &maxdepth);
+	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+		ERROR ("Error parsing the maxdepth.");
+		return status;
+	}
+
+	json_key (writer, "maxdepth", &count);
+	json_number (writer, maxdepth, 2);
+
+	// Parse the temperature.
+	message ("Parsing the temperature.\n");
+	unsigned int ntemperatures = 0;
+	for (unsigned int i = 0; i < 3; ++i) {
+		dc_field_type_t fields[] = {DC_FIELD_TEMPERATURE_SURFACE,
+			DC_FIELD_TEMPERATURE_MINIMUM,
+			DC_FIELD_TEMPERATURE_MAXIMUM};
+		const char *names[] = {"surface", "minimum", "maximum"};
+
+		double temperature = 0.0;
+		status = dc_parser_get_field (parser, fields[i], 0, &temperature);
+		if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+			ERROR ("Error parsing the temperature.");
+			if (ntemperatures)
+				dctool_writer_puts (writer, "}");
+			return status;
+		}
+
+		if (status != DC_STATUS_UNSUPPORTED) {
+			if (ntemperatures == 0) {
+				json_key (writer, "temperature", &count);
+				dctool_writer_puts (writer, "{");
+			}
+			json_key (writer, names[i], &ntemperatures);
+			json_number (writer, temperature, 1);
+		}
+	}
+	if (ntemperatures)
+		dctool_writer_puts (writer, "}");
+
+	// Parse the gas mixes.
+	message ("Parsing the gas mixes.\n");
+	unsigned int ngases = 0;
+	status = dc_parser_get_field (parser, DC_FIELD_GASMIX_COUNT, 0, &ngases);
+	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+		ERROR ("Error parsing the gas mix count.");
+		return status;
+	}
+
+	if (ngases) {
+		json_key (writer, "gasmixes", &count);
+		dctool_writer_puts (writer, "[");
+	}
+	for (unsigned int i = 0; i < ngases; ++i) {
+		dc_gasmix_t gasmix = {0};
+		status = dc_parser_get_field (parser, DC_FIELD_GASMIX, i, &gasmix);
+		if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+			ERROR ("Error parsing the gas mix.");
+			dctool_writer_puts (writer, "]");
+			return status;
+		}
+
+		dctool_writer_puts (writer, i ? ",{\"he\":" : "{\"he\":");
+		json_number (writer, gasmix.helium * 100.0, 1);
+		dctool_writer_puts (writer, ",\"o2\":");
+		json_number (writer, gasmix.oxygen * 100.0, 1);
+		dctool_writer_puts (writer, ",\"n2\":");
+		json_number (writer, gasmix.nitrogen * 100.0, 1);
+		dctool_writer_puts (writer, "}");
+	}
+	if (ngases)
+		dctool_writer_puts (writer, "]");
+
+	// Parse the tanks.
+	message ("Parsing the tanks.\n");
+	unsigned int ntanks = 0;
+	status = dc_parser_get_field (parser, DC_FIELD_TANK_COUNT, 0, &ntanks);
+	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+		ERROR ("Error parsing the tank count.");
+		return status;
+	}
+
+	if (ntanks) {
+		json_key (writer, "tanks", &count);
+		dctool_writer_puts (writer, "[");
+	}
+	for (unsigned int i = 0; i < ntanks; ++i) {
+		const char *names[] = {"none", "metric", "imperial"};
+
+		dc_tank_t tank = {0};
+		status = dc_parser_get_field (parser, DC_FIELD_TANK, i, &tank);
+		if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+			ERROR ("Error parsing the tank.");
+			dctool_writer_puts (writer, "]");
+			return status;
+		}
+
+		dctool_writer_puts (writer, i ? ",{" : "{");
+		if (tank.gasmix != DC_GASMIX_UNKNOWN) {
+			dctool_writer_puts (writer, "\"gasmix\":");
+			dctool_writer_uint (writer, tank.gasmix, 1);
+			dctool_writer_puts (writer, ",");
+		}
+		if (tank.type != DC_TANKVOLUME_NONE) {
+			dctool_writer_puts (writer, "\"type\":");
+			json_string (writer, names[tank.type]);
+			dctool_writer_puts (writer, ",\"volume\":");
+			json_number (writer, tank.volume, 1);
+			dctool_writer_puts (writer, ",\"workpressure\":");
+			json_number (writer, tank.workpressure, 2);
+			dctool_writer_puts (writer, ",");
+		}
+		dctool_writer_puts (writer, "\"beginpressure\":");
+		json_number (writer, tank.beginpressure, 2);
+		dctool_writer_puts (writer, ",\"endpressure\":");
+		json_number (writer, tank.endpressure, 2);
+		dctool_writer_puts (writer, "}");
+	}
+	if (ntanks)
+		dctool_writer_puts (writer, "]");
+
+	// Parse the dive mode.
+	message ("Parsing the dive mode.\n");
+	dc_divemode_t divemode = DC_DIVEMODE_OC;
+	status = dc_parser_get_field (parser, DC_FIELD_DIVEMODE, 0, &divemode);
+	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+		ERROR ("Error parsing the dive mode.");
+		return status;
+	}
+
+	if (status != DC_STATUS_UNSUPPORTED) {
+		const char *names[] = {"freedive", "gauge", "oc", "cc"};
+		json_key (writer, "divemode", &count);
+		json_string (writer, names[divemode]);
+	}
+
+	// Parse the salinity.
+	message ("Parsing the salinity.\n");
+	dc_salinity_t salinity = {DC_WATER_FRESH, 0.0};
+	status = dc_parser_get_field (parser, DC_FIELD_SALINITY, 0, &salinity);
+	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+		ERROR ("Error parsing the salinity.");
+		return status;
+	}
+
+	if (status != DC_STATUS_UNSUPPORTED) {
+		json_key (writer, "salinity", &count);
+		dctool_writer_puts (writer, "{\"type\":");
+		dctool_writer_uint (writer, salinity.type, 1);
+		dctool_writer_puts (writer, ",\"density\":");
+		json_number (writer, salinity.density, 1);
+		dctool_writer_puts (writer, "}");
+	}
+
+	// Parse the atmospheric pressure.
+	message ("Parsing the atmospheric pressure.\n");
+	double atmospheric = 0.0;
+	status = dc_parser_get_field (parser, DC_FIELD_ATMOSPHERIC, 0, &atmospheric);
+	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+		ERROR ("Error parsing the atmospheric pressure.");
+		return status;
+	}
+
+	if (status != DC_STATUS_UNSUPPORTED) {
+		json_key (writer, "atmospheric", &count);
+		json_number (writer, atmospheric, 5);
+	}
+
+	message ("Parsing strings.\n");
+	unsigned int nstrings = 0;
+	for (unsigned int i = 0; i < 100; ++i) {
+		dc_field_string_t str = { NULL };
+		status = dc_parser_get_field (parser, DC_FIELD_STRING, i, &str);
+		if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+			ERROR ("Error parsing strings");
+			if (nstrings)
+				dctool_writer_puts (writer, "]");
+			return status;
+		}
+		if (status == DC_STATUS_UNSUPPORTED)
+			break;
+		if (!str.desc || !str.value)
+			break;
+		if (nstrings++ == 0) {
+			json_key (writer, "extradata", &count);
+			dctool_writer_puts (writer, "[");
+		} else {
+			dctool_writer_puts (writer, ",");
+		}
+		dctool_writer_puts (writer, "{\"key\":");
+		json_string (writer, str.desc);
+		dctool_writer_puts (writer, ",\"value\":");
+		json_string (writer, str.value);
+		dctool_writer_puts (writer, "}");
+	}
+	if (nstrings)
+		dctool_writer_puts (writer, "]");
+
+	// Start the sample data.
+	json_key (writer, "samples", &count);
+	if (!output->columns)
+		dctool_writer_puts (writer, "[");
+	output->samples = 1;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dctool_json_output_end (dctool_output_t *abstract, dc_status_t status)
+{
+	dctool_json_output_t *output = (dctool_json_output_t *) abstract;
+	dctool_writer_t *writer = &output->writer;
+
+	if (output->samples) {
+		sample_flush (output);
+		if (output->columns)
+			json_columns (output);
+		else
+			dctool_writer_puts (writer, "]");
+
+		if (status == DC_STATUS_SUCCESS && output->error) {
+			ERROR ("Insufficient buffer space available.");
+			status = DC_STATUS_NOMEMORY;
+		}
+	}
+
+	dctool_writer_puts (writer, "}\n");
+	dctool_writer_flush (writer);
+
+	return status;
+}
+
+static dc_status_t
+dctool_json_output_free (dctool_output_t *abstract)
+{
+	dctool_json_output_t *output = (dctool_json_output_t *) abstract;
+
+	dctool_writer_flush (&output->writer);
+
+	fclose (output->ostream);
+
+	dc_buffer_free (output->vendor);
+	dc_buffer_free (output->events);
+	dc_buffer_free (output->rows);
+
+	return DC_STATUS_SUCCESS;
+}
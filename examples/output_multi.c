@@ -0,0 +1,136 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+
+#include "output-private.h"
+#include "utils.h"
+
+#define MAXOUTPUTS 8
+
+static dc_status_t dctool_multi_output_write (dctool_output_t *output, dc_parser_t *parser, const unsigned char data[], unsigned int size, const unsigned char fingerprint[], unsigned int fsize);
+static dc_status_t dctool_multi_output_free (dctool_output_t *output);
+
+typedef struct dctool_multi_output_t {
+	dctool_output_t base;
+	dctool_output_t *outputs[MAXOUTPUTS];
+	unsigned int count;
+} dctool_multi_output_t;
+
+static const dctool_output_vtable_t multi_vtable = {
+	sizeof(dctool_multi_output_t), /* size */
+	dctool_multi_output_write, /* write */
+	dctool_multi_output_free, /* free */
+	NULL, /* begin */
+	NULL, /* sample */
+	NULL, /* end */
+};
+
+dctool_output_t *
+dctool_multi_output_new (dctool_output_t *outputs[], unsigned int count)
+{
+	dctool_multi_output_t *output = NULL;
+
+	if (outputs == NULL || count == 0 || count > MAXOUTPUTS)
+		return NULL;
+
+	// Allocate memory.
+	output = (dctool_multi_output_t *) dctool_output_allocate (&multi_vtable);
+	if (output == NULL) {
+		return NULL;
+	}
+
+	for (unsigned int i = 0; i < count; ++i)
+		output->outputs[i] = outputs[i];
+	output->count = count;
+
+	return (dctool_output_t *) output;
+}
+
+static dc_status_t
+dctool_multi_output_write (dctool_output_t *abstract, dc_parser_t *parser, const unsigned char data[], unsigned int size, const unsigned char fingerprint[], unsigned int fsize)
+{
+	dctool_multi_output_t *output = (dctool_multi_output_t *) abstract;
+	dc_status_t status[MAXOUTPUTS];
+	dc_sample_sink_t sinks[MAXOUTPUTS];
+	unsigned int nsinks = 0;
+
+	// Write everything up to the samples, and collect the sample
+	// callbacks of the outputs which got that far.
+	for (unsigned int i = 0; i < output->count; ++i) {
+		dctool_output_t *o = output->outputs[i];
+		o->number = abstract->number;
+		status[i] = DC_STATUS_SUCCESS;
+		if (o->vtable->write) {
+			status[i] = o->vtable->write (o, parser, data, size, fingerprint, fsize);
+		} else if (o->vtable->begin) {
+			status[i] = o->vtable->begin (o, parser, data, size, fingerprint, fsize);
+			if (status[i] == DC_STATUS_SUCCESS) {
+				sinks[nsinks].type = DC_SAMPLE_SINK_CALLBACK;
+				sinks[nsinks].callback = o->vtable->sample;
+				sinks[nsinks].userdata = o;
+				sinks[nsinks].columns = NULL;
+				sinks[nsinks].fixed = NULL;
+				nsinks++;
+			}
+		}
+	}
+
+	// Decode the samples once for all outputs.
+	dc_status_t rc = DC_STATUS_SUCCESS;
+	if (nsinks) {
+		message ("Parsing the sample data.\n");
+		rc = dc_parser_samples_fanout (parser, sinks, nsinks);
+		if (rc != DC_STATUS_SUCCESS) {
+			ERROR ("Error parsing the sample data.");
+		}
+	}
+
+	// Finish the outputs, and report the first error.
+	dc_status_t result = DC_STATUS_SUCCESS;
+	for (unsigned int i = 0; i < output->count; ++i) {
+		dctool_output_t *o = output->outputs[i];
+		if (o->vtable->write == NULL && o->vtable->begin) {
+			if (status[i] == DC_STATUS_SUCCESS)
+				status[i] = rc;
+			status[i] = o->vtable->end (o, status[i]);
+		}
+		if (result == DC_STATUS_SUCCESS)
+			result = status[i];
+	}
+
+	return result;
+}
+
+static dc_status_t
+dctool_multi_output_free (dctool_output_t *abstract)
+{
+	dctool_multi_output_t *output = (dctool_multi_output_t *) abstract;
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	for (unsigned int i = 0; i < output->count; ++i) {
+		dc_status_t rc = dctool_output_free (output->outputs[i]);
+		if (status == DC_STATUS_SUCCESS)
+			status = rc;
+	}
+
+	return status;
+}
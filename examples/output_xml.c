@@ -26,29 +26,37 @@
 #include <libdivecomputer/units.h>
 
 #include "output-private.h"
+#include "writer.h"
 #include "utils.h"
 
-static dc_status_t dctool_xml_output_write (dctool_output_t *output, dc_parser_t *parser, const unsigned char data[], unsigned int size, const unsigned char fingerprint[], unsigned int fsize);
+static dc_status_t dctool_xml_output_begin (dctool_output_t *output, dc_parser_t *parser, const unsigned char data[], unsigned int size, const unsigned char fingerprint[], unsigned int fsize);
+static void dctool_xml_output_sample (dc_sample_type_t type, dc_sample_value_t value, void *userdata);
+static dc_status_t dctool_xml_output_end (dctool_output_t *output, dc_status_t status);
 static dc_status_t dctool_xml_output_free (dctool_output_t *output);
 
+typedef struct sample_data_t {
+	dctool_writer_t *writer;
+	dctool_units_t units;
+	unsigned int nsamples;
+} sample_data_t;
+
 typedef struct dctool_xml_output_t {
 	dctool_output_t base;
 	FILE *ostream;
 	dctool_units_t units;
+	dctool_writer_t writer;
+	sample_data_t sampledata;
 } dctool_xml_output_t;
 
 static const dctool_output_vtable_t xml_vtable = {
 	sizeof(dctool_xml_output_t), /* size */
-	dctool_xml_output_write, /* write */
+	NULL, /* write */
 	dctool_xml_output_free, /* free */
+	dctool_xml_output_begin, /* begin */
+	dctool_xml_output_sample, /* sample */
+	dctool_xml_output_end, /* end */
 };
 
-typedef struct sample_data_t {
-	FILE *ostream;
-	dctool_units_t units;
-	unsigned int nsamples;
-} sample_data_t;
-
 static double
 convert_depth (double value, dctool_units_t units)
 {
@@ -103,65 +111,102 @@ sample_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
 		"ndl", "safety", "deco", "deep"};
 
 	sample_data_t *sampledata = (sample_data_t *) userdata;
+	dctool_writer_t *writer = sampledata->writer;
 
 	switch (type) {
 	case DC_SAMPLE_TIME:
 		if (sampledata->nsamples++)
-			fprintf (sampledata->ostream, "</sample>\n");
-		fprintf (sampledata->ostream, "<sample>\n");
-		fprintf (sampledata->ostream, "   <time>%02u:%02u</time>\n", value.time / 60, value.time % 60);
+			dctool_writer_puts (writer, "</sample>\n");
+		dctool_writer_puts (writer, "<sample>\n   <time>");
+		dctool_writer_uint (writer, value.time / 60, 2);
+		dctool_writer_puts (writer, ":");
+		dctool_writer_uint (writer, value.time % 60, 2);
+		dctool_writer_puts (writer, "</time>\n");
 		break;
 	case DC_SAMPLE_DEPTH:
-		fprintf (sampledata->ostream, "   <depth>%.2f</depth>\n",
-			convert_depth(value.depth, sampledata->units));
+		dctool_writer_puts (writer, "   <depth>");
+		dctool_writer_fixed (writer, convert_depth(value.depth, sampledata->units), 2);
+		dctool_writer_puts (writer, "</depth>\n");
 		break;
 	case DC_SAMPLE_PRESSURE:
-		fprintf (sampledata->ostream, "   <pressure tank=\"%u\">%.2f</pressure>\n",
-			value.pressure.tank,
-			convert_pressure(value.pressure.value, sampledata->units));
+		dctool_writer_puts (writer, "   <pressure tank=\"");
+		dctool_writer_uint (writer, value.pressure.tank, 1);
+		dctool_writer_puts (writer, "\">");
+		dctool_writer_fixed (writer, convert_pressure(value.pressure.value, sampledata->units), 2);
+		dctool_writer_puts (writer, "</pressure>\n");
 		break;
 	case DC_SAMPLE_TEMPERATURE:
-		fprintf (sampledata->ostream, "   <temperature>%.2f</temperature>\n",
-			convert_temperature(value.temperature, sampledata->units));
+		dctool_writer_puts (writer, "   <temperature>");
+		dctool_writer_fixed (writer, convert_temperature(value.temperature, sampledata->units), 2);
+		dctool_writer_puts (writer, "</temperature>\n");
 		break;
 	case DC_SAMPLE_EVENT:
 		if (value.event.type != SAMPLE_EVENT_GASCHANGE && value.event.type != SAMPLE_EVENT_GASCHANGE2) {
-			fprintf (sampledata->ostream, "   <event type=\"%u\" time=\"%u\" flags=\"%u\" value=\"%u\">%s</event>\n",
-				value.event.type, value.event.time, value.event.flags, value.event.value, events[value.event.type]);
+			dctool_writer_puts (writer, "   <event type=\"");
+			dctool_writer_uint (writer, value.event.type, 1);
+			dctool_writer_puts (writer, "\" time=\"");
+			dctool_writer_uint (writer, value.event.time, 1);
+			dctool_writer_puts (writer, "\" flags=\"");
+			dctool_writer_uint (writer, value.event.flags, 1);
+			dctool_writer_puts (writer, "\" value=\"");
+			dctool_writer_uint (writer, value.event.value, 1);
+			dctool_writer_puts (writer, "\">");
+			dctool_writer_puts (writer, events[value.event.type]);
+			dctool_writer_puts (writer, "</event>\n");
 		}
 		break;
 	case DC_SAMPLE_RBT:
-		fprintf (sampledata->ostream, "   <rbt>%u</rbt>\n", value.rbt);
+		dctool_writer_puts (writer, "   <rbt>");
+		dctool_writer_uint (writer, value.rbt, 1);
+		dctool_writer_puts (writer, "</rbt>\n");
 		break;
 	case DC_SAMPLE_HEARTBEAT:
-		fprintf (sampledata->ostream, "   <heartbeat>%u</heartbeat>\n", value.heartbeat);
+		dctool_writer_puts (writer, "   <heartbeat>");
+		dctool_writer_uint (writer, value.heartbeat, 1);
+		dctool_writer_puts (writer, "</heartbeat>\n");
 		break;
 	case DC_SAMPLE_BEARING:
-		fprintf (sampledata->ostream, "   <bearing>%u</bearing>\n", value.bearing);
+		dctool_writer_puts (writer, "   <bearing>");
+		dctool_writer_uint (writer, value.bearing, 1);
+		dctool_writer_puts (writer, "</bearing>\n");
 		break;
 	case DC_SAMPLE_VENDOR:
-		fprintf (sampledata->ostream, "   <vendor type=\"%u\" size=\"%u\">", value.vendor.type, value.vendor.size);
-		for (unsigned int i = 0; i < value.vendor.size; ++i)
-			fprintf (sampledata->ostream, "%02X", ((unsigned char *) value.vendor.data)[i]);
-		fprintf (sampledata->ostream, "</vendor>\n");
+		dctool_writer_puts (writer, "   <vendor type=\"");
+		dctool_writer_uint (writer, value.vendor.type, 1);
+		dctool_writer_puts (writer, "\" size=\"");
+		dctool_writer_uint (writer, value.vendor.size, 1);
+		dctool_writer_puts (writer, "\">");
+		dctool_writer_hex (writer, (const unsigned char *) value.vendor.data, value.vendor.size);
+		dctool_writer_puts (writer, "</vendor>\n");
 		break;
 	case DC_SAMPLE_SETPOINT:
-		fprintf (sampledata->ostream, "   <setpoint>%.2f</setpoint>\n", value.setpoint);
+		dctool_writer_puts (writer, "   <setpoint>");
+		dctool_writer_fixed (writer, value.setpoint, 2);
+		dctool_writer_puts (writer, "</setpoint>\n");
 		break;
 	case DC_SAMPLE_PPO2:
-		fprintf (sampledata->ostream, "   <ppo2>%.2f</ppo2>\n", value.ppo2);
+		dctool_writer_puts (writer, "   <ppo2>");
+		dctool_writer_fixed (writer, value.ppo2, 2);
+		dctool_writer_puts (writer, "</ppo2>\n");
 		break;
 	case DC_SAMPLE_CNS:
-		fprintf (sampledata->ostream, "   <cns>%.1f</cns>\n", value.cns * 100.0);
+		dctool_writer_puts (writer, "   <cns>");
+		dctool_writer_fixed (writer, value.cns * 100.0, 1);
+		dctool_writer_puts (writer, "</cns>\n");
 		break;
 	case DC_SAMPLE_DECO:
-		fprintf (sampledata->ostream, "   <deco time=\"%u\" depth=\"%.2f\">%s</deco>\n",
-			value.deco.time,
-			convert_depth(value.deco.depth, sampledata->units),
-			decostop[value.deco.type]);
+		dctool_writer_puts (writer, "   <deco time=\"");
+		dctool_writer_uint (writer, value.deco.time, 1);
+		dctool_writer_puts (writer, "\" depth=\"");
+		dctool_writer_fixed (writer, convert_depth(value.deco.depth, sampledata->units), 2);
+		dctool_writer_puts (writer, "\">");
+		dctool_writer_puts (writer, decostop[value.deco.type]);
+		dctool_writer_puts (writer, "</deco>\n");
 		break;
 	case DC_SAMPLE_GASMIX:
-		fprintf (sampledata->ostream, "   <gasmix>%u</gasmix>\n", value.gasmix);
+		dctool_writer_puts (writer, "   <gasmix>");
+		dctool_writer_uint (writer, value.gasmix, 1);
+		dctool_writer_puts (writer, "</gasmix>\n");
 		break;
 	default:
 		break;
@@ -189,6 +234,7 @@ dctool_xml_output_new (const char *filename, dctool_units_t units)
 	}
 
 	output->units = units;
+	dctool_writer_init (&output->writer, output->ostream);
 
 	fprintf (output->ostream, "<device>\n");
 
@@ -201,16 +247,15 @@ error_exit:
 }
 
 static dc_status_t
-dctool_xml_output_write (dctool_output_t *abstract, dc_parser_t *parser, const unsigned char data[], unsigned int size, const unsigned char fingerprint[], unsigned int fsize)
+dctool_xml_output_begin (dctool_output_t *abstract, dc_parser_t *parser, const unsigned char data[], unsigned int size, const unsigned char fingerprint[], unsigned int fsize)
 {
 	dctool_xml_output_t *output = (dctool_xml_output_t *) abstract;
 	dc_status_t status = DC_STATUS_SUCCESS;
 
 	// Initialize the sample data.
-	sample_data_t sampledata = {0};
-	sampledata.nsamples = 0;
-	sampledata.ostream = output->ostream;
-	sampledata.units = output->units;
+	output->sampledata.nsamples = 0;
+	output->sampledata.writer = &output->writer;
+	output->sampledata.units = output->units;
 
 	fprintf (output->ostream, "<dive>\n<number>%u</number>\n<size>%u</size>\n", abstract->number, size);
 
@@ -227,7 +272,7 @@ dctool_xml_output_write (dctool_output_t *abstract, dc_parser_t *parser, const u
 	status = dc_parser_get_datetime (parser, &dt);
 	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
 		ERROR ("Error parsing the datetime.");
-		goto cleanup;
+		return status;
 	}
 
 	fprintf (output->ostream, "<datetime>%04i-%02i-%02i %02i:%02i:%02i</datetime>\n",
@@ -240,7 +285,7 @@ dctool_xml_output_write (dctool_output_t *abstract, dc_parser_t *parser, const u
 	status = dc_parser_get_field (parser, DC_FIELD_DIVETIME, 0, &divetime);
 	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
 		ERROR ("Error parsing the divetime.");
-		goto cleanup;
+		return status;
 	}
 
 	fprintf (output->ostream, "<divetime>%02u:%02u</divetime>\n",
@@ -252,7 +297,7 @@ dctool_xml_output_write (dctool_output_t *abstract, dc_parser_t *parser, const u
 	status = dc_parser_get_field (parser, DC_FIELD_MAXDEPTH, 0, &maxdepth);
 	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
 		ERROR ("Error parsing the maxdepth.");
-		goto cleanup;
+		return status;
 	}
 
 	fprintf (output->ostream, "<maxdepth>%.2f</maxdepth>\n",
@@ -270,7 +315,7 @@ dctool_xml_output_write (dctool_output_t *abstract, dc_parser_t *parser, const u
 		status = dc_parser_get_field (parser, fields[i], 0, &temperature);
 		if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
 			ERROR ("Error parsing the temperature.");
-			goto cleanup;
+			return status;
 		}
 
 		if (status != DC_STATUS_UNSUPPORTED) {
@@ -286,7 +331,7 @@ dctool_xml_output_write (dctool_output_t *abstract, dc_parser_t *parser, const u
 	status = dc_parser_get_field (parser, DC_FIELD_GASMIX_COUNT, 0, &ngases);
 	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
 		ERROR ("Error parsing the gas mix count.");
-		goto cleanup;
+		return status;
 	}
 
 	for (unsigned int i = 0; i < ngases; ++i) {
@@ -294,7 +339,7 @@ dctool_xml_output_write (dctool_output_t *abstract, dc_parser_t *parser, const u
 		status = dc_parser_get_field (parser, DC_FIELD_GASMIX, i, &gasmix);
 		if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
 			ERROR ("Error parsing the gas mix.");
-			goto cleanup;
+			return status;
 		}
 
 		fprintf (output->ostream,
@@ -314,7 +359,7 @@ dctool_xml_output_write (dctool_output_t *abstract, dc_parser_t *parser, const u
 	status = dc_parser_get_field (parser, DC_FIELD_TANK_COUNT, 0, &ntanks);
 	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
 		ERROR ("Error parsing the tank count.");
-		goto cleanup;
+		return status;
 	}
 
 	for (unsigned int i = 0; i < ntanks; ++i) {
@@ -324,7 +369,7 @@ dctool_xml_output_write (dctool_output_t *abstract, dc_parser_t *parser, const u
 		status = dc_parser_get_field (parser, DC_FIELD_TANK, i, &tank);
 		if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
 			ERROR ("Error parsing the tank.");
-			goto cleanup;
+			return status;
 		}
 
 		fprintf (output->ostream, "<tank>\n");
@@ -356,7 +401,7 @@ dctool_xml_output_write (dctool_output_t *abstract, dc_parser_t *parser, const u
 	status = dc_parser_get_field (parser, DC_FIELD_DIVEMODE, 0, &divemode);
 	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
 		ERROR ("Error parsing the dive mode.");
-		goto cleanup;
+		return status;
 	}
 
 	if (status != DC_STATUS_UNSUPPORTED) {
@@ -371,7 +416,7 @@ dctool_xml_output_write (dctool_output_t *abstract, dc_parser_t *parser, const u
 	status = dc_parser_get_field (parser, DC_FIELD_SALINITY, 0, &salinity);
 	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
 		ERROR ("Error parsing the salinity.");
-		goto cleanup;
+		return status;
 	}
 
 	if (status != DC_STATUS_UNSUPPORTED) {
@@ -385,7 +430,7 @@ dctool_xml_output_write (dctool_output_t *abstract, dc_parser_t *parser, const u
 	status = dc_parser_get_field (parser, DC_FIELD_ATMOSPHERIC, 0, &atmospheric);
 	if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
 		ERROR ("Error parsing the atmospheric pressure.");
-		goto cleanup;
+		return status;
 	}
 
 	if (status != DC_STATUS_UNSUPPORTED) {
@@ -400,7 +445,7 @@ dctool_xml_output_write (dctool_output_t *abstract, dc_parser_t *parser, const u
 		status = dc_parser_get_field(parser, DC_FIELD_STRING, idx, &str);
 		if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
 			ERROR ("Error parsing strings");
-			goto cleanup;
+			return status;
 		}
 		if (status == DC_STATUS_UNSUPPORTED)
 			break;
@@ -411,18 +456,26 @@ dctool_xml_output_write (dctool_output_t *abstract, dc_parser_t *parser, const u
 
 	}
 
-	// Parse the sample data.
-	message ("Parsing the sample data.\n");
-	status = dc_parser_samples_foreach (parser, sample_cb, &sampledata);
-	if (status != DC_STATUS_SUCCESS) {
-		ERROR ("Error parsing the sample data.");
-		goto cleanup;
-	}
+	return DC_STATUS_SUCCESS;
+}
+
+static void
+dctool_xml_output_sample (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
+{
+	dctool_xml_output_t *output = (dctool_xml_output_t *) userdata;
+
+	sample_cb (type, value, &output->sampledata);
+}
+
+static dc_status_t
+dctool_xml_output_end (dctool_output_t *abstract, dc_status_t status)
+{
+	dctool_xml_output_t *output = (dctool_xml_output_t *) abstract;
 
-cleanup:
+	if (output->sampledata.nsamples)
+		dctool_writer_puts (&output->writer, "</sample>\n");
+	dctool_writer_flush (&output->writer);
 
-	if (sampledata.nsamples)
-		fprintf (output->ostream, "</sample>\n");
 	fprintf (output->ostream, "</dive>\n");
 
 	return status;
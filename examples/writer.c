@@ -0,0 +1,130 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <string.h>
+#include <math.h>
+
+#include "writer.h"
+
+void
+dctool_writer_init (dctool_writer_t *writer, FILE *ostream)
+{
+	writer->ostream = ostream;
+	writer->size = 0;
+}
+
+void
+dctool_writer_flush (dctool_writer_t *writer)
+{
+	if (writer->size) {
+		fwrite (writer->data, 1, writer->size, writer->ostream);
+		writer->size = 0;
+	}
+}
+
+static char *
+dctool_writer_reserve (dctool_writer_t *writer, size_t size)
+{
+	if (writer->size + size > sizeof (writer->data))
+		dctool_writer_flush (writer);
+
+	return writer->data + writer->size;
+}
+
+void
+dctool_writer_write (dctool_writer_t *writer, const char data[], size_t size)
+{
+	if (size > sizeof (writer->data)) {
+		dctool_writer_flush (writer);
+		fwrite (data, 1, size, writer->ostream);
+		return;
+	}
+
+	memcpy (dctool_writer_reserve (writer, size), data, size);
+	writer->size += size;
+}
+
+void
+dctool_writer_puts (dctool_writer_t *writer, const char *str)
+{
+	dctool_writer_write (writer, str, strlen (str));
+}
+
+void
+dctool_writer_uint (dctool_writer_t *writer, unsigned int value, unsigned int width)
+{
+	char digits[16];
+	unsigned int n = 0;
+
+	do {
+		digits[n++] = '0' + value % 10;
+		value /= 10;
+	} while (value || n < width);
+
+	char *p = dctool_writer_reserve (writer, n);
+	for (unsigned int i = 0; i < n; ++i)
+		p[i] = digits[n - i - 1];
+	writer->size += n;
+}
+
+void
+dctool_writer_fixed (dctool_writer_t *writer, double value, unsigned int decimals)
+{
+	static const double scale[] = {1.0, 10.0, 100.0, 1000.0, 10000.0, 100000.0};
+
+	// Only round here when the scaled value is clearly away from a tie.
+	// Ties, huge values and non-finite values fall back to printf, so
+	// the output is identical to the "%.Nf" conversion in all cases.
+	double scaled = fabs (value) * scale[decimals];
+	double integral = floor (scaled);
+	double fraction = scaled - integral;
+	if (!(scaled < 4e9) || fabs (fraction - 0.5) < 1e-6) {
+		char *p = dctool_writer_reserve (writer, 64);
+		int n = snprintf (p, 64, "%.*f", decimals, value);
+		if (n > 0 && n < 64)
+			writer->size += n;
+		return;
+	}
+
+	unsigned int number = (unsigned int) integral + (fraction > 0.5);
+	unsigned int divisor = (unsigned int) scale[decimals];
+
+	if (signbit (value))
+		dctool_writer_puts (writer, "-");
+	dctool_writer_uint (writer, number / divisor, 1);
+	if (decimals) {
+		dctool_writer_puts (writer, ".");
+		dctool_writer_uint (writer, number % divisor, decimals);
+	}
+}
+
+void
+dctool_writer_hex (dctool_writer_t *writer, const unsigned char data[], unsigned int size)
+{
+	static const char hex[] = "0123456789ABCDEF";
+
+	for (unsigned int i = 0; i < size; ++i) {
+		char *p = dctool_writer_reserve (writer, 2);
+		p[0] = hex[(data[i] >> 4) & 0x0F];
+		p[1] = hex[data[i] & 0x0F];
+		writer->size += 2;
+	}
+}
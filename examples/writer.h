@@ -0,0 +1,69 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DCTOOL_WRITER_H
+#define DCTOOL_WRITER_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#define DCTOOL_WRITER_SIZE 65536
+
+/*
+ * Buffered writer for the text outputs. The data is collected in memory
+ * and written to the stream in large blocks, when the buffer is full or
+ * flushed explicitly.
+ */
+typedef struct dctool_writer_t {
+	FILE *ostream;
+	size_t size;
+	char data[DCTOOL_WRITER_SIZE];
+} dctool_writer_t;
+
+void
+dctool_writer_init (dctool_writer_t *writer, FILE *ostream);
+
+void
+dctool_writer_flush (dctool_writer_t *writer);
+
+void
+dctool_writer_write (dctool_writer_t *writer, const char data[], size_t size);
+
+void
+dctool_writer_puts (dctool_writer_t *writer, const char *str);
+
+void
+dctool_writer_uint (dctool_writer_t *writer, unsigned int value, unsigned int width);
+
+void
+dctool_writer_fixed (dctool_writer_t *writer, double value, unsigned int decimals);
+
+void
+dctool_writer_hex (dctool_writer_t *writer, const unsigned char data[], unsigned int size);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DCTOOL_WRITER_H */
@@ -33,6 +33,16 @@ typedef struct dc_buffer_t dc_buffer_t;
 dc_buffer_t *
 dc_buffer_new (size_t capacity);
 
+/*
+ * Create a buffer that refers to external memory, such as a memory mapped
+ * file or a range of a memory dump, without copying it. The memory must
+ * remain valid for the lifetime of the view, and is never modified or
+ * freed by the buffer. Operations that change the contents, other than
+ * shrinking it, first replace the view with a private copy.
+ */
+dc_buffer_t *
+dc_buffer_new_view (const unsigned char data[], size_t size);
+
 void
 dc_buffer_free (dc_buffer_t *buffer);
 
@@ -0,0 +1,68 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_CHECKPOINT_H
+#define DC_CHECKPOINT_H
+
+#include "common.h"
+#include "context.h"
+#include "device.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * A checkpoint records the progress of a download, so a download that
+ * failed halfway (e.g. because the connection dropped) can be resumed
+ * with a new device handle, instead of starting again from zero.
+ *
+ * Attach the same checkpoint to the device before every attempt. A memory
+ * dump continues after the last block that was received, and
+ * dc_device_foreach skips the dives that were already passed to the
+ * callback. The checkpoint is cleared after a successful download.
+ */
+typedef struct dc_checkpoint_t dc_checkpoint_t;
+
+dc_status_t
+dc_checkpoint_new (dc_checkpoint_t **checkpoint, dc_context_t *context);
+
+dc_status_t
+dc_checkpoint_free (dc_checkpoint_t *checkpoint);
+
+/*
+ * Discard the recorded progress, to start the next download from zero.
+ */
+dc_status_t
+dc_checkpoint_reset (dc_checkpoint_t *checkpoint);
+
+/*
+ * Attach a checkpoint to the device, or detach it by passing NULL. The
+ * checkpoint is not owned by the device, and must remain valid until it
+ * is detached or the device is closed.
+ */
+dc_status_t
+dc_device_set_checkpoint (dc_device_t *device, dc_checkpoint_t *checkpoint);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_CHECKPOINT_H */
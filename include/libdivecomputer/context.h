@@ -22,12 +22,28 @@
 #ifndef DC_CONTEXT_H
 #define DC_CONTEXT_H
 
+#include <stddef.h>
+
 #include "common.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
 
+/*
+ * Thread safety
+ *
+ * A context may be shared between multiple threads. Changing the loglevel or
+ * the log function is safe at any time, and log messages emitted from
+ * different threads are serialized: the log function is never called
+ * concurrently for the same context. Consequently, the log function must not
+ * log to the same context itself.
+ *
+ * Device and parser objects are not thread-safe. Each object should be used by
+ * a single thread at a time, but different objects (even when they share a
+ * context) can be used concurrently from different threads.
+ */
+
 typedef struct dc_context_t dc_context_t;
 
 typedef enum dc_loglevel_t {
@@ -39,20 +55,242 @@ typedef enum dc_loglevel_t {
 	DC_LOGLEVEL_ALL
 } dc_loglevel_t;
 
+/*
+ * The subsystem a log message originates from: the transports (serial,
+ * bluetooth, irda and the transcripts), the communication protocols of
+ * the backends together with the library core, the parsers, and the
+ * firmware image handling.
+ */
+typedef enum dc_logcategory_t {
+	DC_LOGCATEGORY_TRANSPORT,
+	DC_LOGCATEGORY_PROTOCOL,
+	DC_LOGCATEGORY_PARSER,
+	DC_LOGCATEGORY_FIRMWARE
+} dc_logcategory_t;
+
+typedef enum dc_trace_type_t {
+	DC_TRACE_READ,
+	DC_TRACE_WRITE,
+	DC_TRACE_TRANSFER
+} dc_trace_type_t;
+
+#define DC_TRACE_MAXDATA 16
+
+/*
+ * A trace entry describes a single read or write on a transport, or a
+ * complete command and answer exchange of a backend (DC_TRACE_TRANSFER).
+ * The timestamp is taken from a monotonic clock, and together with the
+ * duration expressed in microseconds. The data contains the first bytes
+ * that were transferred (the command for a transfer). The sequence number
+ * increases by one for every entry, which allows to detect entries that
+ * were overwritten before they could be retrieved.
+ */
+typedef struct dc_trace_t {
+	unsigned int sequence;
+	dc_trace_type_t type;
+	dc_status_t status;
+	unsigned long long timestamp;
+	unsigned int duration;
+	unsigned int size;
+	unsigned int length;
+	unsigned char data[DC_TRACE_MAXDATA];
+} dc_trace_t;
+
 typedef void (*dc_logfunc_t) (dc_context_t *context, dc_loglevel_t loglevel, const char *file, unsigned int line, const char *function, const char *message, void *userdata);
 
+/*
+ * Schedule a task on an application thread pool. The function must arrange
+ * for func to be called exactly once with the task argument, in any thread,
+ * possibly before returning. Return an error if the task can't be queued;
+ * the work is then done by the library threads themselves.
+ */
+typedef dc_status_t (*dc_submitfunc_t) (void (*func) (void *task), void *task, void *userdata);
+
 dc_status_t
 dc_context_new (dc_context_t **context);
 
 dc_status_t
 dc_context_free (dc_context_t *context);
 
+/*
+ * Set the loglevel of all categories.
+ */
 dc_status_t
 dc_context_set_loglevel (dc_context_t *context, dc_loglevel_t loglevel);
 
+/*
+ * Set the loglevel of a single category, for example to keep the
+ * transport messages at the info level without the verbose output of the
+ * other categories.
+ */
+dc_status_t
+dc_context_set_logcategory (dc_context_t *context, dc_logcategory_t category, dc_loglevel_t loglevel);
+
 dc_status_t
 dc_context_set_logfunc (dc_context_t *context, dc_logfunc_t logfunc, void *userdata);
 
+/*
+ * Deliver the log messages from a background thread, through a ring
+ * buffer of the given size in bytes. The logging calls only queue the
+ * message, or the raw bytes of a hexdump, and the background thread does
+ * the hex conversion and calls the log function. When the ring buffer is
+ * full, messages are dropped, and their number is reported with the next
+ * message. Pass zero to deliver the pending messages and return to
+ * synchronous logging. The setting should be changed while no devices
+ * are in use.
+ */
+dc_status_t
+dc_context_set_logasync (dc_context_t *context, unsigned int capacity);
+
+/*
+ * Record all data transferred over the serial connections opened with this
+ * context to a transcript file. Pass NULL to disable recording again. The
+ * setting only affects connections opened afterwards.
+ */
+dc_status_t
+dc_context_set_record (dc_context_t *context, const char *filename);
+
+/*
+ * Replay a transcript file, created with dc_context_set_record, instead of
+ * opening a real serial port. The device name passed to dc_device_open is
+ * ignored, and the data is returned as fast as possible, without any delays.
+ * This allows to run any serial backend without the hardware attached. Pass
+ * NULL to disable replaying again.
+ */
+dc_status_t
+dc_context_set_replay (dc_context_t *context, const char *filename);
+
+/*
+ * The options of a dedicated I/O thread for a serial connection.
+ */
+typedef struct dc_iothread_t {
+	int priority;          /* Real-time priority, or zero for the default scheduling */
+	int cpu;               /* Processor to run on, or negative for any */
+	unsigned int capacity; /* Size of the receive buffer (bytes), or zero for the default */
+} dc_iothread_t;
+
+/*
+ * Receive the data of the serial ports opened with this context on a
+ * dedicated I/O thread (see dc_serial_iothread_open), such that the
+ * timing of the protocol no longer depends on the scheduling of the
+ * application. Pass NULL to disable the I/O thread again. The setting
+ * only affects ports opened afterwards, and is ignored while recording
+ * or replaying a transcript.
+ */
+dc_status_t
+dc_context_set_iothread (dc_context_t *context, const dc_iothread_t *options);
+
+/*
+ * Check whether messages with the given loglevel would be delivered to the
+ * log function. This is cheap, and can be used to skip the construction of
+ * expensive log messages. Returns zero if logging is disabled, if the context
+ * is NULL or if no log function is set.
+ */
+int
+dc_context_is_enabled (dc_context_t *context, dc_loglevel_t loglevel);
+
+/*
+ * Keep the most recent trace entries in a ring buffer with room for the
+ * given number of entries. When the buffer is full, the oldest entries are
+ * overwritten. Pass zero to disable tracing again. The setting should be
+ * changed while no devices are in use.
+ */
+dc_status_t
+dc_context_set_trace (dc_context_t *context, unsigned int capacity);
+
+/*
+ * Retrieve and remove up to count entries from the trace buffer, oldest
+ * first. The number of entries is returned in actual.
+ */
+dc_status_t
+dc_context_get_trace (dc_context_t *context, dc_trace_t entries[], unsigned int count, unsigned int *actual);
+
+/*
+ * The CPU bound parallel work inside the library, such as the chunked sample
+ * decoding, runs on a single thread pool owned by the context. The blocking
+ * downloads of the multi-device sessions use dedicated threads instead. The thread that starts the work always takes part, so the pool
+ * only adds helpers, and with zero threads everything runs in the calling
+ * thread. By default, the pool has one thread less than the number of
+ * processors. The threads are started on first use; changing the number
+ * waits until the current threads have finished their task.
+ */
+dc_status_t
+dc_context_set_threads (dc_context_t *context, unsigned int nthreads);
+
+/*
+ * Run the parallel work on an application thread pool instead of the own
+ * threads of the context. Pass NULL to use the own threads again. All
+ * submitted tasks must have been run before the context is freed.
+ */
+dc_status_t
+dc_context_set_submitfunc (dc_context_t *context, dc_submitfunc_t submit, void *userdata);
+
+/*
+ * Get the memory in use by all devices and parsers of the context, and
+ * the highest value since the context was created or the peak was last
+ * reset. This covers the objects themselves and the large buffers they
+ * allocate, such as memory dumps and decoding tables, but not the small
+ * allocations of the operating system and the transports.
+ */
+dc_status_t
+dc_context_get_memory_usage (dc_context_t *context, size_t *current, size_t *peak);
+
+dc_status_t
+dc_context_reset_memory_peak (dc_context_t *context);
+
+/*
+ * Create the devices and parsers of the context in caller-provided
+ * storage instead of on the heap, for systems with little or no heap.
+ * Freed objects are re-used. When the storage is full, creating a device
+ * or parser fails with DC_STATUS_NOMEMORY. The storage can only be set
+ * while the context has no devices or parsers, and must remain valid
+ * until the context is freed. Pass NULL to use the heap again.
+ */
+dc_status_t
+dc_context_set_storage (dc_context_t *context, void *storage, size_t size);
+
+#define DC_PARSER_STATS_NSAMPLES 16
+
+/*
+ * Parser statistics of a device family, collected by the generic parser
+ * functions: the number of parsers created and the allocations of their
+ * backends, the dives and the bytes passed to dc_parser_set_data, the
+ * calls to dc_parser_get_field (and dc_parser_get_fields), and the samples
+ * delivered by dc_parser_samples_foreach per sample type. The times are
+ * in microseconds, and the time of the samples includes the sample
+ * callback of the application.
+ */
+typedef struct dc_parser_stats_t {
+	unsigned int nparsers;
+	unsigned int nallocations;
+	unsigned int ndives;
+	unsigned long long nbytes;
+	unsigned long long nfields;
+	unsigned long long nsamples[DC_PARSER_STATS_NSAMPLES];
+	unsigned long long setdatatime;
+	unsigned long long fieldtime;
+	unsigned long long samplestime;
+} dc_parser_stats_t;
+
+/*
+ * Enable or disable the parser statistics. They are disabled by default.
+ * Every parser keeps its own counters, and adds them to the context when
+ * it moves on to the next dive and when it is destroyed, so the context
+ * is only locked once per dive.
+ */
+dc_status_t
+dc_context_set_parser_stats (dc_context_t *context, unsigned int enable);
+
+/*
+ * Get the parser statistics of a device family, or the totals of all
+ * families with DC_FAMILY_NULL.
+ */
+dc_status_t
+dc_context_get_parser_stats (dc_context_t *context, dc_family_t family, dc_parser_stats_t *stats);
+
+dc_status_t
+dc_context_reset_parser_stats (dc_context_t *context);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -0,0 +1,206 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_CUSTOM_H
+#define DC_CUSTOM_H
+
+#include <stddef.h>
+
+#include "common.h"
+#include "context.h"
+#include "device.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/**
+ * The direction of the data transmission.
+ */
+typedef enum dc_direction_t {
+	DC_DIRECTION_INPUT = 0x01,  /**< Input direction */
+	DC_DIRECTION_OUTPUT = 0x02, /**< Output direction */
+	DC_DIRECTION_ALL = DC_DIRECTION_INPUT | DC_DIRECTION_OUTPUT /**< All directions */
+} dc_direction_t;
+
+/**
+ * A data buffer for the scatter/gather functions.
+ */
+typedef struct dc_iovec_t {
+	void *data;  /**< The data buffer */
+	size_t size; /**< The size of the data buffer */
+} dc_iovec_t;
+
+/**
+ * The I/O functions of a transport provided by the application, for
+ * example a bluetooth or network connection.
+ *
+ * The read and write functions are mandatory and follow the semantics of
+ * dc_serial_read and dc_serial_write: a read waits until all requested
+ * bytes are received, or the timeout expires, and returns
+ * #DC_STATUS_TIMEOUT with the number of bytes received so far. The readv
+ * and writev functions transfer several buffers at once, without copying
+ * them into a single packet first. All other functions are optional. The
+ * serial line settings (baudrate, control lines, etc) do not apply to a
+ * custom transport and are ignored.
+ */
+typedef struct dc_custom_io_t {
+	dc_status_t (*set_timeout) (void *userdata, int timeout);
+	dc_status_t (*read) (void *userdata, void *data, size_t size, size_t *actual);
+	dc_status_t (*write) (void *userdata, const void *data, size_t size, size_t *actual);
+	dc_status_t (*readv) (void *userdata, const dc_iovec_t iov[], unsigned int count, size_t *actual);
+	dc_status_t (*writev) (void *userdata, const dc_iovec_t iov[], unsigned int count, size_t *actual);
+	dc_status_t (*get_available) (void *userdata, size_t *value);
+	dc_status_t (*purge) (void *userdata, dc_direction_t direction);
+	dc_status_t (*close) (void *userdata);
+} dc_custom_io_t;
+
+/**
+ * Open a connection on top of a custom transport, to pass to
+ * dc_device_custom_open. The I/O functions must remain valid until the
+ * connection is closed.
+ *
+ * @param[out]  serial    A location to store the connection.
+ * @param[in]   context   A valid context object.
+ * @param[in]   io        The I/O functions of the transport.
+ * @param[in]   userdata  User data to pass to the I/O functions.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_serial_custom_open (dc_serial_t **serial, dc_context_t *context, const dc_custom_io_t *io, void *userdata);
+
+/**
+ * The impairments of a simulated link.
+ *
+ * The bandwidth limits the transfer rate in both directions, and every
+ * write is delayed by the latency plus a random jitter. Every byte is
+ * dropped or corrupted (a single bit flip) with the given probability,
+ * in parts per million. A read that times out early on the underlying
+ * connection still waits for the full timeout, like a real device that
+ * stopped answering. The random numbers are generated from the seed, to
+ * make the results repeatable.
+ */
+typedef struct dc_impairment_t {
+	unsigned int bandwidth; /**< Bytes per second, or zero for unlimited */
+	unsigned int latency;   /**< Delay of a write (milliseconds) */
+	unsigned int jitter;    /**< Maximum extra delay of a write (milliseconds) */
+	unsigned int drop;      /**< Probability of a dropped byte (ppm) */
+	unsigned int corrupt;   /**< Probability of a corrupted byte (ppm) */
+	unsigned int seed;      /**< Seed of the random number generator */
+} dc_impairment_t;
+
+/**
+ * Open a connection which simulates an impaired link on top of another
+ * connection, for example a replayed transcript or an emulated device.
+ * The new connection takes ownership of the underlying connection, and
+ * closes it when it is closed itself, or when it fails to open.
+ *
+ * @param[out]  serial      A location to store the connection.
+ * @param[in]   context     A valid context object.
+ * @param[in]   lower       The underlying connection.
+ * @param[in]   impairment  The impairments of the link.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_serial_impair_open (dc_serial_t **serial, dc_context_t *context, dc_serial_t *lower, const dc_impairment_t *impairment);
+
+/**
+ * Open a connection which receives the data of another connection on a
+ * dedicated I/O thread, optionally with a real-time priority and bound
+ * to a single processor. The received data is buffered in a lock-free
+ * ring buffer, so the timing of the protocol no longer depends on the
+ * scheduling of the calling thread. When the buffer is full, the data is
+ * left in the buffer of the underlying connection. The writes and all
+ * other functions still run on the calling thread, so the underlying
+ * connection must support a read concurrently with the other functions,
+ * like the native serial ports. The new connection takes ownership of
+ * the underlying connection, and closes it when it is closed itself, or
+ * when it fails to open.
+ *
+ * A priority that can't be applied, for example without the permission
+ * for the real-time scheduler, only results in a warning.
+ *
+ * @param[out]  serial   A location to store the connection.
+ * @param[in]   context  A valid context object.
+ * @param[in]   lower    The underlying connection.
+ * @param[in]   options  The options of the I/O thread.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_serial_iothread_open (dc_serial_t **serial, dc_context_t *context, dc_serial_t *lower, const dc_iothread_t *options);
+
+/**
+ * The default ATT MTU of a bluetooth low energy connection.
+ */
+#define DC_BLE_MTU_DEFAULT 23
+
+/**
+ * The largest ATT MTU of a bluetooth low energy connection.
+ */
+#define DC_BLE_MTU_MAXIMUM 517
+
+/**
+ * The GATT functions of a bluetooth low energy serial service (for
+ * example the Nordic UART service), provided by the application.
+ *
+ * The library turns them into a stream: writes are split into packets of
+ * the negotiated size, and small writes are batched until the next read,
+ * while the notifications are collected into a receive buffer.
+ *
+ * The set_mtu function requests an ATT MTU, and stores the value that
+ * was agreed with the device. Without it, the default MTU is assumed. The
+ * write function sends one packet with a write without response. It
+ * returns #DC_STATUS_TIMEOUT when the transmit queue is still full, and
+ * the packet is sent again a little later (flow control). The read
+ * function waits at most timeout milliseconds for one notification, and
+ * returns #DC_STATUS_TIMEOUT if none arrived. The close function is
+ * optional.
+ */
+typedef struct dc_ble_io_t {
+	dc_status_t (*set_mtu) (void *userdata, unsigned int requested, unsigned int *mtu);
+	dc_status_t (*write) (void *userdata, const void *data, size_t size);
+	dc_status_t (*read) (void *userdata, void *data, size_t size, size_t *actual, int timeout);
+	dc_status_t (*close) (void *userdata);
+} dc_ble_io_t;
+
+/**
+ * Open a connection on top of a bluetooth low energy serial service, to
+ * pass to dc_device_custom_open. The largest possible ATT MTU is
+ * negotiated immediately. The GATT functions must remain valid until the
+ * connection is closed.
+ *
+ * @param[out]  serial    A location to store the connection.
+ * @param[in]   context   A valid context object.
+ * @param[in]   io        The GATT functions of the service.
+ * @param[in]   userdata  User data to pass to the GATT functions.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_serial_ble_open (dc_serial_t **serial, dc_context_t *context, const dc_ble_io_t *io, void *userdata);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_CUSTOM_H */
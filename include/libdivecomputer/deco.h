@@ -0,0 +1,82 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_DECO_H
+#define DC_DECO_H
+
+#include "common.h"
+#include "parser.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Decompression model
+ *
+ * A Buhlmann ZHL-16C model with gradient factors, for reconstructing the
+ * decompression state of dives from devices which don't record it. The
+ * tissues start saturated with air at the surface.
+ *
+ * Settings which are zero use the default: gradient factors of 100/100,
+ * a surface pressure of 1 atm and the density of salt water.
+ */
+typedef struct dc_deco_settings_t {
+	double gflow;   /* Gradient factor low (fraction) */
+	double gfhigh;  /* Gradient factor high (fraction) */
+	double surface; /* Surface pressure (bar) */
+	double density; /* Water density (kg/l) */
+} dc_deco_settings_t;
+
+/*
+ * Decompression state after a sample. The type, time and depth have the
+ * same meaning as for DC_SAMPLE_DECO: within the no decompression limit,
+ * the type is DC_DECO_NDL and the time is the remaining time at the
+ * current depth. Otherwise the type is DC_DECO_DECOSTOP, and the time is
+ * the duration of the first stop, at the ceiling rounded up to a multiple
+ * of 3 meters. Both times are limited to 999 minutes.
+ *
+ * The gradient factors are those of the leading tissue, as a fraction of
+ * its M-value, at the current depth and at the surface.
+ */
+typedef struct dc_deco_sample_t {
+	dc_deco_type_t type;
+	unsigned int time;   /* Time (seconds) */
+	double depth;        /* Stop depth (meters) */
+	double ceiling;      /* Ceiling (meters) */
+	double gf;           /* Gradient factor at the current depth */
+	double surface_gf;   /* Gradient factor at the surface */
+} dc_deco_sample_t;
+
+/*
+ * Run the model over the time, depth and gas mix columns, and store the
+ * state after each of the first nsamples samples in the results array.
+ * The gas mix column selects one of the ngasmixes gas mixes; until the
+ * first gas switch, the first gas mix (or air without gas mixes) is
+ * used. A missing depth holds the previous depth.
+ */
+dc_status_t
+dc_deco_compute (const dc_deco_settings_t *settings, const dc_sample_columns_t *columns, const dc_gasmix_t gasmixes[], unsigned int ngasmixes, dc_deco_sample_t results[]);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_DECO_H */
@@ -42,6 +42,19 @@ typedef struct dc_descriptor_t dc_descriptor_t;
 dc_status_t
 dc_descriptor_iterator (dc_iterator_t **iterator);
 
+/*
+ * Lookup a descriptor by family type and model number, or by vendor and
+ * product name (case-insensitive). If several descriptors match, the first
+ * one in the iterator order is returned. The descriptor is a reference to
+ * static data; freeing it is not required. If there is no match,
+ * DC_STATUS_UNSUPPORTED is returned.
+ */
+dc_status_t
+dc_descriptor_find_by_model (dc_descriptor_t **descriptor, dc_family_t type, unsigned int model);
+
+dc_status_t
+dc_descriptor_find_by_name (dc_descriptor_t **descriptor, const char *vendor, const char *product);
+
 void
 dc_descriptor_free (dc_descriptor_t *descriptor);
 
@@ -38,15 +38,32 @@ typedef enum dc_event_type_t {
 	DC_EVENT_PROGRESS = (1 << 1),
 	DC_EVENT_DEVINFO = (1 << 2),
 	DC_EVENT_CLOCK = (1 << 3),
-	DC_EVENT_VENDOR = (1 << 4)
+	DC_EVENT_VENDOR = (1 << 4),
+	DC_EVENT_PHASE = (1 << 5)
 } dc_event_type_t;
 
 typedef struct dc_device_t dc_device_t;
 typedef struct dc_serial_t dc_serial_t;
 
+/*
+ * Since version 1 of the progress event, the library also reports the
+ * time elapsed since the start of the current download, the rate and
+ * the estimated time remaining. They are derived from the progress
+ * itself, so the rate is in the units of the progress (bytes for a
+ * memory dump). The rate and the estimate are zero while unknown. The
+ * version field is filled in by the library; applications should check
+ * it before using the other new fields.
+ */
+#define DC_EVENT_PROGRESS_VERSION 1
+
 typedef struct dc_event_progress_t {
 	unsigned int current;
 	unsigned int maximum;
+	/* Version 1 */
+	unsigned int version;
+	unsigned int elapsed; /* Milliseconds */
+	unsigned int rate;    /* Units per second */
+	unsigned int eta;     /* Milliseconds */
 } dc_event_progress_t;
 
 typedef struct dc_event_devinfo_t {
@@ -65,6 +82,73 @@ typedef struct dc_event_vendor_t {
 	unsigned int size;
 } dc_event_vendor_t;
 
+/*
+ * The phases of a download. The backends report the start of each phase
+ * with a phase event: the handshake to identify the device and switch
+ * it into download mode, the transfer of the logbook (the dive headers
+ * or a manifest), and the transfer of the profiles (or the memory dump
+ * for the backends that download everything at once).
+ */
+typedef enum dc_phase_t {
+	DC_PHASE_HANDSHAKE,
+	DC_PHASE_LOGBOOK,
+	DC_PHASE_PROFILE
+} dc_phase_t;
+
+typedef struct dc_event_phase_t {
+	dc_phase_t phase;
+} dc_event_phase_t;
+
+#define DC_DEVICE_STATS_NBUCKETS 16
+#define DC_DEVICE_STATS_NPHASES 3
+
+/*
+ * Time spent in a phase of the download, in microseconds: the wall time,
+ * the part of it spent waiting for the I/O (including the delays), and
+ * the part spent in the dive callback of the application.
+ */
+typedef struct dc_device_phase_t {
+	unsigned long long walltime;
+	unsigned long long iotime;
+	unsigned long long callbacktime;
+} dc_device_phase_t;
+
+/*
+ * Transfer statistics of a device, reported by the backends that send
+ * commands with automatic retries. Bucket i of the latency histogram
+ * counts the successful packets that took less than 2^i milliseconds
+ * (and at least 2^(i-1) milliseconds), the last bucket also includes all
+ * slower packets.
+ *
+ * The backends that download their memory with the generic dump loop also
+ * report the number of bytes dumped and the time it took in milliseconds,
+ * which gives the effective throughput of the link.
+ *
+ * The time of the downloads is broken down by phase. The handshake
+ * includes the time spent in dc_device_open, and every download starts
+ * in the handshake phase again, until the backend reports the next one.
+ */
+typedef struct dc_device_stats_t {
+	unsigned int npackets;
+	unsigned int nretries;
+	unsigned int ntimeouts;
+	unsigned int nerrors;
+	unsigned int nsent;
+	unsigned int nreceived;
+	unsigned int latency[DC_DEVICE_STATS_NBUCKETS];
+	unsigned int dumpsize;
+	unsigned int dumptime;
+	dc_device_phase_t phases[DC_DEVICE_STATS_NPHASES];
+} dc_device_stats_t;
+
+/*
+ * A range of the device memory, for dc_device_dump_range.
+ */
+typedef struct dc_memory_range_t {
+	unsigned int address;
+	unsigned int size;
+} dc_memory_range_t;
+
 typedef int (*dc_cancel_callback_t) (void *userdata);
 
 typedef void (*dc_event_callback_t) (dc_device_t *device, dc_event_type_t event, const void *data, void *userdata);
@@ -74,6 +158,15 @@ typedef int (*dc_dive_callback_t) (const unsigned char *data, unsigned int size,
 dc_status_t
 dc_device_open (dc_device_t **out, dc_context_t *context, dc_descriptor_t *descriptor, const char *name);
 
+dc_status_t
+dc_serial_replay_open (dc_serial_t **serial, dc_context_t *context, const char *filename);
+
+dc_status_t
+dc_serial_emulator_open (dc_serial_t **serial, dc_context_t *context, dc_descriptor_t *descriptor, const unsigned char data[], unsigned int size);
+
+dc_status_t
+dc_serial_tcp_open (dc_serial_t **serial, dc_context_t *context, const char *url);
+
 dc_status_t
 dc_device_custom_open (dc_device_t **out, dc_context_t *context, dc_descriptor_t *descriptor, dc_serial_t *serial);
 
@@ -83,12 +176,51 @@ dc_device_get_type (dc_device_t *device);
 dc_status_t
 dc_device_set_cancel (dc_device_t *device, dc_cancel_callback_t callback, void *userdata);
 
+/*
+ * Get the memory in use by the device: the object itself, and the
+ * buffers it holds at the moment, such as a memory dump while the dives
+ * are extracted from it.
+ */
+dc_status_t
+dc_device_get_memory_usage (dc_device_t *device, size_t *usage);
+
 dc_status_t
 dc_device_set_events (dc_device_t *device, unsigned int events, dc_event_callback_t callback, void *userdata);
 
+/*
+ * Limit the rate of the progress events. An update is only passed to the
+ * event callback once at least interval milliseconds have elapsed and the
+ * progress has advanced by at least delta per mille of the maximum, since
+ * the previous one. The first and final update are never suppressed. Pass
+ * zero for both to report every update (the default).
+ */
+dc_status_t
+dc_device_set_progress_throttle (dc_device_t *device, unsigned int interval, unsigned int delta);
+
+dc_status_t
+dc_device_get_stats (dc_device_t *device, dc_device_stats_t *stats);
+
+/*
+ * Enable a persistent cache of the device memory in the given directory.
+ * Backends that support it will only read the memory regions that changed
+ * since the previous download. Pass NULL to disable the cache.
+ */
+dc_status_t
+dc_device_set_cachedir (dc_device_t *device, const char *dirname);
+
 dc_status_t
 dc_device_set_fingerprint (dc_device_t *device, const unsigned char data[], unsigned int size);
 
+/*
+ * Set the fingerprints of the dives already in the archive, as an array
+ * of count fingerprints of size bytes each, in any order. Those dives are
+ * not reported again, and backends that download the dives one at a time
+ * skip their profiles. Unlike the single fingerprint, a known dive does
+ * not stop the download. Pass a zero count to clear the set.
+ */
+dc_status_t
+dc_device_set_fingerprints (dc_device_t *device, const unsigned char data[], unsigned int size, unsigned int count);
+
 dc_status_t
 dc_device_version (dc_device_t *device, unsigned char data[], unsigned int size);
 
@@ -101,9 +233,57 @@ dc_device_write (dc_device_t *device, unsigned int address, const unsigned char
 dc_status_t
 dc_device_dump (dc_device_t *device, dc_buffer_t *buffer);
 
+/*
+ * Read only the given ranges of the device memory. The data of the ranges
+ * is stored in the buffer one after the other, in the order given. The
+ * ranges are merged where they overlap or touch, and read in address order
+ * with the block size of the backend.
+ */
+dc_status_t
+dc_device_dump_range (dc_device_t *device, const dc_memory_range_t ranges[], unsigned int count, dc_buffer_t *buffer);
+
 dc_status_t
 dc_device_foreach (dc_device_t *device, dc_dive_callback_t callback, void *userdata);
 
+/*
+ * Extract the dives from a memory dump, which was stored earlier with
+ * dc_device_dump, with the extraction function of the family of the
+ * descriptor. The same checks are run on the data as during the
+ * download. Returns DC_STATUS_DATAFORMAT for a corrupt dump, and
+ * DC_STATUS_UNSUPPORTED for the families without memory dumps, or
+ * with a layout that depends on the device.
+ */
+dc_status_t
+dc_device_extract_dives (dc_descriptor_t *descriptor, const unsigned char data[], unsigned int size, dc_dive_callback_t callback, void *userdata);
+
+/*
+ * Verify a memory dump. Identical to dc_device_extract_dives.
+ */
+dc_status_t
+dc_device_verify_dump (dc_descriptor_t *descriptor, const unsigned char data[], unsigned int size, dc_dive_callback_t callback, void *userdata);
+
+/*
+ * A dive, as returned by the dive iterator. The data remains valid until
+ * the next call to dc_iterator_next, or until the iterator is freed.
+ */
+typedef struct dc_device_dive_t {
+	const unsigned char *data;
+	unsigned int size;
+	const unsigned char *fingerprint;
+	unsigned int fsize;
+} dc_device_dive_t;
+
+/*
+ * Download the dives one at a time. Every dc_iterator_next call, with a
+ * dc_device_dive_t as the item, returns the next dive, DC_STATUS_DONE at
+ * the end, or the error of the download. The download runs on a helper
+ * thread and waits for the consumer between the dives; the events are
+ * emitted from that thread. Freeing the iterator stops the download early.
+ * The device must not be used otherwise until the iterator is freed.
+ */
+dc_status_t
+dc_device_dive_iterator (dc_device_t *device, dc_iterator_t **iterator);
+
 dc_status_t
 dc_device_close (dc_device_t *device);
 
@@ -0,0 +1,84 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_DIVESTORE_H
+#define DC_DIVESTORE_H
+
+#include "common.h"
+#include "context.h"
+#include "buffer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * A dive store keeps raw dives in a directory on disk, indexed by the
+ * family type, serial number and fingerprint of each dive. The same dive
+ * is stored only once, no matter how many times it is downloaded, so an
+ * archive can be reprocessed without parsing duplicates.
+ *
+ * The dives are appended to a data file, and located with a hash index
+ * that is kept in memory and written back when the store is freed. A
+ * missing or outdated index is rebuilt from the data file.
+ */
+typedef struct dc_divestore_t dc_divestore_t;
+
+typedef int (*dc_divestore_callback_t) (dc_family_t family, unsigned int serial, const unsigned char *data, unsigned int size, const unsigned char *fingerprint, unsigned int fsize, void *userdata);
+
+dc_status_t
+dc_divestore_new (dc_divestore_t **store, dc_context_t *context, const char *dirname);
+
+dc_status_t
+dc_divestore_free (dc_divestore_t *store);
+
+/*
+ * Store a dive, using the fingerprint delivered with it by dc_device_foreach.
+ * If the dive is already present, nothing is written and DC_STATUS_DONE is
+ * returned.
+ */
+dc_status_t
+dc_divestore_add (dc_divestore_t *store, dc_family_t family, unsigned int serial, const unsigned char fingerprint[], unsigned int fsize, const unsigned char data[], unsigned int size);
+
+/*
+ * Retrieve a dive. If the dive is not present, the buffer is cleared and
+ * DC_STATUS_SUCCESS is returned.
+ */
+dc_status_t
+dc_divestore_get (dc_divestore_t *store, dc_family_t family, unsigned int serial, const unsigned char fingerprint[], unsigned int fsize, dc_buffer_t *data);
+
+/*
+ * Call the callback once for each stored dive, in the order they were
+ * added. Returning zero from the callback stops the iteration.
+ */
+dc_status_t
+dc_divestore_foreach (dc_divestore_t *store, dc_divestore_callback_t callback, void *userdata);
+
+/*
+ * Write the index to disk, without closing the store.
+ */
+dc_status_t
+dc_divestore_sync (dc_divestore_t *store);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_DIVESTORE_H */
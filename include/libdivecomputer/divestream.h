@@ -0,0 +1,110 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_DIVESTREAM_H
+#define DC_DIVESTREAM_H
+
+#include <stddef.h>
+
+#include "common.h"
+#include "context.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * A dive stream decouples the download from the processing of the dives.
+ * Pass dc_dive_stream_callback as the dive callback of dc_device_foreach
+ * (with the stream as the userdata), and take the dives out of the stream
+ * on one or more other threads. The queue is lock-free, so a consumer
+ * never delays the communication with the device.
+ *
+ * The memory is bounded, both in the number of dives and in the number of
+ * bytes. When a slow consumer lets the stream fill up, the download is
+ * cancelled, as if the dive callback had returned zero, instead of
+ * blocking the device. The dives that were not delivered can be fetched
+ * with a next download, for example with a checkpoint attached to the
+ * device.
+ */
+typedef struct dc_dive_stream_t dc_dive_stream_t;
+
+typedef struct dc_dive_stream_item_t {
+	const unsigned char *data;
+	unsigned int size;
+	const unsigned char *fingerprint;
+	unsigned int fsize;
+} dc_dive_stream_item_t;
+
+/*
+ * Create a stream for at most maxdives dives, with up to maxbytes bytes of
+ * dive and fingerprint data together. Pass zero for no byte limit.
+ */
+dc_status_t
+dc_dive_stream_new (dc_dive_stream_t **stream, dc_context_t *context, unsigned int maxdives, size_t maxbytes);
+
+/*
+ * Free the stream, and all dives still in it. No producer or consumer may
+ * use the stream anymore.
+ */
+dc_status_t
+dc_dive_stream_free (dc_dive_stream_t *stream);
+
+/*
+ * A dive callback which queues a copy of the dive. Returns zero once the
+ * stream is full or finished, which stops the download.
+ */
+int
+dc_dive_stream_callback (const unsigned char *data, unsigned int size, const unsigned char *fingerprint, unsigned int fsize, void *userdata);
+
+/*
+ * Mark the end of the stream, with the status of the download. Queueing
+ * more dives fails afterwards.
+ */
+dc_status_t
+dc_dive_stream_finish (dc_dive_stream_t *stream, dc_status_t status);
+
+/*
+ * Take the next dive out of the stream, waiting at most timeout
+ * milliseconds for one to arrive (a negative timeout waits forever).
+ * Returns DC_STATUS_TIMEOUT if there was none, and, once the stream is
+ * finished and empty, DC_STATUS_CANCELLED if the stream ran full, and
+ * DC_STATUS_DONE otherwise. The dive must be released again.
+ */
+dc_status_t
+dc_dive_stream_pop (dc_dive_stream_t *stream, dc_dive_stream_item_t **item, int timeout);
+
+/*
+ * Release a dive taken from the stream, making room for the next one.
+ */
+dc_status_t
+dc_dive_stream_release (dc_dive_stream_t *stream, dc_dive_stream_item_t *item);
+
+/*
+ * Retrieve the status passed to dc_dive_stream_finish.
+ */
+dc_status_t
+dc_dive_stream_get_status (dc_dive_stream_t *stream, dc_status_t *status);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_DIVESTREAM_H */
@@ -0,0 +1,86 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_DOWNLOAD_H
+#define DC_DOWNLOAD_H
+
+#include "common.h"
+#include "device.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * A download runs dc_device_foreach in the background, and queues the
+ * dives and events, to be delivered to the application by calling
+ * dc_download_dispatch from its own thread. This allows an application
+ * to drive many downloads from a single event loop, without blocking
+ * the loop on the device communication.
+ *
+ * Once started, the device must not be used directly until the download
+ * is closed. The event and cancel handlers of the device are replaced.
+ */
+typedef struct dc_download_t dc_download_t;
+
+/*
+ * Start downloading the dives in the background. Only the events
+ * included in the mask are queued.
+ */
+dc_status_t
+dc_download_start (dc_download_t **download, dc_device_t *device, unsigned int events);
+
+/*
+ * Retrieve a file descriptor which becomes readable whenever there is
+ * something to dispatch. The descriptor remains owned by the download,
+ * and must not be read or closed by the application. Not supported on
+ * Windows.
+ */
+dc_status_t
+dc_download_get_fd (dc_download_t *download, int *fd);
+
+/*
+ * Deliver all queued events and dives to the callbacks. Returns
+ * DC_STATUS_SUCCESS while the download is still in progress, and
+ * DC_STATUS_DONE once the download has finished and everything has been
+ * delivered. If the dive callback returns zero, the download is
+ * cancelled and the remaining dives are discarded.
+ */
+dc_status_t
+dc_download_dispatch (dc_download_t *download, dc_event_callback_t event, dc_dive_callback_t dive, void *userdata);
+
+/*
+ * Request the cancellation of the download.
+ */
+dc_status_t
+dc_download_cancel (dc_download_t *download);
+
+/*
+ * Wait for the download to finish and free all resources. Returns the
+ * status of the dc_device_foreach call.
+ */
+dc_status_t
+dc_download_close (dc_download_t *download);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_DOWNLOAD_H */
@@ -0,0 +1,99 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_HOTPLUG_H
+#define DC_HOTPLUG_H
+
+#include "common.h"
+#include "context.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * A hotplug monitor keeps the list of serial ports up to date in the
+ * background, and queues an event whenever a port appears or disappears,
+ * to be delivered to the application by calling dc_hotplug_dispatch from
+ * its own thread. Polling dc_hotplug_foreach only reads the cached list,
+ * without scanning the system again.
+ *
+ * On Linux, the kernel uevents are monitored, and the ports are only
+ * scanned again when a tty device was added or removed. The other
+ * systems check for changes once per second.
+ */
+typedef struct dc_hotplug_t dc_hotplug_t;
+
+typedef enum dc_hotplug_event_t {
+	DC_HOTPLUG_ADDED,
+	DC_HOTPLUG_REMOVED
+} dc_hotplug_event_t;
+
+/*
+ * A serial port. The USB vendor and product id are zero if the port is
+ * not a USB device, or the ids are not available on the system.
+ */
+typedef struct dc_hotplug_port_t {
+	const char *name;
+	unsigned int vid;
+	unsigned int pid;
+} dc_hotplug_port_t;
+
+typedef void (*dc_hotplug_callback_t) (dc_hotplug_event_t event, const dc_hotplug_port_t *port, void *userdata);
+
+/*
+ * Start monitoring the serial ports. The ports that are present already
+ * are queued as added.
+ */
+dc_status_t
+dc_hotplug_start (dc_hotplug_t **hotplug, dc_context_t *context);
+
+/*
+ * Retrieve a file descriptor which becomes readable whenever there is
+ * something to dispatch. The descriptor remains owned by the monitor,
+ * and must not be read or closed by the application. Not supported on
+ * Windows.
+ */
+dc_status_t
+dc_hotplug_get_fd (dc_hotplug_t *hotplug, int *fd);
+
+/*
+ * Deliver all queued events to the callback.
+ */
+dc_status_t
+dc_hotplug_dispatch (dc_hotplug_t *hotplug, dc_hotplug_callback_t callback, void *userdata);
+
+/*
+ * Report every port in the cached list as added, without queueing.
+ */
+dc_status_t
+dc_hotplug_foreach (dc_hotplug_t *hotplug, dc_hotplug_callback_t callback, void *userdata);
+
+/*
+ * Stop monitoring and free all resources.
+ */
+dc_status_t
+dc_hotplug_close (dc_hotplug_t *hotplug);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_HOTPLUG_H */
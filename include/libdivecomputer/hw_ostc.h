@@ -34,6 +34,12 @@ extern "C" {
 #define HW_OSTC_MD2HASH_SIZE 18
 #define HW_OSTC_EEPROM_SIZE  256
 
+/*
+ * A parsed firmware image. It is never modified by the update, so a
+ * single image can be shared by several devices updated at the same time.
+ */
+typedef struct hw_ostc_firmware_t hw_ostc_firmware_t;
+
 typedef enum hw_ostc_format_t {
 	HW_OSTC_FORMAT_RAW,
 	HW_OSTC_FORMAT_RGB16,
@@ -61,15 +67,41 @@ hw_ostc_device_reset (dc_device_t *device);
 dc_status_t
 hw_ostc_device_screenshot (dc_device_t *device, dc_buffer_t *buffer, hw_ostc_format_t format);
 
+/*
+ * Callback for a single column of a screenshot, with the pixels from top
+ * to bottom in one of the RGB formats.
+ */
+typedef void (*hw_ostc_column_callback_t) (unsigned int column, const unsigned char data[], unsigned int size, void *userdata);
+
+/*
+ * Capture a screenshot, and pass every column to the callback as soon as
+ * it is received, from left to right. Only the RGB formats are supported.
+ * If a frame buffer is passed, it holds the previous capture (in column
+ * layout), only the columns that changed are passed to the callback, and
+ * the buffer is updated with the new capture. An empty frame buffer
+ * reports all columns.
+ */
+dc_status_t
+hw_ostc_device_screenshot_stream (dc_device_t *device, hw_ostc_format_t format, dc_buffer_t *frame, hw_ostc_column_callback_t callback, void *userdata);
+
 dc_status_t
 hw_ostc_extract_dives (dc_device_t *device, const unsigned char data[], unsigned int size, dc_dive_callback_t callback, void *userdata);
 
 dc_status_t
 hw_ostc_parser_create (dc_parser_t **parser, dc_context_t *context, unsigned int serial, unsigned int hwos);
 
+dc_status_t
+hw_ostc_firmware_load (hw_ostc_firmware_t **firmware, dc_context_t *context, const char *filename);
+
+dc_status_t
+hw_ostc_firmware_free (hw_ostc_firmware_t *firmware);
+
 dc_status_t
 hw_ostc_device_fwupdate (dc_device_t *abstract, const char *filename);
 
+dc_status_t
+hw_ostc_device_fwupdate_image (dc_device_t *abstract, const hw_ostc_firmware_t *firmware);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -34,6 +34,24 @@ extern "C" {
 
 #define HW_OSTC3_DISPLAY_SIZE    16
 #define HW_OSTC3_CUSTOMTEXT_SIZE 60
+#define HW_OSTC3_CONFIG_SIZE     4
+
+/*
+ * A single setting: the config id, and its value with the given size.
+ */
+typedef struct hw_ostc3_config_t {
+	unsigned int config;
+	unsigned int size;
+	unsigned char data[HW_OSTC3_CONFIG_SIZE];
+} hw_ostc3_config_t;
+
+/*
+ * A parsed and decrypted firmware image, for either an OSTC4 or one of
+ * the other models, depending on the format of the file. It is never
+ * modified by the update, so a single image can be shared by several
+ * devices updated at the same time.
+ */
+typedef struct hw_ostc3_firmware_t hw_ostc3_firmware_t;
 
 dc_status_t
 hw_ostc3_device_open (dc_device_t **device, dc_context_t *context, const char *name);
@@ -65,9 +83,36 @@ hw_ostc3_device_config_write (dc_device_t *abstract, unsigned int config, const
 dc_status_t
 hw_ostc3_device_config_reset (dc_device_t *abstract);
 
+/*
+ * Read the values of all the given settings. The config id and size of
+ * every entry must be filled in. The commands are pipelined, falling back
+ * to one command at a time if the firmware doesn't keep up, which is
+ * remembered in the sync store.
+ */
+dc_status_t
+hw_ostc3_device_config_snapshot (dc_device_t *abstract, hw_ostc3_config_t configs[], unsigned int count);
+
+/*
+ * Write only the settings that differ from the previous values, such as a
+ * snapshot of the same list, in their original order. Without previous
+ * values, a snapshot is taken first. The number of written settings is
+ * returned in the optional written argument.
+ */
+dc_status_t
+hw_ostc3_device_config_apply (dc_device_t *abstract, const hw_ostc3_config_t configs[], const hw_ostc3_config_t previous[], unsigned int count, unsigned int *written);
+
+dc_status_t
+hw_ostc3_firmware_load (hw_ostc3_firmware_t **firmware, dc_context_t *context, const char *filename);
+
+dc_status_t
+hw_ostc3_firmware_free (hw_ostc3_firmware_t *firmware);
+
 dc_status_t
 hw_ostc3_device_fwupdate (dc_device_t *abstract, const char *filename);
 
+dc_status_t
+hw_ostc3_device_fwupdate_image (dc_device_t *abstract, const hw_ostc3_firmware_t *firmware);
+
 dc_status_t
 hw_ostc3_parser_create (dc_parser_t **out, dc_context_t *context, unsigned int serial, unsigned int model);
 
@@ -22,11 +22,14 @@
 #ifndef DC_PARSER_H
 #define DC_PARSER_H
 
+#include <limits.h>
+
 #include "common.h"
 #include "context.h"
 #include "descriptor.h"
 #include "device.h"
 #include "datetime.h"
+#include "buffer.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -64,6 +67,10 @@ typedef enum dc_field_type_t {
 	DC_FIELD_TANK,
 	DC_FIELD_DIVEMODE,
 	DC_FIELD_STRING,
+	DC_FIELD_ASCENT_RATE,
+	DC_FIELD_DESCENT_RATE,
+	DC_FIELD_SAC,
+	DC_FIELD_DEPTH_HISTOGRAM,
 } dc_field_type_t;
 
 // Make it easy to test support compile-time with "#ifdef DC_FIELD_STRING"
@@ -199,6 +206,34 @@ typedef struct dc_tank_t {
     double endpressure;   /* End pressure (bar) */
 } dc_tank_t;
 
+/*
+ * Metrics derived from the samples
+ *
+ * DC_FIELD_ASCENT_RATE, DC_FIELD_DESCENT_RATE: The maximum ascent and
+ * descent rate (meters per minute), measured over intervals of at least
+ * ten seconds to suppress the noise of the depth resolution.
+ *
+ * DC_FIELD_SAC: The surface air consumption (bar per minute) of the tank
+ * with the index in the flags, from its first to its last pressure
+ * sample, with the consumption at depth reduced to the surface with the
+ * average depth over the same period (10 meters per bar). Multiply by
+ * the tank volume for the consumption in liters per minute.
+ *
+ * DC_FIELD_DEPTH_HISTOGRAM: The time spent in each depth range, as a
+ * dc_depth_histogram_t. Bin i covers the depths from i to i + 1 meter,
+ * and the last bin also everything deeper.
+ *
+ * These fields are computed by the library from the samples. The first
+ * walk over the samples after dc_parser_set_data, with the foreach or
+ * extract functions, computes them on the fly, so querying them afterwards
+ * needs no extra pass. Otherwise the first query makes that pass.
+ */
+#define DC_DEPTH_HISTOGRAM_NBINS 128
+
+typedef struct dc_depth_histogram_t {
+	unsigned int time[DC_DEPTH_HISTOGRAM_NBINS]; /* Time (seconds) */
+} dc_depth_histogram_t;
+
 typedef struct dc_field_string_t {
 	const char *desc;
 	const char *value;
@@ -238,10 +273,287 @@ typedef union dc_sample_value_t {
 	unsigned int gasmix; /* Gas mix index */
 } dc_sample_value_t;
 
+typedef struct dc_sample_event_t {
+	unsigned int sample; /* Index of the sample */
+	unsigned int type;
+	unsigned int time;
+	const char *name;
+	unsigned int flags;
+	unsigned int value;
+} dc_sample_event_t;
+
+/*
+ * Columnar sample data
+ *
+ * All arrays are owned by the caller. The per-sample arrays (time,
+ * depth, temperature, gasmix and each of the ntanks pressure arrays)
+ * must have room for capacity elements, and the events array for
+ * maxevents elements. Columns which are not needed can be set to NULL.
+ *
+ * Every DC_SAMPLE_TIME value starts a new sample. Values which are not
+ * present in a sample are set to NAN, or DC_GASMIX_UNKNOWN for the gas
+ * mix column. The gas mix column contains the index of the gas mix
+ * when a gas switch is reported in that sample. Pressure values for a
+ * tank index beyond ntanks are discarded.
+ *
+ * On return, nsamples and nevents contain the total number of samples
+ * and events in the dive, even if they exceed the capacity of the
+ * arrays. In that case, the arrays contain only the first part of the
+ * data, and DC_STATUS_NOMEMORY is returned. Calling the function with
+ * a zero capacity is therefore a valid way to query the required size.
+ */
+typedef struct dc_sample_columns_t {
+	unsigned int capacity;
+	unsigned int *time;
+	double *depth;
+	double *temperature;
+	unsigned int *gasmix;
+	unsigned int ntanks;
+	double **pressure;
+	unsigned int maxevents;
+	dc_sample_event_t *events;
+	unsigned int nsamples;
+	unsigned int nevents;
+} dc_sample_columns_t;
+
+/*
+ * Fixed-point sample data
+ *
+ * The same values as dc_sample_value_t, but with the depth, pressure,
+ * temperature, setpoint, ppO2 and CNS as integers, in thousandths of
+ * the unit used by dc_sample_value_t: millimeters, millibar, millidegrees
+ * Celsius, millibar (setpoint and ppO2) and 1/1000 of the CNS fraction.
+ * The values are rounded to the nearest integer.
+ */
+#define DC_FIXED_SCALE 1000
+#define DC_FIXED_UNKNOWN INT_MIN
+
+typedef union dc_sample_fixed_t {
+	unsigned int time;
+	int depth;
+	struct {
+		unsigned int tank;
+		int value;
+	} pressure;
+	int temperature;
+	struct {
+		unsigned int type;
+		unsigned int time;
+		const char *name;
+		unsigned int flags;
+		unsigned int value;
+	} event;
+	unsigned int rbt;
+	unsigned int heartbeat;
+	unsigned int bearing;
+	struct {
+		unsigned int type;
+		unsigned int size;
+		const void *data;
+	} vendor;
+	int setpoint;
+	int ppo2;
+	int cns;
+	struct {
+		unsigned int type;
+		unsigned int time;
+		int depth;
+	} deco;
+	unsigned int gasmix; /* Gas mix index */
+} dc_sample_fixed_t;
+
+/*
+ * Columnar fixed-point sample data, with the same layout and rules as
+ * dc_sample_columns_t. Values which are not present in a sample are set
+ * to DC_FIXED_UNKNOWN.
+ */
+typedef struct dc_sample_columns_fixed_t {
+	unsigned int capacity;
+	unsigned int *time;
+	int *depth;
+	int *temperature;
+	unsigned int *gasmix;
+	unsigned int ntanks;
+	int **pressure;
+	unsigned int maxevents;
+	dc_sample_event_t *events;
+	unsigned int nsamples;
+	unsigned int nevents;
+} dc_sample_columns_fixed_t;
+
+/*
+ * Event options
+ *
+ * DC_EVENT_TRANSITIONS: Deliver events with the SAMPLE_FLAGS_BEGIN or
+ * SAMPLE_FLAGS_END flag only when they change the state of the event,
+ * identified by its name, or by its type for events without a name.
+ * Repeated begin events while the event is active, and end events while
+ * it is not active, are dropped.
+ *
+ * DC_EVENT_INTERN: Replace the name of every event by a copy owned by
+ * the parser. Equal names are always delivered as the same pointer,
+ * which remains valid until the parser is destroyed. Each name also has
+ * a small integer id, assigned in order of first appearance and kept
+ * across dives (see dc_parser_get_event_id).
+ *
+ * The options apply to dc_parser_samples_foreach and
+ * dc_parser_samples_foreach_filtered.
+ */
+typedef enum dc_event_options_t {
+	DC_EVENT_TRANSITIONS = (1 << 0),
+	DC_EVENT_INTERN = (1 << 1),
+} dc_event_options_t;
+
+/*
+ * Vendor sample data
+ *
+ * Describes the raw vendor data of every DC_SAMPLE_VENDOR sample as a
+ * region of the dive data, without copying it. The spans array is owned
+ * by the caller and must have room for capacity elements.
+ *
+ * On return, count contains the total number of spans in the dive, even
+ * if it exceeds the capacity of the array. In that case, the array
+ * contains only the first spans, and DC_STATUS_NOMEMORY is returned.
+ */
+typedef struct dc_vendor_span_t {
+	unsigned int sample; /* Index of the sample */
+	unsigned int type;   /* Vendor type (parser_sample_vendor_t) */
+	unsigned int offset; /* Offset in the dive data */
+	unsigned int size;
+} dc_vendor_span_t;
+
+typedef struct dc_vendor_spans_t {
+	unsigned int capacity;
+	dc_vendor_span_t *spans;
+	unsigned int count;
+} dc_vendor_spans_t;
+
+/*
+ * Sample filter
+ *
+ * DC_SAMPLE_FILTER_INTERVAL: Keep at most one sample per interval
+ * seconds.
+ *
+ * DC_SAMPLE_FILTER_DEPTH: Drop the samples which can be reproduced by
+ * linear interpolation of the depth between the samples which are kept,
+ * within the tolerance (in meters). This is a streaming variant of the
+ * Ramer-Douglas-Peucker simplification, which looks ahead at most a
+ * limited number of samples.
+ *
+ * DC_SAMPLE_FILTER_EVENTS: Keep only the samples with an event or a gas
+ * switch.
+ *
+ * In all modes, the first and last sample are always kept, and samples
+ * with an event or a gas switch are never dropped. A sample is either
+ * delivered with all its values, or not at all.
+ */
+typedef enum dc_sample_filter_mode_t {
+	DC_SAMPLE_FILTER_NONE,
+	DC_SAMPLE_FILTER_INTERVAL,
+	DC_SAMPLE_FILTER_DEPTH,
+	DC_SAMPLE_FILTER_EVENTS
+} dc_sample_filter_mode_t;
+
+typedef struct dc_sample_filter_t {
+	dc_sample_filter_mode_t mode;
+	unsigned int interval; /* Interval (seconds) */
+	double tolerance;      /* Depth tolerance (meters) */
+} dc_sample_filter_t;
+
+#define DC_FIELDS_MAXGASMIXES 16
+#define DC_FIELDS_MAXTANKS    16
+#define DC_FIELDS_MAXSTRINGS  32
+
+/*
+ * Summary of all the dive fields, filled in by dc_parser_get_fields. The
+ * mask has bit (1 << type) set for every dc_field_type_t that is
+ * available. The arrays are limited to the maximum sizes above; the
+ * counts never exceed these limits.
+ */
+typedef struct dc_fields_t {
+	unsigned int mask;
+	unsigned int divetime;
+	double maxdepth;
+	double avgdepth;
+	unsigned int ngasmixes;
+	dc_gasmix_t gasmix[DC_FIELDS_MAXGASMIXES];
+	dc_salinity_t salinity;
+	double atmospheric;
+	double temperature_surface;
+	double temperature_minimum;
+	double temperature_maximum;
+	unsigned int ntanks;
+	dc_tank_t tank[DC_FIELDS_MAXTANKS];
+	dc_divemode_t divemode;
+	unsigned int nstrings;
+	dc_field_string_t string[DC_FIELDS_MAXSTRINGS];
+} dc_fields_t;
+
 typedef struct dc_parser_t dc_parser_t;
 
+/*
+ * Sample cursor
+ *
+ * A cursor delivers the samples of the current dive in chunks, starting
+ * at the first sample or at the position of the last seek. A sample starts
+ * with its DC_SAMPLE_TIME value, and is always delivered with all its
+ * values. The event options do not apply to a cursor. A cursor is only
+ * valid until the next dc_parser_set_data call.
+ */
+typedef struct dc_sample_cursor_t dc_sample_cursor_t;
+
+/*
+ * Parser pool
+ *
+ * Keeps released parsers for re-use, keyed by the family, model and
+ * serial number of the descriptor and the clock values. Acquiring a
+ * parser with the same key then needs no allocation. A pool is not
+ * thread safe, so each thread needs its own pool.
+ */
+typedef struct dc_parser_pool_t dc_parser_pool_t;
+
+/*
+ * Sub-dive
+ *
+ * A session (e.g. the freedives of an apnea session) stored as a single
+ * dive, with the start time (seconds since the start of the session) and
+ * summary of each individual dive.
+ */
+typedef struct dc_subdive_t {
+	unsigned int time;
+	unsigned int divetime;
+	unsigned int surftime;
+	double maxdepth;
+	unsigned int nsamples;
+} dc_subdive_t;
+
 typedef void (*dc_sample_callback_t) (dc_sample_type_t type, dc_sample_value_t value, void *userdata);
 
+typedef void (*dc_sample_fixed_callback_t) (dc_sample_type_t type, dc_sample_fixed_t value, void *userdata);
+
+/*
+ * Sample sink
+ *
+ * DC_SAMPLE_SINK_CALLBACK: Deliver the samples to the callback.
+ *
+ * DC_SAMPLE_SINK_COLUMNS, DC_SAMPLE_SINK_COLUMNS_FIXED: Store the samples
+ * in the columns, as dc_parser_samples_extract and
+ * dc_parser_samples_extract_fixed do.
+ */
+typedef enum dc_sample_sink_type_t {
+	DC_SAMPLE_SINK_CALLBACK,
+	DC_SAMPLE_SINK_COLUMNS,
+	DC_SAMPLE_SINK_COLUMNS_FIXED
+} dc_sample_sink_type_t;
+
+typedef struct dc_sample_sink_t {
+	dc_sample_sink_type_t type;
+	dc_sample_callback_t callback;
+	void *userdata;
+	dc_sample_columns_t *columns;
+	dc_sample_columns_fixed_t *fixed;
+} dc_sample_sink_t;
+
 dc_status_t
 dc_parser_new (dc_parser_t **parser, dc_device_t *device);
 
@@ -251,6 +563,37 @@ dc_parser_new2 (dc_parser_t **parser, dc_context_t *context, dc_descriptor_t *de
 dc_family_t
 dc_parser_get_type (dc_parser_t *parser);
 
+/*
+ * Register a cancellation callback, with the same meaning as for a
+ * device. It is polled while parsing, and once it returns non-zero, all
+ * functions which parse the samples of the current dive fail with
+ * DC_STATUS_CANCELLED, and no more samples are delivered.
+ */
+dc_status_t
+dc_parser_set_cancel (dc_parser_t *parser, dc_cancel_callback_t callback, void *userdata);
+
+/*
+ * Limit the time spent on each dive, in milliseconds of wall clock time
+ * since its dc_parser_set_data call. Once the budget is exhausted, the
+ * parser behaves as if it was cancelled. A zero budget (the default)
+ * disables the limit.
+ */
+dc_status_t
+dc_parser_set_budget (dc_parser_t *parser, unsigned int milliseconds);
+
+/*
+ * Get the memory in use by the parser: the object itself, its decoding
+ * tables, the interned event names and the sample index.
+ */
+dc_status_t
+dc_parser_get_memory_usage (dc_parser_t *parser, size_t *usage);
+
+/*
+ * Register the dive data. A parser can be re-used for any number of dives,
+ * because every call discards all the state derived from the previous data.
+ * Only the settings fixed at creation time (model, clock and calibration)
+ * are kept.
+ */
 dc_status_t
 dc_parser_set_data (dc_parser_t *parser, const unsigned char *data, unsigned int size);
 
@@ -260,12 +603,172 @@ dc_parser_get_datetime (dc_parser_t *parser, dc_datetime_t *datetime);
 dc_status_t
 dc_parser_get_field (dc_parser_t *parser, dc_field_type_t type, unsigned int flags, void *value);
 
+dc_status_t
+dc_parser_get_fields (dc_parser_t *parser, dc_fields_t *fields);
+
+/*
+ * Register the dive data, and run only the integrity checks the backend
+ * does on the header and the framing of the profile, without decoding
+ * the samples. Returns DC_STATUS_DATAFORMAT for a corrupt dive.
+ */
+dc_status_t
+dc_parser_verify (dc_parser_t *parser, const unsigned char data[], unsigned int size);
+
 dc_status_t
 dc_parser_samples_foreach (dc_parser_t *parser, dc_sample_callback_t callback, void *userdata);
 
+/*
+ * Set the number of threads used by dc_parser_samples_extract. For the
+ * formats which consist of independent sample records, a long dive is
+ * then split into chunks, which are decoded in parallel. The result is
+ * identical to the decoding in a single thread (the default).
+ */
+dc_status_t
+dc_parser_set_threads (dc_parser_t *parser, unsigned int nthreads);
+
+dc_status_t
+dc_parser_samples_extract (dc_parser_t *parser, dc_sample_columns_t *columns);
+
+dc_status_t
+dc_parser_samples_foreach_fixed (dc_parser_t *parser, dc_sample_fixed_callback_t callback, void *userdata);
+
+dc_status_t
+dc_parser_samples_extract_fixed (dc_parser_t *parser, dc_sample_columns_fixed_t *columns);
+
+/*
+ * Decode the samples once, and deliver them to several sinks in the same
+ * pass, in the order of the array. Every sink receives the stream of
+ * dc_parser_samples_foreach, and the columns of the columnar sinks follow
+ * the rules of dc_parser_samples_extract. The derived metrics are
+ * computed in the same pass. DC_STATUS_NOMEMORY is returned if any of
+ * the columnar sinks ran out of space, after all sinks got all samples.
+ */
+dc_status_t
+dc_parser_samples_fanout (dc_parser_t *parser, const dc_sample_sink_t sinks[], unsigned int count);
+
+dc_status_t
+dc_parser_set_event_options (dc_parser_t *parser, unsigned int options);
+
+#define DC_SAMPLE_MASK(type) (1u << (type))
+#define DC_SAMPLE_MASK_ALL   0xFFFFFFFFu
+
+/*
+ * Restrict the samples delivered by dc_parser_samples_foreach (and the
+ * functions built on it) to the types in the mask, a combination of
+ * DC_SAMPLE_MASK bits. The backends skip the decoding of the other types
+ * where the format allows it. The time is always delivered, because it
+ * separates the samples. The default is DC_SAMPLE_MASK_ALL.
+ */
+dc_status_t
+dc_parser_set_sample_mask (dc_parser_t *parser, unsigned int mask);
+
+/*
+ * Derive the dive time, the maximum and average depth, and the minimum
+ * and maximum temperature from the samples, for the backends that don't
+ * provide these fields themselves. It's disabled by default, and then
+ * these fields return DC_STATUS_UNSUPPORTED for such backends, as before.
+ * The setting also applies to dc_parser_get_fields.
+ */
+dc_status_t
+dc_parser_set_derived_fields (dc_parser_t *parser, unsigned int enable);
+
+dc_status_t
+dc_parser_get_event_id (dc_parser_t *parser, const char *name, unsigned int *id);
+
+dc_status_t
+dc_parser_get_event_name (dc_parser_t *parser, unsigned int id, const char **name);
+
+dc_status_t
+dc_parser_samples_vendor (dc_parser_t *parser, dc_vendor_spans_t *spans);
+
+dc_status_t
+dc_parser_samples_foreach_filtered (dc_parser_t *parser, const dc_sample_filter_t *filter, dc_sample_callback_t callback, void *userdata);
+
+dc_status_t
+dc_parser_samples_begin (dc_parser_t *parser, dc_sample_cursor_t **cursor);
+
+/*
+ * Deliver the next count samples, and advance the cursor. Returns
+ * DC_STATUS_DONE when there are no samples left.
+ */
+dc_status_t
+dc_parser_samples_next (dc_sample_cursor_t *cursor, unsigned int count, dc_sample_callback_t callback, void *userdata);
+
+/*
+ * Position the cursor at the first sample at or after the time (seconds).
+ */
+dc_status_t
+dc_parser_samples_seek_time (dc_sample_cursor_t *cursor, unsigned int time);
+
+dc_status_t
+dc_parser_samples_free (dc_sample_cursor_t *cursor);
+
+/*
+ * Build a sparse index of the samples of the current dive, with a
+ * checkpoint every interval samples. With an index, a cursor resumes
+ * decoding at the nearest checkpoint instead of at the start of the dive.
+ * The index is discarded by dc_parser_set_data.
+ */
+dc_status_t
+dc_parser_samples_index (dc_parser_t *parser, unsigned int interval);
+
+/*
+ * Serialize the sample index, to store it next to the dive data. Loading
+ * it again later avoids the first pass over the samples. An index is only
+ * accepted for the same dive data.
+ */
+dc_status_t
+dc_parser_get_sample_index (dc_parser_t *parser, dc_buffer_t *buffer);
+
+dc_status_t
+dc_parser_set_sample_index (dc_parser_t *parser, const unsigned char data[], unsigned int size);
+
+/*
+ * Get the number of sub-dives in the current dive. Returns
+ * DC_STATUS_UNSUPPORTED if the dive is not a session.
+ */
+dc_status_t
+dc_parser_get_subdive_count (dc_parser_t *parser, unsigned int *count);
+
+dc_status_t
+dc_parser_get_subdive (dc_parser_t *parser, unsigned int index, dc_subdive_t *subdive);
+
+/*
+ * Deliver the samples of a single sub-dive, without decoding the previous
+ * ones. The sample times are relative to the start of the sub-dive.
+ */
+dc_status_t
+dc_parser_subdive_foreach (dc_parser_t *parser, unsigned int index, dc_sample_callback_t callback, void *userdata);
+
 dc_status_t
 dc_parser_destroy (dc_parser_t *parser);
 
+dc_status_t
+dc_parser_pool_new (dc_parser_pool_t **pool, dc_context_t *context);
+
+/*
+ * Get a parser from the pool, or create a new one if there is no
+ * released parser with the same key. The parser behaves as a new one,
+ * except that the interned event names are kept, and must be given back
+ * with dc_parser_pool_release instead of destroyed.
+ */
+dc_status_t
+dc_parser_pool_acquire (dc_parser_pool_t *pool, dc_parser_t **parser, dc_descriptor_t *descriptor, unsigned int devtime, dc_ticks_t systime);
+
+/*
+ * Give a parser back to the pool. The dive data, the sample index and
+ * all options of the parser are reset.
+ */
+dc_status_t
+dc_parser_pool_release (dc_parser_pool_t *pool, dc_parser_t *parser);
+
+/*
+ * Destroy the pool and all its parsers, including the ones which are
+ * still acquired.
+ */
+dc_status_t
+dc_parser_pool_free (dc_parser_pool_t *pool);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
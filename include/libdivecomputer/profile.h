@@ -0,0 +1,70 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_PROFILE_H
+#define DC_PROFILE_H
+
+#include "common.h"
+#include "buffer.h"
+#include "parser.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Compact encoding of the fixed-point sample columns, for keeping many
+ * decoded profiles in memory or in a cache.
+ *
+ * The samples are stored in blocks of DC_PROFILE_BLOCKSIZE samples. Every
+ * column of a block is delta encoded, zigzag encoded and bit packed with
+ * the smallest width for that block. The blocks can be decoded
+ * independently, so any range of samples can be decoded without touching
+ * the rest of the profile. The gas mix column keeps the gas switches, and
+ * the events are stored with their names.
+ */
+#define DC_PROFILE_BLOCKSIZE 128
+
+/*
+ * Encode the samples and events of the columns into the buffer, replacing
+ * its contents. The columns must hold the complete dive: nsamples and
+ * nevents may not exceed the capacity of the arrays. Columns which are
+ * NULL are not stored. At most 32 tanks are supported.
+ */
+dc_status_t
+dc_profile_encode (dc_buffer_t *buffer, const dc_sample_columns_fixed_t *columns);
+
+/*
+ * Decode the samples starting at sample index first into the columns,
+ * with the same rules as dc_parser_samples_extract_fixed: on return,
+ * nsamples and nevents hold the number of samples and events from first
+ * to the end of the dive, and DC_STATUS_NOMEMORY is returned if they
+ * don't fit. The sample index of the events is relative to first. The
+ * event names point into the encoded data, and remain valid as long as
+ * that data does.
+ */
+dc_status_t
+dc_profile_decode (const unsigned char data[], unsigned int size, unsigned int first, dc_sample_columns_fixed_t *columns);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_PROFILE_H */
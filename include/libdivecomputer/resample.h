@@ -0,0 +1,65 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_RESAMPLE_H
+#define DC_RESAMPLE_H
+
+#include "common.h"
+#include "parser.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Resampling options
+ *
+ * By default, the depth, temperature and tank pressure are interpolated
+ * linearly between the samples where they are present. With the step
+ * option, the last known value is held until the next one instead.
+ */
+typedef enum dc_resample_flags_t {
+	DC_RESAMPLE_STEP_DEPTH = (1 << 0),
+	DC_RESAMPLE_STEP_TEMPERATURE = (1 << 1),
+	DC_RESAMPLE_STEP_PRESSURE = (1 << 2),
+} dc_resample_flags_t;
+
+/*
+ * Resample columnar sample data to a uniform time grid.
+ *
+ * The grid contains every multiple of the interval (in seconds) from the
+ * time of the first sample up to the time of the last sample. Values are
+ * never extrapolated: grid points before the first known value of a
+ * channel, or after its last one with linear interpolation, are set to
+ * NAN. A gas switch, and an event, is moved to the first grid point at
+ * or after its sample.
+ *
+ * The output columns follow the rules of dc_sample_columns_t, including
+ * the handling of the capacity. Only the first nsamples samples and
+ * nevents events of the input are used.
+ */
+dc_status_t
+dc_resample_columns (const dc_sample_columns_t *input, unsigned int interval, unsigned int flags, dc_sample_columns_t *output);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_RESAMPLE_H */
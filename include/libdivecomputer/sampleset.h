@@ -0,0 +1,109 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_SAMPLESET_H
+#define DC_SAMPLESET_H
+
+#include "common.h"
+#include "parser.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Columnar sample data, owned by the library
+ *
+ * A sample set holds the same columns as dc_sample_columns_t, and the
+ * deco columns, but the memory is owned by the set and grows as needed.
+ * Resetting the set, or filling it with the next dive, keeps the memory
+ * allocated, so a set that is reused (for example one per thread) stops
+ * allocating once it has seen the largest dive.
+ *
+ * Every DC_SAMPLE_TIME value starts a new sample. Values which are not
+ * present in a sample are set to NAN, or DC_SAMPLE_SET_UNKNOWN for the
+ * integer columns. The gas mix column contains the index of the gas mix
+ * when a gas switch is reported in that sample. There is a pressure
+ * column for every tank up to the highest tank index in the dive.
+ *
+ * The column pointers can be handed to other code without copying, and
+ * stay valid until the set is filled again, reset or freed.
+ */
+typedef struct dc_sample_set_t dc_sample_set_t;
+
+#define DC_SAMPLE_SET_UNKNOWN 0xFFFFFFFF
+
+typedef enum dc_sample_column_t {
+	DC_SAMPLE_COLUMN_TIME,        /* unsigned int, seconds */
+	DC_SAMPLE_COLUMN_DEPTH,       /* double, meters */
+	DC_SAMPLE_COLUMN_TEMPERATURE, /* double, degrees Celsius */
+	DC_SAMPLE_COLUMN_PRESSURE,    /* double, bar (one column per tank) */
+	DC_SAMPLE_COLUMN_GASMIX,      /* unsigned int, gas mix index */
+	DC_SAMPLE_COLUMN_DECO_TYPE,   /* unsigned int, dc_deco_type_t */
+	DC_SAMPLE_COLUMN_DECO_TIME,   /* unsigned int, seconds */
+	DC_SAMPLE_COLUMN_DECO_DEPTH   /* double, meters */
+} dc_sample_column_t;
+
+dc_status_t
+dc_sample_set_new (dc_sample_set_t **set);
+
+void
+dc_sample_set_free (dc_sample_set_t *set);
+
+/*
+ * Remove all samples and events, but keep the memory.
+ */
+void
+dc_sample_set_reset (dc_sample_set_t *set);
+
+unsigned int
+dc_sample_set_get_count (const dc_sample_set_t *set);
+
+unsigned int
+dc_sample_set_get_ntanks (const dc_sample_set_t *set);
+
+/*
+ * Get a column, with dc_sample_set_get_count elements of the type listed
+ * in dc_sample_column_t. The tank selects the pressure column, and is
+ * ignored for the other columns. Returns NULL for a tank beyond the
+ * number of tanks.
+ */
+const void *
+dc_sample_set_get_column (const dc_sample_set_t *set, dc_sample_column_t column, unsigned int tank);
+
+/*
+ * Get the events, except the gas changes, which are available in the gas
+ * mix column.
+ */
+const dc_sample_event_t *
+dc_sample_set_get_events (const dc_sample_set_t *set, unsigned int *count);
+
+/*
+ * Replace the contents of the set with the samples of the current dive,
+ * in a single pass over the samples.
+ */
+dc_status_t
+dc_parser_samples_extract_set (dc_parser_t *parser, dc_sample_set_t *set);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_SAMPLESET_H */
@@ -0,0 +1,119 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_SESSION_H
+#define DC_SESSION_H
+
+#include "common.h"
+#include "context.h"
+#include "descriptor.h"
+#include "device.h"
+#include "syncstore.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * A session downloads the dives from several devices concurrently, on a
+ * bounded number of dedicated threads. The downloads spend most of their
+ * time waiting for the devices, so they don't use the thread pool of the
+ * context, which remains available for the parsing. Each device is
+ * opened, its fingerprint is registered, and its dives are downloaded,
+ * exactly like an application would do with a single device.
+ *
+ * The callbacks are invoked from the worker threads, but never
+ * concurrently, so the application does not need any locking of its
+ * own. Each callback receives the index of the device in the session.
+ */
+typedef struct dc_session_t dc_session_t;
+
+typedef void (*dc_session_event_callback_t) (unsigned int index, dc_device_t *device, dc_event_type_t event, const void *data, void *userdata);
+
+typedef int (*dc_session_dive_callback_t) (unsigned int index, dc_device_t *device, const unsigned char *data, unsigned int size, const unsigned char *fingerprint, unsigned int fsize, void *userdata);
+
+typedef dc_status_t (*dc_session_device_callback_t) (unsigned int index, dc_device_t *device, void *userdata);
+
+dc_status_t
+dc_session_new (dc_session_t **session, dc_context_t *context, unsigned int nthreads);
+
+dc_status_t
+dc_session_free (dc_session_t *session);
+
+/*
+ * Add a device to the session. The name and the fingerprint (which may
+ * be NULL) are copied, but the descriptor must remain valid until the
+ * session is freed. Devices can not be added while the session is
+ * running.
+ */
+dc_status_t
+dc_session_add (dc_session_t *session, dc_descriptor_t *descriptor, const char *name, const unsigned char fingerprint[], unsigned int fsize);
+
+dc_status_t
+dc_session_set_events (dc_session_t *session, unsigned int events, dc_session_event_callback_t callback, void *userdata);
+
+/*
+ * Attach a sync store to every device in the session. It is only used
+ * for the devices without an explicit fingerprint.
+ */
+dc_status_t
+dc_session_set_syncstore (dc_session_t *session, dc_syncstore_t *store);
+
+/*
+ * Download the dives from all devices, and wait until all of them are
+ * finished. Returns the first error, if any. The status of each device
+ * is available with dc_session_get_status.
+ */
+dc_status_t
+dc_session_run (dc_session_t *session, dc_session_dive_callback_t callback, void *userdata);
+
+/*
+ * Open all devices, and pass each of them to the callback instead of
+ * downloading the dives, for example to update the firmware. The status
+ * returned by the callback becomes the status of the device. Unlike the
+ * other callbacks, this one is invoked concurrently, because it does all
+ * the work. Any data shared between the devices, such as a firmware
+ * image, must be read-only or protected by the application.
+ */
+dc_status_t
+dc_session_run_custom (dc_session_t *session, dc_session_device_callback_t callback, void *userdata);
+
+/*
+ * Request the cancellation of all downloads. Safe to call from any
+ * thread, including from the callbacks.
+ */
+dc_status_t
+dc_session_cancel (dc_session_t *session);
+
+dc_status_t
+dc_session_get_status (dc_session_t *session, unsigned int index, dc_status_t *status);
+
+/*
+ * Retrieve the combined progress of all devices. Every device counts
+ * for the same share, regardless of the size of its memory.
+ */
+dc_status_t
+dc_session_get_progress (dc_session_t *session, dc_event_progress_t *progress);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_SESSION_H */
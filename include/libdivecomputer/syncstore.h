@@ -0,0 +1,88 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_SYNCSTORE_H
+#define DC_SYNCSTORE_H
+
+#include "common.h"
+#include "context.h"
+#include "buffer.h"
+#include "device.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * A sync store keeps the fingerprint of the most recent dive of each
+ * device, identified by the family type and serial number, in a
+ * directory on disk.
+ *
+ * When a store is attached to a device, the stored fingerprint is
+ * registered automatically as soon as the device reports its serial
+ * number, and replaced with the fingerprint of the newest dive after
+ * a successful dc_device_foreach. Only new dives are downloaded on
+ * the next sync.
+ */
+typedef struct dc_syncstore_t dc_syncstore_t;
+
+dc_status_t
+dc_syncstore_new (dc_syncstore_t **store, dc_context_t *context, const char *dirname);
+
+dc_status_t
+dc_syncstore_free (dc_syncstore_t *store);
+
+/*
+ * Retrieve the fingerprint of a device. If no fingerprint is stored, the
+ * buffer is cleared and DC_STATUS_SUCCESS is returned.
+ */
+dc_status_t
+dc_syncstore_get (dc_syncstore_t *store, dc_family_t family, unsigned int serial, dc_buffer_t *fingerprint);
+
+/*
+ * Store the fingerprint of a device. The previous fingerprint is replaced
+ * atomically, so an interrupted update never leaves a damaged entry behind.
+ */
+dc_status_t
+dc_syncstore_set (dc_syncstore_t *store, dc_family_t family, unsigned int serial, const unsigned char data[], unsigned int size);
+
+/*
+ * Attach a sync store to the device, or detach it by passing NULL. The store
+ * is not owned by the device, and must remain valid until it is detached or
+ * the device is closed.
+ */
+dc_status_t
+dc_device_set_syncstore (dc_device_t *device, dc_syncstore_t *store);
+
+/*
+ * Attach a sync store to the context, or detach it by passing NULL. The
+ * store remembers the connection settings found while opening a device
+ * (e.g. an autodetected baudrate), so they can be tried first the next
+ * time. The store is not owned by the context, and must remain valid until
+ * it is detached or the context is freed.
+ */
+dc_status_t
+dc_context_set_syncstore (dc_context_t *context, dc_syncstore_t *store);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_SYNCSTORE_H */
@@ -33,6 +33,24 @@ extern "C" {
 dc_status_t
 uwatec_smart_device_open (dc_device_t **device, dc_context_t *context);
 
+/*
+ * Run the IrDA discovery in the background, for example while the user
+ * is still pointing the device at the adapter. The address that is found
+ * is used by the next uwatec_smart_device_open, which then connects
+ * without discovering the device again. The context must remain valid
+ * until the discovery is finished.
+ */
+typedef struct uwatec_smart_discover_t uwatec_smart_discover_t;
+
+dc_status_t
+uwatec_smart_discover_start (uwatec_smart_discover_t **discover, dc_context_t *context);
+
+/*
+ * Wait for the background discovery to finish, and free it.
+ */
+dc_status_t
+uwatec_smart_discover_finish (uwatec_smart_discover_t *discover);
+
 dc_status_t
 uwatec_smart_extract_dives (dc_device_t *device, const unsigned char data[], unsigned int size, dc_dive_callback_t callback, void *userdata);
 
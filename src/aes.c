@@ -67,7 +67,7 @@ typedef struct aes_state_t {
 	state_t* state;
 
 	// The array that stores the round keys.
-	uint8_t RoundKey[176];
+	uint8_t* RoundKey;
 
 	// The Key input to the AES Program
 	const uint8_t* Key;
@@ -456,9 +456,11 @@ static void BlockCopy(uint8_t* output, uint8_t* input)
 void AES128_ECB_encrypt(uint8_t* input, const uint8_t* key, uint8_t* output)
 {
   aes_state_t state;
+  uint8_t roundkey[176];
   // Copy input to output, and work in-memory on output
   BlockCopy(output, input);
   state.state = (state_t*)output;
+  state.RoundKey = roundkey;
 
   state.Key = key;
   KeyExpansion(&state);
@@ -470,9 +472,11 @@ void AES128_ECB_encrypt(uint8_t* input, const uint8_t* key, uint8_t* output)
 void AES128_ECB_decrypt(uint8_t* input, const uint8_t* key, uint8_t *output)
 {
   aes_state_t state;
+  uint8_t roundkey[176];
   // Copy input to output, and work in-memory on output
   BlockCopy(output, input);
   state.state = (state_t*)output;
+  state.RoundKey = roundkey;
 
   // The KeyExpansion routine must be called before encryption.
   state.Key = key;
@@ -505,9 +509,11 @@ void AES128_CBC_encrypt_buffer(uint8_t* output, uint8_t* input, uint32_t length,
   intptr_t i;
   uint8_t remainders = length % KEYLEN; /* Remaining bytes in the last non-full block */
   aes_state_t state;
+  uint8_t roundkey[176];
 
   BlockCopy(output, input);
   state.state = (state_t*)output;
+  state.RoundKey = roundkey;
 
   // Skip the key expansion if key is passed as 0
   if(0 != key)
@@ -546,9 +552,11 @@ void AES128_CBC_decrypt_buffer(uint8_t* output, uint8_t* input, uint32_t length,
   intptr_t i;
   uint8_t remainders = length % KEYLEN; /* Remaining bytes in the last non-full block */
   aes_state_t state;
+  uint8_t roundkey[176];
   
   BlockCopy(output, input);
   state.state = (state_t*)output;
+  state.RoundKey = roundkey;
 
   // Skip the key expansion if key is passed as 0
   if(0 != key)
@@ -587,3 +595,55 @@ void AES128_CBC_decrypt_buffer(uint8_t* output, uint8_t* input, uint32_t length,
 #endif // #if defined(CBC) && CBC
 
 
+
+#if defined(CFB) && CFB
+
+void AES128_init(AES128_ctx* ctx, const uint8_t* key)
+{
+  aes_state_t state;
+
+  state.RoundKey = ctx->RoundKey;
+  state.Key = key;
+  KeyExpansion(&state);
+}
+
+void AES128_ECB_encrypt_ctx(const AES128_ctx* ctx, const uint8_t* input, uint8_t* output)
+{
+  aes_state_t state;
+
+  memmove(output, input, KEYLEN);
+  state.state = (state_t*)output;
+  state.RoundKey = (uint8_t*)ctx->RoundKey;
+
+  Cipher(&state);
+}
+
+// Decrypt a buffer in CFB mode, with the key expanded only once. The
+// output may be the same buffer as the input.
+void AES128_CFB_decrypt_buffer(const AES128_ctx* ctx, uint8_t* output, const uint8_t* input, uint32_t length, const uint8_t* iv)
+{
+  uint8_t keystream[KEYLEN];
+  uint8_t ciphertext[KEYLEN];
+  uint32_t i, j, n;
+
+  AES128_ECB_encrypt_ctx(ctx, iv, keystream);
+
+  for(i = 0; i < length; i += KEYLEN)
+  {
+    n = length - i < KEYLEN ? length - i : KEYLEN;
+
+    // Keep the ciphertext, which feeds the next block.
+    memcpy(ciphertext, input + i, n);
+    for(j = 0; j < n; ++j)
+    {
+      output[i + j] = ciphertext[j] ^ keystream[j];
+    }
+
+    if(n == KEYLEN)
+    {
+      AES128_ECB_encrypt_ctx(ctx, ciphertext, keystream);
+    }
+  }
+}
+
+#endif // #if defined(CFB) && CFB
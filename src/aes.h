@@ -23,6 +23,12 @@ typedef unsigned int  uint32_t;
   #define ECB 1
 #endif
 
+// CFB enables the context based API, which expands the key only once, and
+// decryption of whole buffers in CFB-mode.
+#ifndef CFB
+  #define CFB 1
+#endif
+
 
 
 #if defined(ECB) && ECB
@@ -41,5 +47,18 @@ void AES128_CBC_decrypt_buffer(uint8_t* output, uint8_t* input, uint32_t length,
 #endif // #if defined(CBC) && CBC
 
 
+#if defined(CFB) && CFB
+
+typedef struct AES128_ctx {
+  uint8_t RoundKey[176];
+} AES128_ctx;
+
+void AES128_init(AES128_ctx* ctx, const uint8_t* key);
+void AES128_ECB_encrypt_ctx(const AES128_ctx* ctx, const uint8_t* input, uint8_t* output);
+void AES128_CFB_decrypt_buffer(const AES128_ctx* ctx, uint8_t* output, const uint8_t* input, uint32_t length, const uint8_t* iv);
+
+#endif // #if defined(CFB) && CFB
+
+
 
 #endif //_AES_H_
@@ -34,21 +34,46 @@ array_reverse_bytes (unsigned char data[], unsigned int size)
 }
 
 
+// Lookup table with the bit reversed value of each byte.
+static const unsigned char reverse_bits[256] = {
+	0x00, 0x80, 0x40, 0xC0, 0x20, 0xA0, 0x60, 0xE0, 0x10, 0x90, 0x50, 0xD0, 0x30, 0xB0, 0x70, 0xF0,
+	0x08, 0x88, 0x48, 0xC8, 0x28, 0xA8, 0x68, 0xE8, 0x18, 0x98, 0x58, 0xD8, 0x38, 0xB8, 0x78, 0xF8,
+	0x04, 0x84, 0x44, 0xC4, 0x24, 0xA4, 0x64, 0xE4, 0x14, 0x94, 0x54, 0xD4, 0x34, 0xB4, 0x74, 0xF4,
+	0x0C, 0x8C, 0x4C, 0xCC, 0x2C, 0xAC, 0x6C, 0xEC, 0x1C, 0x9C, 0x5C, 0xDC, 0x3C, 0xBC, 0x7C, 0xFC,
+	0x02, 0x82, 0x42, 0xC2, 0x22, 0xA2, 0x62, 0xE2, 0x12, 0x92, 0x52, 0xD2, 0x32, 0xB2, 0x72, 0xF2,
+	0x0A, 0x8A, 0x4A, 0xCA, 0x2A, 0xAA, 0x6A, 0xEA, 0x1A, 0x9A, 0x5A, 0xDA, 0x3A, 0xBA, 0x7A, 0xFA,
+	0x06, 0x86, 0x46, 0xC6, 0x26, 0xA6, 0x66, 0xE6, 0x16, 0x96, 0x56, 0xD6, 0x36, 0xB6, 0x76, 0xF6,
+	0x0E, 0x8E, 0x4E, 0xCE, 0x2E, 0xAE, 0x6E, 0xEE, 0x1E, 0x9E, 0x5E, 0xDE, 0x3E, 0xBE, 0x7E, 0xFE,
+	0x01, 0x81, 0x41, 0xC1, 0x21, 0xA1, 0x61, 0xE1, 0x11, 0x91, 0x51, 0xD1, 0x31, 0xB1, 0x71, 0xF1,
+	0x09, 0x89, 0x49, 0xC9, 0x29, 0xA9, 0x69, 0xE9, 0x19, 0x99, 0x59, 0xD9, 0x39, 0xB9, 0x79, 0xF9,
+	0x05, 0x85, 0x45, 0xC5, 0x25, 0xA5, 0x65, 0xE5, 0x15, 0x95, 0x55, 0xD5, 0x35, 0xB5, 0x75, 0xF5,
+	0x0D, 0x8D, 0x4D, 0xCD, 0x2D, 0xAD, 0x6D, 0xED, 0x1D, 0x9D, 0x5D, 0xDD, 0x3D, 0xBD, 0x7D, 0xFD,
+	0x03, 0x83, 0x43, 0xC3, 0x23, 0xA3, 0x63, 0xE3, 0x13, 0x93, 0x53, 0xD3, 0x33, 0xB3, 0x73, 0xF3,
+	0x0B, 0x8B, 0x4B, 0xCB, 0x2B, 0xAB, 0x6B, 0xEB, 0x1B, 0x9B, 0x5B, 0xDB, 0x3B, 0xBB, 0x7B, 0xFB,
+	0x07, 0x87, 0x47, 0xC7, 0x27, 0xA7, 0x67, 0xE7, 0x17, 0x97, 0x57, 0xD7, 0x37, 0xB7, 0x77, 0xF7,
+	0x0F, 0x8F, 0x4F, 0xCF, 0x2F, 0xAF, 0x6F, 0xEF, 0x1F, 0x9F, 0x5F, 0xDF, 0x3F, 0xBF, 0x7F, 0xFF};
+
 void
 array_reverse_bits (unsigned char data[], unsigned int size)
 {
 	for (unsigned int i = 0; i < size; ++i) {
-		unsigned char j = 0;
-		j  = (data[i] & 0x01) << 7;
-		j += (data[i] & 0x02) << 5;
-		j += (data[i] & 0x04) << 3;
-		j += (data[i] & 0x08) << 1;
-		j += (data[i] & 0x10) >> 1;
-		j += (data[i] & 0x20) >> 3;
-		j += (data[i] & 0x40) >> 5;
-		j += (data[i] & 0x80) >> 7;
-		data[i] = j;
+		data[i] = reverse_bits[data[i]];
+	}
+}
+
+
+void
+array_reverse_bits_sum (unsigned char data[], unsigned int size, unsigned short *checksum)
+{
+	unsigned short sum = 0;
+	for (unsigned int i = 0; i < size; ++i) {
+		unsigned char value = reverse_bits[data[i]];
+		sum += value;
+		data[i] = value;
 	}
+
+	if (checksum)
+		*checksum += sum;
 }
 
 
@@ -68,11 +93,19 @@ const unsigned char *
 array_search_forward (const unsigned char *data, unsigned int size,
                       const unsigned char *marker, unsigned int msize)
 {
-	while (size >= msize) {
-		if (memcmp (data, marker, msize) == 0)
-			return data;
-		size--;
-		data++;
+	if (msize == 0)
+		return data;
+
+	const unsigned char *p = data;
+	const unsigned char *end = data + size;
+	while ((unsigned int) (end - p) >= msize) {
+		// Jump to the next candidate with the first byte of the marker.
+		p = (const unsigned char *) memchr (p, marker[0], end - p - msize + 1);
+		if (p == NULL)
+			break;
+		if (memcmp (p + 1, marker + 1, msize - 1) == 0)
+			return p;
+		p++;
 	}
 	return NULL;
 }
@@ -82,12 +115,14 @@ const unsigned char *
 array_search_backward (const unsigned char *data, unsigned int size,
                        const unsigned char *marker, unsigned int msize)
 {
-	data += size;
-	while (size >= msize) {
-		if (memcmp (data - msize, marker, msize) == 0)
-			return data;
-		size--;
-		data--;
+	if (msize == 0)
+		return data + size;
+
+	// Only compare the entire marker when its last byte matches.
+	const unsigned char last = marker[msize - 1];
+	for (const unsigned char *p = data + size; (unsigned int) (p - data) >= msize; p--) {
+		if (p[-1] == last && memcmp (p - msize, marker, msize - 1) == 0)
+			return p;
 	}
 	return NULL;
 }
@@ -117,6 +152,26 @@ array_convert_bin2hex (const unsigned char input[], unsigned int isize, unsigned
 }
 
 
+// Lookup table with the value of each hexadecimal digit. All other
+// characters map to 0xFF, which can never be a valid nibble.
+static const unsigned char hex2bin[256] = {
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
 int
 array_convert_hex2bin (const unsigned char input[], unsigned int isize, unsigned char output[], unsigned int osize)
 {
@@ -124,25 +179,41 @@ array_convert_hex2bin (const unsigned char input[], unsigned int isize, unsigned
 		return -1;
 
 	for (unsigned int i = 0; i < osize; ++i) {
-		unsigned char value = 0;
-		for (unsigned int j = 0; j < 2; ++j) {
-			unsigned char number = 0;
-			unsigned char ascii = input[i * 2 + j];
-			if (ascii >= '0' && ascii <= '9')
-				number = ascii - '0';
-			else if (ascii >= 'A' && ascii <= 'F')
-				number = 10 + ascii - 'A';
-			else if (ascii >= 'a' && ascii <= 'f')
-				number = 10 + ascii - 'a';
-			else
-				return -1; /* Invalid character */
-
-			value <<= 4;
-			value += number;
-		}
-		output[i] = value;
+		unsigned char msn = hex2bin[input[i * 2 + 0]];
+		unsigned char lsn = hex2bin[input[i * 2 + 1]];
+		if ((msn | lsn) & 0xF0)
+			return -1; /* Invalid character */
+
+		output[i] = (msn << 4) | lsn;
+	}
+
+	return 0;
+}
+
+
+int
+array_convert_hex2bin_sum (const unsigned char input[], unsigned int isize, unsigned char output[], unsigned int osize, unsigned char *checksum)
+{
+	if (isize != 2 * osize)
+		return -1;
+
+	unsigned int sum = 0;
+	for (unsigned int i = 0; i < osize; ++i) {
+		unsigned char hi = input[i * 2 + 0];
+		unsigned char lo = input[i * 2 + 1];
+		sum += hi + lo;
+
+		unsigned char msn = hex2bin[hi];
+		unsigned char lsn = hex2bin[lo];
+		if ((msn | lsn) & 0xF0)
+			return -1; /* Invalid character */
+
+		output[i] = (msn << 4) | lsn;
 	}
 
+	if (checksum)
+		*checksum += sum;
+
 	return 0;
 }
 
@@ -184,65 +255,6 @@ array_uint_le (const unsigned char data[], unsigned int n)
 	return value;
 }
 
-unsigned int
-array_uint32_be (const unsigned char data[])
-{
-	return (data[0] << 24) + (data[1] << 16) + (data[2] << 8) + data[3];
-}
-
-
-unsigned int
-array_uint32_le (const unsigned char data[])
-{
-	return data[0] + (data[1] << 8) + (data[2] << 16) + (data[3] << 24);
-}
-
-
-void
-array_uint32_le_set (unsigned char data[], const unsigned int input)
-{
-	data[0] = input & 0xFF;
-	data[1] = (input >>  8) & 0xFF;
-	data[2] = (input >> 16) & 0xFF;
-	data[3] = (input >> 24) & 0xFF;
-}
-
-
-unsigned int
-array_uint24_be (const unsigned char data[])
-{
-	return (data[0] << 16) + (data[1] << 8) + data[2];
-}
-
-
-void
-array_uint24_be_set (unsigned char data[], const unsigned int input)
-{
-	data[0] = (input >> 16) & 0xFF;
-	data[1] = (input >>  8) & 0xFF;
-	data[2] = input & 0xFF;
-}
-
-
-unsigned int
-array_uint24_le (const unsigned char data[])
-{
-	return data[0] + (data[1] << 8) + (data[2] << 16);
-}
-
-unsigned short
-array_uint16_be (const unsigned char data[])
-{
-	return (data[0] << 8) + data[1];
-}
-
-
-unsigned short
-array_uint16_le (const unsigned char data[])
-{
-	return data[0] + (data[1] << 8);
-}
-
 unsigned char
 bcd2dec (unsigned char value)
 {
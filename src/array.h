@@ -32,6 +32,9 @@ array_reverse_bytes (unsigned char data[], unsigned int size);
 void
 array_reverse_bits (unsigned char data[], unsigned int size);
 
+void
+array_reverse_bits_sum (unsigned char data[], unsigned int size, unsigned short *checksum);
+
 int
 array_isequal (const unsigned char data[], unsigned int size, unsigned char value);
 
@@ -49,6 +52,9 @@ array_convert_bin2hex (const unsigned char input[], unsigned int isize, unsigned
 int
 array_convert_hex2bin (const unsigned char input[], unsigned int isize, unsigned char output[], unsigned int osize);
 
+int
+array_convert_hex2bin_sum (const unsigned char input[], unsigned int isize, unsigned char output[], unsigned int osize, unsigned char *checksum);
+
 unsigned int
 array_convert_str2num (const unsigned char data[], unsigned int size);
 
@@ -58,29 +64,66 @@ array_uint_be (const unsigned char data[], unsigned int n);
 unsigned int
 array_uint_le (const unsigned char data[], unsigned int n);
 
-unsigned int
-array_uint32_be (const unsigned char data[]);
+/* The fixed size helpers are defined inline, because the parsers use them
+ * for nearly every field. The compilers turn them into a single (unaligned)
+ * load, with a byte swap where needed. */
 
-unsigned int
-array_uint32_le (const unsigned char data[]);
+static inline unsigned int
+array_uint32_be (const unsigned char data[])
+{
+	return ((unsigned int) data[0] << 24) | ((unsigned int) data[1] << 16) |
+		((unsigned int) data[2] << 8) | (unsigned int) data[3];
+}
 
-void
-array_uint32_le_set (unsigned char data[], const unsigned int input);
+static inline unsigned int
+array_uint32_le (const unsigned char data[])
+{
+	return (unsigned int) data[0] | ((unsigned int) data[1] << 8) |
+		((unsigned int) data[2] << 16) | ((unsigned int) data[3] << 24);
+}
 
-unsigned int
-array_uint24_be (const unsigned char data[]);
+static inline void
+array_uint32_le_set (unsigned char data[], const unsigned int input)
+{
+	data[0] = input & 0xFF;
+	data[1] = (input >>  8) & 0xFF;
+	data[2] = (input >> 16) & 0xFF;
+	data[3] = (input >> 24) & 0xFF;
+}
 
-void
-array_uint24_be_set (unsigned char data[], const unsigned int input);
+static inline unsigned int
+array_uint24_be (const unsigned char data[])
+{
+	return ((unsigned int) data[0] << 16) | ((unsigned int) data[1] << 8) |
+		(unsigned int) data[2];
+}
 
-unsigned int
-array_uint24_le (const unsigned char data[]);
+static inline void
+array_uint24_be_set (unsigned char data[], const unsigned int input)
+{
+	data[0] = (input >> 16) & 0xFF;
+	data[1] = (input >>  8) & 0xFF;
+	data[2] = input & 0xFF;
+}
 
-unsigned short
-array_uint16_be (const unsigned char data[]);
+static inline unsigned int
+array_uint24_le (const unsigned char data[])
+{
+	return (unsigned int) data[0] | ((unsigned int) data[1] << 8) |
+		((unsigned int) data[2] << 16);
+}
+
+static inline unsigned short
+array_uint16_be (const unsigned char data[])
+{
+	return (unsigned short) ((data[0] << 8) | data[1]);
+}
 
-unsigned short
-array_uint16_le (const unsigned char data[]);
+static inline unsigned short
+array_uint16_le (const unsigned char data[])
+{
+	return (unsigned short) (data[0] | (data[1] << 8));
+}
 
 unsigned char
 bcd2dec (unsigned char value);
@@ -48,6 +48,9 @@
 #define PID 0x0888
 #define TIMEOUT 2000
 
+#define SZ_PACKET (8 * 1024)
+#define NTRANSFERS 4
+
 #define FP_OFFSET 20
 
 #define SZ_MEMORY (29 * 64 * 1024)
@@ -105,10 +108,9 @@ atomics_cobalt_device_open (dc_device_t **out, dc_context_t *context)
 	device->simulation = 0;
 	memset (device->fingerprint, 0, sizeof (device->fingerprint));
 
-	int rc = libusb_init (&device->context);
-	if (rc < 0) {
+	status = dc_context_usb_acquire (context, &device->context);
+	if (status != DC_STATUS_SUCCESS) {
 		ERROR (context, "Failed to initialize usb support.");
-		status = DC_STATUS_IO;
 		goto error_free;
 	}
 
@@ -119,7 +121,7 @@ atomics_cobalt_device_open (dc_device_t **out, dc_context_t *context)
 		goto error_usb_exit;
 	}
 
-	rc = libusb_claim_interface (device->handle, 0);
+	int rc = libusb_claim_interface (device->handle, 0);
 	if (rc < 0) {
 		ERROR (context, "Failed to claim the usb interface.");
 		status = DC_STATUS_IO;
@@ -139,7 +141,7 @@ atomics_cobalt_device_open (dc_device_t **out, dc_context_t *context)
 error_usb_close:
 	libusb_close (device->handle);
 error_usb_exit:
-	libusb_exit (device->context);
+	dc_context_usb_release (context, device->context);
 error_free:
 	dc_device_deallocate ((dc_device_t *) device);
 	return status;
@@ -157,7 +159,7 @@ atomics_cobalt_device_close (dc_device_t *abstract)
 #ifdef HAVE_LIBUSB
 	libusb_release_interface(device->handle, 0);
 	libusb_close (device->handle);
-	libusb_exit (device->context);
+	dc_context_usb_release (abstract->context, device->context);
 #endif
 
 	return DC_STATUS_SUCCESS;
@@ -248,6 +250,164 @@ atomics_cobalt_device_version (dc_device_t *abstract, unsigned char data[], unsi
 }
 
 
+#ifdef HAVE_LIBUSB
+static void LIBUSB_CALL
+atomics_cobalt_transfer_callback (struct libusb_transfer *transfer)
+{
+	int *completed = (int *) transfer->user_data;
+
+	*completed = 1;
+}
+
+/*
+ * Receive the answer with several bulk transfers in flight, so the next
+ * transfer is already queued by the time the previous one completes. The
+ * transfers complete in the order they were submitted, and the answer ends
+ * with the first transfer that returns less data than requested.
+ *
+ * The queued transfers are submitted without a timeout, because the timeout
+ * of libusb already starts at the submission, long before a transfer at the
+ * end of the queue becomes active. Instead, the transfer at the head of the
+ * queue is given the timeout, from the moment it becomes the head, and is
+ * cancelled when it expires.
+ */
+static dc_status_t
+atomics_cobalt_receive (atomics_cobalt_device_t *device, dc_buffer_t *buffer, unsigned int *nbytes, dc_event_progress_t *progress)
+{
+	dc_device_t *abstract = (dc_device_t *) device;
+	dc_status_t status = DC_STATUS_SUCCESS;
+	struct libusb_transfer *transfers[NTRANSFERS] = {NULL};
+	unsigned char *packets[NTRANSFERS] = {NULL};
+	int completed[NTRANSFERS] = {0};
+	int submitted[NTRANSFERS] = {0};
+	int rc = LIBUSB_SUCCESS;
+
+	// Allocate and submit the transfers.
+	for (unsigned int i = 0; i < NTRANSFERS; ++i) {
+		transfers[i] = libusb_alloc_transfer (0);
+		packets[i] = (unsigned char *) malloc (SZ_PACKET);
+		if (transfers[i] == NULL || packets[i] == NULL) {
+			ERROR (abstract->context, "Failed to allocate memory.");
+			status = DC_STATUS_NOMEMORY;
+			goto error;
+		}
+
+		libusb_fill_bulk_transfer (transfers[i], device->handle, 0x82,
+			packets[i], SZ_PACKET, atomics_cobalt_transfer_callback,
+			&completed[i], 0);
+
+		rc = libusb_submit_transfer (transfers[i]);
+		if (rc != LIBUSB_SUCCESS) {
+			ERROR (abstract->context, "Failed to submit the transfer.");
+			status = EXITCODE(rc);
+			goto error;
+		}
+
+		submitted[i] = 1;
+	}
+
+	unsigned int current = 0;
+	while (1) {
+		struct libusb_transfer *transfer = transfers[current];
+
+		// Wait for the oldest transfer to complete, or cancel it once the
+		// timeout has expired.
+		unsigned long long deadline = dc_context_clock () + TIMEOUT * 1000ULL;
+		int timedout = 0;
+		while (!completed[current]) {
+			unsigned long long now = dc_context_clock ();
+			if (!timedout && now >= deadline) {
+				libusb_cancel_transfer (transfer);
+				timedout = 1;
+			}
+
+			if (timedout) {
+				rc = libusb_handle_events_completed (device->context, &completed[current]);
+			} else {
+				struct timeval tv;
+				tv.tv_sec = (deadline - now) / 1000000;
+				tv.tv_usec = (deadline - now) % 1000000;
+				rc = libusb_handle_events_timeout_completed (device->context, &tv, &completed[current]);
+			}
+			if (rc != LIBUSB_SUCCESS && rc != LIBUSB_ERROR_INTERRUPTED) {
+				ERROR (abstract->context, "Failed to handle the events.");
+				status = EXITCODE(rc);
+				goto error;
+			}
+		}
+
+		submitted[current] = 0;
+
+		// A transfer cancelled because of the timeout ends the answer with
+		// the data received so far, just like a timed out transfer.
+		if (transfer->status != LIBUSB_TRANSFER_COMPLETED &&
+			transfer->status != LIBUSB_TRANSFER_TIMED_OUT &&
+			!(timedout && transfer->status == LIBUSB_TRANSFER_CANCELLED)) {
+			ERROR (abstract->context, "Failed to receive the answer.");
+			status = DC_STATUS_IO;
+			goto error;
+		}
+
+		int length = transfer->actual_length;
+
+		HEXDUMP (abstract->context, DC_LOGLEVEL_INFO, "Read", packets[current], length);
+
+		// Update and emit a progress event.
+		if (progress) {
+			progress->current += length;
+			device_event_emit (abstract, DC_EVENT_PROGRESS, progress);
+		}
+
+		// Append the packet to the output buffer.
+		dc_buffer_append (buffer, packets[current], length);
+		*nbytes += length;
+
+		// If we received fewer bytes than requested, the transfer is finished.
+		if (length < SZ_PACKET)
+			break;
+
+		// Queue the transfer again.
+		completed[current] = 0;
+		rc = libusb_submit_transfer (transfer);
+		if (rc != LIBUSB_SUCCESS) {
+			ERROR (abstract->context, "Failed to submit the transfer.");
+			status = EXITCODE(rc);
+			goto error;
+		}
+
+		submitted[current] = 1;
+
+		current = (current + 1) % NTRANSFERS;
+	}
+
+error:
+	// Cancel the transfers that are still pending, and wait until
+	// they are finished before releasing them.
+	for (unsigned int i = 0; i < NTRANSFERS; ++i) {
+		if (submitted[i] && !completed[i])
+			libusb_cancel_transfer (transfers[i]);
+	}
+	for (unsigned int i = 0; i < NTRANSFERS; ++i) {
+		while (submitted[i] && !completed[i]) {
+			rc = libusb_handle_events_completed (device->context, &completed[i]);
+			if (rc != LIBUSB_SUCCESS && rc != LIBUSB_ERROR_INTERRUPTED)
+				break;
+		}
+
+		// A transfer that is still in flight can't be released safely.
+		if (submitted[i] && !completed[i]) {
+			ERROR (abstract->context, "Failed to cancel the transfer.");
+			continue;
+		}
+
+		libusb_free_transfer (transfers[i]);
+		free (packets[i]);
+	}
+
+	return status;
+}
+#endif
+
 static dc_status_t
 atomics_cobalt_read_dive (dc_device_t *abstract, dc_buffer_t *buffer, int init, dc_event_progress_t *progress)
 {
@@ -279,34 +439,11 @@ atomics_cobalt_read_dive (dc_device_t *abstract, dc_buffer_t *buffer, int init,
 
 	HEXDUMP (abstract->context, DC_LOGLEVEL_INFO, "Write", &bRequest, 1);
 
+	// Receive the answer from the dive computer.
 	unsigned int nbytes = 0;
-	while (1) {
-		// Receive the answer from the dive computer.
-		int length = 0;
-		unsigned char packet[8 * 1024] = {0};
-		rc = libusb_bulk_transfer (device->handle, 0x82,
-			packet, sizeof (packet), &length, TIMEOUT);
-		if (rc != LIBUSB_SUCCESS && rc != LIBUSB_ERROR_TIMEOUT) {
-			ERROR (abstract->context, "Failed to receive the answer.");
-			return EXITCODE(rc);
-		}
-
-		HEXDUMP (abstract->context, DC_LOGLEVEL_INFO, "Read", packet, length);
-
-		// Update and emit a progress event.
-		if (progress) {
-			progress->current += length;
-			device_event_emit (abstract, DC_EVENT_PROGRESS, progress);
-		}
-
-		// Append the packet to the output buffer.
-		dc_buffer_append (buffer, packet, length);
-		nbytes += length;
-
-		// If we received fewer bytes than requested, the transfer is finished.
-		if (length < sizeof (packet))
-			break;
-	}
+	dc_status_t status = atomics_cobalt_receive (device, buffer, &nbytes, progress);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
 
 	// Check for a buffer error.
 	if (dc_buffer_get_size (buffer) != nbytes) {
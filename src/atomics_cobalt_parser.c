@@ -19,9 +19,12 @@
  * MA 02110-1301 USA
  */
 
+#define DC_LOG_CATEGORY DC_LOGCATEGORY_PARSER
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <math.h>
 
 #ifdef _MSC_VER
 #define snprintf _snprintf
@@ -48,12 +51,19 @@ struct atomics_cobalt_parser_t {
 	// Depth calibration.
 	double atmospheric;
 	double hydrostatic;
+	// Cached fields.
+	unsigned int cached;
+	unsigned int header;
+	unsigned int ngasmixes;
+	unsigned int tank;
+	unsigned int nsamples;
 };
 
 static dc_status_t atomics_cobalt_parser_set_data (dc_parser_t *abstract, const unsigned char *data, unsigned int size);
 static dc_status_t atomics_cobalt_parser_get_datetime (dc_parser_t *abstract, dc_datetime_t *datetime);
 static dc_status_t atomics_cobalt_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsigned int flags, void *value);
 static dc_status_t atomics_cobalt_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata);
+static dc_status_t atomics_cobalt_parser_samples_extract (dc_parser_t *abstract, dc_sample_columns_t *columns);
 
 static const dc_parser_vtable_t atomics_cobalt_parser_vtable = {
 	sizeof(atomics_cobalt_parser_t),
@@ -62,6 +72,14 @@ static const dc_parser_vtable_t atomics_cobalt_parser_vtable = {
 	atomics_cobalt_parser_get_datetime, /* datetime */
 	atomics_cobalt_parser_get_field, /* fields */
 	atomics_cobalt_parser_samples_foreach, /* samples_foreach */
+	atomics_cobalt_parser_samples_extract, /* samples_extract */
+	NULL, /* samples_range */
+	NULL, /* samples_seek */
+	NULL, /* samples_index */
+	NULL, /* samples_split */
+	NULL, /* samples_chunk */
+	NULL, /* subdives */
+	NULL, /* samples_vendor */
 	NULL /* destroy */
 };
 
@@ -84,6 +102,11 @@ atomics_cobalt_parser_create (dc_parser_t **out, dc_context_t *context)
 	// Set the default values.
 	parser->atmospheric = 0.0;
 	parser->hydrostatic = 1025.0 * GRAVITY;
+	parser->cached = 0;
+	parser->header = 0;
+	parser->ngasmixes = 0;
+	parser->tank = 0;
+	parser->nsamples = 0;
 
 	*out = (dc_parser_t*) parser;
 
@@ -94,10 +117,109 @@ atomics_cobalt_parser_create (dc_parser_t **out, dc_context_t *context)
 static dc_status_t
 atomics_cobalt_parser_set_data (dc_parser_t *abstract, const unsigned char *data, unsigned int size)
 {
+	atomics_cobalt_parser_t *parser = (atomics_cobalt_parser_t *) abstract;
+
+	// Reset the cache.
+	parser->cached = 0;
+	parser->header = 0;
+	parser->ngasmixes = 0;
+	parser->tank = 0;
+	parser->nsamples = 0;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+/*
+ * Locate the gas mix and gas switch records after the fixed header, and
+ * the primary tank. Only the header is used, never the samples.
+ */
+static dc_status_t
+atomics_cobalt_parser_cache (atomics_cobalt_parser_t *parser)
+{
+	dc_parser_t *abstract = (dc_parser_t *) parser;
+	const unsigned char *data = abstract->data;
+	unsigned int size = abstract->size;
+
+	if (parser->cached)
+		return DC_STATUS_SUCCESS;
+
+	if (size < SZ_HEADER)
+		return DC_STATUS_DATAFORMAT;
+
+	unsigned int ngasmixes = data[0x2a];
+	unsigned int nswitches = data[0x2b];
+
+	unsigned int header = SZ_HEADER + SZ_GASMIX * ngasmixes +
+		SZ_GASSWITCH * nswitches;
+
+	if (size < header)
+		return DC_STATUS_DATAFORMAT;
+
+	// Get the primary tank.
+	unsigned int tank = 0;
+	while (tank < ngasmixes) {
+		unsigned int sensor = array_uint16_le(data + SZ_HEADER + SZ_GASMIX * tank + 12);
+		if (sensor == 1)
+			break;
+		tank++;
+	}
+
+	// Cache the data for later use.
+	parser->header = header;
+	parser->ngasmixes = ngasmixes;
+	parser->tank = tank;
+	parser->nsamples = (size - header) / SZ_SEGMENT;
+	parser->cached = 1;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+/*
+ * Check the sample area, and get the index of the primary tank.
+ */
+static dc_status_t
+atomics_cobalt_parser_cache_samples (atomics_cobalt_parser_t *parser)
+{
+	dc_parser_t *abstract = (dc_parser_t *) parser;
+
+	dc_status_t rc = atomics_cobalt_parser_cache (parser);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	unsigned int nsegments = array_uint16_le (abstract->data + 0x50);
+	if (abstract->size < parser->header + SZ_SEGMENT * nsegments)
+		return DC_STATUS_DATAFORMAT;
+
+	if (parser->tank >= parser->ngasmixes) {
+		ERROR (abstract->context, "Invalid primary tank index.");
+		return DC_STATUS_DATAFORMAT;
+	}
+
 	return DC_STATUS_SUCCESS;
 }
 
 
+/*
+ * Get the index of a gas mix from its identifier in the samples.
+ */
+static unsigned int
+atomics_cobalt_parser_find_gasmix (atomics_cobalt_parser_t *parser, unsigned int id)
+{
+	const unsigned char *data = parser->base.data;
+
+	unsigned int idx = 0;
+	while (idx < parser->ngasmixes) {
+		if (data[SZ_HEADER + SZ_GASMIX * idx + 0] == id)
+			break;
+		idx++;
+	}
+
+	return idx;
+}
+
+
 dc_status_t
 atomics_cobalt_parser_set_calibration (dc_parser_t *abstract, double atmospheric, double hydrostatic)
 {
@@ -142,11 +264,15 @@ atomics_cobalt_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, un
 {
 	atomics_cobalt_parser_t *parser = (atomics_cobalt_parser_t *) abstract;
 
-	if (abstract->size < SZ_HEADER)
-		return DC_STATUS_DATAFORMAT;
+	dc_status_t rc = atomics_cobalt_parser_cache (parser);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
 
 	const unsigned char *p = abstract->data;
 
+	if ((type == DC_FIELD_GASMIX || type == DC_FIELD_TANK) && flags >= parser->ngasmixes)
+		return DC_STATUS_INVALIDARGS;
+
 	dc_gasmix_t *gasmix = (dc_gasmix_t *) value;
 	dc_tank_t *tank = (dc_tank_t *) value;
 
@@ -171,7 +297,7 @@ atomics_cobalt_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, un
 			break;
 		case DC_FIELD_GASMIX_COUNT:
 		case DC_FIELD_TANK_COUNT:
-			*((unsigned int *) value) = p[0x2a];
+			*((unsigned int *) value) = parser->ngasmixes;
 			break;
 		case DC_FIELD_GASMIX:
 			gasmix->helium = p[SZ_HEADER + SZ_GASMIX * flags + 5] / 100.0;
@@ -259,19 +385,12 @@ atomics_cobalt_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback
 	const unsigned char *data = abstract->data;
 	unsigned int size = abstract->size;
 
-	if (size < SZ_HEADER)
-		return DC_STATUS_DATAFORMAT;
+	dc_status_t rc = atomics_cobalt_parser_cache_samples (parser);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
 
 	unsigned int interval = data[0x1a];
-	unsigned int ngasmixes = data[0x2a];
-	unsigned int nswitches = data[0x2b];
-	unsigned int nsegments = array_uint16_le (data + 0x50);
-
-	unsigned int header = SZ_HEADER + SZ_GASMIX * ngasmixes +
-		SZ_GASSWITCH * nswitches;
-
-	if (size < header + SZ_SEGMENT * nsegments)
-		return DC_STATUS_DATAFORMAT;
+	unsigned int tank = parser->tank;
 
 	double atmospheric = 0.0;
 	if (parser->atmospheric)
@@ -282,22 +401,9 @@ atomics_cobalt_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback
 	// Previous gas mix - initialize with impossible value
 	unsigned int gasmix_previous = 0xFFFFFFFF;
 
-	// Get the primary tank.
-	unsigned int tank = 0;
-	while (tank < ngasmixes) {
-		unsigned int sensor = array_uint16_le(data + SZ_HEADER + SZ_GASMIX * tank + 12);
-		if (sensor == 1)
-			break;
-		tank++;
-	}
-	if (tank >= ngasmixes) {
-		ERROR (abstract->context, "Invalid primary tank index.");
-		return DC_STATUS_DATAFORMAT;
-	}
-
 	unsigned int time = 0;
 	unsigned int in_deco = 0;
-	unsigned int offset = header;
+	unsigned int offset = parser->header;
 	while (offset + SZ_SEGMENT <= size) {
 		dc_sample_value_t sample = {0};
 
@@ -320,13 +426,8 @@ atomics_cobalt_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback
 		// Current gas mix
 		unsigned int gasmix = data[offset + 4];
 		if (gasmix != gasmix_previous) {
-			unsigned int idx = 0;
-			while (idx < ngasmixes) {
-				if (data[SZ_HEADER + SZ_GASMIX * idx + 0] == gasmix)
-					break;
-				idx++;
-			}
-			if (idx >= ngasmixes) {
+			unsigned int idx = atomics_cobalt_parser_find_gasmix (parser, gasmix);
+			if (idx >= parser->ngasmixes) {
 				ERROR (abstract->context, "Invalid gas mix index.");
 				return DC_STATUS_DATAFORMAT;
 			}
@@ -352,6 +453,7 @@ atomics_cobalt_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback
 		// violation status
 		sample.event.type = 0;
 		sample.event.time = 0;
+		sample.event.name = NULL;
 		sample.event.value = 0;
 		sample.event.flags = 0;
 		unsigned int violation = data[offset + 11];
@@ -387,3 +489,75 @@ atomics_cobalt_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback
 
 	return DC_STATUS_SUCCESS;
 }
+
+
+static dc_status_t
+atomics_cobalt_parser_samples_extract (dc_parser_t *abstract, dc_sample_columns_t *columns)
+{
+	atomics_cobalt_parser_t *parser = (atomics_cobalt_parser_t *) abstract;
+
+	dc_status_t rc = atomics_cobalt_parser_cache_samples (parser);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	double atmospheric = 0.0;
+	if (parser->atmospheric)
+		atmospheric = parser->atmospheric;
+	else
+		atmospheric = array_uint16_le (abstract->data + 0x26) * BAR / 1000.0;
+	const double hydrostatic = parser->hydrostatic;
+
+	const unsigned char *data = abstract->data + parser->header;
+	unsigned int nsamples = parser->nsamples;
+	unsigned int n = sample_columns_interval (columns, nsamples, abstract->data[0x1a]);
+
+	// The fixed-size records are converted in a separate loop per column.
+	if (columns->depth) {
+		double *depth = columns->depth;
+		for (unsigned int i = 0; i < n; ++i) {
+			unsigned int value = array_uint16_le (data + i * SZ_SEGMENT + 0);
+			depth[i] = (value * BAR / 1000.0 - atmospheric) / hydrostatic;
+		}
+	}
+
+	if (parser->tank < columns->ntanks && columns->pressure[parser->tank]) {
+		double *pressure = columns->pressure[parser->tank];
+		for (unsigned int i = 0; i < n; ++i)
+			pressure[i] = array_uint16_le (data + i * SZ_SEGMENT + 2) * PSI / BAR;
+	}
+
+	if (columns->temperature) {
+		double *temperature = columns->temperature;
+		for (unsigned int i = 0; i < n; ++i)
+			temperature[i] = (data[i * SZ_SEGMENT + 8] - 32.0) * (5.0 / 9.0);
+	}
+
+	// The gas switches and the violations are checked for all samples, to
+	// report the same errors and number of events as the sample callback.
+	unsigned int gasmix_previous = 0xFFFFFFFF;
+	for (unsigned int i = 0; i < nsamples; ++i) {
+		const unsigned char *p = data + i * SZ_SEGMENT;
+
+		unsigned int gasmix = p[4];
+		if (gasmix != gasmix_previous) {
+			unsigned int idx = atomics_cobalt_parser_find_gasmix (parser, gasmix);
+			if (idx >= parser->ngasmixes) {
+				ERROR (abstract->context, "Invalid gas mix index.");
+				return DC_STATUS_DATAFORMAT;
+			}
+			if (columns->gasmix && i < n)
+				columns->gasmix[i] = idx;
+			gasmix_previous = gasmix;
+		}
+
+		unsigned int violation = p[11];
+		if (violation & 0x01)
+			sample_columns_event_at (columns, i, SAMPLE_EVENT_ASCENT, 0, NULL, 0, 0);
+		if (violation & 0x04)
+			sample_columns_event_at (columns, i, SAMPLE_EVENT_CEILING, 0, NULL, 0, 0);
+		if (violation & 0x08)
+			sample_columns_event_at (columns, i, SAMPLE_EVENT_PO2, 0, NULL, 0, 0);
+	}
+
+	return DC_STATUS_SUCCESS;
+}
@@ -21,12 +21,14 @@
 
 #include <stdlib.h> // malloc, realloc, free
 #include <string.h> // memcpy, memmove
+#include <stdint.h> // SIZE_MAX
 
 #include <libdivecomputer/buffer.h>
 
 struct dc_buffer_t {
 	unsigned char *data;
 	size_t capacity, offset, size;
+	int owner;
 };
 
 dc_buffer_t *
@@ -49,6 +51,29 @@ dc_buffer_new (size_t capacity)
 	buffer->capacity = capacity;
 	buffer->offset = 0;
 	buffer->size = 0;
+	buffer->owner = 1;
+
+	return buffer;
+}
+
+
+dc_buffer_t *
+dc_buffer_new_view (const unsigned char data[], size_t size)
+{
+	if (data == NULL && size)
+		return NULL;
+
+	dc_buffer_t *buffer = (dc_buffer_t *) malloc (sizeof (dc_buffer_t));
+	if (buffer == NULL)
+		return NULL;
+
+	// The external memory is never written. Any operation that needs to
+	// modify the contents, detaches the buffer into a private copy first.
+	buffer->data = (unsigned char *) data;
+	buffer->capacity = size;
+	buffer->offset = 0;
+	buffer->size = size;
+	buffer->owner = 0;
 
 	return buffer;
 }
@@ -60,7 +85,7 @@ dc_buffer_free (dc_buffer_t *buffer)
 	if (buffer == NULL)
 		return;
 
-	if (buffer->data)
+	if (buffer->owner && buffer->data)
 		free (buffer->data);
 
 	free (buffer);
@@ -83,34 +108,71 @@ dc_buffer_clear (dc_buffer_t *buffer)
 static size_t
 dc_buffer_expand_calc (dc_buffer_t *buffer, size_t n)
 {
+	// Grow geometrically, such that a series of appends takes amortized
+	// constant time. Stop doubling before the size overflows.
 	size_t oldsize = buffer->capacity;
 	size_t newsize = (oldsize ? oldsize : n);
-	while (newsize < n)
+	while (newsize < n) {
+		if (newsize > SIZE_MAX / 2)
+			return n;
 		newsize *= 2;
+	}
 
 	return newsize;
 }
 
 
+/*
+ * Replace the external memory of a view with a private copy of the
+ * contents, located at the given offset in a block of the given capacity.
+ */
+static int
+dc_buffer_detach (dc_buffer_t *buffer, size_t capacity, size_t offset)
+{
+	unsigned char *data = (unsigned char *) malloc (capacity ? capacity : 1);
+	if (data == NULL)
+		return 0;
+
+	if (buffer->size)
+		memcpy (data + offset, buffer->data + buffer->offset, buffer->size);
+
+	buffer->data = data;
+	buffer->capacity = capacity;
+	buffer->offset = offset;
+	buffer->owner = 1;
+
+	return 1;
+}
+
+
 static int
 dc_buffer_expand_append (dc_buffer_t *buffer, size_t n)
 {
+	if (!buffer->owner) {
+		if (n <= buffer->size)
+			return 1;
+		return dc_buffer_detach (buffer, dc_buffer_expand_calc (buffer, n), 0);
+	}
+
 	if (n > buffer->capacity - buffer->offset) {
 		if (n > buffer->capacity) {
 			size_t capacity = dc_buffer_expand_calc (buffer, n);
 
-			unsigned char *data = (unsigned char *) malloc (capacity);
+			// Move the data to the start of the buffer first, so the
+			// memory block can be grown with realloc, which can often
+			// extend it in-place without copying.
+			if (buffer->offset) {
+				if (buffer->size)
+					memmove (buffer->data, buffer->data + buffer->offset, buffer->size);
+				buffer->offset = 0;
+			}
+
+			unsigned char *data = (unsigned char *) realloc (buffer->data, capacity);
 			if (data == NULL)
 				return 0;
 
-			if (buffer->size)
-				memcpy (data, buffer->data + buffer->offset, buffer->size);
-
-			free (buffer->data);
-
 			buffer->data = data;
 			buffer->capacity = capacity;
-			buffer->offset = 0;
 		} else {
 			if (buffer->size)
 				memmove (buffer->data, buffer->data + buffer->offset, buffer->size);
@@ -126,6 +188,13 @@ dc_buffer_expand_append (dc_buffer_t *buffer, size_t n)
 static int
 dc_buffer_expand_prepend (dc_buffer_t *buffer, size_t n)
 {
+	if (!buffer->owner) {
+		if (n <= buffer->size)
+			return 1;
+		size_t capacity = dc_buffer_expand_calc (buffer, n);
+		return dc_buffer_detach (buffer, capacity, capacity - buffer->size);
+	}
+
 	size_t available = buffer->capacity - buffer->size;
 
 	if (n > buffer->offset + buffer->size) {
@@ -162,6 +231,9 @@ dc_buffer_reserve (dc_buffer_t *buffer, size_t capacity)
 	if (buffer == NULL)
 		return 0;
 
+	if (!buffer->owner)
+		return dc_buffer_detach (buffer, capacity > buffer->size ? capacity : buffer->size, 0);
+
 	if (capacity <= buffer->capacity)
 		return 1;
 
@@ -197,7 +269,7 @@ dc_buffer_resize (dc_buffer_t *buffer, size_t size)
 int
 dc_buffer_append (dc_buffer_t *buffer, const unsigned char data[], size_t size)
 {
-	if (buffer == NULL)
+	if (buffer == NULL || size > SIZE_MAX - buffer->size)
 		return 0;
 
 	if (!dc_buffer_expand_append (buffer, buffer->size + size))
@@ -215,7 +287,7 @@ dc_buffer_append (dc_buffer_t *buffer, const unsigned char data[], size_t size)
 int
 dc_buffer_prepend (dc_buffer_t *buffer, const unsigned char data[], size_t size)
 {
-	if (buffer == NULL)
+	if (buffer == NULL || size > SIZE_MAX - buffer->size)
 		return 0;
 
 	if (!dc_buffer_expand_prepend (buffer, buffer->size + size))
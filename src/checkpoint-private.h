@@ -0,0 +1,68 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_CHECKPOINT_PRIVATE_H
+#define DC_CHECKPOINT_PRIVATE_H
+
+#include <libdivecomputer/checkpoint.h>
+#include <libdivecomputer/buffer.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Restore the completed part of a memory dump of the given size. Returns
+ * the number of bytes copied into the data array, or zero if nothing was
+ * recorded for the same family and memory size.
+ */
+unsigned int
+dc_checkpoint_get_memory (dc_checkpoint_t *checkpoint, dc_family_t family, unsigned char data[], unsigned int size);
+
+/*
+ * Record the first bytes of a memory dump of the given size, which were
+ * received completely. A zero length discards the recorded data.
+ */
+dc_status_t
+dc_checkpoint_set_memory (dc_checkpoint_t *checkpoint, dc_family_t family, const unsigned char data[], unsigned int size, unsigned int completed);
+
+/*
+ * Check whether a dive was already delivered.
+ */
+int
+dc_checkpoint_has_dive (dc_checkpoint_t *checkpoint, dc_family_t family, const unsigned char fingerprint[], unsigned int size);
+
+/*
+ * Record a delivered dive.
+ */
+dc_status_t
+dc_checkpoint_add_dive (dc_checkpoint_t *checkpoint, dc_family_t family, const unsigned char fingerprint[], unsigned int size);
+
+/*
+ * Append the fingerprint of the first (newest) delivered dive, if any.
+ */
+dc_status_t
+dc_checkpoint_get_newest (dc_checkpoint_t *checkpoint, dc_family_t family, dc_buffer_t *fingerprint);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_CHECKPOINT_PRIVATE_H */
@@ -0,0 +1,193 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "checkpoint-private.h"
+#include "context-private.h"
+
+struct dc_checkpoint_t {
+	dc_context_t *context;
+	dc_family_t family;
+	/* Completed part of the memory dump. */
+	unsigned int memsize;
+	dc_buffer_t *memory;
+	/* Fingerprints of the delivered dives, newest first. */
+	unsigned int fsize;
+	dc_buffer_t *dives;
+};
+
+dc_status_t
+dc_checkpoint_new (dc_checkpoint_t **out, dc_context_t *context)
+{
+	if (out == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_checkpoint_t *checkpoint = (dc_checkpoint_t *) malloc (sizeof (dc_checkpoint_t));
+	if (checkpoint == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	checkpoint->context = context;
+	checkpoint->family = DC_FAMILY_NULL;
+	checkpoint->memsize = 0;
+	checkpoint->fsize = 0;
+	checkpoint->memory = dc_buffer_new (0);
+	checkpoint->dives = dc_buffer_new (0);
+	if (checkpoint->memory == NULL || checkpoint->dives == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		dc_buffer_free (checkpoint->memory);
+		dc_buffer_free (checkpoint->dives);
+		free (checkpoint);
+		return DC_STATUS_NOMEMORY;
+	}
+
+	*out = checkpoint;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_checkpoint_free (dc_checkpoint_t *checkpoint)
+{
+	if (checkpoint == NULL)
+		return DC_STATUS_SUCCESS;
+
+	dc_buffer_free (checkpoint->memory);
+	dc_buffer_free (checkpoint->dives);
+	free (checkpoint);
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_checkpoint_reset (dc_checkpoint_t *checkpoint)
+{
+	if (checkpoint == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	checkpoint->family = DC_FAMILY_NULL;
+	checkpoint->memsize = 0;
+	checkpoint->fsize = 0;
+	dc_buffer_clear (checkpoint->memory);
+	dc_buffer_clear (checkpoint->dives);
+
+	return DC_STATUS_SUCCESS;
+}
+
+static void
+dc_checkpoint_select (dc_checkpoint_t *checkpoint, dc_family_t family)
+{
+	// A checkpoint of another device family is useless.
+	if (checkpoint->family != family) {
+		dc_checkpoint_reset (checkpoint);
+		checkpoint->family = family;
+	}
+}
+
+unsigned int
+dc_checkpoint_get_memory (dc_checkpoint_t *checkpoint, dc_family_t family, unsigned char data[], unsigned int size)
+{
+	if (checkpoint == NULL || checkpoint->family != family || checkpoint->memsize != size)
+		return 0;
+
+	unsigned int completed = dc_buffer_get_size (checkpoint->memory);
+	if (completed > size)
+		return 0;
+
+	memcpy (data, dc_buffer_get_data (checkpoint->memory), completed);
+
+	return completed;
+}
+
+dc_status_t
+dc_checkpoint_set_memory (dc_checkpoint_t *checkpoint, dc_family_t family, const unsigned char data[], unsigned int size, unsigned int completed)
+{
+	if (checkpoint == NULL || completed > size)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_checkpoint_select (checkpoint, family);
+
+	checkpoint->memsize = size;
+	if (!dc_buffer_clear (checkpoint->memory) ||
+		!dc_buffer_append (checkpoint->memory, data, completed)) {
+		ERROR (checkpoint->context, "Failed to allocate memory.");
+		checkpoint->memsize = 0;
+		return DC_STATUS_NOMEMORY;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+int
+dc_checkpoint_has_dive (dc_checkpoint_t *checkpoint, dc_family_t family, const unsigned char fingerprint[], unsigned int size)
+{
+	if (checkpoint == NULL || checkpoint->family != family ||
+		checkpoint->fsize != size || size == 0)
+		return 0;
+
+	const unsigned char *dives = dc_buffer_get_data (checkpoint->dives);
+	unsigned int count = dc_buffer_get_size (checkpoint->dives) / size;
+	for (unsigned int i = 0; i < count; ++i) {
+		if (memcmp (dives + i * size, fingerprint, size) == 0)
+			return 1;
+	}
+
+	return 0;
+}
+
+dc_status_t
+dc_checkpoint_add_dive (dc_checkpoint_t *checkpoint, dc_family_t family, const unsigned char fingerprint[], unsigned int size)
+{
+	if (checkpoint == NULL || size == 0)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_checkpoint_select (checkpoint, family);
+
+	if (checkpoint->fsize != size) {
+		dc_buffer_clear (checkpoint->dives);
+		checkpoint->fsize = size;
+	}
+
+	if (!dc_buffer_append (checkpoint->dives, fingerprint, size)) {
+		ERROR (checkpoint->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_checkpoint_get_newest (dc_checkpoint_t *checkpoint, dc_family_t family, dc_buffer_t *fingerprint)
+{
+	if (checkpoint == NULL || checkpoint->family != family || checkpoint->fsize == 0 ||
+		dc_buffer_get_size (checkpoint->dives) < checkpoint->fsize)
+		return DC_STATUS_SUCCESS;
+
+	if (!dc_buffer_append (fingerprint, dc_buffer_get_data (checkpoint->dives), checkpoint->fsize)) {
+		ERROR (checkpoint->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
@@ -39,7 +39,7 @@ unsigned char
 checksum_xor_uint8 (const unsigned char data[], unsigned int size, unsigned char init);
 
 unsigned short
-checksum_crc_ccitt_uint16 (const unsigned char data[], unsigned int size);
+checksum_crc_ccitt_uint16 (const unsigned char data[], unsigned int size, unsigned short init);
 
 #ifdef __cplusplus
 }
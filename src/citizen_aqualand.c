@@ -33,10 +33,15 @@
 
 #define ISINSTANCE(device) dc_device_isinstance((device), &citizen_aqualand_device_vtable)
 
+#define SZ_PACKET 32
+
+#define FP_OFFSET 0x05
+#define FP_SIZE   8
+
 typedef struct citizen_aqualand_device_t {
 	dc_device_t base;
 	dc_serial_t *port;
-	unsigned char fingerprint[8];
+	unsigned char fingerprint[FP_SIZE];
 } citizen_aqualand_device_t;
 
 static dc_status_t citizen_aqualand_device_set_fingerprint (dc_device_t *abstract, const unsigned char data[], unsigned int size);
@@ -83,6 +88,10 @@ citizen_aqualand_device_open (dc_device_t **out, dc_context_t *context, const ch
 		goto error_free;
 	}
 
+	// Interrupt the blocking reads when the download is cancelled, and
+	// measure the time spent waiting for the I/O.
+	device_set_port ((dc_device_t *) device, device->port);
+
 	// Set the serial communication protocol (4800 8N1).
 	status = dc_serial_configure (device->port, 4800, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -147,13 +156,12 @@ citizen_aqualand_device_set_fingerprint (dc_device_t *abstract, const unsigned c
 }
 
 static dc_status_t
-citizen_aqualand_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
+citizen_aqualand_download (citizen_aqualand_device_t *device, dc_buffer_t *buffer, const unsigned char fingerprint[])
 {
 	dc_status_t status = DC_STATUS_SUCCESS;
-	citizen_aqualand_device_t *device = (citizen_aqualand_device_t *) abstract;
+	dc_device_t *abstract = (dc_device_t *) device;
 
-	// Erase the current contents of the buffer and
-	// pre-allocate the required amount of memory.
+	// Erase the current contents of the buffer.
 	if (!dc_buffer_clear (buffer)) {
 		ERROR (abstract->context, "Insufficient buffer space available.");
 		return DC_STATUS_NOMEMORY;
@@ -179,16 +187,31 @@ citizen_aqualand_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 		return status;
 	}
 
+	unsigned int nbytes = 0;
 	while (1) {
+		// Reserve space for the next packet.
+		if (!dc_buffer_resize (buffer, nbytes + SZ_PACKET)) {
+			ERROR (abstract->context, "Insufficient buffer space available.");
+			return DC_STATUS_NOMEMORY;
+		}
+
 		// Receive the response packet.
-		unsigned char answer[32] = {0};
-		status = dc_serial_read (device->port, answer, sizeof (answer), NULL);
+		unsigned char *answer = dc_buffer_get_data (buffer) + nbytes;
+		status = dc_serial_read (device->port, answer, SZ_PACKET, NULL);
 		if (status != DC_STATUS_SUCCESS) {
 			ERROR (abstract->context, "Failed to receive the answer.");
 			return status;
 		}
 
-		dc_buffer_append(buffer, answer, sizeof (answer));
+		nbytes += SZ_PACKET;
+
+		// The fingerprint is located in the first packet. If it matches,
+		// the dive is already known, and the remainder is not needed.
+		if (fingerprint && nbytes == SZ_PACKET &&
+			memcmp (answer + FP_OFFSET, fingerprint, FP_SIZE) == 0) {
+			status = DC_STATUS_DONE;
+			break;
+		}
 
 		// Send the command.
 		status = dc_serial_write (device->port, command, sizeof (command), NULL);
@@ -197,15 +220,23 @@ citizen_aqualand_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 			return status;
 		}
 
-		if (answer[sizeof(answer) - 1] == 0xFF)
+		if (answer[SZ_PACKET - 1] == 0xFF)
 			break;
 	}
 
 	dc_serial_set_dtr (device->port, 0);
 
-	return DC_STATUS_SUCCESS;
+	return status;
 }
 
+
+static dc_status_t
+citizen_aqualand_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
+{
+	return citizen_aqualand_download ((citizen_aqualand_device_t *) abstract, buffer, NULL);
+}
+
+
 static dc_status_t
 citizen_aqualand_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void *userdata)
 {
@@ -215,17 +246,17 @@ citizen_aqualand_device_foreach (dc_device_t *abstract, dc_dive_callback_t callb
 	if (buffer == NULL)
 		return DC_STATUS_NOMEMORY;
 
-	dc_status_t rc = citizen_aqualand_device_dump (abstract, buffer);
+	dc_status_t rc = citizen_aqualand_download (device, buffer, device->fingerprint);
 	if (rc != DC_STATUS_SUCCESS) {
 		dc_buffer_free (buffer);
-		return rc;
+		return (rc == DC_STATUS_DONE ? DC_STATUS_SUCCESS : rc);
 	}
 
 	unsigned char *data = dc_buffer_get_data (buffer);
 	unsigned int   size = dc_buffer_get_size (buffer);
 
-	if (callback && memcmp (data + 0x05, device->fingerprint, sizeof (device->fingerprint)) != 0) {
-		callback (data, size, data + 0x05, sizeof (device->fingerprint), userdata);
+	if (callback) {
+		callback (data, size, data + FP_OFFSET, sizeof (device->fingerprint), userdata);
 	}
 
 	dc_buffer_free (buffer);
@@ -19,6 +19,8 @@
  * MA 02110-1301 USA
  */
 
+#define DC_LOG_CATEGORY DC_LOGCATEGORY_PARSER
+
 #include <stdlib.h>
 
 #include <libdivecomputer/citizen_aqualand.h>
@@ -48,6 +50,14 @@ static const dc_parser_vtable_t citizen_aqualand_parser_vtable = {
 	citizen_aqualand_parser_get_datetime, /* datetime */
 	citizen_aqualand_parser_get_field, /* fields */
 	citizen_aqualand_parser_samples_foreach, /* samples_foreach */
+	NULL, /* samples_extract */
+	NULL, /* samples_range */
+	NULL, /* samples_seek */
+	NULL, /* samples_index */
+	NULL, /* samples_split */
+	NULL, /* samples_chunk */
+	NULL, /* subdives */
+	NULL, /* samples_vendor */
 	NULL /* destroy */
 };
 
@@ -57,7 +57,11 @@ typedef struct cochran_data_t {
 
 	unsigned int logbook_size;
 
+	// The sample buffer contains the range starting at sample_data_offset,
+	// optionally followed by a second range at the start of the profile
+	// ringbuffer (sample_wrap_size bytes) when the new dives wrap around.
 	unsigned int sample_data_offset;
+	unsigned int sample_wrap_size;
 	unsigned int sample_size;
 } cochran_data_t;
 
@@ -89,6 +93,7 @@ typedef struct cochran_commander_device_t {
 	dc_device_t base;
 	dc_serial_t *port;
 	const cochran_device_layout_t *layout;
+	unsigned int baudrate; // Current baudrate of the serial port.
 	unsigned char id[67];
 	unsigned char fingerprint[6];
 } cochran_commander_device_t;
@@ -223,11 +228,17 @@ cochran_commander_serial_setup (cochran_commander_device_t *device)
 {
 	dc_status_t status = DC_STATUS_SUCCESS;
 
-	// Set the serial communication protocol (9600 8N2, no FC).
-	status = dc_serial_configure (device->port, 9600, 8, DC_PARITY_NONE, DC_STOPBITS_TWO, DC_FLOWCONTROL_NONE);
-	if (status != DC_STATUS_SUCCESS) {
-		ERROR (device->base.context, "Failed to set the terminal attributes.");
-		return status;
+	// Reconfigure the port only if it's not at 9600 baud already.
+	if (device->baudrate != 9600) {
+		// Set the serial communication protocol (9600 8N2, no FC).
+		status = dc_serial_configure (device->port, 9600, 8, DC_PARITY_NONE, DC_STOPBITS_TWO, DC_FLOWCONTROL_NONE);
+		if (status != DC_STATUS_SUCCESS) {
+			ERROR (device->base.context, "Failed to set the terminal attributes.");
+			device->baudrate = 0;
+			return status;
+		}
+
+		device->baudrate = 9600;
 	}
 
 	// Set the timeout for receiving data (5000 ms).
@@ -262,6 +273,21 @@ cochran_commander_serial_setup (cochran_commander_device_t *device)
 }
 
 
+// Drop back to 9600 baud after a failed high speed transfer, so the
+// device can be woken up again for the next command.
+static void
+cochran_commander_serial_reset (cochran_commander_device_t *device)
+{
+	if (device->baudrate == 9600)
+		return;
+
+	if (dc_serial_configure (device->port, 9600, 8, DC_PARITY_NONE, DC_STOPBITS_TWO, DC_FLOWCONTROL_NONE) == DC_STATUS_SUCCESS)
+		device->baudrate = 9600;
+	else
+		device->baudrate = 0;
+}
+
+
 static dc_status_t
 cochran_commander_packet (cochran_commander_device_t *device, dc_event_progress_t *progress,
 	const unsigned char command[], unsigned int csize,
@@ -292,10 +318,15 @@ cochran_commander_packet (cochran_commander_device_t *device, dc_event_progress_
 		dc_serial_sleep(device->port, 45);
 
 		// Rates are odd, like 806400 for the EMC, 115200 for commander
-		status = dc_serial_configure(device->port, device->layout->baudrate, 8, DC_PARITY_NONE, DC_STOPBITS_TWO, DC_FLOWCONTROL_NONE);
-		if (status != DC_STATUS_SUCCESS) {
-			ERROR (abstract->context, "Failed to set the high baud rate.");
-			return status;
+		if (device->baudrate != device->layout->baudrate) {
+			status = dc_serial_configure(device->port, device->layout->baudrate, 8, DC_PARITY_NONE, DC_STOPBITS_TWO, DC_FLOWCONTROL_NONE);
+			if (status != DC_STATUS_SUCCESS) {
+				ERROR (abstract->context, "Failed to set the high baud rate.");
+				device->baudrate = 0;
+				return status;
+			}
+
+			device->baudrate = device->layout->baudrate;
 		}
 	}
 
@@ -310,6 +341,7 @@ cochran_commander_packet (cochran_commander_device_t *device, dc_event_progress_
 		status = dc_serial_read (device->port, answer + nbytes, len, NULL);
 		if (status != DC_STATUS_SUCCESS) {
 			ERROR (abstract->context, "Failed to receive data.");
+			cochran_commander_serial_reset (device);
 			return status;
 		}
 
@@ -415,7 +447,12 @@ cochran_commander_read (cochran_commander_device_t *device, dc_event_progress_t
 		return DC_STATUS_UNSUPPORTED;
 	}
 
-	dc_serial_sleep(device->port, 800);
+	// The device returns to 9600 baud on its own after a high speed
+	// transfer, but needs some time before it accepts a new command.
+	// Without a preceding high speed transfer, the link is still at
+	// 9600 baud and there is nothing to wait for.
+	if (device->baudrate != 9600)
+		dc_serial_sleep(device->port, 800);
 
 	// set back to 9600 baud
 	rc = cochran_commander_serial_setup(device);
@@ -448,61 +485,103 @@ cochran_commander_find_fingerprint(cochran_commander_device_t *device, cochran_d
 }
 
 
+/*
+ *  For corrupt dives the end-of-samples pointer is 0xFFFFFFFF
+ *  search for a reasonable size, e.g. using next dive start sample
+ *  or end-of-samples to limit searching for recoverable samples
+ */
+static unsigned int
+cochran_commander_guess_sample_end_address(cochran_commander_device_t *device, cochran_data_t *data, unsigned int log_num)
+{
+	const unsigned char *log_entry = data->logbook + device->layout->rb_logbook_entry_size * log_num;
+
+	if ((log_num + 1) * device->layout->rb_logbook_entry_size >= data->logbook_size)
+		// Return next usable address from config page
+		return array_uint32_le(data->config + device->layout->cf_last_interdive);
+
+	// Next log's start address
+	return array_uint32_le(log_entry + device->layout->rb_logbook_entry_size + device->layout->pt_profile_begin);
+}
+
+
 static void
 cochran_commander_get_sample_parms(cochran_commander_device_t *device, cochran_data_t *data)
 {
 	dc_device_t *abstract = (dc_device_t *) device;
-	unsigned int pre_dive_offset = 0, end_dive_offset = 0;
+	const cochran_device_layout_t *layout = device->layout;
 
 	unsigned int dive_count = 0;
-	if (data->dive_count < device->layout->rb_logbook_entry_count)
+	if (data->dive_count < layout->rb_logbook_entry_count)
 		dive_count = data->dive_count;
 	else
-		dive_count = device->layout->rb_logbook_entry_count;
+		dive_count = layout->rb_logbook_entry_count;
 
-	// Find lowest and highest offsets into sample data
+	// Find the sample ranges of the new dives. Dives up to the one that
+	// wraps around the end of the ringbuffer are located in a first range,
+	// which is followed by a second range at the start of the ringbuffer.
 	unsigned int low_offset = 0xFFFFFFFF;
 	unsigned int high_offset = 0;
+	unsigned int wrap_offset = 0;
+	int wrapped = 0;
 
 	for (int i = data->fp_dive_num + 1; i < dive_count; i++) {
-		pre_dive_offset = array_uint32_le (data->logbook + i * device->layout->rb_logbook_entry_size
-				+ device->layout->pt_profile_pre);
-		end_dive_offset = array_uint32_le (data->logbook + i * device->layout->rb_logbook_entry_size
-				+ device->layout->pt_profile_end);
+		const unsigned char *log_entry = data->logbook + i * layout->rb_logbook_entry_size;
+		unsigned int pre_dive_offset = array_uint32_le (log_entry + layout->pt_profile_pre);
+		unsigned int end_dive_offset = array_uint32_le (log_entry + layout->pt_profile_end);
 
 		// Validate offsets, allow 0xFFFFFFF for end_dive_offset
 		// because we handle that as a special case.
-		if (pre_dive_offset < device->layout->rb_profile_begin ||
-			pre_dive_offset > device->layout->rb_profile_end) {
+		if (pre_dive_offset < layout->rb_profile_begin ||
+			pre_dive_offset > layout->rb_profile_end) {
 			ERROR(abstract->context, "Invalid pre-dive offset (%08x) on dive %d.", pre_dive_offset, i);
 			continue;
 		}
 
-		if (end_dive_offset < device->layout->rb_profile_begin ||
-			(end_dive_offset > device->layout->rb_profile_end &&
+		if (end_dive_offset < layout->rb_profile_begin ||
+			(end_dive_offset > layout->rb_profile_end &&
 			end_dive_offset != 0xFFFFFFFF)) {
 			ERROR(abstract->context, "Invalid end-dive offset (%08x) on dive %d.", end_dive_offset, i);
 			continue;
 		}
 
-		// Check for ring buffer wrap-around.
-		if (pre_dive_offset > end_dive_offset)
-			break;
+		if (end_dive_offset == 0xFFFFFFFF) {
+			// Corrupt dive, guess the end address
+			end_dive_offset = cochran_commander_guess_sample_end_address(device, data, i);
+			if (end_dive_offset < layout->rb_profile_begin ||
+				end_dive_offset > layout->rb_profile_end)
+				continue;
+		}
+
+		if (!wrapped) {
+			if (pre_dive_offset < low_offset)
+				low_offset = pre_dive_offset;
 
-		if (pre_dive_offset < low_offset)
-			low_offset = pre_dive_offset;
-		if (end_dive_offset > high_offset && end_dive_offset != 0xFFFFFFFF )
-			high_offset = end_dive_offset;
+			if (pre_dive_offset > end_dive_offset) {
+				// Dive wraps around the end of the ringbuffer.
+				wrapped = 1;
+				wrap_offset = end_dive_offset;
+			} else if (end_dive_offset > high_offset) {
+				high_offset = end_dive_offset;
+			}
+		} else if (end_dive_offset > wrap_offset) {
+			wrap_offset = end_dive_offset;
+		}
 	}
 
-	if (pre_dive_offset > end_dive_offset) {
-		high_offset = device->layout->rb_profile_end;
-		low_offset = device->layout->rb_profile_begin;
+	data->sample_wrap_size = 0;
+	if (wrapped) {
 		data->sample_data_offset = low_offset;
-		data->sample_size = high_offset - low_offset;
-	} else if (low_offset < 0xFFFFFFFF && high_offset > 0) {
+		data->sample_wrap_size = wrap_offset - layout->rb_profile_begin;
+		data->sample_size = (layout->rb_profile_end - low_offset) + data->sample_wrap_size;
+		if (data->sample_size > layout->rb_profile_end - layout->rb_profile_begin) {
+			// The ranges overlap, read the entire ringbuffer instead.
+			data->sample_data_offset = layout->rb_profile_begin;
+			data->sample_wrap_size = 0;
+			data->sample_size = layout->rb_profile_end - layout->rb_profile_begin;
+		}
+	} else if (low_offset < 0xFFFFFFFF && high_offset > low_offset) {
 		data->sample_data_offset = low_offset;
-		data->sample_size = high_offset - data->sample_data_offset;
+		data->sample_size = high_offset - low_offset;
 	} else {
 		data->sample_data_offset = 0;
 		data->sample_size = 0;
@@ -510,22 +589,25 @@ cochran_commander_get_sample_parms(cochran_commander_device_t *device, cochran_d
 }
 
 
-/*
- *  For corrupt dives the end-of-samples pointer is 0xFFFFFFFF
- *  search for a reasonable size, e.g. using next dive start sample
- *  or end-of-samples to limit searching for recoverable samples
- */
-static unsigned int
-cochran_commander_guess_sample_end_address(cochran_commander_device_t *device, cochran_data_t *data, unsigned int log_num)
+// Get a pointer to the sample data at the given address, or NULL if that
+// range was not read from the device.
+static const unsigned char *
+cochran_commander_get_samples (cochran_commander_device_t *device, cochran_data_t *data, unsigned int address, unsigned int size)
 {
-	const unsigned char *log_entry = data->logbook + device->layout->rb_logbook_entry_size * log_num;
+	unsigned int first = data->sample_size - data->sample_wrap_size;
+	unsigned int begin = device->layout->rb_profile_begin;
 
-	if (log_num == data->dive_count)
-		// Return next usable address from config page
-		return array_uint32_le(data->config + device->layout->rb_profile_end);
+	if (address >= data->sample_data_offset &&
+		address - data->sample_data_offset <= first &&
+		size <= first - (address - data->sample_data_offset))
+		return data->sample + address - data->sample_data_offset;
 
-	// Next log's start address
-	return array_uint32_le(log_entry + device->layout->rb_logbook_entry_size + device->layout->pt_profile_begin);
+	if (address >= begin &&
+		address - begin <= data->sample_wrap_size &&
+		size <= data->sample_wrap_size - (address - begin))
+		return data->sample + first + address - begin;
+
+	return NULL;
 }
 
 
@@ -596,12 +678,22 @@ cochran_commander_read_all (cochran_commander_device_t *device, cochran_data_t *
 			return DC_STATUS_NOMEMORY;
 		}
 
-		// Read the sample data
-		rc = cochran_commander_read (device, &progress, data->sample_data_offset, data->sample, data->sample_size);
+		// Read the sample data, up to the end of the ringbuffer
+		unsigned int first = data->sample_size - data->sample_wrap_size;
+		rc = cochran_commander_read (device, &progress, data->sample_data_offset, data->sample, first);
 		if (rc != DC_STATUS_SUCCESS) {
 			ERROR (abstract->context, "Failed to read the sample data.");
 			return rc;
 		}
+
+		// Read the remaining sample data from the start of the ringbuffer
+		if (data->sample_wrap_size) {
+			rc = cochran_commander_read (device, &progress, device->layout->rb_profile_begin, data->sample + first, data->sample_wrap_size);
+			if (rc != DC_STATUS_SUCCESS) {
+				ERROR (abstract->context, "Failed to read the sample data.");
+				return rc;
+			}
+		}
 	}
 
 	return DC_STATUS_SUCCESS;
@@ -625,6 +717,7 @@ cochran_commander_device_open (dc_device_t **out, dc_context_t *context, const c
 
 	// Set the default values.
 	device->port = NULL;
+	device->baudrate = 0;
 	cochran_commander_device_set_fingerprint((dc_device_t *) device, NULL, 0);
 
 	// Open the device.
@@ -634,6 +727,10 @@ cochran_commander_device_open (dc_device_t **out, dc_context_t *context, const c
 		goto error_free;
 	}
 
+	// Interrupt the blocking reads when the download is cancelled, and
+	// measure the time spent waiting for the I/O.
+	device_set_port ((dc_device_t *) device, device->port);
+
 	status = cochran_commander_serial_setup(device);
 	if (status != DC_STATUS_SUCCESS) {
 		goto error_close;
@@ -684,6 +781,9 @@ cochran_commander_device_close (dc_device_t *abstract)
 	cochran_commander_device_t *device = (cochran_commander_device_t *) abstract;
 	dc_status_t rc = DC_STATUS_SUCCESS;
 
+	// Leave the port at 9600 baud.
+	cochran_commander_serial_reset (device);
+
 	// Close the device.
 	rc = dc_serial_close (device->port);
 	if (rc != DC_STATUS_SUCCESS) {
@@ -832,20 +932,31 @@ cochran_commander_device_foreach (dc_device_t *abstract, dc_dive_callback_t call
 		}
 		last_start_address = sample_start_address;
 
-		unsigned char *sample = NULL;
+		const unsigned char *sample = NULL, *wrap = NULL;
 		int sample_size = 0;
 		if (profile_capacity_remaining < 0) {
 			// There is no profile for this dive
 			sample = NULL;
 			sample_size = 0;
-		} else {
+		} else if (sample_start_address <= sample_end_address) {
 			// Calculate the size of the profile only
-			sample = data.sample + sample_start_address - data.sample_data_offset;
 			sample_size = sample_end_address - sample_start_address;
+			sample = cochran_commander_get_samples (device, &data, sample_start_address, sample_size);
+		} else {
+			// Adjust for ring buffer wrap-around
+			sample_size = sample_end_address - sample_start_address +
+				device->layout->rb_profile_end - device->layout->rb_profile_begin;
+			sample = cochran_commander_get_samples (device, &data, sample_start_address,
+				device->layout->rb_profile_end - sample_start_address);
+			wrap = cochran_commander_get_samples (device, &data, device->layout->rb_profile_begin,
+				sample_end_address - device->layout->rb_profile_begin);
+			if (wrap == NULL)
+				sample = NULL;
+		}
 
-			if (sample_size < 0)
-				// Adjust for ring buffer wrap-around
-				sample_size += device->layout->rb_profile_end - device->layout->rb_profile_begin;
+		if (sample_size && sample == NULL) {
+			WARNING (abstract->context, "Profile data of dive %d not available.", i);
+			sample_size = 0;
 		}
 
 		// Build dive blob
@@ -868,7 +979,7 @@ cochran_commander_device_foreach (dc_device_t *abstract, dc_dive_callback_t call
 
 				memcpy(dive + device->layout->rb_logbook_entry_size, sample, size);
 				memcpy(dive + device->layout->rb_logbook_entry_size + size,
-					data.sample, sample_end_address - device->layout->rb_profile_begin);
+					wrap, sample_end_address - device->layout->rb_profile_begin);
 			}
 		}
 
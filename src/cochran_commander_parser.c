@@ -19,6 +19,8 @@
  * MA 02110-1301 USA
  */
 
+#define DC_LOG_CATEGORY DC_LOGCATEGORY_PARSER
+
 #include <stdlib.h>
 #include <math.h>
 
@@ -38,6 +40,10 @@
 
 #define UNSUPPORTED 0xFFFFFFFF
 
+// Larger than the largest inter-dive event.
+#define BACKPARSE_WINDOW 32
+#define BACKPARSE_BUDGET 0x100000
+
 typedef enum cochran_sample_format_t {
 	SAMPLE_CMDR,
 	SAMPLE_EMC,
@@ -98,6 +104,14 @@ static const dc_parser_vtable_t cochran_commander_parser_vtable = {
 	cochran_commander_parser_get_datetime, /* datetime */
 	cochran_commander_parser_get_field, /* fields */
 	cochran_commander_parser_samples_foreach, /* samples_foreach */
+	NULL, /* samples_extract */
+	NULL, /* samples_range */
+	NULL, /* samples_seek */
+	NULL, /* samples_index */
+	NULL, /* samples_split */
+	NULL, /* samples_chunk */
+	NULL, /* subdives */
+	NULL, /* samples_vendor */
 	NULL /* destroy */
 };
 
@@ -252,24 +266,48 @@ cochran_commander_handle_event (cochran_commander_parser_t *parser, unsigned cha
 /*
  * Used to find the end of a dive that has an incomplete dive-end
  * block. It parses backwards past inter-dive events.
+ *
+ * Because we are parsing backwards and the events vary in size, we can't
+ * be sure the byte that matches an event code is an event code or data
+ * from inside a longer or shorter event. Every position that can be
+ * reached from the end through a chain of matching events is therefore
+ * marked, and the lowest one is the end of the samples. Since an event
+ * is never larger than the window, only the marks within one window
+ * below the current position need to be kept.
  */
 static int
 cochran_commander_backparse(cochran_commander_parser_t *parser, const unsigned char *samples, int size)
 {
-	int result = size, best_result = size;
-
-	for (unsigned int i = 0; i < parser->nevents; i++) {
-		int ptr = size - parser->events[i].size;
-		if (ptr > 0 && samples[ptr] == parser->events[i].code) {
-			// Recurse to find the largest match. Because we are parsing backwards
-			// and the events vary in size we can't be sure the byte that matches
-			// the event code is an event code or data from inside a longer or shorter
-			// event.
-			result = cochran_commander_backparse(parser, samples, ptr);
+	dc_parser_t *abstract = (dc_parser_t *) parser;
+	unsigned char reachable[BACKPARSE_WINDOW] = {0};
+	unsigned int budget = BACKPARSE_BUDGET;
+	unsigned int count = 0;
+	int best_result = size;
+
+	if (size <= 0)
+		return size;
+
+	reachable[size % BACKPARSE_WINDOW] = 1;
+	for (int pos = size; pos > 0 && pos + BACKPARSE_WINDOW > best_result; pos--) {
+		if (!reachable[pos % BACKPARSE_WINDOW])
+			continue;
+
+		reachable[pos % BACKPARSE_WINDOW] = 0;
+		best_result = pos;
+
+		if (budget < parser->nevents) {
+			WARNING (abstract->context, "Backparse budget exhausted at offset %d.", pos);
+			break;
 		}
 
-		if (result < best_result) {
-			best_result = result;
+		if (++count % PARSER_CANCEL_INTERVAL == 0 && parser_is_cancelled (abstract))
+			break;
+		budget -= parser->nevents;
+
+		for (unsigned int i = 0; i < parser->nevents; i++) {
+			int ptr = pos - (int) parser->events[i].size;
+			if (ptr > 0 && samples[ptr] == parser->events[i].code)
+				reachable[ptr % BACKPARSE_WINDOW] = 1;
 		}
 	}
 
@@ -464,6 +502,7 @@ cochran_commander_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callb
 	unsigned int deco_obligation = 0;
 	unsigned int deco_ceiling = 0;
 	unsigned int corrupt_dive = 0;
+	unsigned int count = 0;
 
 	// In rare circumstances Cochran computers won't record the end-of-dive
 	// log entry block. When the end-sample pointer is 0xFFFFFFFF it's corrupt.
@@ -478,6 +517,8 @@ cochran_commander_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callb
 
 		// Eliminate inter-dive events
 		size = cochran_commander_backparse(parser, samples, size);
+		if (parser_is_cancelled (abstract))
+			return DC_STATUS_CANCELLED;
 	}
 
 	// Cochran samples depth every second and varies between ascent rate
@@ -504,6 +545,9 @@ cochran_commander_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callb
 	while (offset < size) {
 		const unsigned char *s = samples + offset;
 
+		if (++count % PARSER_CANCEL_INTERVAL == 0 && parser_is_cancelled (abstract))
+			return DC_STATUS_CANCELLED;
+
 		sample.time = time;
 		if (last_sample_time != sample.time) {
 			// We haven't issued this time yet.
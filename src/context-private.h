@@ -46,13 +46,26 @@ extern "C" {
 #define ATTR_FORMAT_PRINTF(a,b)
 #endif
 
+/*
+ * The log category of the messages from a source file. Files outside the
+ * backends define it before including any header.
+ */
+#ifndef DC_LOG_CATEGORY
+#define DC_LOG_CATEGORY DC_LOGCATEGORY_PROTOCOL
+#endif
+
 #ifdef ENABLE_LOGGING
-#define HEXDUMP(context, loglevel, prefix, data, size) dc_context_hexdump (context, loglevel, __FILE__, __LINE__, FUNCTION, prefix, data, size)
-#define SYSERROR(context, errcode) dc_context_syserror (context, DC_LOGLEVEL_ERROR, __FILE__, __LINE__, FUNCTION, errcode)
-#define ERROR(context, ...) dc_context_log (context, DC_LOGLEVEL_ERROR, __FILE__, __LINE__, FUNCTION, __VA_ARGS__)
-#define WARNING(context, ...) dc_context_log (context, DC_LOGLEVEL_WARNING, __FILE__, __LINE__, FUNCTION, __VA_ARGS__)
-#define INFO(context, ...) dc_context_log (context, DC_LOGLEVEL_INFO, __FILE__, __LINE__, FUNCTION, __VA_ARGS__)
-#define DEBUG(context, ...) dc_context_log (context, DC_LOGLEVEL_DEBUG, __FILE__, __LINE__, FUNCTION, __VA_ARGS__)
+/*
+ * The arguments are only evaluated, and the message is only formatted, if the
+ * loglevel is enabled for the category in the context.
+ */
+#define DC_LOG_ENABLED(context, loglevel) dc_context_is_logged (context, DC_LOG_CATEGORY, loglevel)
+#define HEXDUMP(context, loglevel, prefix, data, size) (DC_LOG_ENABLED (context, loglevel) ? dc_context_hexdump (context, loglevel, __FILE__, __LINE__, FUNCTION, prefix, data, size) : DC_STATUS_SUCCESS)
+#define SYSERROR(context, errcode) (DC_LOG_ENABLED (context, DC_LOGLEVEL_ERROR) ? dc_context_syserror (context, DC_LOGLEVEL_ERROR, __FILE__, __LINE__, FUNCTION, errcode) : DC_STATUS_SUCCESS)
+#define ERROR(context, ...) (DC_LOG_ENABLED (context, DC_LOGLEVEL_ERROR) ? dc_context_log (context, DC_LOGLEVEL_ERROR, __FILE__, __LINE__, FUNCTION, __VA_ARGS__) : DC_STATUS_SUCCESS)
+#define WARNING(context, ...) (DC_LOG_ENABLED (context, DC_LOGLEVEL_WARNING) ? dc_context_log (context, DC_LOGLEVEL_WARNING, __FILE__, __LINE__, FUNCTION, __VA_ARGS__) : DC_STATUS_SUCCESS)
+#define INFO(context, ...) (DC_LOG_ENABLED (context, DC_LOGLEVEL_INFO) ? dc_context_log (context, DC_LOGLEVEL_INFO, __FILE__, __LINE__, FUNCTION, __VA_ARGS__) : DC_STATUS_SUCCESS)
+#define DEBUG(context, ...) (DC_LOG_ENABLED (context, DC_LOGLEVEL_DEBUG) ? dc_context_log (context, DC_LOGLEVEL_DEBUG, __FILE__, __LINE__, FUNCTION, __VA_ARGS__) : DC_STATUS_SUCCESS)
 #else
 #define HEXDUMP(context, loglevel, prefix, data, size) UNUSED(context)
 #define SYSERROR(context, errcode) UNUSED(context)
@@ -68,6 +81,105 @@ dc_context_log (dc_context_t *context, dc_loglevel_t loglevel, const char *file,
 dc_status_t
 dc_context_syserror (dc_context_t *context, dc_loglevel_t loglevel, const char *file, unsigned int line, const char *function, int errcode);
 
+int
+dc_context_is_logged (dc_context_t *context, dc_logcategory_t category, dc_loglevel_t loglevel);
+
+const char *
+dc_context_get_record (dc_context_t *context);
+
+const char *
+dc_context_get_replay (dc_context_t *context);
+
+const dc_iothread_t *
+dc_context_get_iothread (dc_context_t *context);
+
+unsigned long long
+dc_context_clock (void);
+
+/*
+ * Account for memory allocated and freed by the devices and parsers of
+ * the context. Safe to call from multiple threads.
+ */
+void
+dc_context_memory_add (dc_context_t *context, size_t size);
+
+/*
+ * Check whether the parser statistics are enabled, and add the counters
+ * of a parser to those of its family. Safe to call from multiple threads.
+ */
+int
+dc_context_parser_stats_enabled (dc_context_t *context);
+
+void
+dc_context_parser_stats_add (dc_context_t *context, dc_family_t family, const dc_parser_stats_t *stats);
+
+void
+dc_context_memory_sub (dc_context_t *context, size_t size);
+
+/*
+ * Allocate an object from the storage of the context, or from the heap
+ * without storage.
+ */
+void *
+dc_context_allocate (dc_context_t *context, size_t size);
+
+void
+dc_context_deallocate (dc_context_t *context, void *ptr);
+
+int
+dc_context_is_tracing (dc_context_t *context);
+
+void
+dc_context_trace (dc_context_t *context, dc_trace_type_t type, dc_status_t status, unsigned long long begin, const void *data, unsigned int size);
+
+#ifdef HAVE_LIBUSB
+struct libusb_context;
+
+/*
+ * Get the libusb context, which is shared by all devices of the same
+ * context. It's created on first use, and destroyed with the context.
+ * Every successful call must be balanced with a dc_context_usb_release.
+ */
+dc_status_t
+dc_context_usb_acquire (dc_context_t *context, struct libusb_context **usb);
+
+void
+dc_context_usb_release (dc_context_t *context, struct libusb_context *usb);
+#endif
+
+#ifdef HAVE_HIDAPI
+/*
+ * Initialize the hidapi library once per context, instead of once per
+ * device. The library is released again when the context is destroyed.
+ */
+dc_status_t
+dc_context_hid_acquire (dc_context_t *context);
+
+void
+dc_context_hid_release (dc_context_t *context);
+#endif
+
+/*
+ * Retrieve or store a connection hint, identified by its name, for a model
+ * of the given family, in the sync store attached to the context. Without
+ * a store, nothing is stored, the value is left unchanged and
+ * DC_STATUS_SUCCESS is returned.
+ */
+dc_status_t
+dc_context_get_hint (dc_context_t *context, dc_family_t family, unsigned int model, const char *name, unsigned int *value);
+
+dc_status_t
+dc_context_set_hint (dc_context_t *context, dc_family_t family, unsigned int model, const char *name, unsigned int value);
+
+/*
+ * Run the worker function on up to count threads of the thread pool of
+ * the context, including the calling thread, and wait until all of them
+ * have returned. The workers must share their work through a queue, and
+ * return once it is empty. See dc_executor_run for the details.
+ */
+void
+dc_context_run (dc_context_t *context, void (*func) (void *userdata), void *userdata, unsigned int count);
+
 dc_status_t
 dc_context_hexdump (dc_context_t *context, dc_loglevel_t loglevel, const char *file, unsigned int line, const char *function, const char *prefix, const unsigned char data[], unsigned int size);
 
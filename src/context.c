@@ -29,21 +29,84 @@
 #include <windows.h>
 #else
 #include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_LIBUSB
+#include <libusb-1.0/libusb.h>
+#endif
+#ifdef HAVE_HIDAPI
+#include <hidapi/hidapi.h>
 #endif
 
 #include "context-private.h"
+#include "syncstore-private.h"
+#include "executor.h"
+#include "thread.h"
+
+#define NCATEGORIES (DC_LOGCATEGORY_FIRMWARE + 1)
+
+typedef struct dc_context_parser_stats_t {
+	dc_family_t family;
+	dc_parser_stats_t stats;
+} dc_context_parser_stats_t;
 
 struct dc_context_t {
 	dc_loglevel_t loglevel;
+	dc_loglevel_t loglevels[NCATEGORIES];
 	dc_logfunc_t logfunc;
 	void *userdata;
+	char *record;
+	char *replay;
+	dc_iothread_t iothread;
+	int iothread_enabled;
+	dc_mutex_t *trace_mutex;
+	dc_trace_t *trace;
+	unsigned int trace_capacity;
+	unsigned int trace_first;
+	unsigned int trace_count;
+	unsigned int trace_sequence;
+	dc_syncstore_t *syncstore;
+	dc_executor_t *executor;
+	unsigned int memory_current;
+	unsigned int memory_peak;
+	unsigned int parser_stats;
+	dc_mutex_t *parser_stats_mutex;
+	dc_context_parser_stats_t *parser_stats_families;
+	unsigned int parser_stats_count;
+	dc_mutex_t *storage_mutex;
+	unsigned char *storage;
+	size_t storage_size;
+	size_t storage_used;
+#if defined(HAVE_LIBUSB) || defined(HAVE_HIDAPI)
+	dc_mutex_t *usb_mutex;
+#endif
+#ifdef HAVE_LIBUSB
+	libusb_context *usb;
+	unsigned int usb_refcount;
+#endif
+#ifdef HAVE_HIDAPI
+	unsigned int hid_refcount;
+	int hid_initialized;
+#endif
 #ifdef ENABLE_LOGGING
+	dc_mutex_t *mutex;
 	char msg[8192 + 32];
 #ifdef _WIN32
 	LARGE_INTEGER timestamp, frequency;
 #else
 	struct timeval timestamp;
 #endif
+	unsigned long long logtime;
+	dc_mutex_t *async_mutex;
+	dc_cond_t *async_cond;
+	dc_thread_t *async_thread;
+	unsigned char *async_ring;
+	unsigned char *async_scratch;
+	size_t async_capacity, async_head, async_size;
+	unsigned int async_dropped;
+	int async_quit;
 #endif
 };
 
@@ -129,28 +192,36 @@ l_hexdump (char *str, size_t size, const unsigned char data[], size_t n)
 	return (n > maxlength ? -1 : length * 2);
 }
 
-static void
-logfunc (dc_context_t *context, dc_loglevel_t loglevel, const char *file, unsigned int line, const char *function, const char *msg, void *userdata)
+/*
+ * The time elapsed since the context was created, in microseconds.
+ */
+static unsigned long long
+l_elapsed (dc_context_t *context)
 {
-	const char *loglevels[] = {"NONE", "ERROR", "WARNING", "INFO", "DEBUG", "ALL"};
-
-	unsigned long seconds = 0, microseconds = 0;
-
 #ifdef _WIN32
 	LARGE_INTEGER now, delta;
 	QueryPerformanceCounter(&now);
 	delta.QuadPart = now.QuadPart - context->timestamp.QuadPart;
 	delta.QuadPart *= 1000000;
 	delta.QuadPart /= context->frequency.QuadPart;
-	seconds = delta.QuadPart / 1000000;
-	microseconds = delta.QuadPart % 1000000;
+	return delta.QuadPart;
 #else
 	struct timeval now, delta;
 	gettimeofday (&now, NULL);
 	timersub (&now, &context->timestamp, &delta);
-	seconds = delta.tv_sec;
-	microseconds = delta.tv_usec;
+	return (unsigned long long) delta.tv_sec * 1000000 + delta.tv_usec;
 #endif
+}
+
+static void
+logfunc (dc_context_t *context, dc_loglevel_t loglevel, const char *file, unsigned int line, const char *function, const char *msg, void *userdata)
+{
+	const char *loglevels[] = {"NONE", "ERROR", "WARNING", "INFO", "DEBUG", "ALL"};
+
+	// The time at which the message was logged, which differs from the
+	// current time if the delivery is asynchronous.
+	unsigned long seconds = context->logtime / 1000000;
+	unsigned long microseconds = context->logtime % 1000000;
 
 	if (loglevel == DC_LOGLEVEL_ERROR || loglevel == DC_LOGLEVEL_WARNING) {
 		fprintf (stderr, "[%li.%06li] %s: %s [in %s:%d (%s)]\n",
@@ -162,7 +233,182 @@ logfunc (dc_context_t *context, dc_loglevel_t loglevel, const char *file, unsign
 			loglevels[loglevel], msg);
 	}
 }
+
+#define LOG_MESSAGE 0
+#define LOG_HEXDUMP 1
+
+/*
+ * A log record in the asynchronous ring buffer. The header is followed
+ * by the null terminated message, or for a hexdump by the null terminated
+ * prefix and the raw bytes. Records wrap around the end of the buffer.
+ */
+typedef struct dc_logrecord_t {
+	unsigned int type;
+	dc_loglevel_t loglevel;
+	const char *file;
+	unsigned int line;
+	const char *function;
+	unsigned long long timestamp;
+	unsigned int size;
+	unsigned int length;
+} dc_logrecord_t;
+
+static void
+l_ring_write (dc_context_t *context, size_t offset, const void *data, size_t size)
+{
+	if (size == 0)
+		return;
+
+	size_t position = (context->async_head + context->async_size + offset) % context->async_capacity;
+	size_t n = context->async_capacity - position;
+	if (n > size)
+		n = size;
+	memcpy (context->async_ring + position, data, n);
+	memcpy (context->async_ring, (const unsigned char *) data + n, size - n);
+}
+
+static void
+l_ring_read (dc_context_t *context, void *data, size_t size)
+{
+	size_t n = context->async_capacity - context->async_head;
+	if (n > size)
+		n = size;
+	memcpy (data, context->async_ring + context->async_head, n);
+	memcpy ((unsigned char *) data + n, context->async_ring, size - n);
+	context->async_head = (context->async_head + size) % context->async_capacity;
+	context->async_size -= size;
+}
+
+/*
+ * Queue a record for the logging thread. Only the raw data is copied
+ * here, while holding the lock. If the ring buffer is full, the record
+ * is dropped rather than blocking the caller.
+ */
+static void
+l_enqueue (dc_context_t *context, dc_logrecord_t *record, const void *data1, size_t size1, const void *data2, size_t size2)
+{
+	record->timestamp = l_elapsed (context);
+	record->length = size1 + size2;
+
+	size_t total = sizeof (dc_logrecord_t) + record->length;
+
+	dc_mutex_lock (context->async_mutex);
+	if (total > context->async_capacity - context->async_size) {
+		context->async_dropped++;
+	} else {
+		l_ring_write (context, 0, record, sizeof (dc_logrecord_t));
+		l_ring_write (context, sizeof (dc_logrecord_t), data1, size1);
+		l_ring_write (context, sizeof (dc_logrecord_t) + size1, data2, size2);
+		context->async_size += total;
+		dc_cond_broadcast (context->async_cond);
+	}
+	dc_mutex_unlock (context->async_mutex);
+}
+
+/*
+ * The logging thread, which formats the queued records and passes them
+ * to the log function, until it is asked to quit and the ring buffer is
+ * empty.
+ */
+static void
+l_thread (void *userdata)
+{
+	dc_context_t *context = (dc_context_t *) userdata;
+
+	while (1) {
+		dc_logrecord_t record;
+
+		dc_mutex_lock (context->async_mutex);
+		while (context->async_size == 0 && !context->async_quit)
+			dc_cond_wait (context->async_cond, context->async_mutex);
+		if (context->async_size == 0) {
+			dc_mutex_unlock (context->async_mutex);
+			break;
+		}
+		l_ring_read (context, &record, sizeof (record));
+		l_ring_read (context, context->async_scratch, record.length);
+		unsigned int dropped = context->async_dropped;
+		context->async_dropped = 0;
+		dc_mutex_unlock (context->async_mutex);
+
+		dc_mutex_lock (context->mutex);
+
+		if (context->logfunc) {
+			context->logtime = record.timestamp;
+
+			if (dropped) {
+				l_snprintf (context->msg, sizeof (context->msg), "%u log messages dropped.", dropped);
+				context->logfunc (context, DC_LOGLEVEL_WARNING, __FILE__, __LINE__, __func__, context->msg, context->userdata);
+			}
+
+			const char *text = (const char *) context->async_scratch;
+			if (record.type == LOG_HEXDUMP) {
+				size_t length = strlen (text) + 1;
+				int n = l_snprintf (context->msg, sizeof (context->msg), "%s: size=%u, data=", text, record.size);
+				if (n >= 0) {
+					l_hexdump (context->msg + n, sizeof (context->msg) - n, context->async_scratch + length, record.length - length);
+				}
+				text = context->msg;
+			}
+
+			context->logfunc (context, record.loglevel, record.file, record.line, record.function, text, context->userdata);
+		}
+
+		dc_mutex_unlock (context->mutex);
+	}
+}
+
+/*
+ * Stop the logging thread, after it delivered all pending messages, and
+ * free the ring buffer.
+ */
+static void
+l_async_stop (dc_context_t *context)
+{
+	if (context->async_thread == NULL)
+		return;
+
+	dc_mutex_lock (context->async_mutex);
+	context->async_quit = 1;
+	dc_cond_broadcast (context->async_cond);
+	dc_mutex_unlock (context->async_mutex);
+
+	dc_thread_join (context->async_thread);
+
+	dc_cond_free (context->async_cond);
+	dc_mutex_free (context->async_mutex);
+	free (context->async_ring);
+	free (context->async_scratch);
+
+	context->async_thread = NULL;
+	context->async_cond = NULL;
+	context->async_mutex = NULL;
+	context->async_ring = NULL;
+	context->async_scratch = NULL;
+	context->async_capacity = 0;
+}
+#endif
+
+/*
+ * The default size of the thread pool: one thread less than the number of
+ * processors, because the calling thread does its share of the work.
+ */
+static unsigned int
+dc_context_default_threads (void)
+{
+	long nprocessors = 1;
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo (&info);
+	nprocessors = info.dwNumberOfProcessors;
+#elif defined(_SC_NPROCESSORS_ONLN)
+	nprocessors = sysconf (_SC_NPROCESSORS_ONLN);
 #endif
+	if (nprocessors < 1)
+		nprocessors = 1;
+
+	return nprocessors - 1;
+}
 
 dc_status_t
 dc_context_new (dc_context_t **out)
@@ -183,10 +429,75 @@ dc_context_new (dc_context_t **out)
 	context->loglevel = DC_LOGLEVEL_NONE;
 	context->logfunc = NULL;
 #endif
+	for (unsigned int i = 0; i < NCATEGORIES; ++i) {
+		context->loglevels[i] = context->loglevel;
+	}
 	context->userdata = NULL;
+	context->record = NULL;
+	context->replay = NULL;
+	memset (&context->iothread, 0, sizeof (context->iothread));
+	context->iothread_enabled = 0;
+	context->trace_mutex = NULL;
+	context->trace = NULL;
+	context->trace_capacity = 0;
+	context->trace_first = 0;
+	context->trace_count = 0;
+	context->trace_sequence = 0;
+	context->syncstore = NULL;
+	context->memory_current = 0;
+	context->memory_peak = 0;
+	context->parser_stats = 0;
+	context->parser_stats_mutex = NULL;
+	context->parser_stats_families = NULL;
+	context->parser_stats_count = 0;
+	context->storage_mutex = NULL;
+	context->storage = NULL;
+	context->storage_size = 0;
+	context->storage_used = 0;
+#ifdef HAVE_LIBUSB
+	context->usb = NULL;
+	context->usb_refcount = 0;
+#endif
+#ifdef HAVE_HIDAPI
+	context->hid_refcount = 0;
+	context->hid_initialized = 0;
+#endif
+
+	if (dc_executor_new (&context->executor, dc_context_default_threads ()) != DC_STATUS_SUCCESS) {
+		free (context);
+		return DC_STATUS_NOMEMORY;
+	}
+
+#if defined(HAVE_LIBUSB) || defined(HAVE_HIDAPI)
+	if (dc_mutex_new (&context->usb_mutex) != DC_STATUS_SUCCESS) {
+		dc_executor_free (context->executor);
+		free (context);
+		return DC_STATUS_NOMEMORY;
+	}
+#endif
 
 #ifdef ENABLE_LOGGING
+	if (dc_mutex_new (&context->mutex) != DC_STATUS_SUCCESS) {
+#if defined(HAVE_LIBUSB) || defined(HAVE_HIDAPI)
+		dc_mutex_free (context->usb_mutex);
+#endif
+		dc_executor_free (context->executor);
+		free (context);
+		return DC_STATUS_NOMEMORY;
+	}
+
 	memset (context->msg, 0, sizeof (context->msg));
+	context->logtime = 0;
+	context->async_mutex = NULL;
+	context->async_cond = NULL;
+	context->async_thread = NULL;
+	context->async_ring = NULL;
+	context->async_scratch = NULL;
+	context->async_capacity = 0;
+	context->async_head = 0;
+	context->async_size = 0;
+	context->async_dropped = 0;
+	context->async_quit = 0;
 #ifdef _WIN32
 	QueryPerformanceFrequency(&context->frequency);
 	QueryPerformanceCounter(&context->timestamp);
@@ -203,11 +514,369 @@ dc_context_new (dc_context_t **out)
 dc_status_t
 dc_context_free (dc_context_t *context)
 {
+	if (context == NULL)
+		return DC_STATUS_SUCCESS;
+
+	dc_executor_free (context->executor);
+
+#ifdef HAVE_LIBUSB
+	if (context->usb_refcount)
+		WARNING (context, "The libusb context is still in use.");
+	if (context->usb)
+		libusb_exit (context->usb);
+#endif
+#ifdef HAVE_HIDAPI
+	if (context->hid_refcount)
+		WARNING (context, "The hidapi library is still in use.");
+	if (context->hid_initialized)
+		hid_exit ();
+#endif
+#if defined(HAVE_LIBUSB) || defined(HAVE_HIDAPI)
+	dc_mutex_free (context->usb_mutex);
+#endif
+#ifdef ENABLE_LOGGING
+	l_async_stop (context);
+	dc_mutex_free (context->mutex);
+#endif
+	dc_mutex_free (context->trace_mutex);
+	dc_mutex_free (context->parser_stats_mutex);
+	dc_mutex_free (context->storage_mutex);
+	free (context->parser_stats_families);
+	free (context->trace);
+	free (context->record);
+	free (context->replay);
 	free (context);
 
 	return DC_STATUS_SUCCESS;
 }
 
+dc_status_t
+dc_context_set_threads (dc_context_t *context, unsigned int nthreads)
+{
+	if (context == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_executor_set_threads (context->executor, nthreads);
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_context_set_submitfunc (dc_context_t *context, dc_submitfunc_t submit, void *userdata)
+{
+	if (context == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_executor_set_submitfunc (context->executor, submit, userdata);
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_context_get_memory_usage (dc_context_t *context, size_t *current, size_t *peak)
+{
+	if (context == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (current)
+		*current = dc_atomic_load (&context->memory_current);
+	if (peak)
+		*peak = dc_atomic_load (&context->memory_peak);
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_context_reset_memory_peak (dc_context_t *context)
+{
+	if (context == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_atomic_store (&context->memory_peak, dc_atomic_load (&context->memory_current));
+
+	return DC_STATUS_SUCCESS;
+}
+
+void
+dc_context_memory_add (dc_context_t *context, size_t size)
+{
+	if (context == NULL || size == 0)
+		return;
+
+	unsigned int current = dc_atomic_add (&context->memory_current, (unsigned int) size);
+
+	// Raise the peak, unless another thread raised it further already.
+	unsigned int peak = dc_atomic_load (&context->memory_peak);
+	while (current > peak && !dc_atomic_cas (&context->memory_peak, peak, current)) {
+		peak = dc_atomic_load (&context->memory_peak);
+	}
+}
+
+void
+dc_context_memory_sub (dc_context_t *context, size_t size)
+{
+	if (context == NULL || size == 0)
+		return;
+
+	dc_atomic_add (&context->memory_current, - (unsigned int) size);
+}
+
+dc_status_t
+dc_context_set_parser_stats (dc_context_t *context, unsigned int enable)
+{
+	if (context == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (context->parser_stats_mutex == NULL) {
+		if (!enable)
+			return DC_STATUS_SUCCESS;
+
+		dc_status_t status = dc_mutex_new (&context->parser_stats_mutex);
+		if (status != DC_STATUS_SUCCESS)
+			return status;
+	}
+
+	dc_atomic_store (&context->parser_stats, enable ? 1 : 0);
+
+	return DC_STATUS_SUCCESS;
+}
+
+static void
+dc_parser_stats_sum (dc_parser_stats_t *total, const dc_parser_stats_t *stats)
+{
+	total->nparsers += stats->nparsers;
+	total->nallocations += stats->nallocations;
+	total->ndives += stats->ndives;
+	total->nbytes += stats->nbytes;
+	total->nfields += stats->nfields;
+	for (unsigned int i = 0; i < DC_PARSER_STATS_NSAMPLES; ++i) {
+		total->nsamples[i] += stats->nsamples[i];
+	}
+	total->setdatatime += stats->setdatatime;
+	total->fieldtime += stats->fieldtime;
+	total->samplestime += stats->samplestime;
+}
+
+dc_status_t
+dc_context_get_parser_stats (dc_context_t *context, dc_family_t family, dc_parser_stats_t *stats)
+{
+	if (context == NULL || stats == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	memset (stats, 0, sizeof (dc_parser_stats_t));
+
+	if (context->parser_stats_mutex == NULL)
+		return DC_STATUS_SUCCESS;
+
+	dc_mutex_lock (context->parser_stats_mutex);
+	for (unsigned int i = 0; i < context->parser_stats_count; ++i) {
+		const dc_context_parser_stats_t *entry = &context->parser_stats_families[i];
+		if (family == DC_FAMILY_NULL || entry->family == family)
+			dc_parser_stats_sum (stats, &entry->stats);
+	}
+	dc_mutex_unlock (context->parser_stats_mutex);
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_context_reset_parser_stats (dc_context_t *context)
+{
+	if (context == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (context->parser_stats_mutex == NULL)
+		return DC_STATUS_SUCCESS;
+
+	dc_mutex_lock (context->parser_stats_mutex);
+	for (unsigned int i = 0; i < context->parser_stats_count; ++i) {
+		memset (&context->parser_stats_families[i].stats, 0, sizeof (dc_parser_stats_t));
+	}
+	dc_mutex_unlock (context->parser_stats_mutex);
+
+	return DC_STATUS_SUCCESS;
+}
+
+int
+dc_context_parser_stats_enabled (dc_context_t *context)
+{
+	if (context == NULL)
+		return 0;
+
+	return dc_atomic_load (&context->parser_stats);
+}
+
+void
+dc_context_parser_stats_add (dc_context_t *context, dc_family_t family, const dc_parser_stats_t *stats)
+{
+	if (context == NULL || context->parser_stats_mutex == NULL)
+		return;
+
+	dc_mutex_lock (context->parser_stats_mutex);
+
+	// There are only a few dozen families, so a linear search is fine.
+	dc_context_parser_stats_t *entry = NULL;
+	for (unsigned int i = 0; i < context->parser_stats_count; ++i) {
+		if (context->parser_stats_families[i].family == family) {
+			entry = &context->parser_stats_families[i];
+			break;
+		}
+	}
+
+	if (entry == NULL) {
+		dc_context_parser_stats_t *families = (dc_context_parser_stats_t *) realloc (context->parser_stats_families,
+			(context->parser_stats_count + 1) * sizeof (dc_context_parser_stats_t));
+		if (families != NULL) {
+			context->parser_stats_families = families;
+			entry = &families[context->parser_stats_count++];
+			memset (entry, 0, sizeof (dc_context_parser_stats_t));
+			entry->family = family;
+		}
+	}
+
+	if (entry)
+		dc_parser_stats_sum (&entry->stats, stats);
+
+	dc_mutex_unlock (context->parser_stats_mutex);
+}
+
+/*
+ * The storage is a sequence of blocks, each with a header followed by
+ * the object. Freed blocks are merged with the free blocks after them,
+ * and free blocks at the end are returned to the unused part.
+ */
+#define STORAGE_ALIGN 16
+
+typedef struct storage_block_t {
+	size_t size;
+	size_t used;
+} storage_block_t;
+
+#define STORAGE_HEADER ((sizeof (storage_block_t) + STORAGE_ALIGN - 1) / STORAGE_ALIGN * STORAGE_ALIGN)
+
+dc_status_t
+dc_context_set_storage (dc_context_t *context, void *storage, size_t size)
+{
+	if (context == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (dc_atomic_load (&context->memory_current) != 0) {
+		ERROR (context, "The context still has devices or parsers.");
+		return DC_STATUS_INVALIDARGS;
+	}
+
+	if (storage && context->storage_mutex == NULL) {
+		dc_status_t status = dc_mutex_new (&context->storage_mutex);
+		if (status != DC_STATUS_SUCCESS)
+			return status;
+	}
+
+	// Align the start of the storage.
+	unsigned char *data = (unsigned char *) storage;
+	size_t skip = storage ? (STORAGE_ALIGN - (size_t) data % STORAGE_ALIGN) % STORAGE_ALIGN : 0;
+	if (skip > size)
+		skip = size;
+
+	context->storage = storage ? data + skip : NULL;
+	context->storage_size = storage ? size - skip : 0;
+	context->storage_used = 0;
+
+	return DC_STATUS_SUCCESS;
+}
+
+void *
+dc_context_allocate (dc_context_t *context, size_t size)
+{
+	if (context == NULL || context->storage == NULL)
+		return malloc (size);
+
+	size_t n = (size + STORAGE_ALIGN - 1) / STORAGE_ALIGN * STORAGE_ALIGN;
+	void *ptr = NULL;
+
+	dc_mutex_lock (context->storage_mutex);
+
+	// Re-use the first free block which is large enough.
+	size_t offset = 0;
+	while (offset < context->storage_used) {
+		storage_block_t *block = (storage_block_t *) (context->storage + offset);
+		if (!block->used && block->size >= n) {
+			if (block->size >= n + STORAGE_HEADER + STORAGE_ALIGN) {
+				storage_block_t *rest = (storage_block_t *) (context->storage + offset + STORAGE_HEADER + n);
+				rest->size = block->size - n - STORAGE_HEADER;
+				rest->used = 0;
+				block->size = n;
+			}
+			block->used = 1;
+			ptr = context->storage + offset + STORAGE_HEADER;
+			break;
+		}
+		offset += STORAGE_HEADER + block->size;
+	}
+
+	// Append a new block to the used part.
+	if (ptr == NULL && context->storage_size - context->storage_used >= STORAGE_HEADER + n) {
+		storage_block_t *block = (storage_block_t *) (context->storage + context->storage_used);
+		block->size = n;
+		block->used = 1;
+		ptr = context->storage + context->storage_used + STORAGE_HEADER;
+		context->storage_used += STORAGE_HEADER + n;
+	}
+
+	dc_mutex_unlock (context->storage_mutex);
+
+	return ptr;
+}
+
+void
+dc_context_deallocate (dc_context_t *context, void *ptr)
+{
+	if (context == NULL || context->storage == NULL) {
+		free (ptr);
+		return;
+	}
+
+	if (ptr == NULL)
+		return;
+
+	dc_mutex_lock (context->storage_mutex);
+
+	storage_block_t *block = (storage_block_t *) ((unsigned char *) ptr - STORAGE_HEADER);
+	block->used = 0;
+
+	// Merge the adjacent free blocks.
+	size_t offset = 0, last = 0;
+	while (offset < context->storage_used) {
+		storage_block_t *current = (storage_block_t *) (context->storage + offset);
+		size_t next = offset + STORAGE_HEADER + current->size;
+		if (!current->used) {
+			while (next < context->storage_used) {
+				storage_block_t *following = (storage_block_t *) (context->storage + next);
+				if (following->used)
+					break;
+				current->size += STORAGE_HEADER + following->size;
+				next += STORAGE_HEADER + following->size;
+			}
+		}
+		last = offset;
+		offset = next;
+	}
+
+	// Return a free block at the end to the unused part.
+	if (context->storage_used) {
+		storage_block_t *tail = (storage_block_t *) (context->storage + last);
+		if (!tail->used)
+			context->storage_used = last;
+	}
+
+	dc_mutex_unlock (context->storage_mutex);
+}
+
+void
+dc_context_run (dc_context_t *context, void (*func) (void *userdata), void *userdata, unsigned int count)
+{
+	dc_executor_run (context ? context->executor : NULL, func, userdata, count);
+}
+
 dc_status_t
 dc_context_set_loglevel (dc_context_t *context, dc_loglevel_t loglevel)
 {
@@ -215,7 +884,32 @@ dc_context_set_loglevel (dc_context_t *context, dc_loglevel_t loglevel)
 		return DC_STATUS_INVALIDARGS;
 
 #ifdef ENABLE_LOGGING
-	context->loglevel = loglevel;
+	for (unsigned int i = 0; i < NCATEGORIES; ++i) {
+		dc_atomic_store (&context->loglevels[i], loglevel);
+	}
+	dc_atomic_store (&context->loglevel, loglevel);
+#endif
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_context_set_logcategory (dc_context_t *context, dc_logcategory_t category, dc_loglevel_t loglevel)
+{
+	if (context == NULL || category >= NCATEGORIES)
+		return DC_STATUS_INVALIDARGS;
+
+#ifdef ENABLE_LOGGING
+	dc_atomic_store (&context->loglevels[category], loglevel);
+
+	// The overall loglevel is the most verbose of all categories.
+	dc_loglevel_t maximum = DC_LOGLEVEL_NONE;
+	for (unsigned int i = 0; i < NCATEGORIES; ++i) {
+		dc_loglevel_t level = dc_atomic_load (&context->loglevels[i]);
+		if (level > maximum)
+			maximum = level;
+	}
+	dc_atomic_store (&context->loglevel, maximum);
 #endif
 
 	return DC_STATUS_SUCCESS;
@@ -228,13 +922,330 @@ dc_context_set_logfunc (dc_context_t *context, dc_logfunc_t logfunc, void *userd
 		return DC_STATUS_INVALIDARGS;
 
 #ifdef ENABLE_LOGGING
-	context->logfunc = logfunc;
+	dc_mutex_lock (context->mutex);
+	dc_atomic_store (&context->logfunc, logfunc);
 	context->userdata = userdata;
+	dc_mutex_unlock (context->mutex);
 #endif
 
 	return DC_STATUS_SUCCESS;
 }
 
+dc_status_t
+dc_context_set_logasync (dc_context_t *context, unsigned int capacity)
+{
+	if (context == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+#ifdef ENABLE_LOGGING
+	l_async_stop (context);
+
+	if (capacity == 0)
+		return DC_STATUS_SUCCESS;
+
+	// A record is only accepted as a whole, so the ring buffer needs room
+	// for at least one header and some data.
+	if (capacity < 2 * sizeof (dc_logrecord_t))
+		return DC_STATUS_INVALIDARGS;
+
+	context->async_ring = (unsigned char *) malloc (capacity);
+	context->async_scratch = (unsigned char *) malloc (capacity);
+	if (context->async_ring == NULL || context->async_scratch == NULL ||
+		dc_mutex_new (&context->async_mutex) != DC_STATUS_SUCCESS ||
+		dc_cond_new (&context->async_cond) != DC_STATUS_SUCCESS) {
+		goto error;
+	}
+
+	context->async_capacity = capacity;
+	context->async_head = 0;
+	context->async_size = 0;
+	context->async_dropped = 0;
+	context->async_quit = 0;
+
+	if (dc_thread_new (&context->async_thread, l_thread, context) != DC_STATUS_SUCCESS)
+		goto error;
+
+	return DC_STATUS_SUCCESS;
+
+error:
+	dc_cond_free (context->async_cond);
+	dc_mutex_free (context->async_mutex);
+	free (context->async_ring);
+	free (context->async_scratch);
+	context->async_cond = NULL;
+	context->async_mutex = NULL;
+	context->async_ring = NULL;
+	context->async_scratch = NULL;
+	context->async_capacity = 0;
+	return DC_STATUS_NOMEMORY;
+#else
+	return DC_STATUS_SUCCESS;
+#endif
+}
+
+static dc_status_t
+dc_context_set_filename (char **filename, const char *value)
+{
+	char *copy = NULL;
+
+	if (value) {
+		copy = strdup (value);
+		if (copy == NULL)
+			return DC_STATUS_NOMEMORY;
+	}
+
+	free (*filename);
+	*filename = copy;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_context_set_record (dc_context_t *context, const char *filename)
+{
+	if (context == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	return dc_context_set_filename (&context->record, filename);
+}
+
+dc_status_t
+dc_context_set_replay (dc_context_t *context, const char *filename)
+{
+	if (context == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	return dc_context_set_filename (&context->replay, filename);
+}
+
+dc_status_t
+dc_context_set_iothread (dc_context_t *context, const dc_iothread_t *options)
+{
+	if (context == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (options) {
+		context->iothread = *options;
+		context->iothread_enabled = 1;
+	} else {
+		context->iothread_enabled = 0;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_context_set_trace (dc_context_t *context, unsigned int capacity)
+{
+	dc_trace_t *trace = NULL;
+
+	if (context == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (context->trace_mutex == NULL) {
+		if (capacity == 0)
+			return DC_STATUS_SUCCESS;
+
+		dc_status_t status = dc_mutex_new (&context->trace_mutex);
+		if (status != DC_STATUS_SUCCESS)
+			return status;
+	}
+
+	if (capacity) {
+		trace = (dc_trace_t *) malloc (capacity * sizeof (dc_trace_t));
+		if (trace == NULL)
+			return DC_STATUS_NOMEMORY;
+	}
+
+	dc_mutex_lock (context->trace_mutex);
+	free (context->trace);
+	context->trace = trace;
+	context->trace_first = 0;
+	context->trace_count = 0;
+	dc_atomic_store (&context->trace_capacity, capacity);
+	dc_mutex_unlock (context->trace_mutex);
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_context_set_syncstore (dc_context_t *context, dc_syncstore_t *store)
+{
+	if (context == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	context->syncstore = store;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_context_get_hint (dc_context_t *context, dc_family_t family, unsigned int model, const char *name, unsigned int *value)
+{
+	if (context == NULL || context->syncstore == NULL)
+		return DC_STATUS_SUCCESS;
+
+	return dc_syncstore_get_hint (context->syncstore, family, model, name, value);
+}
+
+dc_status_t
+dc_context_set_hint (dc_context_t *context, dc_family_t family, unsigned int model, const char *name, unsigned int value)
+{
+	if (context == NULL || context->syncstore == NULL)
+		return DC_STATUS_SUCCESS;
+
+	return dc_syncstore_set_hint (context->syncstore, family, model, name, value);
+}
+
+dc_status_t
+dc_context_get_trace (dc_context_t *context, dc_trace_t entries[], unsigned int count, unsigned int *actual)
+{
+	unsigned int n = 0;
+
+	if (context == NULL || (entries == NULL && count)) {
+		if (actual)
+			*actual = 0;
+		return DC_STATUS_INVALIDARGS;
+	}
+
+	if (context->trace_mutex) {
+		dc_mutex_lock (context->trace_mutex);
+		while (n < count && context->trace_count) {
+			entries[n++] = context->trace[context->trace_first];
+			context->trace_first = (context->trace_first + 1) % context->trace_capacity;
+			context->trace_count--;
+		}
+		dc_mutex_unlock (context->trace_mutex);
+	}
+
+	if (actual)
+		*actual = n;
+
+	return DC_STATUS_SUCCESS;
+}
+
+unsigned long long
+dc_context_clock (void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER now, frequency;
+	QueryPerformanceCounter (&now);
+	QueryPerformanceFrequency (&frequency);
+	return now.QuadPart / frequency.QuadPart * 1000000 +
+		now.QuadPart % frequency.QuadPart * 1000000 / frequency.QuadPart;
+#elif defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+	struct timespec now;
+	clock_gettime (CLOCK_MONOTONIC, &now);
+	return (unsigned long long) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+#else
+	struct timeval now;
+	gettimeofday (&now, NULL);
+	return (unsigned long long) now.tv_sec * 1000000 + now.tv_usec;
+#endif
+}
+
+int
+dc_context_is_tracing (dc_context_t *context)
+{
+	if (context == NULL)
+		return 0;
+
+	return dc_atomic_load (&context->trace_capacity) != 0;
+}
+
+void
+dc_context_trace (dc_context_t *context, dc_trace_type_t type, dc_status_t status, unsigned long long begin, const void *data, unsigned int size)
+{
+	if (!dc_context_is_tracing (context))
+		return;
+
+	unsigned long long now = dc_context_clock ();
+
+	dc_mutex_lock (context->trace_mutex);
+
+	if (context->trace_capacity) {
+		unsigned int index = (context->trace_first + context->trace_count) % context->trace_capacity;
+		if (context->trace_count == context->trace_capacity) {
+			// Overwrite the oldest entry.
+			context->trace_first = (context->trace_first + 1) % context->trace_capacity;
+		} else {
+			context->trace_count++;
+		}
+
+		dc_trace_t *entry = context->trace + index;
+		entry->sequence = context->trace_sequence++;
+		entry->type = type;
+		entry->status = status;
+		entry->timestamp = begin;
+		entry->duration = now - begin;
+		entry->size = size;
+		entry->length = (data == NULL ? 0 : (size < DC_TRACE_MAXDATA ? size : DC_TRACE_MAXDATA));
+		if (entry->length)
+			memcpy (entry->data, data, entry->length);
+	}
+
+	dc_mutex_unlock (context->trace_mutex);
+}
+
+const char *
+dc_context_get_record (dc_context_t *context)
+{
+	if (context == NULL)
+		return NULL;
+
+	return context->record;
+}
+
+const char *
+dc_context_get_replay (dc_context_t *context)
+{
+	if (context == NULL)
+		return NULL;
+
+	return context->replay;
+}
+
+const dc_iothread_t *
+dc_context_get_iothread (dc_context_t *context)
+{
+	if (context == NULL || !context->iothread_enabled)
+		return NULL;
+
+	return &context->iothread;
+}
+
+int
+dc_context_is_enabled (dc_context_t *context, dc_loglevel_t loglevel)
+{
+	if (context == NULL)
+		return 0;
+
+#ifdef ENABLE_LOGGING
+	if (loglevel > dc_atomic_load (&context->loglevel))
+		return 0;
+
+	return dc_atomic_load (&context->logfunc) != NULL;
+#else
+	return 0;
+#endif
+}
+
+int
+dc_context_is_logged (dc_context_t *context, dc_logcategory_t category, dc_loglevel_t loglevel)
+{
+	if (context == NULL)
+		return 0;
+
+#ifdef ENABLE_LOGGING
+	if (loglevel > dc_atomic_load (&context->loglevels[category]))
+		return 0;
+
+	return dc_atomic_load (&context->logfunc) != NULL;
+#else
+	return 0;
+#endif
+}
+
 dc_status_t
 dc_context_log (dc_context_t *context, dc_loglevel_t loglevel, const char *file, unsigned int line, const char *function, const char *format, ...)
 {
@@ -246,17 +1257,35 @@ dc_context_log (dc_context_t *context, dc_loglevel_t loglevel, const char *file,
 		return DC_STATUS_INVALIDARGS;
 
 #ifdef ENABLE_LOGGING
-	if (loglevel > context->loglevel)
+	if (loglevel > dc_atomic_load (&context->loglevel))
 		return DC_STATUS_SUCCESS;
 
-	if (context->logfunc == NULL)
+	// The arguments can't outlive the call, so the message is formatted
+	// here, but the delivery is left to the logging thread.
+	if (context->async_thread) {
+		char msg[sizeof (context->msg)];
+		dc_logrecord_t record = {LOG_MESSAGE, loglevel, file, line, function};
+		va_start (ap, format);
+		l_vsnprintf (msg, sizeof (msg), format, ap);
+		va_end (ap);
+		l_enqueue (context, &record, msg, strlen (msg) + 1, NULL, 0);
 		return DC_STATUS_SUCCESS;
+	}
 
-	va_start (ap, format);
-	l_vsnprintf (context->msg, sizeof (context->msg), format, ap);
-	va_end (ap);
+	// The message buffer and the callback are shared between all threads
+	// using this context, so formatting and delivery are serialized.
+	dc_mutex_lock (context->mutex);
+
+	if (context->logfunc) {
+		va_start (ap, format);
+		l_vsnprintf (context->msg, sizeof (context->msg), format, ap);
+		va_end (ap);
 
-	context->logfunc (context, loglevel, file, line, function, context->msg, context->userdata);
+		context->logtime = l_elapsed (context);
+		context->logfunc (context, loglevel, file, line, function, context->msg, context->userdata);
+	}
+
+	dc_mutex_unlock (context->mutex);
 #endif
 
 	return DC_STATUS_SUCCESS;
@@ -313,20 +1342,133 @@ dc_context_hexdump (dc_context_t *context, dc_loglevel_t loglevel, const char *f
 		return DC_STATUS_INVALIDARGS;
 
 #ifdef ENABLE_LOGGING
-	if (loglevel > context->loglevel)
+	if (loglevel > dc_atomic_load (&context->loglevel))
 		return DC_STATUS_SUCCESS;
 
-	if (context->logfunc == NULL)
+	// Only the raw bytes are queued, and the logging thread converts
+	// them to hex. Bytes that wouldn't fit in the message are left out.
+	if (context->async_thread) {
+		dc_logrecord_t record = {LOG_HEXDUMP, loglevel, file, line, function};
+		size_t maxsize = (sizeof (context->msg) - 1) / 2;
+		record.size = size;
+		l_enqueue (context, &record, prefix, strlen (prefix) + 1, data, size > maxsize ? maxsize : size);
 		return DC_STATUS_SUCCESS;
+	}
 
-	n = l_snprintf (context->msg, sizeof (context->msg), "%s: size=%u, data=", prefix, size);
+	dc_mutex_lock (context->mutex);
 
-	if (n >= 0) {
-		n = l_hexdump (context->msg + n, sizeof (context->msg) - n, data, size);
+	if (context->logfunc) {
+		context->logtime = l_elapsed (context);
+		n = l_snprintf (context->msg, sizeof (context->msg), "%s: size=%u, data=", prefix, size);
+
+		if (n >= 0) {
+			n = l_hexdump (context->msg + n, sizeof (context->msg) - n, data, size);
+		}
+
+		context->logfunc (context, loglevel, file, line, function, context->msg, context->userdata);
 	}
 
-	context->logfunc (context, loglevel, file, line, function, context->msg, context->userdata);
+	dc_mutex_unlock (context->mutex);
 #endif
 
 	return DC_STATUS_SUCCESS;
 }
+
+#ifdef HAVE_LIBUSB
+dc_status_t
+dc_context_usb_acquire (dc_context_t *context, struct libusb_context **usb)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (usb == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	// Without a context, every device gets its own libusb context.
+	if (context == NULL) {
+		if (libusb_init (usb) < 0)
+			return DC_STATUS_IO;
+		return DC_STATUS_SUCCESS;
+	}
+
+	dc_mutex_lock (context->usb_mutex);
+
+	// The libusb context is created on first use, and kept until the
+	// context is destroyed. Opening the next device doesn't need to
+	// initialize libusb and enumerate the bus again.
+	if (context->usb == NULL && libusb_init (&context->usb) < 0) {
+		ERROR (context, "Failed to initialize usb support.");
+		context->usb = NULL;
+		status = DC_STATUS_IO;
+	} else {
+		context->usb_refcount++;
+		*usb = context->usb;
+	}
+
+	dc_mutex_unlock (context->usb_mutex);
+
+	return status;
+}
+
+void
+dc_context_usb_release (dc_context_t *context, struct libusb_context *usb)
+{
+	if (usb == NULL)
+		return;
+
+	if (context == NULL) {
+		libusb_exit (usb);
+		return;
+	}
+
+	dc_mutex_lock (context->usb_mutex);
+	if (context->usb_refcount)
+		context->usb_refcount--;
+	dc_mutex_unlock (context->usb_mutex);
+}
+#endif
+
+#ifdef HAVE_HIDAPI
+dc_status_t
+dc_context_hid_acquire (dc_context_t *context)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (context == NULL) {
+		if (hid_init () != 0)
+			return DC_STATUS_IO;
+		return DC_STATUS_SUCCESS;
+	}
+
+	dc_mutex_lock (context->usb_mutex);
+
+	if (!context->hid_initialized) {
+		if (hid_init () != 0) {
+			ERROR (context, "Failed to initialize hid support.");
+			status = DC_STATUS_IO;
+		} else {
+			context->hid_initialized = 1;
+		}
+	}
+
+	if (status == DC_STATUS_SUCCESS)
+		context->hid_refcount++;
+
+	dc_mutex_unlock (context->usb_mutex);
+
+	return status;
+}
+
+void
+dc_context_hid_release (dc_context_t *context)
+{
+	if (context == NULL) {
+		hid_exit ();
+		return;
+	}
+
+	dc_mutex_lock (context->usb_mutex);
+	if (context->hid_refcount)
+		context->hid_refcount--;
+	dc_mutex_unlock (context->usb_mutex);
+}
+#endif
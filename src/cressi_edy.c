@@ -31,6 +31,9 @@
 #include "checksum.h"
 #include "array.h"
 #include "ringbuffer.h"
+#include "rbstream.h"
+#include "retry.h"
+#include "packet.h"
 
 #define ISINSTANCE(device) dc_device_isinstance((device), &cressi_edy_device_vtable)
 
@@ -38,6 +41,7 @@
 
 #define SZ_PACKET         0x80
 #define SZ_PAGE           (SZ_PACKET / 4)
+#define SZ_MEMORY         0x8000
 
 #define IQ700 0x05
 #define EDY   0x08
@@ -59,6 +63,9 @@ typedef struct cressi_edy_device_t {
 	const cressi_edy_layout_t *layout;
 	unsigned char fingerprint[SZ_PAGE / 2];
 	unsigned int model;
+	// Copy of the memory packets that have been read already.
+	unsigned char cache[SZ_MEMORY];
+	unsigned char cached[SZ_MEMORY / SZ_PAGE];
 } cressi_edy_device_t;
 
 static dc_status_t cressi_edy_device_set_fingerprint (dc_device_t *abstract, const unsigned char data[], unsigned int size);
@@ -100,88 +107,54 @@ static const cressi_edy_layout_t tusa_iq700_layout = {
 	0x3C, /* config */
 };
 
-static unsigned int
-ifloor (unsigned int x, unsigned int n)
-{
-	// Round down to next lower multiple.
-	return (x / n) * n;
-}
+static const dc_packet_framing_t cressi_edy_framing = {
+	DC_PACKET_ECHO_BYTE, /* flags */
+	0, /* delay */
+	0, 0, 0, /* ack, header, trailer */
+	0, 0, /* start, minimum */
+	DC_PACKET_CHECKSUM_NONE, 0, 0, 0, /* checksum */
+};
 
-static unsigned int
-iceil (unsigned int x, unsigned int n)
-{
-	// Round up to next higher multiple.
-	return ((x + n - 1) / n) * n;
-}
+static const dc_packet_framing_t cressi_edy_framing_trailer = {
+	DC_PACKET_ECHO_BYTE | DC_PACKET_TRAILER, /* flags */
+	0, /* delay */
+	0, 0, 0x45, /* ack, header, trailer */
+	0, 0, /* start, minimum */
+	DC_PACKET_CHECKSUM_NONE, 0, 0, 0, /* checksum */
+};
 
 static dc_status_t
 cressi_edy_packet (cressi_edy_device_t *device, const unsigned char command[], unsigned int csize, unsigned char answer[], unsigned int asize, int trailer)
 {
-	dc_status_t status = DC_STATUS_SUCCESS;
 	dc_device_t *abstract = (dc_device_t *) device;
 
-	if (device_is_cancelled (abstract))
-		return DC_STATUS_CANCELLED;
-
-	for (unsigned int i = 0; i < csize; ++i) {
-		// Send the command to the device.
-		status = dc_serial_write (device->port, command + i, 1, NULL);
-		if (status != DC_STATUS_SUCCESS) {
-			ERROR (abstract->context, "Failed to send the command.");
-			return status;
-		}
-
-		// Receive the echo.
-		unsigned char echo = 0;
-		status = dc_serial_read (device->port, &echo, 1, NULL);
-		if (status != DC_STATUS_SUCCESS) {
-			ERROR (abstract->context, "Failed to receive the echo.");
-			return status;
-		}
-
-		// Verify the echo.
-		if (command[i] != echo) {
-			ERROR (abstract->context, "Unexpected echo.");
-			return DC_STATUS_PROTOCOL;
-		}
-	}
-
-	if (asize) {
-		// Receive the answer of the device.
-		status = dc_serial_read (device->port, answer, asize, NULL);
-		if (status != DC_STATUS_SUCCESS) {
-			ERROR (abstract->context, "Failed to receive the answer.");
-			return status;
-		}
-
-		// Verify the trailer of the packet.
-		if (trailer && answer[asize - 1] != 0x45) {
-			ERROR (abstract->context, "Unexpected answer trailer byte.");
-			return DC_STATUS_PROTOCOL;
-		}
-	}
-
-	return DC_STATUS_SUCCESS;
+	if (trailer)
+		return dc_packet_transfer (abstract, device->port, &cressi_edy_framing_trailer, command, csize, answer, asize);
+	else
+		return dc_packet_transfer (abstract, device->port, &cressi_edy_framing, command, csize, answer, asize);
 }
 
 static dc_status_t
 cressi_edy_transfer (cressi_edy_device_t *device, const unsigned char command[], unsigned int csize, unsigned char answer[], unsigned int asize, int trailer)
 {
-	unsigned int nretries = 0;
+	dc_device_t *abstract = (dc_device_t *) device;
+	dc_retry_t retry;
+	dc_retry_init (&retry, MAXRETRIES, 300, 300, DC_DIRECTION_INPUT);
+	unsigned long long begin = device_timestamp ();
 	dc_status_t rc = DC_STATUS_SUCCESS;
 	while ((rc = cressi_edy_packet (device, command, csize, answer, asize, trailer)) != DC_STATUS_SUCCESS) {
-		if (rc != DC_STATUS_TIMEOUT && rc != DC_STATUS_PROTOCOL)
-			return rc;
+		device_stats_packet (abstract, command, csize, 0, rc, begin);
 
-		// Abort if the maximum number of retries is reached.
-		if (nretries++ >= MAXRETRIES)
+		// Delay the next attempt, or give up.
+		rc = dc_retry_failed (&retry, abstract, device->port, rc);
+		if (rc != DC_STATUS_SUCCESS)
 			return rc;
 
-		// Delay the next attempt.
-		dc_serial_sleep (device->port, 300);
-		dc_serial_purge (device->port, DC_DIRECTION_INPUT);
+		begin = device_timestamp ();
 	}
 
+	device_stats_packet (abstract, command, csize, asize, rc, begin);
+
 	return DC_STATUS_SUCCESS;
 }
 
@@ -248,9 +221,11 @@ cressi_edy_device_open (dc_device_t **out, dc_context_t *context, const char *na
 
 	// Set the default values.
 	device->port = NULL;
+	device->base.blocksize = SZ_PACKET;
 	device->layout = NULL;
 	device->model = 0;
 	memset (device->fingerprint, 0, sizeof (device->fingerprint));
+	memset (device->cached, 0, sizeof (device->cached));
 
 	// Open the device.
 	status = dc_serial_open (&device->port, context, name);
@@ -259,6 +234,10 @@ cressi_edy_device_open (dc_device_t **out, dc_context_t *context, const char *na
 		goto error_free;
 	}
 
+	// Interrupt the blocking reads when the download is cancelled, and
+	// measure the time spent waiting for the I/O.
+	device_set_port ((dc_device_t *) device, device->port);
+
 	// Set the serial communication protocol (1200 8N1).
 	status = dc_serial_configure (device->port, 1200, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -356,17 +335,35 @@ cressi_edy_device_read (dc_device_t *abstract, unsigned int address, unsigned ch
 
 	unsigned int nbytes = 0;
 	while (nbytes < size) {
-		// Read the package.
+		// The memory does not change while the device is connected, so a
+		// packet that has been read before, for example by the logbook
+		// and profile passes, is taken from the cache.
 		unsigned int number = address / SZ_PAGE;
-		unsigned char answer[SZ_PACKET + 1] = {0};
-		unsigned char command[3] = {0x52,
-				(number >> 8) & 0xFF, // high
-				(number     ) & 0xFF}; // low
-		dc_status_t rc = cressi_edy_transfer (device, command, sizeof (command), answer, sizeof (answer), 1);
-		if (rc != DC_STATUS_SUCCESS)
-			return rc;
+		unsigned int iscached = address + SZ_PACKET <= SZ_MEMORY;
+		for (unsigned int i = 0; iscached && i < SZ_PACKET / SZ_PAGE; ++i) {
+			if (!device->cached[number + i])
+				iscached = 0;
+		}
 
-		memcpy (data, answer, SZ_PACKET);
+		if (iscached) {
+			memcpy (data, device->cache + address, SZ_PACKET);
+		} else {
+			// Read the package.
+			unsigned char answer[SZ_PACKET + 1] = {0};
+			unsigned char command[3] = {0x52,
+					(number >> 8) & 0xFF, // high
+					(number     ) & 0xFF}; // low
+			dc_status_t rc = cressi_edy_transfer (device, command, sizeof (command), answer, sizeof (answer), 1);
+			if (rc != DC_STATUS_SUCCESS)
+				return rc;
+
+			memcpy (data, answer, SZ_PACKET);
+
+			if (address + SZ_PACKET <= SZ_MEMORY) {
+				memcpy (device->cache + address, answer, SZ_PACKET);
+				memset (device->cached + number, 1, SZ_PACKET / SZ_PAGE);
+			}
+		}
 
 		nbytes += SZ_PACKET;
 		address += SZ_PACKET;
@@ -430,6 +427,8 @@ cressi_edy_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, v
 	devinfo.serial = 0;
 	device_event_emit (abstract, DC_EVENT_DEVINFO, &devinfo);
 
+	device_phase (abstract, DC_PHASE_LOGBOOK);
+
 	// Read the logbook data.
 	unsigned char logbook[SZ_PACKET] = {0};
 	dc_status_t rc = cressi_edy_device_read (abstract, layout->rb_logbook_offset, logbook, sizeof (logbook));
@@ -492,100 +491,50 @@ cressi_edy_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, v
 		idx--;
 	}
 
-	// Because dives are not necessary aligned to packet boundaries, and
-	// we always do aligned reads, there can be padding bytes present on
-	// both sides of the memory buffer. These extra bytes need to be
-	// included in the total length.
-	total += (previous - ifloor(previous, SZ_PACKET)) +
-		(iceil(eop, SZ_PACKET) - eop);
-
 	// Update and emit a progress event.
 	progress.current += SZ_PACKET;
 	progress.maximum = SZ_PACKET + total;
 	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 
+	device_phase (abstract, DC_PHASE_PROFILE);
+
+	// Create the ringbuffer stream. The dives are not necessarily aligned
+	// to packet boundaries, and the stream drops the padding bytes.
+	dc_rbstream_t *rbstream = NULL;
+	rc = dc_rbstream_new (&rbstream, abstract, SZ_PACKET, SZ_PACKET,
+		layout->rb_profile_begin, layout->rb_profile_end, eop, total);
+	if (rc != DC_STATUS_SUCCESS) {
+		ERROR (abstract->context, "Failed to create the ringbuffer stream.");
+		return rc;
+	}
+
 	// Memory buffer for the profile data.
-	unsigned char *buffer = (unsigned char *) malloc (total);
+	unsigned char *buffer = (unsigned char *) malloc (layout->rb_profile_end - layout->rb_profile_begin);
 	if (buffer == NULL) {
 		ERROR (abstract->context, "Failed to allocate memory.");
+		dc_rbstream_free (rbstream);
 		return DC_STATUS_NOMEMORY;
 	}
 
-	unsigned int available = 0;
-	unsigned int offset = total;
-
-	// Align the ringbuffer to packet boundaries. This results in a
-	// virtual ringbuffer that is slightly larger than the actual
-	// ringbuffer. Data outside the real ringbuffer is downloaded
-	// and then immediately dropped.
-	unsigned int rb_profile_begin = ifloor(layout->rb_profile_begin, SZ_PACKET);
-	unsigned int rb_profile_end = iceil(layout->rb_profile_end, SZ_PACKET);
-
-	// Align the initial memory address to the next packet boundary, and
-	// calculate the amount of padding bytes, so we can easily skip
-	// them later.
-	unsigned int address = iceil(eop, SZ_PACKET);
-	unsigned int skip = address - eop;
-
 	idx = last;
 	previous = eop;
 	for (unsigned int i = 0; i < count; ++i) {
 		// Get the pointer to the profile data.
 		unsigned int current = array_uint_le (logbook + idx * layout->rb_logbook_size, layout->rb_logbook_size) * SZ_PAGE + layout->rb_profile_begin;
-		if (current < layout->rb_profile_begin || current >= layout->rb_profile_end) {
-			ERROR (abstract->context, "Invalid ringbuffer pointer detected (0x%04x).", current);
-			free(buffer);
-			return DC_STATUS_DATAFORMAT;
-		}
 
 		// Get the profile length.
 		unsigned int length = ringbuffer_distance (current, previous, 1, layout->rb_profile_begin, layout->rb_profile_end);
 
-		unsigned nbytes = available;
-		while (nbytes < length) {
-			if (address == rb_profile_begin)
-				address = rb_profile_end;
-			address -= SZ_PACKET;
-
-			// Read the memory page.
-			unsigned char packet[SZ_PACKET];
-			rc = cressi_edy_device_read (abstract, address, packet, sizeof(packet));
-			if (rc != DC_STATUS_SUCCESS) {
-				ERROR (abstract->context, "Failed to read the memory page.");
-				free(buffer);
-				return rc;
-			}
-
-			// At the head and tail of the ringbuffer, the packet can
-			// contain extra data, originating from the larger virtual
-			// ringbuffer. This data must be removed from the packet.
-			unsigned int head = 0;
-			unsigned int tail = 0;
-			unsigned int len = SZ_PACKET;
-			if (address < layout->rb_profile_begin) {
-				head = layout->rb_profile_begin - address;
-			}
-			if (address + SZ_PACKET > layout->rb_profile_end) {
-				tail = (address + SZ_PACKET) - layout->rb_profile_end;
-			}
-			len -= head + tail;
-			offset -= len;
-
-			// Copy the data packet to the buffer.
-			memcpy(buffer + offset, packet + head, len);
-
-			// Update and emit a progress event.
-			progress.current += len;
-			device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
-
-			nbytes += len - skip;
-			skip = 0;
+		// Read the profile data.
+		rc = dc_rbstream_read (rbstream, &progress, buffer, length);
+		if (rc != DC_STATUS_SUCCESS) {
+			ERROR (abstract->context, "Failed to read the dive.");
+			break;
 		}
 
-		available = nbytes - length;
 		previous = current;
 
-		unsigned char *p = buffer + offset + available;
+		unsigned char *p = buffer;
 
 		if (memcmp (p, device->fingerprint, sizeof (device->fingerprint)) == 0)
 			break;
@@ -598,7 +547,8 @@ cressi_edy_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, v
 		idx--;
 	}
 
-	free(buffer);
+	dc_rbstream_free (rbstream);
+	free (buffer);
 
-	return DC_STATUS_SUCCESS;
+	return rc;
 }
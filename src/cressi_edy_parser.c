@@ -19,7 +19,11 @@
  * MA 02110-1301 USA
  */
 
+#define DC_LOG_CATEGORY DC_LOGCATEGORY_PARSER
+
 #include <stdlib.h>
+#include <limits.h>
+#include <math.h>
 
 #include <libdivecomputer/cressi_edy.h>
 
@@ -37,12 +41,18 @@ typedef struct cressi_edy_parser_t cressi_edy_parser_t;
 struct cressi_edy_parser_t {
 	dc_parser_t base;
 	unsigned int model;
+	// Cached fields.
+	unsigned int cached;
+	unsigned int nsamples;
 };
 
 static dc_status_t cressi_edy_parser_set_data (dc_parser_t *abstract, const unsigned char *data, unsigned int size);
 static dc_status_t cressi_edy_parser_get_datetime (dc_parser_t *abstract, dc_datetime_t *datetime);
 static dc_status_t cressi_edy_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsigned int flags, void *value);
 static dc_status_t cressi_edy_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata);
+static dc_status_t cressi_edy_parser_samples_extract (dc_parser_t *abstract, dc_sample_columns_t *columns);
+static dc_status_t cressi_edy_parser_samples_range (dc_parser_t *abstract, unsigned int first, unsigned int count, dc_sample_callback_t callback, void *userdata);
+static dc_status_t cressi_edy_parser_samples_seek (dc_parser_t *abstract, unsigned int time, unsigned int *index);
 
 static const dc_parser_vtable_t cressi_edy_parser_vtable = {
 	sizeof(cressi_edy_parser_t),
@@ -51,6 +61,14 @@ static const dc_parser_vtable_t cressi_edy_parser_vtable = {
 	cressi_edy_parser_get_datetime, /* datetime */
 	cressi_edy_parser_get_field, /* fields */
 	cressi_edy_parser_samples_foreach, /* samples_foreach */
+	cressi_edy_parser_samples_extract, /* samples_extract */
+	cressi_edy_parser_samples_range, /* samples_range */
+	cressi_edy_parser_samples_seek, /* samples_seek */
+	NULL, /* samples_index */
+	NULL, /* samples_split */
+	NULL, /* samples_chunk */
+	NULL, /* subdives */
+	NULL, /* samples_vendor */
 	NULL /* destroy */
 };
 
@@ -87,6 +105,8 @@ cressi_edy_parser_create (dc_parser_t **out, dc_context_t *context, unsigned int
 
 	// Set the default values.
 	parser->model = model;
+	parser->cached = 0;
+	parser->nsamples = 0;
 
 	*out = (dc_parser_t*) parser;
 
@@ -97,6 +117,12 @@ cressi_edy_parser_create (dc_parser_t **out, dc_context_t *context, unsigned int
 static dc_status_t
 cressi_edy_parser_set_data (dc_parser_t *abstract, const unsigned char *data, unsigned int size)
 {
+	cressi_edy_parser_t *parser = (cressi_edy_parser_t *) abstract;
+
+	// Reset the cache.
+	parser->cached = 0;
+	parser->nsamples = 0;
+
 	return DC_STATUS_SUCCESS;
 }
 
@@ -165,15 +191,11 @@ cressi_edy_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsign
 }
 
 
-static dc_status_t
-cressi_edy_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata)
+static unsigned int
+cressi_edy_parser_interval (cressi_edy_parser_t *parser)
 {
-	cressi_edy_parser_t *parser = (cressi_edy_parser_t *) abstract;
-
-	const unsigned char *data = abstract->data;
-	unsigned int size = abstract->size;
+	const unsigned char *data = parser->base.data;
 
-	unsigned int time = 0;
 	unsigned int interval = 30;
 	if (parser->model == EDY) {
 		interval = 1;
@@ -182,9 +204,59 @@ cressi_edy_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t c
 			interval = 15;
 	}
 
+	return interval;
+}
+
+
+static unsigned int
+cressi_edy_parser_sample_gasmix (cressi_edy_parser_t *parser, const unsigned char *sample)
+{
+	if (parser->model == IQ700)
+		return 0; /* FIXME */
+
+	return (sample[0] & 0x60) >> 5;
+}
+
+
+static dc_status_t
+cressi_edy_parser_cache (cressi_edy_parser_t *parser)
+{
+	const unsigned char *data = parser->base.data;
+	unsigned int size = parser->base.size;
+
+	if (parser->cached)
+		return DC_STATUS_SUCCESS;
+
+	// Only the number of samples is needed, and the samples with the
+	// extra bytes are skipped without decoding them.
+	unsigned int nsamples = 0;
+	unsigned int offset = 32;
+	while (offset + 2 <= size && data[offset] != 0xFF) {
+		offset += (data[offset] & 0x80) ? 6 : 2;
+		nsamples++;
+	}
+
+	parser->nsamples = nsamples;
+	parser->cached = 1;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+static dc_status_t
+cressi_edy_parser_samples_range (dc_parser_t *abstract, unsigned int first, unsigned int count, dc_sample_callback_t callback, void *userdata)
+{
+	cressi_edy_parser_t *parser = (cressi_edy_parser_t *) abstract;
+
+	const unsigned char *data = abstract->data;
+	unsigned int size = abstract->size;
+
+	unsigned int interval = cressi_edy_parser_interval (parser);
+
 	unsigned int ngasmixes = cressi_edy_parser_count_gasmixes(data);
 	unsigned int gasmix = 0xFFFFFFFF;
 
+	unsigned int i = 0;
 	unsigned int offset = 32;
 	while (offset + 2 <= size) {
 		dc_sample_value_t sample = {0};
@@ -192,13 +264,32 @@ cressi_edy_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t c
 		if (data[offset] == 0xFF)
 			break;
 
+		// Stop after the last requested sample.
+		if (i >= first && i - first >= count)
+			break;
+
 		unsigned int extra = 0;
 		if (data[offset] & 0x80)
 			extra = 4;
 
+		// The samples before the first one are only checked for the
+		// gas mix, to report the same gas switches and errors.
+		if (i < first) {
+			if (ngasmixes) {
+				unsigned int idx = cressi_edy_parser_sample_gasmix (parser, data + offset);
+				if (idx >= ngasmixes) {
+					ERROR (abstract->context, "Invalid gas mix index.");
+					return DC_STATUS_DATAFORMAT;
+				}
+				gasmix = idx;
+			}
+			offset += 2 + extra;
+			i++;
+			continue;
+		}
+
 		// Time (seconds).
-		time += interval;
-		sample.time = time;
+		sample.time = (i + 1) * interval;
 		if (callback) callback (DC_SAMPLE_TIME, sample, userdata);
 
 		// Depth (1/10 m).
@@ -208,9 +299,7 @@ cressi_edy_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t c
 
 		// Current gasmix
 		if (ngasmixes) {
-			unsigned int idx = (data[offset + 0] & 0x60) >> 5;
-			if (parser->model == IQ700)
-				idx = 0; /* FIXME */
+			unsigned int idx = cressi_edy_parser_sample_gasmix (parser, data + offset);
 			if (idx >= ngasmixes) {
 				ERROR (abstract->context, "Invalid gas mix index.");
 				return DC_STATUS_DATAFORMAT;
@@ -230,6 +319,89 @@ cressi_edy_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t c
 		}
 
 		offset += 2 + extra;
+		i++;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+static dc_status_t
+cressi_edy_parser_samples_seek (dc_parser_t *abstract, unsigned int time, unsigned int *index)
+{
+	cressi_edy_parser_t *parser = (cressi_edy_parser_t *) abstract;
+
+	dc_status_t rc = cressi_edy_parser_cache (parser);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	// The first sample is recorded after one interval.
+	unsigned int interval = cressi_edy_parser_interval (parser);
+	unsigned int i = time ? (time - 1) / interval : 0;
+	if (i > parser->nsamples)
+		i = parser->nsamples;
+
+	*index = i;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+static dc_status_t
+cressi_edy_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata)
+{
+	return cressi_edy_parser_samples_range (abstract, 0, UINT_MAX, callback, userdata);
+}
+
+
+static dc_status_t
+cressi_edy_parser_samples_extract (dc_parser_t *abstract, dc_sample_columns_t *columns)
+{
+	cressi_edy_parser_t *parser = (cressi_edy_parser_t *) abstract;
+
+	const unsigned char *data = abstract->data;
+
+	dc_status_t rc = cressi_edy_parser_cache (parser);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	unsigned int nsamples = parser->nsamples;
+	unsigned int n = sample_columns_interval (columns, nsamples, cressi_edy_parser_interval (parser));
+
+	if (columns->temperature) {
+		double *temperature = columns->temperature;
+		for (unsigned int i = 0; i < n; ++i)
+			temperature[i] = NAN;
+	}
+
+	// The samples have a variable size, and are decoded in a single
+	// pass. The gas mixes are checked for all samples, to report the
+	// same errors as the sample callback.
+	unsigned int ngasmixes = cressi_edy_parser_count_gasmixes(data);
+	unsigned int gasmix = 0xFFFFFFFF;
+
+	double *depth = columns->depth;
+	unsigned int offset = 32;
+	for (unsigned int i = 0; i < nsamples; ++i) {
+		const unsigned char *p = data + offset;
+
+		if (depth && i < n)
+			depth[i] = (bcd2dec (p[0] & 0x0F) * 100 + bcd2dec (p[1])) / 10.0;
+
+		if (ngasmixes) {
+			unsigned int idx = cressi_edy_parser_sample_gasmix (parser, p);
+			if (idx >= ngasmixes) {
+				ERROR (abstract->context, "Invalid gas mix index.");
+				return DC_STATUS_DATAFORMAT;
+			}
+			if (idx != gasmix) {
+				if (columns->gasmix && i < n)
+					columns->gasmix[i] = idx;
+				gasmix = idx;
+			}
+		}
+
+		offset += (p[0] & 0x80) ? 6 : 2;
 	}
 
 	return DC_STATUS_SUCCESS;
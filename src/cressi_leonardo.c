@@ -94,6 +94,10 @@ cressi_leonardo_device_open (dc_device_t **out, dc_context_t *context, const cha
 		goto error_free;
 	}
 
+	// Interrupt the blocking reads when the download is cancelled, and
+	// measure the time spent waiting for the I/O.
+	device_set_port ((dc_device_t *) device, device->port);
+
 	// Set the serial communication protocol (115200 8N1).
 	status = dc_serial_configure (device->port, 115200, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -211,6 +215,10 @@ cressi_leonardo_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 
 	unsigned char *data = dc_buffer_get_data (buffer);
 
+	// The checksum is updated while the data is being received, so it is
+	// ready as soon as the trailer arrives.
+	unsigned short crc = 0xffff;
+
 	unsigned int nbytes = 0;
 	while (nbytes < SZ_MEMORY) {
 		// Set the minimum packet size.
@@ -233,6 +241,8 @@ cressi_leonardo_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 			return status;
 		}
 
+		crc = checksum_crc_ccitt_uint16 (data + nbytes, len, crc);
+
 		// Update and emit a progress event.
 		progress.current += len;
 		device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
@@ -254,7 +264,7 @@ cressi_leonardo_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 
 	// Verify the checksum.
 	unsigned int csum1 = array_uint16_be (checksum);
-	unsigned int csum2 = checksum_crc_ccitt_uint16 (data, SZ_MEMORY);
+	unsigned int csum2 = crc;
 	if (csum1 != csum2) {
 		ERROR (abstract->context, "Unexpected answer bytes.");
 		return DC_STATUS_PROTOCOL;
@@ -270,6 +280,8 @@ cressi_leonardo_device_foreach (dc_device_t *abstract, dc_dive_callback_t callba
 	if (buffer == NULL)
 		return DC_STATUS_NOMEMORY;
 
+	device_phase (abstract, DC_PHASE_PROFILE);
+
 	dc_status_t rc = cressi_leonardo_device_dump (abstract, buffer);
 	if (rc != DC_STATUS_SUCCESS) {
 		dc_buffer_free (buffer);
@@ -19,7 +19,11 @@
  * MA 02110-1301 USA
  */
 
+#define DC_LOG_CATEGORY DC_LOGCATEGORY_PARSER
+
 #include <stdlib.h>
+#include <limits.h>
+#include <math.h>
 
 #include <libdivecomputer/cressi_leonardo.h>
 
@@ -30,6 +34,9 @@
 #define ISINSTANCE(parser) dc_device_isinstance((parser), &cressi_leonardo_parser_vtable)
 
 #define SZ_HEADER 82
+#define SZ_SAMPLE 2
+
+#define INTERVAL  20
 
 typedef struct cressi_leonardo_parser_t cressi_leonardo_parser_t;
 
@@ -41,6 +48,9 @@ static dc_status_t cressi_leonardo_parser_set_data (dc_parser_t *abstract, const
 static dc_status_t cressi_leonardo_parser_get_datetime (dc_parser_t *abstract, dc_datetime_t *datetime);
 static dc_status_t cressi_leonardo_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsigned int flags, void *value);
 static dc_status_t cressi_leonardo_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata);
+static dc_status_t cressi_leonardo_parser_samples_extract (dc_parser_t *abstract, dc_sample_columns_t *columns);
+static dc_status_t cressi_leonardo_parser_samples_range (dc_parser_t *abstract, unsigned int first, unsigned int count, dc_sample_callback_t callback, void *userdata);
+static dc_status_t cressi_leonardo_parser_samples_seek (dc_parser_t *abstract, unsigned int time, unsigned int *index);
 
 static const dc_parser_vtable_t cressi_leonardo_parser_vtable = {
 	sizeof(cressi_leonardo_parser_t),
@@ -49,6 +59,14 @@ static const dc_parser_vtable_t cressi_leonardo_parser_vtable = {
 	cressi_leonardo_parser_get_datetime, /* datetime */
 	cressi_leonardo_parser_get_field, /* fields */
 	cressi_leonardo_parser_samples_foreach, /* samples_foreach */
+	cressi_leonardo_parser_samples_extract, /* samples_extract */
+	cressi_leonardo_parser_samples_range, /* samples_range */
+	cressi_leonardo_parser_samples_seek, /* samples_seek */
+	NULL, /* samples_index */
+	NULL, /* samples_split */
+	NULL, /* samples_chunk */
+	NULL, /* subdives */
+	NULL, /* samples_vendor */
 	NULL /* destroy */
 };
 
@@ -140,26 +158,38 @@ cressi_leonardo_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, u
 }
 
 
+static unsigned int
+cressi_leonardo_parser_nsamples (dc_parser_t *abstract)
+{
+	if (abstract->size < SZ_HEADER)
+		return 0;
+
+	return (abstract->size - SZ_HEADER) / SZ_SAMPLE;
+}
+
+
 static dc_status_t
-cressi_leonardo_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata)
+cressi_leonardo_parser_samples_range (dc_parser_t *abstract, unsigned int first, unsigned int count, dc_sample_callback_t callback, void *userdata)
 {
 	const unsigned char *data = abstract->data;
-	unsigned int size = abstract->size;
 
-	unsigned int time = 0;
-	unsigned int interval = 20;
+	unsigned int nsamples = cressi_leonardo_parser_nsamples (abstract);
+	if (first > nsamples)
+		first = nsamples;
+	unsigned int last = nsamples;
+	if (count < last - first)
+		last = first + count;
 
-	unsigned int offset = SZ_HEADER;
-	while (offset + 2 <= size) {
+	for (unsigned int i = first; i < last; ++i) {
 		dc_sample_value_t sample = {0};
 
+		unsigned int offset = SZ_HEADER + i * SZ_SAMPLE;
 		unsigned int value = array_uint16_le (data + offset);
 		unsigned int depth = value & 0x07FF;
 		unsigned int ascent = (value & 0xC000) >> 14;
 
 		// Time (seconds).
-		time += interval;
-		sample.time = time;
+		sample.time = (i + 1) * INTERVAL;
 		if (callback) callback (DC_SAMPLE_TIME, sample, userdata);
 
 		// Depth (1/10 m).
@@ -174,8 +204,61 @@ cressi_leonardo_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callbac
 			sample.event.value = ascent;
 			if (callback) callback (DC_SAMPLE_EVENT, sample, userdata);
 		}
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+static dc_status_t
+cressi_leonardo_parser_samples_seek (dc_parser_t *abstract, unsigned int time, unsigned int *index)
+{
+	unsigned int nsamples = cressi_leonardo_parser_nsamples (abstract);
+
+	// The first sample is recorded after one interval.
+	unsigned int i = time ? (time - 1) / INTERVAL : 0;
+	if (i > nsamples)
+		i = nsamples;
+
+	*index = i;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+static dc_status_t
+cressi_leonardo_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata)
+{
+	return cressi_leonardo_parser_samples_range (abstract, 0, UINT_MAX, callback, userdata);
+}
+
+
+static dc_status_t
+cressi_leonardo_parser_samples_extract (dc_parser_t *abstract, dc_sample_columns_t *columns)
+{
+	const unsigned char *data = abstract->data + SZ_HEADER;
+
+	unsigned int nsamples = cressi_leonardo_parser_nsamples (abstract);
+	unsigned int n = sample_columns_interval (columns, nsamples, INTERVAL);
+
+	// The fixed-size samples are converted in a separate loop per column.
+	if (columns->depth) {
+		double *depth = columns->depth;
+		for (unsigned int i = 0; i < n; ++i)
+			depth[i] = (array_uint16_le (data + i * SZ_SAMPLE) & 0x07FF) / 10.0;
+	}
+
+	if (columns->temperature) {
+		double *temperature = columns->temperature;
+		for (unsigned int i = 0; i < n; ++i)
+			temperature[i] = NAN;
+	}
 
-		offset += 2;
+	// The ascent rate events are reported for all samples.
+	for (unsigned int i = 0; i < nsamples; ++i) {
+		unsigned int ascent = (array_uint16_le (data + i * SZ_SAMPLE) & 0xC000) >> 14;
+		if (ascent)
+			sample_columns_event_at (columns, i, SAMPLE_EVENT_ASCENT, 0, NULL, 0, ascent);
 	}
 
 	return DC_STATUS_SUCCESS;
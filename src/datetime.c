@@ -23,10 +23,57 @@
 #include "config.h"
 #endif
 
+#include <limits.h>
 #include <time.h>
 
 #include <libdivecomputer/datetime.h>
 
+#include "thread.h"
+
+#define SECONDS_PER_DAY 86400
+
+// The UTC offset of the local time is cached per day. An entry is only
+// stored when the offset is the same at the start and the end of the day,
+// which holds for every day without a timezone transition. The entries
+// are read and written atomically, without locking.
+#if defined(__GNUC__) || defined(_WIN64)
+#define OFFSET_CACHE 64
+#endif
+
+#ifdef OFFSET_CACHE
+static unsigned long long g_offset_cache[OFFSET_CACHE];
+#endif
+
+/*
+ * Conversion between a civil date and the number of days since the epoch
+ * in the proleptic Gregorian calendar. The formulas work with eras of 400
+ * years, starting on March 1st, so the leap day is the last day of the year.
+ */
+static dc_ticks_t
+dc_days_from_civil (dc_ticks_t year, unsigned int month, unsigned int day)
+{
+	year -= month <= 2;
+	dc_ticks_t era = (year >= 0 ? year : year - 399) / 400;
+	unsigned int yoe = year - era * 400;
+	unsigned int doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+	unsigned int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + doe - 719468;
+}
+
+static void
+dc_civil_from_days (dc_ticks_t days, dc_ticks_t *year, unsigned int *month, unsigned int *day)
+{
+	days += 719468;
+	dc_ticks_t era = (days >= 0 ? days : days - 146096) / 146097;
+	unsigned int doe = days - era * 146097;
+	unsigned int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	unsigned int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	unsigned int mp = (5 * doy + 2) / 153;
+	*day = doy - (153 * mp + 2) / 5 + 1;
+	*month = mp < 10 ? mp + 3 : mp - 9;
+	*year = yoe + era * 400 + (*month <= 2);
+}
+
 static struct tm *
 dc_localtime_r (const time_t *t, struct tm *tm)
 {
@@ -44,20 +91,60 @@ dc_localtime_r (const time_t *t, struct tm *tm)
 #endif
 }
 
-static struct tm *
-dc_gmtime_r (const time_t *t, struct tm *tm)
+static int
+dc_datetime_offset (dc_ticks_t ticks, const struct tm *tm)
 {
-#ifdef HAVE_GMTIME_R
-	return gmtime_r (t, tm);
-#else
-	struct tm *p = gmtime (t);
-	if (p == NULL)
-		return NULL;
+	dc_ticks_t local = dc_days_from_civil (tm->tm_year + 1900LL, tm->tm_mon + 1, tm->tm_mday) * SECONDS_PER_DAY +
+		tm->tm_hour * 3600 + tm->tm_min * 60 + tm->tm_sec;
 
-	if (tm)
-		*tm = *p;
+	return local - ticks;
+}
 
-	return tm;
+static int
+dc_datetime_offset_lookup (dc_ticks_t ticks, int *offset)
+{
+#ifdef OFFSET_CACHE
+	if (ticks < 0 || ticks / SECONDS_PER_DAY >= INT_MAX)
+		return 0;
+
+	unsigned long long key = ticks / SECONDS_PER_DAY + 1;
+	unsigned long long entry = dc_atomic_load (&g_offset_cache[key % OFFSET_CACHE]);
+	if ((entry >> 32) != key)
+		return 0;
+
+	*offset = (int) (entry & 0xFFFFFFFF);
+
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+static void
+dc_datetime_offset_store (dc_ticks_t ticks)
+{
+#ifdef OFFSET_CACHE
+	if (ticks < 0 || ticks / SECONDS_PER_DAY >= INT_MAX)
+		return;
+
+	dc_ticks_t day = ticks / SECONDS_PER_DAY;
+	time_t begin = day * SECONDS_PER_DAY;
+	time_t end = begin + SECONDS_PER_DAY - 1;
+	if (begin != day * SECONDS_PER_DAY || end != begin + SECONDS_PER_DAY - 1)
+		return; // Out of range for time_t.
+
+	struct tm tm_begin, tm_end;
+	if (dc_localtime_r (&begin, &tm_begin) == NULL ||
+		dc_localtime_r (&end, &tm_end) == NULL)
+		return;
+
+	int offset = dc_datetime_offset (begin, &tm_begin);
+	if (offset != dc_datetime_offset (end, &tm_end))
+		return; // Timezone transition.
+
+	unsigned long long key = day + 1;
+	unsigned long long entry = (key << 32) | (unsigned int) offset;
+	dc_atomic_store (&g_offset_cache[key % OFFSET_CACHE], entry);
 #endif
 }
 
@@ -71,12 +158,20 @@ dc_datetime_t *
 dc_datetime_localtime (dc_datetime_t *result,
                        dc_ticks_t ticks)
 {
+	int offset = 0;
+	if (dc_datetime_offset_lookup (ticks, &offset))
+		return dc_datetime_gmtime (result, ticks + offset);
+
 	time_t t = ticks;
+	if (t != ticks)
+		return NULL;
 
 	struct tm tm;
 	if (dc_localtime_r (&t, &tm) == NULL)
 		return NULL;
 
+	dc_datetime_offset_store (ticks);
+
 	if (result) {
 		result->year = tm.tm_year + 1900;
 		result->month = tm.tm_mon + 1;
@@ -93,19 +188,26 @@ dc_datetime_t *
 dc_datetime_gmtime (dc_datetime_t *result,
                     dc_ticks_t ticks)
 {
-	time_t t = ticks;
+	dc_ticks_t days = ticks / SECONDS_PER_DAY;
+	dc_ticks_t seconds = ticks % SECONDS_PER_DAY;
+	if (seconds < 0) {
+		seconds += SECONDS_PER_DAY;
+		days--;
+	}
 
-	struct tm tm;
-	if (dc_gmtime_r (&t, &tm) == NULL)
+	dc_ticks_t year = 0;
+	unsigned int month = 0, day = 0;
+	dc_civil_from_days (days, &year, &month, &day);
+	if (year - 1900 > INT_MAX || year - 1900 < INT_MIN)
 		return NULL;
 
 	if (result) {
-		result->year = tm.tm_year + 1900;
-		result->month = tm.tm_mon + 1;
-		result->day = tm.tm_mday;
-		result->hour = tm.tm_hour;
-		result->minute = tm.tm_min;
-		result->second = tm.tm_sec;
+		result->year = year;
+		result->month = month;
+		result->day = day;
+		result->hour = seconds / 3600;
+		result->minute = (seconds % 3600) / 60;
+		result->second = seconds % 60;
 	}
 
 	return result;
@@ -117,6 +219,25 @@ dc_datetime_mktime (const dc_datetime_t *dt)
 	if (dt == NULL)
 		return -1;
 
+	// Normalize the month, and convert the local time to seconds.
+	dc_ticks_t year = dt->year + (dt->month - 1) / 12;
+	int month = (dt->month - 1) % 12;
+	if (month < 0) {
+		month += 12;
+		year--;
+	}
+	dc_ticks_t local = (dc_days_from_civil (year, month + 1, 1) + dt->day - 1) * SECONDS_PER_DAY +
+		dt->hour * 3600LL + dt->minute * 60LL + dt->second;
+
+	// The offset is looked up for the day of the resulting time, not the
+	// local time. Use it only if both days agree on the offset.
+	int guess = 0, offset = 0;
+	if (dc_datetime_offset_lookup (local, &guess) &&
+		dc_datetime_offset_lookup (local - guess, &offset) &&
+		offset == guess) {
+		return local - offset;
+	}
+
 	struct tm tm;
 	tm.tm_year = dt->year - 1900;
 	tm.tm_mon = dt->month - 1;
@@ -126,5 +247,9 @@ dc_datetime_mktime (const dc_datetime_t *dt)
 	tm.tm_sec = dt->second;
 	tm.tm_isdst = -1;
 
-	return mktime (&tm);
+	time_t ticks = mktime (&tm);
+	if (ticks != (time_t) -1)
+		dc_datetime_offset_store (ticks);
+
+	return ticks;
 }
@@ -0,0 +1,338 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <libdivecomputer/deco.h>
+#include <libdivecomputer/units.h>
+
+#define NTISSUES 16
+
+#define WATERVAPOUR 0.0627
+#define AIR_NITROGEN 0.79
+
+#define STOPSTEP 3.0
+#define MAXTIME 999
+
+// ZHL-16C, with compartment 1b for nitrogen.
+static const double n2_halftime[NTISSUES] = {
+	5.0, 8.0, 12.5, 18.5, 27.0, 38.3, 54.3, 77.0,
+	109.0, 146.0, 187.0, 239.0, 305.0, 390.0, 498.0, 635.0};
+static const double n2_a[NTISSUES] = {
+	1.1696, 1.0, 0.8618, 0.7562, 0.6200, 0.5043, 0.4410, 0.4000,
+	0.3750, 0.3500, 0.3295, 0.3065, 0.2835, 0.2610, 0.2480, 0.2327};
+static const double n2_b[NTISSUES] = {
+	0.5578, 0.6514, 0.7222, 0.7825, 0.8126, 0.8434, 0.8693, 0.8910,
+	0.9092, 0.9222, 0.9319, 0.9403, 0.9477, 0.9544, 0.9602, 0.9653};
+
+static const double he_halftime[NTISSUES] = {
+	1.88, 3.02, 4.72, 6.99, 10.21, 14.48, 20.53, 29.11,
+	41.20, 55.19, 70.69, 90.34, 115.29, 147.42, 188.24, 240.03};
+static const double he_a[NTISSUES] = {
+	1.6189, 1.3830, 1.1919, 1.0458, 0.9220, 0.8205, 0.7305, 0.6502,
+	0.5950, 0.5545, 0.5333, 0.5189, 0.5181, 0.5176, 0.5172, 0.5119};
+static const double he_b[NTISSUES] = {
+	0.4770, 0.5747, 0.6527, 0.7223, 0.7582, 0.7957, 0.8279, 0.8553,
+	0.8757, 0.8903, 0.8997, 0.9073, 0.9122, 0.9171, 0.9217, 0.9267};
+
+typedef struct deco_tissues_t {
+	double n2[NTISSUES];
+	double he[NTISSUES];
+} deco_tissues_t;
+
+typedef struct deco_t {
+	double gflow;
+	double gfhigh;
+	double surface;
+	double pressure_per_meter;
+	// Ambient pressure where the gradient factor low applies.
+	double anchor;
+	// Inspired partial pressures of the current gas, per bar of
+	// ambient pressure.
+	double fn2;
+	double fhe;
+} deco_t;
+
+/*
+ * Fill in the fraction of the difference with the inspired pressure
+ * that is taken up during the interval. The tissues are kept as
+ * separate arrays, and all loops run over the same fixed number of
+ * compartments, so the compiler can vectorize them.
+ */
+static void
+deco_factors (double factors[NTISSUES], const double halftime[NTISSUES], double seconds)
+{
+	for (unsigned int i = 0; i < NTISSUES; ++i)
+		factors[i] = 1.0 - pow (2.0, -seconds / (halftime[i] * 60.0));
+}
+
+static void
+deco_load (deco_tissues_t *tissues, const double n2f[NTISSUES], const double hef[NTISSUES], double pn2, double phe)
+{
+	for (unsigned int i = 0; i < NTISSUES; ++i)
+		tissues->n2[i] += (pn2 - tissues->n2[i]) * n2f[i];
+	for (unsigned int i = 0; i < NTISSUES; ++i)
+		tissues->he[i] += (phe - tissues->he[i]) * hef[i];
+}
+
+/*
+ * Get the lowest ambient pressure tolerated by all compartments.
+ */
+static double
+deco_tolerated (const deco_tissues_t *tissues, double gf)
+{
+	double tolerated = 0.0;
+
+	for (unsigned int i = 0; i < NTISSUES; ++i) {
+		double p = tissues->n2[i] + tissues->he[i];
+		double a = (n2_a[i] * tissues->n2[i] + he_a[i] * tissues->he[i]) / p;
+		double b = (n2_b[i] * tissues->n2[i] + he_b[i] * tissues->he[i]) / p;
+		double value = (p - a * gf) / (gf / b + 1.0 - gf);
+		if (tolerated < value)
+			tolerated = value;
+	}
+
+	return tolerated;
+}
+
+/*
+ * Get the gradient factor of the leading compartment at the ambient
+ * pressure, as a fraction of its M-value.
+ */
+static double
+deco_gradient (const deco_tissues_t *tissues, double pressure)
+{
+	double gradient = 0.0;
+
+	for (unsigned int i = 0; i < NTISSUES; ++i) {
+		double p = tissues->n2[i] + tissues->he[i];
+		double a = (n2_a[i] * tissues->n2[i] + he_a[i] * tissues->he[i]) / p;
+		double b = (n2_b[i] * tissues->n2[i] + he_b[i] * tissues->he[i]) / p;
+		double mvalue = a + pressure / b;
+		double value = (p - pressure) / (mvalue - pressure);
+		if (gradient < value)
+			gradient = value;
+	}
+
+	return gradient;
+}
+
+/*
+ * Get the gradient factor at the ambient pressure, going linearly from
+ * the gradient factor low at the deepest ceiling to the gradient factor
+ * high at the surface.
+ */
+static double
+deco_gf (const deco_t *deco, double pressure)
+{
+	if (deco->anchor <= deco->surface || pressure <= deco->surface)
+		return deco->gfhigh;
+
+	if (pressure >= deco->anchor)
+		return deco->gflow;
+
+	return deco->gfhigh + (deco->gflow - deco->gfhigh) *
+		(pressure - deco->surface) / (deco->anchor - deco->surface);
+}
+
+static double
+deco_ceiling (const deco_t *deco, const deco_tissues_t *tissues)
+{
+	// Without a ceiling at the gradient factor high, a direct ascent is
+	// allowed, consistent with the no decompression limit.
+	double ceiling = deco_tolerated (tissues, deco->gfhigh);
+	if (ceiling <= deco->surface)
+		return ceiling;
+
+	// The gradient factor depends on the ceiling itself, but changes
+	// slowly enough to converge in a few iterations.
+	for (unsigned int i = 0; i < 4; ++i)
+		ceiling = deco_tolerated (tissues, deco_gf (deco, ceiling));
+
+	return ceiling;
+}
+
+/*
+ * Check whether the ambient pressure limit is tolerated after staying
+ * the number of minutes at the ambient pressure.
+ */
+static int
+deco_tolerated_after (const deco_t *deco, const deco_tissues_t *tissues, double pressure, unsigned int minutes, double limit)
+{
+	double n2f[NTISSUES], hef[NTISSUES];
+	deco_tissues_t future = *tissues;
+
+	deco_factors (n2f, n2_halftime, minutes * 60.0);
+	deco_factors (hef, he_halftime, minutes * 60.0);
+	deco_load (&future, n2f, hef,
+		(pressure - WATERVAPOUR) * deco->fn2,
+		(pressure - WATERVAPOUR) * deco->fhe);
+
+	return deco_tolerated (&future, deco_gf (deco, limit)) <= limit;
+}
+
+static void
+deco_state (const deco_t *deco, const deco_tissues_t *tissues, double pressure, dc_deco_sample_t *result)
+{
+	double ceiling = deco_ceiling (deco, tissues);
+	double depth = (ceiling - deco->surface) / deco->pressure_per_meter;
+
+	result->ceiling = depth > 0.0 ? depth : 0.0;
+	result->gf = deco_gradient (tissues, pressure);
+	result->surface_gf = deco_gradient (tissues, deco->surface);
+
+	if (depth > 0.0) {
+		// Find the shortest time at the first stop, after which the
+		// ascent to the next stop is allowed.
+		double stop = ceil (depth / STOPSTEP) * STOPSTEP;
+		double pstop = deco->surface + stop * deco->pressure_per_meter;
+		double pnext = deco->surface + (stop - STOPSTEP) * deco->pressure_per_meter;
+		unsigned int lo = 0, hi = MAXTIME;
+		while (hi - lo > 1) {
+			unsigned int mid = lo + (hi - lo) / 2;
+			if (deco_tolerated_after (deco, tissues, pstop, mid, pnext))
+				hi = mid;
+			else
+				lo = mid;
+		}
+
+		result->type = DC_DECO_DECOSTOP;
+		result->time = hi * 60;
+		result->depth = stop;
+	} else {
+		// Find the longest time at the current depth, after which a
+		// direct ascent to the surface is still allowed.
+		unsigned int lo = 0, hi = MAXTIME;
+		if (deco_tolerated_after (deco, tissues, pressure, hi, deco->surface)) {
+			lo = hi;
+		} else {
+			while (hi - lo > 1) {
+				unsigned int mid = lo + (hi - lo) / 2;
+				if (deco_tolerated_after (deco, tissues, pressure, mid, deco->surface))
+					lo = mid;
+				else
+					hi = mid;
+			}
+		}
+
+		result->type = DC_DECO_NDL;
+		result->time = lo * 60;
+		result->depth = 0.0;
+	}
+}
+
+static void
+deco_set_gasmix (deco_t *deco, const dc_gasmix_t *gasmix)
+{
+	if (gasmix) {
+		deco->fhe = gasmix->helium;
+		deco->fn2 = 1.0 - gasmix->oxygen - gasmix->helium;
+	} else {
+		deco->fhe = 0.0;
+		deco->fn2 = AIR_NITROGEN;
+	}
+
+	if (deco->fn2 < 0.0)
+		deco->fn2 = 0.0;
+}
+
+dc_status_t
+dc_deco_compute (const dc_deco_settings_t *settings, const dc_sample_columns_t *columns, const dc_gasmix_t gasmixes[], unsigned int ngasmixes, dc_deco_sample_t results[])
+{
+	deco_t deco;
+	deco_tissues_t tissues;
+	double n2f[NTISSUES], hef[NTISSUES];
+
+	if (columns == NULL || columns->time == NULL || columns->depth == NULL ||
+		results == NULL || (ngasmixes && gasmixes == NULL))
+		return DC_STATUS_INVALIDARGS;
+
+	deco.gflow = 1.0;
+	deco.gfhigh = 1.0;
+	deco.surface = ATM / BAR;
+	double density = 1.025;
+	if (settings) {
+		if (settings->gflow > 0.0)
+			deco.gflow = settings->gflow;
+		if (settings->gfhigh > 0.0)
+			deco.gfhigh = settings->gfhigh;
+		if (settings->surface > 0.0)
+			deco.surface = settings->surface;
+		if (settings->density > 0.0)
+			density = settings->density;
+	}
+
+	if (deco.gflow > deco.gfhigh)
+		return DC_STATUS_INVALIDARGS;
+
+	// Pressure of the water column, with the density in kg/l.
+	deco.pressure_per_meter = density * 1000.0 * GRAVITY / BAR;
+	deco.anchor = deco.surface;
+
+	deco_set_gasmix (&deco, ngasmixes ? &gasmixes[0] : NULL);
+
+	// Start saturated with air at the surface.
+	for (unsigned int i = 0; i < NTISSUES; ++i) {
+		tissues.n2[i] = (deco.surface - WATERVAPOUR) * AIR_NITROGEN;
+		tissues.he[i] = 0.0;
+	}
+
+	unsigned int nsamples = columns->nsamples < columns->capacity ? columns->nsamples : columns->capacity;
+	unsigned int time = 0, interval = 0;
+	double depth = 0.0;
+	for (unsigned int i = 0; i < nsamples; ++i) {
+		double current = columns->depth[i];
+		if (isnan (current))
+			current = depth;
+
+		// Load the tissues at the average pressure of the interval, with
+		// the gas breathed before the sample. The factors are cached for
+		// the common case of a fixed sample rate.
+		if (columns->time[i] > time) {
+			if (columns->time[i] - time != interval) {
+				interval = columns->time[i] - time;
+				deco_factors (n2f, n2_halftime, interval);
+				deco_factors (hef, he_halftime, interval);
+			}
+
+			double pressure = deco.surface + (depth + current) / 2.0 * deco.pressure_per_meter;
+			deco_load (&tissues, n2f, hef,
+				(pressure - WATERVAPOUR) * deco.fn2,
+				(pressure - WATERVAPOUR) * deco.fhe);
+			time = columns->time[i];
+		}
+		depth = current;
+
+		if (columns->gasmix && columns->gasmix[i] < ngasmixes)
+			deco_set_gasmix (&deco, &gasmixes[columns->gasmix[i]]);
+
+		// The gradient factor low applies at the deepest ceiling.
+		double anchor = deco_tolerated (&tissues, deco.gflow);
+		if (deco.anchor < anchor)
+			deco.anchor = anchor;
+
+		deco_state (&deco, &tissues, deco.surface + depth * deco.pressure_per_meter, results + i);
+	}
+
+	return DC_STATUS_SUCCESS;
+}
@@ -25,10 +25,12 @@
 
 #include <stddef.h>
 #include <stdlib.h>
+#include <ctype.h>
 
 #include <libdivecomputer/descriptor.h>
 
 #include "iterator-private.h"
+#include "thread.h"
 
 #define C_ARRAY_SIZE(array) (sizeof (array) / sizeof *(array))
 
@@ -48,6 +50,7 @@ struct dc_descriptor_t {
  */
 
 static const dc_descriptor_t g_descriptors[] = {
+#ifdef ENABLE_BACKEND_SUUNTO
 	/* Suunto Solution */
 	{"Suunto", "Solution", DC_FAMILY_SUUNTO_SOLUTION, 0},
 	/* Suunto Eon */
@@ -84,6 +87,8 @@ static const dc_descriptor_t g_descriptors[] = {
 #ifdef HAVE_LIBUSB
 	{"Suunto", "EON Steel", DC_FAMILY_SUUNTO_EONSTEEL, 0},
 #endif
+#endif
+#ifdef ENABLE_BACKEND_UWATEC
 	/* Uwatec Aladin */
 	{"Uwatec", "Aladin Air Twin",     DC_FAMILY_UWATEC_ALADIN, 0x1C},
 	{"Uwatec", "Aladin Sport Plus",   DC_FAMILY_UWATEC_ALADIN, 0x3E},
@@ -119,10 +124,14 @@ static const dc_descriptor_t g_descriptors[] = {
 	{"Scubapro", "Mantis",      DC_FAMILY_UWATEC_MERIDIAN, 0x20},
 	{"Scubapro", "Chromis",     DC_FAMILY_UWATEC_MERIDIAN, 0x24},
 	{"Scubapro", "Mantis 2",    DC_FAMILY_UWATEC_MERIDIAN, 0x26},
+#endif
+#ifdef ENABLE_BACKEND_REEFNET
 	/* Reefnet */
 	{"Reefnet", "Sensus",       DC_FAMILY_REEFNET_SENSUS, 1},
 	{"Reefnet", "Sensus Pro",   DC_FAMILY_REEFNET_SENSUSPRO, 2},
 	{"Reefnet", "Sensus Ultra", DC_FAMILY_REEFNET_SENSUSULTRA, 3},
+#endif
+#ifdef ENABLE_BACKEND_OCEANIC
 	/* Oceanic VT Pro */
 	{"Aeris",    "500 AI",     DC_FAMILY_OCEANIC_VTPRO, 0x4151},
 	{"Oceanic",  "Versa Pro",  DC_FAMILY_OCEANIC_VTPRO, 0x4155},
@@ -194,6 +203,8 @@ static const dc_descriptor_t g_descriptors[] = {
 	{"Aqualung", "i300",                DC_FAMILY_OCEANIC_ATOM2, 0x4559},
 	{"Aqualung", "i450T",               DC_FAMILY_OCEANIC_ATOM2, 0x4641},
 	{"Aqualung", "i550T",               DC_FAMILY_OCEANIC_ATOM2, 0x4642},
+#endif
+#ifdef ENABLE_BACKEND_MARES
 	/* Mares Nemo */
 	{"Mares", "Nemo",         DC_FAMILY_MARES_NEMO, 0},
 	{"Mares", "Nemo Steel",   DC_FAMILY_MARES_NEMO, 0},
@@ -220,6 +231,8 @@ static const dc_descriptor_t g_descriptors[] = {
 	{"Mares", "Puck Pro",          DC_FAMILY_MARES_ICONHD , 0x18},
 	{"Mares", "Nemo Wide 2",       DC_FAMILY_MARES_ICONHD , 0x19},
 	{"Mares", "Puck 2",            DC_FAMILY_MARES_ICONHD , 0x1F},
+#endif
+#ifdef ENABLE_BACKEND_HW
 	/* Heinrichs Weikamp */
 	{"Heinrichs Weikamp", "OSTC",     DC_FAMILY_HW_OSTC, 0},
 	{"Heinrichs Weikamp", "OSTC Mk2", DC_FAMILY_HW_OSTC, 1},
@@ -237,6 +250,8 @@ static const dc_descriptor_t g_descriptors[] = {
 	{"Heinrichs Weikamp", "OSTC cR",    DC_FAMILY_HW_OSTC3, 0x07},
 	{"Heinrichs Weikamp", "OSTC Sport", DC_FAMILY_HW_OSTC3, 0x12},
 	{"Heinrichs Weikamp", "OSTC Sport", DC_FAMILY_HW_OSTC3, 0x13},
+#endif
+#ifdef ENABLE_BACKEND_CRESSI
 	/* Cressi Edy */
 	{"Tusa",   "IQ-700", DC_FAMILY_CRESSI_EDY, 0x05},
 	{"Cressi", "Edy",    DC_FAMILY_CRESSI_EDY, 0x08},
@@ -244,16 +259,22 @@ static const dc_descriptor_t g_descriptors[] = {
 	{"Cressi", "Leonardo", DC_FAMILY_CRESSI_LEONARDO, 1},
 	{"Cressi", "Giotto",   DC_FAMILY_CRESSI_LEONARDO, 4},
 	{"Cressi", "Newton",   DC_FAMILY_CRESSI_LEONARDO, 5},
+#endif
+#ifdef ENABLE_BACKEND_ZEAGLE
 	/* Zeagle N2iTiON3 */
 	{"Zeagle",   "N2iTiON3",   DC_FAMILY_ZEAGLE_N2ITION3, 0},
 	{"Apeks",    "Quantum X",  DC_FAMILY_ZEAGLE_N2ITION3, 0},
 	{"Dive Rite", "NiTek Trio", DC_FAMILY_ZEAGLE_N2ITION3, 0},
 	{"Scubapro", "XTender 5",  DC_FAMILY_ZEAGLE_N2ITION3, 0},
+#endif
+#ifdef ENABLE_BACKEND_ATOMICS
 	/* Atomic Aquatics Cobalt */
 #ifdef HAVE_LIBUSB
 	{"Atomic Aquatics", "Cobalt", DC_FAMILY_ATOMICS_COBALT, 0},
 	{"Atomic Aquatics", "Cobalt 2", DC_FAMILY_ATOMICS_COBALT, 2},
 #endif
+#endif
+#ifdef ENABLE_BACKEND_SHEARWATER
 	/* Shearwater Predator */
 	{"Shearwater", "Predator", DC_FAMILY_SHEARWATER_PREDATOR, 2},
 	/* Shearwater Petrel */
@@ -261,10 +282,16 @@ static const dc_descriptor_t g_descriptors[] = {
 	{"Shearwater", "Petrel 2", DC_FAMILY_SHEARWATER_PETREL, 3},
 	{"Shearwater", "Nerd",     DC_FAMILY_SHEARWATER_PETREL, 3},
 	{"Shearwater", "Perdix",   DC_FAMILY_SHEARWATER_PETREL, 3},
+#endif
+#ifdef ENABLE_BACKEND_DIVERITE
 	/* Dive Rite NiTek Q */
 	{"Dive Rite", "NiTek Q",   DC_FAMILY_DIVERITE_NITEKQ, 0},
+#endif
+#ifdef ENABLE_BACKEND_CITIZEN
 	/* Citizen Hyper Aqualand */
 	{"Citizen", "Hyper Aqualand", DC_FAMILY_CITIZEN_AQUALAND, 0},
+#endif
+#ifdef ENABLE_BACKEND_DIVESYSTEM
 	/* DiveSystem iDive */
 	{"DiveSystem", "Orca",          DC_FAMILY_DIVESYSTEM_IDIVE, 0x02},
 	{"DiveSystem", "iDive Pro",     DC_FAMILY_DIVESYSTEM_IDIVE, 0x03},
@@ -280,12 +307,156 @@ static const dc_descriptor_t g_descriptors[] = {
 	{"DiveSystem", "iX3M Deep",     DC_FAMILY_DIVESYSTEM_IDIVE, 0x23},
 	{"DiveSystem", "iX3M Tec",      DC_FAMILY_DIVESYSTEM_IDIVE, 0x24},
 	{"DiveSystem", "iX3M Reb",      DC_FAMILY_DIVESYSTEM_IDIVE, 0x25},
+#endif
+#ifdef ENABLE_BACKEND_COCHRAN
 	{"Cochran", "Commander",	DC_FAMILY_COCHRAN_COMMANDER, 0},
 	{"Cochran", "EMC-14",		DC_FAMILY_COCHRAN_COMMANDER, 1},
 	{"Cochran", "EMC-16",		DC_FAMILY_COCHRAN_COMMANDER, 2},
 	{"Cochran", "EMC-20H",		DC_FAMILY_COCHRAN_COMMANDER, 3},
+#endif
 };
 
+/*
+ * Sorted indexes into the descriptor table, for fast lookups by model
+ * number and by name. Both are built once, on first use. Entries that
+ * compare equal keep their relative order in the table, so a lookup
+ * returns the same descriptor as a linear search would.
+ */
+static unsigned short g_index_model[C_ARRAY_SIZE (g_descriptors)];
+static unsigned short g_index_name[C_ARRAY_SIZE (g_descriptors)];
+static dc_once_t g_index_once = DC_ONCE_INIT;
+
+static int
+dc_descriptor_strcasecmp (const char *a, const char *b)
+{
+	while (*a && tolower ((unsigned char) *a) == tolower ((unsigned char) *b)) {
+		a++;
+		b++;
+	}
+
+	return tolower ((unsigned char) *a) - tolower ((unsigned char) *b);
+}
+
+static int
+dc_descriptor_compare_model (const dc_descriptor_t *descriptor, dc_family_t type, unsigned int model)
+{
+	if (descriptor->type != type)
+		return descriptor->type < type ? -1 : 1;
+	if (descriptor->model != model)
+		return descriptor->model < model ? -1 : 1;
+	return 0;
+}
+
+static int
+dc_descriptor_compare_name (const dc_descriptor_t *descriptor, const char *vendor, const char *product)
+{
+	int rc = dc_descriptor_strcasecmp (descriptor->vendor, vendor);
+	if (rc != 0)
+		return rc;
+
+	return dc_descriptor_strcasecmp (descriptor->product, product);
+}
+
+static int
+dc_descriptor_sort_model (const void *a, const void *b)
+{
+	unsigned int ia = *(const unsigned short *) a;
+	unsigned int ib = *(const unsigned short *) b;
+	const dc_descriptor_t *descriptor = g_descriptors + ib;
+
+	int rc = dc_descriptor_compare_model (g_descriptors + ia, descriptor->type, descriptor->model);
+	if (rc != 0)
+		return rc;
+
+	return ia < ib ? -1 : ia > ib;
+}
+
+static int
+dc_descriptor_sort_name (const void *a, const void *b)
+{
+	unsigned int ia = *(const unsigned short *) a;
+	unsigned int ib = *(const unsigned short *) b;
+	const dc_descriptor_t *descriptor = g_descriptors + ib;
+
+	int rc = dc_descriptor_compare_name (g_descriptors + ia, descriptor->vendor, descriptor->product);
+	if (rc != 0)
+		return rc;
+
+	return ia < ib ? -1 : ia > ib;
+}
+
+static void
+dc_descriptor_index_init (void)
+{
+	for (unsigned int i = 0; i < C_ARRAY_SIZE (g_descriptors); ++i) {
+		g_index_model[i] = i;
+		g_index_name[i] = i;
+	}
+
+	qsort (g_index_model, C_ARRAY_SIZE (g_index_model), sizeof (g_index_model[0]), dc_descriptor_sort_model);
+	qsort (g_index_name, C_ARRAY_SIZE (g_index_name), sizeof (g_index_name[0]), dc_descriptor_sort_name);
+}
+
+dc_status_t
+dc_descriptor_find_by_model (dc_descriptor_t **out, dc_family_t type, unsigned int model)
+{
+	if (out == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_once (&g_index_once, dc_descriptor_index_init);
+
+	// Find the first matching entry.
+	size_t lo = 0, hi = C_ARRAY_SIZE (g_index_model);
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (dc_descriptor_compare_model (g_descriptors + g_index_model[mid], type, model) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo == C_ARRAY_SIZE (g_index_model) ||
+		dc_descriptor_compare_model (g_descriptors + g_index_model[lo], type, model) != 0) {
+		*out = NULL;
+		return DC_STATUS_UNSUPPORTED;
+	}
+
+	// See dc_descriptor_iterator_next for the const cast.
+	*out = (dc_descriptor_t *) &g_descriptors[g_index_model[lo]];
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_descriptor_find_by_name (dc_descriptor_t **out, const char *vendor, const char *product)
+{
+	if (out == NULL || vendor == NULL || product == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_once (&g_index_once, dc_descriptor_index_init);
+
+	// Find the first matching entry.
+	size_t lo = 0, hi = C_ARRAY_SIZE (g_index_name);
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (dc_descriptor_compare_name (g_descriptors + g_index_name[mid], vendor, product) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo == C_ARRAY_SIZE (g_index_name) ||
+		dc_descriptor_compare_name (g_descriptors + g_index_name[lo], vendor, product) != 0) {
+		*out = NULL;
+		return DC_STATUS_UNSUPPORTED;
+	}
+
+	// See dc_descriptor_iterator_next for the const cast.
+	*out = (dc_descriptor_t *) &g_descriptors[g_index_name[lo]];
+
+	return DC_STATUS_SUCCESS;
+}
+
 typedef struct dc_descriptor_iterator_t {
 	dc_iterator_t base;
 	size_t current;
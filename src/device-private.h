@@ -26,6 +26,8 @@
 
 #include <libdivecomputer/context.h>
 #include <libdivecomputer/device.h>
+#include <libdivecomputer/syncstore.h>
+#include <libdivecomputer/checkpoint.h>
 
 #include "common-private.h"
 
@@ -48,12 +50,49 @@ struct dc_device_t {
 	unsigned int event_mask;
 	dc_event_callback_t event_callback;
 	void *event_userdata;
+	// Progress event throttling.
+	unsigned int progress_interval;
+	unsigned int progress_delta;
+	unsigned int have_progress;
+	unsigned long long progress_time;
+	dc_event_progress_t progress;
+	// Progress rate and estimate.
+	unsigned int have_transfer;
+	unsigned long long transfer_begin;
+	unsigned int transfer_origin;
+	unsigned int transfer_current;
+	unsigned int transfer_maximum;
+	// Transfer statistics.
+	dc_device_stats_t stats;
 	// Cancellation support.
 	dc_cancel_callback_t cancel_callback;
 	void *cancel_userdata;
 	// Cached events for the parsers.
 	dc_event_devinfo_t devinfo;
 	dc_event_clock_t clock;
+	// Directory for the persistent page cache.
+	char *cachedir;
+	// Fingerprint store for incremental downloads.
+	dc_syncstore_t *syncstore;
+	unsigned int have_devinfo;
+	// Progress of an interrupted download, for resuming.
+	dc_checkpoint_t *checkpoint;
+	// Block size and alignment of the memory reads, for range dumps.
+	unsigned int blocksize;
+	// Sorted set of fingerprints of the dives already in the archive.
+	unsigned char *fingerprints;
+	unsigned int fingerprints_size;
+	unsigned int fingerprints_count;
+	// Memory allocated by the device, on top of the object itself.
+	size_t memory;
+	// Current phase of the download, and the time at its start.
+	unsigned int phase;
+	unsigned long long phase_begin;
+	unsigned long long phase_iotime;
+	unsigned long long phase_callbacktime;
+	// Time spent in the I/O and in the dive callback (microseconds).
+	unsigned long long iotime;
+	unsigned long long callbacktime;
 };
 
 struct dc_device_vtable_t {
@@ -86,9 +125,64 @@ dc_device_deallocate (dc_device_t *device);
 void
 device_event_emit (dc_device_t *device, dc_event_type_t event, const void *data);
 
+/*
+ * Report the buffers allocated by the backend, for the memory usage of
+ * the device and its context. Everything still reported when the device
+ * is closed, is released automatically.
+ */
+void
+device_memory_add (dc_device_t *device, size_t size);
+
+void
+device_memory_sub (dc_device_t *device, size_t size);
+
 int
 device_is_cancelled (dc_device_t *device);
 
+/*
+ * Check whether a dive was delivered by a previous attempt of a resumed
+ * download, so the backend can skip downloading it again.
+ */
+int
+device_checkpoint_contains (dc_device_t *device, const unsigned char fingerprint[], unsigned int size);
+
+/*
+ * Check whether a dive is already known to the application, either from
+ * the set of fingerprints or from the checkpoint of a resumed download,
+ * so the backend can skip downloading its profile.
+ */
+int
+device_fingerprint_known (dc_device_t *device, const unsigned char fingerprint[], unsigned int size);
+
+/*
+ * Cancellation callback for the I/O layer, with the device as the user
+ * data, so the blocking reads can check the cancellation while waiting.
+ */
+int
+device_cancel_callback (void *userdata);
+
+/*
+ * Register the connection of the device, to interrupt the blocking reads
+ * when the download is cancelled, and to measure the I/O time.
+ */
+void
+device_set_port (dc_device_t *device, dc_serial_t *port);
+
+/*
+ * Report the start of a new phase of the download.
+ */
+void
+device_phase (dc_device_t *device, dc_phase_t phase);
+
+unsigned long long
+device_timestamp (void);
+
+void
+device_stats_packet (dc_device_t *device, const unsigned char command[], unsigned int nsent, unsigned int nreceived, dc_status_t status, unsigned long long begin);
+
+void
+device_stats_retry (dc_device_t *device);
+
 dc_status_t
 device_dump_read (dc_device_t *device, unsigned char data[], unsigned int size, unsigned int blocksize);
 
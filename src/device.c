@@ -22,6 +22,7 @@
 
 #include <assert.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <string.h>
 
 #include <libdivecomputer/suunto.h>
@@ -40,7 +41,13 @@
 #include <libdivecomputer/cochran.h>
 
 #include "device-private.h"
+#include "checkpoint-private.h"
 #include "context-private.h"
+#include "iterator-private.h"
+#include "serial.h"
+#include "thread.h"
+
+#define MAXRETRIES 2
 
 dc_device_t *
 dc_device_allocate (dc_context_t *context, const dc_device_vtable_t *vtable)
@@ -51,7 +58,7 @@ dc_device_allocate (dc_context_t *context, const dc_device_vtable_t *vtable)
 	assert(vtable->size >= sizeof(dc_device_t));
 
 	// Allocate memory.
-	device = (dc_device_t *) malloc (vtable->size);
+	device = (dc_device_t *) dc_context_allocate (context, vtable->size);
 	if (device == NULL) {
 		ERROR (context, "Failed to allocate memory.");
 		return device;
@@ -65,19 +72,87 @@ dc_device_allocate (dc_context_t *context, const dc_device_vtable_t *vtable)
 	device->event_callback = NULL;
 	device->event_userdata = NULL;
 
+	device->progress_interval = 0;
+	device->progress_delta = 0;
+	device->have_progress = 0;
+	device->progress_time = 0;
+	memset (&device->progress, 0, sizeof (device->progress));
+
+	device->have_transfer = 0;
+	device->transfer_begin = 0;
+	device->transfer_origin = 0;
+	device->transfer_current = 0;
+	device->transfer_maximum = 0;
+
+	memset (&device->stats, 0, sizeof (device->stats));
+
 	device->cancel_callback = NULL;
 	device->cancel_userdata = NULL;
 
 	memset (&device->devinfo, 0, sizeof (device->devinfo));
 	memset (&device->clock, 0, sizeof (device->clock));
 
+	device->cachedir = NULL;
+
+	device->syncstore = NULL;
+	device->have_devinfo = 0;
+
+	device->checkpoint = NULL;
+
+	device->blocksize = 0;
+
+	device->fingerprints = NULL;
+	device->fingerprints_size = 0;
+	device->fingerprints_count = 0;
+
+	device->memory = 0;
+	dc_context_memory_add (context, vtable->size);
+
+	device->phase = DC_PHASE_HANDSHAKE;
+	device->phase_begin = device_timestamp ();
+	device->phase_iotime = 0;
+	device->phase_callbacktime = 0;
+	device->iotime = 0;
+	device->callbacktime = 0;
+
 	return device;
 }
 
 void
 dc_device_deallocate (dc_device_t *device)
 {
-	free (device);
+	if (device == NULL)
+		return;
+
+	dc_context_memory_sub (device->context, device->vtable->size + device->memory);
+
+	free (device->fingerprints);
+	free (device->cachedir);
+	dc_context_deallocate (device->context, device);
+}
+
+#define PHASE_NONE DC_DEVICE_STATS_NPHASES
+
+/*
+ * Add the time since the start of the current phase to its totals, and
+ * start the next phase.
+ */
+static void
+device_phase_account (dc_device_t *device, unsigned int phase)
+{
+	unsigned long long now = device_timestamp ();
+
+	if (device->phase < DC_DEVICE_STATS_NPHASES) {
+		dc_device_phase_t *stats = &device->stats.phases[device->phase];
+		stats->walltime += now - device->phase_begin;
+		stats->iotime += device->iotime - device->phase_iotime;
+		stats->callbacktime += device->callbacktime - device->phase_callbacktime;
+	}
+
+	device->phase = phase;
+	device->phase_begin = now;
+	device->phase_iotime = device->iotime;
+	device->phase_callbacktime = device->callbacktime;
 }
 
 dc_status_t
@@ -90,6 +165,7 @@ dc_device_open (dc_device_t **out, dc_context_t *context, dc_descriptor_t *descr
 		return DC_STATUS_INVALIDARGS;
 
 	switch (dc_descriptor_get_type (descriptor)) {
+#ifdef ENABLE_BACKEND_SUUNTO
 	case DC_FAMILY_SUUNTO_SOLUTION:
 		rc = suunto_solution_device_open (&device, context, name);
 		break;
@@ -108,6 +184,8 @@ dc_device_open (dc_device_t **out, dc_context_t *context, dc_descriptor_t *descr
 	case DC_FAMILY_SUUNTO_EONSTEEL:
 		rc = suunto_eonsteel_device_open (&device, context, name, dc_descriptor_get_model (descriptor));
 		break;
+#endif
+#ifdef ENABLE_BACKEND_UWATEC
 	case DC_FAMILY_UWATEC_ALADIN:
 		rc = uwatec_aladin_device_open (&device, context, name);
 		break;
@@ -120,6 +198,8 @@ dc_device_open (dc_device_t **out, dc_context_t *context, dc_descriptor_t *descr
 	case DC_FAMILY_UWATEC_MERIDIAN:
 		rc = uwatec_meridian_device_open (&device, context, name);
 		break;
+#endif
+#ifdef ENABLE_BACKEND_REEFNET
 	case DC_FAMILY_REEFNET_SENSUS:
 		rc = reefnet_sensus_device_open (&device, context, name);
 		break;
@@ -129,6 +209,8 @@ dc_device_open (dc_device_t **out, dc_context_t *context, dc_descriptor_t *descr
 	case DC_FAMILY_REEFNET_SENSUSULTRA:
 		rc = reefnet_sensusultra_device_open (&device, context, name);
 		break;
+#endif
+#ifdef ENABLE_BACKEND_OCEANIC
 	case DC_FAMILY_OCEANIC_VTPRO:
 		rc = oceanic_vtpro_device_open2 (&device, context, name, dc_descriptor_get_model (descriptor));
 		break;
@@ -138,6 +220,8 @@ dc_device_open (dc_device_t **out, dc_context_t *context, dc_descriptor_t *descr
 	case DC_FAMILY_OCEANIC_ATOM2:
 		rc = oceanic_atom2_device_open2 (&device, context, name, dc_descriptor_get_model (descriptor));
 		break;
+#endif
+#ifdef ENABLE_BACKEND_MARES
 	case DC_FAMILY_MARES_NEMO:
 		rc = mares_nemo_device_open (&device, context, name);
 		break;
@@ -150,6 +234,8 @@ dc_device_open (dc_device_t **out, dc_context_t *context, dc_descriptor_t *descr
 	case DC_FAMILY_MARES_ICONHD:
 		rc = mares_iconhd_device_open (&device, context, name, dc_descriptor_get_model (descriptor));
 		break;
+#endif
+#ifdef ENABLE_BACKEND_HW
 	case DC_FAMILY_HW_OSTC:
 		rc = hw_ostc_device_open (&device, context, name);
 		break;
@@ -159,40 +245,61 @@ dc_device_open (dc_device_t **out, dc_context_t *context, dc_descriptor_t *descr
 	case DC_FAMILY_HW_OSTC3:
 		rc = hw_ostc3_device_open (&device, context, name);
 		break;
+#endif
+#ifdef ENABLE_BACKEND_CRESSI
 	case DC_FAMILY_CRESSI_EDY:
 		rc = cressi_edy_device_open (&device, context, name);
 		break;
 	case DC_FAMILY_CRESSI_LEONARDO:
 		rc = cressi_leonardo_device_open (&device, context, name);
 		break;
+#endif
+#ifdef ENABLE_BACKEND_ZEAGLE
 	case DC_FAMILY_ZEAGLE_N2ITION3:
 		rc = zeagle_n2ition3_device_open (&device, context, name);
 		break;
+#endif
+#ifdef ENABLE_BACKEND_ATOMICS
 	case DC_FAMILY_ATOMICS_COBALT:
 		rc = atomics_cobalt_device_open (&device, context);
 		break;
+#endif
+#ifdef ENABLE_BACKEND_SHEARWATER
 	case DC_FAMILY_SHEARWATER_PREDATOR:
 		rc = shearwater_predator_device_open (&device, context, name);
 		break;
 	case DC_FAMILY_SHEARWATER_PETREL:
 		rc = shearwater_petrel_device_open (&device, context, name);
 		break;
+#endif
+#ifdef ENABLE_BACKEND_DIVERITE
 	case DC_FAMILY_DIVERITE_NITEKQ:
 		rc = diverite_nitekq_device_open (&device, context, name);
 		break;
+#endif
+#ifdef ENABLE_BACKEND_CITIZEN
 	case DC_FAMILY_CITIZEN_AQUALAND:
 		rc = citizen_aqualand_device_open (&device, context, name);
 		break;
+#endif
+#ifdef ENABLE_BACKEND_DIVESYSTEM
 	case DC_FAMILY_DIVESYSTEM_IDIVE:
 		rc = divesystem_idive_device_open2 (&device, context, name, dc_descriptor_get_model (descriptor));
 		break;
+#endif
+#ifdef ENABLE_BACKEND_COCHRAN
 	case DC_FAMILY_COCHRAN_COMMANDER:
 		rc = cochran_commander_device_open (&device, context, name);
 		break;
+#endif
 	default:
 		return DC_STATUS_INVALIDARGS;
 	}
 
+	// The handshake continues when the download starts.
+	if (rc == DC_STATUS_SUCCESS && device)
+		device_phase_account (device, PHASE_NONE);
+
 	*out = device;
 
 	return rc;
@@ -208,24 +315,123 @@ dc_device_custom_open (dc_device_t **out, dc_context_t *context, dc_descriptor_t
 		return DC_STATUS_INVALIDARGS;
 
 	switch (dc_descriptor_get_type (descriptor)) {
+#ifdef ENABLE_BACKEND_HW
 	case DC_FAMILY_HW_OSTC3:
 		rc = hw_ostc3_device_custom_open (&device, context, serial);
 		break;
+#endif
+#ifdef ENABLE_BACKEND_SHEARWATER
 	case DC_FAMILY_SHEARWATER_PREDATOR:
 		rc = shearwater_predator_device_custom_open (&device, context, serial);
 		break;
 	case DC_FAMILY_SHEARWATER_PETREL:
 		rc = shearwater_petrel_device_custom_open (&device, context, serial);
 		break;
+#endif
 	default:
 		return DC_STATUS_INVALIDARGS;
 	}
 
+	// The handshake continues when the download starts.
+	if (rc == DC_STATUS_SUCCESS && device)
+		device_phase_account (device, PHASE_NONE);
+
 	*out = device;
 
 	return rc;
 }
 
+dc_status_t
+dc_device_extract_dives (dc_descriptor_t *descriptor, const unsigned char data[], unsigned int size, dc_dive_callback_t callback, void *userdata)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+
+	if (descriptor == NULL || (data == NULL && size))
+		return DC_STATUS_INVALIDARGS;
+
+	// Without a device, the backends only run the checks on the data
+	// itself. The families with a layout that depends on the model are
+	// not supported, because the layout is selected when the device is
+	// opened.
+	switch (dc_descriptor_get_type (descriptor)) {
+#ifdef ENABLE_BACKEND_SUUNTO
+	case DC_FAMILY_SUUNTO_SOLUTION:
+		rc = suunto_solution_extract_dives (NULL, data, size, callback, userdata);
+		break;
+	case DC_FAMILY_SUUNTO_EON:
+		rc = suunto_eon_extract_dives (NULL, data, size, callback, userdata);
+		break;
+	case DC_FAMILY_SUUNTO_VYPER:
+		rc = suunto_vyper_extract_dives (NULL, data, size, callback, userdata);
+		break;
+#endif
+#ifdef ENABLE_BACKEND_UWATEC
+	case DC_FAMILY_UWATEC_ALADIN:
+		rc = uwatec_aladin_extract_dives (NULL, data, size, callback, userdata);
+		break;
+	case DC_FAMILY_UWATEC_MEMOMOUSE:
+		rc = uwatec_memomouse_extract_dives (NULL, data, size, callback, userdata);
+		break;
+	case DC_FAMILY_UWATEC_SMART:
+		rc = uwatec_smart_extract_dives (NULL, data, size, callback, userdata);
+		break;
+	case DC_FAMILY_UWATEC_MERIDIAN:
+		rc = uwatec_meridian_extract_dives (NULL, data, size, callback, userdata);
+		break;
+#endif
+#ifdef ENABLE_BACKEND_REEFNET
+	case DC_FAMILY_REEFNET_SENSUS:
+		rc = reefnet_sensus_extract_dives (NULL, data, size, callback, userdata);
+		break;
+	case DC_FAMILY_REEFNET_SENSUSPRO:
+		rc = reefnet_sensuspro_extract_dives (NULL, data, size, callback, userdata);
+		break;
+	case DC_FAMILY_REEFNET_SENSUSULTRA:
+		rc = reefnet_sensusultra_extract_dives (NULL, data, size, callback, userdata);
+		break;
+#endif
+#ifdef ENABLE_BACKEND_MARES
+	case DC_FAMILY_MARES_NEMO:
+		rc = mares_nemo_extract_dives (NULL, data, size, callback, userdata);
+		break;
+	case DC_FAMILY_MARES_PUCK:
+		rc = mares_puck_extract_dives (NULL, data, size, callback, userdata);
+		break;
+#endif
+#ifdef ENABLE_BACKEND_HW
+	case DC_FAMILY_HW_OSTC:
+		rc = hw_ostc_extract_dives (NULL, data, size, callback, userdata);
+		break;
+#endif
+#ifdef ENABLE_BACKEND_CRESSI
+	case DC_FAMILY_CRESSI_LEONARDO:
+		rc = cressi_leonardo_extract_dives (NULL, data, size, callback, userdata);
+		break;
+#endif
+#ifdef ENABLE_BACKEND_SHEARWATER
+	case DC_FAMILY_SHEARWATER_PREDATOR:
+		rc = shearwater_predator_extract_dives (NULL, data, size, callback, userdata);
+		break;
+#endif
+#ifdef ENABLE_BACKEND_DIVERITE
+	case DC_FAMILY_DIVERITE_NITEKQ:
+		rc = diverite_nitekq_extract_dives (NULL, data, size, callback, userdata);
+		break;
+#endif
+	default:
+		return DC_STATUS_UNSUPPORTED;
+	}
+
+	return rc;
+}
+
+dc_status_t
+dc_device_verify_dump (dc_descriptor_t *descriptor, const unsigned char data[], unsigned int size, dc_dive_callback_t callback, void *userdata)
+{
+	// The extraction already runs all checks on the data.
+	return dc_device_extract_dives (descriptor, data, size, callback, userdata);
+}
+
 int
 dc_device_isinstance (dc_device_t *device, const dc_device_vtable_t *vtable)
 {
@@ -268,6 +474,94 @@ dc_device_set_events (dc_device_t *device, unsigned int events, dc_event_callbac
 	device->event_mask = events;
 	device->event_callback = callback;
 	device->event_userdata = userdata;
+	device->have_progress = 0;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+dc_status_t
+dc_device_set_progress_throttle (dc_device_t *device, unsigned int interval, unsigned int delta)
+{
+	if (device == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (delta > 1000)
+		return DC_STATUS_INVALIDARGS;
+
+	device->progress_interval = interval;
+	device->progress_delta = delta;
+	device->have_progress = 0;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+dc_status_t
+dc_device_set_cachedir (dc_device_t *device, const char *dirname)
+{
+	char *copy = NULL;
+
+	if (device == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (dirname) {
+		copy = strdup (dirname);
+		if (copy == NULL) {
+			ERROR (device->context, "Failed to allocate memory.");
+			return DC_STATUS_NOMEMORY;
+		}
+	}
+
+	free (device->cachedir);
+	device->cachedir = copy;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_device_set_syncstore (dc_device_t *device, dc_syncstore_t *store)
+{
+	if (device == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (store && device->vtable->set_fingerprint == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	device->syncstore = store;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_device_set_checkpoint (dc_device_t *device, dc_checkpoint_t *checkpoint)
+{
+	if (device == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	device->checkpoint = checkpoint;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_device_get_stats (dc_device_t *device, dc_device_stats_t *stats)
+{
+	if (device == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (stats == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	*stats = device->stats;
+
+	// Include the phase that is still in progress.
+	if (device->phase < DC_DEVICE_STATS_NPHASES) {
+		dc_device_phase_t *phase = &stats->phases[device->phase];
+		phase->walltime += device_timestamp () - device->phase_begin;
+		phase->iotime += device->iotime - device->phase_iotime;
+		phase->callbacktime += device->callbacktime - device->phase_callbacktime;
+	}
 
 	return DC_STATUS_SUCCESS;
 }
@@ -286,6 +580,75 @@ dc_device_set_fingerprint (dc_device_t *device, const unsigned char data[], unsi
 }
 
 
+static void
+device_fingerprints_sift (unsigned char *data, unsigned int size, unsigned int root, unsigned int count, unsigned char *tmp)
+{
+	while (2 * root + 1 < count) {
+		unsigned int child = 2 * root + 1;
+		if (child + 1 < count &&
+			memcmp (data + child * size, data + (child + 1) * size, size) < 0)
+			child++;
+
+		if (memcmp (data + root * size, data + child * size, size) >= 0)
+			break;
+
+		memcpy (tmp, data + root * size, size);
+		memcpy (data + root * size, data + child * size, size);
+		memcpy (data + child * size, tmp, size);
+
+		root = child;
+	}
+}
+
+dc_status_t
+dc_device_set_fingerprints (dc_device_t *device, const unsigned char data[], unsigned int size, unsigned int count)
+{
+	if (device == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (count && (data == NULL || size == 0))
+		return DC_STATUS_INVALIDARGS;
+
+	if (device->fingerprints)
+		device_memory_sub (device, (size_t) device->fingerprints_size * (device->fingerprints_count + 1));
+	free (device->fingerprints);
+	device->fingerprints = NULL;
+	device->fingerprints_size = 0;
+	device->fingerprints_count = 0;
+
+	if (count == 0)
+		return DC_STATUS_SUCCESS;
+
+	unsigned char *fingerprints = (unsigned char *) malloc ((size_t) size * (count + 1));
+	if (fingerprints == NULL) {
+		ERROR (device->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	memcpy (fingerprints, data, (size_t) size * count);
+
+	// Sort the fingerprints with an in-place heapsort, using the extra
+	// slot at the end as the scratch space for swapping.
+	unsigned char *tmp = fingerprints + (size_t) size * count;
+	for (unsigned int i = count / 2; i > 0; --i) {
+		device_fingerprints_sift (fingerprints, size, i - 1, count, tmp);
+	}
+	for (unsigned int n = count - 1; n > 0; --n) {
+		memcpy (tmp, fingerprints, size);
+		memcpy (fingerprints, fingerprints + n * size, size);
+		memcpy (fingerprints + n * size, tmp, size);
+		device_fingerprints_sift (fingerprints, size, 0, n, tmp);
+	}
+
+	device->fingerprints = fingerprints;
+	device->fingerprints_size = size;
+	device->fingerprints_count = count;
+	device_memory_add (device, (size_t) size * (count + 1));
+
+	return DC_STATUS_SUCCESS;
+}
+
+
 dc_status_t
 dc_device_read (dc_device_t *device, unsigned int address, unsigned char data[], unsigned int size)
 {
@@ -321,10 +684,65 @@ dc_device_dump (dc_device_t *device, dc_buffer_t *buffer)
 	if (device->vtable->dump == NULL)
 		return DC_STATUS_UNSUPPORTED;
 
-	return device->vtable->dump (device, buffer);
+	device_phase (device, DC_PHASE_HANDSHAKE);
+
+	dc_status_t status = device->vtable->dump (device, buffer);
+
+	device_phase_account (device, PHASE_NONE);
+
+	return status;
 }
 
 
+static dc_status_t
+device_dump_blocks (dc_device_t *device, dc_event_progress_t *progress, unsigned int address, unsigned char data[], unsigned int size, unsigned int blocksize)
+{
+	unsigned int nretries = 0;
+	unsigned int nbytes = 0;
+	while (nbytes < size) {
+		// Calculate the packet size.
+		unsigned int len = size - nbytes;
+		if (len > blocksize)
+			len = blocksize;
+
+		// Read the packet. A block that fails with a transient error is
+		// read again, instead of failing the entire dump.
+		dc_status_t rc = device->vtable->read (device, address + nbytes, data + nbytes, len);
+		if (rc == DC_STATUS_TIMEOUT || rc == DC_STATUS_PROTOCOL) {
+			if (nretries++ < MAXRETRIES && !device_is_cancelled (device)) {
+				WARNING (device->context, "Failed to read the block at address 0x%04x, retrying.", address + nbytes);
+				device_stats_retry (device);
+				continue;
+			}
+		}
+		if (rc != DC_STATUS_SUCCESS)
+			return rc;
+
+		// Update and emit a progress event.
+		progress->current += len;
+		device_event_emit (device, DC_EVENT_PROGRESS, progress);
+
+		nbytes += len;
+		nretries = 0;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+static void
+device_dump_stats (dc_device_t *device, unsigned int size, unsigned long long begin)
+{
+	unsigned long long elapsed = (device_timestamp () - begin) / 1000;
+
+	device->stats.dumpsize += size;
+	device->stats.dumptime += elapsed;
+
+	if (elapsed) {
+		INFO (device->context, "Dumped %u bytes in %llu ms (%llu bytes/s).",
+			size, elapsed, size * 1000ULL / elapsed);
+	}
+}
+
 dc_status_t
 device_dump_read (dc_device_t *device, unsigned char data[], unsigned int size, unsigned int blocksize)
 {
@@ -334,34 +752,302 @@ device_dump_read (dc_device_t *device, unsigned char data[], unsigned int size,
 	if (device->vtable->read == NULL)
 		return DC_STATUS_UNSUPPORTED;
 
+	device_phase (device, DC_PHASE_PROFILE);
+
+	// Resume after the blocks received by a previous attempt.
+	unsigned int nbytes = dc_checkpoint_get_memory (device->checkpoint,
+		device->vtable->type, data, size);
+	if (nbytes) {
+		INFO (device->context, "Resuming the download at address 0x%04x.", nbytes);
+	}
+
 	// Enable progress notifications.
 	dc_event_progress_t progress = EVENT_PROGRESS_INITIALIZER;
+	progress.current = nbytes;
 	progress.maximum = size;
 	device_event_emit (device, DC_EVENT_PROGRESS, &progress);
 
-	unsigned int nbytes = 0;
-	while (nbytes < size) {
-		// Calculate the packet size.
-		unsigned int len = size - nbytes;
-		if (len > blocksize)
-			len = blocksize;
+	unsigned long long begin = device_timestamp ();
 
-		// Read the packet.
-		dc_status_t rc = device->vtable->read (device, nbytes, data + nbytes, len);
-		if (rc != DC_STATUS_SUCCESS)
-			return rc;
-
-		// Update and emit a progress event.
-		progress.current += len;
-		device_event_emit (device, DC_EVENT_PROGRESS, &progress);
+	dc_status_t rc = device_dump_blocks (device, &progress, nbytes, data + nbytes, size - nbytes, blocksize);
+	if (rc != DC_STATUS_SUCCESS) {
+		// Keep the blocks that were received completely.
+		if (device->checkpoint) {
+			dc_checkpoint_set_memory (device->checkpoint, device->vtable->type,
+				data, size, progress.current);
+		}
+		return rc;
+	}
 
-		nbytes += len;
+	if (device->checkpoint) {
+		dc_checkpoint_set_memory (device->checkpoint, device->vtable->type,
+			data, size, 0);
 	}
 
+	device_dump_stats (device, size - nbytes, begin);
+
 	return DC_STATUS_SUCCESS;
 }
 
 
+typedef struct device_span_t {
+	unsigned int begin;
+	unsigned int end;
+	unsigned int offset;
+} device_span_t;
+
+static int
+device_span_cmp (const void *a, const void *b)
+{
+	const device_span_t *span_a = (const device_span_t *) a;
+	const device_span_t *span_b = (const device_span_t *) b;
+
+	if (span_a->begin < span_b->begin)
+		return -1;
+	if (span_a->begin > span_b->begin)
+		return 1;
+	return 0;
+}
+
+dc_status_t
+dc_device_dump_range (dc_device_t *device, const dc_memory_range_t ranges[], unsigned int count, dc_buffer_t *buffer)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+
+	if (device == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (device->vtable->read == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (buffer == NULL || (ranges == NULL && count))
+		return DC_STATUS_INVALIDARGS;
+
+	// Without a known block size, every range is read as is, in a single
+	// call to the backend.
+	unsigned int align = device->blocksize ? device->blocksize : 1;
+	unsigned int blocksize = device->blocksize ? device->blocksize : UINT_MAX;
+
+	device_span_t *spans = (device_span_t *) malloc ((count ? count : 1) * sizeof (device_span_t));
+	if (spans == NULL) {
+		ERROR (device->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	// Align the ranges to the block size.
+	unsigned int total = 0, nspans = 0;
+	for (unsigned int i = 0; i < count; ++i) {
+		if (ranges[i].size > UINT_MAX - ranges[i].address ||
+			ranges[i].size > UINT_MAX - total ||
+			ranges[i].address + ranges[i].size > UINT_MAX - (align - 1)) {
+			ERROR (device->context, "Invalid memory range.");
+			free (spans);
+			return DC_STATUS_INVALIDARGS;
+		}
+
+		total += ranges[i].size;
+
+		if (ranges[i].size == 0)
+			continue;
+
+		spans[nspans].begin = ranges[i].address / align * align;
+		spans[nspans].end = (ranges[i].address + ranges[i].size + align - 1) / align * align;
+		nspans++;
+	}
+
+	// Merge the ranges that overlap or touch.
+	qsort (spans, nspans, sizeof (device_span_t), device_span_cmp);
+
+	unsigned int nmerged = 0, length = 0;
+	for (unsigned int i = 0; i < nspans; ++i) {
+		if (nmerged && spans[i].begin <= spans[nmerged - 1].end) {
+			if (spans[i].end > spans[nmerged - 1].end)
+				spans[nmerged - 1].end = spans[i].end;
+		} else {
+			spans[nmerged++] = spans[i];
+		}
+	}
+
+	for (unsigned int i = 0; i < nmerged; ++i) {
+		unsigned int size = spans[i].end - spans[i].begin;
+		if (size > UINT_MAX - length) {
+			ERROR (device->context, "Invalid memory range.");
+			free (spans);
+			return DC_STATUS_INVALIDARGS;
+		}
+
+		spans[i].offset = length;
+		length += size;
+	}
+
+	unsigned char *data = (unsigned char *) malloc (length ? length : 1);
+	if (data == NULL || !dc_buffer_clear (buffer) || !dc_buffer_resize (buffer, total)) {
+		ERROR (device->context, "Insufficient buffer space available.");
+		free (data);
+		free (spans);
+		return DC_STATUS_NOMEMORY;
+	}
+
+	if (length == 0)
+		goto error_free;
+
+	// Enable progress notifications.
+	dc_event_progress_t progress = EVENT_PROGRESS_INITIALIZER;
+	progress.maximum = length;
+	device_event_emit (device, DC_EVENT_PROGRESS, &progress);
+
+	unsigned long long begin = device_timestamp ();
+
+	for (unsigned int i = 0; i < nmerged; ++i) {
+		rc = device_dump_blocks (device, &progress, spans[i].begin,
+			data + spans[i].offset, spans[i].end - spans[i].begin, blocksize);
+		if (rc != DC_STATUS_SUCCESS) {
+			dc_buffer_clear (buffer);
+			goto error_free;
+		}
+	}
+
+	device_dump_stats (device, length, begin);
+
+	// Copy the requested ranges, in their original order.
+	unsigned char *out = dc_buffer_get_data (buffer);
+	for (unsigned int i = 0; i < count; ++i) {
+		if (ranges[i].size == 0)
+			continue;
+
+		// Locate the merged range with a binary search.
+		unsigned int lo = 0, hi = nmerged;
+		while (hi - lo > 1) {
+			unsigned int mid = lo + (hi - lo) / 2;
+			if (spans[mid].begin <= ranges[i].address)
+				lo = mid;
+			else
+				hi = mid;
+		}
+
+		memcpy (out, data + spans[lo].offset + (ranges[i].address - spans[lo].begin), ranges[i].size);
+		out += ranges[i].size;
+	}
+
+error_free:
+	free (data);
+	free (spans);
+	return rc;
+}
+
+
+typedef struct device_sync_t {
+	dc_device_t *device;
+	dc_dive_callback_t callback;
+	void *userdata;
+	dc_buffer_t *fingerprint;
+	unsigned int ndives;
+} device_sync_t;
+
+static int
+device_sync_cb (const unsigned char *data, unsigned int size, const unsigned char *fingerprint, unsigned int fsize, void *userdata)
+{
+	device_sync_t *sync = (device_sync_t *) userdata;
+
+	// Dives are downloaded in reverse order, so the first dive
+	// is always the most recent one.
+	if (sync->ndives++ == 0) {
+		dc_buffer_append (sync->fingerprint, fingerprint, fsize);
+	}
+
+	// Skip the dives delivered by a previous attempt, or already known
+	// to the application.
+	dc_checkpoint_t *checkpoint = sync->device->checkpoint;
+	if (device_fingerprint_known (sync->device, fingerprint, fsize))
+		return 1;
+
+	if (sync->callback && !sync->callback (data, size, fingerprint, fsize, sync->userdata))
+		return 0;
+
+	if (checkpoint && fsize) {
+		dc_checkpoint_add_dive (checkpoint, sync->device->vtable->type, fingerprint, fsize);
+	}
+
+	return 1;
+}
+
+typedef struct device_timed_t {
+	dc_device_t *device;
+	dc_dive_callback_t callback;
+	void *userdata;
+} device_timed_t;
+
+static int
+device_timed_cb (const unsigned char *data, unsigned int size, const unsigned char *fingerprint, unsigned int fsize, void *userdata)
+{
+	device_timed_t *timed = (device_timed_t *) userdata;
+
+	unsigned long long begin = device_timestamp ();
+	int rc = timed->callback (data, size, fingerprint, fsize, timed->userdata);
+	timed->device->callbacktime += device_timestamp () - begin;
+
+	return rc;
+}
+
+static dc_status_t
+device_foreach (dc_device_t *device, dc_dive_callback_t callback, void *userdata)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (device->syncstore == NULL && device->checkpoint == NULL &&
+		device->fingerprints == NULL)
+		return device->vtable->foreach (device, callback, userdata);
+
+	device_sync_t sync;
+	sync.device = device;
+	sync.callback = callback;
+	sync.userdata = userdata;
+	sync.ndives = 0;
+	sync.fingerprint = dc_buffer_new (0);
+	if (sync.fingerprint == NULL) {
+		ERROR (device->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	device->have_devinfo = 0;
+
+	status = device->vtable->foreach (device, device_sync_cb, &sync);
+
+	// After a resumed download, the newest dive was delivered by the
+	// first attempt, and is recorded in the checkpoint.
+	if (status == DC_STATUS_SUCCESS && device->checkpoint) {
+		dc_buffer_t *newest = dc_buffer_new (0);
+		if (newest) {
+			dc_checkpoint_get_newest (device->checkpoint, device->vtable->type, newest);
+			if (dc_buffer_get_size (newest)) {
+				dc_buffer_free (sync.fingerprint);
+				sync.fingerprint = newest;
+			} else {
+				dc_buffer_free (newest);
+			}
+		}
+		dc_checkpoint_reset (device->checkpoint);
+	}
+
+	// Store the fingerprint of the newest dive, but only if the whole
+	// download succeeded, and the device reported its serial number.
+	if (status == DC_STATUS_SUCCESS && device->syncstore && device->have_devinfo &&
+		dc_buffer_get_size (sync.fingerprint)) {
+		dc_status_t rc = dc_syncstore_set (device->syncstore,
+			device->vtable->type, device->devinfo.serial,
+			dc_buffer_get_data (sync.fingerprint),
+			dc_buffer_get_size (sync.fingerprint));
+		if (rc != DC_STATUS_SUCCESS) {
+			WARNING (device->context, "Failed to update the sync store.");
+		}
+	}
+
+	dc_buffer_free (sync.fingerprint);
+
+	return status;
+}
+
+
 dc_status_t
 dc_device_foreach (dc_device_t *device, dc_dive_callback_t callback, void *userdata)
 {
@@ -371,7 +1057,232 @@ dc_device_foreach (dc_device_t *device, dc_dive_callback_t callback, void *userd
 	if (device->vtable->foreach == NULL)
 		return DC_STATUS_UNSUPPORTED;
 
-	return device->vtable->foreach (device, callback, userdata);
+	// Measure the time spent in the callback of the application.
+	device_timed_t timed = {device, callback, userdata};
+	if (callback) {
+		callback = device_timed_cb;
+		userdata = &timed;
+	}
+
+	device_phase (device, DC_PHASE_HANDSHAKE);
+
+	dc_status_t status = device_foreach (device, callback, userdata);
+
+	device_phase_account (device, PHASE_NONE);
+
+	return status;
+}
+
+
+/*
+ * The dive iterator runs dc_device_foreach on a helper thread. The dive
+ * callback hands each dive over to the consumer, and waits until the
+ * consumer asks for the next one, so the data is never copied, and the
+ * download proceeds at the pace of the consumer.
+ */
+typedef enum dc_device_iterator_state_t {
+	DC_DEVICE_ITERATOR_IDLE,  /* Waiting for the next dive. */
+	DC_DEVICE_ITERATOR_READY, /* A dive is waiting for the consumer. */
+	DC_DEVICE_ITERATOR_TAKEN  /* The consumer holds the dive. */
+} dc_device_iterator_state_t;
+
+typedef struct dc_device_iterator_t {
+	dc_iterator_t base;
+	dc_device_t *device;
+	dc_thread_t *thread;
+	dc_cancel_callback_t cancel_callback;
+	void *cancel_userdata;
+	/* Protected by the mutex. */
+	dc_mutex_t *mutex;
+	dc_cond_t *cond;
+	dc_device_iterator_state_t state;
+	dc_device_dive_t dive;
+	int stopped;
+	int finished;
+	dc_status_t status;
+} dc_device_iterator_t;
+
+static dc_status_t dc_device_iterator_next (dc_iterator_t *iterator, void *item);
+static dc_status_t dc_device_iterator_free (dc_iterator_t *iterator);
+
+static const dc_iterator_vtable_t dc_device_iterator_vtable = {
+	dc_device_iterator_free,
+	dc_device_iterator_next
+};
+
+static int
+dc_device_iterator_cancel_cb (void *userdata)
+{
+	dc_device_iterator_t *iterator = (dc_device_iterator_t *) userdata;
+
+	dc_mutex_lock (iterator->mutex);
+	int stopped = iterator->stopped;
+	dc_mutex_unlock (iterator->mutex);
+
+	if (stopped)
+		return 1;
+
+	// Chain to the cancel handler of the application.
+	if (iterator->cancel_callback)
+		return iterator->cancel_callback (iterator->cancel_userdata);
+
+	return 0;
+}
+
+static int
+dc_device_iterator_dive_cb (const unsigned char *data, unsigned int size, const unsigned char *fingerprint, unsigned int fsize, void *userdata)
+{
+	dc_device_iterator_t *iterator = (dc_device_iterator_t *) userdata;
+
+	dc_mutex_lock (iterator->mutex);
+	iterator->dive.data = data;
+	iterator->dive.size = size;
+	iterator->dive.fingerprint = fingerprint;
+	iterator->dive.fsize = fsize;
+	iterator->state = DC_DEVICE_ITERATOR_READY;
+	dc_cond_broadcast (iterator->cond);
+
+	// Wait until the consumer is done with the dive.
+	while (iterator->state != DC_DEVICE_ITERATOR_IDLE && !iterator->stopped)
+		dc_cond_wait (iterator->cond, iterator->mutex);
+	int stopped = iterator->stopped;
+	dc_mutex_unlock (iterator->mutex);
+
+	return !stopped;
+}
+
+static void
+dc_device_iterator_run (void *userdata)
+{
+	dc_device_iterator_t *iterator = (dc_device_iterator_t *) userdata;
+
+	dc_status_t status = dc_device_foreach (iterator->device, dc_device_iterator_dive_cb, iterator);
+
+	dc_mutex_lock (iterator->mutex);
+	iterator->finished = 1;
+	iterator->status = status;
+	dc_cond_broadcast (iterator->cond);
+	dc_mutex_unlock (iterator->mutex);
+}
+
+dc_status_t
+dc_device_dive_iterator (dc_device_t *device, dc_iterator_t **out)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_device_iterator_t *iterator = NULL;
+
+	if (device == NULL || out == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (device->vtable->foreach == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	iterator = (dc_device_iterator_t *) malloc (sizeof (dc_device_iterator_t));
+	if (iterator == NULL) {
+		ERROR (device->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	iterator->base.vtable = &dc_device_iterator_vtable;
+	iterator->device = device;
+	iterator->thread = NULL;
+	iterator->cancel_callback = device->cancel_callback;
+	iterator->cancel_userdata = device->cancel_userdata;
+	iterator->mutex = NULL;
+	iterator->cond = NULL;
+	iterator->state = DC_DEVICE_ITERATOR_IDLE;
+	memset (&iterator->dive, 0, sizeof (iterator->dive));
+	iterator->stopped = 0;
+	iterator->finished = 0;
+	iterator->status = DC_STATUS_SUCCESS;
+
+	status = dc_mutex_new (&iterator->mutex);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (device->context, "Failed to create the mutex.");
+		goto error_free;
+	}
+
+	status = dc_cond_new (&iterator->cond);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (device->context, "Failed to create the condition variable.");
+		goto error_free;
+	}
+
+	// Stop the download as soon as the iterator is freed.
+	dc_device_set_cancel (device, dc_device_iterator_cancel_cb, iterator);
+
+	status = dc_thread_new (&iterator->thread, dc_device_iterator_run, iterator);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (device->context, "Failed to create the thread.");
+		goto error_cancel;
+	}
+
+	*out = (dc_iterator_t *) iterator;
+
+	return DC_STATUS_SUCCESS;
+
+error_cancel:
+	dc_device_set_cancel (device, iterator->cancel_callback, iterator->cancel_userdata);
+error_free:
+	dc_cond_free (iterator->cond);
+	dc_mutex_free (iterator->mutex);
+	free (iterator);
+	return status;
+}
+
+static dc_status_t
+dc_device_iterator_next (dc_iterator_t *abstract, void *out)
+{
+	dc_device_iterator_t *iterator = (dc_device_iterator_t *) abstract;
+	dc_device_dive_t *dive = (dc_device_dive_t *) out;
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	dc_mutex_lock (iterator->mutex);
+
+	// Release the previous dive, and resume the download.
+	if (iterator->state == DC_DEVICE_ITERATOR_TAKEN) {
+		iterator->state = DC_DEVICE_ITERATOR_IDLE;
+		dc_cond_broadcast (iterator->cond);
+	}
+
+	while (iterator->state == DC_DEVICE_ITERATOR_IDLE && !iterator->finished)
+		dc_cond_wait (iterator->cond, iterator->mutex);
+
+	if (iterator->state == DC_DEVICE_ITERATOR_READY) {
+		iterator->state = DC_DEVICE_ITERATOR_TAKEN;
+		*dive = iterator->dive;
+	} else if (iterator->status != DC_STATUS_SUCCESS) {
+		status = iterator->status;
+	} else {
+		status = DC_STATUS_DONE;
+	}
+
+	dc_mutex_unlock (iterator->mutex);
+
+	return status;
+}
+
+static dc_status_t
+dc_device_iterator_free (dc_iterator_t *abstract)
+{
+	dc_device_iterator_t *iterator = (dc_device_iterator_t *) abstract;
+
+	// Stop the download, without waiting for the remaining dives.
+	dc_mutex_lock (iterator->mutex);
+	iterator->stopped = 1;
+	dc_cond_broadcast (iterator->cond);
+	dc_mutex_unlock (iterator->mutex);
+
+	dc_thread_join (iterator->thread);
+
+	// Restore the cancel handler of the application.
+	dc_device_set_cancel (iterator->device, iterator->cancel_callback, iterator->cancel_userdata);
+
+	dc_cond_free (iterator->cond);
+	dc_mutex_free (iterator->mutex);
+	free (iterator);
+
+	return DC_STATUS_SUCCESS;
 }
 
 
@@ -397,6 +1308,100 @@ dc_device_close (dc_device_t *device)
 }
 
 
+static void
+device_syncstore_load (dc_device_t *device)
+{
+	dc_buffer_t *fingerprint = dc_buffer_new (0);
+	if (fingerprint == NULL)
+		return;
+
+	// Register the stored fingerprint. The fingerprint that may have been
+	// registered by the application is kept if nothing is stored yet.
+	dc_status_t rc = dc_syncstore_get (device->syncstore,
+		device->vtable->type, device->devinfo.serial, fingerprint);
+	if (rc == DC_STATUS_SUCCESS && dc_buffer_get_size (fingerprint)) {
+		rc = device->vtable->set_fingerprint (device,
+			dc_buffer_get_data (fingerprint),
+			dc_buffer_get_size (fingerprint));
+		if (rc != DC_STATUS_SUCCESS) {
+			WARNING (device->context, "Failed to register the stored fingerprint.");
+		}
+	}
+
+	dc_buffer_free (fingerprint);
+}
+
+unsigned long long
+device_timestamp (void)
+{
+	return dc_context_clock ();
+}
+
+
+static int
+device_progress_update (dc_device_t *device, const dc_event_progress_t *progress)
+{
+	if (device->progress_interval == 0 && device->progress_delta == 0)
+		return 1;
+
+	unsigned long long now = device_timestamp ();
+
+	// Always pass the first and final update, and any update that moves
+	// backwards or changes the maximum (a new phase of the download).
+	if (device->have_progress &&
+		progress->current != progress->maximum &&
+		progress->maximum == device->progress.maximum &&
+		progress->current >= device->progress.current)
+	{
+		if (now - device->progress_time < device->progress_interval * 1000ULL)
+			return 0;
+
+		unsigned long long delta = progress->current - device->progress.current;
+		if (delta * 1000 < (unsigned long long) device->progress_delta * progress->maximum)
+			return 0;
+	}
+
+	device->progress = *progress;
+	device->progress_time = now;
+	device->have_progress = 1;
+
+	return 1;
+}
+
+static void
+device_progress_metrics (dc_device_t *device, dc_event_progress_t *progress)
+{
+	unsigned long long now = device_timestamp ();
+
+	// A download starts with the first update, or the first one after
+	// the previous download completed or the progress moved backwards.
+	// The maximum may still change in between, when the backend learns
+	// the actual size of the data.
+	if (!device->have_transfer ||
+		device->transfer_current == device->transfer_maximum ||
+		progress->current < device->transfer_current)
+	{
+		device->have_transfer = 1;
+		device->transfer_begin = now;
+		device->transfer_origin = progress->current;
+	}
+
+	device->transfer_current = progress->current;
+	device->transfer_maximum = progress->maximum;
+
+	// A resumed download only counts the data transferred this time.
+	unsigned long long elapsed = (now - device->transfer_begin) / 1000;
+	unsigned long long amount = progress->current - device->transfer_origin;
+	unsigned long long remaining = progress->maximum - progress->current;
+	unsigned long long rate = elapsed ? amount * 1000 / elapsed : 0;
+	unsigned long long eta = amount ? remaining * elapsed / amount : 0;
+
+	progress->version = DC_EVENT_PROGRESS_VERSION;
+	progress->elapsed = elapsed < UINT_MAX ? elapsed : UINT_MAX;
+	progress->rate = rate < UINT_MAX ? rate : UINT_MAX;
+	progress->eta = eta < UINT_MAX ? eta : UINT_MAX;
+}
+
 void
 device_event_emit (dc_device_t *device, dc_event_type_t event, const void *data)
 {
@@ -418,6 +1423,9 @@ device_event_emit (dc_device_t *device, dc_event_type_t event, const void *data)
 	case DC_EVENT_CLOCK:
 		assert (data != NULL);
 		break;
+	case DC_EVENT_PHASE:
+		assert (data != NULL);
+		break;
 	default:
 		break;
 	}
@@ -429,6 +1437,10 @@ device_event_emit (dc_device_t *device, dc_event_type_t event, const void *data)
 	switch (event) {
 	case DC_EVENT_DEVINFO:
 		device->devinfo = *(dc_event_devinfo_t *) data;
+		device->have_devinfo = 1;
+		if (device->syncstore) {
+			device_syncstore_load (device);
+		}
 		break;
 	case DC_EVENT_CLOCK:
 		device->clock = *(dc_event_clock_t *) data;
@@ -437,6 +1449,18 @@ device_event_emit (dc_device_t *device, dc_event_type_t event, const void *data)
 		break;
 	}
 
+	// The backends only fill in the current and maximum value. The rate
+	// and estimate are added to a copy, which is what the application
+	// receives.
+	dc_event_progress_t copy;
+	if (event == DC_EVENT_PROGRESS) {
+		copy.current = progress->current;
+		copy.maximum = progress->maximum;
+		device_progress_metrics (device, &copy);
+		progress = &copy;
+		data = &copy;
+	}
+
 	// Check if there is a callback function registered.
 	if (device->event_callback == NULL)
 		return;
@@ -445,10 +1469,89 @@ device_event_emit (dc_device_t *device, dc_event_type_t event, const void *data)
 	if ((event & device->event_mask) == 0)
 		return;
 
+	// Coalesce progress events.
+	if (event == DC_EVENT_PROGRESS && !device_progress_update (device, progress))
+		return;
+
 	device->event_callback (device, event, data, device->event_userdata);
 }
 
 
+void
+device_stats_packet (dc_device_t *device, const unsigned char command[], unsigned int nsent, unsigned int nreceived, dc_status_t status, unsigned long long begin)
+{
+	if (device == NULL)
+		return;
+
+	dc_context_trace (device->context, DC_TRACE_TRANSFER, status, begin, command, nsent);
+
+	dc_device_stats_t *stats = &device->stats;
+	unsigned long long elapsed = (device_timestamp () - begin) / 1000;
+
+	stats->nsent += nsent;
+
+	if (status == DC_STATUS_TIMEOUT) {
+		stats->ntimeouts++;
+		return;
+	} else if (status != DC_STATUS_SUCCESS) {
+		stats->nerrors++;
+		return;
+	}
+
+	stats->npackets++;
+	stats->nreceived += nreceived;
+
+	// Find the log2 bucket of the latency.
+	unsigned int bucket = 0;
+	while (elapsed && bucket < DC_DEVICE_STATS_NBUCKETS - 1) {
+		elapsed >>= 1;
+		bucket++;
+	}
+	stats->latency[bucket]++;
+}
+
+
+void
+device_stats_retry (dc_device_t *device)
+{
+	if (device == NULL)
+		return;
+
+	device->stats.nretries++;
+}
+
+
+dc_status_t
+dc_device_get_memory_usage (dc_device_t *device, size_t *usage)
+{
+	if (device == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (usage == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	*usage = device->vtable->size + device->memory;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+void
+device_memory_add (dc_device_t *device, size_t size)
+{
+	device->memory += size;
+	dc_context_memory_add (device->context, size);
+}
+
+
+void
+device_memory_sub (dc_device_t *device, size_t size)
+{
+	device->memory -= size;
+	dc_context_memory_sub (device->context, size);
+}
+
+
 int
 device_is_cancelled (dc_device_t *device)
 {
@@ -460,3 +1563,61 @@ device_is_cancelled (dc_device_t *device)
 
 	return device->cancel_callback (device->cancel_userdata);
 }
+
+
+int
+device_checkpoint_contains (dc_device_t *device, const unsigned char fingerprint[], unsigned int size)
+{
+	if (device == NULL || device->checkpoint == NULL)
+		return 0;
+
+	return dc_checkpoint_has_dive (device->checkpoint, device->vtable->type, fingerprint, size);
+}
+
+int
+device_fingerprint_known (dc_device_t *device, const unsigned char fingerprint[], unsigned int size)
+{
+	if (device == NULL || fingerprint == NULL || size == 0)
+		return 0;
+
+	if (device->fingerprints && size == device->fingerprints_size) {
+		unsigned int lo = 0, hi = device->fingerprints_count;
+		while (lo < hi) {
+			unsigned int mid = lo + (hi - lo) / 2;
+			int cmp = memcmp (device->fingerprints + mid * size, fingerprint, size);
+			if (cmp == 0)
+				return 1;
+			if (cmp < 0)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+	}
+
+	return device_checkpoint_contains (device, fingerprint, size);
+}
+
+int
+device_cancel_callback (void *userdata)
+{
+	return device_is_cancelled ((dc_device_t *) userdata);
+}
+
+void
+device_set_port (dc_device_t *device, dc_serial_t *port)
+{
+	dc_serial_set_cancel (port, device_cancel_callback, device);
+	dc_serial_set_iotime (port, device ? &device->iotime : NULL);
+}
+
+void
+device_phase (dc_device_t *device, dc_phase_t phase)
+{
+	if (device == NULL || device->phase == phase)
+		return;
+
+	device_phase_account (device, phase);
+
+	dc_event_phase_t event = {phase};
+	device_event_emit (device, DC_EVENT_PHASE, &event);
+}
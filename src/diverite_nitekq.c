@@ -172,6 +172,10 @@ diverite_nitekq_device_open (dc_device_t **out, dc_context_t *context, const cha
 		goto error_free;
 	}
 
+	// Interrupt the blocking reads when the download is cancelled, and
+	// measure the time spent waiting for the I/O.
+	device_set_port ((dc_device_t *) device, device->port);
+
 	// Set the serial communication protocol (9600 8N1).
 	status = dc_serial_configure (device->port, 9600, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -246,19 +250,64 @@ diverite_nitekq_device_set_fingerprint (dc_device_t *abstract, const unsigned ch
 }
 
 
+/*
+ * Get the amount of memory, starting from the begin, that contains the
+ * logbook and the profiles of all dives newer than the fingerprint. If
+ * the data can't be interpreted, the entire memory is required, and the
+ * errors are reported by the extractor instead.
+ */
+static unsigned int
+diverite_nitekq_required (diverite_nitekq_device_t *device, const unsigned char data[])
+{
+	unsigned int eop = array_uint16_be(data + EOP);
+	if (eop < RB_PROFILE_BEGIN || eop >= RB_PROFILE_END)
+		return SZ_MEMORY;
+
+	unsigned int required = RB_PROFILE_BEGIN;
+	unsigned int previous = eop;
+	for (unsigned int i = 0; i < 10; ++i) {
+		const unsigned char *p = data + LOGBOOK + i * SZ_LOGBOOK;
+
+		if (array_isequal (p, SZ_LOGBOOK, 0x00))
+			break;
+
+		unsigned int address = array_uint16_be(data + ADDRESS + i * 2);
+		if (address < RB_PROFILE_BEGIN || address >= RB_PROFILE_END)
+			return SZ_MEMORY;
+
+		if (memcmp (p, device->fingerprint, sizeof (device->fingerprint)) == 0)
+			break;
+
+		// A profile which wraps around the end of the ringbuffer
+		// requires the entire memory.
+		if (previous <= address)
+			return SZ_MEMORY;
+
+		if (required < previous)
+			required = previous;
+
+		previous = address;
+	}
+
+	return required;
+}
+
+
 static dc_status_t
-diverite_nitekq_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
+diverite_nitekq_download (diverite_nitekq_device_t *device, dc_buffer_t *buffer, unsigned int incremental)
 {
-	diverite_nitekq_device_t *device = (diverite_nitekq_device_t*) abstract;
+	dc_device_t *abstract = (dc_device_t *) device;
 	dc_status_t rc = DC_STATUS_SUCCESS;
-	unsigned char packet[256] = {0};
 
-	// Erase the current contents of the buffer.
-	if (!dc_buffer_clear (buffer) || !dc_buffer_reserve (buffer, SZ_PACKET + SZ_MEMORY)) {
+	// Erase the current contents of the buffer and
+	// allocate the required amount of memory.
+	if (!dc_buffer_clear (buffer) || !dc_buffer_resize (buffer, SZ_PACKET + SZ_MEMORY)) {
 		ERROR (abstract->context, "Insufficient buffer space available.");
 		return DC_STATUS_NOMEMORY;
 	}
 
+	unsigned char *data = dc_buffer_get_data (buffer);
+
 	// Enable progress notifications.
 	dc_event_progress_t progress = EVENT_PROGRESS_INITIALIZER;
 	progress.maximum = SZ_PACKET + SZ_MEMORY;
@@ -287,13 +336,11 @@ diverite_nitekq_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 	// Receive the response packet. It's currently not used (or needed)
 	// for anything, but we prepend it to the main data anyway, in case
 	// we ever need it in the future.
-	rc = diverite_nitekq_receive (device, packet, sizeof (packet));
+	rc = diverite_nitekq_receive (device, data, SZ_PACKET);
 	if (rc != DC_STATUS_SUCCESS) {
 		return rc;
 	}
 
-	dc_buffer_append (buffer, packet, sizeof (packet));
-
 	// Update and emit a progress event.
 	progress.current += SZ_PACKET;
 	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
@@ -304,7 +351,12 @@ diverite_nitekq_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 		return rc;
 	}
 
-	for (unsigned int i = 0; i < 128; ++i) {
+	// The memory blocks can only be downloaded sequentially, starting from
+	// the begin. Once the logbook is available, the download stops after
+	// the last block containing profile data newer than the fingerprint.
+	unsigned int required = SZ_MEMORY;
+	unsigned int nbytes = 0;
+	while (nbytes < required) {
 		// Request the next memory block.
 		rc = diverite_nitekq_send (device, BLOCK);
 		if (rc != DC_STATUS_SUCCESS) {
@@ -312,12 +364,18 @@ diverite_nitekq_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 		}
 
 		// Receive the memory block.
-		rc = diverite_nitekq_receive (device, packet, sizeof (packet));
+		rc = diverite_nitekq_receive (device, data + SZ_PACKET + nbytes, SZ_PACKET);
 		if (rc != DC_STATUS_SUCCESS) {
 			return rc;
 		}
 
-		dc_buffer_append (buffer, packet, sizeof (packet));
+		nbytes += SZ_PACKET;
+
+		if (incremental && nbytes >= RB_PROFILE_BEGIN && nbytes - SZ_PACKET < RB_PROFILE_BEGIN) {
+			unsigned int length = diverite_nitekq_required (device, data + SZ_PACKET);
+			required = (length + SZ_PACKET - 1) / SZ_PACKET * SZ_PACKET;
+			progress.maximum = SZ_PACKET + required;
+		}
 
 		// Update and emit a progress event.
 		progress.current += SZ_PACKET;
@@ -328,15 +386,27 @@ diverite_nitekq_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 }
 
 
+static dc_status_t
+diverite_nitekq_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
+{
+	return diverite_nitekq_download ((diverite_nitekq_device_t *) abstract, buffer, 0);
+}
+
+
 static dc_status_t
 diverite_nitekq_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void *userdata)
 {
-	dc_buffer_t *buffer = dc_buffer_new (0);
+	dc_buffer_t *buffer = dc_buffer_new (SZ_PACKET + SZ_MEMORY);
 	if (buffer == NULL)
 		return DC_STATUS_NOMEMORY;
+	device_memory_add (abstract, SZ_PACKET + SZ_MEMORY);
 
-	dc_status_t rc = diverite_nitekq_device_dump (abstract, buffer);
+	// Only the part of the memory with the new dives is downloaded. The
+	// remainder stays zero, and is never accessed by the extractor,
+	// because it stops at the fingerprint.
+	dc_status_t rc = diverite_nitekq_download ((diverite_nitekq_device_t *) abstract, buffer, 1);
 	if (rc != DC_STATUS_SUCCESS) {
+		device_memory_sub (abstract, SZ_PACKET + SZ_MEMORY);
 		dc_buffer_free (buffer);
 		return rc;
 	}
@@ -344,6 +414,7 @@ diverite_nitekq_device_foreach (dc_device_t *abstract, dc_dive_callback_t callba
 	rc = diverite_nitekq_extract_dives (abstract,
 		dc_buffer_get_data (buffer), dc_buffer_get_size (buffer), callback, userdata);
 
+	device_memory_sub (abstract, SZ_PACKET + SZ_MEMORY);
 	dc_buffer_free (buffer);
 
 	return rc;
@@ -0,0 +1,644 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <libdivecomputer/divestore.h>
+
+#include "context-private.h"
+#include "checksum.h"
+#include "array.h"
+
+#define DATANAME "dives.dat"
+#define INDEXNAME "dives.idx"
+
+#define RECORD_MAGIC 0x56444344 // "DCDV"
+#define INDEX_MAGIC  0x49444344 // "DCDI"
+#define INDEX_VERSION 1
+
+#define SZ_RECORD 24
+#define SZ_HEADER 24
+#define SZ_SLOT   16
+
+#define MINCAPACITY 1024
+
+typedef struct divestore_slot_t {
+	unsigned long long hash;
+	unsigned long long offset; // Offset of the record plus one, zero if empty.
+} divestore_slot_t;
+
+typedef struct divestore_record_t {
+	unsigned int family;
+	unsigned int serial;
+	unsigned int fsize;
+	unsigned int size;
+	unsigned int crc;
+} divestore_record_t;
+
+struct dc_divestore_t {
+	dc_context_t *context;
+	char *dataname;
+	char *indexname;
+	FILE *fp;
+	dc_buffer_t *scratch;
+	divestore_slot_t *slots;
+	size_t capacity;
+	size_t count;
+	unsigned long long end;
+	int dirty;
+};
+
+static char *
+dc_divestore_filename (const char *dirname, const char *name)
+{
+	size_t size = strlen (dirname) + strlen (name) + 2;
+	char *filename = (char *) malloc (size);
+	if (filename == NULL)
+		return NULL;
+
+	snprintf (filename, size, "%s/%s", dirname, name);
+
+	return filename;
+}
+
+static unsigned long long
+dc_divestore_hash (unsigned int family, unsigned int serial, const unsigned char fingerprint[], unsigned int fsize)
+{
+	unsigned char key[8];
+	array_uint32_le_set (key + 0, family);
+	array_uint32_le_set (key + 4, serial);
+
+	// 64 bit FNV-1a hash.
+	unsigned long long hash = 0xcbf29ce484222325ULL;
+	for (unsigned int i = 0; i < sizeof (key); ++i) {
+		hash ^= key[i];
+		hash *= 0x100000001b3ULL;
+	}
+	for (unsigned int i = 0; i < fsize; ++i) {
+		hash ^= fingerprint[i];
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+static unsigned int
+dc_divestore_crc (const unsigned char fingerprint[], unsigned int fsize, const unsigned char data[], unsigned int size)
+{
+	unsigned short crc = checksum_crc_ccitt_uint16 (fingerprint, fsize, 0xffff);
+	return checksum_crc_ccitt_uint16 (data, size, crc);
+}
+
+static void
+dc_divestore_insert_slot (divestore_slot_t slots[], size_t capacity, unsigned long long hash, unsigned long long offset)
+{
+	size_t i = hash & (capacity - 1);
+	while (slots[i].offset)
+		i = (i + 1) & (capacity - 1);
+
+	slots[i].hash = hash;
+	slots[i].offset = offset + 1;
+}
+
+static dc_status_t
+dc_divestore_insert (dc_divestore_t *store, unsigned long long hash, unsigned long long offset)
+{
+	// Keep the load factor below 75%.
+	if ((store->count + 1) * 4 > store->capacity * 3) {
+		size_t capacity = store->capacity ? store->capacity * 2 : MINCAPACITY;
+		divestore_slot_t *slots = (divestore_slot_t *) calloc (capacity, sizeof (divestore_slot_t));
+		if (slots == NULL) {
+			ERROR (store->context, "Failed to allocate memory.");
+			return DC_STATUS_NOMEMORY;
+		}
+
+		for (size_t i = 0; i < store->capacity; ++i) {
+			if (store->slots[i].offset)
+				dc_divestore_insert_slot (slots, capacity, store->slots[i].hash, store->slots[i].offset - 1);
+		}
+
+		free (store->slots);
+		store->slots = slots;
+		store->capacity = capacity;
+	}
+
+	dc_divestore_insert_slot (store->slots, store->capacity, hash, offset);
+	store->count++;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static int
+dc_divestore_read_record (dc_divestore_t *store, unsigned long long offset, divestore_record_t *record)
+{
+	unsigned char header[SZ_RECORD];
+
+	if (fseek (store->fp, (long) offset, SEEK_SET) != 0 ||
+		fread (header, 1, sizeof (header), store->fp) != sizeof (header))
+		return 0;
+
+	if (array_uint32_le (header) != RECORD_MAGIC)
+		return 0;
+
+	record->family = array_uint32_le (header + 4);
+	record->serial = array_uint32_le (header + 8);
+	record->fsize  = array_uint32_le (header + 12);
+	record->size   = array_uint32_le (header + 16);
+	record->crc    = array_uint32_le (header + 20);
+
+	return 1;
+}
+
+static dc_status_t
+dc_divestore_lookup (dc_divestore_t *store, unsigned long long hash, unsigned int family, unsigned int serial, const unsigned char fingerprint[], unsigned int fsize, unsigned long long *offset, divestore_record_t *record)
+{
+	if (store->capacity == 0)
+		return DC_STATUS_DONE;
+
+	size_t i = hash & (store->capacity - 1);
+	while (store->slots[i].offset) {
+		if (store->slots[i].hash == hash) {
+			// Confirm the match with the key stored in the data file.
+			unsigned long long candidate = store->slots[i].offset - 1;
+			if (!dc_divestore_read_record (store, candidate, record)) {
+				ERROR (store->context, "Failed to read the dive record.");
+				return DC_STATUS_IO;
+			}
+
+			if (record->family == family && record->serial == serial && record->fsize == fsize) {
+				if (!dc_buffer_resize (store->scratch, fsize)) {
+					ERROR (store->context, "Failed to allocate memory.");
+					return DC_STATUS_NOMEMORY;
+				}
+
+				unsigned char *buffer = dc_buffer_get_data (store->scratch);
+				if (fread (buffer, 1, fsize, store->fp) != fsize) {
+					ERROR (store->context, "Failed to read the dive record.");
+					return DC_STATUS_IO;
+				}
+
+				if (memcmp (buffer, fingerprint, fsize) == 0) {
+					*offset = candidate;
+					return DC_STATUS_SUCCESS;
+				}
+			}
+		}
+
+		i = (i + 1) & (store->capacity - 1);
+	}
+
+	return DC_STATUS_DONE;
+}
+
+static dc_status_t
+dc_divestore_load_index (dc_divestore_t *store, unsigned long long filesize)
+{
+	unsigned char header[SZ_HEADER];
+	unsigned char slot[SZ_SLOT];
+
+	FILE *fp = fopen (store->indexname, "rb");
+	if (fp == NULL)
+		return DC_STATUS_SUCCESS; // No index stored yet.
+
+	if (fread (header, 1, sizeof (header), fp) != sizeof (header) ||
+		array_uint32_le (header) != INDEX_MAGIC ||
+		array_uint32_le (header + 4) != INDEX_VERSION) {
+		WARNING (store->context, "Ignoring the damaged dive index.");
+		fclose (fp);
+		return DC_STATUS_SUCCESS;
+	}
+
+	size_t capacity = array_uint32_le (header + 8);
+	size_t count = array_uint32_le (header + 12);
+	unsigned long long end =
+		array_uint32_le (header + 16) |
+		((unsigned long long) array_uint32_le (header + 20) << 32);
+
+	if ((capacity & (capacity - 1)) != 0 || count * 4 > capacity * 3 || end > filesize) {
+		WARNING (store->context, "Ignoring the damaged dive index.");
+		fclose (fp);
+		return DC_STATUS_SUCCESS;
+	}
+
+	divestore_slot_t *slots = NULL;
+	if (capacity) {
+		slots = (divestore_slot_t *) calloc (capacity, sizeof (divestore_slot_t));
+		if (slots == NULL) {
+			ERROR (store->context, "Failed to allocate memory.");
+			fclose (fp);
+			return DC_STATUS_NOMEMORY;
+		}
+	}
+
+	int damaged = 0;
+	size_t n = 0;
+	for (size_t i = 0; i < capacity; ++i) {
+		if (fread (slot, 1, sizeof (slot), fp) != sizeof (slot)) {
+			damaged = 1;
+			break;
+		}
+
+		slots[i].hash =
+			array_uint32_le (slot + 0) |
+			((unsigned long long) array_uint32_le (slot + 4) << 32);
+		slots[i].offset =
+			array_uint32_le (slot + 8) |
+			((unsigned long long) array_uint32_le (slot + 12) << 32);
+		if (slots[i].offset > end) {
+			damaged = 1;
+			break;
+		}
+
+		if (slots[i].offset)
+			n++;
+	}
+
+	fclose (fp);
+
+	if (damaged || n != count) {
+		WARNING (store->context, "Ignoring the damaged dive index.");
+		free (slots);
+		return DC_STATUS_SUCCESS;
+	}
+
+	store->slots = slots;
+	store->capacity = capacity;
+	store->count = count;
+	store->end = end;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_divestore_scan (dc_divestore_t *store, unsigned long long filesize)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	divestore_record_t record;
+
+	// Index the records appended after the index was last written.
+	unsigned long long offset = store->end;
+	while (offset + SZ_RECORD <= filesize) {
+		if (!dc_divestore_read_record (store, offset, &record))
+			break;
+
+		unsigned long long length = (unsigned long long) record.fsize + record.size;
+		if (length > filesize - offset - SZ_RECORD)
+			break;
+
+		if (!dc_buffer_resize (store->scratch, length)) {
+			ERROR (store->context, "Failed to allocate memory.");
+			return DC_STATUS_NOMEMORY;
+		}
+
+		unsigned char *buffer = dc_buffer_get_data (store->scratch);
+		if (fread (buffer, 1, length, store->fp) != length)
+			break;
+
+		if (dc_divestore_crc (buffer, record.fsize, buffer + record.fsize, record.size) != record.crc)
+			break;
+
+		unsigned long long hash = dc_divestore_hash (record.family, record.serial, buffer, record.fsize);
+		status = dc_divestore_insert (store, hash, offset);
+		if (status != DC_STATUS_SUCCESS)
+			return status;
+
+		offset += SZ_RECORD + length;
+		store->dirty = 1;
+	}
+
+	if (offset != filesize) {
+		// An interrupted write leaves an incomplete record behind. It is
+		// overwritten by the next dive.
+		WARNING (store->context, "Ignoring %llu bytes of damaged data.", filesize - offset);
+	}
+
+	store->end = offset;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_divestore_new (dc_divestore_t **out, dc_context_t *context, const char *dirname)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_divestore_t *store = NULL;
+
+	if (out == NULL || dirname == NULL) {
+		ERROR (context, "Invalid arguments.");
+		return DC_STATUS_INVALIDARGS;
+	}
+
+	store = (dc_divestore_t *) calloc (1, sizeof (dc_divestore_t));
+	if (store == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	store->context = context;
+	store->dataname = dc_divestore_filename (dirname, DATANAME);
+	store->indexname = dc_divestore_filename (dirname, INDEXNAME);
+	store->scratch = dc_buffer_new (0);
+	if (store->dataname == NULL || store->indexname == NULL || store->scratch == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		status = DC_STATUS_NOMEMORY;
+		goto error_free;
+	}
+
+	store->fp = fopen (store->dataname, "r+b");
+	if (store->fp == NULL)
+		store->fp = fopen (store->dataname, "w+b");
+	if (store->fp == NULL) {
+		ERROR (context, "Failed to open the file.");
+		status = DC_STATUS_IO;
+		goto error_free;
+	}
+
+	if (fseek (store->fp, 0, SEEK_END) != 0) {
+		ERROR (context, "Failed to seek the file.");
+		status = DC_STATUS_IO;
+		goto error_close;
+	}
+
+	long filesize = ftell (store->fp);
+	if (filesize < 0) {
+		ERROR (context, "Failed to seek the file.");
+		status = DC_STATUS_IO;
+		goto error_close;
+	}
+
+	status = dc_divestore_load_index (store, filesize);
+	if (status != DC_STATUS_SUCCESS)
+		goto error_close;
+
+	status = dc_divestore_scan (store, filesize);
+	if (status != DC_STATUS_SUCCESS)
+		goto error_close;
+
+	*out = store;
+
+	return DC_STATUS_SUCCESS;
+
+error_close:
+	fclose (store->fp);
+error_free:
+	free (store->slots);
+	dc_buffer_free (store->scratch);
+	free (store->indexname);
+	free (store->dataname);
+	free (store);
+	return status;
+}
+
+dc_status_t
+dc_divestore_sync (dc_divestore_t *store)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	unsigned char header[SZ_HEADER];
+	unsigned char slot[SZ_SLOT];
+	char *tmpname = NULL;
+
+	if (store == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (!store->dirty)
+		return DC_STATUS_SUCCESS;
+
+	// The index must never refer to data that is not on disk yet.
+	if (fflush (store->fp) != 0) {
+		ERROR (store->context, "Failed to write the file.");
+		return DC_STATUS_IO;
+	}
+
+	tmpname = (char *) malloc (strlen (store->indexname) + 5);
+	if (tmpname == NULL) {
+		ERROR (store->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	sprintf (tmpname, "%s.tmp", store->indexname);
+
+	// Write to a temporary file first, and replace the previous
+	// index only when everything has been written successfully.
+	FILE *fp = fopen (tmpname, "wb");
+	if (fp == NULL) {
+		ERROR (store->context, "Failed to open the file.");
+		status = DC_STATUS_IO;
+		goto error_free;
+	}
+
+	array_uint32_le_set (header + 0, INDEX_MAGIC);
+	array_uint32_le_set (header + 4, INDEX_VERSION);
+	array_uint32_le_set (header + 8, store->capacity);
+	array_uint32_le_set (header + 12, store->count);
+	array_uint32_le_set (header + 16, store->end & 0xFFFFFFFF);
+	array_uint32_le_set (header + 20, store->end >> 32);
+	int ok = fwrite (header, 1, sizeof (header), fp) == sizeof (header);
+
+	for (size_t i = 0; ok && i < store->capacity; ++i) {
+		array_uint32_le_set (slot + 0, store->slots[i].hash & 0xFFFFFFFF);
+		array_uint32_le_set (slot + 4, store->slots[i].hash >> 32);
+		array_uint32_le_set (slot + 8, store->slots[i].offset & 0xFFFFFFFF);
+		array_uint32_le_set (slot + 12, store->slots[i].offset >> 32);
+		ok = fwrite (slot, 1, sizeof (slot), fp) == sizeof (slot);
+	}
+
+	if (!ok) {
+		ERROR (store->context, "Failed to write the file.");
+		fclose (fp);
+		remove (tmpname);
+		status = DC_STATUS_IO;
+		goto error_free;
+	}
+
+	if (fclose (fp) != 0) {
+		ERROR (store->context, "Failed to close the file.");
+		remove (tmpname);
+		status = DC_STATUS_IO;
+		goto error_free;
+	}
+
+#ifdef _WIN32
+	// On Windows, rename fails if the destination already exists.
+	remove (store->indexname);
+#endif
+	if (rename (tmpname, store->indexname) != 0) {
+		ERROR (store->context, "Failed to rename the file.");
+		remove (tmpname);
+		status = DC_STATUS_IO;
+		goto error_free;
+	}
+
+	store->dirty = 0;
+
+error_free:
+	free (tmpname);
+	return status;
+}
+
+dc_status_t
+dc_divestore_free (dc_divestore_t *store)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (store == NULL)
+		return DC_STATUS_SUCCESS;
+
+	status = dc_divestore_sync (store);
+
+	if (fclose (store->fp) != 0 && status == DC_STATUS_SUCCESS) {
+		ERROR (store->context, "Failed to close the file.");
+		status = DC_STATUS_IO;
+	}
+
+	free (store->slots);
+	dc_buffer_free (store->scratch);
+	free (store->indexname);
+	free (store->dataname);
+	free (store);
+
+	return status;
+}
+
+dc_status_t
+dc_divestore_add (dc_divestore_t *store, dc_family_t family, unsigned int serial, const unsigned char fingerprint[], unsigned int fsize, const unsigned char data[], unsigned int size)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	divestore_record_t record;
+	unsigned long long offset = 0;
+	unsigned char header[SZ_RECORD];
+
+	if (store == NULL || fingerprint == NULL || fsize == 0 || (data == NULL && size))
+		return DC_STATUS_INVALIDARGS;
+
+	unsigned long long hash = dc_divestore_hash (family, serial, fingerprint, fsize);
+	status = dc_divestore_lookup (store, hash, family, serial, fingerprint, fsize, &offset, &record);
+	if (status != DC_STATUS_DONE)
+		return status == DC_STATUS_SUCCESS ? DC_STATUS_DONE : status;
+
+	array_uint32_le_set (header + 0, RECORD_MAGIC);
+	array_uint32_le_set (header + 4, family);
+	array_uint32_le_set (header + 8, serial);
+	array_uint32_le_set (header + 12, fsize);
+	array_uint32_le_set (header + 16, size);
+	array_uint32_le_set (header + 20, dc_divestore_crc (fingerprint, fsize, data, size));
+
+	if (fseek (store->fp, (long) store->end, SEEK_SET) != 0 ||
+		fwrite (header, 1, sizeof (header), store->fp) != sizeof (header) ||
+		fwrite (fingerprint, 1, fsize, store->fp) != fsize ||
+		fwrite (data, 1, size, store->fp) != size) {
+		ERROR (store->context, "Failed to write the file.");
+		return DC_STATUS_IO;
+	}
+
+	status = dc_divestore_insert (store, hash, store->end);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	store->end += SZ_RECORD + (unsigned long long) fsize + size;
+	store->dirty = 1;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_divestore_get (dc_divestore_t *store, dc_family_t family, unsigned int serial, const unsigned char fingerprint[], unsigned int fsize, dc_buffer_t *data)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	divestore_record_t record;
+	unsigned long long offset = 0;
+
+	if (store == NULL || fingerprint == NULL || data == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_buffer_clear (data);
+
+	unsigned long long hash = dc_divestore_hash (family, serial, fingerprint, fsize);
+	status = dc_divestore_lookup (store, hash, family, serial, fingerprint, fsize, &offset, &record);
+	if (status != DC_STATUS_SUCCESS)
+		return status == DC_STATUS_DONE ? DC_STATUS_SUCCESS : status;
+
+	// The file is positioned right after the fingerprint.
+	if (!dc_buffer_resize (data, record.size)) {
+		ERROR (store->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	if (fread (dc_buffer_get_data (data), 1, record.size, store->fp) != record.size) {
+		ERROR (store->context, "Failed to read the dive record.");
+		dc_buffer_clear (data);
+		return DC_STATUS_IO;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_divestore_foreach (dc_divestore_t *store, dc_divestore_callback_t callback, void *userdata)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	divestore_record_t record;
+
+	if (store == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	// A separate buffer, because the callback is allowed to add dives to
+	// the store, which moves the end of the data too.
+	dc_buffer_t *buffer = dc_buffer_new (0);
+	if (buffer == NULL) {
+		ERROR (store->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	unsigned long long offset = 0;
+	while (offset < store->end) {
+		if (!dc_divestore_read_record (store, offset, &record)) {
+			ERROR (store->context, "Failed to read the dive record.");
+			status = DC_STATUS_IO;
+			break;
+		}
+
+		unsigned long long length = (unsigned long long) record.fsize + record.size;
+		if (!dc_buffer_resize (buffer, length)) {
+			ERROR (store->context, "Failed to allocate memory.");
+			status = DC_STATUS_NOMEMORY;
+			break;
+		}
+
+		unsigned char *data = dc_buffer_get_data (buffer);
+		if (fread (data, 1, length, store->fp) != length) {
+			ERROR (store->context, "Failed to read the dive record.");
+			status = DC_STATUS_IO;
+			break;
+		}
+
+		offset += SZ_RECORD + length;
+
+		if (callback && !callback (record.family, record.serial,
+			data + record.fsize, record.size, data, record.fsize, userdata))
+			break;
+	}
+
+	dc_buffer_free (buffer);
+
+	return status;
+}
@@ -0,0 +1,309 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <libdivecomputer/divestream.h>
+
+#include "context-private.h"
+#include "thread.h"
+
+/* The interval (in milliseconds) to check for new dives, while waiting. */
+#define INTERVAL 1
+
+typedef struct dc_dive_stream_entry_t {
+	dc_dive_stream_item_t item;
+	unsigned int size;
+} dc_dive_stream_entry_t;
+
+/*
+ * A bounded multi-producer, multi-consumer queue. Every slot carries a
+ * sequence number, which tells whether the slot is ready to be filled
+ * (equal to the position of the producer), or to be emptied (one more
+ * than the position of the consumer). The positions are claimed with a
+ * compare and swap, and never wrap before a slot has been recycled.
+ */
+typedef struct dc_dive_stream_slot_t {
+	unsigned int sequence;
+	dc_dive_stream_entry_t *entry;
+} dc_dive_stream_slot_t;
+
+struct dc_dive_stream_t {
+	dc_context_t *context;
+	dc_dive_stream_slot_t *slots;
+	unsigned int mask;
+	unsigned int maxbytes;
+	/* Accessed atomically. */
+	unsigned int head, tail;
+	unsigned int nbytes;
+	unsigned int finished;
+	unsigned int overflow;
+	dc_status_t status;
+};
+
+dc_status_t
+dc_dive_stream_new (dc_dive_stream_t **out, dc_context_t *context, unsigned int maxdives, size_t maxbytes)
+{
+	dc_dive_stream_t *stream = NULL;
+
+	if (out == NULL || maxdives == 0 || maxdives > 0x10000000)
+		return DC_STATUS_INVALIDARGS;
+
+	// The number of slots is rounded up to a power of two.
+	unsigned int nslots = 1;
+	while (nslots < maxdives)
+		nslots *= 2;
+
+	stream = (dc_dive_stream_t *) malloc (sizeof (dc_dive_stream_t));
+	if (stream == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	stream->slots = (dc_dive_stream_slot_t *) malloc (nslots * sizeof (dc_dive_stream_slot_t));
+	if (stream->slots == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		free (stream);
+		return DC_STATUS_NOMEMORY;
+	}
+
+	for (unsigned int i = 0; i < nslots; ++i) {
+		stream->slots[i].sequence = i;
+		stream->slots[i].entry = NULL;
+	}
+
+	stream->context = context;
+	stream->mask = nslots - 1;
+	stream->maxbytes = (maxbytes == 0 || maxbytes > 0x7FFFFFFF) ? 0x7FFFFFFF : (unsigned int) maxbytes;
+	stream->head = 0;
+	stream->tail = 0;
+	stream->nbytes = 0;
+	stream->finished = 0;
+	stream->overflow = 0;
+	stream->status = DC_STATUS_SUCCESS;
+
+	*out = stream;
+
+	return DC_STATUS_SUCCESS;
+}
+
+/*
+ * Take the next entry, without waiting.
+ */
+static dc_dive_stream_entry_t *
+dc_dive_stream_dequeue (dc_dive_stream_t *stream)
+{
+	unsigned int position = dc_atomic_load (&stream->head);
+	while (1) {
+		dc_dive_stream_slot_t *slot = stream->slots + (position & stream->mask);
+		unsigned int sequence = dc_atomic_load_acquire (&slot->sequence);
+		int difference = (int) (sequence - (position + 1));
+		if (difference == 0) {
+			if (dc_atomic_cas (&stream->head, position, position + 1)) {
+				dc_dive_stream_entry_t *entry = slot->entry;
+				// Hand the slot back to the producers, one lap later.
+				dc_atomic_store_release (&slot->sequence, position + stream->mask + 1);
+				return entry;
+			}
+			position = dc_atomic_load (&stream->head);
+		} else if (difference < 0) {
+			return NULL;
+		} else {
+			position = dc_atomic_load (&stream->head);
+		}
+	}
+}
+
+/*
+ * Queue an entry, without waiting. Returns zero if the queue is full.
+ */
+static int
+dc_dive_stream_enqueue (dc_dive_stream_t *stream, dc_dive_stream_entry_t *entry)
+{
+	unsigned int position = dc_atomic_load (&stream->tail);
+	while (1) {
+		dc_dive_stream_slot_t *slot = stream->slots + (position & stream->mask);
+		unsigned int sequence = dc_atomic_load_acquire (&slot->sequence);
+		int difference = (int) (sequence - position);
+		if (difference == 0) {
+			if (dc_atomic_cas (&stream->tail, position, position + 1)) {
+				slot->entry = entry;
+				dc_atomic_store_release (&slot->sequence, position + 1);
+				return 1;
+			}
+			position = dc_atomic_load (&stream->tail);
+		} else if (difference < 0) {
+			return 0;
+		} else {
+			position = dc_atomic_load (&stream->tail);
+		}
+	}
+}
+
+dc_status_t
+dc_dive_stream_free (dc_dive_stream_t *stream)
+{
+	if (stream == NULL)
+		return DC_STATUS_SUCCESS;
+
+	dc_dive_stream_entry_t *entry = NULL;
+	while ((entry = dc_dive_stream_dequeue (stream)) != NULL) {
+		free (entry);
+	}
+
+	free (stream->slots);
+	free (stream);
+
+	return DC_STATUS_SUCCESS;
+}
+
+/*
+ * Mark the stream as overflowed. The download is stopped, and the
+ * consumers are told so once the stream is empty.
+ */
+static int
+dc_dive_stream_overflow (dc_dive_stream_t *stream)
+{
+	if (!dc_atomic_load (&stream->overflow)) {
+		WARNING (stream->context, "The dive stream is full, stopping the download.");
+		dc_atomic_store (&stream->overflow, 1);
+	}
+
+	return 0;
+}
+
+int
+dc_dive_stream_callback (const unsigned char *data, unsigned int size, const unsigned char *fingerprint, unsigned int fsize, void *userdata)
+{
+	dc_dive_stream_t *stream = (dc_dive_stream_t *) userdata;
+
+	if (stream == NULL || dc_atomic_load_acquire (&stream->finished))
+		return 0;
+
+	// Reserve the memory first, such that the limit is never exceeded.
+	if (size > stream->maxbytes || fsize > stream->maxbytes - size)
+		return dc_dive_stream_overflow (stream);
+	unsigned int nbytes = size + fsize;
+	unsigned int total = dc_atomic_add (&stream->nbytes, nbytes);
+	if (total > stream->maxbytes) {
+		dc_atomic_add (&stream->nbytes, -nbytes);
+		return dc_dive_stream_overflow (stream);
+	}
+
+	// Allocate the entry and its data in a single block.
+	dc_dive_stream_entry_t *entry = (dc_dive_stream_entry_t *) malloc (sizeof (dc_dive_stream_entry_t) + nbytes);
+	if (entry == NULL) {
+		ERROR (stream->context, "Failed to allocate memory.");
+		dc_atomic_add (&stream->nbytes, -nbytes);
+		return 0;
+	}
+
+	unsigned char *buffer = (unsigned char *) (entry + 1);
+	if (size)
+		memcpy (buffer, data, size);
+	if (fsize)
+		memcpy (buffer + size, fingerprint, fsize);
+	entry->item.data = buffer;
+	entry->item.size = size;
+	entry->item.fingerprint = fsize ? buffer + size : NULL;
+	entry->item.fsize = fsize;
+	entry->size = nbytes;
+
+	if (!dc_dive_stream_enqueue (stream, entry)) {
+		dc_atomic_add (&stream->nbytes, -nbytes);
+		free (entry);
+		return dc_dive_stream_overflow (stream);
+	}
+
+	return 1;
+}
+
+dc_status_t
+dc_dive_stream_finish (dc_dive_stream_t *stream, dc_status_t status)
+{
+	if (stream == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	// The status is published by the release store of the flag.
+	stream->status = status;
+	dc_atomic_store_release (&stream->finished, 1);
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_dive_stream_pop (dc_dive_stream_t *stream, dc_dive_stream_item_t **item, int timeout)
+{
+	if (stream == NULL || item == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	unsigned long long deadline = 0;
+	if (timeout > 0)
+		deadline = dc_context_clock () + (unsigned long long) timeout * 1000;
+
+	while (1) {
+		// Check the flag before the queue, such that the dives queued
+		// before the stream was finished are never missed.
+		unsigned int finished = dc_atomic_load_acquire (&stream->finished);
+
+		dc_dive_stream_entry_t *entry = dc_dive_stream_dequeue (stream);
+		if (entry) {
+			*item = &entry->item;
+			return DC_STATUS_SUCCESS;
+		}
+
+		if (finished)
+			return dc_atomic_load (&stream->overflow) ? DC_STATUS_CANCELLED : DC_STATUS_DONE;
+
+		if (timeout == 0 || (timeout > 0 && dc_context_clock () >= deadline))
+			return DC_STATUS_TIMEOUT;
+
+		dc_thread_sleep (INTERVAL);
+	}
+}
+
+dc_status_t
+dc_dive_stream_release (dc_dive_stream_t *stream, dc_dive_stream_item_t *item)
+{
+	if (stream == NULL || item == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_dive_stream_entry_t *entry = (dc_dive_stream_entry_t *) item;
+	dc_atomic_add (&stream->nbytes, -entry->size);
+	free (entry);
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_dive_stream_get_status (dc_dive_stream_t *stream, dc_status_t *status)
+{
+	if (stream == NULL || status == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (!dc_atomic_load_acquire (&stream->finished))
+		return DC_STATUS_INVALIDARGS;
+
+	*status = stream->status;
+
+	return DC_STATUS_SUCCESS;
+}
@@ -29,6 +29,8 @@
 #include "serial.h"
 #include "checksum.h"
 #include "array.h"
+#include "retry.h"
+#include "packet.h"
 
 #define ISINSTANCE(device) dc_device_isinstance((device), &divesystem_idive_device_vtable)
 
@@ -131,6 +133,10 @@ divesystem_idive_device_open2 (dc_device_t **out, dc_context_t *context, const c
 		goto error_free;
 	}
 
+	// Interrupt the blocking reads when the download is cancelled, and
+	// measure the time spent waiting for the I/O.
+	device_set_port ((dc_device_t *) device, device->port);
+
 	// Set the serial communication protocol (115200 8N1).
 	status = dc_serial_configure (device->port, 115200, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -195,98 +201,34 @@ divesystem_idive_device_set_fingerprint (dc_device_t *abstract, const unsigned c
 }
 
 
+static const dc_packet_framing_t divesystem_idive_framing = {
+	0, /* flags */
+	0, /* delay */
+	0, 0, 0, /* ack, header, trailer */
+	START, 2, /* start, minimum */
+	DC_PACKET_CHECKSUM_CRC_CCITT_BE, 0xffff, 0, 0, /* checksum */
+};
+
 static dc_status_t
 divesystem_idive_send (divesystem_idive_device_t *device, const unsigned char command[], unsigned int csize)
 {
-	dc_status_t status = DC_STATUS_SUCCESS;
-	dc_device_t *abstract = (dc_device_t *) device;
-	unsigned char packet[MAXPACKET + 4];
-	unsigned short crc = 0;
-
-	if (device_is_cancelled (abstract))
-		return DC_STATUS_CANCELLED;
-
-	if (csize < 1 || csize > MAXPACKET)
-		return DC_STATUS_INVALIDARGS;
-
-	// Setup the data packet
-	packet[0] = START;
-	packet[1] = csize;
-	memcpy(packet + 2, command, csize);
-	crc = checksum_crc_ccitt_uint16 (packet, csize + 2);
-	packet[csize + 2] = (crc >> 8) & 0xFF;
-	packet[csize + 3] = (crc     ) & 0xFF;
-
-	// Send the data packet.
-	status = dc_serial_write (device->port, packet, csize + 4, NULL);
-	if (status != DC_STATUS_SUCCESS) {
-		ERROR (abstract->context, "Failed to send the command.");
-		return status;
-	}
-
-	return DC_STATUS_SUCCESS;
+	return dc_packet_send ((dc_device_t *) device, device->port, &divesystem_idive_framing, command, csize);
 }
 
 
 static dc_status_t
 divesystem_idive_receive (divesystem_idive_device_t *device, unsigned char answer[], unsigned int *asize)
 {
-	dc_status_t status = DC_STATUS_SUCCESS;
 	dc_device_t *abstract = (dc_device_t *) device;
-	unsigned char packet[MAXPACKET + 4];
 
 	if (asize == NULL || *asize < MAXPACKET) {
 		ERROR (abstract->context, "Invalid arguments.");
 		return DC_STATUS_INVALIDARGS;
 	}
 
-	// Read the packet start byte.
-	while (1) {
-		status = dc_serial_read (device->port, packet + 0, 1, NULL);
-		if (status != DC_STATUS_SUCCESS) {
-			ERROR (abstract->context, "Failed to receive the packet start byte.");
-			return status;
-		}
-
-		if (packet[0] == START)
-			break;
-	}
-
-	// Read the packet length.
-	status = dc_serial_read (device->port, packet + 1, 1, NULL);
-	if (status != DC_STATUS_SUCCESS) {
-		ERROR (abstract->context, "Failed to receive the packet length.");
-		return status;
-	}
-
-	unsigned int len = packet[1];
-	if (len < 2 || len > MAXPACKET) {
-		ERROR (abstract->context, "Invalid packet length.");
-		return DC_STATUS_PROTOCOL;
-	}
-
-	// Read the packet payload and checksum.
-	status = dc_serial_read (device->port, packet + 2, len + 2, NULL);
-	if (status != DC_STATUS_SUCCESS) {
-		ERROR (abstract->context, "Failed to receive the packet payload and checksum.");
-		return status;
-	}
-
-	// Verify the checksum.
-	unsigned short crc = array_uint16_be (packet + len + 2);
-	unsigned short ccrc = checksum_crc_ccitt_uint16 (packet, len + 2);
-	if (crc != ccrc) {
-		ERROR (abstract->context, "Unexpected packet checksum.");
-		return DC_STATUS_PROTOCOL;
-	}
-
-	memcpy(answer, packet + 2, len);
-	*asize = len;
-
-	return DC_STATUS_SUCCESS;
+	return dc_packet_receive (abstract, device->port, &divesystem_idive_framing, answer, *asize, asize);
 }
 
-
 static dc_status_t
 divesystem_idive_transfer (divesystem_idive_device_t *device, const unsigned char command[], unsigned int csize, unsigned char answer[], unsigned int asize)
 {
@@ -294,7 +236,11 @@ divesystem_idive_transfer (divesystem_idive_device_t *device, const unsigned cha
 	dc_device_t *abstract = (dc_device_t *) device;
 	unsigned char packet[MAXPACKET] = {0};
 	unsigned int length = 0;
-	unsigned int nretries = 0;
+
+	// Wait a little longer after every busy answer, starting with a
+	// short delay because the device is usually ready again quickly.
+	dc_retry_t retry;
+	dc_retry_init (&retry, MAXRETRIES, 20, 320, 0);
 
 	while (1) {
 		// Send the command.
@@ -337,12 +283,10 @@ divesystem_idive_transfer (divesystem_idive_device_t *device, const unsigned cha
 			return DC_STATUS_PROTOCOL;
 		}
 
-		// Abort if the maximum number of retries is reached.
-		if (nretries++ >= MAXRETRIES)
-			return DC_STATUS_PROTOCOL;
-
-		// Delay the next attempt.
-		dc_serial_sleep(device->port, 100);
+		// Delay the next attempt, or give up.
+		rc = dc_retry_failed (&retry, abstract, device->port, DC_STATUS_PROTOCOL);
+		if (rc != DC_STATUS_SUCCESS)
+			return rc;
 	}
 
 	// Verify the length of the packet.
@@ -421,14 +365,23 @@ divesystem_idive_device_foreach (dc_device_t *abstract, dc_dive_callback_t callb
 			(number     ) & 0xFF,
 			(number >> 8) & 0xFF};
 		rc = divesystem_idive_transfer (device, cmd_header, sizeof(cmd_header), packet, commands->header.size);
-		if (rc != DC_STATUS_SUCCESS)
+		if (rc != DC_STATUS_SUCCESS) {
+			dc_buffer_free (buffer);
 			return rc;
+		}
 
 		if (memcmp(packet + 7, device->fingerprint, sizeof(device->fingerprint)) == 0)
 			break;
 
 		unsigned int nsamples = array_uint16_le (packet + 1);
 
+		// Skip the samples of the dives that are already known.
+		if (device_fingerprint_known (abstract, packet + 7, sizeof(device->fingerprint))) {
+			progress.current = (i + 1) * NSTEPS;
+			device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
+			continue;
+		}
+
 		// Update and emit a progress event.
 		progress.current = i * NSTEPS + STEP(1, nsamples + 1);
 		device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
@@ -443,8 +396,10 @@ divesystem_idive_device_foreach (dc_device_t *abstract, dc_dive_callback_t callb
 				(idx     ) & 0xFF,
 				(idx >> 8) & 0xFF};
 			rc = divesystem_idive_transfer (device, cmd_sample, sizeof(cmd_sample), packet, commands->sample.size);
-			if (rc != DC_STATUS_SUCCESS)
+			if (rc != DC_STATUS_SUCCESS) {
+				dc_buffer_free (buffer);
 				return rc;
+			}
 
 			// Update and emit a progress event.
 			progress.current = i * NSTEPS + STEP(j + 2, nsamples + 1);
@@ -19,7 +19,10 @@
  * MA 02110-1301 USA
  */
 
+#define DC_LOG_CATEGORY DC_LOGCATEGORY_PARSER
+
 #include <stdlib.h>
+#include <math.h>
 
 #include <libdivecomputer/divesystem_idive.h>
 
@@ -51,6 +54,7 @@ struct divesystem_idive_parser_t {
 	unsigned int samplesize;
 	// Cached fields.
 	unsigned int cached;
+	unsigned int nsamples;
 	unsigned int divetime;
 	unsigned int maxdepth;
 	unsigned int ngasmixes;
@@ -62,6 +66,7 @@ static dc_status_t divesystem_idive_parser_set_data (dc_parser_t *abstract, cons
 static dc_status_t divesystem_idive_parser_get_datetime (dc_parser_t *abstract, dc_datetime_t *datetime);
 static dc_status_t divesystem_idive_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsigned int flags, void *value);
 static dc_status_t divesystem_idive_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata);
+static dc_status_t divesystem_idive_parser_samples_extract (dc_parser_t *abstract, dc_sample_columns_t *columns);
 
 static const dc_parser_vtable_t divesystem_idive_parser_vtable = {
 	sizeof(divesystem_idive_parser_t),
@@ -70,6 +75,14 @@ static const dc_parser_vtable_t divesystem_idive_parser_vtable = {
 	divesystem_idive_parser_get_datetime, /* datetime */
 	divesystem_idive_parser_get_field, /* fields */
 	divesystem_idive_parser_samples_foreach, /* samples_foreach */
+	divesystem_idive_parser_samples_extract, /* samples_extract */
+	NULL, /* samples_range */
+	NULL, /* samples_seek */
+	NULL, /* samples_index */
+	NULL, /* samples_split */
+	NULL, /* samples_chunk */
+	NULL, /* subdives */
+	NULL, /* samples_vendor */
 	NULL /* destroy */
 };
 
@@ -105,6 +118,7 @@ divesystem_idive_parser_create2 (dc_parser_t **out, dc_context_t *context, unsig
 		parser->samplesize = SZ_SAMPLE_IDIVE;
 	}
 	parser->cached = 0;
+	parser->nsamples = 0;
 	parser->divetime = 0;
 	parser->maxdepth = 0;
 	parser->ngasmixes = 0;
@@ -126,6 +140,7 @@ divesystem_idive_parser_set_data (dc_parser_t *abstract, const unsigned char *da
 
 	// Reset the cache.
 	parser->cached = 0;
+	parser->nsamples = 0;
 	parser->divetime = 0;
 	parser->maxdepth = 0;
 	parser->ngasmixes = 0;
@@ -138,6 +153,85 @@ divesystem_idive_parser_set_data (dc_parser_t *abstract, const unsigned char *da
 }
 
 
+/*
+ * Summarize the samples, without decoding them completely. The records
+ * have a fixed size, so only the timestamp, the depth and the gas mix of
+ * each record are read.
+ */
+static dc_status_t
+divesystem_idive_parser_cache (divesystem_idive_parser_t *parser)
+{
+	dc_parser_t *abstract = (dc_parser_t *) parser;
+	const unsigned char *data = abstract->data;
+	unsigned int size = abstract->size;
+
+	if (parser->cached)
+		return DC_STATUS_SUCCESS;
+
+	if (size < parser->headersize)
+		return DC_STATUS_DATAFORMAT;
+
+	unsigned int nsamples = (size - parser->headersize) / parser->samplesize;
+
+	unsigned int time = 0;
+	unsigned int maxdepth = 0;
+	unsigned int ngasmixes = 0;
+	unsigned int oxygen[NGASMIXES];
+	unsigned int helium[NGASMIXES];
+	unsigned int o2_previous = 0xFFFFFFFF;
+	unsigned int he_previous = 0xFFFFFFFF;
+
+	const unsigned char *p = data + parser->headersize;
+	for (unsigned int n = 0; n < nsamples; ++n, p += parser->samplesize) {
+		unsigned int timestamp = array_uint32_le (p + 2);
+		if (timestamp <= time) {
+			ERROR (abstract->context, "Timestamp moved backwards.");
+			return DC_STATUS_DATAFORMAT;
+		}
+		time = timestamp;
+
+		unsigned int depth = array_uint16_le (p + 6);
+		if (maxdepth < depth)
+			maxdepth = depth;
+
+		unsigned int o2 = p[10];
+		unsigned int he = p[11];
+		if (o2 != o2_previous || he != he_previous) {
+			unsigned int i = 0;
+			while (i < ngasmixes) {
+				if (o2 == oxygen[i] && he == helium[i])
+					break;
+				i++;
+			}
+			if (i >= ngasmixes) {
+				if (i >= NGASMIXES) {
+					ERROR (abstract->context, "Maximum number of gas mixes reached.");
+					return DC_STATUS_DATAFORMAT;
+				}
+				oxygen[i] = o2;
+				helium[i] = he;
+				ngasmixes = i + 1;
+			}
+			o2_previous = o2;
+			he_previous = he;
+		}
+	}
+
+	// Cache the data for later use.
+	for (unsigned int i = 0; i < ngasmixes; ++i) {
+		parser->helium[i] = helium[i];
+		parser->oxygen[i] = oxygen[i];
+	}
+	parser->ngasmixes = ngasmixes;
+	parser->nsamples = nsamples;
+	parser->maxdepth = maxdepth;
+	parser->divetime = time;
+	parser->cached = 1;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
 static dc_status_t
 divesystem_idive_parser_get_datetime (dc_parser_t *abstract, dc_datetime_t *datetime)
 {
@@ -164,8 +258,9 @@ divesystem_idive_parser_get_field (dc_parser_t *abstract, dc_field_type_t type,
 	if (abstract->size < parser->headersize)
 		return DC_STATUS_DATAFORMAT;
 
-	if (!parser->cached) {
-		dc_status_t rc = divesystem_idive_parser_samples_foreach (abstract, NULL, NULL);
+	// Only the header fields are available without the samples.
+	if (type != DC_FIELD_ATMOSPHERIC) {
+		dc_status_t rc = divesystem_idive_parser_cache (parser);
 		if (rc != DC_STATUS_SUCCESS)
 			return rc;
 	}
@@ -215,6 +310,7 @@ divesystem_idive_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callba
 	unsigned int o2_previous = 0xFFFFFFFF;
 	unsigned int he_previous = 0xFFFFFFFF;
 
+	unsigned int nsamples = 0;
 	unsigned int offset = parser->headersize;
 	while (offset + parser->samplesize <= size) {
 		dc_sample_value_t sample = {0};
@@ -298,6 +394,7 @@ divesystem_idive_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callba
 		if (callback) callback (DC_SAMPLE_CNS, sample, userdata);
 
 		offset += parser->samplesize;
+		nsamples++;
 	}
 
 	// Cache the data for later use.
@@ -306,9 +403,80 @@ divesystem_idive_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callba
 		parser->oxygen[i] = oxygen[i];
 	}
 	parser->ngasmixes = ngasmixes;
+	parser->nsamples = nsamples;
 	parser->maxdepth = maxdepth;
 	parser->divetime = time;
 	parser->cached = 1;
 
 	return DC_STATUS_SUCCESS;
 }
+
+
+static dc_status_t
+divesystem_idive_parser_samples_extract (dc_parser_t *abstract, dc_sample_columns_t *columns)
+{
+	divesystem_idive_parser_t *parser = (divesystem_idive_parser_t *) abstract;
+
+	// The timestamps are validated, and the gas mixes collected, in
+	// advance by the summary pass.
+	dc_status_t rc = divesystem_idive_parser_cache (parser);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	const unsigned char *data = abstract->data + parser->headersize;
+	unsigned int samplesize = parser->samplesize;
+	unsigned int n = parser->nsamples < columns->capacity ? parser->nsamples : columns->capacity;
+
+	columns->nsamples = parser->nsamples;
+
+	// Each column is converted in a separate loop over the records.
+	if (columns->time) {
+		unsigned int *time = columns->time;
+		for (unsigned int i = 0; i < n; ++i)
+			time[i] = array_uint32_le (data + i * samplesize + 2);
+	}
+
+	if (columns->depth) {
+		double *depth = columns->depth;
+		for (unsigned int i = 0; i < n; ++i)
+			depth[i] = array_uint16_le (data + i * samplesize + 6) / 10.0;
+	}
+
+	if (columns->temperature) {
+		double *temperature = columns->temperature;
+		for (unsigned int i = 0; i < n; ++i)
+			temperature[i] = (signed short) array_uint16_le (data + i * samplesize + 8) / 10.0;
+	}
+
+	if (columns->gasmix) {
+		unsigned int *gasmix = columns->gasmix;
+		unsigned int o2_previous = 0xFFFFFFFF;
+		unsigned int he_previous = 0xFFFFFFFF;
+		for (unsigned int i = 0; i < n; ++i) {
+			unsigned int o2 = data[i * samplesize + 10];
+			unsigned int he = data[i * samplesize + 11];
+			gasmix[i] = DC_GASMIX_UNKNOWN;
+			if (o2 != o2_previous || he != he_previous) {
+				unsigned int idx = 0;
+				while (idx < parser->ngasmixes) {
+					if (o2 == parser->oxygen[idx] && he == parser->helium[idx])
+						break;
+					idx++;
+				}
+				gasmix[i] = idx;
+				o2_previous = o2;
+				he_previous = he;
+			}
+		}
+	}
+
+	for (unsigned int t = 0; t < columns->ntanks; ++t) {
+		double *pressure = columns->pressure[t];
+		if (pressure == NULL)
+			continue;
+		for (unsigned int i = 0; i < n; ++i)
+			pressure[i] = NAN;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
@@ -0,0 +1,364 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#endif
+
+#include <libdivecomputer/download.h>
+
+#include "device-private.h"
+#include "context-private.h"
+#include "thread.h"
+
+typedef struct dc_download_item_t {
+	struct dc_download_item_t *next;
+	/* The event type, or zero for a dive. */
+	dc_event_type_t event;
+	union {
+		dc_event_progress_t progress;
+		dc_event_devinfo_t devinfo;
+		dc_event_clock_t clock;
+		dc_event_vendor_t vendor;
+	} data;
+	/* The dive data followed by the fingerprint, or the vendor data. */
+	unsigned char *buffer;
+	unsigned int size;
+	unsigned int fsize;
+} dc_download_item_t;
+
+struct dc_download_t {
+	dc_device_t *device;
+	dc_thread_t *thread;
+	int cancelled;
+	/* Protected by the mutex. */
+	dc_mutex_t *mutex;
+	dc_download_item_t *head, *tail;
+	int finished;
+	dc_status_t status;
+#ifndef _WIN32
+	int fds[2];
+#endif
+};
+
+static dc_download_item_t *
+dc_download_item_new (dc_event_type_t event, const unsigned char data[], unsigned int size, const unsigned char fingerprint[], unsigned int fsize)
+{
+	// Allocate the item and its data in a single block.
+	dc_download_item_t *item = (dc_download_item_t *) malloc (sizeof (dc_download_item_t) + size + fsize);
+	if (item == NULL)
+		return NULL;
+
+	memset (item, 0, sizeof (dc_download_item_t));
+	item->event = event;
+	item->buffer = (unsigned char *) (item + 1);
+	item->size = size;
+	item->fsize = fsize;
+	if (size)
+		memcpy (item->buffer, data, size);
+	if (fsize)
+		memcpy (item->buffer + size, fingerprint, fsize);
+
+	return item;
+}
+
+static void
+dc_download_notify (dc_download_t *download)
+{
+#ifndef _WIN32
+	// A full pipe is already readable, so a failed write is harmless.
+	unsigned char c = 0;
+	ssize_t rc = write (download->fds[1], &c, 1);
+	(void) rc;
+#else
+	(void) download;
+#endif
+}
+
+static void
+dc_download_push (dc_download_t *download, dc_download_item_t *item)
+{
+	dc_mutex_lock (download->mutex);
+	if (download->tail)
+		download->tail->next = item;
+	else
+		download->head = item;
+	download->tail = item;
+	dc_mutex_unlock (download->mutex);
+
+	dc_download_notify (download);
+}
+
+static void
+dc_download_free_items (dc_download_item_t *item)
+{
+	while (item) {
+		dc_download_item_t *next = item->next;
+		free (item);
+		item = next;
+	}
+}
+
+static int
+dc_download_cancel_cb (void *userdata)
+{
+	dc_download_t *download = (dc_download_t *) userdata;
+
+	return dc_atomic_load (&download->cancelled);
+}
+
+static void
+dc_download_event_cb (dc_device_t *device, dc_event_type_t event, const void *data, void *userdata)
+{
+	dc_download_t *download = (dc_download_t *) userdata;
+	dc_download_item_t *item = NULL;
+
+	if (event == DC_EVENT_VENDOR) {
+		const dc_event_vendor_t *vendor = (const dc_event_vendor_t *) data;
+		item = dc_download_item_new (event, vendor->data, vendor->size, NULL, 0);
+	} else {
+		item = dc_download_item_new (event, NULL, 0, NULL, 0);
+	}
+	if (item == NULL) {
+		ERROR (device->context, "Failed to allocate memory.");
+		return;
+	}
+
+	switch (event) {
+	case DC_EVENT_PROGRESS:
+		item->data.progress = *(const dc_event_progress_t *) data;
+		break;
+	case DC_EVENT_DEVINFO:
+		item->data.devinfo = *(const dc_event_devinfo_t *) data;
+		break;
+	case DC_EVENT_CLOCK:
+		item->data.clock = *(const dc_event_clock_t *) data;
+		break;
+	default:
+		break;
+	}
+
+	dc_download_push (download, item);
+}
+
+static int
+dc_download_dive_cb (const unsigned char *data, unsigned int size, const unsigned char *fingerprint, unsigned int fsize, void *userdata)
+{
+	dc_download_t *download = (dc_download_t *) userdata;
+
+	if (dc_atomic_load (&download->cancelled))
+		return 0;
+
+	dc_download_item_t *item = dc_download_item_new (0, data, size, fingerprint, fsize);
+	if (item == NULL) {
+		ERROR (download->device->context, "Failed to allocate memory.");
+		return 0;
+	}
+
+	dc_download_push (download, item);
+
+	return 1;
+}
+
+static void
+dc_download_run (void *userdata)
+{
+	dc_download_t *download = (dc_download_t *) userdata;
+
+	dc_status_t status = dc_device_foreach (download->device, dc_download_dive_cb, download);
+
+	dc_mutex_lock (download->mutex);
+	download->status = status;
+	download->finished = 1;
+	dc_mutex_unlock (download->mutex);
+
+	dc_download_notify (download);
+}
+
+dc_status_t
+dc_download_start (dc_download_t **out, dc_device_t *device, unsigned int events)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_download_t *download = NULL;
+
+	if (out == NULL || device == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	download = (dc_download_t *) malloc (sizeof (dc_download_t));
+	if (download == NULL) {
+		ERROR (device->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	download->device = device;
+	download->thread = NULL;
+	download->cancelled = 0;
+	download->head = NULL;
+	download->tail = NULL;
+	download->finished = 0;
+	download->status = DC_STATUS_SUCCESS;
+
+	status = dc_mutex_new (&download->mutex);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (device->context, "Failed to create the mutex.");
+		goto error_free;
+	}
+
+#ifndef _WIN32
+	// Create the notification pipe. Both ends are non-blocking, to
+	// be able to drain the pipe, and to never block the download.
+	if (pipe (download->fds) != 0) {
+		SYSERROR (device->context, errno);
+		status = DC_STATUS_IO;
+		goto error_mutex_free;
+	}
+
+	for (unsigned int i = 0; i < 2; ++i) {
+		int flags = fcntl (download->fds[i], F_GETFL);
+		fcntl (download->fds[i], F_SETFL, flags | O_NONBLOCK);
+		fcntl (download->fds[i], F_SETFD, FD_CLOEXEC);
+	}
+#endif
+
+	dc_device_set_events (device, events, dc_download_event_cb, download);
+	dc_device_set_cancel (device, dc_download_cancel_cb, download);
+
+	status = dc_thread_new (&download->thread, dc_download_run, download);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (device->context, "Failed to create the thread.");
+		goto error_close;
+	}
+
+	*out = download;
+
+	return DC_STATUS_SUCCESS;
+
+error_close:
+	dc_device_set_events (device, 0, NULL, NULL);
+	dc_device_set_cancel (device, NULL, NULL);
+#ifndef _WIN32
+	close (download->fds[0]);
+	close (download->fds[1]);
+error_mutex_free:
+#endif
+	dc_mutex_free (download->mutex);
+error_free:
+	free (download);
+	return status;
+}
+
+dc_status_t
+dc_download_get_fd (dc_download_t *download, int *fd)
+{
+	if (download == NULL || fd == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+#ifdef _WIN32
+	return DC_STATUS_UNSUPPORTED;
+#else
+	*fd = download->fds[0];
+
+	return DC_STATUS_SUCCESS;
+#endif
+}
+
+dc_status_t
+dc_download_dispatch (dc_download_t *download, dc_event_callback_t event, dc_dive_callback_t dive, void *userdata)
+{
+	if (download == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+#ifndef _WIN32
+	// Drain the notification pipe first, so a notification arriving
+	// after the queue has been taken keeps the pipe readable.
+	unsigned char buffer[64];
+	while (read (download->fds[0], buffer, sizeof (buffer)) > 0);
+#endif
+
+	// Take all pending items at once, to keep the lock short.
+	dc_mutex_lock (download->mutex);
+	dc_download_item_t *items = download->head;
+	int finished = download->finished;
+	download->head = NULL;
+	download->tail = NULL;
+	dc_mutex_unlock (download->mutex);
+
+	for (dc_download_item_t *item = items; item; item = item->next) {
+		if (item->event == 0) {
+			if (dive && !dc_atomic_load (&download->cancelled)) {
+				const unsigned char *fingerprint = item->buffer + item->size;
+				if (!dive (item->buffer, item->size, fingerprint, item->fsize, userdata))
+					dc_atomic_store (&download->cancelled, 1);
+			}
+		} else if (event) {
+			if (item->event == DC_EVENT_VENDOR) {
+				item->data.vendor.data = item->buffer;
+				item->data.vendor.size = item->size;
+			}
+			event (download->device, item->event, &item->data, userdata);
+		}
+	}
+
+	dc_download_free_items (items);
+
+	return finished ? DC_STATUS_DONE : DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_download_cancel (dc_download_t *download)
+{
+	if (download == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_atomic_store (&download->cancelled, 1);
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_download_close (dc_download_t *download)
+{
+	if (download == NULL)
+		return DC_STATUS_SUCCESS;
+
+	// Stop a download that is still in progress.
+	dc_atomic_store (&download->cancelled, 1);
+	dc_thread_join (download->thread);
+
+	dc_status_t status = download->status;
+
+	dc_device_set_events (download->device, 0, NULL, NULL);
+	dc_device_set_cancel (download->device, NULL, NULL);
+
+	dc_download_free_items (download->head);
+#ifndef _WIN32
+	close (download->fds[0]);
+	close (download->fds[1]);
+#endif
+	dc_mutex_free (download->mutex);
+	free (download);
+
+	return status;
+}
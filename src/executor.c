@@ -0,0 +1,379 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+
+#include "executor.h"
+#include "thread.h"
+
+typedef struct dc_executor_group_t {
+	dc_executor_t *executor;
+	void (*func) (void *userdata);
+	void *userdata;
+	// Protected by the mutex of the executor.
+	unsigned int refcount;
+	unsigned int running;
+	int closed;
+} dc_executor_group_t;
+
+typedef struct dc_executor_task_t {
+	struct dc_executor_task_t *next;
+	dc_executor_group_t *group;
+} dc_executor_task_t;
+
+struct dc_executor_t {
+	dc_mutex_t *mutex;
+	dc_cond_t *work; /* A task is queued, or the threads have to stop. */
+	dc_cond_t *done; /* A helper has returned, or a group is released. */
+	// Protected by the mutex.
+	unsigned int nthreads;
+	unsigned int nstarted;
+	dc_thread_t **threads;
+	int stop;
+	unsigned int ngroups;
+	dc_executor_task_t *head, *tail;
+	dc_submitfunc_t submit;
+	void *userdata;
+};
+
+dc_status_t
+dc_executor_new (dc_executor_t **out, unsigned int nthreads)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_executor_t *executor = NULL;
+
+	if (out == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	// Allocate memory.
+	executor = (dc_executor_t *) malloc (sizeof (dc_executor_t));
+	if (executor == NULL)
+		return DC_STATUS_NOMEMORY;
+
+	executor->mutex = NULL;
+	executor->work = NULL;
+	executor->done = NULL;
+	executor->nthreads = nthreads;
+	executor->nstarted = 0;
+	executor->threads = NULL;
+	executor->stop = 0;
+	executor->ngroups = 0;
+	executor->head = NULL;
+	executor->tail = NULL;
+	executor->submit = NULL;
+	executor->userdata = NULL;
+
+	status = dc_mutex_new (&executor->mutex);
+	if (status != DC_STATUS_SUCCESS)
+		goto error_free;
+
+	status = dc_cond_new (&executor->work);
+	if (status != DC_STATUS_SUCCESS)
+		goto error_free;
+
+	status = dc_cond_new (&executor->done);
+	if (status != DC_STATUS_SUCCESS)
+		goto error_free;
+
+	*out = executor;
+
+	return DC_STATUS_SUCCESS;
+
+error_free:
+	dc_cond_free (executor->work);
+	dc_mutex_free (executor->mutex);
+	free (executor);
+	return status;
+}
+
+static void
+dc_executor_stop (dc_executor_t *executor)
+{
+	dc_mutex_lock (executor->mutex);
+	executor->stop = 1;
+	dc_cond_broadcast (executor->work);
+	unsigned int nstarted = executor->nstarted;
+	dc_thread_t **threads = executor->threads;
+	dc_mutex_unlock (executor->mutex);
+
+	// No new threads are started while the flag is set.
+	for (unsigned int i = 0; i < nstarted; ++i) {
+		dc_thread_join (threads[i]);
+	}
+
+	dc_mutex_lock (executor->mutex);
+	free (executor->threads);
+	executor->threads = NULL;
+	executor->nstarted = 0;
+	executor->stop = 0;
+	dc_mutex_unlock (executor->mutex);
+}
+
+void
+dc_executor_free (dc_executor_t *executor)
+{
+	if (executor == NULL)
+		return;
+
+	dc_executor_stop (executor);
+
+	// Tasks handed to the application hold on to the executor, until
+	// they have been run.
+	dc_mutex_lock (executor->mutex);
+	while (executor->ngroups)
+		dc_cond_wait (executor->done, executor->mutex);
+	dc_mutex_unlock (executor->mutex);
+
+	dc_cond_free (executor->done);
+	dc_cond_free (executor->work);
+	dc_mutex_free (executor->mutex);
+	free (executor);
+}
+
+void
+dc_executor_set_threads (dc_executor_t *executor, unsigned int nthreads)
+{
+	dc_executor_stop (executor);
+
+	dc_mutex_lock (executor->mutex);
+	executor->nthreads = nthreads;
+	dc_mutex_unlock (executor->mutex);
+}
+
+void
+dc_executor_set_submitfunc (dc_executor_t *executor, dc_submitfunc_t submit, void *userdata)
+{
+	dc_mutex_lock (executor->mutex);
+	executor->submit = submit;
+	executor->userdata = userdata;
+	dc_mutex_unlock (executor->mutex);
+}
+
+/*
+ * Release a reference to the group. Must be called with the mutex locked.
+ */
+static void
+dc_executor_group_release (dc_executor_group_t *group)
+{
+	dc_executor_t *executor = group->executor;
+
+	if (--group->refcount)
+		return;
+
+	free (group);
+	executor->ngroups--;
+	dc_cond_broadcast (executor->done);
+}
+
+static void
+dc_executor_helper (void *task)
+{
+	dc_executor_group_t *group = (dc_executor_group_t *) task;
+	dc_executor_t *executor = group->executor;
+
+	dc_mutex_lock (executor->mutex);
+	// Once the group is closed, all work has been taken already.
+	if (!group->closed) {
+		group->running++;
+		dc_mutex_unlock (executor->mutex);
+
+		group->func (group->userdata);
+
+		dc_mutex_lock (executor->mutex);
+		group->running--;
+		dc_cond_broadcast (executor->done);
+	}
+	dc_executor_group_release (group);
+	dc_mutex_unlock (executor->mutex);
+}
+
+static void
+dc_executor_worker (void *userdata)
+{
+	dc_executor_t *executor = (dc_executor_t *) userdata;
+
+	dc_mutex_lock (executor->mutex);
+	while (1) {
+		while (!executor->stop && executor->head == NULL)
+			dc_cond_wait (executor->work, executor->mutex);
+
+		if (executor->stop)
+			break;
+
+		dc_executor_task_t *task = executor->head;
+		executor->head = task->next;
+		if (executor->head == NULL)
+			executor->tail = NULL;
+		dc_mutex_unlock (executor->mutex);
+
+		dc_executor_group_t *group = task->group;
+		free (task);
+		dc_executor_helper (group);
+
+		dc_mutex_lock (executor->mutex);
+	}
+	dc_mutex_unlock (executor->mutex);
+}
+
+/*
+ * Start the threads of the pool, if that hasn't happened yet. Must be
+ * called with the mutex locked.
+ */
+static void
+dc_executor_start (dc_executor_t *executor)
+{
+	if (executor->stop || executor->nstarted || executor->nthreads == 0)
+		return;
+
+	executor->threads = (dc_thread_t **) malloc (executor->nthreads * sizeof (dc_thread_t *));
+	if (executor->threads == NULL)
+		return;
+
+	// If a thread can't be created, the pool simply has fewer threads.
+	while (executor->nstarted < executor->nthreads) {
+		if (dc_thread_new (&executor->threads[executor->nstarted], dc_executor_worker, executor) != DC_STATUS_SUCCESS)
+			break;
+		executor->nstarted++;
+	}
+}
+
+static void
+dc_executor_run_threads (void (*func) (void *userdata), void *userdata, unsigned int count)
+{
+	dc_thread_t **threads = (dc_thread_t **) malloc ((count - 1) * sizeof (dc_thread_t *));
+
+	// If a thread can't be created, the remaining work is simply shared
+	// by fewer threads.
+	unsigned int nthreads = 0;
+	while (threads && nthreads < count - 1) {
+		if (dc_thread_new (&threads[nthreads], func, userdata) != DC_STATUS_SUCCESS)
+			break;
+		nthreads++;
+	}
+
+	// The calling thread is a worker too.
+	func (userdata);
+
+	for (unsigned int i = 0; i < nthreads; ++i) {
+		dc_thread_join (threads[i]);
+	}
+
+	free (threads);
+}
+
+void
+dc_executor_run (dc_executor_t *executor, void (*func) (void *userdata), void *userdata, unsigned int count)
+{
+	if (count <= 1) {
+		func (userdata);
+		return;
+	}
+
+	if (executor == NULL) {
+		dc_executor_run_threads (func, userdata, count);
+		return;
+	}
+
+	dc_executor_group_t *group = (dc_executor_group_t *) malloc (sizeof (dc_executor_group_t));
+	if (group == NULL) {
+		func (userdata);
+		return;
+	}
+
+	group->executor = executor;
+	group->func = func;
+	group->userdata = userdata;
+	group->refcount = 1;
+	group->running = 0;
+	group->closed = 0;
+
+	dc_mutex_lock (executor->mutex);
+	executor->ngroups++;
+
+	unsigned int nhelpers = count - 1;
+	if (executor->submit) {
+		for (unsigned int i = 0; i < nhelpers; ++i) {
+			dc_submitfunc_t submit = executor->submit;
+			void *data = executor->userdata;
+
+			// The application may run the task immediately.
+			group->refcount++;
+			dc_mutex_unlock (executor->mutex);
+			dc_status_t rc = submit (dc_executor_helper, group, data);
+			dc_mutex_lock (executor->mutex);
+			if (rc != DC_STATUS_SUCCESS) {
+				group->refcount--;
+				break;
+			}
+		}
+	} else {
+		dc_executor_start (executor);
+		if (nhelpers > executor->nstarted)
+			nhelpers = executor->nstarted;
+
+		for (unsigned int i = 0; i < nhelpers; ++i) {
+			dc_executor_task_t *task = (dc_executor_task_t *) malloc (sizeof (dc_executor_task_t));
+			if (task == NULL)
+				break;
+
+			task->next = NULL;
+			task->group = group;
+			if (executor->tail)
+				executor->tail->next = task;
+			else
+				executor->head = task;
+			executor->tail = task;
+			group->refcount++;
+		}
+		dc_cond_broadcast (executor->work);
+	}
+	dc_mutex_unlock (executor->mutex);
+
+	// The calling thread is a worker too.
+	func (userdata);
+
+	dc_mutex_lock (executor->mutex);
+	group->closed = 1;
+
+	// Take back the helpers which haven't started yet, instead of
+	// waiting for a thread to become available.
+	dc_executor_task_t **link = &executor->head;
+	dc_executor_task_t *previous = NULL;
+	while (*link) {
+		dc_executor_task_t *task = *link;
+		if (task->group == group) {
+			*link = task->next;
+			free (task);
+			dc_executor_group_release (group);
+		} else {
+			previous = task;
+			link = &task->next;
+		}
+	}
+	executor->tail = previous;
+
+	// Wait for the helpers which are still busy.
+	while (group->running)
+		dc_cond_wait (executor->done, executor->mutex);
+
+	dc_executor_group_release (group);
+	dc_mutex_unlock (executor->mutex);
+}
@@ -0,0 +1,101 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_EXECUTOR_H
+#define DC_EXECUTOR_H
+
+#include <libdivecomputer/context.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/**
+ * Opaque object representing a thread pool.
+ */
+typedef struct dc_executor_t dc_executor_t;
+
+/**
+ * Create a new thread pool. The threads are only started when the pool
+ * is used for the first time.
+ *
+ * @param[out]  executor  A location to store the thread pool.
+ * @param[in]   nthreads  The number of threads.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_executor_new (dc_executor_t **executor, unsigned int nthreads);
+
+/**
+ * Stop the threads and free all resources. The pool must not be in use.
+ *
+ * @param[in]  executor  A valid thread pool.
+ */
+void
+dc_executor_free (dc_executor_t *executor);
+
+/**
+ * Change the number of threads. The current threads are stopped, after
+ * they have finished their current task. New threads are started again
+ * when the pool is used next.
+ *
+ * @param[in]  executor  A valid thread pool.
+ * @param[in]  nthreads  The number of threads.
+ */
+void
+dc_executor_set_threads (dc_executor_t *executor, unsigned int nthreads);
+
+/**
+ * Hand the tasks to an application provided thread pool, instead of the
+ * own threads. Pass NULL to use the own threads again.
+ *
+ * @param[in]  executor  A valid thread pool.
+ * @param[in]  submit    The function to schedule a task.
+ * @param[in]  userdata  The argument passed to the submit function.
+ */
+void
+dc_executor_set_submitfunc (dc_executor_t *executor, dc_submitfunc_t submit, void *userdata);
+
+/**
+ * Run the worker function in the calling thread, and in up to count - 1
+ * threads of the pool, and wait until all of them have returned.
+ *
+ * The workers are expected to take their work items from a shared queue,
+ * until the queue is empty. If the pool is busy, the calling thread does
+ * all the work itself: helpers which haven't started yet when the
+ * calling thread runs out of work are not run anymore. A worker may thus
+ * run nested work on the same pool without the risk of a deadlock.
+ *
+ * Without a pool (NULL), dedicated threads are started instead.
+ *
+ * @param[in]  executor  A thread pool, or NULL.
+ * @param[in]  func      The worker function.
+ * @param[in]  userdata  The argument passed to the worker function.
+ * @param[in]  count     The maximum number of workers.
+ */
+void
+dc_executor_run (dc_executor_t *executor, void (*func) (void *userdata), void *userdata, unsigned int count);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_EXECUTOR_H */
@@ -0,0 +1,86 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+
+#include <stdio.h>
+
+#include "file.h"
+#include "context-private.h"
+
+dc_status_t
+dc_file_read (dc_context_t *context, const char *filename, dc_buffer_t *buffer)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	FILE *fp = NULL;
+	long size = 0;
+
+	if (filename == NULL || buffer == NULL) {
+		ERROR (context, "Invalid arguments.");
+		return DC_STATUS_INVALIDARGS;
+	}
+
+	// Clear the buffer.
+	dc_buffer_clear (buffer);
+
+	// Open the file.
+	fp = fopen (filename, "rb");
+	if (fp == NULL) {
+		ERROR (context, "Failed to open the file.");
+		return DC_STATUS_IO;
+	}
+
+	// Pre-allocate the buffer, if the size of the file is known, so the
+	// contents can be read with a single allocation.
+	if (fseek (fp, 0, SEEK_END) == 0 && (size = ftell (fp)) > 0) {
+		if (!dc_buffer_reserve (buffer, size)) {
+			ERROR (context, "Insufficient buffer space available.");
+			status = DC_STATUS_NOMEMORY;
+			goto error_close;
+		}
+	}
+	rewind (fp);
+
+	// Read the entire file into the buffer.
+	size_t n = 0;
+	unsigned char block[4096];
+	while ((n = fread (block, 1, sizeof (block), fp)) > 0) {
+		if (!dc_buffer_append (buffer, block, n)) {
+			ERROR (context, "Insufficient buffer space available.");
+			status = DC_STATUS_NOMEMORY;
+			goto error_close;
+		}
+	}
+
+	if (ferror (fp)) {
+		ERROR (context, "Failed to read the file.");
+		status = DC_STATUS_IO;
+		goto error_close;
+	}
+
+	fclose (fp);
+
+	return DC_STATUS_SUCCESS;
+
+error_close:
+	dc_buffer_clear (buffer);
+	fclose (fp);
+	return status;
+}
@@ -0,0 +1,577 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#define DC_LOG_CATEGORY DC_LOGCATEGORY_TRANSPORT
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef _WIN32
+#define NOGDI
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/select.h>
+#endif
+#ifdef __linux__
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#endif
+
+#include <libdivecomputer/hotplug.h>
+
+#include "serial.h"
+#include "context-private.h"
+#include "thread.h"
+
+/* The interval (in milliseconds) to check for changes without uevents. */
+#define INTERVAL 1000
+
+/* The delay (in milliseconds) to collect a burst of uevents. */
+#define SETTLE 250
+
+typedef struct dc_hotplug_entry_t {
+	char name[256];
+	unsigned int vid;
+	unsigned int pid;
+} dc_hotplug_entry_t;
+
+typedef struct dc_hotplug_list_t {
+	dc_hotplug_entry_t *entries;
+	unsigned int count;
+	unsigned int capacity;
+} dc_hotplug_list_t;
+
+typedef struct dc_hotplug_item_t {
+	struct dc_hotplug_item_t *next;
+	dc_hotplug_event_t event;
+	dc_hotplug_entry_t entry;
+} dc_hotplug_item_t;
+
+struct dc_hotplug_t {
+	dc_context_t *context;
+	dc_thread_t *thread;
+	int stopped;
+	/* Protected by the mutex. */
+	dc_mutex_t *mutex;
+	dc_hotplug_list_t ports;
+	dc_hotplug_item_t *head, *tail;
+#ifndef _WIN32
+	int fds[2];
+	int wakeup[2];
+#endif
+#ifdef __linux__
+	int uevent;
+#endif
+};
+
+#ifdef __linux__
+/*
+ * Read a hexadecimal id from a sysfs attribute file.
+ */
+static unsigned int
+dc_hotplug_read_id (const char *dirname, const char *attribute)
+{
+	char filename[PATH_MAX];
+	int n = snprintf (filename, sizeof (filename), "%s/%s", dirname, attribute);
+	if (n < 0 || (size_t) n >= sizeof (filename))
+		return 0;
+
+	FILE *fp = fopen (filename, "r");
+	if (fp == NULL)
+		return 0;
+
+	unsigned int value = 0;
+	if (fscanf (fp, "%x", &value) != 1)
+		value = 0;
+
+	fclose (fp);
+
+	return value;
+}
+#endif
+
+/*
+ * Look up the USB ids of a serial port, by walking up from the tty to the
+ * USB device in sysfs.
+ */
+static void
+dc_hotplug_usb_ids (dc_hotplug_entry_t *entry)
+{
+	entry->vid = 0;
+	entry->pid = 0;
+
+#ifdef __linux__
+	const char *basename = strrchr (entry->name, '/');
+	basename = basename ? basename + 1 : entry->name;
+
+	char path[PATH_MAX];
+	int n = snprintf (path, sizeof (path), "/sys/class/tty/%s/device", basename);
+	if (n < 0 || (size_t) n >= sizeof (path))
+		return;
+
+	char dirname[PATH_MAX];
+	if (realpath (path, dirname) == NULL)
+		return;
+
+	// The interface and the device are a few levels up.
+	for (unsigned int i = 0; i < 4; ++i) {
+		unsigned int vid = dc_hotplug_read_id (dirname, "idVendor");
+		if (vid) {
+			entry->vid = vid;
+			entry->pid = dc_hotplug_read_id (dirname, "idProduct");
+			return;
+		}
+
+		char *separator = strrchr (dirname, '/');
+		if (separator == NULL || separator == dirname)
+			return;
+		*separator = 0;
+	}
+#endif
+}
+
+static dc_hotplug_entry_t *
+dc_hotplug_list_find (const dc_hotplug_list_t *list, const char *name)
+{
+	for (unsigned int i = 0; i < list->count; ++i) {
+		if (strcmp (list->entries[i].name, name) == 0)
+			return list->entries + i;
+	}
+
+	return NULL;
+}
+
+static void
+dc_hotplug_scan_cb (const char *name, void *userdata)
+{
+	dc_hotplug_list_t *list = (dc_hotplug_list_t *) userdata;
+
+	if (strlen (name) >= sizeof (list->entries[0].name))
+		return;
+
+	if (list->count == list->capacity) {
+		unsigned int capacity = list->capacity ? list->capacity * 2 : 16;
+		dc_hotplug_entry_t *entries = (dc_hotplug_entry_t *) realloc (list->entries, capacity * sizeof (dc_hotplug_entry_t));
+		if (entries == NULL)
+			return;
+		list->entries = entries;
+		list->capacity = capacity;
+	}
+
+	dc_hotplug_entry_t *entry = list->entries + list->count++;
+	strcpy (entry->name, name);
+	dc_hotplug_usb_ids (entry);
+}
+
+static void
+dc_hotplug_notify (dc_hotplug_t *hotplug)
+{
+#ifndef _WIN32
+	// A full pipe is already readable, so a failed write is harmless.
+	unsigned char c = 0;
+	ssize_t rc = write (hotplug->fds[1], &c, 1);
+	(void) rc;
+#else
+	(void) hotplug;
+#endif
+}
+
+static void
+dc_hotplug_free_items (dc_hotplug_item_t *item)
+{
+	while (item) {
+		dc_hotplug_item_t *next = item->next;
+		free (item);
+		item = next;
+	}
+}
+
+static void
+dc_hotplug_queue (dc_hotplug_t *hotplug, dc_hotplug_item_t **head, dc_hotplug_item_t **tail, dc_hotplug_event_t event, const dc_hotplug_entry_t *entry)
+{
+	dc_hotplug_item_t *item = (dc_hotplug_item_t *) malloc (sizeof (dc_hotplug_item_t));
+	if (item == NULL) {
+		ERROR (hotplug->context, "Failed to allocate memory.");
+		return;
+	}
+
+	item->next = NULL;
+	item->event = event;
+	item->entry = *entry;
+
+	if (*tail)
+		(*tail)->next = item;
+	else
+		*head = item;
+	*tail = item;
+}
+
+/*
+ * Scan the serial ports, and queue the differences with the cached list.
+ */
+static void
+dc_hotplug_rescan (dc_hotplug_t *hotplug)
+{
+	dc_hotplug_list_t list = {NULL, 0, 0};
+	dc_status_t rc = dc_serial_enumerate (dc_hotplug_scan_cb, &list);
+	if (rc != DC_STATUS_SUCCESS) {
+		ERROR (hotplug->context, "Failed to enumerate the serial ports.");
+		free (list.entries);
+		return;
+	}
+
+	dc_hotplug_item_t *head = NULL, *tail = NULL;
+
+	dc_mutex_lock (hotplug->mutex);
+	for (unsigned int i = 0; i < hotplug->ports.count; ++i) {
+		const dc_hotplug_entry_t *entry = hotplug->ports.entries + i;
+		if (dc_hotplug_list_find (&list, entry->name) == NULL)
+			dc_hotplug_queue (hotplug, &head, &tail, DC_HOTPLUG_REMOVED, entry);
+	}
+	for (unsigned int i = 0; i < list.count; ++i) {
+		const dc_hotplug_entry_t *entry = list.entries + i;
+		if (dc_hotplug_list_find (&hotplug->ports, entry->name) == NULL)
+			dc_hotplug_queue (hotplug, &head, &tail, DC_HOTPLUG_ADDED, entry);
+	}
+
+	free (hotplug->ports.entries);
+	hotplug->ports = list;
+
+	if (head) {
+		if (hotplug->tail)
+			hotplug->tail->next = head;
+		else
+			hotplug->head = head;
+		hotplug->tail = tail;
+	}
+	dc_mutex_unlock (hotplug->mutex);
+
+	if (head) {
+		dc_hotplug_notify (hotplug);
+	}
+}
+
+#ifdef __linux__
+/*
+ * Check whether a uevent message concerns a tty device.
+ */
+static int
+dc_hotplug_is_tty (const char *message, size_t size)
+{
+	size_t offset = 0;
+	while (offset < size) {
+		const char *line = message + offset;
+		size_t length = strnlen (line, size - offset);
+		if (length == 13 && memcmp (line, "SUBSYSTEM=tty", 13) == 0)
+			return 1;
+		offset += length + 1;
+	}
+
+	return 0;
+}
+#endif
+
+static void
+dc_hotplug_run (void *userdata)
+{
+	dc_hotplug_t *hotplug = (dc_hotplug_t *) userdata;
+
+#ifndef _WIN32
+	int pending = 0;
+	while (!dc_atomic_load (&hotplug->stopped)) {
+		fd_set fds;
+		FD_ZERO (&fds);
+		FD_SET (hotplug->wakeup[0], &fds);
+		int nfds = hotplug->wakeup[0];
+
+		int timeout = INTERVAL;
+#ifdef __linux__
+		if (hotplug->uevent >= 0) {
+			FD_SET (hotplug->uevent, &fds);
+			if (hotplug->uevent > nfds)
+				nfds = hotplug->uevent;
+			// Rescan only once the burst of uevents has settled.
+			timeout = pending ? SETTLE : -1;
+		}
+#endif
+
+		struct timeval tv;
+		tv.tv_sec  = (timeout / 1000);
+		tv.tv_usec = (timeout % 1000) * 1000;
+
+		int rc = select (nfds + 1, &fds, NULL, NULL, timeout < 0 ? NULL : &tv);
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			SYSERROR (hotplug->context, errno);
+			break;
+		} else if (rc == 0) {
+			dc_hotplug_rescan (hotplug);
+			pending = 0;
+			continue;
+		}
+
+		if (FD_ISSET (hotplug->wakeup[0], &fds))
+			break;
+
+#ifdef __linux__
+		if (hotplug->uevent >= 0 && FD_ISSET (hotplug->uevent, &fds)) {
+			char message[4096];
+			ssize_t n = recv (hotplug->uevent, message, sizeof (message), 0);
+			if (n > 0 && dc_hotplug_is_tty (message, n))
+				pending = 1;
+		}
+#endif
+	}
+#else
+	unsigned int elapsed = 0;
+	while (!dc_atomic_load (&hotplug->stopped)) {
+		Sleep (100);
+		elapsed += 100;
+		if (elapsed >= INTERVAL) {
+			dc_hotplug_rescan (hotplug);
+			elapsed = 0;
+		}
+	}
+#endif
+}
+
+dc_status_t
+dc_hotplug_start (dc_hotplug_t **out, dc_context_t *context)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_hotplug_t *hotplug = NULL;
+
+	if (out == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	hotplug = (dc_hotplug_t *) malloc (sizeof (dc_hotplug_t));
+	if (hotplug == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	hotplug->context = context;
+	hotplug->thread = NULL;
+	hotplug->stopped = 0;
+	hotplug->ports.entries = NULL;
+	hotplug->ports.count = 0;
+	hotplug->ports.capacity = 0;
+	hotplug->head = NULL;
+	hotplug->tail = NULL;
+
+	status = dc_mutex_new (&hotplug->mutex);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (context, "Failed to create the mutex.");
+		goto error_free;
+	}
+
+#ifndef _WIN32
+	// Create the notification pipe, and the pipe to stop the thread. Both
+	// ends are non-blocking, to be able to drain the pipe, and to never
+	// block the thread.
+	if (pipe (hotplug->fds) != 0) {
+		SYSERROR (context, errno);
+		status = DC_STATUS_IO;
+		goto error_mutex_free;
+	}
+
+	if (pipe (hotplug->wakeup) != 0) {
+		SYSERROR (context, errno);
+		status = DC_STATUS_IO;
+		goto error_pipe_close;
+	}
+
+	for (unsigned int i = 0; i < 2; ++i) {
+		int fds[] = {hotplug->fds[i], hotplug->wakeup[i]};
+		for (unsigned int j = 0; j < 2; ++j) {
+			int flags = fcntl (fds[j], F_GETFL);
+			fcntl (fds[j], F_SETFL, flags | O_NONBLOCK);
+			fcntl (fds[j], F_SETFD, FD_CLOEXEC);
+		}
+	}
+#endif
+
+#ifdef __linux__
+	// Subscribe to the kernel uevents. Without permission (e.g. in a
+	// container), fall back to checking regularly.
+	hotplug->uevent = socket (AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+	if (hotplug->uevent >= 0) {
+		struct sockaddr_nl addr;
+		memset (&addr, 0, sizeof (addr));
+		addr.nl_family = AF_NETLINK;
+		addr.nl_groups = 1;
+		if (bind (hotplug->uevent, (struct sockaddr *) &addr, sizeof (addr)) != 0) {
+			close (hotplug->uevent);
+			hotplug->uevent = -1;
+		}
+	}
+	if (hotplug->uevent < 0) {
+		INFO (context, "Kernel uevents not available, polling instead.");
+	}
+#endif
+
+	// Queue the ports that are present already.
+	dc_hotplug_rescan (hotplug);
+
+	status = dc_thread_new (&hotplug->thread, dc_hotplug_run, hotplug);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (context, "Failed to create the thread.");
+		goto error_close;
+	}
+
+	*out = hotplug;
+
+	return DC_STATUS_SUCCESS;
+
+error_close:
+	dc_hotplug_free_items (hotplug->head);
+	free (hotplug->ports.entries);
+#ifdef __linux__
+	if (hotplug->uevent >= 0)
+		close (hotplug->uevent);
+#endif
+#ifndef _WIN32
+	close (hotplug->wakeup[0]);
+	close (hotplug->wakeup[1]);
+error_pipe_close:
+	close (hotplug->fds[0]);
+	close (hotplug->fds[1]);
+error_mutex_free:
+#endif
+	dc_mutex_free (hotplug->mutex);
+error_free:
+	free (hotplug);
+	return status;
+}
+
+dc_status_t
+dc_hotplug_get_fd (dc_hotplug_t *hotplug, int *fd)
+{
+	if (hotplug == NULL || fd == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+#ifdef _WIN32
+	return DC_STATUS_UNSUPPORTED;
+#else
+	*fd = hotplug->fds[0];
+
+	return DC_STATUS_SUCCESS;
+#endif
+}
+
+dc_status_t
+dc_hotplug_dispatch (dc_hotplug_t *hotplug, dc_hotplug_callback_t callback, void *userdata)
+{
+	if (hotplug == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+#ifndef _WIN32
+	// Drain the notification pipe first, so a notification arriving
+	// after the queue has been taken keeps the pipe readable.
+	unsigned char buffer[64];
+	while (read (hotplug->fds[0], buffer, sizeof (buffer)) > 0);
+#endif
+
+	// Take all pending items at once, to keep the lock short.
+	dc_mutex_lock (hotplug->mutex);
+	dc_hotplug_item_t *items = hotplug->head;
+	hotplug->head = NULL;
+	hotplug->tail = NULL;
+	dc_mutex_unlock (hotplug->mutex);
+
+	for (dc_hotplug_item_t *item = items; item; item = item->next) {
+		if (callback) {
+			dc_hotplug_port_t port = {item->entry.name, item->entry.vid, item->entry.pid};
+			callback (item->event, &port, userdata);
+		}
+	}
+
+	dc_hotplug_free_items (items);
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_hotplug_foreach (dc_hotplug_t *hotplug, dc_hotplug_callback_t callback, void *userdata)
+{
+	if (hotplug == NULL || callback == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	// Take a copy, to not call the application with the lock held.
+	dc_mutex_lock (hotplug->mutex);
+	unsigned int count = hotplug->ports.count;
+	dc_hotplug_entry_t *entries = (dc_hotplug_entry_t *) malloc ((count ? count : 1) * sizeof (dc_hotplug_entry_t));
+	if (entries && count)
+		memcpy (entries, hotplug->ports.entries, count * sizeof (dc_hotplug_entry_t));
+	dc_mutex_unlock (hotplug->mutex);
+
+	if (entries == NULL) {
+		ERROR (hotplug->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	for (unsigned int i = 0; i < count; ++i) {
+		dc_hotplug_port_t port = {entries[i].name, entries[i].vid, entries[i].pid};
+		callback (DC_HOTPLUG_ADDED, &port, userdata);
+	}
+
+	free (entries);
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_hotplug_close (dc_hotplug_t *hotplug)
+{
+	if (hotplug == NULL)
+		return DC_STATUS_SUCCESS;
+
+	// Stop the thread.
+	dc_atomic_store (&hotplug->stopped, 1);
+#ifndef _WIN32
+	unsigned char c = 0;
+	ssize_t rc = write (hotplug->wakeup[1], &c, 1);
+	(void) rc;
+#endif
+	dc_thread_join (hotplug->thread);
+
+	dc_hotplug_free_items (hotplug->head);
+	free (hotplug->ports.entries);
+#ifdef __linux__
+	if (hotplug->uevent >= 0)
+		close (hotplug->uevent);
+#endif
+#ifndef _WIN32
+	close (hotplug->wakeup[0]);
+	close (hotplug->wakeup[1]);
+	close (hotplug->fds[0]);
+	close (hotplug->fds[1]);
+#endif
+	dc_mutex_free (hotplug->mutex);
+	free (hotplug);
+
+	return DC_STATUS_SUCCESS;
+}
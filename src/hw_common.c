@@ -0,0 +1,156 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2013 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <string.h> // memcmp
+
+#include "context-private.h"
+#include "hw_common.h"
+
+#define EXIT 0xFF
+
+dc_status_t
+hw_common_transfer (dc_device_t *abstract, dc_serial_t *port,
+	dc_event_progress_t *progress,
+	unsigned char cmd, unsigned int echo, unsigned char ready,
+	const unsigned char input[], unsigned int isize,
+	unsigned char output[], unsigned int osize,
+	unsigned int delay)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (device_is_cancelled (abstract))
+		return DC_STATUS_CANCELLED;
+
+	// Send the command.
+	unsigned char command[1] = {cmd};
+	status = dc_serial_write (port, command, sizeof (command), NULL);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (abstract->context, "Failed to send the command.");
+		return status;
+	}
+
+	if (echo) {
+		// Read the echo.
+		unsigned char answer[1] = {0};
+		status = dc_serial_read (port, answer, sizeof (answer), NULL);
+		if (status != DC_STATUS_SUCCESS) {
+			ERROR (abstract->context, "Failed to receive the echo.");
+			return status;
+		}
+
+		// Verify the echo.
+		if (memcmp (answer, command, sizeof (command)) != 0) {
+			if (answer[0] == ready) {
+				ERROR (abstract->context, "Unsupported command.");
+				return DC_STATUS_UNSUPPORTED;
+			} else {
+				ERROR (abstract->context, "Unexpected echo.");
+				return DC_STATUS_PROTOCOL;
+			}
+		}
+	}
+
+	if (input) {
+		// Send the input data packet.
+		unsigned int nbytes = 0;
+		while (nbytes < isize) {
+			// Set the minimum packet size.
+			unsigned int len = 64;
+
+			// Limit the packet size to the total size.
+			if (nbytes + len > isize)
+				len = isize - nbytes;
+
+			// Write the packet.
+			status = dc_serial_write (port, input + nbytes, len, NULL);
+			if (status != DC_STATUS_SUCCESS) {
+				ERROR (abstract->context, "Failed to send the data packet.");
+				return status;
+			}
+
+			// Update and emit a progress event.
+			if (progress) {
+				progress->current += len;
+				device_event_emit (abstract, DC_EVENT_PROGRESS, progress);
+			}
+
+			nbytes += len;
+		}
+	}
+
+	if (output) {
+		unsigned int nbytes = 0;
+		while (nbytes < osize) {
+			// Set the minimum packet size.
+			unsigned int len = 1024;
+
+			// Increase the packet size if more data is immediately available.
+			size_t available = 0;
+			status = dc_serial_get_available (port, &available);
+			if (status == DC_STATUS_SUCCESS && available > len)
+				len = available;
+
+			// Limit the packet size to the total size.
+			if (nbytes + len > osize)
+				len = osize - nbytes;
+
+			// Read the packet.
+			status = dc_serial_read (port, output + nbytes, len, NULL);
+			if (status != DC_STATUS_SUCCESS) {
+				ERROR (abstract->context, "Failed to receive the answer.");
+				return status;
+			}
+
+			// Update and emit a progress event.
+			if (progress) {
+				progress->current += len;
+				device_event_emit (abstract, DC_EVENT_PROGRESS, progress);
+			}
+
+			nbytes += len;
+		}
+	}
+
+	if (delay) {
+		// Wait until the device starts sending the ready byte. A
+		// timeout is not an error, because the read below still uses
+		// the regular timeout.
+		dc_serial_poll (port, delay);
+	}
+
+	if (cmd != EXIT) {
+		// Read the ready byte.
+		unsigned char answer[1] = {0};
+		status = dc_serial_read (port, answer, sizeof (answer), NULL);
+		if (status != DC_STATUS_SUCCESS) {
+			ERROR (abstract->context, "Failed to receive the ready byte.");
+			return status;
+		}
+
+		// Verify the ready byte.
+		if (answer[0] != ready) {
+			ERROR (abstract->context, "Unexpected ready byte.");
+			return DC_STATUS_PROTOCOL;
+		}
+	}
+
+	return DC_STATUS_SUCCESS;
+}
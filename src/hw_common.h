@@ -0,0 +1,50 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2013 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef HW_COMMON_H
+#define HW_COMMON_H
+
+#include "device-private.h"
+#include "serial.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Execute a command of the protocol shared by the heinrichs weikamp
+ * devices: send the command byte, verify the echo (if enabled), send and
+ * receive the optional data packets, and verify the ready byte (except
+ * for the exit command). A command which is answered with the ready byte
+ * instead of the echo is not supported by the firmware.
+ */
+dc_status_t
+hw_common_transfer (dc_device_t *device, dc_serial_t *port,
+	dc_event_progress_t *progress,
+	unsigned char cmd, unsigned int echo, unsigned char ready,
+	const unsigned char input[], unsigned int isize,
+	unsigned char output[], unsigned int osize,
+	unsigned int delay);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* HW_COMMON_H */
@@ -27,6 +27,7 @@
 #include "context-private.h"
 #include "device-private.h"
 #include "serial.h"
+#include "hw_common.h"
 #include "checksum.h"
 #include "ringbuffer.h"
 #include "array.h"
@@ -105,95 +106,11 @@ hw_frog_transfer (hw_frog_device_t *device,
                   unsigned char output[],
                   unsigned int osize)
 {
-	dc_status_t status = DC_STATUS_SUCCESS;
-	dc_device_t *abstract = (dc_device_t *) device;
-
-	if (device_is_cancelled (abstract))
-		return DC_STATUS_CANCELLED;
-
-	// Send the command.
-	unsigned char command[1] = {cmd};
-	status = dc_serial_write (device->port, command, sizeof (command), NULL);
-	if (status != DC_STATUS_SUCCESS) {
-		ERROR (abstract->context, "Failed to send the command.");
-		return status;
-	}
+	// The init and header commands are not echoed.
+	unsigned int echo = (cmd != INIT && cmd != HEADER);
 
-	if (cmd != INIT && cmd != HEADER) {
-		// Read the echo.
-		unsigned char answer[1] = {0};
-		status = dc_serial_read (device->port, answer, sizeof (answer), NULL);
-		if (status != DC_STATUS_SUCCESS) {
-			ERROR (abstract->context, "Failed to receive the echo.");
-			return status;
-		}
-
-		// Verify the echo.
-		if (memcmp (answer, command, sizeof (command)) != 0) {
-			ERROR (abstract->context, "Unexpected echo.");
-			return DC_STATUS_PROTOCOL;
-		}
-	}
-
-	if (input) {
-		// Send the input data packet.
-		status = dc_serial_write (device->port, input, isize, NULL);
-		if (status != DC_STATUS_SUCCESS) {
-			ERROR (abstract->context, "Failed to send the data packet.");
-			return status;
-		}
-	}
-
-	if (output) {
-		unsigned int nbytes = 0;
-		while (nbytes < osize) {
-			// Set the minimum packet size.
-			unsigned int len = 1024;
-
-			// Increase the packet size if more data is immediately available.
-			size_t available = 0;
-			status = dc_serial_get_available (device->port, &available);
-			if (status == DC_STATUS_SUCCESS && available > len)
-				len = available;
-
-			// Limit the packet size to the total size.
-			if (nbytes + len > osize)
-				len = osize - nbytes;
-
-			// Read the packet.
-			status = dc_serial_read (device->port, output + nbytes, len, NULL);
-			if (status != DC_STATUS_SUCCESS) {
-				ERROR (abstract->context, "Failed to receive the answer.");
-				return status;
-			}
-
-			// Update and emit a progress event.
-			if (progress) {
-				progress->current += len;
-				device_event_emit ((dc_device_t *) device, DC_EVENT_PROGRESS, progress);
-			}
-
-			nbytes += len;
-		}
-	}
-
-	if (cmd != EXIT) {
-		// Read the ready byte.
-		unsigned char answer[1] = {0};
-		status = dc_serial_read (device->port, answer, sizeof (answer), NULL);
-		if (status != sizeof (answer)) {
-			ERROR (abstract->context, "Failed to receive the ready byte.");
-			return status;
-		}
-
-		// Verify the ready byte.
-		if (answer[0] != READY) {
-			ERROR (abstract->context, "Unexpected ready byte.");
-			return DC_STATUS_PROTOCOL;
-		}
-	}
-
-	return DC_STATUS_SUCCESS;
+	return hw_common_transfer ((dc_device_t *) device, device->port, progress,
+		cmd, echo, READY, input, isize, output, osize, 0);
 }
 
 
@@ -224,6 +141,10 @@ hw_frog_device_open (dc_device_t **out, dc_context_t *context, const char *name)
 		goto error_free;
 	}
 
+	// Interrupt the blocking reads when the download is cancelled, and
+	// measure the time spent waiting for the I/O.
+	device_set_port ((dc_device_t *) device, device->port);
+
 	// Set the serial communication protocol (115200 8N1).
 	status = dc_serial_configure (device->port, 115200, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -423,7 +344,7 @@ hw_frog_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void
 	}
 
 	// Update and emit a progress event.
-	progress.maximum = (RB_LOGBOOK_SIZE * RB_LOGBOOK_COUNT) + size;
+	progress.maximum = (RB_LOGBOOK_SIZE * RB_LOGBOOK_COUNT) + size + ndives;
 	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 
 	// Finish immediately if there are no dives available.
@@ -63,10 +63,10 @@ typedef struct hw_ostc_device_t {
 	unsigned char fingerprint[5];
 } hw_ostc_device_t;
 
-typedef struct hw_ostc_firmware_t {
+struct hw_ostc_firmware_t {
 	unsigned char data[SZ_FIRMWARE];
 	unsigned char bitmap[SZ_FIRMWARE / SZ_BLOCK];
-} hw_ostc_firmware_t;
+};
 
 static dc_status_t hw_ostc_device_set_fingerprint (dc_device_t *abstract, const unsigned char data[], unsigned int size);
 static dc_status_t hw_ostc_device_dump (dc_device_t *abstract, dc_buffer_t *buffer);
@@ -146,6 +146,10 @@ hw_ostc_device_open (dc_device_t **out, dc_context_t *context, const char *name)
 		goto error_free;
 	}
 
+	// Interrupt the blocking reads when the download is cancelled, and
+	// measure the time spent waiting for the I/O.
+	device_set_port ((dc_device_t *) device, device->port);
+
 	// Set the serial communication protocol (115200 8N1).
 	status = dc_serial_configure (device->port, 115200, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -312,10 +316,15 @@ hw_ostc_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 static dc_status_t
 hw_ostc_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void *userdata)
 {
-	dc_buffer_t *buffer = dc_buffer_new (0);
+	// The protocol has no command to read part of the profile memory, and
+	// the most recent dive is only received at the very end of the stream.
+	// Thus the dives can only be extracted once the dump is complete.
+	dc_buffer_t *buffer = dc_buffer_new (SZ_HEADER + SZ_FW_NEW);
 	if (buffer == NULL)
 		return DC_STATUS_NOMEMORY;
 
+	device_phase (abstract, DC_PHASE_PROFILE);
+
 	dc_status_t rc = hw_ostc_device_dump (abstract, buffer);
 	if (rc != DC_STATUS_SUCCESS) {
 		dc_buffer_free (buffer);
@@ -497,42 +506,26 @@ hw_ostc_device_reset (dc_device_t *abstract)
 }
 
 
-dc_status_t
-hw_ostc_device_screenshot (dc_device_t *abstract, dc_buffer_t *buffer, hw_ostc_format_t format)
-{
-	dc_status_t status = DC_STATUS_SUCCESS;
-	hw_ostc_device_t *device = (hw_ostc_device_t *) abstract;
+typedef struct hw_ostc_screenshot_t {
+	unsigned char *image;
+	unsigned int bpp;
+} hw_ostc_screenshot_t;
 
-	if (!ISINSTANCE (abstract))
-		return DC_STATUS_INVALIDARGS;
+typedef struct hw_ostc_screenshot_delta_t {
+	unsigned char *frame;
+	unsigned int changed;
+	hw_ostc_column_callback_t callback;
+	void *userdata;
+} hw_ostc_screenshot_delta_t;
 
-	// Erase the current contents of the buffer.
-	if (!dc_buffer_clear (buffer)) {
-		ERROR (abstract->context, "Insufficient buffer space available.");
-		return DC_STATUS_NOMEMORY;
-	}
+static dc_status_t
+hw_ostc_screenshot_receive (hw_ostc_device_t *device, hw_ostc_format_t format, dc_buffer_t *buffer, hw_ostc_column_callback_t callback, void *userdata)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_device_t *abstract = (dc_device_t *) device;
 
 	// Bytes per pixel (RGB formats only).
-	unsigned int bpp = 0;
-
-	if (format == HW_OSTC_FORMAT_RAW) {
-		// The RAW format has a variable size, depending on the actual image
-		// content. Usually the total size is around 4K, which is used as an
-		// initial guess and expanded when necessary.
-		if (!dc_buffer_reserve (buffer, 4096)) {
-			ERROR (abstract->context, "Insufficient buffer space available.");
-			return DC_STATUS_NOMEMORY;
-		}
-	} else {
-		// The RGB formats have a fixed size, depending only on the dimensions
-		// and the number of bytes per pixel. The required amount of memory is
-		// allocated immediately.
-		bpp = (format == HW_OSTC_FORMAT_RGB16) ? 2 : 3;
-		if (!dc_buffer_resize (buffer, WIDTH * HEIGHT * bpp)) {
-			ERROR (abstract->context, "Insufficient buffer space available.");
-			return DC_STATUS_NOMEMORY;
-		}
-	}
+	unsigned int bpp = (format == HW_OSTC_FORMAT_RGB16) ? 2 : 3;
 
 	// Enable progress notifications.
 	dc_event_progress_t progress = EVENT_PROGRESS_INITIALIZER;
@@ -544,13 +537,10 @@ hw_ostc_device_screenshot (dc_device_t *abstract, dc_buffer_t *buffer, hw_ostc_f
 	if (rc != DC_STATUS_SUCCESS)
 		return rc;
 
-	// Cache the pointer to the image data (RGB formats only).
-	unsigned char *image = dc_buffer_get_data (buffer);
-
-	// The OSTC sends the image data in a column by column layout, which is
-	// converted on the fly to a more convenient row by row layout as used
-	// in the majority of image formats. This conversions requires knowledge
-	// of the pixel coordinates.
+	// The OSTC sends the image data in a column by column layout. Each
+	// column is decoded into a separate buffer, and passed to the callback
+	// as soon as it is complete.
+	unsigned char column[HEIGHT * 3] = {0};
 	unsigned int x = 0, y = 0;
 
 	unsigned int npixels = 0;
@@ -595,27 +585,27 @@ hw_ostc_device_screenshot (dc_device_t *abstract, dc_buffer_t *buffer, hw_ostc_f
 			// Append the raw data to the output buffer.
 			dc_buffer_append (buffer, raw, nbytes);
 		} else {
-			// Store the decompressed data in the output buffer.
+			// Store the decompressed data in the column buffer.
 			for (unsigned int i = 0; i < count; ++i) {
-				// Calculate the offset to the current pixel (row layout)
-				unsigned int offset = (y * WIDTH + x) * bpp;
+				unsigned int offset = y * bpp;
 
 				if (format == HW_OSTC_FORMAT_RGB16) {
-					image[offset + 0] = raw[1];
-					image[offset + 1] = raw[2];
+					column[offset + 0] = raw[1];
+					column[offset + 1] = raw[2];
 				} else {
 					unsigned int value = (raw[1] << 8) + raw[2];
 					unsigned char r = (value & 0xF800) >> 11;
 					unsigned char g = (value & 0x07E0) >> 5;
 					unsigned char b = (value & 0x001F);
-					image[offset + 0] = 255 * r / 31;
-					image[offset + 1] = 255 * g / 63;
-					image[offset + 2] = 255 * b / 31;
+					column[offset + 0] = 255 * r / 31;
+					column[offset + 1] = 255 * g / 63;
+					column[offset + 2] = 255 * b / 31;
 				}
 
 				// Move to the next pixel coordinate (column layout).
 				y++;
 				if (y == HEIGHT) {
+					callback (x, column, HEIGHT * bpp, userdata);
 					y = 0;
 					x++;
 				}
@@ -632,6 +622,104 @@ hw_ostc_device_screenshot (dc_device_t *abstract, dc_buffer_t *buffer, hw_ostc_f
 	return DC_STATUS_SUCCESS;
 }
 
+static void
+hw_ostc_screenshot_column (unsigned int column, const unsigned char data[], unsigned int size, void *userdata)
+{
+	hw_ostc_screenshot_t *screenshot = (hw_ostc_screenshot_t *) userdata;
+	unsigned int bpp = screenshot->bpp;
+
+	// Convert to the row by row layout, as used in the majority of image
+	// formats.
+	for (unsigned int y = 0; y < size / bpp; ++y) {
+		memcpy (screenshot->image + (y * WIDTH + column) * bpp, data + y * bpp, bpp);
+	}
+}
+
+static void
+hw_ostc_screenshot_delta (unsigned int column, const unsigned char data[], unsigned int size, void *userdata)
+{
+	hw_ostc_screenshot_delta_t *delta = (hw_ostc_screenshot_delta_t *) userdata;
+
+	if (delta->frame) {
+		unsigned char *previous = delta->frame + column * size;
+		if (!delta->changed && memcmp (previous, data, size) == 0)
+			return;
+
+		memcpy (previous, data, size);
+	}
+
+	delta->callback (column, data, size, delta->userdata);
+}
+
+dc_status_t
+hw_ostc_device_screenshot (dc_device_t *abstract, dc_buffer_t *buffer, hw_ostc_format_t format)
+{
+	hw_ostc_device_t *device = (hw_ostc_device_t *) abstract;
+
+	if (!ISINSTANCE (abstract))
+		return DC_STATUS_INVALIDARGS;
+
+	// Erase the current contents of the buffer.
+	if (!dc_buffer_clear (buffer)) {
+		ERROR (abstract->context, "Insufficient buffer space available.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	hw_ostc_screenshot_t screenshot = {NULL, 0};
+
+	if (format == HW_OSTC_FORMAT_RAW) {
+		// The RAW format has a variable size, depending on the actual image
+		// content. Usually the total size is around 4K, which is used as an
+		// initial guess and expanded when necessary.
+		if (!dc_buffer_reserve (buffer, 4096)) {
+			ERROR (abstract->context, "Insufficient buffer space available.");
+			return DC_STATUS_NOMEMORY;
+		}
+	} else {
+		// The RGB formats have a fixed size, depending only on the dimensions
+		// and the number of bytes per pixel. The required amount of memory is
+		// allocated immediately.
+		screenshot.bpp = (format == HW_OSTC_FORMAT_RGB16) ? 2 : 3;
+		if (!dc_buffer_resize (buffer, WIDTH * HEIGHT * screenshot.bpp)) {
+			ERROR (abstract->context, "Insufficient buffer space available.");
+			return DC_STATUS_NOMEMORY;
+		}
+		screenshot.image = dc_buffer_get_data (buffer);
+	}
+
+	return hw_ostc_screenshot_receive (device, format, buffer, hw_ostc_screenshot_column, &screenshot);
+}
+
+dc_status_t
+hw_ostc_device_screenshot_stream (dc_device_t *abstract, hw_ostc_format_t format, dc_buffer_t *frame, hw_ostc_column_callback_t callback, void *userdata)
+{
+	hw_ostc_device_t *device = (hw_ostc_device_t *) abstract;
+
+	if (!ISINSTANCE (abstract))
+		return DC_STATUS_INVALIDARGS;
+
+	if (format == HW_OSTC_FORMAT_RAW || callback == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	hw_ostc_screenshot_delta_t delta = {NULL, 0, callback, userdata};
+
+	if (frame) {
+		// A frame buffer with a different size does not contain a previous
+		// capture in this format, and all columns are reported.
+		unsigned int size = WIDTH * HEIGHT * ((format == HW_OSTC_FORMAT_RGB16) ? 2 : 3);
+		if (dc_buffer_get_size (frame) != size) {
+			if (!dc_buffer_resize (frame, size)) {
+				ERROR (abstract->context, "Insufficient buffer space available.");
+				return DC_STATUS_NOMEMORY;
+			}
+			delta.changed = 1;
+		}
+		delta.frame = dc_buffer_get_data (frame);
+	}
+
+	return hw_ostc_screenshot_receive (device, format, NULL, hw_ostc_screenshot_delta, &delta);
+}
+
 
 dc_status_t
 hw_ostc_extract_dives (dc_device_t *abstract, const unsigned char data[], unsigned int size, dc_dive_callback_t callback, void *userdata)
@@ -641,6 +729,9 @@ hw_ostc_extract_dives (dc_device_t *abstract, const unsigned char data[], unsign
 	if (abstract && !ISINSTANCE (abstract))
 		return DC_STATUS_INVALIDARGS;
 
+	if (size < SZ_HEADER)
+		return DC_STATUS_DATAFORMAT;
+
 	const unsigned char header[2] = {0xFA, 0xFA};
 	const unsigned char footer[2] = {0xFD, 0xFD};
 
@@ -691,55 +782,42 @@ hw_ostc_firmware_readfile (hw_ostc_firmware_t *firmware, dc_context_t *context,
 	memset (firmware->data, 0xFF, sizeof (firmware->data));
 	memset (firmware->bitmap, 0x00, sizeof (firmware->bitmap));
 
-	// Open the hex file.
-	dc_ihex_file_t *file = NULL;
-	rc = dc_ihex_file_open (&file, context, filename);
+	// Parse the hex file.
+	dc_ihex_image_t *image = NULL;
+	rc = dc_ihex_image_open (&image, context, filename);
 	if (rc != DC_STATUS_SUCCESS) {
-		ERROR (context, "Failed to open the hex file.");
+		ERROR (context, "Failed to read the hex file.");
 		return rc;
 	}
 
-	// Read the hex file.
-	unsigned int lba = 0;
-	dc_ihex_entry_t entry;
-	while ((rc = dc_ihex_file_read (file, &entry)) == DC_STATUS_SUCCESS) {
-		if (entry.type == 0) {
-			// Data record.
-			unsigned int address = (lba << 16) + entry.address;
-			if (address + entry.length > SZ_FIRMWARE) {
-				WARNING (context, "Ignoring out of range record (0x%08x,%u).", address, entry.length);
-				continue;
-			}
+	// Copy the data segments.
+	unsigned int count = dc_ihex_image_count (image);
+	for (unsigned int i = 0; i < count; ++i) {
+		dc_ihex_segment_t segment;
+		dc_ihex_image_get (image, i, &segment);
 
-			// Copy the record to the buffer.
-			memcpy (firmware->data + address, entry.data, entry.length);
+		if (segment.address >= SZ_FIRMWARE) {
+			WARNING (context, "Ignoring out of range segment (0x%08x,%u).", segment.address, segment.length);
+			continue;
+		}
 
-			// Mark the corresponding blocks in the bitmap.
-			unsigned int begin = address / SZ_BLOCK;
-			unsigned int end = (address + entry.length + SZ_BLOCK - 1) / SZ_BLOCK;
-			for (unsigned int i = begin; i < end; ++i) {
-				firmware->bitmap[i] = 1;
-			}
-		} else if (entry.type == 1) {
-			// End of file record.
-			break;
-		} else if (entry.type == 4) {
-			// Extended linear address record.
-			lba = array_uint16_be (entry.data);
-		} else {
-			ERROR (context, "Unexpected record type.");
-			dc_ihex_file_close (file);
-			return DC_STATUS_DATAFORMAT;
+		if (segment.length > SZ_FIRMWARE - segment.address) {
+			WARNING (context, "Ignoring out of range data (0x%08x,%u).", SZ_FIRMWARE, segment.address + segment.length - SZ_FIRMWARE);
+			segment.length = SZ_FIRMWARE - segment.address;
+		}
+
+		// Copy the segment to the buffer.
+		memcpy (firmware->data + segment.address, segment.data, segment.length);
+
+		// Mark the corresponding blocks in the bitmap.
+		unsigned int begin = segment.address / SZ_BLOCK;
+		unsigned int end = (segment.address + segment.length + SZ_BLOCK - 1) / SZ_BLOCK;
+		for (unsigned int j = begin; j < end; ++j) {
+			firmware->bitmap[j] = 1;
 		}
-	}
-	if (rc != DC_STATUS_SUCCESS && rc != DC_STATUS_DONE) {
-		ERROR (context, "Failed to read the record.");
-		dc_ihex_file_close (file);
-		return rc;
 	}
 
-	// Close the file.
-	dc_ihex_file_close (file);
+	dc_ihex_image_free (image);
 
 	// Verify the presence of the first block.
 	if (firmware->bitmap[0] == 0) {
@@ -766,6 +844,46 @@ hw_ostc_firmware_readfile (hw_ostc_firmware_t *firmware, dc_context_t *context,
 }
 
 
+dc_status_t
+hw_ostc_firmware_load (hw_ostc_firmware_t **out, dc_context_t *context, const char *filename)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+
+	if (out == NULL || filename == NULL) {
+		ERROR (context, "Invalid arguments.");
+		return DC_STATUS_INVALIDARGS;
+	}
+
+	// Allocate memory for the firmware data.
+	hw_ostc_firmware_t *firmware = (hw_ostc_firmware_t *) malloc (sizeof (hw_ostc_firmware_t));
+	if (firmware == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	// Read the hex file.
+	rc = hw_ostc_firmware_readfile (firmware, context, filename);
+	if (rc != DC_STATUS_SUCCESS) {
+		ERROR (context, "Failed to read the firmware file.");
+		free (firmware);
+		return rc;
+	}
+
+	*out = firmware;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+dc_status_t
+hw_ostc_firmware_free (hw_ostc_firmware_t *firmware)
+{
+	free (firmware);
+
+	return DC_STATUS_SUCCESS;
+}
+
+
 static dc_status_t
 hw_ostc_firmware_setup_internal (hw_ostc_device_t *device)
 {
@@ -877,30 +995,14 @@ hw_ostc_firmware_write (hw_ostc_device_t *device, unsigned char *data, unsigned
  * paperweight. You have been warned!
  */
 dc_status_t
-hw_ostc_device_fwupdate (dc_device_t *abstract, const char *filename)
+hw_ostc_device_fwupdate_image (dc_device_t *abstract, const hw_ostc_firmware_t *firmware)
 {
 	dc_status_t rc = DC_STATUS_SUCCESS;
 	hw_ostc_device_t *device = (hw_ostc_device_t *) abstract;
-	dc_context_t *context = (abstract ? abstract->context : NULL);
 
-	if (!ISINSTANCE (abstract))
+	if (!ISINSTANCE (abstract) || firmware == NULL)
 		return DC_STATUS_INVALIDARGS;
 
-	// Allocate memory for the firmware data.
-	hw_ostc_firmware_t *firmware = (hw_ostc_firmware_t *) malloc (sizeof (hw_ostc_firmware_t));
-	if (firmware == NULL) {
-		ERROR (context, "Failed to allocate memory.");
-		return DC_STATUS_NOMEMORY;
-	}
-
-	// Read the hex file.
-	rc = hw_ostc_firmware_readfile (firmware, context, filename);
-	if (rc != DC_STATUS_SUCCESS) {
-		ERROR (context, "Failed to read the firmware file.");
-		free (firmware);
-		return rc;
-	}
-
 	// Temporary set a relative short timeout. The command to setup the
 	// bootloader needs to be send repeatedly, until the response packet is
 	// received. Thus the time between each two attempts is directly controlled
@@ -914,7 +1016,6 @@ hw_ostc_device_fwupdate (dc_device_t *abstract, const char *filename)
 		rc = dc_serial_configure (device->port, baudrates[i], 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 		if (rc != DC_STATUS_SUCCESS) {
 			ERROR (abstract->context, "Failed to set the terminal attributes.");
-			free (firmware);
 			return rc;
 		}
 
@@ -926,7 +1027,6 @@ hw_ostc_device_fwupdate (dc_device_t *abstract, const char *filename)
 	}
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR (abstract->context, "Failed to setup the bootloader.");
-		free (firmware);
 		return rc;
 	}
 
@@ -958,7 +1058,6 @@ hw_ostc_device_fwupdate (dc_device_t *abstract, const char *filename)
 		rc = hw_ostc_firmware_write (device, packet, sizeof (packet));
 		if (rc != DC_STATUS_SUCCESS) {
 			ERROR (abstract->context, "Failed to send the packet.");
-			free (firmware);
 			return rc;
 		}
 
@@ -967,7 +1066,26 @@ hw_ostc_device_fwupdate (dc_device_t *abstract, const char *filename)
 		device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 	}
 
-	free (firmware);
-
 	return DC_STATUS_SUCCESS;
 }
+
+
+dc_status_t
+hw_ostc_device_fwupdate (dc_device_t *abstract, const char *filename)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+	hw_ostc_firmware_t *firmware = NULL;
+
+	if (!ISINSTANCE (abstract))
+		return DC_STATUS_INVALIDARGS;
+
+	rc = hw_ostc_firmware_load (&firmware, abstract->context, filename);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	rc = hw_ostc_device_fwupdate_image (abstract, firmware);
+
+	hw_ostc_firmware_free (firmware);
+
+	return rc;
+}
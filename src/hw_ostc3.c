@@ -22,16 +22,19 @@
  */
 
 #include <string.h> // memcmp, memcpy
-#include <stdlib.h> // malloc, free
-#include <stdio.h>  // FILE, fopen
+#include <stdlib.h> // malloc, realloc, free
+#include <stdio.h>  // snprintf
 
 #include <libdivecomputer/hw_ostc3.h>
 
 #include "context-private.h"
 #include "device-private.h"
 #include "serial.h"
+#include "hw_common.h"
 #include "array.h"
 #include "aes.h"
+#include "file.h"
+#include "syncstore-private.h"
 
 #ifdef _MSC_VER
 #define snprintf _snprintf
@@ -87,6 +90,9 @@
 
 #define NODELAY 0
 
+// The maximum number of config commands sent ahead of their answers.
+#define CONFIG_WINDOW 8
+
 typedef enum hw_ostc3_state_t {
 	OPEN,
 	DOWNLOAD,
@@ -102,6 +108,7 @@ typedef struct hw_ostc3_device_t {
 	unsigned int model;
 	unsigned char fingerprint[5];
 	hw_ostc3_state_t state;
+	unsigned int window;
 } hw_ostc3_device_t;
 
 typedef struct hw_ostc3_logbook_t {
@@ -111,10 +118,11 @@ typedef struct hw_ostc3_logbook_t {
 	unsigned int number;
 } hw_ostc3_logbook_t;
 
-typedef struct hw_ostc3_firmware_t {
-	unsigned char data[SZ_FIRMWARE];
+struct hw_ostc3_firmware_t {
+	unsigned int hardware; // OSTC3 or OSTC4 format
 	unsigned int checksum;
-} hw_ostc3_firmware_t;
+	dc_buffer_t *buffer;
+};
 
 // This key is used both for the Ostc3 and its cousin,
 // the Ostc Sport.
@@ -187,132 +195,11 @@ hw_ostc3_transfer (hw_ostc3_device_t *device,
                   unsigned int osize,
                   unsigned int delay)
 {
-	dc_device_t *abstract = (dc_device_t *) device;
-	dc_status_t status = DC_STATUS_SUCCESS;
-
-	if (device_is_cancelled (abstract))
-		return DC_STATUS_CANCELLED;
-
 	// Get the correct ready byte for the current state.
 	const unsigned char ready = (device->state == SERVICE ? S_READY : READY);
 
-	// Send the command.
-	unsigned char command[1] = {cmd};
-	status = dc_serial_write (device->port, command, sizeof (command), NULL);
-	if (status != DC_STATUS_SUCCESS) {
-		ERROR (abstract->context, "Failed to send the command.");
-		return status;
-	}
-
-	// Read the echo.
-	unsigned char echo[1] = {0};
-	status = dc_serial_read (device->port, echo, sizeof (echo), NULL);
-	if (status != DC_STATUS_SUCCESS) {
-		ERROR (abstract->context, "Failed to receive the echo.");
-		return status;
-	}
-
-	// Verify the echo.
-	if (memcmp (echo, command, sizeof (command)) != 0) {
-		if (echo[0] == ready) {
-			ERROR (abstract->context, "Unsupported command.");
-			return DC_STATUS_UNSUPPORTED;
-		} else {
-			ERROR (abstract->context, "Unexpected echo.");
-			return DC_STATUS_PROTOCOL;
-		}
-	}
-
-	if (input) {
-		// Send the input data packet.
-		unsigned int nbytes = 0;
-		while (nbytes < isize) {
-			// Set the minimum packet size.
-			unsigned int len = 64;
-
-			// Limit the packet size to the total size.
-			if (nbytes + len > isize)
-				len = isize - nbytes;
-
-			// Write the packet.
-			status = dc_serial_write (device->port, input + nbytes, len, NULL);
-			if (status != DC_STATUS_SUCCESS) {
-				ERROR (abstract->context, "Failed to send the data packet.");
-				return status;
-			}
-
-			// Update and emit a progress event.
-			if (progress) {
-				progress->current += len;
-				device_event_emit ((dc_device_t *) device, DC_EVENT_PROGRESS, progress);
-			}
-
-			nbytes += len;
-		}
-	}
-
-	if (output) {
-		unsigned int nbytes = 0;
-		while (nbytes < osize) {
-			// Set the minimum packet size.
-			unsigned int len = 1024;
-
-			// Increase the packet size if more data is immediately available.
-			size_t available = 0;
-			status = dc_serial_get_available (device->port, &available);
-			if (status == DC_STATUS_SUCCESS && available > len)
-				len = available;
-
-			// Limit the packet size to the total size.
-			if (nbytes + len > osize)
-				len = osize - nbytes;
-
-			// Read the packet.
-			status = dc_serial_read (device->port, output + nbytes, len, NULL);
-			if (status != DC_STATUS_SUCCESS) {
-				ERROR (abstract->context, "Failed to receive the answer.");
-				return status;
-			}
-
-			// Update and emit a progress event.
-			if (progress) {
-				progress->current += len;
-				device_event_emit ((dc_device_t *) device, DC_EVENT_PROGRESS, progress);
-			}
-
-			nbytes += len;
-		}
-	}
-
-	if (delay) {
-		unsigned int count = delay / 100;
-		for (unsigned int i = 0; i < count; ++i) {
-			size_t available = 0;
-			status = dc_serial_get_available (device->port, &available);
-			if (status == DC_STATUS_SUCCESS && available > 0)
-				break;
-
-			dc_serial_sleep (device->port, 100);
-		}
-	}
-
-	if (cmd != EXIT) {
-		// Read the ready byte.
-		unsigned char answer[1] = {0};
-		status = dc_serial_read (device->port, answer, sizeof (answer), NULL);
-		if (status != DC_STATUS_SUCCESS) {
-			ERROR (abstract->context, "Failed to receive the ready byte.");
-			return status;
-		}
-
-		// Verify the ready byte.
-		if (answer[0] != ready) {
-			ERROR (abstract->context, "Unexpected ready byte.");
-			return DC_STATUS_PROTOCOL;
-		}
-	}
-
-	return DC_STATUS_SUCCESS;
+	return hw_common_transfer ((dc_device_t *) device, device->port, progress,
+		cmd, 1, ready, input, isize, output, osize, delay);
 }
 
 
@@ -338,6 +225,7 @@ hw_ostc3_device_open (dc_device_t **out, dc_context_t *context, const char *name
 	device->feature = 0;
 	device->model = 0;
 	memset (device->fingerprint, 0, sizeof (device->fingerprint));
+	device->window = CONFIG_WINDOW;
 
 	// Open the device.
 	status = dc_serial_open (&device->port, context, name);
@@ -346,6 +234,10 @@ hw_ostc3_device_open (dc_device_t **out, dc_context_t *context, const char *name
 		goto error_free;
 	}
 
+	// Interrupt the blocking reads when the download is cancelled, and
+	// measure the time spent waiting for the I/O.
+	device_set_port ((dc_device_t *) device, device->port);
+
 	// Set the serial communication protocol (115200 8N1).
 	status = dc_serial_configure (device->port, 115200, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -398,10 +290,15 @@ hw_ostc3_device_custom_open (dc_device_t **out, dc_context_t *context, dc_serial
 	// Set the default values.
 	device->hardware = INVALID;
 	memset (device->fingerprint, 0, sizeof (device->fingerprint));
+	device->window = CONFIG_WINDOW;
 
 	// Set the serial reference
 	device->port = port;
 
+	// Interrupt the blocking reads when the download is cancelled, and
+	// measure the time spent waiting for the I/O.
+	device_set_port ((dc_device_t *) device, device->port);
+
 	if (1) {
 //	if (port->type == DC_TRANSPORT_SERIAL) {
 		// Set the serial communication protocol (115200 8N1).
@@ -501,10 +398,8 @@ hw_ostc3_device_init_service (hw_ostc3_device_t *device)
 		return status;
 	}
 
-	// Give the device some time to enter service mode
-	dc_serial_sleep (device->port, 100);
-
-	// Read the response
+	// Read the response. The read waits until the device has entered
+	// service mode and starts answering, so no fixed delay is needed.
 	status = dc_serial_read (device->port, output, sizeof (output), NULL);
 	if (status != DC_STATUS_SUCCESS) {
 		ERROR (context, "Failed to receive the echo.");
@@ -666,6 +561,20 @@ hw_ostc3_device_hardware (dc_device_t *abstract, unsigned char data[], unsigned
 }
 
 
+static unsigned int
+hw_ostc3_logbook_length (const hw_ostc3_logbook_t *logbook, const unsigned char data[], unsigned int compact)
+{
+	unsigned int length = RB_LOGBOOK_SIZE_FULL + array_uint24_le (data + logbook->profile) - 3;
+	if (!compact) {
+		// Workaround for a bug in older firmware versions.
+		unsigned int firmware = array_uint16_be (data + 0x30);
+		if (firmware < 93)
+			length -= 3;
+	}
+
+	return length;
+}
+
 static dc_status_t
 hw_ostc3_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void *userdata)
 {
@@ -707,12 +616,16 @@ hw_ostc3_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, voi
 	}
 	device_event_emit (abstract, DC_EVENT_DEVINFO, &devinfo);
 
-	// Allocate memory.
-	unsigned char *header = (unsigned char *) malloc (RB_LOGBOOK_SIZE_FULL * RB_LOGBOOK_COUNT);
+	// Allocate memory for the compact logbook headers.
+	unsigned int headersize = RB_LOGBOOK_SIZE_COMPACT * RB_LOGBOOK_COUNT;
+	unsigned char *header = (unsigned char *) malloc (headersize);
 	if (header == NULL) {
 		ERROR (abstract->context, "Failed to allocate memory.");
 		return DC_STATUS_NOMEMORY;
 	}
+	device_memory_add (abstract, headersize);
+
+	device_phase (abstract, DC_PHASE_LOGBOOK);
 
 	// Download the compact logbook headers. If the firmware doesn't support
 	// compact headers yet, fallback to downloading the full logbook headers.
@@ -722,11 +635,25 @@ hw_ostc3_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, voi
               NULL, 0, header, RB_LOGBOOK_SIZE_COMPACT * RB_LOGBOOK_COUNT, NODELAY);
 	if (rc == DC_STATUS_UNSUPPORTED) {
 		compact = 0;
+
+		// Grow the buffer for the full logbook headers.
+		unsigned char *full = (unsigned char *) realloc (header, RB_LOGBOOK_SIZE_FULL * RB_LOGBOOK_COUNT);
+		if (full == NULL) {
+			ERROR (abstract->context, "Failed to allocate memory.");
+			device_memory_sub (abstract, headersize);
+			free (header);
+			return DC_STATUS_NOMEMORY;
+		}
+		header = full;
+		device_memory_add (abstract, RB_LOGBOOK_SIZE_FULL * RB_LOGBOOK_COUNT - headersize);
+		headersize = RB_LOGBOOK_SIZE_FULL * RB_LOGBOOK_COUNT;
+
 		rc = hw_ostc3_transfer (device, &progress, HEADER,
 		          NULL, 0, header, RB_LOGBOOK_SIZE_FULL * RB_LOGBOOK_COUNT, NODELAY);
 	}
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR (abstract->context, "Failed to read the header.");
+		device_memory_sub (abstract, headersize);
 		free (header);
 		return rc;
 	}
@@ -780,13 +707,7 @@ hw_ostc3_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, voi
 		}
 
 		// Calculate the profile length.
-		unsigned int length = RB_LOGBOOK_SIZE_FULL + array_uint24_le (header + offset + logbook->profile) - 3;
-		if (!compact) {
-			// Workaround for a bug in older firmware versions.
-			unsigned int firmware = array_uint16_be (header + offset + 0x30);
-			if (firmware < 93)
-				length -= 3;
-		}
+		unsigned int length = hw_ostc3_logbook_length (logbook, header + offset, compact);
 
 		// Check the fingerprint data.
 		if (memcmp (header + offset + logbook->fingerprint, device->fingerprint, sizeof (device->fingerprint)) == 0)
@@ -804,6 +725,7 @@ hw_ostc3_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, voi
 
 	// Finish immediately if there are no dives available.
 	if (ndives == 0) {
+		device_memory_sub (abstract, headersize);
 		free (header);
 		return DC_STATUS_SUCCESS;
 	}
@@ -812,9 +734,13 @@ hw_ostc3_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, voi
 	unsigned char *profile = (unsigned char *) malloc (maxsize);
 	if (profile == NULL) {
 		ERROR (abstract->context, "Failed to allocate memory.");
+		device_memory_sub (abstract, headersize);
 		free (header);
 		return DC_STATUS_NOMEMORY;
 	}
+	device_memory_add (abstract, maxsize);
+
+	device_phase (abstract, DC_PHASE_PROFILE);
 
 	// Download the dives.
 	for (unsigned int i = 0; i < ndives; ++i) {
@@ -822,12 +748,13 @@ hw_ostc3_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, voi
 		unsigned int offset = idx * logbook->size;
 
 		// Calculate the profile length.
-		unsigned int length = RB_LOGBOOK_SIZE_FULL + array_uint24_le (header + offset + logbook->profile) - 3;
-		if (!compact) {
-			// Workaround for a bug in older firmware versions.
-			unsigned int firmware = array_uint16_be (header + offset + 0x30);
-			if (firmware < 93)
-				length -= 3;
+		unsigned int length = hw_ostc3_logbook_length (logbook, header + offset, compact);
+
+		// Skip the dives that are already known.
+		if (device_fingerprint_known (abstract, header + offset + logbook->fingerprint, sizeof (device->fingerprint))) {
+			progress.current += length + 1;
+			device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
+			continue;
 		}
 
 		// Download the dive.
@@ -836,6 +763,7 @@ hw_ostc3_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, voi
 			number, sizeof (number), profile, length, NODELAY);
 		if (rc != DC_STATUS_SUCCESS) {
 			ERROR (abstract->context, "Failed to read the dive.");
+			device_memory_sub (abstract, headersize + maxsize);
 			free (profile);
 			free (header);
 			return rc;
@@ -844,6 +772,7 @@ hw_ostc3_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, voi
 		// Verify the header in the logbook and profile are identical.
 		if (!compact && memcmp (profile, header + offset, logbook->size) != 0) {
 			ERROR (abstract->context, "Unexpected profile header.");
+			device_memory_sub (abstract, headersize + maxsize);
 			free (profile);
 			free (header);
 			return rc;
@@ -853,6 +782,7 @@ hw_ostc3_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, voi
 			break;
 	}
 
+	device_memory_sub (abstract, headersize + maxsize);
 	free (profile);
 	free (header);
 
@@ -1017,6 +947,264 @@ hw_ostc3_device_config_reset (dc_device_t *abstract)
 	return DC_STATUS_SUCCESS;
 }
 
+static void
+hw_ostc3_hint_load (hw_ostc3_device_t *device)
+{
+	dc_device_t *abstract = (dc_device_t *) device;
+	unsigned int value = 0;
+
+	if (abstract->syncstore == NULL)
+		return;
+
+	dc_syncstore_get_hint (abstract->syncstore, DC_FAMILY_HW_OSTC3,
+		device->hardware, "configwindow", &value);
+	if (value >= 1 && value <= CONFIG_WINDOW)
+		device->window = value;
+}
+
+static void
+hw_ostc3_hint_save (hw_ostc3_device_t *device)
+{
+	dc_device_t *abstract = (dc_device_t *) device;
+
+	if (abstract->syncstore == NULL)
+		return;
+
+	if (dc_syncstore_set_hint (abstract->syncstore, DC_FAMILY_HW_OSTC3,
+		device->hardware, "configwindow", device->window) != DC_STATUS_SUCCESS) {
+		WARNING (abstract->context, "Failed to update the sync store.");
+	}
+}
+
+static dc_status_t
+hw_ostc3_device_config_check (hw_ostc3_device_t *device, const hw_ostc3_config_t configs[], unsigned int count)
+{
+	dc_device_t *abstract = (dc_device_t *) device;
+
+	for (unsigned int i = 0; i < count; ++i) {
+		unsigned int size = configs[i].size;
+		if (configs[i].config > 0xFF ||
+			(device->hardware == OSTC4 ? size != SZ_CONFIG : size > SZ_CONFIG)) {
+			ERROR (abstract->context, "Invalid parameter specified.");
+			return DC_STATUS_INVALIDARGS;
+		}
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+/*
+ * Read or write the config entries with a window of commands in flight.
+ * All commands of a window are sent in a single write, and the answers
+ * are verified in the same order. The number of acknowledged entries is
+ * returned, so a failed transfer can be resumed.
+ */
+static dc_status_t
+hw_ostc3_device_config_pipeline (hw_ostc3_device_t *device, unsigned char cmd, hw_ostc3_config_t configs[], unsigned int count, unsigned int *done)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_device_t *abstract = (dc_device_t *) device;
+	const unsigned char ready = (device->state == SERVICE ? S_READY : READY);
+
+	*done = 0;
+	while (*done < count) {
+		if (device_is_cancelled (abstract))
+			return DC_STATUS_CANCELLED;
+
+		unsigned int n = count - *done;
+		if (n > device->window)
+			n = device->window;
+
+		// Queue the commands of the window.
+		unsigned char packet[CONFIG_WINDOW * (SZ_CONFIG + 2)];
+		unsigned int length = 0;
+		for (unsigned int i = 0; i < n; ++i) {
+			const hw_ostc3_config_t *config = configs + *done + i;
+			packet[length++] = cmd;
+			packet[length++] = config->config;
+			if (cmd == WRITE) {
+				memcpy (packet + length, config->data, config->size);
+				length += config->size;
+			}
+		}
+
+		status = dc_serial_write (device->port, packet, length, NULL);
+		if (status != DC_STATUS_SUCCESS) {
+			ERROR (abstract->context, "Failed to send the command.");
+			return status;
+		}
+
+		// Receive the answers.
+		for (unsigned int i = 0; i < n; ++i) {
+			hw_ostc3_config_t *config = configs + *done;
+
+			unsigned char echo[1] = {0};
+			status = dc_serial_read (device->port, echo, sizeof (echo), NULL);
+			if (status != DC_STATUS_SUCCESS) {
+				ERROR (abstract->context, "Failed to receive the echo.");
+				return status;
+			}
+
+			if (echo[0] != cmd) {
+				ERROR (abstract->context, "Unexpected echo.");
+				return DC_STATUS_PROTOCOL;
+			}
+
+			if (cmd == READ && config->size) {
+				status = dc_serial_read (device->port, config->data, config->size, NULL);
+				if (status != DC_STATUS_SUCCESS) {
+					ERROR (abstract->context, "Failed to receive the answer.");
+					return status;
+				}
+			}
+
+			unsigned char answer[1] = {0};
+			status = dc_serial_read (device->port, answer, sizeof (answer), NULL);
+			if (status != DC_STATUS_SUCCESS) {
+				ERROR (abstract->context, "Failed to receive the ready byte.");
+				return status;
+			}
+
+			if (answer[0] != ready) {
+				ERROR (abstract->context, "Unexpected ready byte.");
+				return DC_STATUS_PROTOCOL;
+			}
+
+			(*done)++;
+		}
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+hw_ostc3_device_config_batch (hw_ostc3_device_t *device, unsigned char cmd, hw_ostc3_config_t configs[], unsigned int count)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+	dc_device_t *abstract = (dc_device_t *) device;
+	unsigned int done = 0;
+
+	hw_ostc3_hint_load (device);
+
+	if (device->window > 1) {
+		rc = hw_ostc3_device_config_pipeline (device, cmd, configs, count, &done);
+		if (rc != DC_STATUS_PROTOCOL && rc != DC_STATUS_TIMEOUT)
+			return rc;
+
+		// The firmware didn't keep up with the pipelined commands. Let the
+		// device settle, remember to not pipeline for this model again, and
+		// resume with one command at a time. Repeating a write that was
+		// already applied is harmless.
+		WARNING (abstract->context, "Pipelined config transfer failed, retrying one command at a time.");
+		dc_serial_sleep (device->port, 300);
+		dc_serial_purge (device->port, DC_DIRECTION_ALL);
+		device->window = 1;
+		hw_ostc3_hint_save (device);
+	}
+
+	for (unsigned int i = done; i < count; ++i) {
+		hw_ostc3_config_t *config = configs + i;
+		unsigned char command[SZ_CONFIG + 1] = {config->config};
+		if (cmd == WRITE) {
+			memcpy (command + 1, config->data, config->size);
+			rc = hw_ostc3_transfer (device, NULL, WRITE, command, config->size + 1, NULL, 0, NODELAY);
+		} else {
+			rc = hw_ostc3_transfer (device, NULL, READ, command, 1, config->data, config->size, NODELAY);
+		}
+		if (rc != DC_STATUS_SUCCESS)
+			return rc;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+hw_ostc3_device_config_snapshot (dc_device_t *abstract, hw_ostc3_config_t configs[], unsigned int count)
+{
+	hw_ostc3_device_t *device = (hw_ostc3_device_t *) abstract;
+
+	if (!ISINSTANCE (abstract) || (configs == NULL && count))
+		return DC_STATUS_INVALIDARGS;
+
+	dc_status_t rc = hw_ostc3_device_init (device, DOWNLOAD);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	rc = hw_ostc3_device_config_check (device, configs, count);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	return hw_ostc3_device_config_batch (device, READ, configs, count);
+}
+
+dc_status_t
+hw_ostc3_device_config_apply (dc_device_t *abstract, const hw_ostc3_config_t configs[], const hw_ostc3_config_t previous[], unsigned int count, unsigned int *written)
+{
+	hw_ostc3_device_t *device = (hw_ostc3_device_t *) abstract;
+	hw_ostc3_config_t *snapshot = NULL, *changes = NULL;
+	unsigned int n = 0;
+
+	if (written)
+		*written = 0;
+
+	if (!ISINSTANCE (abstract) || (configs == NULL && count))
+		return DC_STATUS_INVALIDARGS;
+
+	dc_status_t rc = hw_ostc3_device_init (device, DOWNLOAD);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	rc = hw_ostc3_device_config_check (device, configs, count);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	if (count == 0)
+		return DC_STATUS_SUCCESS;
+
+	snapshot = (hw_ostc3_config_t *) malloc (count * sizeof (hw_ostc3_config_t));
+	changes = (hw_ostc3_config_t *) malloc (count * sizeof (hw_ostc3_config_t));
+	if (snapshot == NULL || changes == NULL) {
+		ERROR (abstract->context, "Failed to allocate memory.");
+		rc = DC_STATUS_NOMEMORY;
+		goto error_free;
+	}
+
+	// Without the previous values, read the current ones first.
+	if (previous == NULL) {
+		memcpy (snapshot, configs, count * sizeof (hw_ostc3_config_t));
+		rc = hw_ostc3_device_config_batch (device, READ, snapshot, count);
+		if (rc != DC_STATUS_SUCCESS)
+			goto error_free;
+		previous = snapshot;
+	}
+
+	// Collect the changed entries, in their original order.
+	for (unsigned int i = 0; i < count; ++i) {
+		if (previous[i].config != configs[i].config) {
+			ERROR (abstract->context, "Invalid parameter specified.");
+			rc = DC_STATUS_INVALIDARGS;
+			goto error_free;
+		}
+
+		if (previous[i].size != configs[i].size ||
+			memcmp (previous[i].data, configs[i].data, configs[i].size) != 0) {
+			changes[n++] = configs[i];
+		}
+	}
+
+	rc = hw_ostc3_device_config_batch (device, WRITE, changes, n);
+	if (rc != DC_STATUS_SUCCESS)
+		goto error_free;
+
+	if (written)
+		*written = n;
+
+error_free:
+	free (changes);
+	free (snapshot);
+	return rc;
+}
+
 // This is a variant of fletcher16 with a 16 bit sum instead of an 8 bit sum,
 // and modulo 2^16 instead of 2^16-1
 static unsigned int
@@ -1032,45 +1220,49 @@ hw_ostc3_firmware_checksum (const unsigned char data[], unsigned int size)
 }
 
 static dc_status_t
-hw_ostc3_firmware_readline (FILE *fp, dc_context_t *context, unsigned int addr, unsigned char data[], unsigned int size)
+hw_ostc3_firmware_readline (dc_buffer_t *file, size_t *offset, dc_context_t *context, unsigned int addr, unsigned char data[], unsigned int size)
 {
-	unsigned char ascii[39];
+	const unsigned char *ascii = dc_buffer_get_data (file);
+	size_t length = dc_buffer_get_size (file);
+	size_t n = *offset;
 	unsigned char faddr_byte[3];
 	unsigned int faddr = 0;
-	int n = 0;
 
 	if (size > 16) {
 		ERROR (context, "Invalid arguments.");
 		return DC_STATUS_INVALIDARGS;
 	}
 
-	// Read the start code.
+	// Find the start code.
 	while (1) {
-		n = fread (ascii, 1, 1, fp);
-		if (n != 1) {
+		if (n >= length) {
 			ERROR (context, "Failed to read the start code.");
 			return DC_STATUS_IO;
 		}
 
-		if (ascii[0] == ':')
+		if (ascii[n] == ':')
 			break;
 
 		// Ignore CR and LF characters.
-		if (ascii[0] != '\n' && ascii[0] != '\r') {
-			ERROR (context, "Unexpected character (0x%02x).", ascii[0]);
+		if (ascii[n] != '\n' && ascii[n] != '\r') {
+			ERROR (context, "Unexpected character (0x%02x).", ascii[n]);
 			return DC_STATUS_DATAFORMAT;
 		}
+
+		n++;
 	}
 
-	// Read the payload.
-	n = fread (ascii + 1, 1, 6 + size * 2, fp);
-	if (n != 6 + size * 2) {
+	// Skip the start code.
+	n++;
+
+	// Get the payload.
+	if (length - n < 6 + size * 2) {
 		ERROR (context, "Failed to read the data.");
 		return DC_STATUS_IO;
 	}
 
 	// Convert the address to binary representation.
-	if (array_convert_hex2bin(ascii + 1, 6, faddr_byte, sizeof(faddr_byte)) != 0) {
+	if (array_convert_hex2bin(ascii + n, 6, faddr_byte, sizeof(faddr_byte)) != 0) {
 		ERROR (context, "Invalid hexadecimal character.");
 		return DC_STATUS_DATAFORMAT;
 	}
@@ -1083,80 +1275,66 @@ hw_ostc3_firmware_readline (FILE *fp, dc_context_t *context, unsigned int addr,
 	}
 
 	// Convert the payload to binary representation.
-	if (array_convert_hex2bin (ascii + 1 + 6, size * 2, data, size) != 0) {
+	if (array_convert_hex2bin (ascii + n + 6, size * 2, data, size) != 0) {
 		ERROR (context, "Invalid hexadecimal character.");
 		return DC_STATUS_DATAFORMAT;
 	}
 
+	*offset = n + 6 + size * 2;
+
 	return DC_STATUS_SUCCESS;
 }
 
 
 static dc_status_t
-hw_ostc3_firmware_readfile3 (hw_ostc3_firmware_t *firmware, dc_context_t *context, const char *filename)
+hw_ostc3_firmware_parse3 (hw_ostc3_firmware_t *firmware, dc_context_t *context, dc_buffer_t *file)
 {
 	dc_status_t rc = DC_STATUS_SUCCESS;
-	FILE *fp = NULL;
+	size_t offset = 0;
 	unsigned char iv[16] = {0};
-	unsigned char tmpbuf[16] = {0};
-	unsigned char encrypted[16] = {0};
 	unsigned int bytes = 0, addr = 0;
 	unsigned char checksum[4];
 
-	if (firmware == NULL) {
-		ERROR (context, "Invalid arguments.");
-		return DC_STATUS_INVALIDARGS;
+	// Initialize the buffers.
+	if (!dc_buffer_resize (firmware->buffer, SZ_FIRMWARE)) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
 	}
 
-	// Initialize the buffers.
-	memset (firmware->data, 0xFF, sizeof (firmware->data));
+	unsigned char *data = dc_buffer_get_data (firmware->buffer);
+	memset (data, 0xFF, SZ_FIRMWARE);
 	firmware->checksum = 0;
 
-	fp = fopen (filename, "rb");
-	if (fp == NULL) {
-		ERROR (context, "Failed to open the file.");
-		return DC_STATUS_IO;
-	}
-
-	rc = hw_ostc3_firmware_readline (fp, context, 0, iv, sizeof(iv));
+	rc = hw_ostc3_firmware_readline (file, &offset, context, 0, iv, sizeof(iv));
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR (context, "Failed to parse header.");
-		fclose (fp);
 		return rc;
 	}
 	bytes += 16;
 
-	// Load the iv for AES-FCB-mode
-	AES128_ECB_encrypt (iv, ostc3_key, tmpbuf);
-
+	// Read the encrypted data.
 	for (addr = 0; addr < SZ_FIRMWARE; addr += 16, bytes += 16) {
-		rc = hw_ostc3_firmware_readline (fp, context, bytes, encrypted, sizeof(encrypted));
+		rc = hw_ostc3_firmware_readline (file, &offset, context, bytes, data + addr, 16);
 		if (rc != DC_STATUS_SUCCESS) {
 			ERROR (context, "Failed to parse file data.");
-			fclose (fp);
 			return rc;
 		}
-
-		// Decrypt AES-FCB data
-		for (unsigned int i = 0; i < 16; i++)
-			firmware->data[addr + i] = encrypted[i] ^ tmpbuf[i];
-
-		// Run the next round of encryption
-		AES128_ECB_encrypt (encrypted, ostc3_key, tmpbuf);
 	}
 
+	// Decrypt the AES-FCB data in place, with the key expanded only once.
+	AES128_ctx aes;
+	AES128_init (&aes, ostc3_key);
+	AES128_CFB_decrypt_buffer (&aes, data, data, SZ_FIRMWARE, iv);
+
 	// This file format contains a tail with the checksum in
-	rc = hw_ostc3_firmware_readline (fp, context, bytes, checksum, sizeof(checksum));
+	rc = hw_ostc3_firmware_readline (file, &offset, context, bytes, checksum, sizeof(checksum));
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR (context, "Failed to parse file tail.");
-		fclose (fp);
 		return rc;
 	}
 
-	fclose (fp);
-
 	unsigned int csum1 = array_uint32_le (checksum);
-	unsigned int csum2 = hw_ostc3_firmware_checksum (firmware->data, sizeof(firmware->data));
+	unsigned int csum2 = hw_ostc3_firmware_checksum (data, SZ_FIRMWARE);
 	if (csum1 != csum2) {
 		ERROR (context, "Failed to verify file checksum.");
 		return DC_STATUS_DATAFORMAT;
@@ -1168,34 +1346,10 @@ hw_ostc3_firmware_readfile3 (hw_ostc3_firmware_t *firmware, dc_context_t *contex
 }
 
 static dc_status_t
-hw_ostc3_firmware_readfile4 (dc_buffer_t *buffer, dc_context_t *context, const char *filename)
+hw_ostc3_firmware_parse4 (hw_ostc3_firmware_t *firmware, dc_context_t *context, dc_buffer_t *file)
 {
-	FILE *fp = NULL;
-
-	if (buffer == NULL) {
-		ERROR (context, "Invalid arguments.");
-		return DC_STATUS_INVALIDARGS;
-	}
-
-	// Open the file.
-	fp = fopen (filename, "rb");
-	if (fp == NULL) {
-		ERROR (context, "Failed to open the file.");
-		return DC_STATUS_IO;
-	}
-
-	// Read the entire file into the buffer.
-	size_t n = 0;
-	unsigned char block[1024] = {0};
-	while ((n = fread (block, 1, sizeof (block), fp)) > 0) {
-		dc_buffer_append (buffer, block, n);
-	}
-
-	// Close the file.
-	fclose (fp);
-
 	// Verify the minimum size.
-	size_t size = dc_buffer_get_size (buffer);
+	size_t size = dc_buffer_get_size (file);
 	if (size < 4) {
 		ERROR (context, "Invalid file size.");
 		return DC_STATUS_DATAFORMAT;
@@ -1203,7 +1357,7 @@ hw_ostc3_firmware_readfile4 (dc_buffer_t *buffer, dc_context_t *context, const c
 	}
 
 	// Verify the checksum.
-	const unsigned char *data = dc_buffer_get_data (buffer);
+	const unsigned char *data = dc_buffer_get_data (file);
 	unsigned int csum1 = array_uint32_le (data + size - 4);
 	unsigned int csum2 = hw_ostc3_firmware_checksum (data, size - 4);
 	if (csum1 != csum2) {
@@ -1211,8 +1365,89 @@ hw_ostc3_firmware_readfile4 (dc_buffer_t *buffer, dc_context_t *context, const c
 		return DC_STATUS_DATAFORMAT;
 	}
 
-	// Remove the checksum.
-	dc_buffer_slice (buffer, 0, size - 4);
+	// The image is the file without the checksum.
+	if (!dc_buffer_append (firmware->buffer, data, size - 4)) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	firmware->checksum = csum1;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+hw_ostc3_firmware_load (hw_ostc3_firmware_t **out, dc_context_t *context, const char *filename)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+	hw_ostc3_firmware_t *firmware = NULL;
+	dc_buffer_t *file = NULL;
+
+	if (out == NULL || filename == NULL) {
+		ERROR (context, "Invalid arguments.");
+		return DC_STATUS_INVALIDARGS;
+	}
+
+	firmware = (hw_ostc3_firmware_t *) malloc (sizeof (hw_ostc3_firmware_t));
+	if (firmware == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	firmware->hardware = UNKNOWN;
+	firmware->checksum = 0;
+	firmware->buffer = dc_buffer_new (0);
+	file = dc_buffer_new (0);
+	if (firmware->buffer == NULL || file == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		rc = DC_STATUS_NOMEMORY;
+		goto error;
+	}
+
+	// Load the entire file, and parse it from memory.
+	rc = dc_file_read (context, filename, file);
+	if (rc != DC_STATUS_SUCCESS)
+		goto error;
+
+	// The OSTC3 files are in a text format, with every line starting with
+	// a colon. The OSTC4 files are binary, and start with the length of
+	// the first blob, which is always far below 0x3A000000.
+	const unsigned char *data = dc_buffer_get_data (file);
+	size_t size = dc_buffer_get_size (file);
+	size_t n = 0;
+	while (n < size && (data[n] == '\r' || data[n] == '\n'))
+		n++;
+
+	if (n < size && data[n] == ':') {
+		firmware->hardware = OSTC3;
+		rc = hw_ostc3_firmware_parse3 (firmware, context, file);
+	} else {
+		firmware->hardware = OSTC4;
+		rc = hw_ostc3_firmware_parse4 (firmware, context, file);
+	}
+	if (rc != DC_STATUS_SUCCESS)
+		goto error;
+
+	dc_buffer_free (file);
+
+	*out = firmware;
+
+	return DC_STATUS_SUCCESS;
+
+error:
+	dc_buffer_free (file);
+	hw_ostc3_firmware_free (firmware);
+	return rc;
+}
+
+dc_status_t
+hw_ostc3_firmware_free (hw_ostc3_firmware_t *firmware)
+{
+	if (firmware == NULL)
+		return DC_STATUS_SUCCESS;
+
+	dc_buffer_free (firmware->buffer);
+	free (firmware);
 
 	return DC_STATUS_SUCCESS;
 }
@@ -1286,98 +1521,90 @@ hw_ostc3_firmware_upgrade (dc_device_t *abstract, unsigned int checksum)
 
 
 static dc_status_t
-hw_ostc3_device_fwupdate3 (dc_device_t *abstract, const char *filename)
+hw_ostc3_device_fwupdate3 (dc_device_t *abstract, const hw_ostc3_firmware_t *firmware)
 {
 	dc_status_t rc = DC_STATUS_SUCCESS;
 	hw_ostc3_device_t *device = (hw_ostc3_device_t *) abstract;
 	dc_context_t *context = (abstract ? abstract->context : NULL);
 
 	// Enable progress notifications.
-	// load, erase, upload FZ, verify FZ, reprogram
+	// load, compare, upload FZ, verify FZ, reprogram
 	dc_event_progress_t progress = EVENT_PROGRESS_INITIALIZER;
 	progress.maximum = 3 + SZ_FIRMWARE * 2 / SZ_FIRMWARE_BLOCK;
 	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 
-	// Allocate memory for the firmware data.
-	hw_ostc3_firmware_t *firmware = (hw_ostc3_firmware_t *) malloc (sizeof (hw_ostc3_firmware_t));
-	if (firmware == NULL) {
-		ERROR (context, "Failed to allocate memory.");
-		return DC_STATUS_NOMEMORY;
-	}
-
-	// Read the hex file.
-	rc = hw_ostc3_firmware_readfile3 (firmware, context, filename);
-	if (rc != DC_STATUS_SUCCESS) {
-		free (firmware);
-		return rc;
-	}
+	// The image is only read, and may be shared with other devices.
+	unsigned char *data = dc_buffer_get_data (firmware->buffer);
 
 	// Device open and firmware loaded
 	progress.current++;
 	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 
-	hw_ostc3_device_display (abstract, " Erasing FW...");
-
-	rc = hw_ostc3_firmware_erase (device, FIRMWARE_AREA, SZ_FIRMWARE);
-	if (rc != DC_STATUS_SUCCESS) {
-		ERROR (context, "Failed to erase old firmware");
-		free (firmware);
-		return rc;
-	}
-
-	// Memory erased
-	progress.current++;
-	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
-
-	hw_ostc3_device_display (abstract, " Uploading...");
-
+	// The firmware is uploaded into a staging area first, which keeps its
+	// contents until the next upload. Blocks that already contain the
+	// right data, because the previous image was almost identical or an
+	// earlier update got interrupted, are left untouched. Only the other
+	// blocks are erased, written and verified.
+	unsigned int nwritten = 0;
 	for (unsigned int len = 0; len < SZ_FIRMWARE; len += SZ_FIRMWARE_BLOCK) {
+		unsigned char block[SZ_FIRMWARE_BLOCK];
 		char status[SZ_DISPLAY + 1]; // Status message on the display
 		snprintf (status, sizeof(status), " Uploading %2d%%", (100 * len) / SZ_FIRMWARE);
 		hw_ostc3_device_display (abstract, status);
 
-		rc = hw_ostc3_firmware_block_write (device, FIRMWARE_AREA + len, firmware->data + len, SZ_FIRMWARE_BLOCK);
+		rc = hw_ostc3_firmware_block_read (device, FIRMWARE_AREA + len, block, sizeof (block));
 		if (rc != DC_STATUS_SUCCESS) {
-			ERROR (context, "Failed to write block to device");
-			free(firmware);
+			ERROR (context, "Failed to read block.");
 			return rc;
 		}
-		// One block uploaded
+
+		// One block compared
 		progress.current++;
 		device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
-	}
 
-	hw_ostc3_device_display (abstract, " Verifying...");
+		if (memcmp (data + len, block, sizeof (block)) != 0) {
+			rc = hw_ostc3_firmware_erase (device, FIRMWARE_AREA + len, SZ_FIRMWARE_BLOCK);
+			if (rc != DC_STATUS_SUCCESS) {
+				ERROR (context, "Failed to erase old firmware");
+				return rc;
+			}
 
-	for (unsigned int len = 0; len < SZ_FIRMWARE; len += SZ_FIRMWARE_BLOCK) {
-		unsigned char block[SZ_FIRMWARE_BLOCK];
-		char status[SZ_DISPLAY + 1]; // Status message on the display
-		snprintf (status, sizeof(status), " Verifying %2d%%", (100 * len) / SZ_FIRMWARE);
-		hw_ostc3_device_display (abstract, status);
+			rc = hw_ostc3_firmware_block_write (device, FIRMWARE_AREA + len, data + len, SZ_FIRMWARE_BLOCK);
+			if (rc != DC_STATUS_SUCCESS) {
+				ERROR (context, "Failed to write block to device");
+				return rc;
+			}
 
-		rc = hw_ostc3_firmware_block_read (device, FIRMWARE_AREA + len, block, sizeof (block));
-		if (rc != DC_STATUS_SUCCESS) {
-			ERROR (context, "Failed to read block.");
-			free (firmware);
-			return rc;
-		}
-		if (memcmp (firmware->data + len, block, sizeof (block)) != 0) {
-			ERROR (context, "Failed verify.");
-			hw_ostc3_device_display (abstract, " Verify FAILED");
-			free (firmware);
-			return DC_STATUS_PROTOCOL;
+			rc = hw_ostc3_firmware_block_read (device, FIRMWARE_AREA + len, block, sizeof (block));
+			if (rc != DC_STATUS_SUCCESS) {
+				ERROR (context, "Failed to read block.");
+				return rc;
+			}
+			if (memcmp (data + len, block, sizeof (block)) != 0) {
+				ERROR (context, "Failed verify.");
+				hw_ostc3_device_display (abstract, " Verify FAILED");
+				return DC_STATUS_PROTOCOL;
+			}
+
+			nwritten++;
 		}
-		// One block verified
+
+		// One block uploaded and verified
 		progress.current++;
 		device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 	}
 
+	DEBUG (context, "Rewritten %u of %u firmware blocks.", nwritten, SZ_FIRMWARE / SZ_FIRMWARE_BLOCK);
+
+	// Staging area complete
+	progress.current++;
+	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
+
 	hw_ostc3_device_display (abstract, " Programming...");
 
 	rc = hw_ostc3_firmware_upgrade (abstract, firmware->checksum);
 	if (rc != DC_STATUS_SUCCESS) {
 		ERROR (context, "Failed to start programing");
-		free (firmware);
 		return rc;
 	}
 
@@ -1385,32 +1612,16 @@ hw_ostc3_device_fwupdate3 (dc_device_t *abstract, const char *filename)
 	progress.current++;
 	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 
-	free (firmware);
-
 	// Finished!
 	return DC_STATUS_SUCCESS;
 }
 
 static dc_status_t
-hw_ostc3_device_fwupdate4 (dc_device_t *abstract, const char *filename)
+hw_ostc3_device_fwupdate4 (dc_device_t *abstract, const hw_ostc3_firmware_t *firmware)
 {
 	dc_status_t status = DC_STATUS_SUCCESS;
 	hw_ostc3_device_t *device = (hw_ostc3_device_t *) abstract;
-	dc_context_t *context = (abstract ? abstract->context : NULL);
-
-	// Allocate memory for the firmware data.
-	dc_buffer_t *buffer = dc_buffer_new (0);
-	if (buffer == NULL) {
-		ERROR (context, "Failed to allocate memory.");
-		status = DC_STATUS_NOMEMORY;
-		goto error;
-	}
-
-	// Read the firmware file.
-	status = hw_ostc3_firmware_readfile4 (buffer, context, filename);
-	if (status != DC_STATUS_SUCCESS) {
-		goto error;
-	}
+	dc_buffer_t *buffer = firmware->buffer;
 
 	// Enable progress notifications.
 	dc_event_progress_t progress = EVENT_PROGRESS_INITIALIZER;
@@ -1426,8 +1637,7 @@ hw_ostc3_device_fwupdate4 (dc_device_t *abstract, const char *filename)
 		// Get the length of the firmware blob.
 		unsigned int length = array_uint32_be(data + offset) + 20;
 		if (offset + length > size) {
-			status = DC_STATUS_DATAFORMAT;
-			goto error;
+			return DC_STATUS_DATAFORMAT;
 		}
 
 		// Get the blob type.
@@ -1457,7 +1667,7 @@ hw_ostc3_device_fwupdate4 (dc_device_t *abstract, const char *filename)
 			data + offset + 4, 1, fwinfo, sizeof(fwinfo), NODELAY);
 		if (status != DC_STATUS_SUCCESS) {
 			ERROR (abstract->context, "Failed to read the firmware info.");
-			goto error;
+			return status;
 		}
 
 		// Upload the firmware blob.
@@ -1469,7 +1679,7 @@ hw_ostc3_device_fwupdate4 (dc_device_t *abstract, const char *filename)
 			status = hw_ostc3_transfer (device, &progress, S_UPLOAD,
 				data + offset, length, NULL, 0, usecs / 1000);
 			if (status != DC_STATUS_SUCCESS) {
-				goto error;
+				return status;
 			}
 		} else {
 			// Update and emit a progress event.
@@ -1480,18 +1690,16 @@ hw_ostc3_device_fwupdate4 (dc_device_t *abstract, const char *filename)
 		offset += length;
 	}
 
-error:
-	dc_buffer_free (buffer);
-	return status;
+	return DC_STATUS_SUCCESS;
 }
 
 dc_status_t
-hw_ostc3_device_fwupdate (dc_device_t *abstract, const char *filename)
+hw_ostc3_device_fwupdate_image (dc_device_t *abstract, const hw_ostc3_firmware_t *firmware)
 {
 	dc_status_t status = DC_STATUS_SUCCESS;
 	hw_ostc3_device_t *device = (hw_ostc3_device_t *) abstract;
 
-	if (!ISINSTANCE (abstract))
+	if (!ISINSTANCE (abstract) || firmware == NULL)
 		return DC_STATUS_INVALIDARGS;
 
 	// Make sure the device is in service mode.
@@ -1500,13 +1708,39 @@ hw_ostc3_device_fwupdate (dc_device_t *abstract, const char *filename)
 		return status;
 	}
 
+	// The OSTC4 has its own firmware format.
+	if ((device->hardware == OSTC4) != (firmware->hardware == OSTC4)) {
+		ERROR (abstract->context, "The firmware image doesn't match the device.");
+		return DC_STATUS_DATAFORMAT;
+	}
+
 	if (device->hardware == OSTC4) {
-		return hw_ostc3_device_fwupdate4 (abstract, filename);
+		return hw_ostc3_device_fwupdate4 (abstract, firmware);
 	} else {
-		return hw_ostc3_device_fwupdate3 (abstract, filename);
+		return hw_ostc3_device_fwupdate3 (abstract, firmware);
 	}
 }
 
+dc_status_t
+hw_ostc3_device_fwupdate (dc_device_t *abstract, const char *filename)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	hw_ostc3_firmware_t *firmware = NULL;
+
+	if (!ISINSTANCE (abstract))
+		return DC_STATUS_INVALIDARGS;
+
+	status = hw_ostc3_firmware_load (&firmware, abstract->context, filename);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	status = hw_ostc3_device_fwupdate_image (abstract, firmware);
+
+	hw_ostc3_firmware_free (firmware);
+
+	return status;
+}
+
 static dc_status_t
 hw_ostc3_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 {
@@ -19,9 +19,12 @@
  * MA 02110-1301 USA
  */
 
+#define DC_LOG_CATEGORY DC_LOGCATEGORY_PARSER
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <limits.h>
 
 #ifdef _MSC_VER
 #define snprintf _snprintf
@@ -37,6 +40,7 @@
 #define ISINSTANCE(parser) dc_parser_isinstance((parser), &hw_ostc_parser_vtable)
 
 #define MAXCONFIG 7
+#define MAXPERIOD 840
 #define NGASMIXES 15
 
 #define UNDEFINED 0xFF
@@ -120,6 +124,10 @@ static dc_status_t hw_ostc_parser_set_data (dc_parser_t *abstract, const unsigne
 static dc_status_t hw_ostc_parser_get_datetime (dc_parser_t *abstract, dc_datetime_t *datetime);
 static dc_status_t hw_ostc_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsigned int flags, void *value);
 static dc_status_t hw_ostc_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata);
+static dc_status_t hw_ostc_parser_samples_extract (dc_parser_t *abstract, dc_sample_columns_t *columns);
+static dc_status_t hw_ostc_parser_samples_range (dc_parser_t *abstract, unsigned int first, unsigned int count, dc_sample_callback_t callback, void *userdata);
+static dc_status_t hw_ostc_parser_samples_seek (dc_parser_t *abstract, unsigned int time, unsigned int *index);
+static dc_status_t hw_ostc_parser_samples_index (dc_parser_t *abstract, sample_index_t *index);
 
 static const dc_parser_vtable_t hw_ostc_parser_vtable = {
 	sizeof(hw_ostc_parser_t),
@@ -128,6 +136,14 @@ static const dc_parser_vtable_t hw_ostc_parser_vtable = {
 	hw_ostc_parser_get_datetime, /* datetime */
 	hw_ostc_parser_get_field, /* fields */
 	hw_ostc_parser_samples_foreach, /* samples_foreach */
+	hw_ostc_parser_samples_extract, /* samples_extract */
+	hw_ostc_parser_samples_range, /* samples_range */
+	hw_ostc_parser_samples_seek, /* samples_seek */
+	hw_ostc_parser_samples_index, /* samples_index */
+	NULL, /* samples_split */
+	NULL, /* samples_chunk */
+	NULL, /* subdives */
+	NULL, /* samples_vendor */
 	NULL /* destroy */
 };
 
@@ -448,8 +464,10 @@ hw_ostc_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsigned
 	if (rc != DC_STATUS_SUCCESS)
 		return rc;
 
-	// Cache the profile data.
-	if (parser->cached < PROFILE) {
+	// Cache the profile data. Only the gas mixes can be extended from
+	// the samples, so the other fields never need it.
+	if (parser->cached < PROFILE &&
+		(type == DC_FIELD_GASMIX_COUNT || type == DC_FIELD_GASMIX)) {
 		rc = hw_ostc_parser_samples_foreach (abstract, NULL, NULL);
 		if (rc != DC_STATUS_SUCCESS)
 			return rc;
@@ -615,8 +633,50 @@ hw_ostc_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsigned
 }
 
 
+static unsigned int
+hw_ostc_parser_samplerate (hw_ostc_parser_t *parser)
+{
+	const unsigned char *data = parser->base.data;
+
+	if (parser->version == 0x23 || parser->version == 0x24)
+		return data[parser->header + 3];
+	else
+		return data[36];
+}
+
 static dc_status_t
-hw_ostc_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata)
+hw_ostc_parser_restore (hw_ostc_parser_t *parser, const sample_index_t *index)
+{
+	dc_parser_t *abstract = (dc_parser_t *) parser;
+
+	if (parser->cached >= PROFILE)
+		return DC_STATUS_SUCCESS;
+
+	// Restore the manual gas mixes, in the order of the original pass.
+	if (index->nstate % 2) {
+		ERROR (abstract->context, "Invalid sample index state.");
+		return DC_STATUS_DATAFORMAT;
+	}
+	for (unsigned int i = 0; i < index->nstate; i += 2) {
+		unsigned int o2 = index->state[i + 0];
+		unsigned int he = index->state[i + 1];
+		unsigned int idx = hw_ostc_find_gasmix (parser, o2, he, MANUAL);
+		if (idx >= parser->ngasmixes) {
+			if (idx >= NGASMIXES) {
+				ERROR (abstract->context, "Maximum number of gas mixes reached.");
+				return DC_STATUS_DATAFORMAT;
+			}
+			parser->gasmix[idx].oxygen = o2;
+			parser->gasmix[idx].helium = he;
+			parser->ngasmixes = idx + 1;
+		}
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+hw_ostc_parser_samples_internal (dc_parser_t *abstract, unsigned int first, unsigned int count, dc_sample_callback_t callback, void *userdata, dc_sample_columns_t *columns, sample_index_t *index)
 {
 	hw_ostc_parser_t *parser = (hw_ostc_parser_t *) abstract;
 	const unsigned char *data = abstract->data;
@@ -630,17 +690,14 @@ hw_ostc_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t call
 	unsigned int version = parser->version;
 	unsigned int header = parser->header;
 	const hw_ostc_layout_t *layout = parser->layout;
+	unsigned int hwos = version == 0x23 || version == 0x24;
 
 	// Get the sample rate.
-	unsigned int samplerate = 0;
-	if (version == 0x23 || version == 0x24)
-		samplerate = data[header + 3];
-	else
-		samplerate = data[36];
+	unsigned int samplerate = hw_ostc_parser_samplerate (parser);
 
 	// Get the salinity factor.
 	unsigned int salinity = data[layout->salinity];
-	if (version == 0x23 || version == 0x24)
+	if (hwos)
 		salinity += 100;
 	if (salinity < 100 || salinity > 104)
 		salinity = 100;
@@ -648,7 +705,7 @@ hw_ostc_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t call
 
 	// Get the number of sample descriptors.
 	unsigned int nconfig = 0;
-	if (version == 0x23 || version == 0x24)
+	if (hwos)
 		nconfig = data[header + 4];
 	else
 		nconfig = 6;
@@ -660,7 +717,7 @@ hw_ostc_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t call
 	// Get the extended sample configuration.
 	hw_ostc_sample_info_t info[MAXCONFIG] = {{0}};
 	for (unsigned int i = 0; i < nconfig; ++i) {
-		if (version == 0x23 || version == 0x24) {
+		if (hwos) {
 			info[i].type    = data[header + 5 + 3 * i + 0];
 			info[i].size    = data[header + 5 + 3 * i + 1];
 			info[i].divisor = data[header + 5 + 3 * i + 2];
@@ -705,26 +762,138 @@ hw_ostc_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t call
 		firmware = array_uint16_be (data + layout->firmware);
 	}
 
+	// Due to a firmware bug, the deco/ndl info is incorrect for
+	// all OSTC4 dives with a firmware older than version 1.0.8.
+	unsigned int have_deco = parser->model != OSTC4 || firmware >= 0x0810;
+
+	// The extended sample info which isn't wanted by the application is
+	// stepped over without decoding it.
+	unsigned int skip = 0;
+	for (unsigned int i = 0; i < nconfig && columns == NULL; ++i) {
+		dc_sample_type_t type = DC_SAMPLE_TIME;
+		switch (info[i].type) {
+		case 0: // Temperature
+			type = DC_SAMPLE_TEMPERATURE;
+			break;
+		case 1: // Deco / NDL
+			type = DC_SAMPLE_DECO;
+			break;
+		case 3: // ppO2
+			type = DC_SAMPLE_PPO2;
+			break;
+		case 5: // CNS
+			type = DC_SAMPLE_CNS;
+			break;
+		default: // Not yet used.
+			break;
+		}
+		if (!parser_sample_wanted (abstract, type))
+			skip |= 1 << i;
+	}
+
+	// The extended sample info is present in every sample whose index is
+	// a multiple of its divisor. The pattern repeats with a period equal
+	// to the least common multiple of all divisors. If that period is
+	// small enough, the set of descriptors present at each position in
+	// the period is precomputed as a bitmask.
+	unsigned int period = 1;
+	for (unsigned int i = 0; i < nconfig && period; ++i) {
+		if (info[i].divisor == 0)
+			continue;
+		unsigned int a = period, b = info[i].divisor;
+		while (b) {
+			unsigned int t = a % b;
+			a = b;
+			b = t;
+		}
+		period = period / a * info[i].divisor;
+		if (period > MAXPERIOD)
+			period = 0;
+	}
+	unsigned char schedule[MAXPERIOD];
+	for (unsigned int n = 0; n < period; ++n) {
+		schedule[n] = 0;
+		for (unsigned int i = 0; i < nconfig; ++i) {
+			if (info[i].divisor && (n % info[i].divisor) == 0)
+				schedule[n] |= 1 << i;
+		}
+	}
+	unsigned int phase = 0;
+
 	unsigned int time = 0;
 	unsigned int nsamples = 0;
 
 	unsigned int offset = header;
-	if (version == 0x23 || version == 0x24)
+	if (hwos)
 		offset += 5 + 3 * nconfig;
+
+	// Resume at the nearest checkpoint of the sample index.
+	const sample_checkpoint_t *checkpoint = NULL;
+	if (index == NULL)
+		checkpoint = sample_index_find (abstract->index, first);
+	if (checkpoint && checkpoint->sample) {
+		if (checkpoint->offset < offset) {
+			ERROR (abstract->context, "Invalid sample index checkpoint.");
+			return DC_STATUS_DATAFORMAT;
+		}
+
+		rc = hw_ostc_parser_restore (parser, abstract->index);
+		if (rc != DC_STATUS_SUCCESS)
+			return rc;
+
+		nsamples = checkpoint->sample;
+		time = checkpoint->time;
+		offset = checkpoint->offset;
+		if (period)
+			phase = nsamples % period;
+	}
+	unsigned int complete = nsamples == 0;
+
 	while (offset + 3 <= size) {
 		dc_sample_value_t sample = {0};
 
+		// Stop after the last requested sample.
+		if (nsamples >= first && nsamples - first >= count)
+			break;
+
+		if (index && (nsamples % index->interval) == 0) {
+			rc = sample_index_append (index, nsamples, time, offset);
+			if (rc != DC_STATUS_SUCCESS) {
+				ERROR (abstract->context, "Failed to allocate memory.");
+				return rc;
+			}
+		}
+
+		// Samples before the requested range are decoded, but not delivered.
+		dc_sample_callback_t cb = nsamples >= first ? callback : NULL;
+		dc_sample_columns_t *cols = nsamples >= first ? columns : NULL;
+
 		nsamples++;
 
+		// Extended sample info present in this sample.
+		unsigned int mask = 0;
+		if (period) {
+			if (++phase == period)
+				phase = 0;
+			mask = schedule[phase];
+		} else {
+			for (unsigned int i = 0; i < nconfig; ++i) {
+				if (info[i].divisor && (nsamples % info[i].divisor) == 0)
+					mask |= 1 << i;
+			}
+		}
+
 		// Time (seconds).
 		time += samplerate;
 		sample.time = time;
-		if (callback) callback (DC_SAMPLE_TIME, sample, userdata);
+		if (cols) sample_columns_time (columns, time);
+		if (cb) cb (DC_SAMPLE_TIME, sample, userdata);
 
 		// Initial gas mix.
 		if (time == samplerate && parser->initial != UNDEFINED) {
 			sample.gasmix = parser->initial;
-			if (callback) callback (DC_SAMPLE_GASMIX, sample, userdata);
+			if (cols) sample_columns_gasmix (columns, sample.gasmix);
+			if (cb) cb (DC_SAMPLE_GASMIX, sample, userdata);
 #ifdef ENABLE_DEPRECATED
 			unsigned int idx = parser->initial;
 			unsigned int o2 = parser->gasmix[idx].oxygen;
@@ -733,14 +902,15 @@ hw_ostc_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t call
 			sample.event.time = 0;
 			sample.event.flags = 0;
 			sample.event.value = o2 | (he << 16);
-			if (callback) callback (DC_SAMPLE_EVENT, sample, userdata);
+			if (cb) cb (DC_SAMPLE_EVENT, sample, userdata);
 #endif
 		}
 
 		// Depth (mbar).
 		unsigned int depth = array_uint16_le (data + offset);
 		sample.depth = (depth * BAR / 1000.0) / hydrostatic;
-		if (callback) callback (DC_SAMPLE_DEPTH, sample, userdata);
+		if (cols) sample_columns_depth (columns, sample.depth);
+		if (cb) cb (DC_SAMPLE_DEPTH, sample, userdata);
 		offset += 2;
 
 		// Extended sample info.
@@ -757,7 +927,7 @@ hw_ostc_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t call
 		unsigned int nbits = 0;
 		unsigned int events = 0;
 		while (data[offset - 1] & 0x80) {
-			if (nbits && version != 0x23 && version != 0x24)
+			if (nbits && !hwos)
 				break;
 			if (length < 1) {
 				ERROR (abstract->context, "Buffer overflow detected!");
@@ -798,8 +968,10 @@ hw_ostc_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t call
 		case 7: // Low Battery
 			break;
 		}
-		if (sample.event.type && callback)
-			callback (DC_SAMPLE_EVENT, sample, userdata);
+		if (sample.event.type && cols)
+			sample_columns_event (columns, sample.event.type, 0, NULL, 0, 0);
+		if (sample.event.type && cb)
+			cb (DC_SAMPLE_EVENT, sample, userdata);
 
 		// Manual Gas Set & Change
 		if (events & 0x10) {
@@ -821,13 +993,14 @@ hw_ostc_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t call
 			}
 
 			sample.gasmix = idx;
-			if (callback) callback (DC_SAMPLE_GASMIX, sample, userdata);
+			if (cols) sample_columns_gasmix (columns, idx);
+			if (cb) cb (DC_SAMPLE_GASMIX, sample, userdata);
 #ifdef ENABLE_DEPRECATED
 			sample.event.type = SAMPLE_EVENT_GASCHANGE2;
 			sample.event.time = 0;
 			sample.event.flags = 0;
 			sample.event.value = o2 | (he << 16);
-			if (callback) callback (DC_SAMPLE_EVENT, sample, userdata);
+			if (cb) cb (DC_SAMPLE_EVENT, sample, userdata);
 #endif
 			offset += 2;
 			length -= 2;
@@ -846,7 +1019,8 @@ hw_ostc_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t call
 			}
 			idx--; /* Convert to a zero based index. */
 			sample.gasmix = idx;
-			if (callback) callback (DC_SAMPLE_GASMIX, sample, userdata);
+			if (cols) sample_columns_gasmix (columns, idx);
+			if (cb) cb (DC_SAMPLE_GASMIX, sample, userdata);
 #ifdef ENABLE_DEPRECATED
 			unsigned int o2 = parser->gasmix[idx].oxygen;
 			unsigned int he = parser->gasmix[idx].helium;
@@ -854,13 +1028,13 @@ hw_ostc_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t call
 			sample.event.time = 0;
 			sample.event.flags = 0;
 			sample.event.value = o2 | (he << 16);
-			if (callback) callback (DC_SAMPLE_EVENT, sample, userdata);
+			if (cb) cb (DC_SAMPLE_EVENT, sample, userdata);
 #endif
 			offset++;
 			length--;
 		}
 
-		if (version == 0x23 || version == 0x24) {
+		if (hwos) {
 			// SetPoint Change
 			if (events & 0x40) {
 				if (length < 1) {
@@ -868,7 +1042,7 @@ hw_ostc_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t call
 					return DC_STATUS_DATAFORMAT;
 				}
 				sample.setpoint = data[offset] / 100.0;
-				if (callback) callback (DC_SAMPLE_SETPOINT, sample, userdata);
+				if (cb) cb (DC_SAMPLE_SETPOINT, sample, userdata);
 				offset++;
 				length--;
 			}
@@ -894,13 +1068,14 @@ hw_ostc_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t call
 				}
 
 				sample.gasmix = idx;
-				if (callback) callback (DC_SAMPLE_GASMIX, sample, userdata);
+				if (cols) sample_columns_gasmix (columns, idx);
+				if (cb) cb (DC_SAMPLE_GASMIX, sample, userdata);
 #ifdef ENABLE_DEPRECATED
 				sample.event.type = SAMPLE_EVENT_GASCHANGE2;
 				sample.event.time = 0;
 				sample.event.flags = 0;
 				sample.event.value = o2 | (he << 16);
-				if (callback) callback (DC_SAMPLE_EVENT, sample, userdata);
+				if (cb) cb (DC_SAMPLE_EVENT, sample, userdata);
 #endif
 				offset += 2;
 				length -= 2;
@@ -908,13 +1083,19 @@ hw_ostc_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t call
 		}
 
 		// Extended sample info.
-		for (unsigned int i = 0; i < nconfig; ++i) {
-			if (info[i].divisor && (nsamples % info[i].divisor) == 0) {
+		for (unsigned int i = 0; (mask >> i) != 0; ++i) {
+			if (mask & (1 << i)) {
 				if (length < info[i].size) {
 					ERROR (abstract->context, "Buffer overflow detected!");
 					return DC_STATUS_DATAFORMAT;
 				}
 
+				if (skip & (1 << i)) {
+					offset += info[i].size;
+					length -= info[i].size;
+					continue;
+				}
+
 				unsigned int ppo2[3] = {0};
 				unsigned int count = 0;
 				unsigned int value = 0;
@@ -922,12 +1103,11 @@ hw_ostc_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t call
 				case 0: // Temperature (0.1 °C).
 					value = array_uint16_le (data + offset);
 					sample.temperature = value / 10.0;
-					if (callback) callback (DC_SAMPLE_TEMPERATURE, sample, userdata);
+					if (cols) sample_columns_temperature (columns, sample.temperature);
+					if (cb) cb (DC_SAMPLE_TEMPERATURE, sample, userdata);
 					break;
 				case 1: // Deco / NDL
-					// Due to a firmware bug, the deco/ndl info is incorrect for
-					// all OSTC4 dives with a firmware older than version 1.0.8.
-					if (parser->model == OSTC4 && firmware < 0x0810)
+					if (!have_deco)
 						break;
 					if (data[offset]) {
 						sample.deco.type = DC_DECO_DECOSTOP;
@@ -937,7 +1117,7 @@ hw_ostc_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t call
 						sample.deco.depth = 0.0;
 					}
 					sample.deco.time = data[offset + 1] * 60;
-					if (callback) callback (DC_SAMPLE_DECO, sample, userdata);
+					if (cb) cb (DC_SAMPLE_DECO, sample, userdata);
 					break;
 				case 3: // ppO2 (0.01 bar).
 					for (unsigned int j = 0; j < 3; ++j) {
@@ -952,7 +1132,7 @@ hw_ostc_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t call
 					if (count) {
 						for (unsigned int j = 0; j < 3; ++j) {
 							sample.ppo2 = ppo2[j] / 100.0;
-							if (callback) callback (DC_SAMPLE_PPO2, sample, userdata);
+							if (cb) cb (DC_SAMPLE_PPO2, sample, userdata);
 						}
 					}
 					break;
@@ -961,7 +1141,7 @@ hw_ostc_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t call
 						sample.cns = array_uint16_le (data + offset) / 100.0;
 					else
 						sample.cns = data[offset] / 100.0;
-					if (callback) callback (DC_SAMPLE_CNS, sample, userdata);
+					if (cb) cb (DC_SAMPLE_CNS, sample, userdata);
 					break;
 				default: // Not yet used.
 					break;
@@ -972,7 +1152,7 @@ hw_ostc_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t call
 			}
 		}
 
-		if (version != 0x23 && version != 0x24) {
+		if (!hwos) {
 			// SetPoint Change
 			if (events & 0x40) {
 				if (length < 1) {
@@ -980,7 +1160,7 @@ hw_ostc_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t call
 					return DC_STATUS_DATAFORMAT;
 				}
 				sample.setpoint = data[offset] / 100.0;
-				if (callback) callback (DC_SAMPLE_SETPOINT, sample, userdata);
+				if (cb) cb (DC_SAMPLE_SETPOINT, sample, userdata);
 				offset++;
 				length--;
 			}
@@ -1006,13 +1186,14 @@ hw_ostc_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t call
 				}
 
 				sample.gasmix = idx;
-				if (callback) callback (DC_SAMPLE_GASMIX, sample, userdata);
+				if (cols) sample_columns_gasmix (columns, idx);
+				if (cb) cb (DC_SAMPLE_GASMIX, sample, userdata);
 #ifdef ENABLE_DEPRECATED
 				sample.event.type = SAMPLE_EVENT_GASCHANGE2;
 				sample.event.time = 0;
 				sample.event.flags = 0;
 				sample.event.value = o2 | (he << 16);
-				if (callback) callback (DC_SAMPLE_EVENT, sample, userdata);
+				if (cb) cb (DC_SAMPLE_EVENT, sample, userdata);
 #endif
 				offset += 2;
 				length -= 2;
@@ -1026,12 +1207,76 @@ hw_ostc_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t call
 		offset += length;
 	}
 
+	// The end marker is only checked at the end of the samples.
+	if (nsamples >= first && nsamples - first >= count && offset + 3 <= size)
+		return DC_STATUS_SUCCESS;
+
 	if (offset + 2 > size || data[offset] != 0xFD || data[offset + 1] != 0xFD) {
 		ERROR (abstract->context, "Invalid end marker found!");
 		return DC_STATUS_DATAFORMAT;
 	}
 
-	parser->cached = PROFILE;
+	if (complete)
+		parser->cached = PROFILE;
+
+	// The manual gas mixes are only known after a pass over all samples.
+	if (index) {
+		index->nsamples = nsamples;
+		index->nstate = 0;
+		for (unsigned int i = parser->nfixed; i < parser->ngasmixes; ++i) {
+			index->state[index->nstate++] = parser->gasmix[i].oxygen;
+			index->state[index->nstate++] = parser->gasmix[i].helium;
+		}
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+hw_ostc_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata)
+{
+	return hw_ostc_parser_samples_internal (abstract, 0, UINT_MAX, callback, userdata, NULL, NULL);
+}
+
+static dc_status_t
+hw_ostc_parser_samples_extract (dc_parser_t *abstract, dc_sample_columns_t *columns)
+{
+	return hw_ostc_parser_samples_internal (abstract, 0, UINT_MAX, NULL, NULL, columns, NULL);
+}
+
+static dc_status_t
+hw_ostc_parser_samples_range (dc_parser_t *abstract, unsigned int first, unsigned int count, dc_sample_callback_t callback, void *userdata)
+{
+	return hw_ostc_parser_samples_internal (abstract, first, count, callback, userdata, NULL, NULL);
+}
+
+static dc_status_t
+hw_ostc_parser_samples_seek (dc_parser_t *abstract, unsigned int time, unsigned int *index)
+{
+	hw_ostc_parser_t *parser = (hw_ostc_parser_t *) abstract;
+
+	dc_status_t rc = hw_ostc_parser_cache (parser);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	// The samples are recorded at a fixed rate, starting after one
+	// interval. The number of samples is only known from the index.
+	unsigned int samplerate = hw_ostc_parser_samplerate (parser);
+	unsigned int i = 0;
+	if (time && samplerate == 0)
+		i = UINT_MAX;
+	else if (time)
+		i = (time - 1) / samplerate;
+	if (abstract->index && i > abstract->index->nsamples)
+		i = abstract->index->nsamples;
+
+	*index = i;
 
 	return DC_STATUS_SUCCESS;
 }
+
+static dc_status_t
+hw_ostc_parser_samples_index (dc_parser_t *abstract, sample_index_t *index)
+{
+	return hw_ostc_parser_samples_internal (abstract, 0, UINT_MAX, NULL, NULL, NULL, index);
+}
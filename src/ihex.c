@@ -19,121 +19,102 @@
  * MA 02110-1301 USA
  */
 
+#define DC_LOG_CATEGORY DC_LOGCATEGORY_FIRMWARE
+
 #include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
-#include <stdio.h>
 
 #include "ihex.h"
+#include "file.h"
 #include "context-private.h"
 #include "checksum.h"
 #include "array.h"
 
 struct dc_ihex_file_t {
 	dc_context_t *context;
-	FILE *fp;
+	dc_buffer_t *buffer;
+	size_t offset;
 };
 
-dc_status_t
-dc_ihex_file_open (dc_ihex_file_t **result, dc_context_t *context, const char *filename)
-{
-	dc_ihex_file_t *file = NULL;
-
-	if (result == NULL || filename == NULL) {
-		ERROR (context, "Invalid arguments.");
-		return DC_STATUS_INVALIDARGS;
-	}
-
-	file = (dc_ihex_file_t *) malloc (sizeof (dc_ihex_file_t));
-	if (file == NULL) {
-		ERROR (context, "Failed to allocate memory.");
-		return DC_STATUS_NOMEMORY;
-	}
-
-	file->context = context;
-
-	file->fp = fopen (filename, "rb");
-	if (file->fp == NULL) {
-		ERROR (context, "Failed to open the file.");
-		free (file);
-		return DC_STATUS_IO;
-	}
+typedef struct dc_ihex_range_t {
+	unsigned int address;
+	unsigned int offset;
+	unsigned int length;
+} dc_ihex_range_t;
 
-	*result = file;
-
-	return DC_STATUS_SUCCESS;
-}
+struct dc_ihex_image_t {
+	dc_context_t *context;
+	dc_buffer_t *data;
+	dc_ihex_range_t *ranges;
+	unsigned int count;
+	unsigned int capacity;
+};
 
-dc_status_t
-dc_ihex_file_read (dc_ihex_file_t *file, dc_ihex_entry_t *entry)
+static dc_status_t
+dc_ihex_decode (dc_context_t *context, const unsigned char ascii[], size_t size, size_t *position, dc_ihex_entry_t *entry)
 {
-	unsigned char ascii[9 + 2 * 255 + 2] = {0};
 	unsigned char data[4 + 255 + 1] = {0};
 	unsigned int type, length, address;
 	unsigned char csum_a, csum_b;
-	size_t n;
+	size_t offset = *position;
 
-	if (file == NULL || entry == NULL) {
-		ERROR (file ? file->context : NULL, "Invalid arguments.");
-		return DC_STATUS_INVALIDARGS;
-	}
-
-	/* Read the start code. */
+	/* Find the start code. */
 	while (1) {
-		n = fread (ascii, 1, 1, file->fp);
-		if (n != 1) {
-			if (feof (file->fp)) {
-				return DC_STATUS_DONE;
-			} else {
-				ERROR (file->context, "Failed to read the start code.");
-				return DC_STATUS_IO;
-			}
+		if (offset >= size) {
+			*position = offset;
+			return DC_STATUS_DONE;
 		}
 
-		if (ascii[0] == ':')
+		if (ascii[offset] == ':')
 			break;
 
 		/* Ignore CR and LF characters. */
-		if (ascii[0] != '\n' && ascii[0] != '\r') {
-			ERROR (file->context, "Unexpected character (0x%02x).", ascii[0]);
+		if (ascii[offset] != '\n' && ascii[offset] != '\r') {
+			ERROR (context, "Unexpected character (0x%02x).", ascii[offset]);
 			return DC_STATUS_DATAFORMAT;
 		}
+
+		offset++;
 	}
 
-	/* Read the record length, address and type. */
-	n = fread (ascii + 1, 1, 8, file->fp);
-	if (n != 8) {
-		ERROR (file->context, "Failed to read the header.");
+	/* Skip the start code. */
+	offset++;
+
+	/* Get the record length, address and type. */
+	if (size - offset < 8) {
+		ERROR (context, "Failed to read the header.");
 		return DC_STATUS_IO;
 	}
 
 	/* Convert to binary representation. */
-	if (array_convert_hex2bin (ascii + 1, 8, data, 4) != 0) {
-		ERROR (file->context, "Invalid hexadecimal character.");
+	if (array_convert_hex2bin (ascii + offset, 8, data, 4) != 0) {
+		ERROR (context, "Invalid hexadecimal character.");
 		return DC_STATUS_DATAFORMAT;
 	}
+	offset += 8;
 
 	/* Get the record length. */
 	length = data[0];
 
-	/* Read the record payload. */
-	n = fread (ascii + 9, 1, 2 * length + 2, file->fp);
-	if (n != 2 * length + 2) {
-		ERROR (file->context, "Failed to read the data.");
+	/* Get the record payload. */
+	if (size - offset < 2 * length + 2) {
+		ERROR (context, "Failed to read the data.");
 		return DC_STATUS_IO;
 	}
 
 	/* Convert to binary representation. */
-	if (array_convert_hex2bin (ascii + 9, 2 * length + 2, data + 4, length + 1) != 0) {
-		ERROR (file->context, "Invalid hexadecimal character.");
+	if (array_convert_hex2bin (ascii + offset, 2 * length + 2, data + 4, length + 1) != 0) {
+		ERROR (context, "Invalid hexadecimal character.");
 		return DC_STATUS_DATAFORMAT;
 	}
+	offset += 2 * length + 2;
 
 	/* Verify the checksum. */
 	csum_a = data[4 + length];
 	csum_b = ~checksum_add_uint8 (data, 4 + length, 0x00) + 1;
 	if (csum_a != csum_b) {
-		ERROR (file->context, "Unexpected checksum (0x%02x, 0x%02x).", csum_a, csum_b);
+		ERROR (context, "Unexpected checksum (0x%02x, 0x%02x).", csum_a, csum_b);
 		return DC_STATUS_DATAFORMAT;
 	}
 
@@ -143,7 +124,7 @@ dc_ihex_file_read (dc_ihex_file_t *file, dc_ihex_entry_t *entry)
 	/* Get the record type. */
 	type = data[3];
 	if (type < 0 || type > 5) {
-		ERROR (file->context, "Invalid record type (0x%02x).", type);
+		ERROR (context, "Invalid record type (0x%02x).", type);
 		return DC_STATUS_DATAFORMAT;
 	}
 
@@ -164,11 +145,14 @@ dc_ihex_file_read (dc_ihex_file_t *file, dc_ihex_entry_t *entry)
 			break;
 		}
 		if (length != len || address != 0) {
-			ERROR (file->context, "Invalid record length or address.");
+			ERROR (context, "Invalid record length or address.");
 			return DC_STATUS_DATAFORMAT;
 		}
 	}
 
+	/* Advance to the next record. */
+	*position = offset;
+
 	/* Set the record fields. */
 	entry->type = type;
 	entry->address = address;
@@ -181,6 +165,58 @@ dc_ihex_file_read (dc_ihex_file_t *file, dc_ihex_entry_t *entry)
 	return DC_STATUS_SUCCESS;
 }
 
+dc_status_t
+dc_ihex_file_open (dc_ihex_file_t **result, dc_context_t *context, const char *filename)
+{
+	dc_ihex_file_t *file = NULL;
+
+	if (result == NULL || filename == NULL) {
+		ERROR (context, "Invalid arguments.");
+		return DC_STATUS_INVALIDARGS;
+	}
+
+	file = (dc_ihex_file_t *) malloc (sizeof (dc_ihex_file_t));
+	if (file == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	file->context = context;
+	file->offset = 0;
+
+	file->buffer = dc_buffer_new (0);
+	if (file->buffer == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		free (file);
+		return DC_STATUS_NOMEMORY;
+	}
+
+	/* Load the entire file, and parse the records from memory. */
+	dc_status_t rc = dc_file_read (context, filename, file->buffer);
+	if (rc != DC_STATUS_SUCCESS) {
+		dc_buffer_free (file->buffer);
+		free (file);
+		return rc;
+	}
+
+	*result = file;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_ihex_file_read (dc_ihex_file_t *file, dc_ihex_entry_t *entry)
+{
+	if (file == NULL || entry == NULL) {
+		ERROR (file ? file->context : NULL, "Invalid arguments.");
+		return DC_STATUS_INVALIDARGS;
+	}
+
+	return dc_ihex_decode (file->context,
+		dc_buffer_get_data (file->buffer), dc_buffer_get_size (file->buffer),
+		&file->offset, entry);
+}
+
 dc_status_t
 dc_ihex_file_reset (dc_ihex_file_t *file)
 {
@@ -189,7 +225,7 @@ dc_ihex_file_reset (dc_ihex_file_t *file)
 		return DC_STATUS_INVALIDARGS;
 	}
 
-	rewind (file->fp);
+	file->offset = 0;
 
 	return DC_STATUS_SUCCESS;
 }
@@ -198,9 +234,201 @@ dc_status_t
 dc_ihex_file_close (dc_ihex_file_t *file)
 {
 	if (file) {
-		fclose (file->fp);
+		dc_buffer_free (file->buffer);
 		free (file);
 	}
 
 	return DC_STATUS_SUCCESS;
 }
+
+static dc_status_t
+dc_ihex_image_append (dc_ihex_image_t *image, unsigned int address, const unsigned char data[], unsigned int length)
+{
+	unsigned int offset = dc_buffer_get_size (image->data);
+
+	if (!dc_buffer_append (image->data, data, length)) {
+		ERROR (image->context, "Insufficient buffer space available.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	/* Extend the last segment if the record is contiguous. */
+	if (image->count) {
+		dc_ihex_range_t *last = image->ranges + image->count - 1;
+		if (last->address + last->length == address) {
+			last->length += length;
+			return DC_STATUS_SUCCESS;
+		}
+	}
+
+	/* Grow the segment list. */
+	if (image->count == image->capacity) {
+		unsigned int capacity = image->capacity ? image->capacity * 2 : 16;
+		dc_ihex_range_t *ranges = (dc_ihex_range_t *) realloc (image->ranges, capacity * sizeof (dc_ihex_range_t));
+		if (ranges == NULL) {
+			ERROR (image->context, "Failed to allocate memory.");
+			return DC_STATUS_NOMEMORY;
+		}
+		image->ranges = ranges;
+		image->capacity = capacity;
+	}
+
+	image->ranges[image->count].address = address;
+	image->ranges[image->count].offset = offset;
+	image->ranges[image->count].length = length;
+	image->count++;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_ihex_parse (dc_context_t *context, const unsigned char data[], size_t size, dc_ihex_image_t *image)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+	dc_ihex_entry_t entry;
+	unsigned int base = 0;
+	size_t offset = 0;
+
+	while ((rc = dc_ihex_decode (context, data, size, &offset, &entry)) == DC_STATUS_SUCCESS) {
+		if (entry.type == 0) {
+			/* Data record. */
+			if (image) {
+				rc = dc_ihex_image_append (image, base + entry.address, entry.data, entry.length);
+				if (rc != DC_STATUS_SUCCESS)
+					return rc;
+			}
+		} else if (entry.type == 1) {
+			/* End of file record. */
+			return DC_STATUS_SUCCESS;
+		} else if (entry.type == 2) {
+			/* Extended segment address record. */
+			base = array_uint16_be (entry.data) << 4;
+		} else if (entry.type == 4) {
+			/* Extended linear address record. */
+			base = array_uint16_be (entry.data) << 16;
+		}
+	}
+
+	/* A missing end of file record is tolerated. */
+	if (rc == DC_STATUS_DONE)
+		rc = DC_STATUS_SUCCESS;
+
+	return rc;
+}
+
+dc_status_t
+dc_ihex_validate (dc_context_t *context, const unsigned char data[], size_t size)
+{
+	if (data == NULL && size) {
+		ERROR (context, "Invalid arguments.");
+		return DC_STATUS_INVALIDARGS;
+	}
+
+	return dc_ihex_parse (context, data, size, NULL);
+}
+
+dc_status_t
+dc_ihex_image_parse (dc_ihex_image_t **result, dc_context_t *context, const unsigned char data[], size_t size)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+	dc_ihex_image_t *image = NULL;
+
+	if (result == NULL || (data == NULL && size)) {
+		ERROR (context, "Invalid arguments.");
+		return DC_STATUS_INVALIDARGS;
+	}
+
+	image = (dc_ihex_image_t *) malloc (sizeof (dc_ihex_image_t));
+	if (image == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	image->context = context;
+	image->ranges = NULL;
+	image->count = 0;
+	image->capacity = 0;
+
+	/* Every data byte takes at least two hex digits, so half the input
+	 * size is enough to hold the entire image without reallocating. */
+	image->data = dc_buffer_new (size / 2);
+	if (image->data == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		free (image);
+		return DC_STATUS_NOMEMORY;
+	}
+
+	rc = dc_ihex_parse (context, data, size, image);
+	if (rc != DC_STATUS_SUCCESS) {
+		dc_ihex_image_free (image);
+		return rc;
+	}
+
+	*result = image;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_ihex_image_open (dc_ihex_image_t **result, dc_context_t *context, const char *filename)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+
+	if (result == NULL || filename == NULL) {
+		ERROR (context, "Invalid arguments.");
+		return DC_STATUS_INVALIDARGS;
+	}
+
+	dc_buffer_t *buffer = dc_buffer_new (0);
+	if (buffer == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	rc = dc_file_read (context, filename, buffer);
+	if (rc == DC_STATUS_SUCCESS) {
+		rc = dc_ihex_image_parse (result, context,
+			dc_buffer_get_data (buffer), dc_buffer_get_size (buffer));
+	}
+
+	dc_buffer_free (buffer);
+
+	return rc;
+}
+
+unsigned int
+dc_ihex_image_count (dc_ihex_image_t *image)
+{
+	if (image == NULL)
+		return 0;
+
+	return image->count;
+}
+
+dc_status_t
+dc_ihex_image_get (dc_ihex_image_t *image, unsigned int index, dc_ihex_segment_t *segment)
+{
+	if (image == NULL || segment == NULL || index >= image->count) {
+		ERROR (image ? image->context : NULL, "Invalid arguments.");
+		return DC_STATUS_INVALIDARGS;
+	}
+
+	const dc_ihex_range_t *range = image->ranges + index;
+
+	segment->address = range->address;
+	segment->length = range->length;
+	segment->data = dc_buffer_get_data (image->data) + range->offset;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_ihex_image_free (dc_ihex_image_t *image)
+{
+	if (image) {
+		dc_buffer_free (image->data);
+		free (image->ranges);
+		free (image);
+	}
+
+	return DC_STATUS_SUCCESS;
+}
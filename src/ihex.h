@@ -22,6 +22,8 @@
 #ifndef DC_IHEX_H
 #define DC_IHEX_H
 
+#include <stddef.h>
+
 #include <libdivecomputer/common.h>
 #include <libdivecomputer/context.h>
 
@@ -50,6 +52,44 @@ dc_ihex_file_reset (dc_ihex_file_t *file);
 dc_status_t
 dc_ihex_file_close (dc_ihex_file_t *file);
 
+/*
+ * A parsed hex file, stored as a sparse list of segments. Contiguous data
+ * records are merged into a single segment, and the segment addresses
+ * include the extended segment or linear address.
+ */
+typedef struct dc_ihex_image_t dc_ihex_image_t;
+
+typedef struct dc_ihex_segment_t {
+	unsigned int address;
+	unsigned int length;
+	const unsigned char *data;
+} dc_ihex_segment_t;
+
+/*
+ * Verify the syntax and checksums of all records, up to the end of file
+ * record, without storing any data.
+ */
+dc_status_t
+dc_ihex_validate (dc_context_t *context, const unsigned char data[], size_t size);
+
+dc_status_t
+dc_ihex_image_parse (dc_ihex_image_t **image, dc_context_t *context, const unsigned char data[], size_t size);
+
+dc_status_t
+dc_ihex_image_open (dc_ihex_image_t **image, dc_context_t *context, const char *filename);
+
+unsigned int
+dc_ihex_image_count (dc_ihex_image_t *image);
+
+/*
+ * The segment data remains valid until the image is freed.
+ */
+dc_status_t
+dc_ihex_image_get (dc_ihex_image_t *image, unsigned int index, dc_ihex_segment_t *segment);
+
+dc_status_t
+dc_ihex_image_free (dc_ihex_image_t *image);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -19,6 +19,8 @@
  * MA 02110-1301 USA
  */
 
+#define DC_LOG_CATEGORY DC_LOGCATEGORY_TRANSPORT
+
 #include <stdlib.h> // malloc, free
 #include <stdio.h>	// snprintf
 #ifdef _WIN32
@@ -27,6 +27,9 @@
 #include "mares_common.h"
 #include "checksum.h"
 #include "array.h"
+#include "ringbuffer.h"
+#include "retry.h"
+#include "packet.h"
 
 #define MAXRETRIES 4
 
@@ -46,6 +49,22 @@
 #define FREEDIVE 2
 #define GAUGE    3
 
+static const dc_packet_framing_t mares_common_framing = {
+	DC_PACKET_HEADER | DC_PACKET_TRAILER, /* flags */
+	0, /* delay */
+	0, '<', '>', /* ack, header, trailer */
+	0, 0, /* start, minimum */
+	DC_PACKET_CHECKSUM_NONE, 0, 0, 0, /* checksum */
+};
+
+static const dc_packet_framing_t mares_common_framing_echo = {
+	DC_PACKET_ECHO | DC_PACKET_ECHO_WARN | DC_PACKET_HEADER | DC_PACKET_TRAILER, /* flags */
+	0, /* delay */
+	0, '<', '>', /* ack, header, trailer */
+	0, 0, /* start, minimum */
+	DC_PACKET_CHECKSUM_NONE, 0, 0, 0, /* checksum */
+};
+
 void
 mares_common_device_init (mares_common_device_t *device)
 {
@@ -55,6 +74,7 @@ mares_common_device_init (mares_common_device_t *device)
 	device->port = NULL;
 	device->echo = 0;
 	device->delay = 0;
+	device->base.blocksize = PACKETSIZE;
 }
 
 
@@ -79,57 +99,31 @@ mares_common_make_ascii (const unsigned char raw[], unsigned int rsize, unsigned
 
 
 static dc_status_t
-mares_common_packet (mares_common_device_t *device, const unsigned char command[], unsigned int csize, unsigned char answer[], unsigned int asize)
+mares_common_packet (mares_common_device_t *device, const unsigned char command[], unsigned int csize, unsigned char answer[], unsigned int asize, unsigned char data[])
 {
 	dc_status_t status = DC_STATUS_SUCCESS;
 	dc_device_t *abstract = (dc_device_t *) device;
 
-	if (device_is_cancelled (abstract))
-		return DC_STATUS_CANCELLED;
-
 	if (device->delay) {
 		dc_serial_sleep (device->port, device->delay);
 	}
 
-	// Send the command to the device.
-	status = dc_serial_write (device->port, command, csize, NULL);
-	if (status != DC_STATUS_SUCCESS) {
-		ERROR (abstract->context, "Failed to send the command.");
+	// Send the command, and receive the answer.
+	if (device->echo)
+		status = dc_packet_transfer (abstract, device->port, &mares_common_framing_echo, command, csize, answer, asize);
+	else
+		status = dc_packet_transfer (abstract, device->port, &mares_common_framing, command, csize, answer, asize);
+	if (status != DC_STATUS_SUCCESS)
 		return status;
-	}
 
-	if (device->echo) {
-		// Receive the echo of the command.
-		unsigned char echo[PACKETSIZE] = {0};
-		status = dc_serial_read (device->port, echo, csize, NULL);
-		if (status != DC_STATUS_SUCCESS) {
-			ERROR (abstract->context, "Failed to receive the echo.");
-			return status;
-		}
-
-		// Verify the echo.
-		if (memcmp (echo, command, csize) != 0) {
-			WARNING (abstract->context, "Unexpected echo.");
-		}
-	}
-
-	// Receive the answer of the device.
-	status = dc_serial_read (device->port, answer, asize, NULL);
-	if (status != DC_STATUS_SUCCESS) {
-		ERROR (abstract->context, "Failed to receive the answer.");
-		return status;
-	}
-
-	// Verify the header and trailer of the packet.
-	if (answer[0] != '<' || answer[asize - 1] != '>') {
-		ERROR (abstract->context, "Unexpected answer header/trailer byte.");
+	// Extract the raw data and verify the checksum of the packet, in a
+	// single pass over the ascii payload.
+	unsigned char crc = 0, ccrc = 0x00;
+	if (array_convert_hex2bin_sum (answer + 1, asize - 4, data, (asize - 4) / 2, &ccrc) != 0 ||
+		array_convert_hex2bin (answer + asize - 3, 2, &crc, 1) != 0) {
+		ERROR (abstract->context, "Unexpected answer character.");
 		return DC_STATUS_PROTOCOL;
 	}
-
-	// Verify the checksum of the packet.
-	unsigned char crc = 0;
-	unsigned char ccrc = checksum_add_uint8 (answer + 1, asize - 4, 0x00);
-	array_convert_hex2bin (answer + asize - 3, 2, &crc, 1);
 	if (crc != ccrc) {
 		ERROR (abstract->context, "Unexpected answer checksum.");
 		return DC_STATUS_PROTOCOL;
@@ -140,25 +134,27 @@ mares_common_packet (mares_common_device_t *device, const unsigned char command[
 
 
 static dc_status_t
-mares_common_transfer (mares_common_device_t *device, const unsigned char command[], unsigned int csize, unsigned char answer[], unsigned int asize)
+mares_common_transfer (mares_common_device_t *device, const unsigned char command[], unsigned int csize, unsigned char answer[], unsigned int asize, unsigned char data[])
 {
-	unsigned int nretries = 0;
+	dc_device_t *abstract = (dc_device_t *) device;
+	dc_retry_t retry;
+	dc_retry_init (&retry, MAXRETRIES, 100, 100, DC_DIRECTION_INPUT);
+	unsigned long long begin = device_timestamp ();
 	dc_status_t rc = DC_STATUS_SUCCESS;
-	while ((rc = mares_common_packet (device, command, csize, answer, asize)) != DC_STATUS_SUCCESS) {
-		// Automatically discard a corrupted packet,
-		// and request a new one.
-		if (rc != DC_STATUS_PROTOCOL && rc != DC_STATUS_TIMEOUT)
-			return rc;
+	while ((rc = mares_common_packet (device, command, csize, answer, asize, data)) != DC_STATUS_SUCCESS) {
+		device_stats_packet (abstract, command, csize, 0, rc, begin);
 
-		// Abort if the maximum number of retries is reached.
-		if (nretries++ >= MAXRETRIES)
+		// Automatically discard a corrupted packet, including any
+		// garbage bytes, and request a new one.
+		rc = dc_retry_failed (&retry, abstract, device->port, rc);
+		if (rc != DC_STATUS_SUCCESS)
 			return rc;
 
-		// Discard any garbage bytes.
-		dc_serial_sleep (device->port, 100);
-		dc_serial_purge (device->port, DC_DIRECTION_INPUT);
+		begin = device_timestamp ();
 	}
 
+	device_stats_packet (abstract, command, csize, asize, rc, begin);
+
 	return rc;
 }
 
@@ -187,13 +183,10 @@ mares_common_device_read (dc_device_t *abstract, unsigned int address, unsigned
 
 		// Send the command and receive the answer.
 		unsigned char answer[2 * (PACKETSIZE + 2)] = {0};
-		dc_status_t rc = mares_common_transfer (device, command, sizeof (command), answer, 2 * (len + 2));
+		dc_status_t rc = mares_common_transfer (device, command, sizeof (command), answer, 2 * (len + 2), data);
 		if (rc != DC_STATUS_SUCCESS)
 			return rc;
 
-		// Extract the raw data from the packet.
-		array_convert_hex2bin (answer + 1, 2 * len, data, len);
-
 		nbytes += len;
 		address += len;
 		data += len;
@@ -203,19 +196,111 @@ mares_common_device_read (dc_device_t *abstract, unsigned int address, unsigned
 }
 
 
-dc_status_t
-mares_common_extract_dives (dc_context_t *context, const mares_common_layout_t *layout, const unsigned char fingerprint[], const unsigned char data[], dc_dive_callback_t callback, void *userdata)
+typedef struct mares_common_source_t {
+	const mares_common_layout_t *layout;
+	mares_common_device_t *device;
+	dc_event_progress_t *progress;
+	const unsigned char *data;
+	unsigned char *buffer;
+	unsigned int available;
+	unsigned int eop;
+	unsigned char *freedives;
+} mares_common_source_t;
+
+/*
+ * Make sure the linear profile buffer contains the data from the offset
+ * up to the end. When the memory isn't available yet, the missing part
+ * is read from the device, walking the ringbuffer backwards from the end
+ * of profile pointer.
+ */
+static dc_status_t
+mares_common_fetch (mares_common_source_t *source, unsigned int offset)
 {
-	assert (layout != NULL);
+	const mares_common_layout_t *layout = source->layout;
+	unsigned int rb_profile_size = layout->rb_profile_end - layout->rb_profile_begin;
+
+	if (offset >= rb_profile_size - source->available)
+		return DC_STATUS_SUCCESS;
+
+	// Read whole packets, except at the start of the buffer.
+	unsigned int begin = offset - offset % PACKETSIZE;
+	unsigned int end = rb_profile_size - source->available;
+
+	while (end > begin) {
+		// Get the address of the last byte, and limit the read to the
+		// start of the ringbuffer.
+		unsigned int address = layout->rb_profile_begin +
+			(source->eop - layout->rb_profile_begin + end - 1) % rb_profile_size;
+		unsigned int len = end - begin;
+		if (len > address + 1 - layout->rb_profile_begin)
+			len = address + 1 - layout->rb_profile_begin;
+
+		dc_status_t rc = mares_common_device_read ((dc_device_t *) source->device,
+			address + 1 - len, source->buffer + end - len, len);
+		if (rc != DC_STATUS_SUCCESS)
+			return rc;
+
+		// Update and emit a progress event.
+		source->progress->current += len;
+		device_event_emit ((dc_device_t *) source->device, DC_EVENT_PROGRESS, source->progress);
+
+		end -= len;
+	}
+
+	source->available = rb_profile_size - begin;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+mares_common_fetch_freedives (mares_common_source_t *source, const unsigned char **freedives)
+{
+	const mares_common_layout_t *layout = source->layout;
+	unsigned int size = layout->rb_freedives_end - layout->rb_freedives_begin;
+
+	if (source->data) {
+		*freedives = source->data + layout->rb_freedives_begin;
+		return DC_STATUS_SUCCESS;
+	}
+
+	if (source->freedives == NULL) {
+		unsigned char *buffer = (unsigned char *) malloc (size ? size : 1);
+		if (buffer == NULL)
+			return DC_STATUS_NOMEMORY;
+
+		dc_status_t rc = mares_common_device_read ((dc_device_t *) source->device,
+			layout->rb_freedives_begin, buffer, size);
+		if (rc != DC_STATUS_SUCCESS) {
+			free (buffer);
+			return rc;
+		}
+
+		// Update and emit a progress event.
+		source->progress->current += size;
+		device_event_emit ((dc_device_t *) source->device, DC_EVENT_PROGRESS, source->progress);
+
+		source->freedives = buffer;
+	}
+
+	*freedives = source->freedives;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+mares_common_extract (dc_context_t *context, mares_common_source_t *source, const unsigned char fingerprint[], const unsigned char header[], dc_dive_callback_t callback, void *userdata)
+{
+	const mares_common_layout_t *layout = source->layout;
+	dc_status_t rc = DC_STATUS_SUCCESS;
 
 	// Get the freedive mode for this model.
-	unsigned int model = data[1];
+	unsigned int model = header[1];
 	unsigned int freedive = FREEDIVE;
 	if (model == NEMOWIDE || model == NEMOAIR || model == PUCK || model == PUCKAIR)
 		freedive = GAUGE;
 
 	// Get the end of the profile ring buffer.
-	unsigned int eop = array_uint16_le (data + 0x6B);
+	unsigned int eop = array_uint16_le (header + 0x6B);
 	if (eop < layout->rb_profile_begin || eop >= layout->rb_profile_end) {
 		ERROR (context, "Ringbuffer pointer out of range (0x%04x).", eop);
 		return DC_STATUS_DATAFORMAT;
@@ -232,8 +317,14 @@ mares_common_extract_dives (dc_context_t *context, const mares_common_layout_t *
 		return DC_STATUS_NOMEMORY;
 	}
 
-	memcpy (buffer + 0, data + eop, layout->rb_profile_end - eop);
-	memcpy (buffer + layout->rb_profile_end - eop, data + layout->rb_profile_begin, eop - layout->rb_profile_begin);
+	source->buffer = buffer;
+	source->eop = eop;
+	if (source->data) {
+		ringbuffer_copy (buffer, source->data, eop,
+			layout->rb_profile_end - layout->rb_profile_begin,
+			layout->rb_profile_begin, layout->rb_profile_end);
+		source->available = layout->rb_profile_end - layout->rb_profile_begin;
+	}
 
 	// For a freedive session, the Mares Nemo stores all the freedives of
 	// that session in a single logbook entry, and each sample is actually
@@ -245,6 +336,10 @@ mares_common_extract_dives (dc_context_t *context, const mares_common_layout_t *
 
 	unsigned int offset = layout->rb_profile_end - layout->rb_profile_begin;
 	while (offset >= 3) {
+		rc = mares_common_fetch (source, offset - 3);
+		if (rc != DC_STATUS_SUCCESS)
+			break;
+
 		// Check for the presence of extra header bytes, which can be detected
 		// by means of a three byte marker sequence.
 		unsigned int extra = 0;
@@ -260,6 +355,10 @@ mares_common_extract_dives (dc_context_t *context, const mares_common_layout_t *
 		if (offset < extra + 3)
 			break;
 
+		rc = mares_common_fetch (source, offset - extra - 3);
+		if (rc != DC_STATUS_SUCCESS)
+			break;
+
 		// Check the dive mode of the logbook entry. Valid modes are
 		// 0 (air), 1 (EANx), 2 (freedive) or 3 (bottom timer).
 		// If the ringbuffer has never reached the wrap point before,
@@ -299,20 +398,29 @@ mares_common_extract_dives (dc_context_t *context, const mares_common_layout_t *
 		// Move to the start of the dive.
 		offset -= nbytes;
 
+		rc = mares_common_fetch (source, offset);
+		if (rc != DC_STATUS_SUCCESS)
+			break;
+
 		// Verify that the length that is stored in the profile data
 		// equals the calculated length. If both values are different,
 		// something is wrong and an error is returned.
 		unsigned int length = array_uint16_le (buffer + offset);
 		if (length != nbytes) {
 			ERROR (context, "Calculated and stored size are not equal (%u %u).", length, nbytes);
-			free (buffer);
-			return DC_STATUS_DATAFORMAT;
+			rc = DC_STATUS_DATAFORMAT;
+			break;
 		}
 
 		// Process the profile data for the most recent freedive entry.
 		// Since we are processing the entries backwards (newest to oldest),
 		// this entry will always be the first one.
 		if (mode == freedive && nfreedives == 1) {
+			const unsigned char *freedives = NULL;
+			rc = mares_common_fetch_freedives (source, &freedives);
+			if (rc != DC_STATUS_SUCCESS)
+				break;
+
 			// Count the number of freedives in the profile data.
 			unsigned int count = 0;
 			unsigned int idx = layout->rb_freedives_begin;
@@ -320,7 +428,7 @@ mares_common_extract_dives (dc_context_t *context, const mares_common_layout_t *
 				count != nsamples)
 			{
 				// Each freedive in the session ends with a zero sample.
-				unsigned int sample = array_uint16_le (data + idx);
+				unsigned int sample = array_uint16_le (freedives + idx - layout->rb_freedives_begin);
 				if (sample == 0)
 					count++;
 
@@ -333,30 +441,79 @@ mares_common_extract_dives (dc_context_t *context, const mares_common_layout_t *
 			// both values are different, the profile data is incomplete.
 			if (count != nsamples) {
 				ERROR (context, "Unexpected number of freedive sessions (%u %u).", count, nsamples);
-				free (buffer);
-				return DC_STATUS_DATAFORMAT;
+				rc = DC_STATUS_DATAFORMAT;
+				break;
 			}
 
 			// Append the profile data to the main logbook entry. The
 			// buffer is guaranteed to have enough space, and the dives
 			// that will be overwritten have already been processed.
-			memcpy (buffer + offset + nbytes, data + layout->rb_freedives_begin, idx - layout->rb_freedives_begin);
+			memcpy (buffer + offset + nbytes, freedives, idx - layout->rb_freedives_begin);
 			nbytes += idx - layout->rb_freedives_begin;
 		}
 
 		unsigned int fp_offset = offset + length - extra - FP_OFFSET;
-		if (fingerprint && memcmp (buffer + fp_offset, fingerprint, FP_SIZE) == 0) {
-			free (buffer);
-			return DC_STATUS_SUCCESS;
-		}
+		if (fingerprint && memcmp (buffer + fp_offset, fingerprint, FP_SIZE) == 0)
+			break;
 
-		if (callback && !callback (buffer + offset, nbytes, buffer + fp_offset, FP_SIZE, userdata)) {
-			free (buffer);
-			return DC_STATUS_SUCCESS;
-		}
+		if (callback && !callback (buffer + offset, nbytes, buffer + fp_offset, FP_SIZE, userdata))
+			break;
 	}
 
 	free (buffer);
 
-	return DC_STATUS_SUCCESS;
+	return rc;
+}
+
+
+dc_status_t
+mares_common_extract_dives (dc_context_t *context, const mares_common_layout_t *layout, const unsigned char fingerprint[], const unsigned char data[], dc_dive_callback_t callback, void *userdata)
+{
+	assert (layout != NULL);
+
+	mares_common_source_t source = {layout, NULL, NULL, data, NULL, 0, 0, NULL};
+
+	return mares_common_extract (context, &source, fingerprint, data, callback, userdata);
+}
+
+
+dc_status_t
+mares_common_device_foreach (dc_device_t *abstract, const mares_common_layout_t *layout, const unsigned char fingerprint[], dc_dive_callback_t callback, void *userdata)
+{
+	mares_common_device_t *device = (mares_common_device_t *) abstract;
+
+	assert (layout != NULL);
+
+	// Enable progress notifications.
+	dc_event_progress_t progress = EVENT_PROGRESS_INITIALIZER;
+	progress.maximum = layout->memsize;
+	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
+
+	// Read the header, with the model number and the end of profile pointer.
+	unsigned char header[0x70] = {0};
+	assert (layout->rb_profile_begin >= sizeof (header));
+	dc_status_t rc = mares_common_device_read (abstract, 0, header, sizeof (header));
+	if (rc != DC_STATUS_SUCCESS) {
+		ERROR (abstract->context, "Failed to read the memory.");
+		return rc;
+	}
+
+	// Update and emit a progress event.
+	progress.current += sizeof (header);
+	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
+
+	// Emit a device info event.
+	dc_event_devinfo_t devinfo;
+	devinfo.model = header[1];
+	devinfo.firmware = 0;
+	devinfo.serial = array_uint16_be (header + 8);
+	device_event_emit (abstract, DC_EVENT_DEVINFO, &devinfo);
+
+	mares_common_source_t source = {layout, device, &progress, NULL, NULL, 0, 0, NULL};
+
+	rc = mares_common_extract (abstract->context, &source, fingerprint, header, callback, userdata);
+
+	free (source.freedives);
+
+	return rc;
 }
@@ -128,6 +128,10 @@ mares_darwin_device_open (dc_device_t **out, dc_context_t *context, const char *
 		goto error_free;
 	}
 
+	// Interrupt the blocking reads when the download is cancelled, and
+	// measure the time spent waiting for the I/O.
+	device_set_port ((dc_device_t *) device, device->base.port);
+
 	// Set the serial communication protocol (9600 8N1).
 	status = dc_serial_configure (device->base.port, 9600, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -239,6 +243,8 @@ mares_darwin_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback,
 	if (buffer == NULL)
 		return DC_STATUS_NOMEMORY;
 
+	device_phase (abstract, DC_PHASE_PROFILE);
+
 	dc_status_t rc = mares_darwin_device_dump (abstract, buffer);
 	if (rc != DC_STATUS_SUCCESS) {
 		dc_buffer_free (buffer);
@@ -29,6 +29,9 @@
 #include "device-private.h"
 #include "serial.h"
 #include "array.h"
+#include "ringbuffer.h"
+#include "pagecache.h"
+#include "syncstore-private.h"
 
 #define C_ARRAY_SIZE(array) (sizeof (array) / sizeof *(array))
 
@@ -46,6 +49,11 @@
 #define ACK 0xAA
 #define EOF 0xEA
 
+#define MAXRETRIES    4
+#define MINPACKETSIZE 64
+#define MAXPACKETSIZE 4096
+#define NGROW         8
+
 #define AIR       0
 #define GAUGE     1
 #define NITROX    2
@@ -70,6 +78,9 @@ typedef struct mares_iconhd_device_t {
 	unsigned char version[140];
 	unsigned int model;
 	unsigned int packetsize;
+	// Adaptive packet size, and number of consecutive successful packets.
+	unsigned int transfersize;
+	unsigned int nsuccess;
 } mares_iconhd_device_t;
 
 static dc_status_t mares_iconhd_device_set_fingerprint (dc_device_t *abstract, const unsigned char data[], unsigned int size);
@@ -231,6 +242,8 @@ mares_iconhd_device_open (dc_device_t **out, dc_context_t *context, const char *
 	memset (device->version, 0, sizeof (device->version));
 	device->model = 0;
 	device->packetsize = 0;
+	device->transfersize = 0;
+	device->nsuccess = 0;
 
 	// Open the device.
 	status = dc_serial_open (&device->port, context, name);
@@ -239,6 +252,10 @@ mares_iconhd_device_open (dc_device_t **out, dc_context_t *context, const char *
 		goto error_free;
 	}
 
+	// Interrupt the blocking reads when the download is cancelled, and
+	// measure the time spent waiting for the I/O.
+	device_set_port ((dc_device_t *) device, device->port);
+
 	// Set the serial communication protocol (115200 8E1).
 	status = dc_serial_configure (device->port, 115200, 8, DC_PARITY_EVEN, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -306,6 +323,10 @@ mares_iconhd_device_open (dc_device_t **out, dc_context_t *context, const char *
 		break;
 	}
 
+	// Start with the largest packet size.
+	device->transfersize = device->packetsize;
+	device->base.blocksize = device->packetsize;
+
 	*out = (dc_device_t *) device;
 
 	return DC_STATUS_SUCCESS;
@@ -358,12 +379,13 @@ mares_iconhd_device_read (dc_device_t *abstract, unsigned int address, unsigned
 	dc_status_t rc = DC_STATUS_SUCCESS;
 	mares_iconhd_device_t *device = (mares_iconhd_device_t *) abstract;
 
+	unsigned int nretries = 0;
 	unsigned int nbytes = 0;
 	while (nbytes < size) {
 		// Calculate the packet size.
 		unsigned int len = size - nbytes;
-		if (len > device->packetsize)
-			len = device->packetsize;
+		if (len > device->transfersize)
+			len = device->transfersize;
 
 		// Read the packet.
 		unsigned char command[] = {0xE7, 0x42,
@@ -376,9 +398,37 @@ mares_iconhd_device_read (dc_device_t *abstract, unsigned int address, unsigned
 			(len >> 16) & 0xFF,
 			(len >> 24) & 0xFF};
 		rc = mares_iconhd_transfer (device, command, sizeof (command), data, len);
-		if (rc != DC_STATUS_SUCCESS)
-			return rc;
+		if (rc != DC_STATUS_SUCCESS) {
+			// Only timeouts and corrupted packets are retried.
+			if (rc != DC_STATUS_TIMEOUT && rc != DC_STATUS_PROTOCOL)
+				return rc;
+
+			// Abort if the maximum number of retries is reached.
+			if (nretries++ >= MAXRETRIES)
+				return rc;
+
+			device_stats_retry (abstract);
 
+			// Retry with a smaller packet size.
+			if (device->transfersize > MINPACKETSIZE) {
+				device->transfersize /= 2;
+				DEBUG (abstract->context, "Packet size reduced to %u bytes.", device->transfersize);
+			}
+			device->nsuccess = 0;
+
+			// Discard any remaining data of the failed packet.
+			dc_serial_sleep (device->port, 100);
+			dc_serial_purge (device->port, DC_DIRECTION_ALL);
+			continue;
+		}
+
+		// Grow the packet size again after a number of successful packets.
+		if (++device->nsuccess >= NGROW && device->transfersize < device->packetsize) {
+			device->transfersize *= 2;
+			device->nsuccess = 0;
+		}
+
+		nretries = 0;
 		nbytes += len;
 		address += len;
 		data += len;
@@ -388,6 +438,54 @@ mares_iconhd_device_read (dc_device_t *abstract, unsigned int address, unsigned
 }
 
 
+static unsigned int
+mares_iconhd_get_eop (const unsigned char data[])
+{
+	unsigned int eop = 0;
+	const unsigned int config[] = {0x2001, 0x3001};
+	for (unsigned int i = 0; i < C_ARRAY_SIZE (config); ++i) {
+		eop = array_uint32_le (data + config[i]);
+		if (eop != 0xFFFFFFFF)
+			break;
+	}
+
+	return eop;
+}
+
+/*
+ * The packet size that worked during the previous download is remembered
+ * in the sync store (if attached), to avoid starting with a packet size
+ * that is too large for the link every time.
+ */
+static void
+mares_iconhd_hint_load (mares_iconhd_device_t *device)
+{
+	dc_device_t *abstract = (dc_device_t *) device;
+	unsigned int value = 0;
+
+	if (abstract->syncstore == NULL)
+		return;
+
+	dc_syncstore_get_hint (abstract->syncstore, DC_FAMILY_MARES_ICONHD,
+		device->model, "packetsize", &value);
+	if (value >= MINPACKETSIZE && value <= device->packetsize)
+		device->transfersize = value;
+}
+
+static void
+mares_iconhd_hint_save (mares_iconhd_device_t *device)
+{
+	dc_device_t *abstract = (dc_device_t *) device;
+
+	if (abstract->syncstore == NULL)
+		return;
+
+	if (dc_syncstore_set_hint (abstract->syncstore, DC_FAMILY_MARES_ICONHD,
+		device->model, "packetsize", device->transfersize) != DC_STATUS_SUCCESS) {
+		WARNING (abstract->context, "Failed to update the sync store.");
+	}
+}
+
 static dc_status_t
 mares_iconhd_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 {
@@ -406,22 +504,220 @@ mares_iconhd_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 	vendor.size = sizeof (device->version);
 	device_event_emit (abstract, DC_EVENT_VENDOR, &vendor);
 
-	return device_dump_read (abstract, dc_buffer_get_data (buffer),
+	mares_iconhd_hint_load (device);
+
+	dc_status_t rc = device_dump_read (abstract, dc_buffer_get_data (buffer),
 		dc_buffer_get_size (buffer), device->packetsize);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	mares_iconhd_hint_save (device);
+
+	return DC_STATUS_SUCCESS;
 }
 
 
 static dc_status_t
-mares_iconhd_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void *userdata)
+mares_iconhd_device_read_range (dc_device_t *abstract, dc_event_progress_t *progress, unsigned char data[], unsigned int begin, unsigned int end)
+{
+	mares_iconhd_device_t *device = (mares_iconhd_device_t *) abstract;
+
+	unsigned int address = begin;
+	while (address < end) {
+		// Calculate the packet size.
+		unsigned int len = end - address;
+		if (len > device->packetsize)
+			len = device->packetsize;
+
+		// Read the packet.
+		dc_status_t rc = mares_iconhd_device_read (abstract, address, data + address, len);
+		if (rc != DC_STATUS_SUCCESS)
+			return rc;
+
+		// Update and emit a progress event.
+		progress->current += len;
+		device_event_emit (abstract, DC_EVENT_PROGRESS, progress);
+
+		address += len;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+/*
+ * Download the memory, using the page cache (if enabled) to avoid reading
+ * the parts of the profile ringbuffer that didn't change since the previous
+ * download. New dives are always appended at the end of the ringbuffer, so
+ * only the range between the previous and the current end pointer needs to
+ * be read. The rest of the ringbuffer is taken from the cache, after the
+ * packet in front of the previous end pointer has been checked against it.
+ */
+static dc_status_t
+mares_iconhd_device_download (dc_device_t *abstract, dc_buffer_t *buffer)
+{
+	mares_iconhd_device_t *device = (mares_iconhd_device_t *) abstract;
+	const mares_iconhd_layout_t *layout = device->layout;
+	dc_status_t rc = DC_STATUS_SUCCESS;
+	dc_pagecache_t *cache = NULL;
+
+	if (abstract->cachedir == NULL)
+		return mares_iconhd_device_dump (abstract, buffer);
+
+	// Erase the current contents of the buffer and
+	// pre-allocate the required amount of memory.
+	if (!dc_buffer_clear (buffer) || !dc_buffer_resize (buffer, layout->memsize)) {
+		ERROR (abstract->context, "Insufficient buffer space available.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	unsigned char *data = dc_buffer_get_data (buffer);
+
+	// Emit a vendor event.
+	dc_event_vendor_t vendor;
+	vendor.data = device->version;
+	vendor.size = sizeof (device->version);
+	device_event_emit (abstract, DC_EVENT_VENDOR, &vendor);
+
+	mares_iconhd_hint_load (device);
+
+	// Enable progress notifications.
+	dc_event_progress_t progress = EVENT_PROGRESS_INITIALIZER;
+	progress.maximum = layout->memsize;
+	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
+
+	device_phase (abstract, DC_PHASE_LOGBOOK);
+
+	// Read the configuration area, with the serial number and the ringbuffer
+	// pointers, which is always located in front of the ringbuffer.
+	rc = mares_iconhd_device_read_range (abstract, &progress, data, 0, layout->rb_profile_begin);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	unsigned int serial = array_uint32_le (data + 0x0C);
+	unsigned int eop = mares_iconhd_get_eop (data);
+
+	rc = dc_pagecache_open (&cache, abstract->context, abstract->cachedir,
+		DC_FAMILY_MARES_ICONHD, serial, layout->memsize, device->packetsize);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	// By default the entire ringbuffer is downloaded.
+	unsigned int begin = layout->rb_profile_begin;
+	unsigned int end = layout->rb_profile_end;
+	unsigned int wrap = 0;
+
+	if (eop >= layout->rb_profile_begin && eop < layout->rb_profile_end &&
+		dc_pagecache_is_valid (cache, 0, layout->memsize)) {
+		// Get the end pointer of the previous download.
+		unsigned char *config = NULL;
+		unsigned int previous = 0xFFFFFFFF;
+		config = (unsigned char *) malloc (layout->rb_profile_begin);
+		if (config && dc_pagecache_get (cache, 0, config, layout->rb_profile_begin) == DC_STATUS_SUCCESS) {
+			previous = mares_iconhd_get_eop (config);
+		}
+		free (config);
+
+		if (previous >= layout->rb_profile_begin && previous < layout->rb_profile_end) {
+			// Restore the cached copy of the ringbuffer.
+			dc_pagecache_get (cache, layout->rb_profile_begin,
+				data + layout->rb_profile_begin,
+				layout->rb_profile_end - layout->rb_profile_begin);
+
+			// Align the range to packet boundaries.
+			begin = (previous / device->packetsize) * device->packetsize;
+			end = ((eop + device->packetsize - 1) / device->packetsize) * device->packetsize;
+			if (begin < layout->rb_profile_begin)
+				begin = layout->rb_profile_begin;
+			if (end > layout->rb_profile_end)
+				end = layout->rb_profile_end;
+
+			if (eop == previous)
+				end = begin;
+			else if (eop < previous)
+				wrap = 1;
+
+			// Verify the cached copy, by reading the data in front of the
+			// previous end pointer again. That data is only overwritten if
+			// the ringbuffer wrapped around completely, or the memory was
+			// reset, and then the entire ringbuffer is downloaded again.
+			unsigned int check_end = (begin > layout->rb_profile_begin ? begin : layout->rb_profile_end);
+			unsigned int check_begin = layout->rb_profile_begin;
+			if (check_end - check_begin > device->packetsize)
+				check_begin = check_end - device->packetsize;
+
+			unsigned char cached[MAXPACKETSIZE];
+			memcpy (cached, data + check_begin, check_end - check_begin);
+			rc = mares_iconhd_device_read_range (abstract, &progress, data, check_begin, check_end);
+			if (rc != DC_STATUS_SUCCESS) {
+				dc_pagecache_close (cache);
+				return rc;
+			}
+
+			if (memcmp (cached, data + check_begin, check_end - check_begin) != 0) {
+				WARNING (abstract->context, "The cached ringbuffer is out of date.");
+				begin = layout->rb_profile_begin;
+				end = layout->rb_profile_end;
+				wrap = 0;
+			}
+		}
+	}
+
+	device_phase (abstract, DC_PHASE_PROFILE);
+
+	// Update the total amount of data to download.
+	unsigned int nbytes = (wrap ?
+		(layout->rb_profile_end - begin) + (end - layout->rb_profile_begin) :
+		end - begin);
+	progress.maximum = progress.current + nbytes;
+	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
+
+	// Read the modified parts of the ringbuffer.
+	if (wrap) {
+		rc = mares_iconhd_device_read_range (abstract, &progress, data, begin, layout->rb_profile_end);
+		if (rc == DC_STATUS_SUCCESS)
+			rc = mares_iconhd_device_read_range (abstract, &progress, data, layout->rb_profile_begin, end);
+	} else {
+		rc = mares_iconhd_device_read_range (abstract, &progress, data, begin, end);
+	}
+	if (rc != DC_STATUS_SUCCESS) {
+		dc_pagecache_close (cache);
+		return rc;
+	}
+
+	// Read the area behind the ringbuffer (if any).
+	rc = mares_iconhd_device_read_range (abstract, &progress, data, layout->rb_profile_end, layout->memsize);
+	if (rc != DC_STATUS_SUCCESS) {
+		dc_pagecache_close (cache);
+		return rc;
+	}
+
+	// Update the cache. A failure is not fatal, because the data has
+	// already been downloaded successfully.
+	dc_pagecache_set (cache, 0, data, layout->memsize);
+	if (dc_pagecache_save (cache) != DC_STATUS_SUCCESS) {
+		WARNING (abstract->context, "Failed to update the page cache.");
+	}
+
+	dc_pagecache_close (cache);
+
+	mares_iconhd_hint_save (device);
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+mares_iconhd_device_foreach_full (dc_device_t *abstract, dc_dive_callback_t callback, void *userdata)
 {
 	mares_iconhd_device_t *device = (mares_iconhd_device_t *) abstract;
 
 	dc_buffer_t *buffer = dc_buffer_new (device->layout->memsize);
 	if (buffer == NULL)
 		return DC_STATUS_NOMEMORY;
+	device_memory_add (abstract, device->layout->memsize);
 
-	dc_status_t rc = mares_iconhd_device_dump (abstract, buffer);
+	dc_status_t rc = mares_iconhd_device_download (abstract, buffer);
 	if (rc != DC_STATUS_SUCCESS) {
+		device_memory_sub (abstract, device->layout->memsize);
 		dc_buffer_free (buffer);
 		return rc;
 	}
@@ -437,28 +733,72 @@ mares_iconhd_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback,
 	rc = mares_iconhd_extract_dives (abstract, dc_buffer_get_data (buffer),
 		dc_buffer_get_size (buffer), callback, userdata);
 
+	device_memory_sub (abstract, device->layout->memsize);
 	dc_buffer_free (buffer);
 
 	return rc;
 }
 
 
-dc_status_t
-mares_iconhd_extract_dives (dc_device_t *abstract, const unsigned char data[], unsigned int size, dc_dive_callback_t callback, void *userdata)
+/*
+ * State for reading the profile ringbuffer on demand. The ringbuffer is
+ * made linear in memory, with the end of profile pointer located at the
+ * end of the buffer, and filled backwards while the dives are processed.
+ */
+typedef struct mares_iconhd_stream_t {
+	dc_event_progress_t *progress;
+	unsigned int eop;
+	unsigned int available;
+} mares_iconhd_stream_t;
+
+static dc_status_t
+mares_iconhd_stream_fetch (mares_iconhd_device_t *device, mares_iconhd_stream_t *stream, unsigned char buffer[], unsigned int offset)
 {
-	mares_iconhd_device_t *device = (mares_iconhd_device_t *) abstract;
-	dc_context_t *context = (abstract ? abstract->context : NULL);
+	dc_device_t *abstract = (dc_device_t *) device;
+	const mares_iconhd_layout_t *layout = device->layout;
+	const unsigned int rb_size = layout->rb_profile_end - layout->rb_profile_begin;
 
-	if (!ISINSTANCE (abstract))
-		return DC_STATUS_INVALIDARGS;
+	// All data is available already.
+	if (stream == NULL || offset >= stream->available)
+		return DC_STATUS_SUCCESS;
 
-	const mares_iconhd_layout_t *layout = device->layout;
+	// Read whole packets, to reduce the number of requests.
+	unsigned int begin = 0;
+	unsigned int length = stream->available - offset;
+	length = ((length + device->packetsize - 1) / device->packetsize) * device->packetsize;
+	if (length < stream->available)
+		begin = stream->available - length;
 
-	if (size < layout->memsize)
-		return DC_STATUS_DATAFORMAT;
+	// Translate the linear offset to the physical address.
+	unsigned int address = layout->rb_profile_begin +
+		(stream->eop - layout->rb_profile_begin + begin) % rb_size;
 
-	// Get the model code.
-	unsigned int model = device ? device->model : data[0];
+	ringbuffer_segment_t segments[2];
+	unsigned int n = ringbuffer_segments (address, stream->available - begin,
+		layout->rb_profile_begin, layout->rb_profile_end, segments);
+
+	unsigned int nbytes = 0;
+	for (unsigned int i = 0; i < n; ++i) {
+		dc_status_t rc = mares_iconhd_device_read (abstract, segments[i].offset,
+			buffer + begin + nbytes, segments[i].size);
+		if (rc != DC_STATUS_SUCCESS)
+			return rc;
+
+		nbytes += segments[i].size;
+	}
+
+	stream->progress->current += stream->available - begin;
+	device_event_emit (abstract, DC_EVENT_PROGRESS, stream->progress);
+
+	stream->available = begin;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+mares_iconhd_extract (mares_iconhd_device_t *device, dc_context_t *context, unsigned int model, unsigned char buffer[], unsigned int size, mares_iconhd_stream_t *stream, dc_dive_callback_t callback, void *userdata)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
 
 	// Get the corresponding dive header size.
 	unsigned int header = 0x5C;
@@ -469,33 +809,12 @@ mares_iconhd_extract_dives (dc_device_t *abstract, const unsigned char data[], u
 	else if (model == SMARTAPNEA)
 		header = 6; // Type and number of samples only!
 
-	// Get the end of the profile ring buffer.
-	unsigned int eop = 0;
-	const unsigned int config[] = {0x2001, 0x3001};
-	for (unsigned int i = 0; i < sizeof (config) / sizeof (*config); ++i) {
-		eop = array_uint32_le (data + config[i]);
-		if (eop != 0xFFFFFFFF)
-			break;
-	}
-	if (eop < layout->rb_profile_begin || eop >= layout->rb_profile_end) {
-		if (eop == 0xFFFFFFFF)
-			return DC_STATUS_SUCCESS; // No dives available.
-		ERROR (context, "Ringbuffer pointer out of range (0x%08x).", eop);
-		return DC_STATUS_DATAFORMAT;
-	}
-
-	// Make the ringbuffer linear, to avoid having to deal with the wrap point.
-	unsigned char *buffer = (unsigned char *) malloc (layout->rb_profile_end - layout->rb_profile_begin);
-	if (buffer == NULL) {
-		ERROR (context, "Failed to allocate memory.");
-		return DC_STATUS_NOMEMORY;
-	}
-
-	memcpy (buffer + 0, data + eop, layout->rb_profile_end - eop);
-	memcpy (buffer + layout->rb_profile_end - eop, data + layout->rb_profile_begin, eop - layout->rb_profile_begin);
-
-	unsigned int offset = layout->rb_profile_end - layout->rb_profile_begin;
+	unsigned int offset = size;
 	while (offset >= header + 4) {
+		rc = mares_iconhd_stream_fetch (device, stream, buffer, offset - header);
+		if (rc != DC_STATUS_SUCCESS)
+			return rc;
+
 		// Get the number of samples in the profile data.
 		unsigned int type = 0, nsamples = 0;
 		if (model == SMART || model == SMARTAPNEA) {
@@ -545,6 +864,10 @@ mares_iconhd_extract_dives (dc_device_t *abstract, const unsigned char data[], u
 			if (offset < headersize)
 				break;
 
+			rc = mares_iconhd_stream_fetch (device, stream, buffer, offset - headersize);
+			if (rc != DC_STATUS_SUCCESS)
+				return rc;
+
 			unsigned int settings = array_uint16_le (buffer + offset - headersize + 0x1C);
 			unsigned int divetime = array_uint32_le (buffer + offset - headersize + 0x24);
 			unsigned int samplerate = 1 << ((settings >> 9) & 0x03);
@@ -557,6 +880,10 @@ mares_iconhd_extract_dives (dc_device_t *abstract, const unsigned char data[], u
 		// Move to the start of the dive.
 		offset -= nbytes;
 
+		rc = mares_iconhd_stream_fetch (device, stream, buffer, offset);
+		if (rc != DC_STATUS_SUCCESS)
+			return rc;
+
 		// Verify that the length that is stored in the profile data
 		// equals the calculated length. If both values are different,
 		// we assume we reached the last dive.
@@ -566,17 +893,148 @@ mares_iconhd_extract_dives (dc_device_t *abstract, const unsigned char data[], u
 
 		unsigned char *fp = buffer + offset + length - headersize + fingerprint;
 		if (device && memcmp (fp, device->fingerprint, sizeof (device->fingerprint)) == 0) {
-			free (buffer);
 			return DC_STATUS_SUCCESS;
 		}
 
 		if (callback && !callback (buffer + offset, length, fp, sizeof (device->fingerprint), userdata)) {
-			free (buffer);
 			return DC_STATUS_SUCCESS;
 		}
 	}
 
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+mares_iconhd_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void *userdata)
+{
+	mares_iconhd_device_t *device = (mares_iconhd_device_t *) abstract;
+	const mares_iconhd_layout_t *layout = device->layout;
+	const unsigned int rb_size = layout->rb_profile_end - layout->rb_profile_begin;
+	dc_status_t rc = DC_STATUS_SUCCESS;
+
+	// With the page cache enabled, the memory is downloaded and cached
+	// as a whole, and the dives are extracted afterwards.
+	if (abstract->cachedir)
+		return mares_iconhd_device_foreach_full (abstract, callback, userdata);
+
+	// Emit a vendor event.
+	dc_event_vendor_t vendor;
+	vendor.data = device->version;
+	vendor.size = sizeof (device->version);
+	device_event_emit (abstract, DC_EVENT_VENDOR, &vendor);
+
+	mares_iconhd_hint_load (device);
+
+	// Enable progress notifications. The amount of data to download is
+	// not known in advance, because the download stops at the first dive
+	// that was already downloaded before.
+	dc_event_progress_t progress = EVENT_PROGRESS_INITIALIZER;
+	progress.maximum = rb_size;
+	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
+
+	// Read the serial number and the end of profile pointer. Only the
+	// parts that are needed are read, not the entire configuration area.
+	unsigned char config[0x3001 + 4];
+	memset (config, 0xFF, sizeof (config));
+	const unsigned int ranges[][2] = {
+		{0x0000, 0x10},
+		{0x2001, 4},
+		{0x3001, 4},
+	};
+	for (unsigned int i = 0; i < C_ARRAY_SIZE (ranges); ++i) {
+		if (i == 2 && array_uint32_le (config + 0x2001) != 0xFFFFFFFF)
+			break;
+
+		rc = mares_iconhd_device_read (abstract, ranges[i][0], config + ranges[i][0], ranges[i][1]);
+		if (rc != DC_STATUS_SUCCESS)
+			return rc;
+	}
+
+	// Emit a device info event.
+	dc_event_devinfo_t devinfo;
+	devinfo.model = device->model;
+	devinfo.firmware = 0;
+	devinfo.serial = array_uint32_le (config + 0x0C);
+	device_event_emit (abstract, DC_EVENT_DEVINFO, &devinfo);
+
+	// Get the end of the profile ring buffer.
+	unsigned int eop = mares_iconhd_get_eop (config);
+	if (eop < layout->rb_profile_begin || eop >= layout->rb_profile_end) {
+		if (eop == 0xFFFFFFFF)
+			return DC_STATUS_SUCCESS; // No dives available.
+		ERROR (abstract->context, "Ringbuffer pointer out of range (0x%08x).", eop);
+		return DC_STATUS_DATAFORMAT;
+	}
+
+	unsigned char *buffer = (unsigned char *) malloc (rb_size);
+	if (buffer == NULL) {
+		ERROR (abstract->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	mares_iconhd_stream_t stream;
+	stream.progress = &progress;
+	stream.eop = eop;
+	stream.available = rb_size;
+
+	rc = mares_iconhd_extract (device, abstract->context, device->model,
+		buffer, rb_size, &stream, callback, userdata);
+
 	free (buffer);
 
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	mares_iconhd_hint_save (device);
+
+	progress.current = progress.maximum;
+	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
+
 	return DC_STATUS_SUCCESS;
 }
+
+
+dc_status_t
+mares_iconhd_extract_dives (dc_device_t *abstract, const unsigned char data[], unsigned int size, dc_dive_callback_t callback, void *userdata)
+{
+	mares_iconhd_device_t *device = (mares_iconhd_device_t *) abstract;
+	dc_context_t *context = (abstract ? abstract->context : NULL);
+
+	if (!ISINSTANCE (abstract))
+		return DC_STATUS_INVALIDARGS;
+
+	const mares_iconhd_layout_t *layout = device->layout;
+
+	if (size < layout->memsize)
+		return DC_STATUS_DATAFORMAT;
+
+	// Get the model code.
+	unsigned int model = device ? device->model : data[0];
+
+	// Get the end of the profile ring buffer.
+	unsigned int eop = mares_iconhd_get_eop (data);
+	if (eop < layout->rb_profile_begin || eop >= layout->rb_profile_end) {
+		if (eop == 0xFFFFFFFF)
+			return DC_STATUS_SUCCESS; // No dives available.
+		ERROR (context, "Ringbuffer pointer out of range (0x%08x).", eop);
+		return DC_STATUS_DATAFORMAT;
+	}
+
+	// Make the ringbuffer linear, to avoid having to deal with the wrap point.
+	unsigned char *buffer = (unsigned char *) malloc (layout->rb_profile_end - layout->rb_profile_begin);
+	if (buffer == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	ringbuffer_copy (buffer, data, eop,
+		layout->rb_profile_end - layout->rb_profile_begin,
+		layout->rb_profile_begin, layout->rb_profile_end);
+
+	dc_status_t rc = mares_iconhd_extract (device, context, model, buffer,
+		layout->rb_profile_end - layout->rb_profile_begin, NULL, callback, userdata);
+
+	free (buffer);
+
+	return rc;
+}
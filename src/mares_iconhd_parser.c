@@ -19,6 +19,8 @@
  * MA 02110-1301 USA
  */
 
+#define DC_LOG_CATEGORY DC_LOGCATEGORY_PARSER
+
 #include <stdlib.h>
 
 #include <libdivecomputer/mares_iconhd.h>
@@ -41,6 +43,11 @@
 #define NITROX    2
 #define FREEDIVE  3
 
+// Sample layouts
+#define LAYOUT_DIVE     0 // Regular samples
+#define LAYOUT_FREEDIVE 1 // Summary of each freedive
+#define LAYOUT_APNEA    2 // Summary and profile of each freedive
+
 typedef struct mares_iconhd_parser_t mares_iconhd_parser_t;
 
 struct mares_iconhd_parser_t {
@@ -52,14 +59,24 @@ struct mares_iconhd_parser_t {
 	unsigned int nsamples;
 	unsigned int footer;
 	unsigned int samplesize;
+	unsigned int layout;
+	unsigned int interval;
+	unsigned int samplerate;
 	unsigned int ngasmixes;
 	unsigned int oxygen[NGASMIXES];
+	// Freedive session.
+	unsigned int have_subdives;
+	parser_subdive_t *subdives;
+	unsigned int subdives_capacity;
 };
 
 static dc_status_t mares_iconhd_parser_set_data (dc_parser_t *abstract, const unsigned char *data, unsigned int size);
 static dc_status_t mares_iconhd_parser_get_datetime (dc_parser_t *abstract, dc_datetime_t *datetime);
 static dc_status_t mares_iconhd_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsigned int flags, void *value);
 static dc_status_t mares_iconhd_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata);
+static dc_status_t mares_iconhd_parser_samples_extract (dc_parser_t *abstract, dc_sample_columns_t *columns);
+static dc_status_t mares_iconhd_parser_subdives (dc_parser_t *abstract, const parser_subdive_t **table, unsigned int *count);
+static dc_status_t mares_iconhd_parser_destroy (dc_parser_t *abstract);
 
 static const dc_parser_vtable_t mares_iconhd_parser_vtable = {
 	sizeof(mares_iconhd_parser_t),
@@ -68,7 +85,15 @@ static const dc_parser_vtable_t mares_iconhd_parser_vtable = {
 	mares_iconhd_parser_get_datetime, /* datetime */
 	mares_iconhd_parser_get_field, /* fields */
 	mares_iconhd_parser_samples_foreach, /* samples_foreach */
-	NULL /* destroy */
+	mares_iconhd_parser_samples_extract, /* samples_extract */
+	NULL, /* samples_range */
+	NULL, /* samples_seek */
+	NULL, /* samples_index */
+	NULL, /* samples_split */
+	NULL, /* samples_chunk */
+	mares_iconhd_parser_subdives, /* subdives */
+	NULL, /* samples_vendor */
+	mares_iconhd_parser_destroy /* destroy */
 };
 
 static dc_status_t
@@ -154,6 +179,19 @@ mares_iconhd_parser_cache (mares_iconhd_parser_t *parser)
 		return DC_STATUS_DATAFORMAT;
 	}
 
+	// Get the sample layout.
+	unsigned int layout = LAYOUT_DIVE;
+	unsigned int interval = 5;
+	unsigned int samplerate = 1;
+	if (parser->model == SMARTAPNEA) {
+		unsigned int settings = array_uint16_le (data + length - headersize + 0x1C);
+		layout = LAYOUT_APNEA;
+		interval = 1;
+		samplerate = 1 << ((settings >> 9) & 0x03);
+	} else if (mode == FREEDIVE) {
+		layout = LAYOUT_FREEDIVE;
+	}
+
 	const unsigned char *p = data + length - headersize;
 	if (parser->model != SMART && parser->model != SMARTAPNEA) {
 		p += 4;
@@ -185,6 +223,9 @@ mares_iconhd_parser_cache (mares_iconhd_parser_t *parser)
 	parser->nsamples = nsamples;
 	parser->footer = length - headersize;
 	parser->samplesize = samplesize;
+	parser->layout = layout;
+	parser->interval = interval;
+	parser->samplerate = samplerate;
 	parser->ngasmixes = ngasmixes;
 	for (unsigned int i = 0; i < ngasmixes; ++i) {
 		parser->oxygen[i] = oxygen[i];
@@ -217,10 +258,16 @@ mares_iconhd_parser_create (dc_parser_t **out, dc_context_t *context, unsigned i
 	parser->nsamples = 0;
 	parser->footer = 0;
 	parser->samplesize = 0;
+	parser->layout = LAYOUT_DIVE;
+	parser->interval = 0;
+	parser->samplerate = 0;
 	parser->ngasmixes = 0;
 	for (unsigned int i = 0; i < NGASMIXES; ++i) {
 		parser->oxygen[i] = 0;
 	}
+	parser->have_subdives = 0;
+	parser->subdives = NULL;
+	parser->subdives_capacity = 0;
 
 	*out = (dc_parser_t*) parser;
 
@@ -239,10 +286,25 @@ mares_iconhd_parser_set_data (dc_parser_t *abstract, const unsigned char *data,
 	parser->nsamples = 0;
 	parser->footer = 0;
 	parser->samplesize = 0;
+	parser->layout = LAYOUT_DIVE;
+	parser->interval = 0;
+	parser->samplerate = 0;
 	parser->ngasmixes = 0;
 	for (unsigned int i = 0; i < NGASMIXES; ++i) {
 		parser->oxygen[i] = 0;
 	}
+	parser->have_subdives = 0;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+static dc_status_t
+mares_iconhd_parser_destroy (dc_parser_t *abstract)
+{
+	mares_iconhd_parser_t *parser = (mares_iconhd_parser_t *) abstract;
+
+	free (parser->subdives);
 
 	return DC_STATUS_SUCCESS;
 }
@@ -385,147 +447,341 @@ mares_iconhd_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsi
 
 
 static dc_status_t
-mares_iconhd_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata)
+mares_iconhd_parser_samples_apnea (mares_iconhd_parser_t *parser, dc_sample_callback_t callback, void *userdata)
 {
-	mares_iconhd_parser_t *parser = (mares_iconhd_parser_t *) abstract;
+	dc_parser_t *abstract = (dc_parser_t *) parser;
+	const unsigned char *data = abstract->data;
+	unsigned int samplerate = parser->samplerate;
+
+	if (samplerate > 1) {
+		// The Smart Apnea supports multiple samples per second
+		// (e.g. 2, 4 or 8). Since our smallest unit of time is one
+		// second, we can't represent this, and the extra samples
+		// will get dropped.
+		WARNING(abstract->context, "Multiple samples per second are not supported!");
+	}
 
-	// Cache the parser data.
-	dc_status_t rc = mares_iconhd_parser_cache (parser);
-	if (rc != DC_STATUS_SUCCESS)
-		return rc;
+	unsigned int time = 0;
+	unsigned int offset = 4;
+	for (unsigned int n = 0; n < parser->nsamples; ++n) {
+		dc_sample_value_t sample = {0};
+
+		unsigned int divetime = array_uint16_le (data + offset + 2);
+		unsigned int surftime = array_uint16_le (data + offset + 4);
+
+		// Surface Time (seconds).
+		time += surftime;
+		sample.time = time;
+		if (callback) callback (DC_SAMPLE_TIME, sample, userdata);
+
+		// Surface Depth (0 m).
+		sample.depth = 0.0;
+		if (callback) callback (DC_SAMPLE_DEPTH, sample, userdata);
+
+		offset += parser->samplesize;
+
+		for (unsigned int i = 0; i < divetime; ++i) {
+			// Time (seconds).
+			time += parser->interval;
+			sample.time = time;
+			if (callback) callback (DC_SAMPLE_TIME, sample, userdata);
+
+			// Depth (1/10 m).
+			unsigned int depth = array_uint16_le (data + offset);
+			sample.depth = depth / 10.0;
+			if (callback) callback (DC_SAMPLE_DEPTH, sample, userdata);
 
+			offset += 2 * samplerate;
+		}
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+static dc_status_t
+mares_iconhd_parser_samples_freedive (mares_iconhd_parser_t *parser, dc_sample_callback_t callback, void *userdata)
+{
+	dc_parser_t *abstract = (dc_parser_t *) parser;
 	const unsigned char *data = abstract->data;
 
 	unsigned int time = 0;
-	unsigned int interval = 5;
-	unsigned int samplerate = 1;
-	if (parser->model == SMARTAPNEA) {
-		unsigned int settings = array_uint16_le (data + parser->footer + 0x1C);
-		samplerate = 1 << ((settings >> 9) & 0x03);
-		if (samplerate > 1) {
-			// The Smart Apnea supports multiple samples per second
-			// (e.g. 2, 4 or 8). Since our smallest unit of time is one
-			// second, we can't represent this, and the extra samples
-			// will get dropped.
-			WARNING(abstract->context, "Multiple samples per second are not supported!");
-		}
-		interval = 1;
+	unsigned int offset = 4;
+	for (unsigned int n = 0; n < parser->nsamples; ++n) {
+		dc_sample_value_t sample = {0};
+
+		unsigned int maxdepth = array_uint16_le (data + offset + 0);
+		unsigned int divetime = array_uint16_le (data + offset + 2);
+		unsigned int surftime = array_uint16_le (data + offset + 4);
+
+		// Surface Time (seconds).
+		time += surftime;
+		sample.time = time;
+		if (callback) callback (DC_SAMPLE_TIME, sample, userdata);
+
+		// Surface Depth (0 m).
+		sample.depth = 0.0;
+		if (callback) callback (DC_SAMPLE_DEPTH, sample, userdata);
+
+		// Dive Time (seconds).
+		time += divetime;
+		sample.time = time;
+		if (callback) callback (DC_SAMPLE_TIME, sample, userdata);
+
+		// Maximum Depth (1/10 m).
+		sample.depth = maxdepth / 10.0;
+		if (callback) callback (DC_SAMPLE_DEPTH, sample, userdata);
+
+		offset += parser->samplesize;
 	}
 
+	return DC_STATUS_SUCCESS;
+}
+
+
+static dc_status_t
+mares_iconhd_parser_samples_dive (mares_iconhd_parser_t *parser, dc_sample_callback_t callback, void *userdata)
+{
+	dc_parser_t *abstract = (dc_parser_t *) parser;
+	const unsigned char *data = abstract->data;
+
 	// Previous gas mix - initialize with impossible value
 	unsigned int gasmix_previous = 0xFFFFFFFF;
 
+	unsigned int time = 0;
 	unsigned int offset = 4;
 	unsigned int nsamples = 0;
 	while (nsamples < parser->nsamples) {
 		dc_sample_value_t sample = {0};
 
-		if (parser->model == SMARTAPNEA) {
-			unsigned int maxdepth = array_uint16_le (data + offset + 0);
-			unsigned int divetime = array_uint16_le (data + offset + 2);
-			unsigned int surftime = array_uint16_le (data + offset + 4);
+		// Time (seconds).
+		time += parser->interval;
+		sample.time = time;
+		if (callback) callback (DC_SAMPLE_TIME, sample, userdata);
+
+		// Depth (1/10 m).
+		unsigned int depth = array_uint16_le (data + offset + 0);
+		sample.depth = depth / 10.0;
+		if (callback) callback (DC_SAMPLE_DEPTH, sample, userdata);
+
+		// Temperature (1/10 °C).
+		unsigned int temperature = array_uint16_le (data + offset + 2) & 0x0FFF;
+		sample.temperature = temperature / 10.0;
+		if (callback) callback (DC_SAMPLE_TEMPERATURE, sample, userdata);
+
+		// Current gas mix
+		if (parser->ngasmixes > 0) {
+			unsigned int gasmix = (data[offset + 3] & 0xF0) >> 4;
+			if (gasmix >= parser->ngasmixes) {
+				ERROR (abstract->context, "Invalid gas mix index.");
+				return DC_STATUS_DATAFORMAT;
+			}
+			if (gasmix != gasmix_previous) {
+				sample.gasmix = gasmix;
+				if (callback) callback (DC_SAMPLE_GASMIX, sample, userdata);
+#ifdef ENABLE_DEPRECATED
+				sample.event.type = SAMPLE_EVENT_GASCHANGE;
+				sample.event.time = 0;
+				sample.event.value = parser->oxygen[gasmix];
+				if (callback) callback (DC_SAMPLE_EVENT, sample, userdata);
+#endif
+				gasmix_previous = gasmix;
+			}
+		}
 
-			// Surface Time (seconds).
-			time += surftime;
-			sample.time = time;
-			if (callback) callback (DC_SAMPLE_TIME, sample, userdata);
+		offset += parser->samplesize;
+		nsamples++;
 
-			// Surface Depth (0 m).
-			sample.depth = 0.0;
-			if (callback) callback (DC_SAMPLE_DEPTH, sample, userdata);
+		// Some extra data.
+		if (parser->model == ICONHDNET && (nsamples % 4) == 0) {
+			// Pressure (1/100 bar).
+			unsigned int pressure = array_uint16_le(data + offset);
+			sample.pressure.tank = 0;
+			sample.pressure.value = pressure / 100.0;
+			if (callback) callback (DC_SAMPLE_PRESSURE, sample, userdata);
 
-			offset += parser->samplesize;
-			nsamples++;
+			offset += 8;
+		}
+	}
 
-			for (unsigned int i = 0; i < divetime; ++i) {
-				// Time (seconds).
-				time += interval;
-				sample.time = time;
-				if (callback) callback (DC_SAMPLE_TIME, sample, userdata);
+	return DC_STATUS_SUCCESS;
+}
 
-				// Depth (1/10 m).
-				unsigned int depth = array_uint16_le (data + offset);
-				sample.depth = depth / 10.0;
-				if (callback) callback (DC_SAMPLE_DEPTH, sample, userdata);
 
-				offset += 2 * samplerate;
-			}
-		} else if (parser->mode == FREEDIVE) {
-			unsigned int maxdepth = array_uint16_le (data + offset + 0);
-			unsigned int divetime = array_uint16_le (data + offset + 2);
-			unsigned int surftime = array_uint16_le (data + offset + 4);
+static dc_status_t
+mares_iconhd_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata)
+{
+	mares_iconhd_parser_t *parser = (mares_iconhd_parser_t *) abstract;
 
-			// Surface Time (seconds).
-			time += surftime;
-			sample.time = time;
-			if (callback) callback (DC_SAMPLE_TIME, sample, userdata);
+	// Cache the parser data.
+	dc_status_t rc = mares_iconhd_parser_cache (parser);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
 
-			// Surface Depth (0 m).
-			sample.depth = 0.0;
-			if (callback) callback (DC_SAMPLE_DEPTH, sample, userdata);
+	switch (parser->layout) {
+	case LAYOUT_APNEA:
+		return mares_iconhd_parser_samples_apnea (parser, callback, userdata);
+	case LAYOUT_FREEDIVE:
+		return mares_iconhd_parser_samples_freedive (parser, callback, userdata);
+	default:
+		return mares_iconhd_parser_samples_dive (parser, callback, userdata);
+	}
+}
 
-			// Dive Time (seconds).
-			time += divetime;
-			sample.time = time;
-			if (callback) callback (DC_SAMPLE_TIME, sample, userdata);
 
-			// Maximum Depth (1/10 m).
-			sample.depth = maxdepth / 10.0;
-			if (callback) callback (DC_SAMPLE_DEPTH, sample, userdata);
+static dc_status_t
+mares_iconhd_parser_samples_extract (dc_parser_t *abstract, dc_sample_columns_t *columns)
+{
+	mares_iconhd_parser_t *parser = (mares_iconhd_parser_t *) abstract;
 
-			offset += parser->samplesize;
-			nsamples++;
-		} else {
-			// Time (seconds).
-			time += interval;
-			sample.time = time;
-			if (callback) callback (DC_SAMPLE_TIME, sample, userdata);
+	// Cache the parser data.
+	dc_status_t rc = mares_iconhd_parser_cache (parser);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
 
-			// Depth (1/10 m).
-			unsigned int depth = array_uint16_le (data + offset + 0);
-			sample.depth = depth / 10.0;
-			if (callback) callback (DC_SAMPLE_DEPTH, sample, userdata);
+	// The freedive sessions have a variable layout, and only a few
+	// samples per freedive.
+	if (parser->layout != LAYOUT_DIVE)
+		return mares_iconhd_parser_samples_foreach (abstract, sample_columns_cb, columns);
 
-			// Temperature (1/10 °C).
-			unsigned int temperature = array_uint16_le (data + offset + 2) & 0x0FFF;
-			sample.temperature = temperature / 10.0;
-			if (callback) callback (DC_SAMPLE_TEMPERATURE, sample, userdata);
-
-			// Current gas mix
-			if (parser->ngasmixes > 0) {
-				unsigned int gasmix = (data[offset + 3] & 0xF0) >> 4;
-				if (gasmix >= parser->ngasmixes) {
-					ERROR (abstract->context, "Invalid gas mix index.");
-					return DC_STATUS_DATAFORMAT;
-				}
-				if (gasmix != gasmix_previous) {
-					sample.gasmix = gasmix;
-					if (callback) callback (DC_SAMPLE_GASMIX, sample, userdata);
-#ifdef ENABLE_DEPRECATED
-					sample.event.type = SAMPLE_EVENT_GASCHANGE;
-					sample.event.time = 0;
-					sample.event.value = parser->oxygen[gasmix];
-					if (callback) callback (DC_SAMPLE_EVENT, sample, userdata);
-#endif
-					gasmix_previous = gasmix;
-				}
+	// The Icon HD Net Ready stores an extra 8 byte record, with the
+	// tank pressure, after every 4 samples.
+	unsigned int extra = 0;
+	if (parser->model == ICONHDNET)
+		extra = 8;
+
+	const unsigned char *data = abstract->data + 4;
+	unsigned int samplesize = parser->samplesize;
+	unsigned int nsamples = parser->nsamples;
+	unsigned int n = sample_columns_interval (columns, nsamples, parser->interval);
+
+	if (columns->depth) {
+		double *depth = columns->depth;
+		for (unsigned int i = 0; i < n; ++i) {
+			const unsigned char *p = data + i * samplesize + (i / 4) * extra;
+			depth[i] = array_uint16_le (p + 0) / 10.0;
+		}
+	}
+
+	if (columns->temperature) {
+		double *temperature = columns->temperature;
+		for (unsigned int i = 0; i < n; ++i) {
+			const unsigned char *p = data + i * samplesize + (i / 4) * extra;
+			temperature[i] = (array_uint16_le (p + 2) & 0x0FFF) / 10.0;
+		}
+	}
+
+	// Only the gas switches are reported, but every gas mix index is
+	// validated, as in the sample callback.
+	if (parser->ngasmixes > 0) {
+		unsigned int *gasmix = columns->gasmix;
+		unsigned int previous = 0xFFFFFFFF;
+		for (unsigned int i = 0; i < nsamples; ++i) {
+			const unsigned char *p = data + i * samplesize + (i / 4) * extra;
+			unsigned int value = (p[3] & 0xF0) >> 4;
+			if (value >= parser->ngasmixes) {
+				ERROR (abstract->context, "Invalid gas mix index.");
+				return DC_STATUS_DATAFORMAT;
 			}
+			if (value != previous && gasmix && i < n)
+				gasmix[i] = value;
+			previous = value;
+		}
+	}
+
+	if (extra && columns->ntanks && columns->pressure[0]) {
+		double *pressure = columns->pressure[0];
+		for (unsigned int i = 3; i < n; i += 4) {
+			const unsigned char *p = data + (i + 1) * samplesize + (i / 4) * extra;
+			pressure[i] = array_uint16_le (p) / 100.0;
+		}
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+static dc_status_t
+mares_iconhd_parser_subdives (dc_parser_t *abstract, const parser_subdive_t **table, unsigned int *count)
+{
+	mares_iconhd_parser_t *parser = (mares_iconhd_parser_t *) abstract;
+
+	// Cache the parser data.
+	dc_status_t rc = mares_iconhd_parser_cache (parser);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	if (parser->layout == LAYOUT_DIVE)
+		return DC_STATUS_UNSUPPORTED;
 
-			offset += parser->samplesize;
-			nsamples++;
+	if (parser->have_subdives) {
+		*table = parser->subdives;
+		*count = parser->nsamples;
+		return DC_STATUS_SUCCESS;
+	}
 
-			// Some extra data.
-			if (parser->model == ICONHDNET && (nsamples % 4) == 0) {
-				// Pressure (1/100 bar).
-				unsigned int pressure = array_uint16_le(data + offset);
-				sample.pressure.tank = 0;
-				sample.pressure.value = pressure / 100.0;
-				if (callback) callback (DC_SAMPLE_PRESSURE, sample, userdata);
+	const unsigned char *data = abstract->data;
 
-				offset += 8;
+	if (parser->nsamples > parser->subdives_capacity) {
+		parser_subdive_t *subdives = (parser_subdive_t *) realloc (parser->subdives, parser->nsamples * sizeof (parser_subdive_t));
+		if (subdives == NULL) {
+			ERROR (abstract->context, "Failed to allocate memory.");
+			return DC_STATUS_NOMEMORY;
+		}
+		parser_memory_add (abstract, (parser->nsamples - parser->subdives_capacity) * sizeof (parser_subdive_t));
+		parser->subdives = subdives;
+		parser->subdives_capacity = parser->nsamples;
+	}
+
+	// Only the Smart Apnea stores the profile of each freedive, directly
+	// after its summary. Of multiple samples per second, only the first
+	// one is used.
+	unsigned int stride = 0;
+	if (parser->layout == LAYOUT_APNEA)
+		stride = 2 * parser->samplerate;
+
+	unsigned int time = 0;
+	unsigned int offset = 4;
+	for (unsigned int i = 0; i < parser->nsamples; ++i) {
+		parser_subdive_t *entry = parser->subdives + i;
+
+		if (offset + parser->samplesize > parser->footer) {
+			ERROR (abstract->context, "Buffer overflow detected!");
+			return DC_STATUS_DATAFORMAT;
+		}
+
+		unsigned int maxdepth = array_uint16_le (data + offset + 0);
+		unsigned int divetime = array_uint16_le (data + offset + 2);
+		unsigned int surftime = array_uint16_le (data + offset + 4);
+		offset += parser->samplesize;
+
+		time += surftime;
+
+		entry->info.time = time;
+		entry->info.divetime = divetime;
+		entry->info.surftime = surftime;
+		entry->info.maxdepth = maxdepth / 10.0;
+		entry->info.nsamples = 0;
+		entry->offset = offset;
+		entry->stride = stride;
+		entry->interval = 1;
+
+		if (stride) {
+			if (divetime > (parser->footer - offset) / stride) {
+				ERROR (abstract->context, "Buffer overflow detected!");
+				return DC_STATUS_DATAFORMAT;
 			}
+			entry->info.nsamples = divetime;
+			offset += divetime * stride;
 		}
+
+		time += divetime;
 	}
 
+	parser->have_subdives = 1;
+
+	*table = parser->subdives;
+	*count = parser->nsamples;
+
 	return DC_STATUS_SUCCESS;
 }
@@ -110,6 +110,10 @@ mares_nemo_device_open (dc_device_t **out, dc_context_t *context, const char *na
 		goto error_free;
 	}
 
+	// Interrupt the blocking reads when the download is cancelled, and
+	// measure the time spent waiting for the I/O.
+	device_set_port ((dc_device_t *) device, device->port);
+
 	// Set the serial communication protocol (9600 8N1).
 	status = dc_serial_configure (device->port, 9600, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -206,13 +210,11 @@ mares_nemo_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 
 	// Wait until some data arrives.
-	size_t available = 0;
-	while (dc_serial_get_available (device->port, &available) == DC_STATUS_SUCCESS && available == 0) {
+	while (dc_serial_poll (device->port, 100) == DC_STATUS_TIMEOUT) {
 		if (device_is_cancelled (abstract))
 			return DC_STATUS_CANCELLED;
 
 		device_event_emit (abstract, DC_EVENT_WAITING, NULL);
-		dc_serial_sleep (device->port, 100);
 	}
 
 	// Receive the header of the package.
@@ -287,6 +289,8 @@ mares_nemo_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, v
 	if (buffer == NULL)
 		return DC_STATUS_NOMEMORY;
 
+	device_phase (abstract, DC_PHASE_PROFILE);
+
 	dc_status_t rc = mares_nemo_device_dump (abstract, buffer);
 	if (rc != DC_STATUS_SUCCESS) {
 		dc_buffer_free (buffer);
@@ -19,6 +19,8 @@
  * MA 02110-1301 USA
  */
 
+#define DC_LOG_CATEGORY DC_LOGCATEGORY_PARSER
+
 #include <stdlib.h>
 #include <string.h>
 
@@ -57,12 +59,18 @@ struct mares_nemo_parser_t {
 	unsigned int sample_size;
 	unsigned int header;
 	unsigned int extra;
+	/* Freedive session */
+	unsigned int have_subdives;
+	parser_subdive_t *subdives;
+	unsigned int subdives_capacity;
 };
 
 static dc_status_t mares_nemo_parser_set_data (dc_parser_t *abstract, const unsigned char *data, unsigned int size);
 static dc_status_t mares_nemo_parser_get_datetime (dc_parser_t *abstract, dc_datetime_t *datetime);
 static dc_status_t mares_nemo_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsigned int flags, void *value);
 static dc_status_t mares_nemo_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata);
+static dc_status_t mares_nemo_parser_subdives (dc_parser_t *abstract, const parser_subdive_t **table, unsigned int *count);
+static dc_status_t mares_nemo_parser_destroy (dc_parser_t *abstract);
 
 static const dc_parser_vtable_t mares_nemo_parser_vtable = {
 	sizeof(mares_nemo_parser_t),
@@ -71,7 +79,15 @@ static const dc_parser_vtable_t mares_nemo_parser_vtable = {
 	mares_nemo_parser_get_datetime, /* datetime */
 	mares_nemo_parser_get_field, /* fields */
 	mares_nemo_parser_samples_foreach, /* samples_foreach */
-	NULL /* destroy */
+	NULL, /* samples_extract */
+	NULL, /* samples_range */
+	NULL, /* samples_seek */
+	NULL, /* samples_index */
+	NULL, /* samples_split */
+	NULL, /* samples_chunk */
+	mares_nemo_parser_subdives, /* subdives */
+	NULL, /* samples_vendor */
+	mares_nemo_parser_destroy /* destroy */
 };
 
 
@@ -104,6 +120,9 @@ mares_nemo_parser_create (dc_parser_t **out, dc_context_t *context, unsigned int
 	parser->sample_size = 0;
 	parser->header = 0;
 	parser->extra = 0;
+	parser->have_subdives = 0;
+	parser->subdives = NULL;
+	parser->subdives_capacity = 0;
 
 	*out = (dc_parser_t*) parser;
 
@@ -125,6 +144,7 @@ mares_nemo_parser_set_data (dc_parser_t *abstract, const unsigned char *data, un
 	parser->sample_size = 0;
 	parser->header = 0;
 	parser->extra = 0;
+	parser->have_subdives = 0;
 
 	if (size == 0)
 		return DC_STATUS_SUCCESS;
@@ -183,6 +203,17 @@ mares_nemo_parser_set_data (dc_parser_t *abstract, const unsigned char *data, un
 }
 
 
+static dc_status_t
+mares_nemo_parser_destroy (dc_parser_t *abstract)
+{
+	mares_nemo_parser_t *parser = (mares_nemo_parser_t *) abstract;
+
+	free (parser->subdives);
+
+	return DC_STATUS_SUCCESS;
+}
+
+
 static dc_status_t
 mares_nemo_parser_get_datetime (dc_parser_t *abstract, dc_datetime_t *datetime)
 {
@@ -512,3 +543,104 @@ mares_nemo_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t c
 
 	return DC_STATUS_SUCCESS;
 }
+
+
+static dc_status_t
+mares_nemo_parser_subdives (dc_parser_t *abstract, const parser_subdive_t **table, unsigned int *count)
+{
+	mares_nemo_parser_t *parser = (mares_nemo_parser_t *) abstract;
+
+	if (abstract->size == 0)
+		return DC_STATUS_DATAFORMAT;
+
+	if (parser->mode != parser->freedive)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (parser->have_subdives) {
+		*table = parser->subdives;
+		*count = parser->sample_count;
+		return DC_STATUS_SUCCESS;
+	}
+
+	const unsigned char *data = abstract->data;
+	unsigned int size = abstract->size;
+
+	if (parser->sample_count > parser->subdives_capacity) {
+		parser_subdive_t *subdives = (parser_subdive_t *) realloc (parser->subdives, parser->sample_count * sizeof (parser_subdive_t));
+		if (subdives == NULL) {
+			ERROR (abstract->context, "Failed to allocate memory.");
+			return DC_STATUS_NOMEMORY;
+		}
+		parser_memory_add (abstract, (parser->sample_count - parser->subdives_capacity) * sizeof (parser_subdive_t));
+		parser->subdives = subdives;
+		parser->subdives_capacity = parser->sample_count;
+	}
+
+	// Get the freedive sample interval for this model.
+	unsigned int interval = 4;
+	if (parser->model == NEMOAPNEIST)
+		interval = 1;
+
+	// Locate the profile of each freedive, with the same rules as the
+	// walk over the entire session.
+	int profiles = (size > parser->length);
+
+	unsigned int time = 0;
+	unsigned int offset = parser->length;
+	for (unsigned int i = 0; i < parser->sample_count; ++i) {
+		parser_subdive_t *entry = parser->subdives + i;
+
+		unsigned int idx = 2 + parser->sample_size * i;
+		unsigned int maxdepth = array_uint16_le (data + idx);
+		unsigned int divetime = data[idx + 2] + data[idx + 3] * 60;
+		unsigned int surftime = data[idx + 4] + data[idx + 5] * 60;
+
+		time += surftime;
+
+		entry->info.time = time;
+		entry->info.divetime = divetime;
+		entry->info.surftime = surftime;
+		entry->info.maxdepth = maxdepth / 10.0;
+		entry->info.nsamples = 0;
+		entry->offset = 0;
+		entry->stride = 0;
+		entry->interval = interval;
+
+		if (profiles) {
+			unsigned int n = (divetime + interval - 1) / interval;
+
+			// The profile ends with a zero depth sample.
+			unsigned int count = 0;
+			entry->offset = offset;
+			while (offset + 2 <= size) {
+				unsigned int depth = array_uint16_le (data + offset);
+				offset += 2;
+
+				if (depth == 0)
+					break;
+
+				count++;
+
+				if (count > n)
+					break;
+			}
+
+			if (count != n) {
+				ERROR (abstract->context, "Unexpected number of samples.");
+				return DC_STATUS_DATAFORMAT;
+			}
+
+			entry->info.nsamples = n;
+			entry->stride = 2;
+		}
+
+		time += divetime;
+	}
+
+	parser->have_subdives = 1;
+
+	*table = parser->subdives;
+	*count = parser->sample_count;
+
+	return DC_STATUS_SUCCESS;
+}
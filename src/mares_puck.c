@@ -116,6 +116,10 @@ mares_puck_device_open (dc_device_t **out, dc_context_t *context, const char *na
 		goto error_free;
 	}
 
+	// Interrupt the blocking reads when the download is cancelled, and
+	// measure the time spent waiting for the I/O.
+	device_set_port ((dc_device_t *) device, device->base.port);
+
 	// Set the serial communication protocol (38400 8N1).
 	status = dc_serial_configure (device->base.port, 38400, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -243,29 +247,7 @@ mares_puck_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, v
 
 	assert (device->layout != NULL);
 
-	dc_buffer_t *buffer = dc_buffer_new (device->layout->memsize);
-	if (buffer == NULL)
-		return DC_STATUS_NOMEMORY;
-
-	dc_status_t rc = mares_puck_device_dump (abstract, buffer);
-	if (rc != DC_STATUS_SUCCESS) {
-		dc_buffer_free (buffer);
-		return rc;
-	}
-
-	// Emit a device info event.
-	unsigned char *data = dc_buffer_get_data (buffer);
-	dc_event_devinfo_t devinfo;
-	devinfo.model = data[1];
-	devinfo.firmware = 0;
-	devinfo.serial = array_uint16_be (data + 8);
-	device_event_emit (abstract, DC_EVENT_DEVINFO, &devinfo);
-
-	rc = mares_common_extract_dives (abstract->context, device->layout, device->fingerprint, data, callback, userdata);
-
-	dc_buffer_free (buffer);
-
-	return rc;
+	return mares_common_device_foreach (abstract, device->layout, device->fingerprint, callback, userdata);
 }
 
 
@@ -31,6 +31,7 @@
 #include "array.h"
 #include "ringbuffer.h"
 #include "checksum.h"
+#include "retry.h"
 
 #define ISINSTANCE(device) dc_device_isinstance((device), &oceanic_atom2_device_vtable.base)
 
@@ -39,6 +40,7 @@
 #define MAXRETRIES 2
 #define MAXDELAY   16
 #define INVALID    0xFFFFFFFF
+#define CACHESIZE  16
 
 #define CMD_INIT      0xA8
 #define CMD_VERSION   0x84
@@ -52,13 +54,22 @@
 #define ACK 0x5A
 #define NAK 0xA5
 
+typedef struct oceanic_atom2_cache_t {
+	unsigned int page;
+	unsigned int used;
+	unsigned char data[256];
+} oceanic_atom2_cache_t;
+
 typedef struct oceanic_atom2_device_t {
 	oceanic_common_device_t base;
 	dc_serial_t *port;
 	unsigned int delay;
+	dc_retry_t retry;
 	unsigned int bigpage;
-	unsigned char cache[256];
-	unsigned int cached;
+	oceanic_atom2_cache_t cache[CACHESIZE];
+	unsigned int tick;
+	unsigned int hits;
+	unsigned int misses;
 } oceanic_atom2_device_t;
 
 static dc_status_t oceanic_atom2_device_read (dc_device_t *abstract, unsigned int address, unsigned char data[], unsigned int size);
@@ -77,7 +88,6 @@ static const oceanic_common_device_vtable_t oceanic_atom2_device_vtable = {
 		oceanic_atom2_device_close /* close */
 	},
 	oceanic_common_device_logbook,
-	oceanic_common_device_profile,
 };
 
 static const oceanic_common_version_t aeris_f10_version[] = {
@@ -516,25 +526,29 @@ oceanic_atom2_transfer (oceanic_atom2_device_t *device, const unsigned char comm
 	// a NAK byte, we try to resend the command a number of times before
 	// returning an error.
 
-	unsigned int nretries = 0;
+	dc_device_t *abstract = (dc_device_t *) device;
+	dc_retry_begin (&device->retry);
+	unsigned long long begin = device_timestamp ();
 	dc_status_t rc = DC_STATUS_SUCCESS;
 	while ((rc = oceanic_atom2_packet (device, command, csize, answer, asize, crc_size)) != DC_STATUS_SUCCESS) {
-		if (rc != DC_STATUS_TIMEOUT && rc != DC_STATUS_PROTOCOL)
-			return rc;
+		device_stats_packet (abstract, command, csize, 0, rc, begin);
 
-		// Abort if the maximum number of retries is reached.
-		if (nretries++ >= MAXRETRIES)
+		// Delay the next attempt, or give up.
+		rc = dc_retry_failed (&device->retry, abstract, device->port, rc);
+		if (rc != DC_STATUS_SUCCESS)
 			return rc;
 
 		// Increase the inter packet delay.
 		if (device->delay < MAXDELAY)
 			device->delay++;
 
-		// Delay the next attempt.
-		dc_serial_sleep (device->port, 100);
-		dc_serial_purge (device->port, DC_DIRECTION_INPUT);
+		begin = device_timestamp ();
 	}
 
+	dc_retry_success (&device->retry, device->port, begin);
+
+	device_stats_packet (abstract, command, csize, asize, rc, begin);
+
 	return DC_STATUS_SUCCESS;
 }
 
@@ -552,6 +566,36 @@ oceanic_atom2_quit (oceanic_atom2_device_t *device)
 }
 
 
+static void
+oceanic_atom2_cache_invalidate (oceanic_atom2_device_t *device)
+{
+	for (unsigned int i = 0; i < CACHESIZE; ++i) {
+		device->cache[i].page = INVALID;
+		device->cache[i].used = 0;
+	}
+	device->tick = 0;
+}
+
+static oceanic_atom2_cache_t *
+oceanic_atom2_cache_lookup (oceanic_atom2_device_t *device, unsigned int page, unsigned int *found)
+{
+	// Return the cached page if available, or otherwise the least
+	// recently used entry, which is the one to be replaced.
+	oceanic_atom2_cache_t *entry = &device->cache[0];
+	for (unsigned int i = 0; i < CACHESIZE; ++i) {
+		if (device->cache[i].page == page) {
+			*found = 1;
+			return &device->cache[i];
+		}
+		if (device->cache[i].used < entry->used)
+			entry = &device->cache[i];
+	}
+
+	*found = 0;
+	return entry;
+}
+
+
 dc_status_t
 oceanic_atom2_device_open (dc_device_t **out, dc_context_t *context, const char *name)
 {
@@ -581,9 +625,11 @@ oceanic_atom2_device_open2 (dc_device_t **out, dc_context_t *context, const char
 	// Set the default values.
 	device->port = NULL;
 	device->delay = 0;
+	dc_retry_init (&device->retry, MAXRETRIES, 100, 100, DC_DIRECTION_INPUT);
 	device->bigpage = 1; // no big pages
-	device->cached = INVALID;
-	memset(device->cache, 0, sizeof(device->cache));
+	oceanic_atom2_cache_invalidate (device);
+	device->hits = 0;
+	device->misses = 0;
 
 	// Open the device.
 	status = dc_serial_open (&device->port, context, name);
@@ -592,6 +638,10 @@ oceanic_atom2_device_open2 (dc_device_t **out, dc_context_t *context, const char
 		goto error_free;
 	}
 
+	// Interrupt the blocking reads when the download is cancelled, and
+	// measure the time spent waiting for the I/O.
+	device_set_port ((dc_device_t *) device, device->port);
+
 	// Get the correct baudrate.
 	unsigned int baudrate = 38400;
 	if (model == VTX) {
@@ -605,8 +655,9 @@ oceanic_atom2_device_open2 (dc_device_t **out, dc_context_t *context, const char
 		goto error_close;
 	}
 
-	// Set the timeout for receiving data (1000 ms).
-	status = dc_serial_set_timeout (device->port, 1000);
+	// Set the timeout for receiving data. It adapts to the measured
+	// round trip time, between 250 and 1000 ms.
+	status = dc_retry_set_timeout (&device->retry, device->port, 250, 1000);
 	if (status != DC_STATUS_SUCCESS) {
 		ERROR (context, "Failed to set the timeout.");
 		goto error_close;
@@ -691,6 +742,12 @@ oceanic_atom2_device_open2 (dc_device_t **out, dc_context_t *context, const char
 		}
 	}
 
+	// Read a complete big page at once. The logbook and profile data
+	// of consecutive dives is then read in chunks that match the size
+	// of the transfers, instead of one page at a time.
+	device->base.multipage = device->bigpage;
+	device->base.base.blocksize = PAGESIZE * device->bigpage;
+
 	*out = (dc_device_t*) device;
 
 	return DC_STATUS_SUCCESS;
@@ -710,6 +767,8 @@ oceanic_atom2_device_close (dc_device_t *abstract)
 	oceanic_atom2_device_t *device = (oceanic_atom2_device_t*) abstract;
 	dc_status_t rc = DC_STATUS_SUCCESS;
 
+	DEBUG (abstract->context, "Cache: hits=%u, misses=%u", device->hits, device->misses);
+
 	// Send the quit command.
 	oceanic_atom2_quit (device);
 
@@ -799,7 +858,11 @@ oceanic_atom2_device_read (dc_device_t *abstract, unsigned int address, unsigned
 	unsigned int nbytes = 0;
 	while (nbytes < size) {
 		unsigned int page = address / pagesize;
-		if (page != device->cached) {
+		unsigned int found = 0;
+		oceanic_atom2_cache_t *entry = oceanic_atom2_cache_lookup (device, page, &found);
+		if (found) {
+			device->hits++;
+		} else {
 			// Read the package.
 			unsigned int number = page * device->bigpage; // This is always PAGESIZE, even in big page mode.
 			unsigned char answer[256 + 2] = {0};          // Maximum we support for the known commands.
@@ -812,16 +875,18 @@ oceanic_atom2_device_read (dc_device_t *abstract, unsigned int address, unsigned
 				return rc;
 
 			// Cache the page.
-			memcpy (device->cache, answer, pagesize);
-			device->cached = page;
+			memcpy (entry->data, answer, pagesize);
+			entry->page = page;
+			device->misses++;
 		}
+		entry->used = ++device->tick;
 
 		unsigned int offset = address % pagesize;
 		unsigned int length = pagesize - offset;
 		if (nbytes + length > size)
 			length = size - nbytes;
 
-		memcpy (data, device->cache + offset, length);
+		memcpy (data, entry->data + offset, length);
 
 		nbytes += length;
 		address += length;
@@ -842,7 +907,7 @@ oceanic_atom2_device_write (dc_device_t *abstract, unsigned int address, const u
 		return DC_STATUS_INVALIDARGS;
 
 	// Invalidate the cache.
-	device->cached = INVALID;
+	oceanic_atom2_cache_invalidate (device);
 
 	unsigned int nbytes = 0;
 	while (nbytes < size) {
@@ -19,6 +19,8 @@
  * MA 02110-1301 USA
  */
 
+#define DC_LOG_CATEGORY DC_LOGCATEGORY_PARSER
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -91,7 +93,55 @@
 #define NGASMIXES 6
 
 #define HEADER  1
-#define PROFILE 2
+
+typedef enum oceanic_atom2_tank_t {
+	TANK_MASK,     /* Pressure (1 psi), single tank */
+	TANK_1PSI,     /* Pressure (1 psi) and number */
+	TANK_2PSI_3,   /* Pressure (2 psi) at byte 3 and number */
+	TANK_2PSI_4,   /* Pressure (2 psi) at byte 4 and number */
+} oceanic_atom2_tank_t;
+
+typedef enum oceanic_atom2_temperature_t {
+	TEMPERATURE_BYTE,      /* Absolute value in a single byte */
+	TEMPERATURE_PACKED,    /* Absolute value spread over bytes 5 and 7 */
+	TEMPERATURE_SIGN5,     /* Relative change, sign in byte 5 */
+	TEMPERATURE_SIGN5_INV, /* Relative change, inverted sign in byte 5 */
+	TEMPERATURE_SIGN0,     /* Relative change, sign in byte 0 */
+	TEMPERATURE_SIGN0_INV, /* Relative change, inverted sign in byte 0 */
+} oceanic_atom2_temperature_t;
+
+typedef enum oceanic_atom2_pressure_t {
+	PRESSURE_NONE,
+	PRESSURE_12BIT,   /* Absolute value (12 bits) */
+	PRESSURE_16BIT,   /* Absolute value (16 bits) */
+	PRESSURE_PACKED,  /* Absolute value (5 psi) in bytes 0 and 1 */
+	PRESSURE_DELTA,   /* Relative change in byte 1 */
+} oceanic_atom2_pressure_t;
+
+typedef enum oceanic_atom2_depth_t {
+	DEPTH_12BIT,      /* 12 bits */
+	DEPTH_BYTE,       /* Single byte (1 ft) */
+} oceanic_atom2_depth_t;
+
+typedef struct oceanic_atom2_layout_t {
+	unsigned int freedive;
+	unsigned int interval;
+	unsigned int samplesize;
+	oceanic_atom2_tank_t tank;
+	unsigned int pressure_initial;
+	oceanic_atom2_pressure_t pressure;
+	unsigned int pressure_offset;
+	oceanic_atom2_temperature_t temperature;
+	unsigned int temperature_offset;
+	oceanic_atom2_depth_t depth;
+	unsigned int depth_offset;
+	unsigned int gasmix;
+	unsigned int deco;
+	unsigned int decostop_offset, decostop_mask, decostop_shift;
+	unsigned int decotime_offset, decotime_mask;
+	unsigned int rbt;
+	unsigned int rbt_offset, rbt_mask;
+} oceanic_atom2_layout_t;
 
 typedef struct oceanic_atom2_parser_t oceanic_atom2_parser_t;
 
@@ -101,6 +151,7 @@ struct oceanic_atom2_parser_t {
 	unsigned int headersize;
 	unsigned int footersize;
 	unsigned int serial;
+	oceanic_atom2_layout_t layout;
 	// Cached fields.
 	unsigned int cached;
 	unsigned int header;
@@ -109,8 +160,6 @@ struct oceanic_atom2_parser_t {
 	unsigned int ngasmixes;
 	unsigned int oxygen[NGASMIXES];
 	unsigned int helium[NGASMIXES];
-	unsigned int divetime;
-	double maxdepth;
 };
 
 static dc_status_t oceanic_atom2_parser_set_data (dc_parser_t *abstract, const unsigned char *data, unsigned int size);
@@ -125,10 +174,190 @@ static const dc_parser_vtable_t oceanic_atom2_parser_vtable = {
 	oceanic_atom2_parser_get_datetime, /* datetime */
 	oceanic_atom2_parser_get_field, /* fields */
 	oceanic_atom2_parser_samples_foreach, /* samples_foreach */
+	NULL, /* samples_extract */
+	NULL, /* samples_range */
+	NULL, /* samples_seek */
+	NULL, /* samples_index */
+	NULL, /* samples_split */
+	NULL, /* samples_chunk */
+	NULL, /* subdives */
+	NULL, /* samples_vendor */
 	NULL /* destroy */
 };
 
 
+static void
+oceanic_atom2_parser_layout (oceanic_atom2_layout_t *layout, unsigned int model)
+{
+	memset (layout, 0, sizeof (*layout));
+
+	// Freedive models.
+	if (model == F10 || model == F11A ||
+		model == F11B || model == MUNDIAL2 ||
+		model == MUNDIAL3) {
+		layout->freedive = 1;
+	}
+
+	// Sample interval and size.
+	layout->interval = 0x17;
+	layout->samplesize = PAGESIZE / 2;
+	if (model == A300CS || model == VTX || model == I450T)
+		layout->interval = 0x1f;
+	if (model == OC1A || model == OC1B ||
+		model == OC1C || model == OCI ||
+		model == TX1 || model == A300CS ||
+		model == VTX || model == I450T) {
+		layout->samplesize = PAGESIZE;
+	}
+
+	// Tank switch.
+	if (model == DATAMASK || model == COMPUMASK)
+		layout->tank = TANK_MASK;
+	else if (model == A300CS || model == VTX)
+		layout->tank = TANK_1PSI;
+	else if (model == ATOM2 || model == EPICA || model == EPICB)
+		layout->tank = TANK_2PSI_3;
+	else
+		layout->tank = TANK_2PSI_4;
+
+	// Temperature (°F)
+	if (model == GEO || model == ATOM1 ||
+		model == ELEMENT2 || model == MANTA ||
+		model == ZEN) {
+		layout->temperature = TEMPERATURE_BYTE;
+		layout->temperature_offset = 6;
+	} else if (model == GEO20 || model == VEO20 ||
+		model == VEO30 || model == OC1A ||
+		model == OC1B || model == OC1C ||
+		model == OCI || model == A300 ||
+		model == I450T || model == I300) {
+		layout->temperature = TEMPERATURE_BYTE;
+		layout->temperature_offset = 3;
+	} else if (model == OCS || model == TX1) {
+		layout->temperature = TEMPERATURE_BYTE;
+		layout->temperature_offset = 1;
+	} else if (model == VT4 || model == VT41 ||
+		model == ATOM3 || model == ATOM31 ||
+		model == A300AI || model == VISION) {
+		layout->temperature = TEMPERATURE_PACKED;
+	} else if (model == A300CS || model == VTX) {
+		layout->temperature = TEMPERATURE_BYTE;
+		layout->temperature_offset = 11;
+	} else if (model == DG03 || model == PROPLUS3 ||
+		model == I550T) {
+		layout->temperature = TEMPERATURE_SIGN5_INV;
+	} else if (model == VOYAGER2G || model == AMPHOS ||
+		model == AMPHOSAIR || model == ZENAIR) {
+		layout->temperature = TEMPERATURE_SIGN5;
+	} else if (model == ATOM2 || model == PROPLUS21 ||
+		model == EPICA || model == EPICB ||
+		model == ATMOSAI2 ||
+		model == WISDOM2 || model == WISDOM3) {
+		layout->temperature = TEMPERATURE_SIGN0;
+	} else {
+		layout->temperature = TEMPERATURE_SIGN0_INV;
+	}
+
+	// Tank pressure (psi)
+	layout->pressure_initial = 2;
+	if (model == A300CS || model == VTX)
+		layout->pressure_initial = 16;
+	if (model == VEO30 || model == OCS ||
+		model == ELEMENT2 || model == VEO20 ||
+		model == A300 || model == ZEN ||
+		model == GEO || model == GEO20 ||
+		model == MANTA || model == I300) {
+		layout->pressure = PRESSURE_NONE;
+	} else if (model == OC1A || model == OC1B ||
+		model == OC1C || model == OCI ||
+		model == I450T) {
+		layout->pressure = PRESSURE_12BIT;
+		layout->pressure_offset = 10;
+	} else if (model == VT4 || model == VT41||
+		model == ATOM3 || model == ATOM31 ||
+		model == ZENAIR ||model == A300AI ||
+		model == DG03 || model == PROPLUS3 ||
+		model == AMPHOSAIR || model == I550T ||
+		model == VISION) {
+		layout->pressure = PRESSURE_PACKED;
+	} else if (model == TX1 || model == A300CS || model == VTX) {
+		layout->pressure = PRESSURE_16BIT;
+		layout->pressure_offset = 4;
+	} else {
+		layout->pressure = PRESSURE_DELTA;
+	}
+
+	// Depth (1/16 ft)
+	if (model == GEO20 || model == VEO20 ||
+		model == VEO30 || model == OC1A ||
+		model == OC1B || model == OC1C ||
+		model == OCI || model == A300 ||
+		model == I450T || model == I300) {
+		layout->depth = DEPTH_12BIT;
+		layout->depth_offset = 4;
+	} else if (model == ATOM1) {
+		layout->depth = DEPTH_BYTE;
+		layout->depth_offset = 3;
+	} else {
+		layout->depth = DEPTH_12BIT;
+		layout->depth_offset = 2;
+	}
+
+	// Gas mix
+	if (model == TX1)
+		layout->gasmix = 1;
+
+	// NDL / Deco
+	layout->decostop_mask = 0xF0;
+	layout->decostop_shift = 4;
+	layout->decotime_mask = 0x03FF;
+	if (model == A300CS || model == VTX || model == I450T) {
+		layout->deco = 1;
+		layout->decostop_offset = 15;
+		layout->decostop_mask = 0x70;
+		layout->decotime_offset = 6;
+	} else if (model == ZEN) {
+		layout->deco = 1;
+		layout->decostop_offset = 5;
+		layout->decotime_offset = 4;
+		layout->decotime_mask = 0x0FFF;
+	} else if (model == TX1) {
+		layout->deco = 1;
+		layout->decostop_offset = 10;
+		layout->decostop_mask = 0xFF;
+		layout->decostop_shift = 0;
+		layout->decotime_offset = 6;
+		layout->decotime_mask = 0xFFFF;
+	} else if (model == ATOM31 || model == VISION) {
+		layout->deco = 1;
+		layout->decostop_offset = 5;
+		layout->decotime_offset = 4;
+	} else if (model == I550T) {
+		layout->deco = 1;
+		layout->decostop_offset = 7;
+		layout->decotime_offset = 6;
+	}
+
+	// Remaining bottom time
+	if (model == ATOM31) {
+		layout->rbt = 1;
+		layout->rbt_offset = 6;
+		layout->rbt_mask = 0x01FF;
+	} else if (model == I450T) {
+		layout->rbt = 1;
+		layout->rbt_offset = 8;
+		layout->rbt_mask = 0x01FF;
+	} else if (model == I550T) {
+		layout->rbt = 1;
+		layout->rbt_offset = 4;
+		layout->rbt_mask = 0x03FF;
+	} else if (model == VISION) {
+		layout->rbt = 1;
+		layout->rbt_offset = 6;
+		layout->rbt_mask = 0x03FF;
+	}
+}
+
 dc_status_t
 oceanic_atom2_parser_create (dc_parser_t **out, dc_context_t *context, unsigned int model, unsigned int serial)
 {
@@ -146,6 +375,7 @@ oceanic_atom2_parser_create (dc_parser_t **out, dc_context_t *context, unsigned
 
 	// Set the default values.
 	parser->model = model;
+	oceanic_atom2_parser_layout (&parser->layout, model);
 	parser->headersize = 9 * PAGESIZE / 2;
 	parser->footersize = 2 * PAGESIZE / 2;
 	if (model == DATAMASK || model == COMPUMASK ||
@@ -182,8 +412,6 @@ oceanic_atom2_parser_create (dc_parser_t **out, dc_context_t *context, unsigned
 		parser->oxygen[i] = 0;
 		parser->helium[i] = 0;
 	}
-	parser->divetime = 0;
-	parser->maxdepth = 0.0;
 
 	*out = (dc_parser_t*) parser;
 
@@ -206,8 +434,6 @@ oceanic_atom2_parser_set_data (dc_parser_t *abstract, const unsigned char *data,
 		parser->oxygen[i] = 0;
 		parser->helium[i] = 0;
 	}
-	parser->divetime = 0;
-	parser->maxdepth = 0.0;
 
 	return DC_STATUS_SUCCESS;
 }
@@ -386,9 +612,7 @@ oceanic_atom2_parser_cache (oceanic_atom2_parser_t *parser)
 
 	// Get the dive mode.
 	unsigned int mode = NORMAL;
-	if (parser->model == F10 || parser->model == F11A ||
-		parser->model == F11B || parser->model == MUNDIAL2 ||
-		parser->model == MUNDIAL3) {
+	if (parser->layout.freedive) {
 		mode = FREEDIVE;
 	} else if (parser->model == T3B || parser->model == VT3 ||
 		parser->model == DG03) {
@@ -473,19 +697,6 @@ oceanic_atom2_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, uns
 	if (status != DC_STATUS_SUCCESS)
 		return status;
 
-	// Cache the profile data.
-	if (parser->cached < PROFILE) {
-		sample_statistics_t statistics = SAMPLE_STATISTICS_INITIALIZER;
-		status = oceanic_atom2_parser_samples_foreach (
-			abstract, sample_statistics_cb, &statistics);
-		if (status != DC_STATUS_SUCCESS)
-			return status;
-
-		parser->cached = PROFILE;
-		parser->divetime = statistics.divetime;
-		parser->maxdepth = statistics.maxdepth;
-	}
-
 	dc_gasmix_t *gasmix = (dc_gasmix_t *) value;
 	dc_salinity_t *water = (dc_salinity_t *) value;
 	dc_field_string_t *string = (dc_field_string_t *) value;
@@ -495,17 +706,18 @@ oceanic_atom2_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, uns
 	if (value) {
 		switch (type) {
 		case DC_FIELD_DIVETIME:
-			if (parser->model == F10 || parser->model == F11A ||
-				parser->model == F11B || parser->model == MUNDIAL2 ||
-				parser->model == MUNDIAL3)
+			if (parser->layout.freedive)
 				*((unsigned int *) value) = bcd2dec (data[2]) + bcd2dec (data[3]) * 60;
-			else
-				*((unsigned int *) value) = parser->divetime;
+			else {
+				const sample_statistics_t *statistics = NULL;
+				status = dc_parser_get_statistics (abstract, &statistics);
+				if (status != DC_STATUS_SUCCESS)
+					return status;
+				*((unsigned int *) value) = statistics->divetime;
+			}
 			break;
 		case DC_FIELD_MAXDEPTH:
-			if (parser->model == F10 || parser->model == F11A ||
-				parser->model == F11B || parser->model == MUNDIAL2 ||
-				parser->model == MUNDIAL3)
+			if (parser->layout.freedive)
 				*((double *) value) = array_uint16_le (data + 4) / 16.0 * FEET;
 			else
 				*((double *) value) = (array_uint16_le (data + parser->footer + 4) & 0x0FFF) / 16.0 * FEET;
@@ -570,6 +782,7 @@ oceanic_atom2_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_
 {
 	dc_status_t status = DC_STATUS_SUCCESS;
 	oceanic_atom2_parser_t *parser = (oceanic_atom2_parser_t *) abstract;
+	const oceanic_atom2_layout_t *layout = &parser->layout;
 
 	const unsigned char *data = abstract->data;
 	unsigned int size = abstract->size;
@@ -583,11 +796,7 @@ oceanic_atom2_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_
 	unsigned int interval = 1;
 	unsigned int samplerate = 1;
 	if (parser->mode != FREEDIVE) {
-		unsigned int idx = 0x17;
-		if (parser->model == A300CS || parser->model == VTX ||
-			parser->model == I450T)
-			idx = 0x1f;
-		switch (data[idx] & 0x03) {
+		switch (data[layout->interval] & 0x03) {
 		case 0:
 			interval = 2;
 			break;
@@ -627,31 +836,20 @@ oceanic_atom2_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_
 		}
 	}
 
-	unsigned int samplesize = PAGESIZE / 2;
+	unsigned int samplesize = layout->samplesize;
 	if (parser->mode == FREEDIVE) {
-		if (parser->model == F10 || parser->model == F11A ||
-			parser->model == F11B || parser->model == MUNDIAL2 ||
-			parser->model == MUNDIAL3) {
+		if (layout->freedive) {
 			samplesize = 2;
 		} else {
 			samplesize = 4;
 		}
-	} else if (parser->model == OC1A || parser->model == OC1B ||
-		parser->model == OC1C || parser->model == OCI ||
-		parser->model == TX1 || parser->model == A300CS ||
-		parser->model == VTX || parser->model == I450T) {
-		samplesize = PAGESIZE;
 	}
 
 	unsigned int have_temperature = 1, have_pressure = 1;
 	if (parser->mode == FREEDIVE) {
 		have_temperature = 0;
 		have_pressure = 0;
-	} else if (parser->model == VEO30 || parser->model == OCS ||
-		parser->model == ELEMENT2 || parser->model == VEO20 ||
-		parser->model == A300 || parser->model == ZEN ||
-		parser->model == GEO || parser->model == GEO20 ||
-		parser->model == MANTA || parser->model == I300) {
+	} else if (layout->pressure == PRESSURE_NONE) {
 		have_pressure = 0;
 	}
 
@@ -665,10 +863,7 @@ oceanic_atom2_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_
 	unsigned int tank = 0;
 	unsigned int pressure = 0;
 	if (have_pressure) {
-		unsigned int idx = 2;
-		if (parser->model == A300CS || parser->model == VTX)
-			idx = 16;
-		pressure = array_uint16_le(data + parser->header + idx);
+		pressure = array_uint16_le(data + parser->header + layout->pressure_initial);
 		if (pressure == 10000)
 			have_pressure = 0;
 	}
@@ -720,21 +915,27 @@ oceanic_atom2_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_
 
 		// Check for a tank switch sample.
 		if (sampletype == 0xAA) {
-			if (parser->model == DATAMASK || parser->model == COMPUMASK) {
+			switch (layout->tank) {
+			case TANK_MASK:
 				// Tank pressure (1 psi) and number
 				tank = 0;
 				pressure = (((data[offset + 7] << 8) + data[offset + 6]) & 0x0FFF);
-			} else if (parser->model == A300CS || parser->model == VTX) {
+				break;
+			case TANK_1PSI:
 				// Tank pressure (1 psi) and number (one based index)
 				tank = (data[offset + 1] & 0x03) - 1;
 				pressure = ((data[offset + 7] << 8) + data[offset + 6]) & 0x0FFF;
-			} else {
+				break;
+			case TANK_2PSI_3:
+				// Tank pressure (2 psi) and number (one based index)
+				tank = (data[offset + 1] & 0x03) - 1;
+				pressure = (((data[offset + 3] << 8) + data[offset + 4]) & 0x0FFF) * 2;
+				break;
+			case TANK_2PSI_4:
 				// Tank pressure (2 psi) and number (one based index)
 				tank = (data[offset + 1] & 0x03) - 1;
-				if (parser->model == ATOM2 || parser->model == EPICA || parser->model == EPICB)
-					pressure = (((data[offset + 3] << 8) + data[offset + 4]) & 0x0FFF) * 2;
-				else
-					pressure = (((data[offset + 4] << 8) + data[offset + 5]) & 0x0FFF) * 2;
+				pressure = (((data[offset + 4] << 8) + data[offset + 5]) & 0x0FFF) * 2;
+				break;
 			}
 		} else if (sampletype == 0xBB) {
 			// The surface time is not always a nice multiple of the samplerate.
@@ -757,39 +958,28 @@ oceanic_atom2_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_
 		} else {
 			// Temperature (°F)
 			if (have_temperature) {
-				if (parser->model == GEO || parser->model == ATOM1 ||
-					parser->model == ELEMENT2 || parser->model == MANTA ||
-					parser->model == ZEN) {
-					temperature = data[offset + 6];
-				} else if (parser->model == GEO20 || parser->model == VEO20 ||
-					parser->model == VEO30 || parser->model == OC1A ||
-					parser->model == OC1B || parser->model == OC1C ||
-					parser->model == OCI || parser->model == A300 ||
-					parser->model == I450T || parser->model == I300) {
-					temperature = data[offset + 3];
-				} else if (parser->model == OCS || parser->model == TX1) {
-					temperature = data[offset + 1];
-				} else if (parser->model == VT4 || parser->model == VT41 ||
-					parser->model == ATOM3 || parser->model == ATOM31 ||
-					parser->model == A300AI || parser->model == VISION) {
+				unsigned int sign = 0;
+				switch (layout->temperature) {
+				case TEMPERATURE_BYTE:
+					temperature = data[offset + layout->temperature_offset];
+					break;
+				case TEMPERATURE_PACKED:
 					temperature = ((data[offset + 7] & 0xF0) >> 4) | ((data[offset + 7] & 0x0C) << 2) | ((data[offset + 5] & 0x0C) << 4);
-				} else if (parser->model == A300CS || parser->model == VTX) {
-					temperature = data[offset + 11];
-				} else {
-					unsigned int sign;
-					if (parser->model == DG03 || parser->model == PROPLUS3 ||
-						parser->model == I550T)
-						sign = (~data[offset + 5] & 0x04) >> 2;
-					else if (parser->model == VOYAGER2G || parser->model == AMPHOS ||
-						parser->model == AMPHOSAIR || parser->model == ZENAIR)
-						sign = (data[offset + 5] & 0x04) >> 2;
-					else if (parser->model == ATOM2 || parser->model == PROPLUS21 ||
-						parser->model == EPICA || parser->model == EPICB ||
-						parser->model == ATMOSAI2 ||
-						parser->model == WISDOM2 || parser->model == WISDOM3)
-						sign = (data[offset + 0] & 0x80) >> 7;
-					else
-						sign = (~data[offset + 0] & 0x80) >> 7;
+					break;
+				case TEMPERATURE_SIGN5_INV:
+					sign = (~data[offset + 5] & 0x04) >> 2;
+					break;
+				case TEMPERATURE_SIGN5:
+					sign = (data[offset + 5] & 0x04) >> 2;
+					break;
+				case TEMPERATURE_SIGN0:
+					sign = (data[offset + 0] & 0x80) >> 7;
+					break;
+				case TEMPERATURE_SIGN0_INV:
+					sign = (~data[offset + 0] & 0x80) >> 7;
+					break;
+				}
+				if (layout->temperature >= TEMPERATURE_SIGN5) {
 					if (sign)
 						temperature -= (data[offset + 7] & 0x0C) >> 2;
 					else
@@ -801,21 +991,22 @@ oceanic_atom2_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_
 
 			// Tank Pressure (psi)
 			if (have_pressure) {
-				if (parser->model == OC1A || parser->model == OC1B ||
-					parser->model == OC1C || parser->model == OCI ||
-					parser->model == I450T)
-					pressure = (data[offset + 10] + (data[offset + 11] << 8)) & 0x0FFF;
-				else if (parser->model == VT4 || parser->model == VT41||
-					parser->model == ATOM3 || parser->model == ATOM31 ||
-					parser->model == ZENAIR ||parser->model == A300AI ||
-					parser->model == DG03 || parser->model == PROPLUS3 ||
-					parser->model == AMPHOSAIR || parser->model == I550T ||
-					parser->model == VISION)
+				switch (layout->pressure) {
+				case PRESSURE_12BIT:
+					pressure = array_uint16_le (data + offset + layout->pressure_offset) & 0x0FFF;
+					break;
+				case PRESSURE_16BIT:
+					pressure = array_uint16_le (data + offset + layout->pressure_offset);
+					break;
+				case PRESSURE_PACKED:
 					pressure = (((data[offset + 0] & 0x03) << 8) + data[offset + 1]) * 5;
-				else if (parser->model == TX1 || parser->model == A300CS || parser->model == VTX)
-					pressure = array_uint16_le (data + offset + 4);
-				else
+					break;
+				case PRESSURE_DELTA:
 					pressure -= data[offset + 1];
+					break;
+				case PRESSURE_NONE:
+					break;
+				}
 				sample.pressure.tank = tank;
 				sample.pressure.value = pressure * PSI / BAR;
 				if (callback) callback (DC_SAMPLE_PRESSURE, sample, userdata);
@@ -825,23 +1016,17 @@ oceanic_atom2_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_
 			unsigned int depth;
 			if (parser->mode == FREEDIVE)
 				depth = array_uint16_le (data + offset);
-			else if (parser->model == GEO20 || parser->model == VEO20 ||
-				parser->model == VEO30 || parser->model == OC1A ||
-				parser->model == OC1B || parser->model == OC1C ||
-				parser->model == OCI || parser->model == A300 ||
-				parser->model == I450T || parser->model == I300)
-				depth = (data[offset + 4] + (data[offset + 5] << 8)) & 0x0FFF;
-			else if (parser->model == ATOM1)
-				depth = data[offset + 3] * 16;
+			else if (layout->depth == DEPTH_BYTE)
+				depth = data[offset + layout->depth_offset] * 16;
 			else
-				depth = (data[offset + 2] + (data[offset + 3] << 8)) & 0x0FFF;
+				depth = array_uint16_le (data + offset + layout->depth_offset) & 0x0FFF;
 			sample.depth = depth / 16.0 * FEET;
 			if (callback) callback (DC_SAMPLE_DEPTH, sample, userdata);
 
 			// Gas mix
 			unsigned int have_gasmix = 0;
 			unsigned int gasmix = 0;
-			if (parser->model == TX1) {
+			if (layout->gasmix) {
 				gasmix = data[offset] & 0x07;
 				have_gasmix = 1;
 			}
@@ -867,25 +1052,9 @@ oceanic_atom2_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_
 			// NDL / Deco
 			unsigned int have_deco = 0;
 			unsigned int decostop = 0, decotime = 0;
-			if (parser->model == A300CS || parser->model == VTX || parser->model == I450T) {
-				decostop = (data[offset + 15] & 0x70) >> 4;
-				decotime = array_uint16_le(data + offset + 6) & 0x03FF;
-				have_deco = 1;
-			} else if (parser->model == ZEN) {
-				decostop = (data[offset + 5] & 0xF0) >> 4;
-				decotime = array_uint16_le(data + offset + 4) & 0x0FFF;
-				have_deco = 1;
-			} else if (parser->model == TX1) {
-				decostop = data[offset + 10];
-				decotime = array_uint16_le(data + offset + 6);
-				have_deco = 1;
-			} else if (parser->model == ATOM31 || parser->model == VISION) {
-				decostop = (data[offset + 5] & 0xF0) >> 4;
-				decotime = array_uint16_le(data + offset + 4) & 0x03FF;
-				have_deco = 1;
-			} else if (parser->model == I550T) {
-				decostop = (data[offset + 7] & 0xF0) >> 4;
-				decotime = array_uint16_le(data + offset + 6) & 0x03FF;
+			if (layout->deco) {
+				decostop = (data[offset + layout->decostop_offset] & layout->decostop_mask) >> layout->decostop_shift;
+				decotime = array_uint16_le(data + offset + layout->decotime_offset) & layout->decotime_mask;
 				have_deco = 1;
 			}
 			if (have_deco) {
@@ -902,17 +1071,8 @@ oceanic_atom2_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_
 
 			unsigned int have_rbt = 0;
 			unsigned int rbt = 0;
-			if (parser->model == ATOM31) {
-				rbt = array_uint16_le(data + offset + 6) & 0x01FF;
-				have_rbt = 1;
-			} else if (parser->model == I450T) {
-				rbt = array_uint16_le(data + offset + 8) & 0x01FF;
-				have_rbt = 1;
-			} else if (parser->model == I550T) {
-				rbt = array_uint16_le(data + offset + 4) & 0x03FF;
-				have_rbt = 1;
-			} else if (parser->model == VISION) {
-				rbt = array_uint16_le(data + offset + 6) & 0x03FF;
+			if (layout->rbt) {
+				rbt = array_uint16_le(data + offset + layout->rbt_offset) & layout->rbt_mask;
 				have_rbt = 1;
 			}
 			if (have_rbt) {
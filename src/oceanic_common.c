@@ -137,6 +137,7 @@ oceanic_common_device_init (oceanic_common_device_t *device)
 	memset (device->fingerprint, 0, sizeof (device->fingerprint));
 	device->layout = NULL;
 	device->multipage = 1;
+	device->base.blocksize = PAGESIZE;
 }
 
 
@@ -190,7 +191,7 @@ oceanic_common_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 
 
 dc_status_t
-oceanic_common_device_logbook (dc_device_t *abstract, dc_event_progress_t *progress, dc_buffer_t *logbook)
+oceanic_common_device_logbook (dc_device_t *abstract, dc_event_progress_t *progress, dc_buffer_t *logbook, oceanic_common_entry_callback_t callback, void *userdata)
 {
 	oceanic_common_device_t *device = (oceanic_common_device_t *) abstract;
 	dc_status_t rc = DC_STATUS_SUCCESS;
@@ -393,6 +394,13 @@ oceanic_common_device_logbook (dc_device_t *abstract, dc_event_progress_t *progr
 				abort = 1;
 				break;
 			}
+
+			// Pass the new entry to the callback.
+			if (callback && !callback (abstract, logbooks + current, layout->rb_logbook_entry_size, userdata)) {
+				begin = current;
+				abort = 1;
+				break;
+			}
 		}
 
 		// Stop reading pages too.
@@ -410,198 +418,139 @@ oceanic_common_device_logbook (dc_device_t *abstract, dc_event_progress_t *progr
 }
 
 
-dc_status_t
-oceanic_common_device_profile (dc_device_t *abstract, dc_event_progress_t *progress, dc_buffer_t *logbook, dc_dive_callback_t callback, void *userdata)
+typedef struct oceanic_common_stream_t {
+	dc_event_progress_t *progress;
+	dc_dive_callback_t callback;
+	void *userdata;
+	dc_status_t status;
+	unsigned int address;
+	unsigned int previous;
+	unsigned int remaining;
+	unsigned int nbytes;
+	unsigned int available;
+	unsigned char *cache;
+	dc_buffer_t *buffer;
+} oceanic_common_stream_t;
+
+
+static int
+oceanic_common_device_profile (dc_device_t *abstract, const unsigned char data[], unsigned int size, void *userdata)
 {
 	oceanic_common_device_t *device = (oceanic_common_device_t *) abstract;
+	oceanic_common_stream_t *stream = (oceanic_common_stream_t *) userdata;
 	dc_status_t rc = DC_STATUS_SUCCESS;
 
-	assert (device != NULL);
-	assert (device->layout != NULL);
-	assert (device->layout->rb_logbook_entry_size <= sizeof (device->fingerprint));
-	assert (progress != NULL);
-
 	const oceanic_common_layout_t *layout = device->layout;
 
-	// Cache the logbook pointer and size.
-	const unsigned char *logbooks = dc_buffer_get_data (logbook);
-	unsigned int rb_logbook_size = dc_buffer_get_size (logbook);
-
-	// Go through the logbook entries a first time, to get the end of
-	// profile pointer and calculate the total amount of bytes in the
-	// profile ringbuffer.
-	unsigned int rb_profile_end  = INVALID;
-	unsigned int rb_profile_size = 0;
-
-	// Traverse the logbook ringbuffer backwards to retrieve the most recent
-	// dives first. The logbook ringbuffer is linearized at this point, so
-	// we do not have to take into account any memory wrapping near the end
-	// of the memory buffer.
-	unsigned int remaining = layout->rb_profile_end - layout->rb_profile_begin;
-	unsigned int previous = rb_profile_end;
-	unsigned int entry = rb_logbook_size;
-	while (entry) {
-		// Move to the start of the current entry.
-		entry -= layout->rb_logbook_entry_size;
-
-		// Get the profile pointers.
-		unsigned int rb_entry_first = get_profile_first (logbooks + entry, layout);
-		unsigned int rb_entry_last  = get_profile_last (logbooks + entry, layout);
-		if (rb_entry_first < layout->rb_profile_begin ||
-			rb_entry_first >= layout->rb_profile_end ||
-			rb_entry_last < layout->rb_profile_begin ||
-			rb_entry_last >= layout->rb_profile_end)
-		{
-			ERROR (abstract->context, "Invalid ringbuffer pointer detected (0x%06x 0x%06x).",
-				rb_entry_first, rb_entry_last);
-			break;
-		}
-
-		// Calculate the end pointer and the number of bytes.
-		unsigned int rb_entry_end   = RB_PROFILE_INCR (rb_entry_last, PAGESIZE, layout);
-		unsigned int rb_entry_size  = RB_PROFILE_DISTANCE (rb_entry_first, rb_entry_last, layout) + PAGESIZE;
-
-		// Take the end pointer of the most recent logbook entry as the
-		// end of profile pointer.
-		if (rb_profile_end == INVALID) {
-			rb_profile_end = previous = rb_entry_end;
-		}
+	// Get the profile pointers.
+	unsigned int rb_entry_first = get_profile_first (data, layout);
+	unsigned int rb_entry_last  = get_profile_last (data, layout);
+	if (rb_entry_first < layout->rb_profile_begin ||
+		rb_entry_first >= layout->rb_profile_end ||
+		rb_entry_last < layout->rb_profile_begin ||
+		rb_entry_last >= layout->rb_profile_end)
+	{
+		ERROR (abstract->context, "Invalid ringbuffer pointer detected (0x%06x 0x%06x).",
+			rb_entry_first, rb_entry_last);
+		stream->status = DC_STATUS_DATAFORMAT;
+		return 0;
+	}
 
-		// Skip gaps between the profiles.
-		unsigned int gap = 0;
-		if (rb_entry_end != previous) {
-			WARNING (abstract->context, "Profiles are not continuous.");
-			gap = RB_PROFILE_DISTANCE (rb_entry_end, previous, layout);
-		}
+	// Calculate the end pointer and the number of bytes.
+	unsigned int rb_entry_end   = RB_PROFILE_INCR (rb_entry_last, PAGESIZE, layout);
+	unsigned int rb_entry_size  = RB_PROFILE_DISTANCE (rb_entry_first, rb_entry_last, layout) + PAGESIZE;
 
-		// Make sure the profile size is valid.
-		if (rb_entry_size + gap > remaining) {
-			WARNING (abstract->context, "Unexpected profile size.");
-			break;
-		}
-
-		// Update the total profile size.
-		rb_profile_size += rb_entry_size + gap;
+	// Take the end pointer of the most recent logbook entry as the
+	// end of profile pointer.
+	if (stream->previous == INVALID) {
+		stream->address = stream->previous = rb_entry_end;
+	}
 
-		remaining -= rb_entry_size + gap;
-		previous = rb_entry_first;
+	// Skip gaps between the profiles.
+	unsigned int gap = 0;
+	if (rb_entry_end != stream->previous) {
+		WARNING (abstract->context, "Profiles are not continuous.");
+		gap = RB_PROFILE_DISTANCE (rb_entry_end, stream->previous, layout);
 	}
 
-	// At this point, we know the exact amount of data
-	// that needs to be transfered for the profiles.
-	progress->maximum -= (layout->rb_profile_end - layout->rb_profile_begin) - rb_profile_size;
-	device_event_emit (abstract, DC_EVENT_PROGRESS, progress);
+	// Make sure the profile size is valid. Data that is already
+	// downloaded for this dive is still available in the cache.
+	if (rb_entry_size + gap > stream->remaining + stream->available) {
+		WARNING (abstract->context, "Unexpected profile size.");
+		return 0;
+	}
 
-	// Memory buffer for the profile data.
-	unsigned char *profiles = (unsigned char *) malloc (rb_profile_size + rb_logbook_size);
-	if (profiles == NULL) {
-		return DC_STATUS_NOMEMORY;
+	// Allocate memory for the logbook entry and the profile data.
+	if (!dc_buffer_resize (stream->buffer, size + rb_entry_size + gap)) {
+		stream->status = DC_STATUS_NOMEMORY;
+		return 0;
 	}
 
-	// Keep track of the current position.
-	unsigned int offset = rb_profile_size + rb_logbook_size;
-	unsigned int address = rb_profile_end;
+	// The profile data is received backwards, starting at the end of
+	// the dive. The logbook entry is prepended to the profile data.
+	unsigned char *p = dc_buffer_get_data (stream->buffer);
+	unsigned int current = size + rb_entry_size + gap;
+	memcpy (p, data, size);
 
 	// When using multipage reads, the last packet can contain data from more
-	// than one dive. Therefore, the remaining data of this package (and its
-	// size) needs to be preserved for the next dive.
-	unsigned int available = 0;
-
-	// Traverse the logbook ringbuffer backwards to retrieve the most recent
-	// dives first. The logbook ringbuffer is linearized at this point, so
-	// we do not have to take into account any memory wrapping near the end
-	// of the memory buffer.
-	remaining = rb_profile_size;
-	previous = rb_profile_end;
-	entry = rb_logbook_size;
-	while (entry) {
-		// Move to the start of the current entry.
-		entry -= layout->rb_logbook_entry_size;
-
-		// Get the profile pointers.
-		unsigned int rb_entry_first = get_profile_first (logbooks + entry, layout);
-		unsigned int rb_entry_last  = get_profile_last (logbooks + entry, layout);
-		if (rb_entry_first < layout->rb_profile_begin ||
-			rb_entry_first >= layout->rb_profile_end ||
-			rb_entry_last < layout->rb_profile_begin ||
-			rb_entry_last >= layout->rb_profile_end)
-		{
-			ERROR (abstract->context, "Invalid ringbuffer pointer detected (0x%06x 0x%06x).",
-				rb_entry_first, rb_entry_last);
-			free (profiles);
-			return DC_STATUS_DATAFORMAT;
-		}
+	// than one dive. The remaining data of this packet is kept in the cache,
+	// and is used first.
+	unsigned int n = stream->available;
+	if (n > current - size)
+		n = current - size;
+	current -= n;
+	stream->available -= n;
+	memcpy (p + current, stream->cache + stream->available, n);
+
+	// Read the profile data.
+	device_phase (abstract, DC_PHASE_PROFILE);
+	while (current > size) {
+		// Handle the ringbuffer wrap point.
+		if (stream->address == layout->rb_profile_begin)
+			stream->address = layout->rb_profile_end;
 
-		// Calculate the end pointer and the number of bytes.
-		unsigned int rb_entry_end   = RB_PROFILE_INCR (rb_entry_last, PAGESIZE, layout);
-		unsigned int rb_entry_size  = RB_PROFILE_DISTANCE (rb_entry_first, rb_entry_last, layout) + PAGESIZE;
+		// Calculate the optimal packet size.
+		unsigned int len = PAGESIZE * device->multipage;
+		if (layout->rb_profile_begin + len > stream->address)
+			len = stream->address - layout->rb_profile_begin; // End of ringbuffer.
+		if (len > stream->remaining)
+			len = stream->remaining; // End of profiles.
 
-		// Skip gaps between the profiles.
-		unsigned int gap = 0;
-		if (rb_entry_end != previous) {
-			WARNING (abstract->context, "Profiles are not continuous.");
-			gap = RB_PROFILE_DISTANCE (rb_entry_end, previous, layout);
+		// Move to the start of the current page.
+		stream->address -= len;
+
+		// Read the profile page. A packet which also contains data from
+		// the next dive is received in the cache.
+		if (len <= current - size) {
+			current -= len;
+			rc = dc_device_read (abstract, stream->address, p + current, len);
+		} else {
+			rc = dc_device_read (abstract, stream->address, stream->cache, len);
+			stream->available = len - (current - size);
+			memcpy (p + size, stream->cache + stream->available, current - size);
+			current = size;
 		}
-
-		// Make sure the profile size is valid.
-		if (rb_entry_size + gap > remaining) {
-			WARNING (abstract->context, "Unexpected profile size.");
-			break;
+		if (rc != DC_STATUS_SUCCESS) {
+			stream->status = rc;
+			return 0;
 		}
 
-		// Read the profile data.
-		unsigned int nbytes = available;
-		while (nbytes < rb_entry_size + gap) {
-			// Handle the ringbuffer wrap point.
-			if (address == layout->rb_profile_begin)
-				address = layout->rb_profile_end;
-
-			// Calculate the optimal packet size.
-			unsigned int len = PAGESIZE * device->multipage;
-			if (layout->rb_profile_begin + len > address)
-				len = address - layout->rb_profile_begin; // End of ringbuffer.
-			if (nbytes + len > remaining)
-				len = remaining - nbytes; // End of profile.
-
-			// Move to the start of the current page.
-			address -= len;
-			offset -= len;
-
-			// Read the profile page.
-			rc = dc_device_read (abstract, address, profiles + offset, len);
-			if (rc != DC_STATUS_SUCCESS) {
-				free (profiles);
-				return rc;
-			}
-
-			// Update and emit a progress event.
-			progress->current += len;
-			device_event_emit (abstract, DC_EVENT_PROGRESS, progress);
-
-			nbytes += len;
-		}
+		// Update and emit a progress event.
+		stream->progress->current += len;
+		device_event_emit (abstract, DC_EVENT_PROGRESS, stream->progress);
 
-		available = nbytes - (rb_entry_size + gap);
-		remaining -= rb_entry_size + gap;
-		previous = rb_entry_first;
+		stream->remaining -= len;
+		stream->nbytes += len;
+	}
+	device_phase (abstract, DC_PHASE_LOGBOOK);
 
-		// Prepend the logbook entry to the profile data. The memory buffer is
-		// large enough to store this entry, but any data that belongs to the
-		// next dive needs to be moved down first.
-		if (available)
-			memmove (profiles + offset - layout->rb_logbook_entry_size, profiles + offset, available);
-		offset -= layout->rb_logbook_entry_size;
-		memcpy (profiles + offset + available, logbooks + entry, layout->rb_logbook_entry_size);
+	stream->previous = rb_entry_first;
 
-		unsigned char *p = profiles + offset + available;
-		if (callback && !callback (p, rb_entry_size + layout->rb_logbook_entry_size, p, layout->rb_logbook_entry_size, userdata)) {
-			break;
-		}
+	if (stream->callback && !stream->callback (p, size + rb_entry_size, p, size, stream->userdata)) {
+		return 0;
 	}
 
-	free (profiles);
-
-	return DC_STATUS_SUCCESS;
+	return 1;
 }
 
 
@@ -661,27 +610,44 @@ oceanic_common_device_foreach (dc_device_t *abstract, dc_dive_callback_t callbac
 		return DC_STATUS_NOMEMORY;
 	}
 
-	// Download the logbook ringbuffer.
-	rc = VTABLE(abstract)->logbook (abstract, &progress, logbook);
-	if (rc != DC_STATUS_SUCCESS) {
+	// Memory buffers for the profile data.
+	oceanic_common_stream_t stream;
+	stream.progress = &progress;
+	stream.callback = callback;
+	stream.userdata = userdata;
+	stream.status = DC_STATUS_SUCCESS;
+	stream.address = INVALID;
+	stream.previous = INVALID;
+	stream.remaining = layout->rb_profile_end - layout->rb_profile_begin;
+	stream.nbytes = 0;
+	stream.available = 0;
+	stream.cache = (unsigned char *) malloc (PAGESIZE * device->multipage);
+	stream.buffer = dc_buffer_new (0);
+	if (stream.cache == NULL || stream.buffer == NULL) {
+		dc_buffer_free (stream.buffer);
+		free (stream.cache);
 		dc_buffer_free (logbook);
-		return rc;
+		return DC_STATUS_NOMEMORY;
 	}
 
-	// Exit if there are no (new) dives.
-	if (dc_buffer_get_size (logbook) == 0) {
-		dc_buffer_free (logbook);
-		return DC_STATUS_SUCCESS;
-	}
+	// Download the logbook ringbuffer. The profile of each new logbook
+	// entry is downloaded as soon as the entry is available, instead of
+	// waiting until the entire logbook ringbuffer has been downloaded.
+	device_phase (abstract, DC_PHASE_LOGBOOK);
+	rc = VTABLE(abstract)->logbook (abstract, &progress, logbook, oceanic_common_device_profile, &stream);
+	if (rc == DC_STATUS_SUCCESS)
+		rc = stream.status;
 
-	// Download the profile ringbuffer.
-	rc = VTABLE(abstract)->profile (abstract, &progress, logbook, callback, userdata);
-	if (rc != DC_STATUS_SUCCESS) {
-		dc_buffer_free (logbook);
-		return rc;
+	// At this point, we know the exact amount of data
+	// that has been transfered for the profiles.
+	if (rc == DC_STATUS_SUCCESS) {
+		progress.maximum -= (layout->rb_profile_end - layout->rb_profile_begin) - stream.nbytes;
+		device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 	}
 
+	dc_buffer_free (stream.buffer);
+	free (stream.cache);
 	dc_buffer_free (logbook);
 
-	return DC_STATUS_SUCCESS;
+	return rc;
 }
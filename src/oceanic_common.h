@@ -66,10 +66,13 @@ typedef struct oceanic_common_device_t {
 	unsigned int multipage;
 } oceanic_common_device_t;
 
+// Callback for the new logbook entries, in newest-first order. Returning
+// zero stops the download of the logbook.
+typedef int (*oceanic_common_entry_callback_t) (dc_device_t *device, const unsigned char data[], unsigned int size, void *userdata);
+
 typedef struct oceanic_common_device_vtable_t {
 	dc_device_vtable_t base;
-	dc_status_t (*logbook) (dc_device_t *device, dc_event_progress_t *progress, dc_buffer_t *logbook);
-	dc_status_t (*profile) (dc_device_t *device, dc_event_progress_t *progress, dc_buffer_t *logbook, dc_dive_callback_t callback, void *userdata);
+	dc_status_t (*logbook) (dc_device_t *device, dc_event_progress_t *progress, dc_buffer_t *logbook, oceanic_common_entry_callback_t callback, void *userdata);
 } oceanic_common_device_vtable_t;
 
 typedef unsigned char oceanic_common_version_t[PAGESIZE + 1];
@@ -81,10 +84,7 @@ void
 oceanic_common_device_init (oceanic_common_device_t *device);
 
 dc_status_t
-oceanic_common_device_logbook (dc_device_t *device, dc_event_progress_t *progress, dc_buffer_t *logbook);
-
-dc_status_t
-oceanic_common_device_profile (dc_device_t *device, dc_event_progress_t *progress, dc_buffer_t *logbook, dc_dive_callback_t callback, void *userdata);
+oceanic_common_device_logbook (dc_device_t *device, dc_event_progress_t *progress, dc_buffer_t *logbook, oceanic_common_entry_callback_t callback, void *userdata);
 
 dc_status_t
 oceanic_common_device_set_fingerprint (dc_device_t *device, const unsigned char data[], unsigned int size);
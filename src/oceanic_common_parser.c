@@ -0,0 +1,199 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#define DC_LOG_CATEGORY DC_LOGCATEGORY_PARSER
+
+#include <stdlib.h>
+#include <math.h>
+
+#include <libdivecomputer/units.h>
+
+#include "oceanic_common_parser.h"
+#include "context-private.h"
+#include "array.h"
+
+static unsigned int
+oceanic_common_field (const oceanic_common_field_t *field, const unsigned char *p)
+{
+	unsigned int value = p[field->offset];
+	if (field->mask > 0xFF)
+		value |= p[field->offset + 1] << 8;
+
+	return (value & field->mask) >> field->shift;
+}
+
+
+void
+oceanic_common_slots_init (oceanic_common_slots_t *slots, unsigned int vendor, unsigned int size, const oceanic_common_field_t *depth, const oceanic_common_field_t *temperature)
+{
+	slots->vendor = vendor;
+	slots->size = size;
+	slots->depth = *depth;
+	slots->temperature = *temperature;
+	slots->cached = 0;
+	slots->status = DC_STATUS_SUCCESS;
+	slots->count = 0;
+	slots->capacity = 0;
+	slots->slots = NULL;
+}
+
+
+void
+oceanic_common_slots_reset (oceanic_common_slots_t *slots)
+{
+	slots->cached = 0;
+	slots->status = DC_STATUS_SUCCESS;
+	slots->count = 0;
+}
+
+
+dc_status_t
+oceanic_common_slots_append (dc_parser_t *parser, oceanic_common_slots_t *slots, unsigned int offset, unsigned int time)
+{
+	if (slots->count == slots->capacity) {
+		unsigned int capacity = slots->capacity ? slots->capacity * 2 : 256;
+		oceanic_common_slot_t *table = (oceanic_common_slot_t *) realloc (slots->slots, capacity * sizeof (oceanic_common_slot_t));
+		if (table == NULL) {
+			ERROR (parser->context, "Failed to allocate memory.");
+			return DC_STATUS_NOMEMORY;
+		}
+		parser_memory_add (parser, (capacity - slots->capacity) * sizeof (oceanic_common_slot_t));
+		slots->slots = table;
+		slots->capacity = capacity;
+	}
+
+	slots->slots[slots->count].offset = offset;
+	slots->slots[slots->count].time = time;
+	slots->count++;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+void
+oceanic_common_slots_free (oceanic_common_slots_t *slots)
+{
+	free (slots->slots);
+	slots->slots = NULL;
+	slots->capacity = 0;
+	slots->count = 0;
+}
+
+
+dc_status_t
+oceanic_common_slots_foreach (dc_parser_t *parser, const oceanic_common_slots_t *slots, dc_sample_callback_t callback, void *userdata)
+{
+	const unsigned char *data = parser->data;
+
+	for (unsigned int i = 0; i < slots->count; ++i) {
+		dc_sample_value_t sample = {0};
+		const unsigned char *p = data + slots->slots[i].offset;
+
+		// Time.
+		sample.time = slots->slots[i].time;
+		if (callback) callback (DC_SAMPLE_TIME, sample, userdata);
+
+		// Vendor specific data
+		sample.vendor.type = slots->vendor;
+		sample.vendor.size = slots->size;
+		sample.vendor.data = p;
+		if (callback) callback (DC_SAMPLE_VENDOR, sample, userdata);
+
+		// Depth (ft)
+		sample.depth = oceanic_common_field (&slots->depth, p) * FEET;
+		if (callback) callback (DC_SAMPLE_DEPTH, sample, userdata);
+
+		// Temperature (°F)
+		unsigned int temperature = oceanic_common_field (&slots->temperature, p);
+		sample.temperature = (temperature - 32.0) * (5.0 / 9.0);
+		if (callback) callback (DC_SAMPLE_TEMPERATURE, sample, userdata);
+	}
+
+	return slots->status;
+}
+
+
+dc_status_t
+oceanic_common_slots_extract (dc_parser_t *parser, const oceanic_common_slots_t *slots, dc_sample_columns_t *columns)
+{
+	const unsigned char *data = parser->data;
+	const oceanic_common_slot_t *table = slots->slots;
+	unsigned int n = slots->count < columns->capacity ? slots->count : columns->capacity;
+
+	columns->nsamples = slots->count;
+
+	// Each column is converted in a separate loop over the map.
+	if (columns->time) {
+		unsigned int *time = columns->time;
+		for (unsigned int i = 0; i < n; ++i)
+			time[i] = table[i].time;
+	}
+
+	if (columns->depth) {
+		double *depth = columns->depth;
+		for (unsigned int i = 0; i < n; ++i)
+			depth[i] = oceanic_common_field (&slots->depth, data + table[i].offset) * FEET;
+	}
+
+	if (columns->temperature) {
+		double *temperature = columns->temperature;
+		for (unsigned int i = 0; i < n; ++i) {
+			unsigned int value = oceanic_common_field (&slots->temperature, data + table[i].offset);
+			temperature[i] = (value - 32.0) * (5.0 / 9.0);
+		}
+	}
+
+	if (columns->gasmix) {
+		unsigned int *gasmix = columns->gasmix;
+		for (unsigned int i = 0; i < n; ++i)
+			gasmix[i] = DC_GASMIX_UNKNOWN;
+	}
+
+	for (unsigned int t = 0; t < columns->ntanks; ++t) {
+		double *pressure = columns->pressure[t];
+		if (pressure == NULL)
+			continue;
+		for (unsigned int i = 0; i < n; ++i)
+			pressure[i] = NAN;
+	}
+
+	return slots->status;
+}
+
+
+dc_status_t
+oceanic_common_slots_vendor (dc_parser_t *parser, const oceanic_common_slots_t *slots, dc_vendor_spans_t *spans)
+{
+	unsigned int n = slots->count;
+	if (n > spans->capacity || spans->spans == NULL)
+		n = spans->spans ? spans->capacity : 0;
+
+	spans->count = slots->count;
+
+	for (unsigned int i = 0; i < n; ++i) {
+		spans->spans[i].sample = i;
+		spans->spans[i].type = slots->vendor;
+		spans->spans[i].offset = slots->slots[i].offset;
+		spans->spans[i].size = slots->size;
+	}
+
+	return slots->status;
+}
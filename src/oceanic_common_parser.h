@@ -0,0 +1,91 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef OCEANIC_COMMON_PARSER_H
+#define OCEANIC_COMMON_PARSER_H
+
+#include "parser-private.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * A value in a sample slot: the little endian 16 bit word at the offset,
+ * or the single byte for a mask below 0x100, masked and shifted.
+ */
+typedef struct oceanic_common_field_t {
+	unsigned int offset;
+	unsigned int mask;
+	unsigned int shift;
+} oceanic_common_field_t;
+
+typedef struct oceanic_common_slot_t {
+	unsigned int offset;
+	unsigned int time;
+} oceanic_common_slot_t;
+
+/*
+ * The map of the fixed-size sample slots of a dive, with the offset and
+ * time of every sample, and the layout of the depth (ft) and temperature
+ * (°F) in a slot. The backend builds the map once per dive, and all the
+ * samples are then decoded from it. If the backend stops at an invalid
+ * slot, the error is kept in the status, and returned after decoding the
+ * samples before it.
+ */
+typedef struct oceanic_common_slots_t {
+	unsigned int vendor;
+	unsigned int size;
+	oceanic_common_field_t depth;
+	oceanic_common_field_t temperature;
+	// Current dive.
+	unsigned int cached;
+	dc_status_t status;
+	unsigned int count;
+	unsigned int capacity;
+	oceanic_common_slot_t *slots;
+} oceanic_common_slots_t;
+
+void
+oceanic_common_slots_init (oceanic_common_slots_t *slots, unsigned int vendor, unsigned int size, const oceanic_common_field_t *depth, const oceanic_common_field_t *temperature);
+
+void
+oceanic_common_slots_reset (oceanic_common_slots_t *slots);
+
+dc_status_t
+oceanic_common_slots_append (dc_parser_t *parser, oceanic_common_slots_t *slots, unsigned int offset, unsigned int time);
+
+void
+oceanic_common_slots_free (oceanic_common_slots_t *slots);
+
+dc_status_t
+oceanic_common_slots_foreach (dc_parser_t *parser, const oceanic_common_slots_t *slots, dc_sample_callback_t callback, void *userdata);
+
+dc_status_t
+oceanic_common_slots_extract (dc_parser_t *parser, const oceanic_common_slots_t *slots, dc_sample_columns_t *columns);
+
+dc_status_t
+oceanic_common_slots_vendor (dc_parser_t *parser, const oceanic_common_slots_t *slots, dc_vendor_spans_t *spans);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* OCEANIC_COMMON_PARSER_H */
@@ -30,11 +30,13 @@
 #include "serial.h"
 #include "ringbuffer.h"
 #include "checksum.h"
+#include "packet.h"
 
 #define ISINSTANCE(device) dc_device_isinstance((device), &oceanic_veo250_device_vtable.base)
 
 #define MAXRETRIES 2
 #define MULTIPAGE  4
+#define KEEPALIVE  1000
 
 #define ACK 0x5A
 #define NAK 0xA5
@@ -43,6 +45,7 @@ typedef struct oceanic_veo250_device_t {
 	oceanic_common_device_t base;
 	dc_serial_t *port;
 	unsigned int last;
+	unsigned long long timestamp;
 } oceanic_veo250_device_t;
 
 static dc_status_t oceanic_veo250_device_read (dc_device_t *abstract, unsigned int address, unsigned char data[], unsigned int size);
@@ -60,7 +63,6 @@ static const oceanic_common_device_vtable_t oceanic_veo250_device_vtable = {
 		oceanic_veo250_device_close /* close */
 	},
 	oceanic_common_device_logbook,
-	oceanic_common_device_profile,
 };
 
 static const oceanic_common_version_t oceanic_veo250_version[] = {
@@ -88,40 +90,18 @@ static const oceanic_common_layout_t oceanic_veo250_layout = {
 };
 
 
+static const dc_packet_framing_t oceanic_veo250_framing = {
+	DC_PACKET_PURGE | DC_PACKET_ACK | DC_PACKET_TRAILER, /* flags */
+	0, /* delay */
+	ACK, 0, NAK, /* ack, header, trailer */
+	0, 0, /* start, minimum */
+	DC_PACKET_CHECKSUM_NONE, 0, 0, 0, /* checksum */
+};
+
 static dc_status_t
 oceanic_veo250_send (oceanic_veo250_device_t *device, const unsigned char command[], unsigned int csize)
 {
-	dc_status_t status = DC_STATUS_SUCCESS;
-	dc_device_t *abstract = (dc_device_t *) device;
-
-	if (device_is_cancelled (abstract))
-		return DC_STATUS_CANCELLED;
-
-	// Discard garbage bytes.
-	dc_serial_purge (device->port, DC_DIRECTION_INPUT);
-
-	// Send the command to the dive computer.
-	status = dc_serial_write (device->port, command, csize, NULL);
-	if (status != DC_STATUS_SUCCESS) {
-		ERROR (abstract->context, "Failed to send the command.");
-		return status;
-	}
-
-	// Receive the response (ACK/NAK) of the dive computer.
-	unsigned char response = NAK;
-	status = dc_serial_read (device->port, &response, 1, NULL);
-	if (status != DC_STATUS_SUCCESS) {
-		ERROR (abstract->context, "Failed to receive the answer.");
-		return status;
-	}
-
-	// Verify the response of the dive computer.
-	if (response != ACK) {
-		ERROR (abstract->context, "Unexpected answer start byte(s).");
-		return DC_STATUS_PROTOCOL;
-	}
-
-	return DC_STATUS_SUCCESS;
+	return dc_packet_send_command ((dc_device_t *) device, device->port, &oceanic_veo250_framing, command, csize);
 }
 
 
@@ -152,17 +132,11 @@ oceanic_veo250_transfer (oceanic_veo250_device_t *device, const unsigned char co
 	}
 
 	// Receive the answer of the dive computer.
-	status = dc_serial_read (device->port, answer, asize, NULL);
-	if (status != DC_STATUS_SUCCESS) {
-		ERROR (abstract->context, "Failed to receive the answer.");
+	status = dc_packet_receive_answer (abstract, device->port, &oceanic_veo250_framing, command, csize, answer, asize);
+	if (status != DC_STATUS_SUCCESS)
 		return status;
-	}
 
-	// Verify the last byte of the answer.
-	if (answer[asize - 1] != NAK) {
-		ERROR (abstract->context, "Unexpected answer byte.");
-		return DC_STATUS_PROTOCOL;
-	}
+	device->timestamp = device_timestamp ();
 
 	return DC_STATUS_SUCCESS;
 }
@@ -245,9 +219,11 @@ oceanic_veo250_device_open (dc_device_t **out, dc_context_t *context, const char
 
 	// Override the base class values.
 	device->base.multipage = MULTIPAGE;
+	device->base.base.blocksize = PAGESIZE * MULTIPAGE;
 
 	// Set the default values.
 	device->port = NULL;
+	device->timestamp = 0;
 	device->last = 0;
 
 	// Open the device.
@@ -257,6 +233,10 @@ oceanic_veo250_device_open (dc_device_t **out, dc_context_t *context, const char
 		goto error_free;
 	}
 
+	// Interrupt the blocking reads when the download is cancelled, and
+	// measure the time spent waiting for the I/O.
+	device_set_port ((dc_device_t *) device, device->port);
+
 	// Set the serial communication protocol (9600 8N1).
 	status = dc_serial_configure (device->port, 9600, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -422,6 +402,14 @@ oceanic_veo250_device_read (dc_device_t *abstract, unsigned int address, unsigne
 		if (npackets > MULTIPAGE)
 			npackets = MULTIPAGE;
 
+		// Keep the session alive after a long pause, for example while the
+		// application was busy processing the previous dive.
+		if (device->timestamp && device_timestamp () - device->timestamp > KEEPALIVE * 1000ULL) {
+			dc_status_t rc = oceanic_veo250_device_keepalive (abstract);
+			if (rc != DC_STATUS_SUCCESS)
+				return rc;
+		}
+
 		// Read the package.
 		unsigned int first =  address / PAGESIZE;
 		unsigned int last  = first + npackets - 1;
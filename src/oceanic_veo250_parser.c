@@ -19,12 +19,15 @@
  * MA 02110-1301 USA
  */
 
+#define DC_LOG_CATEGORY DC_LOGCATEGORY_PARSER
+
 #include <stdlib.h>
 
 #include <libdivecomputer/oceanic_veo250.h>
 #include <libdivecomputer/units.h>
 
 #include "oceanic_common.h"
+#include "oceanic_common_parser.h"
 #include "context-private.h"
 #include "parser-private.h"
 #include "array.h"
@@ -41,16 +44,16 @@ typedef struct oceanic_veo250_parser_t oceanic_veo250_parser_t;
 struct oceanic_veo250_parser_t {
 	dc_parser_t base;
 	unsigned int model;
-	// Cached fields.
-	unsigned int cached;
-	unsigned int divetime;
-	double maxdepth;
+	oceanic_common_slots_t slots;
 };
 
 static dc_status_t oceanic_veo250_parser_set_data (dc_parser_t *abstract, const unsigned char *data, unsigned int size);
 static dc_status_t oceanic_veo250_parser_get_datetime (dc_parser_t *abstract, dc_datetime_t *datetime);
 static dc_status_t oceanic_veo250_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsigned int flags, void *value);
 static dc_status_t oceanic_veo250_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata);
+static dc_status_t oceanic_veo250_parser_samples_extract (dc_parser_t *abstract, dc_sample_columns_t *columns);
+static dc_status_t oceanic_veo250_parser_samples_vendor (dc_parser_t *abstract, dc_vendor_spans_t *spans);
+static dc_status_t oceanic_veo250_parser_destroy (dc_parser_t *abstract);
 
 static const dc_parser_vtable_t oceanic_veo250_parser_vtable = {
 	sizeof(oceanic_veo250_parser_t),
@@ -59,7 +62,15 @@ static const dc_parser_vtable_t oceanic_veo250_parser_vtable = {
 	oceanic_veo250_parser_get_datetime, /* datetime */
 	oceanic_veo250_parser_get_field, /* fields */
 	oceanic_veo250_parser_samples_foreach, /* samples_foreach */
-	NULL /* destroy */
+	oceanic_veo250_parser_samples_extract, /* samples_extract */
+	NULL, /* samples_range */
+	NULL, /* samples_seek */
+	NULL, /* samples_index */
+	NULL, /* samples_split */
+	NULL, /* samples_chunk */
+	NULL, /* subdives */
+	oceanic_veo250_parser_samples_vendor, /* samples_vendor */
+	oceanic_veo250_parser_destroy /* destroy */
 };
 
 
@@ -80,9 +91,13 @@ oceanic_veo250_parser_create (dc_parser_t **out, dc_context_t *context, unsigned
 
 	// Set the default values.
 	parser->model = model;
-	parser->cached = 0;
-	parser->divetime = 0;
-	parser->maxdepth = 0.0;
+
+	// Layout of the sample slots.
+	oceanic_common_field_t depth = {2, 0xFF, 0};
+	oceanic_common_field_t temperature = {7, 0xFF, 0};
+	if (model == REACTPRO || model == REACTPROWHITE)
+		temperature.offset = 6;
+	oceanic_common_slots_init (&parser->slots, SAMPLE_VENDOR_OCEANIC_VEO250, PAGESIZE / 2, &depth, &temperature);
 
 	*out = (dc_parser_t*) parser;
 
@@ -96,9 +111,18 @@ oceanic_veo250_parser_set_data (dc_parser_t *abstract, const unsigned char *data
 	oceanic_veo250_parser_t *parser = (oceanic_veo250_parser_t *) abstract;
 
 	// Reset the cache.
-	parser->cached = 0;
-	parser->divetime = 0;
-	parser->maxdepth = 0.0;
+	oceanic_common_slots_reset (&parser->slots);
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+static dc_status_t
+oceanic_veo250_parser_destroy (dc_parser_t *abstract)
+{
+	oceanic_veo250_parser_t *parser = (oceanic_veo250_parser_t *) abstract;
+
+	oceanic_common_slots_free (&parser->slots);
 
 	return DC_STATUS_SUCCESS;
 }
@@ -135,7 +159,8 @@ oceanic_veo250_parser_get_datetime (dc_parser_t *abstract, dc_datetime_t *dateti
 static dc_status_t
 oceanic_veo250_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsigned int flags, void *value)
 {
-	oceanic_veo250_parser_t *parser = (oceanic_veo250_parser_t *) abstract;
+	dc_status_t rc = DC_STATUS_SUCCESS;
+	const sample_statistics_t *statistics = NULL;
 
 	const unsigned char *data = abstract->data;
 	unsigned int size = abstract->size;
@@ -143,18 +168,6 @@ oceanic_veo250_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, un
 	if (size < 7 * PAGESIZE / 2)
 		return DC_STATUS_DATAFORMAT;
 
-	if (!parser->cached) {
-		sample_statistics_t statistics = SAMPLE_STATISTICS_INITIALIZER;
-		dc_status_t rc = oceanic_veo250_parser_samples_foreach (
-			abstract, sample_statistics_cb, &statistics);
-		if (rc != DC_STATUS_SUCCESS)
-			return rc;
-
-		parser->cached = 1;
-		parser->divetime = statistics.divetime;
-		parser->maxdepth = statistics.maxdepth;
-	}
-
 	unsigned int footer = size - PAGESIZE;
 
 	dc_gasmix_t *gasmix = (dc_gasmix_t *) value;
@@ -165,7 +178,10 @@ oceanic_veo250_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, un
 			*((unsigned int *) value) = data[footer + 3] * 60 + data[footer + 4] * 3600;
 			break;
 		case DC_FIELD_MAXDEPTH:
-			*((double *) value) = parser->maxdepth;
+			rc = dc_parser_get_statistics (abstract, &statistics);
+			if (rc != DC_STATUS_SUCCESS)
+				return rc;
+			*((double *) value) = statistics->maxdepth;
 			break;
 		case DC_FIELD_GASMIX_COUNT:
 				*((unsigned int *) value) = 1;
@@ -188,12 +204,15 @@ oceanic_veo250_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, un
 
 
 static dc_status_t
-oceanic_veo250_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata)
+oceanic_veo250_parser_cache (oceanic_veo250_parser_t *parser)
 {
-	oceanic_veo250_parser_t *parser = (oceanic_veo250_parser_t *) abstract;
+	dc_parser_t *abstract = (dc_parser_t *) parser;
 	const unsigned char *data = abstract->data;
 	unsigned int size = abstract->size;
 
+	if (parser->slots.cached)
+		return DC_STATUS_SUCCESS;
+
 	if (size < 7 * PAGESIZE / 2)
 		return DC_STATUS_DATAFORMAT;
 
@@ -219,10 +238,10 @@ oceanic_veo250_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback
 		break;
 	}
 
+	oceanic_common_slots_reset (&parser->slots);
+
 	unsigned int offset = 5 * PAGESIZE / 2;
 	while (offset + PAGESIZE / 2 <= size - PAGESIZE) {
-		dc_sample_value_t sample = {0};
-
 		// Ignore empty samples.
 		if (array_isequal (data + offset, PAGESIZE / 2, 0x00)) {
 			offset += PAGESIZE / 2;
@@ -231,32 +250,54 @@ oceanic_veo250_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback
 
 		// Time.
 		time += interval;
-		sample.time = time;
-		if (callback) callback (DC_SAMPLE_TIME, sample, userdata);
-
-		// Vendor specific data
-		sample.vendor.type = SAMPLE_VENDOR_OCEANIC_VEO250;
-		sample.vendor.size = PAGESIZE / 2;
-		sample.vendor.data = data + offset;
-		if (callback) callback (DC_SAMPLE_VENDOR, sample, userdata);
-
-		// Depth (ft)
-		unsigned int depth = data[offset + 2];
-		sample.depth = depth * FEET;
-		if (callback) callback (DC_SAMPLE_DEPTH, sample, userdata);
-
-		// Temperature (°F)
-		unsigned int temperature;
-		if (parser->model == REACTPRO || parser->model == REACTPROWHITE) {
-			temperature = data[offset + 6];
-		} else {
-			temperature = data[offset + 7];
-		}
-		sample.temperature = (temperature - 32.0) * (5.0 / 9.0);
-		if (callback) callback (DC_SAMPLE_TEMPERATURE, sample, userdata);
+
+		dc_status_t rc = oceanic_common_slots_append (abstract, &parser->slots, offset, time);
+		if (rc != DC_STATUS_SUCCESS)
+			return rc;
 
 		offset += PAGESIZE / 2;
 	}
 
+	parser->slots.cached = 1;
+
 	return DC_STATUS_SUCCESS;
 }
+
+
+static dc_status_t
+oceanic_veo250_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata)
+{
+	oceanic_veo250_parser_t *parser = (oceanic_veo250_parser_t *) abstract;
+
+	dc_status_t rc = oceanic_veo250_parser_cache (parser);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	return oceanic_common_slots_foreach (abstract, &parser->slots, callback, userdata);
+}
+
+
+static dc_status_t
+oceanic_veo250_parser_samples_extract (dc_parser_t *abstract, dc_sample_columns_t *columns)
+{
+	oceanic_veo250_parser_t *parser = (oceanic_veo250_parser_t *) abstract;
+
+	dc_status_t rc = oceanic_veo250_parser_cache (parser);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	return oceanic_common_slots_extract (abstract, &parser->slots, columns);
+}
+
+
+static dc_status_t
+oceanic_veo250_parser_samples_vendor (dc_parser_t *abstract, dc_vendor_spans_t *spans)
+{
+	oceanic_veo250_parser_t *parser = (oceanic_veo250_parser_t *) abstract;
+
+	dc_status_t rc = oceanic_veo250_parser_cache (parser);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	return oceanic_common_slots_vendor (abstract, &parser->slots, spans);
+}
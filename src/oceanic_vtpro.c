@@ -31,12 +31,14 @@
 #include "serial.h"
 #include "ringbuffer.h"
 #include "checksum.h"
+#include "packet.h"
 #include "array.h"
 
 #define ISINSTANCE(device) dc_device_isinstance((device), &oceanic_vtpro_device_vtable.base)
 
 #define MAXRETRIES 2
 #define MULTIPAGE  4
+#define KEEPALIVE  1000
 
 #define ACK 0x5A
 #define NAK 0xA5
@@ -54,9 +56,10 @@ typedef struct oceanic_vtpro_device_t {
 	dc_serial_t *port;
 	unsigned int model;
 	oceanic_vtpro_protocol_t protocol;
+	unsigned long long timestamp;
 } oceanic_vtpro_device_t;
 
-static dc_status_t oceanic_vtpro_device_logbook (dc_device_t *abstract, dc_event_progress_t *progress, dc_buffer_t *logbook);
+static dc_status_t oceanic_vtpro_device_logbook (dc_device_t *abstract, dc_event_progress_t *progress, dc_buffer_t *logbook, oceanic_common_entry_callback_t callback, void *userdata);
 static dc_status_t oceanic_vtpro_device_read (dc_device_t *abstract, unsigned int address, unsigned char data[], unsigned int size);
 static dc_status_t oceanic_vtpro_device_close (dc_device_t *abstract);
 
@@ -72,7 +75,6 @@ static const oceanic_common_device_vtable_t oceanic_vtpro_device_vtable = {
 		oceanic_vtpro_device_close /* close */
 	},
 	oceanic_vtpro_device_logbook,
-	oceanic_common_device_profile,
 };
 
 static const oceanic_common_version_t oceanic_vtpro_version[] = {
@@ -130,37 +132,18 @@ static const oceanic_common_layout_t aeris_500ai_layout = {
 	2, /* pt_mode_serial */
 };
 
+static const dc_packet_framing_t oceanic_vtpro_framing = {
+	DC_PACKET_ACK, /* flags */
+	0, /* delay */
+	ACK, 0, 0, /* ack, header, trailer */
+	0, 0, /* start, minimum */
+	DC_PACKET_CHECKSUM_NONE, 0, 0, 0, /* checksum */
+};
+
 static dc_status_t
 oceanic_vtpro_send (oceanic_vtpro_device_t *device, const unsigned char command[], unsigned int csize)
 {
-	dc_status_t status = DC_STATUS_SUCCESS;
-	dc_device_t *abstract = (dc_device_t *) device;
-
-	if (device_is_cancelled (abstract))
-		return DC_STATUS_CANCELLED;
-
-	// Send the command to the dive computer.
-	status = dc_serial_write (device->port, command, csize, NULL);
-	if (status != DC_STATUS_SUCCESS) {
-		ERROR (abstract->context, "Failed to send the command.");
-		return status;
-	}
-
-	// Receive the response (ACK/NAK) of the dive computer.
-	unsigned char response = NAK;
-	status = dc_serial_read (device->port, &response, 1, NULL);
-	if (status != DC_STATUS_SUCCESS) {
-		ERROR (abstract->context, "Failed to receive the answer.");
-		return status;
-	}
-
-	// Verify the response of the dive computer.
-	if (response != ACK) {
-		ERROR (abstract->context, "Unexpected answer start byte(s).");
-		return DC_STATUS_PROTOCOL;
-	}
-
-	return DC_STATUS_SUCCESS;
+	return dc_packet_send_command ((dc_device_t *) device, device->port, &oceanic_vtpro_framing, command, csize);
 }
 
 
@@ -187,14 +170,12 @@ oceanic_vtpro_transfer (oceanic_vtpro_device_t *device, const unsigned char comm
 			return rc;
 	}
 
-	if (asize) {
-		// Receive the answer of the dive computer.
-		status = dc_serial_read (device->port, answer, asize, NULL);
-		if (status != DC_STATUS_SUCCESS) {
-			ERROR (abstract->context, "Failed to receive the answer.");
-			return status;
-		}
-	}
+	// Receive the answer of the dive computer.
+	status = dc_packet_receive_answer (abstract, device->port, &oceanic_vtpro_framing, command, csize, answer, asize);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	device->timestamp = device_timestamp ();
 
 	return DC_STATUS_SUCCESS;
 }
@@ -285,7 +266,7 @@ oceanic_vtpro_calibrate (oceanic_vtpro_device_t *device)
 }
 
 static dc_status_t
-oceanic_aeris500ai_device_logbook (dc_device_t *abstract, dc_event_progress_t *progress, dc_buffer_t *logbook)
+oceanic_aeris500ai_device_logbook (dc_device_t *abstract, dc_event_progress_t *progress, dc_buffer_t *logbook, oceanic_common_entry_callback_t callback, void *userdata)
 {
 	dc_status_t rc = DC_STATUS_SUCCESS;
 	oceanic_vtpro_device_t *device = (oceanic_vtpro_device_t *) abstract;
@@ -369,18 +350,30 @@ oceanic_aeris500ai_device_logbook (dc_device_t *abstract, dc_event_progress_t *p
 		}
 	}
 
+	// The logbook index is received oldest-first, so the new entries
+	// can only be passed to the callback once the index is complete.
+	if (callback) {
+		const unsigned char *entries = dc_buffer_get_data (logbook);
+		unsigned int entry = dc_buffer_get_size (logbook);
+		while (entry) {
+			entry -= PAGESIZE / 2;
+			if (!callback (abstract, entries + entry, PAGESIZE / 2, userdata))
+				break;
+		}
+	}
+
 	return DC_STATUS_SUCCESS;
 }
 
 static dc_status_t
-oceanic_vtpro_device_logbook (dc_device_t *abstract, dc_event_progress_t *progress, dc_buffer_t *logbook)
+oceanic_vtpro_device_logbook (dc_device_t *abstract, dc_event_progress_t *progress, dc_buffer_t *logbook, oceanic_common_entry_callback_t callback, void *userdata)
 {
 	oceanic_vtpro_device_t *device = (oceanic_vtpro_device_t *) abstract;
 
 	if (device->model == AERIS500AI) {
-		return oceanic_aeris500ai_device_logbook (abstract, progress, logbook);
+		return oceanic_aeris500ai_device_logbook (abstract, progress, logbook, callback, userdata);
 	} else {
-		return oceanic_common_device_logbook (abstract, progress, logbook);
+		return oceanic_common_device_logbook (abstract, progress, logbook, callback, userdata);
 	}
 }
 
@@ -412,9 +405,11 @@ oceanic_vtpro_device_open2 (dc_device_t **out, dc_context_t *context, const char
 
 	// Override the base class values.
 	device->base.multipage = MULTIPAGE;
+	device->base.base.blocksize = PAGESIZE * MULTIPAGE;
 
 	// Set the default values.
 	device->port = NULL;
+	device->timestamp = 0;
 	device->model = model;
 	if (model == AERIS500AI) {
 		device->protocol = INTR;
@@ -429,6 +424,10 @@ oceanic_vtpro_device_open2 (dc_device_t **out, dc_context_t *context, const char
 		goto error_free;
 	}
 
+	// Interrupt the blocking reads when the download is cancelled, and
+	// measure the time spent waiting for the I/O.
+	device_set_port ((dc_device_t *) device, device->port);
+
 	// Set the serial communication protocol (9600 8N1).
 	status = dc_serial_configure (device->port, 9600, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -635,6 +634,14 @@ oceanic_vtpro_device_read (dc_device_t *abstract, unsigned int address, unsigned
 		if (npackets > MULTIPAGE)
 			npackets = MULTIPAGE;
 
+		// Keep the session alive after a long pause, for example while the
+		// application was busy processing the previous dive.
+		if (device->timestamp && device_timestamp () - device->timestamp > KEEPALIVE * 1000ULL) {
+			dc_status_t rc = oceanic_vtpro_device_keepalive (abstract);
+			if (rc != DC_STATUS_SUCCESS)
+				return rc;
+		}
+
 		// Read the package.
 		unsigned int first =  address / PAGESIZE;
 		unsigned int last  = first + npackets - 1;
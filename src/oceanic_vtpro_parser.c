@@ -19,12 +19,15 @@
  * MA 02110-1301 USA
  */
 
+#define DC_LOG_CATEGORY DC_LOGCATEGORY_PARSER
+
 #include <stdlib.h>
 
 #include <libdivecomputer/oceanic_vtpro.h>
 #include <libdivecomputer/units.h>
 
 #include "oceanic_common.h"
+#include "oceanic_common_parser.h"
 #include "context-private.h"
 #include "parser-private.h"
 #include "array.h"
@@ -38,16 +41,16 @@ typedef struct oceanic_vtpro_parser_t oceanic_vtpro_parser_t;
 struct oceanic_vtpro_parser_t {
 	dc_parser_t base;
 	unsigned int model;
-	// Cached fields.
-	unsigned int cached;
-	unsigned int divetime;
-	double maxdepth;
+	oceanic_common_slots_t slots;
 };
 
 static dc_status_t oceanic_vtpro_parser_set_data (dc_parser_t *abstract, const unsigned char *data, unsigned int size);
 static dc_status_t oceanic_vtpro_parser_get_datetime (dc_parser_t *abstract, dc_datetime_t *datetime);
 static dc_status_t oceanic_vtpro_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsigned int flags, void *value);
 static dc_status_t oceanic_vtpro_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata);
+static dc_status_t oceanic_vtpro_parser_samples_extract (dc_parser_t *abstract, dc_sample_columns_t *columns);
+static dc_status_t oceanic_vtpro_parser_samples_vendor (dc_parser_t *abstract, dc_vendor_spans_t *spans);
+static dc_status_t oceanic_vtpro_parser_destroy (dc_parser_t *abstract);
 
 static const dc_parser_vtable_t oceanic_vtpro_parser_vtable = {
 	sizeof(oceanic_vtpro_parser_t),
@@ -56,7 +59,15 @@ static const dc_parser_vtable_t oceanic_vtpro_parser_vtable = {
 	oceanic_vtpro_parser_get_datetime, /* datetime */
 	oceanic_vtpro_parser_get_field, /* fields */
 	oceanic_vtpro_parser_samples_foreach, /* samples_foreach */
-	NULL /* destroy */
+	oceanic_vtpro_parser_samples_extract, /* samples_extract */
+	NULL, /* samples_range */
+	NULL, /* samples_seek */
+	NULL, /* samples_index */
+	NULL, /* samples_split */
+	NULL, /* samples_chunk */
+	NULL, /* subdives */
+	oceanic_vtpro_parser_samples_vendor, /* samples_vendor */
+	oceanic_vtpro_parser_destroy /* destroy */
 };
 
 
@@ -84,9 +95,17 @@ oceanic_vtpro_parser_create2 (dc_parser_t **out, dc_context_t *context, unsigned
 
 	// Set the default values.
 	parser->model = model;
-	parser->cached = 0;
-	parser->divetime = 0;
-	parser->maxdepth = 0.0;
+
+	// Layout of the sample slots.
+	oceanic_common_field_t depth = {3, 0xFF, 0};
+	oceanic_common_field_t temperature = {6, 0xFF, 0};
+	if (model == AERIS500AI) {
+		oceanic_common_field_t depth_aeris = {2, 0x0FF0, 4};
+		oceanic_common_field_t temperature_aeris = {6, 0x0FF0, 4};
+		depth = depth_aeris;
+		temperature = temperature_aeris;
+	}
+	oceanic_common_slots_init (&parser->slots, SAMPLE_VENDOR_OCEANIC_VTPRO, PAGESIZE / 2, &depth, &temperature);
 
 	*out = (dc_parser_t*) parser;
 
@@ -100,9 +119,18 @@ oceanic_vtpro_parser_set_data (dc_parser_t *abstract, const unsigned char *data,
 	oceanic_vtpro_parser_t *parser = (oceanic_vtpro_parser_t *) abstract;
 
 	// Reset the cache.
-	parser->cached = 0;
-	parser->divetime = 0;
-	parser->maxdepth = 0.0;
+	oceanic_common_slots_reset (&parser->slots);
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+static dc_status_t
+oceanic_vtpro_parser_destroy (dc_parser_t *abstract)
+{
+	oceanic_vtpro_parser_t *parser = (oceanic_vtpro_parser_t *) abstract;
+
+	oceanic_common_slots_free (&parser->slots);
 
 	return DC_STATUS_SUCCESS;
 }
@@ -157,6 +185,8 @@ static dc_status_t
 oceanic_vtpro_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsigned int flags, void *value)
 {
 	oceanic_vtpro_parser_t *parser = (oceanic_vtpro_parser_t *) abstract;
+	dc_status_t rc = DC_STATUS_SUCCESS;
+	const sample_statistics_t *statistics = NULL;
 
 	const unsigned char *data = abstract->data;
 	unsigned int size = abstract->size;
@@ -164,18 +194,6 @@ oceanic_vtpro_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, uns
 	if (size < 7 * PAGESIZE / 2)
 		return DC_STATUS_DATAFORMAT;
 
-	if (!parser->cached) {
-		sample_statistics_t statistics = SAMPLE_STATISTICS_INITIALIZER;
-		dc_status_t rc = oceanic_vtpro_parser_samples_foreach (
-			abstract, sample_statistics_cb, &statistics);
-		if (rc != DC_STATUS_SUCCESS)
-			return rc;
-
-		parser->cached = 1;
-		parser->divetime = statistics.divetime;
-		parser->maxdepth = statistics.maxdepth;
-	}
-
 	unsigned int footer = size - PAGESIZE;
 
 	unsigned int oxygen = 0;
@@ -196,7 +214,10 @@ oceanic_vtpro_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, uns
 	if (value) {
 		switch (type) {
 		case DC_FIELD_DIVETIME:
-			*((unsigned int *) value) = parser->divetime;
+			rc = dc_parser_get_statistics (abstract, &statistics);
+			if (rc != DC_STATUS_SUCCESS)
+				return rc;
+			*((unsigned int *) value) = statistics->divetime;
 			break;
 		case DC_FIELD_MAXDEPTH:
 			*((double *) value) = maxdepth * FEET;
@@ -236,13 +257,15 @@ oceanic_vtpro_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, uns
 
 
 static dc_status_t
-oceanic_vtpro_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata)
+oceanic_vtpro_parser_cache (oceanic_vtpro_parser_t *parser)
 {
-	oceanic_vtpro_parser_t *parser = (oceanic_vtpro_parser_t *) abstract;
-
+	dc_parser_t *abstract = (dc_parser_t *) parser;
 	const unsigned char *data = abstract->data;
 	unsigned int size = abstract->size;
 
+	if (parser->slots.cached)
+		return DC_STATUS_SUCCESS;
+
 	if (size < 7 * PAGESIZE / 2)
 		return DC_STATUS_DATAFORMAT;
 
@@ -265,10 +288,13 @@ oceanic_vtpro_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_
 	// Initialize the state for the timestamp processing.
 	unsigned int timestamp = 0, count = 0, i = 0;
 
+	// An invalid timestamp ends the map, but the samples before it
+	// remain available.
+	dc_status_t status = DC_STATUS_SUCCESS;
+	oceanic_common_slots_reset (&parser->slots);
+
 	unsigned int offset = 5 * PAGESIZE / 2;
 	while (offset + PAGESIZE / 2 <= size - PAGESIZE) {
-		dc_sample_value_t sample = {0};
-
 		// Ignore empty samples.
 		if (array_isequal (data + offset, PAGESIZE / 2, 0x00) ||
 			array_isequal (data + offset, PAGESIZE / 2, 0xFF)) {
@@ -280,7 +306,8 @@ oceanic_vtpro_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_
 		unsigned int current = bcd2dec (data[offset + 1] & 0x0F) * 60 + bcd2dec (data[offset + 0]);
 		if (current < timestamp) {
 			ERROR (abstract->context, "Timestamp moved backwards.");
-			return DC_STATUS_DATAFORMAT;
+			status = DC_STATUS_DATAFORMAT;
+			break;
 		}
 
 		if (current != timestamp || count == 0) {
@@ -319,7 +346,8 @@ oceanic_vtpro_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_
 		if (interval) {
 			if (current > timestamp + 1) {
 				ERROR (abstract->context, "Unexpected timestamp jump.");
-				return DC_STATUS_DATAFORMAT;
+				status = DC_STATUS_DATAFORMAT;
+				break;
 			}
 			if (i >= count) {
 				WARNING (abstract->context, "Unexpected sample with the same timestamp ignored.");
@@ -336,37 +364,55 @@ oceanic_vtpro_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_
 			time += interval;
 		else
 			time = timestamp * 60 + (i + 1) * 60.0 / count + 0.5;
-		sample.time = time;
-		if (callback) callback (DC_SAMPLE_TIME, sample, userdata);
-
-		// Vendor specific data
-		sample.vendor.type = SAMPLE_VENDOR_OCEANIC_VTPRO;
-		sample.vendor.size = PAGESIZE / 2;
-		sample.vendor.data = data + offset;
-		if (callback) callback (DC_SAMPLE_VENDOR, sample, userdata);
 
-		// Depth (ft)
-		unsigned int depth = 0;
-		if (parser->model == AERIS500AI) {
-			depth = (array_uint16_le(data + offset + 2) & 0x0FF0) >> 4;
-		} else {
-			depth = data[offset + 3];
-		}
-		sample.depth = depth * FEET;
-		if (callback) callback (DC_SAMPLE_DEPTH, sample, userdata);
-
-		// Temperature (°F)
-		unsigned int temperature = 0;
-		if (parser->model == AERIS500AI) {
-			temperature = (array_uint16_le(data + offset + 6) & 0x0FF0) >> 4;
-		} else {
-			temperature = data[offset + 6];
-		}
-		sample.temperature = (temperature - 32.0) * (5.0 / 9.0);
-		if (callback) callback (DC_SAMPLE_TEMPERATURE, sample, userdata);
+		dc_status_t rc = oceanic_common_slots_append (abstract, &parser->slots, offset, time);
+		if (rc != DC_STATUS_SUCCESS)
+			return rc;
 
 		offset += PAGESIZE / 2;
 	}
 
+	parser->slots.status = status;
+	parser->slots.cached = 1;
+
 	return DC_STATUS_SUCCESS;
 }
+
+
+static dc_status_t
+oceanic_vtpro_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata)
+{
+	oceanic_vtpro_parser_t *parser = (oceanic_vtpro_parser_t *) abstract;
+
+	dc_status_t rc = oceanic_vtpro_parser_cache (parser);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	return oceanic_common_slots_foreach (abstract, &parser->slots, callback, userdata);
+}
+
+
+static dc_status_t
+oceanic_vtpro_parser_samples_extract (dc_parser_t *abstract, dc_sample_columns_t *columns)
+{
+	oceanic_vtpro_parser_t *parser = (oceanic_vtpro_parser_t *) abstract;
+
+	dc_status_t rc = oceanic_vtpro_parser_cache (parser);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	return oceanic_common_slots_extract (abstract, &parser->slots, columns);
+}
+
+
+static dc_status_t
+oceanic_vtpro_parser_samples_vendor (dc_parser_t *abstract, dc_vendor_spans_t *spans)
+{
+	oceanic_vtpro_parser_t *parser = (oceanic_vtpro_parser_t *) abstract;
+
+	dc_status_t rc = oceanic_vtpro_parser_cache (parser);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	return oceanic_common_slots_vendor (abstract, &parser->slots, spans);
+}
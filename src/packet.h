@@ -0,0 +1,408 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_PACKET_H
+#define DC_PACKET_H
+
+#include <string.h>
+
+#include <libdivecomputer/common.h>
+#include <libdivecomputer/device.h>
+
+#include "context-private.h"
+#include "device-private.h"
+#include "checksum.h"
+#include "array.h"
+#include "serial.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Shared framing for the command/answer packet transfers.
+ *
+ * The framing of a protocol (echo handling, acknowledgement, header and
+ * trailer bytes and the checksum) is described by a static const table.
+ * The transfer functions are defined inline, so when they are called
+ * with such a table, the compiler removes all the steps that are not
+ * used by the protocol.
+ */
+
+#define DC_PACKET_PURGE       0x01 /* Discard the pending input first. */
+#define DC_PACKET_ECHO        0x02 /* Receive the echo of the command. */
+#define DC_PACKET_ECHO_BYTE   0x04 /* Receive the echo after each byte. */
+#define DC_PACKET_ECHO_ANSWER 0x08 /* The answer starts with the echo. */
+#define DC_PACKET_ECHO_WARN   0x10 /* An unexpected echo is not fatal. */
+#define DC_PACKET_ACK         0x20 /* The command is acknowledged. */
+#define DC_PACKET_HEADER      0x40 /* The answer has a header byte. */
+#define DC_PACKET_TRAILER     0x80 /* The answer has a trailer byte. */
+
+#define DC_PACKET_MAXLENGTH 255
+
+typedef enum dc_packet_checksum_t {
+	DC_PACKET_CHECKSUM_NONE,
+	DC_PACKET_CHECKSUM_ADD_UINT8,
+	DC_PACKET_CHECKSUM_NEG_UINT8,
+	DC_PACKET_CHECKSUM_XOR_UINT8,
+	DC_PACKET_CHECKSUM_ADD_UINT16_LE,
+	DC_PACKET_CHECKSUM_CRC_CCITT_BE,
+} dc_packet_checksum_t;
+
+typedef struct dc_packet_framing_t {
+	unsigned int flags;
+	/* Delay before each command (milliseconds). */
+	unsigned int delay;
+	/* Acknowledgement, header and trailer bytes. */
+	unsigned char ack;
+	unsigned char header;
+	unsigned char trailer;
+	/* Start byte and minimum length of the length prefixed packets. */
+	unsigned char start;
+	unsigned int minimum;
+	/* Checksum type and initial value. The checksum is stored at the end
+	 * of the answer (or before the trailer bytes), and covers the bytes
+	 * starting at the begin offset. */
+	dc_packet_checksum_t checksum;
+	unsigned int checksum_init;
+	unsigned int checksum_begin;
+	unsigned int checksum_trailer;
+} dc_packet_framing_t;
+
+static inline unsigned int
+dc_packet_checksum_size (const dc_packet_framing_t *framing)
+{
+	switch (framing->checksum) {
+	case DC_PACKET_CHECKSUM_NONE:
+		return 0;
+	case DC_PACKET_CHECKSUM_ADD_UINT16_LE:
+	case DC_PACKET_CHECKSUM_CRC_CCITT_BE:
+		return 2;
+	default:
+		return 1;
+	}
+}
+
+static inline unsigned int
+dc_packet_checksum_calculate (const dc_packet_framing_t *framing, const unsigned char data[], unsigned int size)
+{
+	switch (framing->checksum) {
+	case DC_PACKET_CHECKSUM_ADD_UINT8:
+		return checksum_add_uint8 (data, size, framing->checksum_init);
+	case DC_PACKET_CHECKSUM_NEG_UINT8:
+		return (unsigned char) (~checksum_add_uint8 (data, size, framing->checksum_init) + 1);
+	case DC_PACKET_CHECKSUM_XOR_UINT8:
+		return checksum_xor_uint8 (data, size, framing->checksum_init);
+	case DC_PACKET_CHECKSUM_ADD_UINT16_LE:
+		return checksum_add_uint16 (data, size, framing->checksum_init);
+	case DC_PACKET_CHECKSUM_CRC_CCITT_BE:
+		return checksum_crc_ccitt_uint16 (data, size, framing->checksum_init);
+	default:
+		return 0;
+	}
+}
+
+static inline unsigned int
+dc_packet_checksum_get (const dc_packet_framing_t *framing, const unsigned char data[])
+{
+	switch (framing->checksum) {
+	case DC_PACKET_CHECKSUM_ADD_UINT16_LE:
+		return array_uint16_le (data);
+	case DC_PACKET_CHECKSUM_CRC_CCITT_BE:
+		return array_uint16_be (data);
+	default:
+		return data[0];
+	}
+}
+
+static inline void
+dc_packet_checksum_set (const dc_packet_framing_t *framing, unsigned char data[], unsigned int value)
+{
+	switch (framing->checksum) {
+	case DC_PACKET_CHECKSUM_ADD_UINT16_LE:
+		data[0] = (value     ) & 0xFF;
+		data[1] = (value >> 8) & 0xFF;
+		break;
+	case DC_PACKET_CHECKSUM_CRC_CCITT_BE:
+		data[0] = (value >> 8) & 0xFF;
+		data[1] = (value     ) & 0xFF;
+		break;
+	default:
+		data[0] = value;
+		break;
+	}
+}
+
+static inline dc_status_t
+dc_packet_send_command (dc_device_t *device, dc_serial_t *port, const dc_packet_framing_t *framing, const unsigned char command[], unsigned int csize)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (device_is_cancelled (device))
+		return DC_STATUS_CANCELLED;
+
+	if (framing->delay) {
+		dc_serial_sleep (port, framing->delay);
+	}
+
+	if (framing->flags & DC_PACKET_PURGE) {
+		// Discard garbage bytes.
+		dc_serial_purge (port, DC_DIRECTION_INPUT);
+	}
+
+	if (framing->flags & DC_PACKET_ECHO_BYTE) {
+		for (unsigned int i = 0; i < csize; ++i) {
+			// Send the command to the device.
+			status = dc_serial_write (port, command + i, 1, NULL);
+			if (status != DC_STATUS_SUCCESS) {
+				ERROR (device->context, "Failed to send the command.");
+				return status;
+			}
+
+			// Receive the echo.
+			unsigned char echo = 0;
+			status = dc_serial_read (port, &echo, 1, NULL);
+			if (status != DC_STATUS_SUCCESS) {
+				ERROR (device->context, "Failed to receive the echo.");
+				return status;
+			}
+
+			// Verify the echo.
+			if (command[i] != echo) {
+				ERROR (device->context, "Unexpected echo.");
+				return DC_STATUS_PROTOCOL;
+			}
+		}
+	} else {
+		// Send the command to the device.
+		status = dc_serial_write (port, command, csize, NULL);
+		if (status != DC_STATUS_SUCCESS) {
+			ERROR (device->context, "Failed to send the command.");
+			return status;
+		}
+	}
+
+	if (framing->flags & DC_PACKET_ECHO) {
+		// Receive and verify the echo of the command.
+		int mismatch = 0;
+		unsigned int nbytes = 0;
+		while (nbytes < csize) {
+			unsigned char echo[32] = {0};
+			unsigned int len = csize - nbytes;
+			if (len > sizeof (echo))
+				len = sizeof (echo);
+
+			status = dc_serial_read (port, echo, len, NULL);
+			if (status != DC_STATUS_SUCCESS) {
+				ERROR (device->context, "Failed to receive the echo.");
+				return status;
+			}
+
+			if (memcmp (echo, command + nbytes, len) != 0)
+				mismatch = 1;
+
+			nbytes += len;
+		}
+
+		if (mismatch) {
+			if (framing->flags & DC_PACKET_ECHO_WARN) {
+				WARNING (device->context, "Unexpected echo.");
+			} else {
+				ERROR (device->context, "Unexpected echo.");
+				return DC_STATUS_PROTOCOL;
+			}
+		}
+	}
+
+	if (framing->flags & DC_PACKET_ACK) {
+		// Receive the response (ACK/NAK) of the dive computer.
+		unsigned char response = ~framing->ack;
+		status = dc_serial_read (port, &response, 1, NULL);
+		if (status != DC_STATUS_SUCCESS) {
+			ERROR (device->context, "Failed to receive the answer.");
+			return status;
+		}
+
+		// Verify the response of the dive computer.
+		if (response != framing->ack) {
+			ERROR (device->context, "Unexpected answer start byte(s).");
+			return DC_STATUS_PROTOCOL;
+		}
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+/*
+ * Receive and verify the fixed size answer to a command.
+ */
+static inline dc_status_t
+dc_packet_receive_answer (dc_device_t *device, dc_serial_t *port, const dc_packet_framing_t *framing, const unsigned char command[], unsigned int csize, unsigned char answer[], unsigned int asize)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (asize == 0)
+		return DC_STATUS_SUCCESS;
+
+	// Receive the answer of the device.
+	status = dc_serial_read (port, answer, asize, NULL);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (device->context, "Failed to receive the answer.");
+		return status;
+	}
+
+	const unsigned char *payload = answer;
+	unsigned int size = asize;
+	if (framing->flags & DC_PACKET_ECHO_ANSWER) {
+		// Verify the echo.
+		if (memcmp (answer, command, csize) != 0) {
+			ERROR (device->context, "Unexpected echo.");
+			return DC_STATUS_PROTOCOL;
+		}
+
+		payload += csize;
+		size -= csize;
+	}
+
+	// Verify the header and trailer of the packet.
+	if ((framing->flags & DC_PACKET_HEADER) && payload[0] != framing->header) {
+		ERROR (device->context, "Unexpected answer header byte.");
+		return DC_STATUS_PROTOCOL;
+	}
+	if ((framing->flags & DC_PACKET_TRAILER) && payload[size - 1] != framing->trailer) {
+		ERROR (device->context, "Unexpected answer trailer byte.");
+		return DC_STATUS_PROTOCOL;
+	}
+
+	if (framing->checksum != DC_PACKET_CHECKSUM_NONE) {
+		// Verify the checksum of the packet.
+		unsigned int end = size - framing->checksum_trailer - dc_packet_checksum_size (framing);
+		unsigned int crc = dc_packet_checksum_get (framing, payload + end);
+		unsigned int ccrc = dc_packet_checksum_calculate (framing, payload + framing->checksum_begin, end - framing->checksum_begin);
+		if (crc != ccrc) {
+			ERROR (device->context, "Unexpected answer checksum.");
+			return DC_STATUS_PROTOCOL;
+		}
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+/*
+ * Send a command and receive a fixed size answer.
+ */
+static inline dc_status_t
+dc_packet_transfer (dc_device_t *device, dc_serial_t *port, const dc_packet_framing_t *framing, const unsigned char command[], unsigned int csize, unsigned char answer[], unsigned int asize)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	status = dc_packet_send_command (device, port, framing, command, csize);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	return dc_packet_receive_answer (device, port, framing, command, csize, answer, asize);
+}
+
+/*
+ * Send a length prefixed packet. The packet consists of the start byte,
+ * the length of the payload, the payload and the checksum.
+ */
+static inline dc_status_t
+dc_packet_send (dc_device_t *device, dc_serial_t *port, const dc_packet_framing_t *framing, const unsigned char data[], unsigned int size)
+{
+	unsigned char packet[DC_PACKET_MAXLENGTH + 4];
+
+	if (size < 1 || size > DC_PACKET_MAXLENGTH)
+		return DC_STATUS_INVALIDARGS;
+
+	// Setup the data packet.
+	packet[0] = framing->start;
+	packet[1] = size;
+	memcpy (packet + 2, data, size);
+	unsigned int crc = dc_packet_checksum_calculate (framing, packet + framing->checksum_begin, size + 2 - framing->checksum_begin);
+	dc_packet_checksum_set (framing, packet + size + 2, crc);
+
+	return dc_packet_send_command (device, port, framing, packet, size + 2 + dc_packet_checksum_size (framing));
+}
+
+/*
+ * Receive a length prefixed packet. Any garbage bytes before the start
+ * byte are ignored.
+ */
+static inline dc_status_t
+dc_packet_receive (dc_device_t *device, dc_serial_t *port, const dc_packet_framing_t *framing, unsigned char answer[], unsigned int asize, unsigned int *actual)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	unsigned char packet[DC_PACKET_MAXLENGTH + 4];
+
+	// Read the packet start byte.
+	while (1) {
+		status = dc_serial_read (port, packet + 0, 1, NULL);
+		if (status != DC_STATUS_SUCCESS) {
+			ERROR (device->context, "Failed to receive the packet start byte.");
+			return status;
+		}
+
+		if (packet[0] == framing->start)
+			break;
+	}
+
+	// Read the packet length.
+	status = dc_serial_read (port, packet + 1, 1, NULL);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (device->context, "Failed to receive the packet length.");
+		return status;
+	}
+
+	unsigned int len = packet[1];
+	if (len < framing->minimum || len > asize) {
+		ERROR (device->context, "Invalid packet length.");
+		return DC_STATUS_PROTOCOL;
+	}
+
+	// Read the packet payload and checksum.
+	status = dc_serial_read (port, packet + 2, len + dc_packet_checksum_size (framing), NULL);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (device->context, "Failed to receive the packet payload and checksum.");
+		return status;
+	}
+
+	// Verify the checksum.
+	if (framing->checksum != DC_PACKET_CHECKSUM_NONE) {
+		unsigned int crc = dc_packet_checksum_get (framing, packet + len + 2);
+		unsigned int ccrc = dc_packet_checksum_calculate (framing, packet + framing->checksum_begin, len + 2 - framing->checksum_begin);
+		if (crc != ccrc) {
+			ERROR (device->context, "Unexpected packet checksum.");
+			return DC_STATUS_PROTOCOL;
+		}
+	}
+
+	memcpy (answer, packet + 2, len);
+	if (actual)
+		*actual = len;
+
+	return DC_STATUS_SUCCESS;
+}
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_PACKET_H */
@@ -0,0 +1,310 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "pagecache.h"
+#include "context-private.h"
+#include "checksum.h"
+#include "array.h"
+
+#define PAGECACHE_MAGIC   0x43504344 /* DCPC */
+#define PAGECACHE_VERSION 1
+
+#define SZ_HEADER 24
+#define SZ_ENTRY  4
+
+#define VALID 0x0001
+
+struct dc_pagecache_t {
+	dc_context_t *context;
+	char *filename;
+	dc_family_t family;
+	unsigned int serial;
+	unsigned int memsize;
+	unsigned int pagesize;
+	unsigned int npages;
+	unsigned char *data;
+	unsigned char *valid;
+};
+
+static void
+dc_pagecache_load (dc_pagecache_t *cache)
+{
+	unsigned char header[SZ_HEADER] = {0};
+	unsigned char *table = NULL;
+	unsigned int count = 0;
+
+	FILE *fp = fopen (cache->filename, "rb");
+	if (fp == NULL)
+		return; // No cache available yet.
+
+	if (fread (header, 1, sizeof (header), fp) != sizeof (header) ||
+		array_uint32_le (header +  0) != PAGECACHE_MAGIC ||
+		array_uint32_le (header +  4) != PAGECACHE_VERSION ||
+		array_uint32_le (header +  8) != cache->family ||
+		array_uint32_le (header + 12) != cache->serial ||
+		array_uint32_le (header + 16) != cache->memsize ||
+		array_uint32_le (header + 20) != cache->pagesize) {
+		WARNING (cache->context, "Ignoring incompatible page cache.");
+		goto error_close;
+	}
+
+	table = (unsigned char *) malloc (cache->npages * SZ_ENTRY);
+	if (table == NULL) {
+		ERROR (cache->context, "Failed to allocate memory.");
+		goto error_close;
+	}
+
+	if (fread (table, SZ_ENTRY, cache->npages, fp) != cache->npages ||
+		fread (cache->data, 1, cache->memsize, fp) != cache->memsize) {
+		WARNING (cache->context, "Ignoring truncated page cache.");
+		goto error_free;
+	}
+
+	for (unsigned int i = 0; i < cache->npages; ++i) {
+		unsigned int flags = array_uint16_le (table + i * SZ_ENTRY + 0);
+		unsigned int crc = array_uint16_le (table + i * SZ_ENTRY + 2);
+
+		if ((flags & VALID) == 0)
+			continue;
+
+		unsigned int offset = i * cache->pagesize;
+		unsigned int length = cache->memsize - offset;
+		if (length > cache->pagesize)
+			length = cache->pagesize;
+
+		if (checksum_crc_ccitt_uint16 (cache->data + offset, length, 0xffff) != crc) {
+			count++;
+			continue;
+		}
+
+		cache->valid[i] = 1;
+	}
+
+	if (count) {
+		WARNING (cache->context, "Page cache contains %u corrupted pages.", count);
+	}
+
+error_free:
+	free (table);
+error_close:
+	fclose (fp);
+}
+
+dc_status_t
+dc_pagecache_open (dc_pagecache_t **out, dc_context_t *context, const char *dirname, dc_family_t family, unsigned int serial, unsigned int memsize, unsigned int pagesize)
+{
+	dc_pagecache_t *cache = NULL;
+
+	if (out == NULL || dirname == NULL || memsize == 0 || pagesize == 0) {
+		ERROR (context, "Invalid arguments.");
+		return DC_STATUS_INVALIDARGS;
+	}
+
+	cache = (dc_pagecache_t *) malloc (sizeof (dc_pagecache_t));
+	if (cache == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	cache->context = context;
+	cache->family = family;
+	cache->serial = serial;
+	cache->memsize = memsize;
+	cache->pagesize = pagesize;
+	cache->npages = (memsize + pagesize - 1) / pagesize;
+	cache->data = (unsigned char *) calloc (memsize, 1);
+	cache->valid = (unsigned char *) calloc (cache->npages, 1);
+
+	size_t length = strlen (dirname) + 32;
+	cache->filename = (char *) malloc (length);
+
+	if (cache->data == NULL || cache->valid == NULL || cache->filename == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		dc_pagecache_close (cache);
+		return DC_STATUS_NOMEMORY;
+	}
+
+	snprintf (cache->filename, length, "%s/%08x-%08x.cache", dirname, family, serial);
+
+	dc_pagecache_load (cache);
+
+	*out = cache;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_pagecache_close (dc_pagecache_t *cache)
+{
+	if (cache == NULL)
+		return DC_STATUS_SUCCESS;
+
+	free (cache->filename);
+	free (cache->valid);
+	free (cache->data);
+	free (cache);
+
+	return DC_STATUS_SUCCESS;
+}
+
+int
+dc_pagecache_is_valid (dc_pagecache_t *cache, unsigned int address, unsigned int size)
+{
+	if (cache == NULL || address > cache->memsize || size > cache->memsize - address)
+		return 0;
+
+	if (size == 0)
+		return 1;
+
+	unsigned int first = address / cache->pagesize;
+	unsigned int last = (address + size - 1) / cache->pagesize;
+	for (unsigned int i = first; i <= last; ++i) {
+		if (!cache->valid[i])
+			return 0;
+	}
+
+	return 1;
+}
+
+dc_status_t
+dc_pagecache_get (dc_pagecache_t *cache, unsigned int address, unsigned char data[], unsigned int size)
+{
+	if (!dc_pagecache_is_valid (cache, address, size))
+		return DC_STATUS_INVALIDARGS;
+
+	memcpy (data, cache->data + address, size);
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_pagecache_set (dc_pagecache_t *cache, unsigned int address, const unsigned char data[], unsigned int size)
+{
+	if (cache == NULL || address > cache->memsize || size > cache->memsize - address)
+		return DC_STATUS_INVALIDARGS;
+
+	// Only entire pages can be stored.
+	if ((address % cache->pagesize) != 0 ||
+		((size % cache->pagesize) != 0 && address + size != cache->memsize))
+		return DC_STATUS_INVALIDARGS;
+
+	memcpy (cache->data + address, data, size);
+
+	unsigned int first = address / cache->pagesize;
+	unsigned int last = (address + size + cache->pagesize - 1) / cache->pagesize;
+	for (unsigned int i = first; i < last; ++i) {
+		cache->valid[i] = 1;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_pagecache_save (dc_pagecache_t *cache)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	unsigned char header[SZ_HEADER] = {0};
+	unsigned char *table = NULL;
+	char *tmpname = NULL;
+	FILE *fp = NULL;
+
+	if (cache == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	table = (unsigned char *) calloc (cache->npages, SZ_ENTRY);
+	size_t length = strlen (cache->filename) + 5;
+	tmpname = (char *) malloc (length);
+	if (table == NULL || tmpname == NULL) {
+		ERROR (cache->context, "Failed to allocate memory.");
+		status = DC_STATUS_NOMEMORY;
+		goto error_free;
+	}
+
+	array_uint32_le_set (header +  0, PAGECACHE_MAGIC);
+	array_uint32_le_set (header +  4, PAGECACHE_VERSION);
+	array_uint32_le_set (header +  8, cache->family);
+	array_uint32_le_set (header + 12, cache->serial);
+	array_uint32_le_set (header + 16, cache->memsize);
+	array_uint32_le_set (header + 20, cache->pagesize);
+
+	for (unsigned int i = 0; i < cache->npages; ++i) {
+		if (!cache->valid[i])
+			continue;
+
+		unsigned int offset = i * cache->pagesize;
+		unsigned int len = cache->memsize - offset;
+		if (len > cache->pagesize)
+			len = cache->pagesize;
+
+		unsigned short crc = checksum_crc_ccitt_uint16 (cache->data + offset, len, 0xffff);
+		table[i * SZ_ENTRY + 0] = VALID;
+		table[i * SZ_ENTRY + 2] = crc & 0xFF;
+		table[i * SZ_ENTRY + 3] = (crc >> 8) & 0xFF;
+	}
+
+	// Write to a temporary file first, and replace the previous cache
+	// only when everything has been written successfully.
+	snprintf (tmpname, length, "%s.tmp", cache->filename);
+
+	fp = fopen (tmpname, "wb");
+	if (fp == NULL) {
+		ERROR (cache->context, "Failed to open the file.");
+		status = DC_STATUS_IO;
+		goto error_free;
+	}
+
+	if (fwrite (header, 1, sizeof (header), fp) != sizeof (header) ||
+		fwrite (table, SZ_ENTRY, cache->npages, fp) != cache->npages ||
+		fwrite (cache->data, 1, cache->memsize, fp) != cache->memsize) {
+		ERROR (cache->context, "Failed to write the file.");
+		fclose (fp);
+		remove (tmpname);
+		status = DC_STATUS_IO;
+		goto error_free;
+	}
+
+	if (fclose (fp) != 0) {
+		ERROR (cache->context, "Failed to close the file.");
+		remove (tmpname);
+		status = DC_STATUS_IO;
+		goto error_free;
+	}
+
+#ifdef _WIN32
+	// On Windows, rename fails if the destination already exists.
+	remove (cache->filename);
+#endif
+	if (rename (tmpname, cache->filename) != 0) {
+		ERROR (cache->context, "Failed to rename the file.");
+		remove (tmpname);
+		status = DC_STATUS_IO;
+		goto error_free;
+	}
+
+error_free:
+	free (tmpname);
+	free (table);
+	return status;
+}
@@ -0,0 +1,62 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_PAGECACHE_H
+#define DC_PAGECACHE_H
+
+#include <libdivecomputer/common.h>
+#include <libdivecomputer/context.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * A persistent copy of the memory of a device, identified by the family
+ * type and serial number. Backends that need to download the full memory
+ * can use it to read only the regions that changed since the last
+ * download. Every page is stored with a checksum, and pages that fail
+ * the verification are treated as not cached.
+ */
+typedef struct dc_pagecache_t dc_pagecache_t;
+
+dc_status_t
+dc_pagecache_open (dc_pagecache_t **cache, dc_context_t *context, const char *dirname, dc_family_t family, unsigned int serial, unsigned int memsize, unsigned int pagesize);
+
+dc_status_t
+dc_pagecache_close (dc_pagecache_t *cache);
+
+int
+dc_pagecache_is_valid (dc_pagecache_t *cache, unsigned int address, unsigned int size);
+
+dc_status_t
+dc_pagecache_get (dc_pagecache_t *cache, unsigned int address, unsigned char data[], unsigned int size);
+
+dc_status_t
+dc_pagecache_set (dc_pagecache_t *cache, unsigned int address, const unsigned char data[], unsigned int size);
+
+dc_status_t
+dc_pagecache_save (dc_pagecache_t *cache);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_PAGECACHE_H */
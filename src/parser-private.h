@@ -34,11 +34,136 @@ struct dc_parser_vtable_t;
 
 typedef struct dc_parser_vtable_t dc_parser_vtable_t;
 
+typedef struct sample_tank_statistics_t {
+	unsigned int npressures;
+	unsigned int begintime, endtime;
+	double beginpressure, endpressure;
+	double beginarea, endarea;
+} sample_tank_statistics_t;
+
+typedef struct sample_statistics_t {
+	unsigned int nsamples;
+	unsigned int divetime;
+	unsigned int ndepths;
+	double maxdepth;
+	double avgdepth;
+	unsigned int ntemperatures;
+	double mintemperature;
+	double maxtemperature;
+	// Internal state for the time weighted average.
+	unsigned int time;
+	double depth;
+	double area;
+	// Maximum ascent and descent rates, and the start of the interval.
+	unsigned int nrates;
+	double ascent_rate;
+	double descent_rate;
+	unsigned int rate_time;
+	double rate_depth;
+	// First and last pressure of each tank, for the gas consumption.
+	sample_tank_statistics_t tank[DC_FIELDS_MAXTANKS];
+	// Time at depth.
+	dc_depth_histogram_t histogram;
+} sample_statistics_t;
+
+#define SAMPLE_STATISTICS_INITIALIZER {0, 0, 0, 0.0, 0.0, 0, 0.0, 0.0, 0, 0.0, 0.0}
+
+#define SAMPLE_INDEX_MAXSTATE 64
+
+/*
+ * A checkpoint records where the decoding of a sample starts: the sample
+ * number, its time and the byte offset in the dive data.
+ */
+typedef struct sample_checkpoint_t {
+	unsigned int sample;
+	unsigned int time;
+	unsigned int offset;
+} sample_checkpoint_t;
+
+/*
+ * Sparse index of the samples, with a checkpoint every interval samples.
+ * The state contains the backend data needed to resume at a checkpoint,
+ * which is otherwise only known after a full pass over the samples.
+ */
+typedef struct sample_index_t {
+	unsigned int interval;
+	unsigned int nsamples;
+	unsigned int count;
+	unsigned int capacity;
+	sample_checkpoint_t *checkpoints;
+	unsigned int nstate;
+	unsigned char state[SAMPLE_INDEX_MAXSTATE];
+} sample_index_t;
+
+#define SAMPLE_CHUNK_MIN 1024
+
+/*
+ * A chunk of samples which can be decoded independently: the byte range
+ * in the dive data, the number of the first sample, the number of
+ * samples, and the backend state at the start of the chunk.
+ */
+typedef struct sample_chunk_t {
+	unsigned int begin;
+	unsigned int end;
+	unsigned int first;
+	unsigned int nsamples;
+	unsigned int state;
+} sample_chunk_t;
+
+/*
+ * A sub-dive of a session (e.g. a single freedive), with the location of
+ * its depth profile in the dive data: nsamples little endian 16 bit depths
+ * (1/10 m), stride bytes apart, and interval seconds between them. A
+ * sub-dive with only a summary has a zero stride.
+ */
+typedef struct parser_subdive_t {
+	dc_subdive_t info;
+	unsigned int offset;
+	unsigned int stride;
+	unsigned int interval;
+} parser_subdive_t;
+
+typedef struct dc_event_name_t {
+	char *name;
+	const char *source; /* Last name pointer passed by the backend */
+	unsigned int active;
+} dc_event_name_t;
+
 struct dc_parser_t {
 	const dc_parser_vtable_t *vtable;
 	dc_context_t *context;
 	const unsigned char *data;
 	unsigned int size;
+	// Statistics derived from the samples, computed on first use.
+	unsigned int have_statistics;
+	dc_status_t statistics_status;
+	sample_statistics_t statistics;
+	// Event options and the interned event names.
+	unsigned int event_options;
+	dc_event_name_t *event_names;
+	unsigned int nevent_names;
+	unsigned int event_names_capacity;
+	// Sample index of the current dive.
+	sample_index_t *index;
+	// Number of threads for the sample extraction.
+	unsigned int nthreads;
+	// Cancellation, and the deadline of the time budget (if any).
+	dc_cancel_callback_t cancel_callback;
+	void *cancel_userdata;
+	unsigned int budget;
+	unsigned long long deadline;
+	unsigned int cancelled;
+	// Sample types delivered to the application, and the types the
+	// backend may skip during the current walk.
+	unsigned int sample_mask;
+	unsigned int sample_skip;
+	// Derive the missing summary fields from the samples.
+	unsigned int derived_fields;
+	// Memory allocated by the backend, on top of the object itself.
+	size_t memory;
+	// Statistics not yet added to the context.
+	unsigned int stats_enabled;
+	dc_parser_stats_t stats;
 };
 
 struct dc_parser_vtable_t {
@@ -54,6 +179,50 @@ struct dc_parser_vtable_t {
 
 	dc_status_t (*samples_foreach) (dc_parser_t *parser, dc_sample_callback_t callback, void *userdata);
 
+	dc_status_t (*samples_extract) (dc_parser_t *parser, dc_sample_columns_t *columns);
+
+	/*
+	 * Optional random access to the samples, for backends where the
+	 * position of a sample can be computed. The samples_range function
+	 * delivers up to count samples, starting with the sample at the
+	 * first index. The samples_seek function returns the index of the
+	 * first sample at or after the time. Any index past the last sample
+	 * is the end of the samples.
+	 */
+	dc_status_t (*samples_range) (dc_parser_t *parser, unsigned int first, unsigned int count, dc_sample_callback_t callback, void *userdata);
+
+	dc_status_t (*samples_seek) (dc_parser_t *parser, unsigned int time, unsigned int *index);
+
+	/*
+	 * Optional sample index. The backend adds a checkpoint for every
+	 * interval samples, and uses the index of the parser (if any) to
+	 * resume in samples_range.
+	 */
+	dc_status_t (*samples_index) (dc_parser_t *parser, sample_index_t *index);
+
+	/*
+	 * Optional parallel decoding. The samples_split function divides the
+	 * samples into at most count chunks, of at least SAMPLE_CHUNK_MIN
+	 * samples each (except for a single chunk), and caches everything
+	 * the chunks need. The samples_chunk function must be safe to call
+	 * concurrently for different chunks, and must not modify the parser.
+	 */
+	dc_status_t (*samples_split) (dc_parser_t *parser, sample_chunk_t chunks[], unsigned int *count);
+
+	dc_status_t (*samples_chunk) (dc_parser_t *parser, const sample_chunk_t *chunk, dc_sample_callback_t callback, void *userdata);
+
+	/*
+	 * Optional table of the sub-dives of a session, built once for the
+	 * current dive data and owned by the backend.
+	 */
+	dc_status_t (*subdives) (dc_parser_t *parser, const parser_subdive_t **table, unsigned int *count);
+
+	/*
+	 * Optional direct location of the vendor data, with the same result
+	 * as collecting the DC_SAMPLE_VENDOR samples of samples_foreach.
+	 */
+	dc_status_t (*samples_vendor) (dc_parser_t *parser, dc_vendor_spans_t *spans);
+
 	dc_status_t (*destroy) (dc_parser_t *parser);
 };
 
@@ -66,16 +235,93 @@ dc_parser_deallocate (dc_parser_t *parser);
 int
 dc_parser_isinstance (dc_parser_t *parser, const dc_parser_vtable_t *vtable);
 
-typedef struct sample_statistics_t {
-	unsigned int divetime;
-	double maxdepth;
-} sample_statistics_t;
+/*
+ * Check whether the parsing of the current dive is cancelled, by the
+ * application or by the time budget. The result is latched until the
+ * next dc_parser_set_data call. Backends call this from long loops, once
+ * every PARSER_CANCEL_INTERVAL iterations, and return DC_STATUS_CANCELLED.
+ */
+#define PARSER_CANCEL_INTERVAL 256
+
+int
+parser_is_cancelled (dc_parser_t *parser);
 
-#define SAMPLE_STATISTICS_INITIALIZER {0, 0.0}
+/*
+ * Check whether the samples of a type are needed by the current walk.
+ * Backends use this to skip the decoding of the types masked out by the
+ * application. Samples delivered anyway are dropped before the callback.
+ */
+#define parser_sample_wanted(parser,type) (((parser)->sample_skip & (1u << (type))) == 0)
+
+/*
+ * Report the buffers allocated by the backend, for the memory usage of
+ * the parser and its context. Everything still reported when the parser
+ * is destroyed, is released automatically.
+ */
+void
+parser_memory_add (dc_parser_t *parser, size_t size);
+
+void
+parser_memory_sub (dc_parser_t *parser, size_t size);
+
+dc_status_t
+sample_index_append (sample_index_t *index, unsigned int sample, unsigned int time, unsigned int offset);
+
+/*
+ * Get the last checkpoint at or before the sample, or NULL if there is none.
+ */
+const sample_checkpoint_t *
+sample_index_find (const sample_index_t *index, unsigned int sample);
 
 void
 sample_statistics_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata);
 
+/*
+ * Get the statistics of the samples of the current dive. The samples are
+ * parsed only once after each dc_parser_set_data call, and the result is
+ * cached for all subsequent calls.
+ */
+dc_status_t
+dc_parser_get_statistics (dc_parser_t *parser, const sample_statistics_t **statistics);
+
+void
+sample_columns_time (dc_sample_columns_t *columns, unsigned int time);
+
+/*
+ * Start the columns for a dive with count samples at a fixed interval,
+ * with the first sample after one interval, and without gas mixes and
+ * tank pressures. The time, gas mix and pressure columns are filled in
+ * directly, and the number of samples that fit in the columns is
+ * returned, for the parser to fill in the remaining columns.
+ */
+unsigned int
+sample_columns_interval (dc_sample_columns_t *columns, unsigned int count, unsigned int interval);
+
+void
+sample_columns_depth (dc_sample_columns_t *columns, double depth);
+
+void
+sample_columns_temperature (dc_sample_columns_t *columns, double temperature);
+
+void
+sample_columns_pressure (dc_sample_columns_t *columns, unsigned int tank, double pressure);
+
+void
+sample_columns_gasmix (dc_sample_columns_t *columns, unsigned int gasmix);
+
+void
+sample_columns_event (dc_sample_columns_t *columns, unsigned int type, unsigned int time, const char *name, unsigned int flags, unsigned int value);
+
+/*
+ * Add an event to a sample filled in directly by the parser, with the
+ * index of that sample.
+ */
+void
+sample_columns_event_at (dc_sample_columns_t *columns, unsigned int sample, unsigned int type, unsigned int time, const char *name, unsigned int flags, unsigned int value);
+
+void
+sample_columns_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -19,8 +19,14 @@
  * MA 02110-1301 USA
  */
 
+#define DC_LOG_CATEGORY DC_LOGCATEGORY_PARSER
+
 #include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
 #include <assert.h>
+#include <limits.h>
 
 #include <libdivecomputer/suunto.h>
 #include <libdivecomputer/reefnet.h>
@@ -40,9 +46,14 @@
 #include "context-private.h"
 #include "parser-private.h"
 #include "device-private.h"
+#include "thread.h"
+#include "checksum.h"
+#include "array.h"
 
 #define REACTPROWHITE 0x4354
 
+#define C_ARRAY_SIZE(array) (sizeof (array) / sizeof *(array))
+
 static dc_status_t
 dc_parser_new_internal (dc_parser_t **out, dc_context_t *context, dc_family_t family, unsigned int model, unsigned int serial, unsigned int devtime, dc_ticks_t systime)
 {
@@ -53,6 +64,7 @@ dc_parser_new_internal (dc_parser_t **out, dc_context_t *context, dc_family_t fa
 		return DC_STATUS_INVALIDARGS;
 
 	switch (family) {
+#ifdef ENABLE_BACKEND_SUUNTO
 	case DC_FAMILY_SUUNTO_SOLUTION:
 		rc = suunto_solution_parser_create (&parser, context);
 		break;
@@ -72,6 +84,8 @@ dc_parser_new_internal (dc_parser_t **out, dc_context_t *context, dc_family_t fa
 	case DC_FAMILY_SUUNTO_EONSTEEL:
 		rc = suunto_eonsteel_parser_create(&parser, context, model);
 		break;
+#endif
+#ifdef ENABLE_BACKEND_UWATEC
 	case DC_FAMILY_UWATEC_ALADIN:
 	case DC_FAMILY_UWATEC_MEMOMOUSE:
 		rc = uwatec_memomouse_parser_create (&parser, context, devtime, systime);
@@ -80,6 +94,8 @@ dc_parser_new_internal (dc_parser_t **out, dc_context_t *context, dc_family_t fa
 	case DC_FAMILY_UWATEC_MERIDIAN:
 		rc = uwatec_smart_parser_create (&parser, context, model, devtime, systime);
 		break;
+#endif
+#ifdef ENABLE_BACKEND_REEFNET
 	case DC_FAMILY_REEFNET_SENSUS:
 		rc = reefnet_sensus_parser_create (&parser, context, devtime, systime);
 		break;
@@ -89,6 +105,8 @@ dc_parser_new_internal (dc_parser_t **out, dc_context_t *context, dc_family_t fa
 	case DC_FAMILY_REEFNET_SENSUSULTRA:
 		rc = reefnet_sensusultra_parser_create (&parser, context, devtime, systime);
 		break;
+#endif
+#ifdef ENABLE_BACKEND_OCEANIC
 	case DC_FAMILY_OCEANIC_VTPRO:
 		rc = oceanic_vtpro_parser_create2 (&parser, context, model);
 		break;
@@ -101,6 +119,8 @@ dc_parser_new_internal (dc_parser_t **out, dc_context_t *context, dc_family_t fa
 		else
 			rc = oceanic_atom2_parser_create (&parser, context, model, serial);
 		break;
+#endif
+#ifdef ENABLE_BACKEND_MARES
 	case DC_FAMILY_MARES_NEMO:
 	case DC_FAMILY_MARES_PUCK:
 		rc = mares_nemo_parser_create (&parser, context, model);
@@ -111,6 +131,8 @@ dc_parser_new_internal (dc_parser_t **out, dc_context_t *context, dc_family_t fa
 	case DC_FAMILY_MARES_ICONHD:
 		rc = mares_iconhd_parser_create (&parser, context, model);
 		break;
+#endif
+#ifdef ENABLE_BACKEND_HW
 	case DC_FAMILY_HW_OSTC:
 		rc = hw_ostc_parser_create (&parser, context, serial, 0);
 		break;
@@ -118,34 +140,56 @@ dc_parser_new_internal (dc_parser_t **out, dc_context_t *context, dc_family_t fa
 	case DC_FAMILY_HW_OSTC3:
 		rc = hw_ostc3_parser_create (&parser, context, serial, model);
 		break;
+#endif
+#if defined(ENABLE_BACKEND_CRESSI) || defined(ENABLE_BACKEND_ZEAGLE)
+	// The Zeagle N2iTiON3 shares the Cressi Edy data format.
+#ifdef ENABLE_BACKEND_CRESSI
 	case DC_FAMILY_CRESSI_EDY:
+#endif
+#ifdef ENABLE_BACKEND_ZEAGLE
 	case DC_FAMILY_ZEAGLE_N2ITION3:
+#endif
 		rc = cressi_edy_parser_create (&parser, context, model);
 		break;
+#endif
+#ifdef ENABLE_BACKEND_CRESSI
 	case DC_FAMILY_CRESSI_LEONARDO:
 		rc = cressi_leonardo_parser_create (&parser, context);
 		break;
+#endif
+#ifdef ENABLE_BACKEND_ATOMICS
 	case DC_FAMILY_ATOMICS_COBALT:
 		rc = atomics_cobalt_parser_create (&parser, context);
 		break;
+#endif
+#ifdef ENABLE_BACKEND_SHEARWATER
 	case DC_FAMILY_SHEARWATER_PREDATOR:
 		rc = shearwater_predator_parser_create (&parser, context, serial);
 		break;
 	case DC_FAMILY_SHEARWATER_PETREL:
 		rc = shearwater_petrel_parser_create (&parser, context, serial);
 		break;
+#endif
+#ifdef ENABLE_BACKEND_DIVERITE
 	case DC_FAMILY_DIVERITE_NITEKQ:
 		rc = diverite_nitekq_parser_create (&parser, context);
 		break;
+#endif
+#ifdef ENABLE_BACKEND_CITIZEN
 	case DC_FAMILY_CITIZEN_AQUALAND:
 		rc = citizen_aqualand_parser_create (&parser, context);
 		break;
+#endif
+#ifdef ENABLE_BACKEND_DIVESYSTEM
 	case DC_FAMILY_DIVESYSTEM_IDIVE:
 		rc = divesystem_idive_parser_create2 (&parser, context, model);
 		break;
+#endif
+#ifdef ENABLE_BACKEND_COCHRAN
 	case DC_FAMILY_COCHRAN_COMMANDER:
 		rc = cochran_commander_parser_create (&parser, context, model);
 		break;
+#endif
 	default:
 		return DC_STATUS_INVALIDARGS;
 	}
@@ -178,6 +222,17 @@ dc_parser_new2 (dc_parser_t **out, dc_context_t *context, dc_descriptor_t *descr
 		devtime, systime);
 }
 
+static void
+dc_parser_free_index (dc_parser_t *parser)
+{
+	if (parser->index) {
+		free (parser->index->checkpoints);
+		free (parser->index);
+		parser->index = NULL;
+	}
+}
+
+
 dc_parser_t *
 dc_parser_allocate (dc_context_t *context, const dc_parser_vtable_t *vtable)
 {
@@ -187,7 +242,7 @@ dc_parser_allocate (dc_context_t *context, const dc_parser_vtable_t *vtable)
 	assert(vtable->size >= sizeof(dc_parser_t));
 
 	// Allocate memory.
-	parser = (dc_parser_t *) malloc (vtable->size);
+	parser = (dc_parser_t *) dc_context_allocate (context, vtable->size);
 	if (parser == NULL) {
 		ERROR (context, "Failed to allocate memory.");
 		return parser;
@@ -198,14 +253,55 @@ dc_parser_allocate (dc_context_t *context, const dc_parser_vtable_t *vtable)
 	parser->context = context;
 	parser->data = NULL;
 	parser->size = 0;
+	parser->have_statistics = 0;
+	parser->statistics_status = DC_STATUS_SUCCESS;
+	parser->event_options = 0;
+	parser->event_names = NULL;
+	parser->nevent_names = 0;
+	parser->event_names_capacity = 0;
+	parser->index = NULL;
+	parser->nthreads = 1;
+	parser->cancel_callback = NULL;
+	parser->cancel_userdata = NULL;
+	parser->budget = 0;
+	parser->deadline = 0;
+	parser->cancelled = 0;
+	parser->sample_mask = DC_SAMPLE_MASK_ALL;
+	parser->sample_skip = 0;
+	parser->derived_fields = 0;
+	parser->memory = 0;
+	parser->stats_enabled = dc_context_parser_stats_enabled (context);
+	memset (&parser->stats, 0, sizeof (parser->stats));
+	parser->stats.nparsers = 1;
+	dc_context_memory_add (context, vtable->size);
 
 	return parser;
 }
 
+static void
+dc_parser_stats_flush (dc_parser_t *parser)
+{
+	if (parser->stats_enabled) {
+		dc_context_parser_stats_add (parser->context, parser->vtable->type, &parser->stats);
+		memset (&parser->stats, 0, sizeof (parser->stats));
+	}
+
+	parser->stats_enabled = dc_context_parser_stats_enabled (parser->context);
+}
+
 void
 dc_parser_deallocate (dc_parser_t *parser)
 {
-	free (parser);
+	dc_parser_stats_flush (parser);
+
+	dc_context_memory_sub (parser->context, parser->vtable->size + parser->memory);
+
+	for (unsigned int i = 0; i < parser->nevent_names; ++i) {
+		free (parser->event_names[i].name);
+	}
+	free (parser->event_names);
+	dc_parser_free_index (parser);
+	dc_context_deallocate (parser->context, parser);
 }
 
 int
@@ -239,8 +335,117 @@ dc_parser_set_data (dc_parser_t *parser, const unsigned char *data, unsigned int
 
 	parser->data = data;
 	parser->size = size;
+	parser->have_statistics = 0;
+	dc_parser_free_index (parser);
+
+	// Start the time budget of the new dive.
+	parser->cancelled = 0;
+	parser->deadline = 0;
+	if (parser->budget)
+		parser->deadline = dc_context_clock () + parser->budget * 1000ULL;
+
+	// The counters of the previous dive are complete now.
+	dc_parser_stats_flush (parser);
+	if (!parser->stats_enabled)
+		return parser->vtable->set_data (parser, data, size);
+
+	unsigned long long begin = dc_context_clock ();
+	dc_status_t rc = parser->vtable->set_data (parser, data, size);
+	parser->stats.setdatatime += dc_context_clock () - begin;
+	parser->stats.ndives++;
+	parser->stats.nbytes += size;
+
+	return rc;
+}
+
+
+dc_status_t
+dc_parser_set_cancel (dc_parser_t *parser, dc_cancel_callback_t callback, void *userdata)
+{
+	if (parser == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	parser->cancel_callback = callback;
+	parser->cancel_userdata = userdata;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+dc_status_t
+dc_parser_set_budget (dc_parser_t *parser, unsigned int milliseconds)
+{
+	if (parser == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	// The budget applies from the next dive on.
+	parser->budget = milliseconds;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+dc_status_t
+dc_parser_get_memory_usage (dc_parser_t *parser, size_t *usage)
+{
+	if (parser == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (usage == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	size_t total = parser->vtable->size + parser->memory;
+
+	total += parser->event_names_capacity * sizeof (dc_event_name_t);
+	for (unsigned int i = 0; i < parser->nevent_names; ++i) {
+		total += strlen (parser->event_names[i].name) + 1;
+	}
+
+	if (parser->index) {
+		total += sizeof (sample_index_t) +
+			parser->index->capacity * sizeof (sample_checkpoint_t);
+	}
+
+	*usage = total;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+void
+parser_memory_add (dc_parser_t *parser, size_t size)
+{
+	parser->stats.nallocations++;
+	parser->memory += size;
+	dc_context_memory_add (parser->context, size);
+}
+
+
+void
+parser_memory_sub (dc_parser_t *parser, size_t size)
+{
+	parser->memory -= size;
+	dc_context_memory_sub (parser->context, size);
+}
+
+
+int
+parser_is_cancelled (dc_parser_t *parser)
+{
+	if (parser == NULL)
+		return 0;
+
+	if (parser->cancelled)
+		return 1;
 
-	return parser->vtable->set_data (parser, data, size);
+	if (parser->cancel_callback && parser->cancel_callback (parser->cancel_userdata)) {
+		parser->cancelled = 1;
+	} else if (parser->deadline && dc_context_clock () >= parser->deadline) {
+		WARNING (parser->context, "Time budget of the dive exhausted.");
+		parser->cancelled = 1;
+	}
+
+	return parser->cancelled;
 }
 
 
@@ -256,62 +461,2247 @@ dc_parser_get_datetime (dc_parser_t *parser, dc_datetime_t *datetime)
 	return parser->vtable->datetime (parser, datetime);
 }
 
-dc_status_t
-dc_parser_get_field (dc_parser_t *parser, dc_field_type_t type, unsigned int flags, void *value)
+static dc_status_t
+dc_parser_field (dc_parser_t *parser, dc_field_type_t type, unsigned int flags, void *value)
 {
-	if (parser == NULL)
+	dc_status_t rc = DC_STATUS_UNSUPPORTED;
+
+	if (parser->vtable->field)
+		rc = parser->vtable->field (parser, type, flags, value);
+
+	if (rc != DC_STATUS_UNSUPPORTED)
+		return rc;
+
+	// Fallback to the statistics derived from the samples. They are
+	// cached, so all fields together cost only a single pass. For the
+	// fields a backend can provide itself, that's only done on request,
+	// because the callers may rely on DC_STATUS_UNSUPPORTED.
+	switch (type) {
+	case DC_FIELD_DIVETIME:
+	case DC_FIELD_MAXDEPTH:
+	case DC_FIELD_AVGDEPTH:
+	case DC_FIELD_TEMPERATURE_MINIMUM:
+	case DC_FIELD_TEMPERATURE_MAXIMUM:
+		if (!parser->derived_fields)
+			return DC_STATUS_UNSUPPORTED;
+		break;
+	case DC_FIELD_ASCENT_RATE:
+	case DC_FIELD_DESCENT_RATE:
+	case DC_FIELD_SAC:
+	case DC_FIELD_DEPTH_HISTOGRAM:
+		break;
+	default:
+		return DC_STATUS_UNSUPPORTED;
+	}
+
+	const sample_statistics_t *statistics = NULL;
+	const sample_tank_statistics_t *tank = NULL;
+	if (dc_parser_get_statistics (parser, &statistics) != DC_STATUS_SUCCESS)
 		return DC_STATUS_UNSUPPORTED;
 
-	if (parser->vtable->field == NULL)
+	if (statistics->nsamples == 0)
+		return DC_STATUS_UNSUPPORTED;
+
+	switch (type) {
+	case DC_FIELD_DIVETIME:
+		if (value)
+			*((unsigned int *) value) = statistics->divetime;
+		break;
+	case DC_FIELD_MAXDEPTH:
+		if (statistics->ndepths == 0)
+			return DC_STATUS_UNSUPPORTED;
+		if (value)
+			*((double *) value) = statistics->maxdepth;
+		break;
+	case DC_FIELD_AVGDEPTH:
+		if (statistics->ndepths == 0 || statistics->divetime == 0)
+			return DC_STATUS_UNSUPPORTED;
+		if (value)
+			*((double *) value) = statistics->avgdepth;
+		break;
+	case DC_FIELD_TEMPERATURE_MINIMUM:
+		if (statistics->ntemperatures == 0)
+			return DC_STATUS_UNSUPPORTED;
+		if (value)
+			*((double *) value) = statistics->mintemperature;
+		break;
+	case DC_FIELD_TEMPERATURE_MAXIMUM:
+		if (statistics->ntemperatures == 0)
+			return DC_STATUS_UNSUPPORTED;
+		if (value)
+			*((double *) value) = statistics->maxtemperature;
+		break;
+	case DC_FIELD_ASCENT_RATE:
+		if (statistics->nrates == 0)
+			return DC_STATUS_UNSUPPORTED;
+		if (value)
+			*((double *) value) = statistics->ascent_rate;
+		break;
+	case DC_FIELD_DESCENT_RATE:
+		if (statistics->nrates == 0)
+			return DC_STATUS_UNSUPPORTED;
+		if (value)
+			*((double *) value) = statistics->descent_rate;
+		break;
+	case DC_FIELD_SAC:
+		if (flags >= DC_FIELDS_MAXTANKS)
+			return DC_STATUS_UNSUPPORTED;
+		tank = statistics->tank + flags;
+		if (tank->npressures < 2 || tank->endtime <= tank->begintime)
+			return DC_STATUS_UNSUPPORTED;
+		if (value) {
+			double interval = tank->endtime - tank->begintime;
+			double depth = (tank->endarea - tank->beginarea) / interval;
+			*((double *) value) = (tank->beginpressure - tank->endpressure) * 60.0 /
+				interval / (1.0 + depth / 10.0);
+		}
+		break;
+	case DC_FIELD_DEPTH_HISTOGRAM:
+		if (statistics->ndepths == 0)
+			return DC_STATUS_UNSUPPORTED;
+		if (value)
+			*((dc_depth_histogram_t *) value) = statistics->histogram;
+		break;
+	default:
 		return DC_STATUS_UNSUPPORTED;
+	}
 
-	return parser->vtable->field (parser, type, flags, value);
+	return DC_STATUS_SUCCESS;
 }
 
 
 dc_status_t
-dc_parser_samples_foreach (dc_parser_t *parser, dc_sample_callback_t callback, void *userdata)
+dc_parser_get_field (dc_parser_t *parser, dc_field_type_t type, unsigned int flags, void *value)
 {
 	if (parser == NULL)
 		return DC_STATUS_UNSUPPORTED;
 
-	if (parser->vtable->samples_foreach == NULL)
-		return DC_STATUS_UNSUPPORTED;
+	if (parser_is_cancelled (parser))
+		return DC_STATUS_CANCELLED;
+
+	if (!parser->stats_enabled)
+		return dc_parser_field (parser, type, flags, value);
+
+	unsigned long long begin = dc_context_clock ();
+	dc_status_t rc = dc_parser_field (parser, type, flags, value);
+	parser->stats.fieldtime += dc_context_clock () - begin;
+	parser->stats.nfields++;
+
+	return rc;
+}
+
 
-	return parser->vtable->samples_foreach (parser, callback, userdata);
+static dc_status_t
+dc_parser_get_fields_value (dc_parser_t *parser, dc_fields_t *fields, dc_field_type_t type, unsigned int flags, void *value)
+{
+	unsigned long long begin = parser->stats_enabled ? dc_context_clock () : 0;
+	dc_status_t rc = dc_parser_field (parser, type, flags, value);
+	if (parser->stats_enabled) {
+		parser->stats.fieldtime += dc_context_clock () - begin;
+		parser->stats.nfields++;
+	}
+	if (rc == DC_STATUS_SUCCESS && flags == 0)
+		fields->mask |= (1u << type);
+
+	return rc;
 }
 
 
 dc_status_t
-dc_parser_destroy (dc_parser_t *parser)
+dc_parser_get_fields (dc_parser_t *parser, dc_fields_t *fields)
 {
-	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_status_t rc = DC_STATUS_SUCCESS;
+
+	if (parser == NULL || fields == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	memset (fields, 0, sizeof (dc_fields_t));
+
+	// Query all fields in a single pass. Unsupported fields are simply
+	// left out of the mask, but any other error is returned.
+	struct {
+		dc_field_type_t type;
+		void *value;
+	} simple[] = {
+		{DC_FIELD_DIVETIME, &fields->divetime},
+		{DC_FIELD_MAXDEPTH, &fields->maxdepth},
+		{DC_FIELD_AVGDEPTH, &fields->avgdepth},
+		{DC_FIELD_SALINITY, &fields->salinity},
+		{DC_FIELD_ATMOSPHERIC, &fields->atmospheric},
+		{DC_FIELD_TEMPERATURE_SURFACE, &fields->temperature_surface},
+		{DC_FIELD_TEMPERATURE_MINIMUM, &fields->temperature_minimum},
+		{DC_FIELD_TEMPERATURE_MAXIMUM, &fields->temperature_maximum},
+		{DC_FIELD_DIVEMODE, &fields->divemode},
+	};
+	for (unsigned int i = 0; i < C_ARRAY_SIZE (simple); ++i) {
+		rc = dc_parser_get_fields_value (parser, fields, simple[i].type, 0, simple[i].value);
+		if (rc != DC_STATUS_SUCCESS && rc != DC_STATUS_UNSUPPORTED)
+			return rc;
+	}
+
+	// Gas mixes.
+	unsigned int ngasmixes = 0;
+	rc = dc_parser_get_fields_value (parser, fields, DC_FIELD_GASMIX_COUNT, 0, &ngasmixes);
+	if (rc != DC_STATUS_SUCCESS && rc != DC_STATUS_UNSUPPORTED)
+		return rc;
+	if (ngasmixes > DC_FIELDS_MAXGASMIXES)
+		ngasmixes = DC_FIELDS_MAXGASMIXES;
+	for (unsigned int i = 0; i < ngasmixes; ++i) {
+		rc = dc_parser_field (parser, DC_FIELD_GASMIX, i, &fields->gasmix[i]);
+		if (rc != DC_STATUS_SUCCESS)
+			return rc;
+	}
+	if (ngasmixes)
+		fields->mask |= (1u << DC_FIELD_GASMIX);
+	fields->ngasmixes = ngasmixes;
+
+	// Tanks.
+	unsigned int ntanks = 0;
+	rc = dc_parser_get_fields_value (parser, fields, DC_FIELD_TANK_COUNT, 0, &ntanks);
+	if (rc != DC_STATUS_SUCCESS && rc != DC_STATUS_UNSUPPORTED)
+		return rc;
+	if (ntanks > DC_FIELDS_MAXTANKS)
+		ntanks = DC_FIELDS_MAXTANKS;
+	for (unsigned int i = 0; i < ntanks; ++i) {
+		rc = dc_parser_field (parser, DC_FIELD_TANK, i, &fields->tank[i]);
+		if (rc != DC_STATUS_SUCCESS)
+			return rc;
+	}
+	if (ntanks)
+		fields->mask |= (1u << DC_FIELD_TANK);
+	fields->ntanks = ntanks;
+
+	// Strings, until the first missing index.
+	unsigned int nstrings = 0;
+	while (nstrings < DC_FIELDS_MAXSTRINGS) {
+		rc = dc_parser_field (parser, DC_FIELD_STRING, nstrings, &fields->string[nstrings]);
+		if (rc != DC_STATUS_SUCCESS)
+			break;
+		nstrings++;
+	}
+	if (nstrings)
+		fields->mask |= (1u << DC_FIELD_STRING);
+	fields->nstrings = nstrings;
+
+	return DC_STATUS_SUCCESS;
+}
+
 
+dc_status_t
+dc_parser_verify (dc_parser_t *parser, const unsigned char data[], unsigned int size)
+{
 	if (parser == NULL)
-		return DC_STATUS_SUCCESS;
+		return DC_STATUS_INVALIDARGS;
 
-	if (parser->vtable->destroy) {
-		status = parser->vtable->destroy (parser);
+	dc_status_t rc = dc_parser_set_data (parser, data, size);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	// The backends validate the header and the framing of the profile
+	// when the header is cached, which happens for the first field. None
+	// of these fields fall back to the sample statistics, so the samples
+	// themselves are never decoded.
+	dc_datetime_t datetime;
+	rc = dc_parser_get_datetime (parser, &datetime);
+	if (rc != DC_STATUS_SUCCESS && rc != DC_STATUS_UNSUPPORTED)
+		return rc;
+
+	unsigned int ngasmixes = 0;
+	rc = dc_parser_get_field (parser, DC_FIELD_GASMIX_COUNT, 0, &ngasmixes);
+	if (rc != DC_STATUS_SUCCESS && rc != DC_STATUS_UNSUPPORTED)
+		return rc;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+typedef struct sample_events_t {
+	dc_parser_t *parser;
+	dc_sample_callback_t callback;
+	void *userdata;
+	dc_status_t status;
+	unsigned int active[SAMPLE_EVENT_STRING + 1];
+} sample_events_t;
+
+static dc_event_name_t *
+dc_parser_intern_event (dc_parser_t *parser, const char *name)
+{
+	dc_event_name_t *names = parser->event_names;
+	unsigned int n = parser->nevent_names;
+
+	// Backends usually pass the same pointer for every occurrence of a
+	// name, so try that first. The contents are always compared, because
+	// the memory of a previous dive may have been reused.
+	for (unsigned int i = 0; i < n; ++i) {
+		if (names[i].source == name && strcmp (names[i].name, name) == 0)
+			return names + i;
 	}
 
-	dc_parser_deallocate (parser);
+	for (unsigned int i = 0; i < n; ++i) {
+		if (strcmp (names[i].name, name) == 0) {
+			names[i].source = name;
+			return names + i;
+		}
+	}
 
-	return status;
+	if (n == parser->event_names_capacity) {
+		unsigned int capacity = parser->event_names_capacity ? parser->event_names_capacity * 2 : 16;
+		names = (dc_event_name_t *) realloc (parser->event_names, capacity * sizeof (dc_event_name_t));
+		if (names == NULL)
+			return NULL;
+		parser->event_names = names;
+		parser->event_names_capacity = capacity;
+	}
+
+	char *copy = strdup (name);
+	if (copy == NULL)
+		return NULL;
+
+	names[n].name = copy;
+	names[n].source = name;
+	names[n].active = 0;
+	parser->nevent_names++;
+
+	return names + n;
 }
 
+static void
+sample_events_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
+{
+	sample_events_t *events = (sample_events_t *) userdata;
+	dc_parser_t *parser = events->parser;
 
-void
-sample_statistics_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
+	if (type != DC_SAMPLE_EVENT) {
+		if (events->callback) events->callback (type, value, events->userdata);
+		return;
+	}
+
+	dc_event_name_t *entry = NULL;
+	if (value.event.name) {
+		entry = dc_parser_intern_event (parser, value.event.name);
+		if (entry == NULL) {
+			ERROR (parser->context, "Failed to allocate memory.");
+			events->status = DC_STATUS_NOMEMORY;
+		} else if (parser->event_options & DC_EVENT_INTERN) {
+			value.event.name = entry->name;
+		}
+	}
+
+	if (parser->event_options & DC_EVENT_TRANSITIONS) {
+		unsigned int flags = value.event.flags & (SAMPLE_FLAGS_BEGIN | SAMPLE_FLAGS_END);
+		unsigned int *active = NULL;
+		if (entry)
+			active = &entry->active;
+		else if (value.event.name == NULL && value.event.type < C_ARRAY_SIZE (events->active))
+			active = &events->active[value.event.type];
+
+		if (active && (flags == SAMPLE_FLAGS_BEGIN || flags == SAMPLE_FLAGS_END)) {
+			unsigned int state = flags == SAMPLE_FLAGS_BEGIN;
+			if (*active == state)
+				return;
+			*active = state;
+		}
+	}
+
+	if (events->callback) events->callback (type, value, events->userdata);
+}
+
+typedef struct sample_tee_t {
+	dc_sample_callback_t callback;
+	void *userdata;
+	sample_statistics_t statistics;
+} sample_tee_t;
+
+typedef struct sample_cancel_t {
+	dc_parser_t *parser;
+	dc_sample_callback_t callback;
+	void *userdata;
+	unsigned int count;
+} sample_cancel_t;
+
+static void
+sample_cancel_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
 {
-	sample_statistics_t *statistics  = (sample_statistics_t *) userdata;
+	sample_cancel_t *cancel = (sample_cancel_t *) userdata;
+
+	if (cancel->parser->cancelled)
+		return;
+
+	if (type == DC_SAMPLE_TIME && cancel->count++ % PARSER_CANCEL_INTERVAL == 0 &&
+		parser_is_cancelled (cancel->parser))
+		return;
+
+	if (cancel->callback) cancel->callback (type, value, cancel->userdata);
+}
+
+typedef struct sample_mask_t {
+	unsigned int mask;
+	dc_sample_callback_t callback;
+	void *userdata;
+} sample_mask_t;
+
+static void
+sample_mask_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
+{
+	sample_mask_t *mask = (sample_mask_t *) userdata;
+
+	if ((unsigned int) type < 32 && !(mask->mask & (1u << type)))
+		return;
+
+	if (mask->callback) mask->callback (type, value, mask->userdata);
+}
+
+static void
+sample_tee_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
+{
+	sample_tee_t *tee = (sample_tee_t *) userdata;
+
+	sample_statistics_cb (type, value, &tee->statistics);
+
+	if (tee->callback) tee->callback (type, value, tee->userdata);
+}
+
+/*
+ * Walk over all samples with the backend, and compute the statistics in
+ * the same pass if they are not available yet.
+ */
+static dc_status_t
+dc_parser_samples_walk (dc_parser_t *parser, dc_sample_callback_t callback, void *userdata)
+{
+	if (parser_is_cancelled (parser))
+		return DC_STATUS_CANCELLED;
+
+	// Drop the sample types masked out by the application. The backend
+	// may skip them entirely, so the statistics of such a pass are
+	// incomplete, and not kept.
+	sample_mask_t mask;
+	unsigned int skip = 0;
+	if (parser->sample_mask != DC_SAMPLE_MASK_ALL) {
+		mask.mask = parser->sample_mask | DC_SAMPLE_MASK (DC_SAMPLE_TIME);
+		mask.callback = callback;
+		mask.userdata = userdata;
+		callback = sample_mask_cb;
+		userdata = &mask;
+		skip = ~mask.mask;
+	}
+
+	// Stop delivering samples once cancelled, also for the backends
+	// which don't poll for cancellation themselves.
+	sample_cancel_t cancel;
+	if (parser->cancel_callback || parser->deadline) {
+		cancel.parser = parser;
+		cancel.callback = callback;
+		cancel.userdata = userdata;
+		cancel.count = 0;
+		callback = sample_cancel_cb;
+		userdata = &cancel;
+	}
+
+	if (parser->have_statistics || skip) {
+		unsigned int previous = parser->sample_skip;
+		parser->sample_skip = skip;
+		dc_status_t rc = parser->vtable->samples_foreach (parser, callback, userdata);
+		parser->sample_skip = previous;
+		if (parser->cancelled)
+			return DC_STATUS_CANCELLED;
+		return rc;
+	}
+
+	sample_statistics_t initializer = SAMPLE_STATISTICS_INITIALIZER;
+	sample_tee_t tee;
+	tee.callback = callback;
+	tee.userdata = userdata;
+	tee.statistics = initializer;
+
+	dc_status_t rc = parser->vtable->samples_foreach (parser, sample_tee_cb, &tee);
+	if (parser->cancelled)
+		return DC_STATUS_CANCELLED;
+
+	// Keep the statistics, unless the callback already triggered a
+	// separate pass for them.
+	if (rc == DC_STATUS_SUCCESS && !parser->have_statistics) {
+		parser->statistics = tee.statistics;
+		parser->statistics_status = DC_STATUS_SUCCESS;
+		parser->have_statistics = 1;
+	}
+
+	return rc;
+}
+
+static dc_status_t
+dc_parser_samples_events (dc_parser_t *parser, dc_sample_callback_t callback, void *userdata)
+{
+	if (parser->event_options == 0)
+		return dc_parser_samples_walk (parser, callback, userdata);
+
+	// Every walk starts with all events inactive.
+	for (unsigned int i = 0; i < parser->nevent_names; ++i) {
+		parser->event_names[i].active = 0;
+	}
+
+	sample_events_t events;
+	memset (&events, 0, sizeof (events));
+	events.parser = parser;
+	events.callback = callback;
+	events.userdata = userdata;
+	events.status = DC_STATUS_SUCCESS;
+
+	dc_status_t rc = dc_parser_samples_walk (parser, sample_events_cb, &events);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	return events.status;
+}
+
+typedef struct sample_count_t {
+	dc_parser_stats_t *stats;
+	dc_sample_callback_t callback;
+	void *userdata;
+} sample_count_t;
+
+static void
+sample_count_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
+{
+	sample_count_t *count = (sample_count_t *) userdata;
+
+	if ((unsigned int) type < DC_PARSER_STATS_NSAMPLES)
+		count->stats->nsamples[type]++;
+
+	if (count->callback) count->callback (type, value, count->userdata);
+}
+
+dc_status_t
+dc_parser_samples_foreach (dc_parser_t *parser, dc_sample_callback_t callback, void *userdata)
+{
+	if (parser == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (parser->vtable->samples_foreach == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (!parser->stats_enabled)
+		return dc_parser_samples_events (parser, callback, userdata);
+
+	sample_count_t count;
+	count.stats = &parser->stats;
+	count.callback = callback;
+	count.userdata = userdata;
+
+	unsigned long long begin = dc_context_clock ();
+	dc_status_t rc = dc_parser_samples_events (parser, sample_count_cb, &count);
+	parser->stats.samplestime += dc_context_clock () - begin;
+
+	return rc;
+}
+
+
+static int
+sample_fixed (double value)
+{
+	double scaled = value * DC_FIXED_SCALE;
+
+	// Round to the nearest integer. Values out of range (and NAN) are
+	// reported as unknown.
+	if (!(scaled > INT_MIN && scaled < INT_MAX))
+		return DC_FIXED_UNKNOWN;
+
+	return (int) (scaled < 0 ? ceil (scaled - 0.5) : floor (scaled + 0.5));
+}
+
+typedef struct sample_fixed_t {
+	dc_sample_fixed_callback_t callback;
+	void *userdata;
+} sample_fixed_t;
+
+static void
+sample_fixed_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
+{
+	sample_fixed_t *fixed = (sample_fixed_t *) userdata;
+	dc_sample_fixed_t sample;
+
+	memset (&sample, 0, sizeof (sample));
 
 	switch (type) {
+	case DC_SAMPLE_DEPTH:
+		sample.depth = sample_fixed (value.depth);
+		break;
+	case DC_SAMPLE_PRESSURE:
+		sample.pressure.tank = value.pressure.tank;
+		sample.pressure.value = sample_fixed (value.pressure.value);
+		break;
+	case DC_SAMPLE_TEMPERATURE:
+		sample.temperature = sample_fixed (value.temperature);
+		break;
+	case DC_SAMPLE_EVENT:
+		sample.event.type = value.event.type;
+		sample.event.time = value.event.time;
+		sample.event.name = value.event.name;
+		sample.event.flags = value.event.flags;
+		sample.event.value = value.event.value;
+		break;
+	case DC_SAMPLE_VENDOR:
+		sample.vendor.type = value.vendor.type;
+		sample.vendor.size = value.vendor.size;
+		sample.vendor.data = value.vendor.data;
+		break;
+	case DC_SAMPLE_SETPOINT:
+		sample.setpoint = sample_fixed (value.setpoint);
+		break;
+	case DC_SAMPLE_PPO2:
+		sample.ppo2 = sample_fixed (value.ppo2);
+		break;
+	case DC_SAMPLE_CNS:
+		sample.cns = sample_fixed (value.cns);
+		break;
+	case DC_SAMPLE_DECO:
+		sample.deco.type = value.deco.type;
+		sample.deco.time = value.deco.time;
+		sample.deco.depth = sample_fixed (value.deco.depth);
+		break;
 	case DC_SAMPLE_TIME:
-		statistics->divetime = value.time;
+	case DC_SAMPLE_RBT:
+	case DC_SAMPLE_HEARTBEAT:
+	case DC_SAMPLE_BEARING:
+	case DC_SAMPLE_GASMIX:
+	default:
+		// All these values are a single unsigned integer.
+		sample.time = value.time;
+		break;
+	}
+
+	fixed->callback (type, sample, fixed->userdata);
+}
+
+dc_status_t
+dc_parser_samples_foreach_fixed (dc_parser_t *parser, dc_sample_fixed_callback_t callback, void *userdata)
+{
+	if (parser == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (callback == NULL)
+		return dc_parser_samples_foreach (parser, NULL, NULL);
+
+	sample_fixed_t fixed = {callback, userdata};
+
+	return dc_parser_samples_foreach (parser, sample_fixed_cb, &fixed);
+}
+
+static void
+sample_columns_fixed_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
+{
+	dc_sample_columns_fixed_t *columns = (dc_sample_columns_fixed_t *) userdata;
+
+	unsigned int n = columns->nsamples - 1;
+	if (type == DC_SAMPLE_TIME) {
+		n = columns->nsamples++;
+		if (n >= columns->capacity)
+			return;
+
+		// Initialize all columns of the new sample.
+		if (columns->time)
+			columns->time[n] = value.time;
+		if (columns->depth)
+			columns->depth[n] = DC_FIXED_UNKNOWN;
+		if (columns->temperature)
+			columns->temperature[n] = DC_FIXED_UNKNOWN;
+		if (columns->gasmix)
+			columns->gasmix[n] = DC_GASMIX_UNKNOWN;
+		for (unsigned int i = 0; i < columns->ntanks; ++i) {
+			if (columns->pressure[i])
+				columns->pressure[i][n] = DC_FIXED_UNKNOWN;
+		}
+		return;
+	}
+
+	if (type == DC_SAMPLE_EVENT) {
+		// Gas changes are already available in the gas mix column.
+		if (value.event.type == SAMPLE_EVENT_GASCHANGE ||
+			value.event.type == SAMPLE_EVENT_GASCHANGE2)
+			return;
+
+		unsigned int i = columns->nevents++;
+		if (i >= columns->maxevents || columns->events == NULL)
+			return;
+
+		columns->events[i].sample = columns->nsamples ? columns->nsamples - 1 : 0;
+		columns->events[i].type = value.event.type;
+		columns->events[i].time = value.event.time;
+		columns->events[i].name = value.event.name;
+		columns->events[i].flags = value.event.flags;
+		columns->events[i].value = value.event.value;
+		return;
+	}
+
+	if (columns->nsamples == 0 || n >= columns->capacity)
+		return;
+
+	switch (type) {
+	case DC_SAMPLE_DEPTH:
+		if (columns->depth)
+			columns->depth[n] = sample_fixed (value.depth);
+		break;
+	case DC_SAMPLE_TEMPERATURE:
+		if (columns->temperature)
+			columns->temperature[n] = sample_fixed (value.temperature);
+		break;
+	case DC_SAMPLE_PRESSURE:
+		if (value.pressure.tank < columns->ntanks && columns->pressure[value.pressure.tank])
+			columns->pressure[value.pressure.tank][n] = sample_fixed (value.pressure.value);
+		break;
+	case DC_SAMPLE_GASMIX:
+		if (columns->gasmix)
+			columns->gasmix[n] = value.gasmix;
+		break;
+	default:
+		break;
+	}
+}
+
+dc_status_t
+dc_parser_samples_extract_fixed (dc_parser_t *parser, dc_sample_columns_fixed_t *columns)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+
+	if (parser == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (columns == NULL || (columns->ntanks && columns->pressure == NULL))
+		return DC_STATUS_INVALIDARGS;
+
+	columns->nsamples = 0;
+	columns->nevents = 0;
+
+	if (parser->vtable->samples_foreach == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	rc = dc_parser_samples_walk (parser, sample_columns_fixed_cb, columns);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	if (columns->nsamples > columns->capacity ||
+		columns->nevents > columns->maxevents)
+		return DC_STATUS_NOMEMORY;
+
+	return DC_STATUS_SUCCESS;
+}
+
+typedef struct sample_fanout_t {
+	const dc_sample_sink_t *sinks;
+	unsigned int count;
+} sample_fanout_t;
+
+static void
+sample_fanout_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
+{
+	sample_fanout_t *fanout = (sample_fanout_t *) userdata;
+
+	for (unsigned int i = 0; i < fanout->count; ++i) {
+		const dc_sample_sink_t *sink = fanout->sinks + i;
+		switch (sink->type) {
+		case DC_SAMPLE_SINK_CALLBACK:
+			if (sink->callback) sink->callback (type, value, sink->userdata);
+			break;
+		case DC_SAMPLE_SINK_COLUMNS:
+			sample_columns_cb (type, value, sink->columns);
+			break;
+		case DC_SAMPLE_SINK_COLUMNS_FIXED:
+			sample_columns_fixed_cb (type, value, sink->fixed);
+			break;
+		}
+	}
+}
+
+dc_status_t
+dc_parser_samples_fanout (dc_parser_t *parser, const dc_sample_sink_t sinks[], unsigned int count)
+{
+	if (parser == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (sinks == NULL && count)
+		return DC_STATUS_INVALIDARGS;
+
+	for (unsigned int i = 0; i < count; ++i) {
+		const dc_sample_sink_t *sink = sinks + i;
+		switch (sink->type) {
+		case DC_SAMPLE_SINK_CALLBACK:
+			break;
+		case DC_SAMPLE_SINK_COLUMNS:
+			if (sink->columns == NULL || (sink->columns->ntanks && sink->columns->pressure == NULL))
+				return DC_STATUS_INVALIDARGS;
+			sink->columns->nsamples = 0;
+			sink->columns->nevents = 0;
+			break;
+		case DC_SAMPLE_SINK_COLUMNS_FIXED:
+			if (sink->fixed == NULL || (sink->fixed->ntanks && sink->fixed->pressure == NULL))
+				return DC_STATUS_INVALIDARGS;
+			sink->fixed->nsamples = 0;
+			sink->fixed->nevents = 0;
+			break;
+		default:
+			return DC_STATUS_INVALIDARGS;
+		}
+	}
+
+	// A single walk over the samples feeds all sinks, and computes the
+	// derived metrics on the fly.
+	sample_fanout_t fanout = {sinks, count};
+	dc_status_t rc = dc_parser_samples_foreach (parser, sample_fanout_cb, &fanout);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	for (unsigned int i = 0; i < count; ++i) {
+		const dc_sample_sink_t *sink = sinks + i;
+		if (sink->type == DC_SAMPLE_SINK_COLUMNS &&
+			(sink->columns->nsamples > sink->columns->capacity ||
+			sink->columns->nevents > sink->columns->maxevents))
+			return DC_STATUS_NOMEMORY;
+		if (sink->type == DC_SAMPLE_SINK_COLUMNS_FIXED &&
+			(sink->fixed->nsamples > sink->fixed->capacity ||
+			sink->fixed->nevents > sink->fixed->maxevents))
+			return DC_STATUS_NOMEMORY;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_parser_set_event_options (dc_parser_t *parser, unsigned int options)
+{
+	if (parser == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (options & ~(DC_EVENT_TRANSITIONS | DC_EVENT_INTERN))
+		return DC_STATUS_INVALIDARGS;
+
+	parser->event_options = options;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_parser_set_sample_mask (dc_parser_t *parser, unsigned int mask)
+{
+	if (parser == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	parser->sample_mask = mask;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_parser_set_derived_fields (dc_parser_t *parser, unsigned int enable)
+{
+	if (parser == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	parser->derived_fields = enable ? 1 : 0;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_parser_get_event_id (dc_parser_t *parser, const char *name, unsigned int *id)
+{
+	if (parser == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (name == NULL || id == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	// Interned names are recognized by their pointer.
+	for (unsigned int i = 0; i < parser->nevent_names; ++i) {
+		if (parser->event_names[i].name == name) {
+			*id = i;
+			return DC_STATUS_SUCCESS;
+		}
+	}
+
+	for (unsigned int i = 0; i < parser->nevent_names; ++i) {
+		if (strcmp (parser->event_names[i].name, name) == 0) {
+			*id = i;
+			return DC_STATUS_SUCCESS;
+		}
+	}
+
+	return DC_STATUS_INVALIDARGS;
+}
+
+dc_status_t
+dc_parser_get_event_name (dc_parser_t *parser, unsigned int id, const char **name)
+{
+	if (parser == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (name == NULL || id >= parser->nevent_names)
+		return DC_STATUS_INVALIDARGS;
+
+	*name = parser->event_names[id].name;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+#define MAXTHREADS 64
+
+typedef struct sample_extract_chunk_t {
+	sample_chunk_t chunk;
+	dc_sample_columns_t columns;
+	dc_status_t status;
+} sample_extract_chunk_t;
+
+typedef struct sample_extract_t {
+	dc_parser_t *parser;
+	dc_mutex_t *mutex;
+	unsigned int count;
+	unsigned int next;
+	sample_extract_chunk_t *chunks;
+} sample_extract_t;
+
+static void
+sample_extract_worker (void *userdata)
+{
+	sample_extract_t *extract = (sample_extract_t *) userdata;
+	dc_parser_t *parser = extract->parser;
+
+	while (1) {
+		dc_mutex_lock (extract->mutex);
+		unsigned int i = extract->next;
+		if (i < extract->count)
+			extract->next++;
+		dc_mutex_unlock (extract->mutex);
+
+		if (i >= extract->count)
+			break;
+
+		sample_extract_chunk_t *entry = extract->chunks + i;
+		entry->status = parser->vtable->samples_chunk (parser, &entry->chunk, sample_columns_cb, &entry->columns);
+	}
+}
+
+static dc_status_t
+dc_parser_samples_extract_parallel (dc_parser_t *parser, dc_sample_columns_t *columns)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	sample_chunk_t chunks[MAXTHREADS];
+
+	unsigned int count = parser->nthreads;
+	status = parser->vtable->samples_split (parser, chunks, &count);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	// A short dive is decoded in the calling thread.
+	if (count <= 1) {
+		if (count == 0)
+			return DC_STATUS_SUCCESS;
+		return parser->vtable->samples_chunk (parser, chunks, sample_columns_cb, columns);
+	}
+
+	// Every chunk writes its samples directly into the columns, at the
+	// position of its first sample. The events are collected per chunk,
+	// and merged afterwards.
+	unsigned int maxevents = columns->events ? columns->maxevents : 0;
+	sample_extract_chunk_t *entries = (sample_extract_chunk_t *) calloc (count, sizeof (sample_extract_chunk_t));
+	double **pressure = (double **) calloc (count * columns->ntanks + 1, sizeof (double *));
+	dc_sample_event_t *events = (dc_sample_event_t *) calloc (count * maxevents + 1, sizeof (dc_sample_event_t));
+	if (entries == NULL || pressure == NULL || events == NULL) {
+		ERROR (parser->context, "Failed to allocate memory.");
+		status = DC_STATUS_NOMEMORY;
+		goto error_free;
+	}
+
+	for (unsigned int i = 0; i < count; ++i) {
+		sample_extract_chunk_t *entry = entries + i;
+		dc_sample_columns_t *view = &entry->columns;
+		unsigned int first = chunks[i].first;
+
+		unsigned int capacity = 0;
+		if (first < columns->capacity) {
+			capacity = columns->capacity - first;
+			if (capacity > chunks[i].nsamples)
+				capacity = chunks[i].nsamples;
+		}
+
+		entry->chunk = chunks[i];
+		entry->status = DC_STATUS_SUCCESS;
+		view->capacity = capacity;
+		view->ntanks = columns->ntanks;
+		view->pressure = pressure + i * columns->ntanks;
+		if (capacity) {
+			view->time = columns->time ? columns->time + first : NULL;
+			view->depth = columns->depth ? columns->depth + first : NULL;
+			view->temperature = columns->temperature ? columns->temperature + first : NULL;
+			view->gasmix = columns->gasmix ? columns->gasmix + first : NULL;
+			for (unsigned int j = 0; j < columns->ntanks; ++j) {
+				view->pressure[j] = columns->pressure[j] ? columns->pressure[j] + first : NULL;
+			}
+		}
+		view->maxevents = maxevents;
+		view->events = maxevents ? events + i * maxevents : NULL;
+	}
+
+	sample_extract_t extract = {parser, NULL, count, 0, entries};
+	status = dc_mutex_new (&extract.mutex);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (parser->context, "Failed to create the mutex.");
+		goto error_free;
+	}
+
+	// Decode the chunks on the thread pool of the context. The calling
+	// thread is a worker too.
+	dc_context_run (parser->context, sample_extract_worker, &extract, count);
+
+	dc_mutex_free (extract.mutex);
+
+	// Merge the chunks in order.
+	for (unsigned int i = 0; i < count; ++i) {
+		sample_extract_chunk_t *entry = entries + i;
+		dc_sample_columns_t *view = &entry->columns;
+
+		if (entry->status != DC_STATUS_SUCCESS) {
+			status = entry->status;
+			goto error_free;
+		}
+
+		if (view->nsamples != entry->chunk.nsamples) {
+			ERROR (parser->context, "Unexpected number of samples in chunk %u.", i);
+			status = DC_STATUS_DATAFORMAT;
+			goto error_free;
+		}
+
+		for (unsigned int j = 0; j < view->nevents && j < view->maxevents; ++j) {
+			unsigned int n = columns->nevents + j;
+			if (n >= columns->maxevents)
+				break;
+			columns->events[n] = view->events[j];
+			columns->events[n].sample += entry->chunk.first;
+		}
+
+		columns->nsamples += view->nsamples;
+		columns->nevents += view->nevents;
+	}
+
+error_free:
+	free (events);
+	free (pressure);
+	free (entries);
+	return status;
+}
+
+dc_status_t
+dc_parser_set_threads (dc_parser_t *parser, unsigned int nthreads)
+{
+	if (parser == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (nthreads == 0)
+		return DC_STATUS_INVALIDARGS;
+
+	if (nthreads > MAXTHREADS)
+		nthreads = MAXTHREADS;
+
+	parser->nthreads = nthreads;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_parser_samples_extract (dc_parser_t *parser, dc_sample_columns_t *columns)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+
+	if (parser == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (columns == NULL || (columns->ntanks && columns->pressure == NULL))
+		return DC_STATUS_INVALIDARGS;
+
+	columns->nsamples = 0;
+	columns->nevents = 0;
+
+	if (parser_is_cancelled (parser))
+		return DC_STATUS_CANCELLED;
+
+	if (parser->nthreads > 1 && parser->vtable->samples_split && parser->vtable->samples_chunk) {
+		rc = dc_parser_samples_extract_parallel (parser, columns);
+	} else if (parser->vtable->samples_extract) {
+		rc = parser->vtable->samples_extract (parser, columns);
+	} else if (parser->vtable->samples_foreach) {
+		// Fallback to the generic adapter on top of the callback.
+		rc = dc_parser_samples_walk (parser, sample_columns_cb, columns);
+	} else {
+		return DC_STATUS_UNSUPPORTED;
+	}
+
+	if (parser->cancelled)
+		return DC_STATUS_CANCELLED;
+
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	if (columns->nsamples > columns->capacity ||
+		columns->nevents > columns->maxevents)
+		return DC_STATUS_NOMEMORY;
+
+	return DC_STATUS_SUCCESS;
+}
+
+#define FILTER_MAXVALUES 64
+#define FILTER_WINDOW    256
+
+typedef struct sample_filter_value_t {
+	dc_sample_type_t type;
+	dc_sample_value_t value;
+} sample_filter_value_t;
+
+typedef struct sample_filter_sample_t {
+	unsigned int nvalues;
+	unsigned int time;
+	double depth;
+	int timed;
+	int keep;
+	sample_filter_value_t values[FILTER_MAXVALUES];
+} sample_filter_sample_t;
+
+typedef struct sample_filter_t {
+	const dc_sample_filter_t *settings;
+	dc_sample_callback_t callback;
+	void *userdata;
+	dc_context_t *context;
+	// The sample being collected, and the previous complete sample.
+	sample_filter_sample_t samples[2];
+	sample_filter_sample_t *current, *previous;
+	int have_previous;
+	int emitted;
+	// The last sample delivered to the callback.
+	int have_anchor;
+	unsigned int anchor_time;
+	double anchor_depth;
+	// The samples since the anchor, for the depth mode.
+	unsigned int npending;
+	unsigned int pending_time[FILTER_WINDOW];
+	double pending_depth[FILTER_WINDOW];
+	double depth;
+	int overflow;
+} sample_filter_t;
+
+static void
+sample_filter_emit (sample_filter_t *filter, const sample_filter_sample_t *sample)
+{
+	for (unsigned int i = 0; i < sample->nvalues; ++i) {
+		filter->callback (sample->values[i].type, sample->values[i].value, filter->userdata);
+	}
+
+	filter->have_anchor = 1;
+	filter->anchor_time = sample->time;
+	filter->anchor_depth = sample->depth;
+	filter->npending = 0;
+}
+
+static int
+sample_filter_deviates (sample_filter_t *filter, unsigned int time, double depth)
+{
+	double tolerance = filter->settings->tolerance;
+
+	if (time <= filter->anchor_time)
+		return fabs (depth - filter->anchor_depth) > tolerance;
+
+	// Compare the depth of the pending samples against the straight
+	// line between the anchor and the new sample.
+	double slope = (depth - filter->anchor_depth) / (time - filter->anchor_time);
+	for (unsigned int i = 0; i < filter->npending; ++i) {
+		double dt = (double) filter->pending_time[i] - filter->anchor_time;
+		double interpolated = filter->anchor_depth + slope * dt;
+		if (fabs (filter->pending_depth[i] - interpolated) > tolerance)
+			return 1;
+	}
+
+	return 0;
+}
+
+static void
+sample_filter_complete (sample_filter_t *filter)
+{
+	sample_filter_sample_t *sample = filter->current;
+	const dc_sample_filter_t *settings = filter->settings;
+
+	if (sample->nvalues == 0)
+		return;
+
+	if (!sample->timed || !filter->have_anchor) {
+		// Values before the first sample, and the first sample itself,
+		// are always delivered.
+		sample->keep = 1;
+	} else if (settings->mode == DC_SAMPLE_FILTER_INTERVAL) {
+		if (sample->time >= filter->anchor_time + settings->interval)
+			sample->keep = 1;
+	} else if (settings->mode == DC_SAMPLE_FILTER_DEPTH) {
+		// Samples which are kept anyway also end the current segment,
+		// so the pending samples are checked against them too.
+		if (sample_filter_deviates (filter, sample->time, sample->depth) ||
+			filter->npending >= FILTER_WINDOW) {
+			// The previous sample is the last one which can still be
+			// reproduced by interpolation. It becomes the new anchor.
+			if (filter->have_previous && !filter->emitted && filter->npending) {
+				sample_filter_emit (filter, filter->previous);
+				filter->emitted = 1;
+			}
+			if (sample_filter_deviates (filter, sample->time, sample->depth))
+				sample->keep = 1;
+		}
+	}
+
+	if (sample->keep) {
+		sample_filter_emit (filter, sample);
+	} else if (settings->mode == DC_SAMPLE_FILTER_DEPTH) {
+		filter->pending_time[filter->npending] = sample->time;
+		filter->pending_depth[filter->npending] = sample->depth;
+		filter->npending++;
+	}
+
+	// The completed sample becomes the previous sample.
+	filter->previous = sample;
+	filter->current = (sample == filter->samples) ? filter->samples + 1 : filter->samples;
+	filter->have_previous = 1;
+	filter->emitted = sample->keep;
+
+	memset (filter->current, 0, offsetof (sample_filter_sample_t, values));
+	filter->current->depth = filter->depth;
+}
+
+static void
+sample_filter_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
+{
+	sample_filter_t *filter = (sample_filter_t *) userdata;
+
+	if (type == DC_SAMPLE_TIME) {
+		sample_filter_complete (filter);
+		filter->current->timed = 1;
+		filter->current->time = value.time;
+	}
+
+	sample_filter_sample_t *sample = filter->current;
+
+	switch (type) {
+	case DC_SAMPLE_DEPTH:
+		// Samples without a depth inherit the previous depth.
+		filter->depth = sample->depth = value.depth;
+		break;
+	case DC_SAMPLE_EVENT:
+	case DC_SAMPLE_GASMIX:
+		sample->keep = 1;
+		break;
+	default:
+		break;
+	}
+
+	if (sample->nvalues >= FILTER_MAXVALUES) {
+		if (!filter->overflow)
+			WARNING (filter->context, "Too many values in a single sample.");
+		filter->overflow = 1;
+		return;
+	}
+
+	sample->values[sample->nvalues].type = type;
+	sample->values[sample->nvalues].value = value;
+	sample->nvalues++;
+}
+
+
+dc_status_t
+dc_parser_samples_foreach_filtered (dc_parser_t *parser, const dc_sample_filter_t *filter, dc_sample_callback_t callback, void *userdata)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+
+	if (parser == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (filter == NULL || filter->mode == DC_SAMPLE_FILTER_NONE)
+		return dc_parser_samples_foreach (parser, callback, userdata);
+
+	if (callback == NULL || filter->mode > DC_SAMPLE_FILTER_EVENTS ||
+		(filter->mode == DC_SAMPLE_FILTER_DEPTH && !(filter->tolerance >= 0.0)))
+		return DC_STATUS_INVALIDARGS;
+
+	if (parser->vtable->samples_foreach == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	sample_filter_t *state = (sample_filter_t *) calloc (1, sizeof (sample_filter_t));
+	if (state == NULL) {
+		ERROR (parser->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	state->settings = filter;
+	state->callback = callback;
+	state->userdata = userdata;
+	state->context = parser->context;
+	state->current = state->samples;
+
+	rc = dc_parser_samples_events (parser, sample_filter_cb, state);
+	if (rc == DC_STATUS_SUCCESS) {
+		sample_filter_complete (state);
+		// The last sample is always delivered.
+		if (state->have_previous && !state->emitted)
+			sample_filter_emit (state, state->previous);
+	}
+
+	free (state);
+
+	return rc;
+}
+
+
+struct dc_sample_cursor_t {
+	dc_parser_t *parser;
+	unsigned int index;
+};
+
+typedef struct sample_cursor_t {
+	dc_sample_callback_t callback;
+	void *userdata;
+	unsigned int started;
+	unsigned int index;
+	unsigned int first;
+	unsigned int count;
+	unsigned int ndelivered;
+} sample_cursor_t;
+
+static void
+sample_cursor_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
+{
+	sample_cursor_t *cursor = (sample_cursor_t *) userdata;
+
+	// Every time sample starts a new sample.
+	if (type == DC_SAMPLE_TIME) {
+		if (cursor->started)
+			cursor->index++;
+		cursor->started = 1;
+	}
+
+	if (cursor->index - cursor->first >= cursor->count)
+		return;
+
+	if (type == DC_SAMPLE_TIME)
+		cursor->ndelivered++;
+
+	if (cursor->callback)
+		cursor->callback (type, value, cursor->userdata);
+}
+
+typedef struct sample_seek_t {
+	unsigned int time;
+	unsigned int started;
+	unsigned int found;
+	unsigned int index;
+} sample_seek_t;
+
+static void
+sample_seek_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
+{
+	sample_seek_t *seek = (sample_seek_t *) userdata;
+
+	if (type != DC_SAMPLE_TIME || seek->found)
+		return;
+
+	if (seek->started)
+		seek->index++;
+	seek->started = 1;
+
+	if (value.time >= seek->time)
+		seek->found = 1;
+}
+
+dc_status_t
+dc_parser_samples_begin (dc_parser_t *parser, dc_sample_cursor_t **out)
+{
+	if (parser == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (out == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (parser->vtable->samples_foreach == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	dc_sample_cursor_t *cursor = (dc_sample_cursor_t *) malloc (sizeof (dc_sample_cursor_t));
+	if (cursor == NULL) {
+		ERROR (parser->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	cursor->parser = parser;
+	cursor->index = 0;
+
+	*out = cursor;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_parser_samples_next (dc_sample_cursor_t *cursor, unsigned int count, dc_sample_callback_t callback, void *userdata)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+
+	if (cursor == NULL || count == 0)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_parser_t *parser = cursor->parser;
+
+	sample_cursor_t state = {callback, userdata, 0, 0, cursor->index, count, 0};
+	if (parser->vtable->samples_range) {
+		// The backend starts at the requested sample.
+		state.index = cursor->index;
+		rc = parser->vtable->samples_range (parser, cursor->index, count, sample_cursor_cb, &state);
+	} else {
+		// Walk the entire dive, and skip the samples outside the range.
+		rc = parser->vtable->samples_foreach (parser, sample_cursor_cb, &state);
+	}
+
+	cursor->index += state.ndelivered;
+
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	if (state.ndelivered == 0)
+		return DC_STATUS_DONE;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_parser_samples_seek_time (dc_sample_cursor_t *cursor, unsigned int time)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+
+	if (cursor == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_parser_t *parser = cursor->parser;
+
+	if (parser->vtable->samples_seek)
+		return parser->vtable->samples_seek (parser, time, &cursor->index);
+
+	sample_seek_t state = {time, 0, 0, 0};
+	rc = parser->vtable->samples_foreach (parser, sample_seek_cb, &state);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	// Without a matching sample, the cursor is positioned at the end.
+	if (state.found)
+		cursor->index = state.index;
+	else if (state.started)
+		cursor->index = state.index + 1;
+	else
+		cursor->index = 0;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_parser_samples_free (dc_sample_cursor_t *cursor)
+{
+	free (cursor);
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+#define INDEX_VERSION 1
+#define INDEX_HEADER  28
+#define INDEX_ENTRY   12
+
+dc_status_t
+sample_index_append (sample_index_t *index, unsigned int sample, unsigned int time, unsigned int offset)
+{
+	if (index->count == index->capacity) {
+		unsigned int capacity = index->capacity ? index->capacity * 2 : 64;
+		sample_checkpoint_t *checkpoints = (sample_checkpoint_t *) realloc (index->checkpoints, capacity * sizeof (sample_checkpoint_t));
+		if (checkpoints == NULL)
+			return DC_STATUS_NOMEMORY;
+		index->checkpoints = checkpoints;
+		index->capacity = capacity;
+	}
+
+	index->checkpoints[index->count].sample = sample;
+	index->checkpoints[index->count].time = time;
+	index->checkpoints[index->count].offset = offset;
+	index->count++;
+
+	return DC_STATUS_SUCCESS;
+}
+
+const sample_checkpoint_t *
+sample_index_find (const sample_index_t *index, unsigned int sample)
+{
+	if (index == NULL || index->count == 0 || index->checkpoints[0].sample > sample)
+		return NULL;
+
+	// Binary search for the last checkpoint at or before the sample.
+	unsigned int lo = 0, hi = index->count;
+	while (hi - lo > 1) {
+		unsigned int mid = lo + (hi - lo) / 2;
+		if (index->checkpoints[mid].sample <= sample)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	return index->checkpoints + lo;
+}
+
+static unsigned int
+sample_index_checksum (dc_parser_t *parser)
+{
+	return checksum_crc_ccitt_uint16 (parser->data, parser->size, 0xFFFF);
+}
+
+dc_status_t
+dc_parser_samples_index (dc_parser_t *parser, unsigned int interval)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+
+	if (parser == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (interval == 0)
+		return DC_STATUS_INVALIDARGS;
+
+	if (parser->vtable->samples_index == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	sample_index_t *index = (sample_index_t *) calloc (1, sizeof (sample_index_t));
+	if (index == NULL) {
+		ERROR (parser->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	index->interval = interval;
+
+	rc = parser->vtable->samples_index (parser, index);
+	if (rc != DC_STATUS_SUCCESS) {
+		free (index->checkpoints);
+		free (index);
+		return rc;
+	}
+
+	dc_parser_free_index (parser);
+	parser->index = index;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_parser_get_sample_index (dc_parser_t *parser, dc_buffer_t *buffer)
+{
+	if (parser == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (buffer == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	const sample_index_t *index = parser->index;
+	if (index == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	unsigned int size = INDEX_HEADER + index->nstate + index->count * INDEX_ENTRY;
+	if (!dc_buffer_clear (buffer) || !dc_buffer_resize (buffer, size)) {
+		ERROR (parser->context, "Insufficient buffer space available.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	unsigned char *data = dc_buffer_get_data (buffer);
+	array_uint32_le_set (data + 0, INDEX_VERSION);
+	array_uint32_le_set (data + 4, parser->vtable->type);
+	array_uint32_le_set (data + 8, parser->size);
+	array_uint32_le_set (data + 12, sample_index_checksum (parser) | (index->nstate << 16));
+	array_uint32_le_set (data + 16, index->interval);
+	array_uint32_le_set (data + 20, index->nsamples);
+	array_uint32_le_set (data + 24, index->count);
+	memcpy (data + INDEX_HEADER, index->state, index->nstate);
+
+	unsigned char *p = data + INDEX_HEADER + index->nstate;
+	for (unsigned int i = 0; i < index->count; ++i) {
+		array_uint32_le_set (p + 0, index->checkpoints[i].sample);
+		array_uint32_le_set (p + 4, index->checkpoints[i].time);
+		array_uint32_le_set (p + 8, index->checkpoints[i].offset);
+		p += INDEX_ENTRY;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_parser_set_sample_index (dc_parser_t *parser, const unsigned char data[], unsigned int size)
+{
+	if (parser == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (data == NULL && size)
+		return DC_STATUS_INVALIDARGS;
+
+	if (parser->vtable->samples_index == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (size < INDEX_HEADER ||
+		array_uint32_le (data + 0) != INDEX_VERSION ||
+		array_uint32_le (data + 4) != parser->vtable->type) {
+		ERROR (parser->context, "Unsupported sample index.");
+		return DC_STATUS_DATAFORMAT;
+	}
+
+	// The index must belong to the current dive.
+	unsigned int checksum = array_uint32_le (data + 12);
+	if (array_uint32_le (data + 8) != parser->size ||
+		(checksum & 0xFFFF) != sample_index_checksum (parser)) {
+		ERROR (parser->context, "The sample index does not match the dive.");
+		return DC_STATUS_DATAFORMAT;
+	}
+
+	unsigned int nstate = checksum >> 16;
+	unsigned int interval = array_uint32_le (data + 16);
+	unsigned int nsamples = array_uint32_le (data + 20);
+	unsigned int count = array_uint32_le (data + 24);
+	if (nstate > SAMPLE_INDEX_MAXSTATE || interval == 0 ||
+		count > (size - INDEX_HEADER) / INDEX_ENTRY ||
+		size != INDEX_HEADER + nstate + count * INDEX_ENTRY) {
+		ERROR (parser->context, "Invalid sample index size.");
+		return DC_STATUS_DATAFORMAT;
+	}
+
+	sample_index_t *index = (sample_index_t *) calloc (1, sizeof (sample_index_t));
+	if (index == NULL) {
+		ERROR (parser->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	index->interval = interval;
+	index->nsamples = nsamples;
+	index->nstate = nstate;
+	memcpy (index->state, data + INDEX_HEADER, nstate);
+
+	const unsigned char *p = data + INDEX_HEADER + nstate;
+	for (unsigned int i = 0; i < count; ++i) {
+		unsigned int sample = array_uint32_le (p + 0);
+		unsigned int time = array_uint32_le (p + 4);
+		unsigned int offset = array_uint32_le (p + 8);
+
+		// The checkpoints are strictly increasing, and inside the data.
+		const sample_checkpoint_t *previous = index->count ? index->checkpoints + index->count - 1 : NULL;
+		if (offset > parser->size || sample > nsamples ||
+			(previous && (sample <= previous->sample || time < previous->time || offset <= previous->offset))) {
+			ERROR (parser->context, "Invalid sample index checkpoint.");
+			free (index->checkpoints);
+			free (index);
+			return DC_STATUS_DATAFORMAT;
+		}
+
+		if (sample_index_append (index, sample, time, offset) != DC_STATUS_SUCCESS) {
+			ERROR (parser->context, "Failed to allocate memory.");
+			free (index->checkpoints);
+			free (index);
+			return DC_STATUS_NOMEMORY;
+		}
+
+		p += INDEX_ENTRY;
+	}
+
+	dc_parser_free_index (parser);
+	parser->index = index;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+static dc_status_t
+dc_parser_get_subdives (dc_parser_t *parser, const parser_subdive_t **table, unsigned int *count)
+{
+	if (parser == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (parser->vtable->subdives == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	return parser->vtable->subdives (parser, table, count);
+}
+
+
+dc_status_t
+dc_parser_get_subdive_count (dc_parser_t *parser, unsigned int *count)
+{
+	const parser_subdive_t *table = NULL;
+	unsigned int n = 0;
+
+	if (count == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_status_t rc = dc_parser_get_subdives (parser, &table, &n);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	*count = n;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+dc_status_t
+dc_parser_get_subdive (dc_parser_t *parser, unsigned int index, dc_subdive_t *subdive)
+{
+	const parser_subdive_t *table = NULL;
+	unsigned int count = 0;
+
+	if (subdive == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_status_t rc = dc_parser_get_subdives (parser, &table, &count);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	if (index >= count)
+		return DC_STATUS_INVALIDARGS;
+
+	*subdive = table[index].info;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+dc_status_t
+dc_parser_subdive_foreach (dc_parser_t *parser, unsigned int index, dc_sample_callback_t callback, void *userdata)
+{
+	const parser_subdive_t *table = NULL;
+	unsigned int count = 0;
+
+	dc_status_t rc = dc_parser_get_subdives (parser, &table, &count);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	if (index >= count)
+		return DC_STATUS_INVALIDARGS;
+
+	const parser_subdive_t *entry = table + index;
+	const unsigned char *data = parser->data;
+	dc_sample_value_t sample = {0};
+
+	// Surface (0 m).
+	sample.time = 0;
+	if (callback) callback (DC_SAMPLE_TIME, sample, userdata);
+	sample.depth = 0.0;
+	if (callback) callback (DC_SAMPLE_DEPTH, sample, userdata);
+
+	if (entry->stride == 0) {
+		// Summary only.
+		sample.time = entry->info.divetime;
+		if (callback) callback (DC_SAMPLE_TIME, sample, userdata);
+		sample.depth = entry->info.maxdepth;
+		if (callback) callback (DC_SAMPLE_DEPTH, sample, userdata);
+		return DC_STATUS_SUCCESS;
+	}
+
+	unsigned int offset = entry->offset;
+	for (unsigned int i = 0; i < entry->info.nsamples; ++i) {
+		if ((i % PARSER_CANCEL_INTERVAL) == 0 && parser_is_cancelled (parser))
+			return DC_STATUS_CANCELLED;
+
+		// The last sample interval can be shorter than the others.
+		unsigned int time = (i + 1) * entry->interval;
+		if (time > entry->info.divetime)
+			time = entry->info.divetime;
+
+		sample.time = time;
+		if (callback) callback (DC_SAMPLE_TIME, sample, userdata);
+		sample.depth = array_uint16_le (data + offset) / 10.0;
+		if (callback) callback (DC_SAMPLE_DEPTH, sample, userdata);
+
+		offset += entry->stride;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+dc_status_t
+dc_parser_destroy (dc_parser_t *parser)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (parser == NULL)
+		return DC_STATUS_SUCCESS;
+
+	if (parser->vtable->destroy) {
+		status = parser->vtable->destroy (parser);
+	}
+
+	dc_parser_deallocate (parser);
+
+	return status;
+}
+
+
+typedef struct dc_parser_pool_entry_t {
+	dc_family_t family;
+	unsigned int model;
+	unsigned int serial;
+	unsigned int devtime;
+	dc_ticks_t systime;
+	unsigned int acquired;
+	dc_parser_t *parser;
+} dc_parser_pool_entry_t;
+
+struct dc_parser_pool_t {
+	dc_context_t *context;
+	dc_parser_pool_entry_t *entries;
+	unsigned int count;
+	unsigned int capacity;
+};
+
+dc_status_t
+dc_parser_pool_new (dc_parser_pool_t **out, dc_context_t *context)
+{
+	if (out == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_parser_pool_t *pool = (dc_parser_pool_t *) malloc (sizeof (dc_parser_pool_t));
+	if (pool == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	pool->context = context;
+	pool->entries = NULL;
+	pool->count = 0;
+	pool->capacity = 0;
+
+	*out = pool;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_parser_pool_acquire (dc_parser_pool_t *pool, dc_parser_t **out, dc_descriptor_t *descriptor, unsigned int devtime, dc_ticks_t systime)
+{
+	if (pool == NULL || out == NULL || descriptor == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_family_t family = dc_descriptor_get_type (descriptor);
+	unsigned int model = dc_descriptor_get_model (descriptor);
+	unsigned int serial = dc_descriptor_get_serial (descriptor);
+
+	for (unsigned int i = 0; i < pool->count; ++i) {
+		dc_parser_pool_entry_t *entry = pool->entries + i;
+		if (!entry->acquired && entry->family == family &&
+			entry->model == model && entry->serial == serial &&
+			entry->devtime == devtime && entry->systime == systime) {
+			entry->acquired = 1;
+			*out = entry->parser;
+			return DC_STATUS_SUCCESS;
+		}
+	}
+
+	if (pool->count == pool->capacity) {
+		unsigned int capacity = pool->capacity ? pool->capacity * 2 : 8;
+		dc_parser_pool_entry_t *entries = (dc_parser_pool_entry_t *) realloc (pool->entries, capacity * sizeof (dc_parser_pool_entry_t));
+		if (entries == NULL) {
+			ERROR (pool->context, "Failed to allocate memory.");
+			return DC_STATUS_NOMEMORY;
+		}
+		pool->entries = entries;
+		pool->capacity = capacity;
+	}
+
+	dc_parser_t *parser = NULL;
+	dc_status_t rc = dc_parser_new_internal (&parser, pool->context,
+		family, model, serial, devtime, systime);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	dc_parser_pool_entry_t *entry = pool->entries + pool->count++;
+	entry->family = family;
+	entry->model = model;
+	entry->serial = serial;
+	entry->devtime = devtime;
+	entry->systime = systime;
+	entry->acquired = 1;
+	entry->parser = parser;
+
+	*out = parser;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_parser_pool_release (dc_parser_pool_t *pool, dc_parser_t *parser)
+{
+	if (pool == NULL || parser == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	for (unsigned int i = 0; i < pool->count; ++i) {
+		dc_parser_pool_entry_t *entry = pool->entries + i;
+		if (entry->parser != parser || !entry->acquired)
+			continue;
+
+		// Reset the parser to the state of a new one. The backend
+		// state is reset by the next dc_parser_set_data call.
+		parser->data = NULL;
+		parser->size = 0;
+		parser->have_statistics = 0;
+		parser->event_options = 0;
+		parser->nthreads = 1;
+		parser->sample_mask = DC_SAMPLE_MASK_ALL;
+		parser->derived_fields = 0;
+		parser->cancel_callback = NULL;
+		parser->cancel_userdata = NULL;
+		parser->budget = 0;
+		parser->deadline = 0;
+		parser->cancelled = 0;
+		dc_parser_free_index (parser);
+
+		entry->acquired = 0;
+
+		return DC_STATUS_SUCCESS;
+	}
+
+	ERROR (pool->context, "The parser is not acquired from the pool.");
+	return DC_STATUS_INVALIDARGS;
+}
+
+dc_status_t
+dc_parser_pool_free (dc_parser_pool_t *pool)
+{
+	if (pool == NULL)
+		return DC_STATUS_SUCCESS;
+
+	for (unsigned int i = 0; i < pool->count; ++i) {
+		dc_parser_destroy (pool->entries[i].parser);
+	}
+
+	free (pool->entries);
+	free (pool);
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+#define RATE_INTERVAL 10
+
+void
+sample_statistics_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
+{
+	sample_statistics_t *statistics  = (sample_statistics_t *) userdata;
+
+	switch (type) {
+	case DC_SAMPLE_TIME:
+		// The previous depth is held until the next sample.
+		if (value.time > statistics->time) {
+			unsigned int interval = value.time - statistics->time;
+			statistics->area += statistics->depth * interval;
+
+			unsigned int bin = 0;
+			if (statistics->depth >= DC_DEPTH_HISTOGRAM_NBINS - 1)
+				bin = DC_DEPTH_HISTOGRAM_NBINS - 1;
+			else if (statistics->depth > 0.0)
+				bin = (unsigned int) statistics->depth;
+			statistics->histogram.time[bin] += interval;
+		}
+		statistics->time = value.time;
+		statistics->divetime = value.time;
+		statistics->nsamples++;
 		break;
 	case DC_SAMPLE_DEPTH:
-		if (statistics->maxdepth < value.depth)
+		if (statistics->ndepths == 0 || statistics->maxdepth < value.depth)
 			statistics->maxdepth = value.depth;
+		// Measure the rate over a long enough interval, to suppress the
+		// noise of the depth resolution.
+		if (statistics->ndepths == 0) {
+			statistics->rate_time = statistics->time;
+			statistics->rate_depth = value.depth;
+		} else if (statistics->time >= statistics->rate_time + RATE_INTERVAL) {
+			double rate = (value.depth - statistics->rate_depth) * 60.0 /
+				(statistics->time - statistics->rate_time);
+			if (statistics->nrates == 0 || statistics->descent_rate < rate)
+				statistics->descent_rate = rate;
+			if (statistics->nrates == 0 || statistics->ascent_rate < -rate)
+				statistics->ascent_rate = -rate;
+			statistics->rate_time = statistics->time;
+			statistics->rate_depth = value.depth;
+			statistics->nrates++;
+		}
+		statistics->depth = value.depth;
+		statistics->ndepths++;
+		break;
+	case DC_SAMPLE_PRESSURE:
+		if (value.pressure.tank < DC_FIELDS_MAXTANKS) {
+			sample_tank_statistics_t *tank = statistics->tank + value.pressure.tank;
+			if (tank->npressures == 0) {
+				tank->begintime = statistics->time;
+				tank->beginpressure = value.pressure.value;
+				tank->beginarea = statistics->area;
+			}
+			tank->endtime = statistics->time;
+			tank->endpressure = value.pressure.value;
+			tank->endarea = statistics->area;
+			tank->npressures++;
+		}
+		break;
+	case DC_SAMPLE_TEMPERATURE:
+		if (statistics->ntemperatures == 0 || statistics->mintemperature > value.temperature)
+			statistics->mintemperature = value.temperature;
+		if (statistics->ntemperatures == 0 || statistics->maxtemperature < value.temperature)
+			statistics->maxtemperature = value.temperature;
+		statistics->ntemperatures++;
+		break;
+	default:
+		break;
+	}
+
+	if (statistics->divetime)
+		statistics->avgdepth = statistics->area / statistics->divetime;
+}
+
+
+typedef struct vendor_spans_t {
+	const unsigned char *data;
+	unsigned int size;
+	unsigned int nsamples;
+	dc_vendor_spans_t *spans;
+} vendor_spans_t;
+
+static void
+vendor_spans_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
+{
+	vendor_spans_t *state = (vendor_spans_t *) userdata;
+	dc_vendor_spans_t *spans = state->spans;
+
+	if (type == DC_SAMPLE_TIME) {
+		state->nsamples++;
+		return;
+	}
+
+	if (type != DC_SAMPLE_VENDOR)
+		return;
+
+	// Only vendor data inside the dive buffer can be described by an
+	// offset. All parsers pass a pointer into the dive data.
+	const unsigned char *data = (const unsigned char *) value.vendor.data;
+	if (data < state->data || data > state->data + state->size ||
+		value.vendor.size > state->size - (unsigned int) (data - state->data))
+		return;
+
+	unsigned int n = spans->count++;
+	if (n >= spans->capacity || spans->spans == NULL)
+		return;
+
+	spans->spans[n].sample = state->nsamples ? state->nsamples - 1 : 0;
+	spans->spans[n].type = value.vendor.type;
+	spans->spans[n].offset = data - state->data;
+	spans->spans[n].size = value.vendor.size;
+}
+
+dc_status_t
+dc_parser_samples_vendor (dc_parser_t *parser, dc_vendor_spans_t *spans)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+
+	if (parser == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (spans == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	spans->count = 0;
+
+	if (parser->vtable->samples_vendor) {
+		rc = parser->vtable->samples_vendor (parser, spans);
+	} else if (parser->vtable->samples_foreach) {
+		vendor_spans_t state = {parser->data, parser->size, 0, spans};
+		rc = parser->vtable->samples_foreach (parser, vendor_spans_cb, &state);
+	} else {
+		return DC_STATUS_UNSUPPORTED;
+	}
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	if (spans->count > spans->capacity)
+		return DC_STATUS_NOMEMORY;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+dc_status_t
+dc_parser_get_statistics (dc_parser_t *parser, const sample_statistics_t **statistics)
+{
+	if (!parser->have_statistics) {
+		sample_statistics_t initializer = SAMPLE_STATISTICS_INITIALIZER;
+		parser->statistics = initializer;
+		// Mark as unavailable during the walk, to guard against
+		// recursion from a backend querying its own fields.
+		parser->have_statistics = 1;
+		parser->statistics_status = DC_STATUS_UNSUPPORTED;
+		// The statistics need all samples, even when called during a
+		// walk with a sample mask.
+		unsigned int skip = parser->sample_skip;
+		parser->sample_skip = 0;
+		if (parser->vtable->samples_foreach) {
+			parser->statistics_status = parser->vtable->samples_foreach (
+				parser, sample_statistics_cb, &parser->statistics);
+		}
+		parser->sample_skip = skip;
+		if (parser_is_cancelled (parser))
+			parser->statistics_status = DC_STATUS_CANCELLED;
+	}
+
+	if (parser->statistics_status != DC_STATUS_SUCCESS)
+		return parser->statistics_status;
+
+	*statistics = &parser->statistics;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+void
+sample_columns_time (dc_sample_columns_t *columns, unsigned int time)
+{
+	unsigned int n = columns->nsamples++;
+	if (n >= columns->capacity)
+		return;
+
+	// Initialize all columns of the new sample.
+	if (columns->time)
+		columns->time[n] = time;
+	if (columns->depth)
+		columns->depth[n] = NAN;
+	if (columns->temperature)
+		columns->temperature[n] = NAN;
+	if (columns->gasmix)
+		columns->gasmix[n] = DC_GASMIX_UNKNOWN;
+	for (unsigned int i = 0; i < columns->ntanks; ++i) {
+		if (columns->pressure[i])
+			columns->pressure[i][n] = NAN;
+	}
+}
+
+unsigned int
+sample_columns_interval (dc_sample_columns_t *columns, unsigned int count, unsigned int interval)
+{
+	unsigned int n = count < columns->capacity ? count : columns->capacity;
+
+	columns->nsamples = count;
+
+	if (columns->time) {
+		unsigned int *time = columns->time;
+		for (unsigned int i = 0; i < n; ++i)
+			time[i] = (i + 1) * interval;
+	}
+	if (columns->gasmix) {
+		unsigned int *gasmix = columns->gasmix;
+		for (unsigned int i = 0; i < n; ++i)
+			gasmix[i] = DC_GASMIX_UNKNOWN;
+	}
+	for (unsigned int t = 0; t < columns->ntanks; ++t) {
+		double *pressure = columns->pressure[t];
+		if (pressure == NULL)
+			continue;
+		for (unsigned int i = 0; i < n; ++i)
+			pressure[i] = NAN;
+	}
+
+	return n;
+}
+
+void
+sample_columns_depth (dc_sample_columns_t *columns, double depth)
+{
+	unsigned int n = columns->nsamples - 1;
+	if (columns->nsamples == 0 || n >= columns->capacity || columns->depth == NULL)
+		return;
+
+	columns->depth[n] = depth;
+}
+
+void
+sample_columns_temperature (dc_sample_columns_t *columns, double temperature)
+{
+	unsigned int n = columns->nsamples - 1;
+	if (columns->nsamples == 0 || n >= columns->capacity || columns->temperature == NULL)
+		return;
+
+	columns->temperature[n] = temperature;
+}
+
+void
+sample_columns_pressure (dc_sample_columns_t *columns, unsigned int tank, double pressure)
+{
+	unsigned int n = columns->nsamples - 1;
+	if (columns->nsamples == 0 || n >= columns->capacity || tank >= columns->ntanks || columns->pressure[tank] == NULL)
+		return;
+
+	columns->pressure[tank][n] = pressure;
+}
+
+void
+sample_columns_gasmix (dc_sample_columns_t *columns, unsigned int gasmix)
+{
+	unsigned int n = columns->nsamples - 1;
+	if (columns->nsamples == 0 || n >= columns->capacity || columns->gasmix == NULL)
+		return;
+
+	columns->gasmix[n] = gasmix;
+}
+
+void
+sample_columns_event (dc_sample_columns_t *columns, unsigned int type, unsigned int time, const char *name, unsigned int flags, unsigned int value)
+{
+	unsigned int sample = columns->nsamples ? columns->nsamples - 1 : 0;
+
+	sample_columns_event_at (columns, sample, type, time, name, flags, value);
+}
+
+void
+sample_columns_event_at (dc_sample_columns_t *columns, unsigned int sample, unsigned int type, unsigned int time, const char *name, unsigned int flags, unsigned int value)
+{
+	unsigned int n = columns->nevents++;
+	if (n >= columns->maxevents || columns->events == NULL)
+		return;
+
+	columns->events[n].sample = sample;
+	columns->events[n].type = type;
+	columns->events[n].time = time;
+	columns->events[n].name = name;
+	columns->events[n].flags = flags;
+	columns->events[n].value = value;
+}
+
+void
+sample_columns_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
+{
+	dc_sample_columns_t *columns = (dc_sample_columns_t *) userdata;
+
+	switch (type) {
+	case DC_SAMPLE_TIME:
+		sample_columns_time (columns, value.time);
+		break;
+	case DC_SAMPLE_DEPTH:
+		sample_columns_depth (columns, value.depth);
+		break;
+	case DC_SAMPLE_TEMPERATURE:
+		sample_columns_temperature (columns, value.temperature);
+		break;
+	case DC_SAMPLE_PRESSURE:
+		sample_columns_pressure (columns, value.pressure.tank, value.pressure.value);
+		break;
+	case DC_SAMPLE_GASMIX:
+		sample_columns_gasmix (columns, value.gasmix);
+		break;
+	case DC_SAMPLE_EVENT:
+		// Gas changes are already available in the gas mix column.
+		if (value.event.type == SAMPLE_EVENT_GASCHANGE ||
+			value.event.type == SAMPLE_EVENT_GASCHANGE2)
+			break;
+		sample_columns_event (columns, value.event.type, value.event.time,
+			value.event.name, value.event.flags, value.event.value);
 		break;
 	default:
 		break;
@@ -0,0 +1,563 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+/*
+ * All values are stored in little endian byte order.
+ *
+ * The data starts with a 24 byte header:
+ *
+ *    0  magic "DP" (2 bytes), version (u8), number of tanks (u8)
+ *    4  number of samples (u32)
+ *    8  number of events (u32)
+ *   12  column mask (u8): time, depth, temperature, gas mix; 3 reserved
+ *   16  pressure mask (u32): one bit per tank
+ *   20  offset of the events (u32)
+ *
+ * The header is followed by the offsets of all blocks (u32), the blocks
+ * and the events. A block contains the columns of the column mask in the
+ * order above, and then the pressure columns of the tanks in the
+ * pressure mask. Each column starts with a mode byte: no values present,
+ * all values present, or some values present with a bitmap of the
+ * present samples. For the present values follow: the first value and
+ * the minimum of the remaining deltas (zigzag encoded varints), the bit
+ * width (u8), and the remaining deltas minus the minimum, bit packed
+ * with the least significant bit first.
+ *
+ * The events start with the size of the string table (varint), followed
+ * by the table of null terminated names. Each event is a sequence of
+ * varints: the sample, type, time, flags, value and the offset of the
+ * name in the table plus one (zero for no name).
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include <libdivecomputer/profile.h>
+
+#include "array.h"
+
+#define VERSION 1
+
+#define SZ_HEADER 24
+#define BLOCKSIZE DC_PROFILE_BLOCKSIZE
+#define MAXTANKS  32
+
+#define COLUMN_TIME        0x01
+#define COLUMN_DEPTH       0x02
+#define COLUMN_TEMPERATURE 0x04
+#define COLUMN_GASMIX      0x08
+
+#define MODE_NONE    0
+#define MODE_ALL     1
+#define MODE_PARTIAL 2
+
+#define FIXED_UNKNOWN ((unsigned int) DC_FIXED_UNKNOWN)
+
+static unsigned int
+zigzag_encode (unsigned int value)
+{
+	return (value << 1) ^ (0U - (value >> 31));
+}
+
+static unsigned int
+zigzag_decode (unsigned int value)
+{
+	return (value >> 1) ^ (0U - (value & 1));
+}
+
+static int
+varint_append (dc_buffer_t *buffer, unsigned int value)
+{
+	unsigned char data[5];
+	unsigned int n = 0;
+
+	while (value >= 0x80) {
+		data[n++] = (value & 0x7F) | 0x80;
+		value >>= 7;
+	}
+	data[n++] = value;
+
+	return dc_buffer_append (buffer, data, n);
+}
+
+static const unsigned char *
+varint_read (const unsigned char *p, const unsigned char *end, unsigned int *value)
+{
+	unsigned int result = 0;
+
+	for (unsigned int shift = 0; shift < 35; shift += 7) {
+		if (p >= end)
+			return NULL;
+		unsigned char byte = *p++;
+		result |= (unsigned int) (byte & 0x7F) << shift;
+		if ((byte & 0x80) == 0) {
+			*value = result;
+			return p;
+		}
+	}
+
+	return NULL;
+}
+
+static int
+profile_encode_column (dc_buffer_t *buffer, const unsigned int values[], unsigned int n, unsigned int unknown)
+{
+	unsigned char bitmap[BLOCKSIZE / 8] = {0};
+	unsigned int present[BLOCKSIZE];
+	unsigned int count = 0;
+
+	for (unsigned int i = 0; i < n; ++i) {
+		if (values[i] != unknown) {
+			bitmap[i / 8] |= 1 << (i % 8);
+			present[count++] = values[i];
+		}
+	}
+
+	unsigned char mode = count == 0 ? MODE_NONE : (count == n ? MODE_ALL : MODE_PARTIAL);
+	if (!dc_buffer_append (buffer, &mode, 1))
+		return 0;
+	if (mode == MODE_PARTIAL && !dc_buffer_append (buffer, bitmap, (n + 7) / 8))
+		return 0;
+	if (count == 0)
+		return 1;
+
+	if (!varint_append (buffer, zigzag_encode (present[0])))
+		return 0;
+	if (count == 1)
+		return 1;
+
+	// Replace the values by their deltas, and find the range.
+	unsigned int minimum = UINT_MAX, maximum = 0;
+	for (unsigned int i = count - 1; i > 0; --i) {
+		present[i] = zigzag_encode (present[i] - present[i - 1]);
+		if (present[i] < minimum)
+			minimum = present[i];
+		if (present[i] > maximum)
+			maximum = present[i];
+	}
+
+	unsigned char width = 0;
+	while (width < 32 && ((maximum - minimum) >> width) != 0)
+		width++;
+
+	if (!varint_append (buffer, minimum) || !dc_buffer_append (buffer, &width, 1))
+		return 0;
+
+	// Pack the deltas.
+	unsigned char packed[BLOCKSIZE * 4 + 8];
+	unsigned long long accumulator = 0;
+	unsigned int nbits = 0, nbytes = 0;
+	for (unsigned int i = 1; i < count; ++i) {
+		accumulator |= (unsigned long long) (present[i] - minimum) << nbits;
+		nbits += width;
+		while (nbits >= 8) {
+			packed[nbytes++] = accumulator & 0xFF;
+			accumulator >>= 8;
+			nbits -= 8;
+		}
+	}
+	if (nbits)
+		packed[nbytes++] = accumulator & 0xFF;
+
+	return dc_buffer_append (buffer, packed, nbytes);
+}
+
+/*
+ * Decode a column of n samples. The missing values are set to unknown.
+ */
+static const unsigned char *
+profile_decode_column (const unsigned char *p, const unsigned char *end, unsigned int values[], unsigned int n, unsigned int unknown)
+{
+	unsigned char bitmap[BLOCKSIZE / 8];
+	unsigned int deltas[BLOCKSIZE];
+	unsigned int count = 0;
+
+	if (p >= end)
+		return NULL;
+
+	unsigned char mode = *p++;
+	if (mode == MODE_NONE) {
+		for (unsigned int i = 0; i < n; ++i)
+			values[i] = unknown;
+		return p;
+	} else if (mode == MODE_ALL) {
+		memset (bitmap, 0xFF, sizeof (bitmap));
+		count = n;
+	} else if (mode == MODE_PARTIAL) {
+		unsigned int length = (n + 7) / 8;
+		if (end - p < length)
+			return NULL;
+		memset (bitmap, 0, sizeof (bitmap));
+		memcpy (bitmap, p, length);
+		p += length;
+		for (unsigned int i = 0; i < n; ++i)
+			count += (bitmap[i / 8] >> (i % 8)) & 1;
+		if (count == 0)
+			return NULL;
+	} else {
+		return NULL;
+	}
+
+	unsigned int value = 0;
+	p = varint_read (p, end, &value);
+	if (p == NULL)
+		return NULL;
+
+	if (count > 1) {
+		unsigned int minimum = 0;
+		p = varint_read (p, end, &minimum);
+		if (p == NULL || p >= end)
+			return NULL;
+
+		unsigned int width = *p++;
+		if (width > 32)
+			return NULL;
+
+		unsigned int nbytes = ((count - 1) * width + 7) / 8;
+		if (end - p < nbytes)
+			return NULL;
+
+		// Copy the packed data into a padded buffer, to load five bytes
+		// for every delta without any bounds checks. That keeps the loop
+		// free of branches, so the compiler can vectorize it.
+		unsigned char packed[BLOCKSIZE * 4 + 8] = {0};
+		memcpy (packed, p, nbytes);
+		p += nbytes;
+
+		unsigned long long mask = (1ULL << width) - 1;
+		for (unsigned int i = 0; i < count - 1; ++i) {
+			unsigned int bit = i * width;
+			const unsigned char *q = packed + bit / 8;
+			unsigned long long word =
+				(unsigned long long) q[0] |
+				((unsigned long long) q[1] << 8) |
+				((unsigned long long) q[2] << 16) |
+				((unsigned long long) q[3] << 24) |
+				((unsigned long long) q[4] << 32);
+			deltas[i] = (unsigned int) ((word >> (bit % 8)) & mask) + minimum;
+		}
+	}
+
+	// Undo the delta encoding, and put the values back in their samples.
+	unsigned int j = 0;
+	for (unsigned int i = 0; i < n; ++i) {
+		if ((bitmap[i / 8] >> (i % 8)) & 1) {
+			if (j == 0)
+				value = zigzag_decode (value);
+			else
+				value += zigzag_decode (deltas[j - 1]);
+			values[i] = value;
+			j++;
+		} else {
+			values[i] = unknown;
+		}
+	}
+
+	return p;
+}
+
+static unsigned int
+profile_string_offset (dc_buffer_t *strings, const char *name)
+{
+	const char *data = (const char *) dc_buffer_get_data (strings);
+	size_t size = dc_buffer_get_size (strings);
+	size_t offset = 0;
+
+	while (offset < size) {
+		if (strcmp (data + offset, name) == 0)
+			return offset;
+		offset += strlen (data + offset) + 1;
+	}
+
+	if (!dc_buffer_append (strings, (const unsigned char *) name, strlen (name) + 1))
+		return UINT_MAX;
+
+	return offset;
+}
+
+dc_status_t
+dc_profile_encode (dc_buffer_t *buffer, const dc_sample_columns_fixed_t *columns)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (buffer == NULL || columns == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (columns->nsamples > columns->capacity ||
+		columns->nevents > columns->maxevents ||
+		(columns->nevents && columns->events == NULL) ||
+		(columns->ntanks && columns->pressure == NULL) ||
+		columns->ntanks > MAXTANKS)
+		return DC_STATUS_INVALIDARGS;
+
+	unsigned int nsamples = columns->nsamples;
+	unsigned int nblocks = (nsamples / BLOCKSIZE) + (nsamples % BLOCKSIZE != 0);
+
+	unsigned int mask = 0;
+	if (columns->time)
+		mask |= COLUMN_TIME;
+	if (columns->depth)
+		mask |= COLUMN_DEPTH;
+	if (columns->temperature)
+		mask |= COLUMN_TEMPERATURE;
+	if (columns->gasmix)
+		mask |= COLUMN_GASMIX;
+
+	unsigned int tanks = 0;
+	for (unsigned int i = 0; i < columns->ntanks; ++i) {
+		if (columns->pressure[i])
+			tanks |= 1U << i;
+	}
+
+	// Write the header, with room for the block offsets.
+	dc_buffer_clear (buffer);
+	if (!dc_buffer_resize (buffer, SZ_HEADER + (size_t) nblocks * 4))
+		return DC_STATUS_NOMEMORY;
+
+	unsigned char *data = dc_buffer_get_data (buffer);
+	data[0] = 'D';
+	data[1] = 'P';
+	data[2] = VERSION;
+	data[3] = columns->ntanks;
+	array_uint32_le_set (data + 4, nsamples);
+	array_uint32_le_set (data + 8, columns->nevents);
+	data[12] = mask;
+	array_uint32_le_set (data + 16, tanks);
+
+	// Write the blocks.
+	for (unsigned int b = 0; b < nblocks; ++b) {
+		unsigned int begin = b * BLOCKSIZE;
+		unsigned int n = nsamples - begin < BLOCKSIZE ? nsamples - begin : BLOCKSIZE;
+		int ok = 1;
+
+		array_uint32_le_set (dc_buffer_get_data (buffer) + SZ_HEADER + b * 4, dc_buffer_get_size (buffer));
+
+		if (columns->time)
+			ok = ok && profile_encode_column (buffer, columns->time + begin, n, UINT_MAX);
+		if (columns->depth)
+			ok = ok && profile_encode_column (buffer, (const unsigned int *) columns->depth + begin, n, FIXED_UNKNOWN);
+		if (columns->temperature)
+			ok = ok && profile_encode_column (buffer, (const unsigned int *) columns->temperature + begin, n, FIXED_UNKNOWN);
+		if (columns->gasmix)
+			ok = ok && profile_encode_column (buffer, columns->gasmix + begin, n, DC_GASMIX_UNKNOWN);
+		for (unsigned int i = 0; i < columns->ntanks; ++i) {
+			if (columns->pressure[i] == NULL)
+				continue;
+			ok = ok && profile_encode_column (buffer, (const unsigned int *) columns->pressure[i] + begin, n, FIXED_UNKNOWN);
+		}
+
+		if (!ok)
+			return DC_STATUS_NOMEMORY;
+	}
+
+	array_uint32_le_set (dc_buffer_get_data (buffer) + 20, dc_buffer_get_size (buffer));
+
+	// Write the events.
+	dc_buffer_t *strings = dc_buffer_new (0);
+	dc_buffer_t *events = dc_buffer_new (0);
+	if (strings == NULL || events == NULL) {
+		status = DC_STATUS_NOMEMORY;
+		goto error_free;
+	}
+
+	for (unsigned int i = 0; i < columns->nevents; ++i) {
+		const dc_sample_event_t *event = columns->events + i;
+
+		unsigned int name = 0;
+		if (event->name) {
+			unsigned int offset = profile_string_offset (strings, event->name);
+			if (offset == UINT_MAX) {
+				status = DC_STATUS_NOMEMORY;
+				goto error_free;
+			}
+			name = offset + 1;
+		}
+
+		if (!varint_append (events, event->sample) ||
+			!varint_append (events, event->type) ||
+			!varint_append (events, event->time) ||
+			!varint_append (events, event->flags) ||
+			!varint_append (events, event->value) ||
+			!varint_append (events, name)) {
+			status = DC_STATUS_NOMEMORY;
+			goto error_free;
+		}
+	}
+
+	if (!varint_append (buffer, dc_buffer_get_size (strings)) ||
+		!dc_buffer_append (buffer, dc_buffer_get_data (strings), dc_buffer_get_size (strings)) ||
+		!dc_buffer_append (buffer, dc_buffer_get_data (events), dc_buffer_get_size (events))) {
+		status = DC_STATUS_NOMEMORY;
+		goto error_free;
+	}
+
+error_free:
+	dc_buffer_free (events);
+	dc_buffer_free (strings);
+	return status;
+}
+
+static void
+profile_copy_column (unsigned int *column, unsigned int offset, const unsigned int values[], unsigned int begin, unsigned int count)
+{
+	if (column)
+		memcpy (column + offset, values + begin, count * sizeof (unsigned int));
+}
+
+dc_status_t
+dc_profile_decode (const unsigned char data[], unsigned int size, unsigned int first, dc_sample_columns_fixed_t *columns)
+{
+	unsigned int values[BLOCKSIZE];
+
+	if (data == NULL || columns == NULL || (columns->ntanks && columns->pressure == NULL))
+		return DC_STATUS_INVALIDARGS;
+
+	columns->nsamples = 0;
+	columns->nevents = 0;
+
+	if (size < SZ_HEADER || data[0] != 'D' || data[1] != 'P' || data[2] != VERSION)
+		return DC_STATUS_DATAFORMAT;
+
+	unsigned int nsamples = array_uint32_le (data + 4);
+	unsigned int nevents = array_uint32_le (data + 8);
+	unsigned int mask = data[12];
+	unsigned int tanks = array_uint32_le (data + 16);
+	unsigned int eventsoffset = array_uint32_le (data + 20);
+	unsigned int nblocks = (nsamples / BLOCKSIZE) + (nsamples % BLOCKSIZE != 0);
+
+	if (nblocks > (size - SZ_HEADER) / 4 || eventsoffset > size ||
+		eventsoffset < SZ_HEADER + nblocks * 4)
+		return DC_STATUS_DATAFORMAT;
+
+	// Decode the blocks with the requested samples.
+	unsigned int remaining = first < nsamples ? nsamples - first : 0;
+	unsigned int count = remaining < columns->capacity ? remaining : columns->capacity;
+	unsigned int n = 0;
+	while (n < count) {
+		unsigned int sample = first + n;
+		unsigned int b = sample / BLOCKSIZE;
+		unsigned int begin = b * BLOCKSIZE;
+		unsigned int length = nsamples - begin < BLOCKSIZE ? nsamples - begin : BLOCKSIZE;
+		unsigned int skip = sample - begin;
+		unsigned int ncopy = length - skip < count - n ? length - skip : count - n;
+
+		unsigned int offset = array_uint32_le (data + SZ_HEADER + b * 4);
+		if (offset < SZ_HEADER + nblocks * 4 || offset > eventsoffset)
+			return DC_STATUS_DATAFORMAT;
+
+		const unsigned char *p = data + offset;
+		const unsigned char *end = data + eventsoffset;
+
+		if (mask & COLUMN_TIME) {
+			if ((p = profile_decode_column (p, end, values, length, UINT_MAX)) == NULL)
+				return DC_STATUS_DATAFORMAT;
+		} else {
+			memset (values, 0, sizeof (values));
+		}
+		profile_copy_column (columns->time, n, values, skip, ncopy);
+
+		if (mask & COLUMN_DEPTH) {
+			if ((p = profile_decode_column (p, end, values, length, FIXED_UNKNOWN)) == NULL)
+				return DC_STATUS_DATAFORMAT;
+		} else {
+			for (unsigned int i = 0; i < length; ++i)
+				values[i] = FIXED_UNKNOWN;
+		}
+		profile_copy_column ((unsigned int *) columns->depth, n, values, skip, ncopy);
+
+		if (mask & COLUMN_TEMPERATURE) {
+			if ((p = profile_decode_column (p, end, values, length, FIXED_UNKNOWN)) == NULL)
+				return DC_STATUS_DATAFORMAT;
+		} else {
+			for (unsigned int i = 0; i < length; ++i)
+				values[i] = FIXED_UNKNOWN;
+		}
+		profile_copy_column ((unsigned int *) columns->temperature, n, values, skip, ncopy);
+
+		if (mask & COLUMN_GASMIX) {
+			if ((p = profile_decode_column (p, end, values, length, DC_GASMIX_UNKNOWN)) == NULL)
+				return DC_STATUS_DATAFORMAT;
+		} else {
+			for (unsigned int i = 0; i < length; ++i)
+				values[i] = DC_GASMIX_UNKNOWN;
+		}
+		profile_copy_column (columns->gasmix, n, values, skip, ncopy);
+
+		for (unsigned int t = 0; t < MAXTANKS; ++t) {
+			if (tanks & (1U << t)) {
+				if ((p = profile_decode_column (p, end, values, length, FIXED_UNKNOWN)) == NULL)
+					return DC_STATUS_DATAFORMAT;
+			} else if (t < columns->ntanks) {
+				for (unsigned int i = 0; i < length; ++i)
+					values[i] = FIXED_UNKNOWN;
+			}
+			if (t < columns->ntanks)
+				profile_copy_column ((unsigned int *) columns->pressure[t], n, values, skip, ncopy);
+		}
+
+		n += ncopy;
+	}
+
+	columns->nsamples = remaining;
+
+	// Decode the events.
+	const unsigned char *p = data + eventsoffset;
+	const unsigned char *end = data + size;
+
+	unsigned int nstrings = 0;
+	p = varint_read (p, end, &nstrings);
+	if (p == NULL || end - p < nstrings || (nstrings && p[nstrings - 1] != 0))
+		return DC_STATUS_DATAFORMAT;
+
+	const char *strings = (const char *) p;
+	p += nstrings;
+
+	for (unsigned int i = 0; i < nevents; ++i) {
+		dc_sample_event_t event;
+		unsigned int name = 0;
+
+		if ((p = varint_read (p, end, &event.sample)) == NULL ||
+			(p = varint_read (p, end, &event.type)) == NULL ||
+			(p = varint_read (p, end, &event.time)) == NULL ||
+			(p = varint_read (p, end, &event.flags)) == NULL ||
+			(p = varint_read (p, end, &event.value)) == NULL ||
+			(p = varint_read (p, end, &name)) == NULL ||
+			name > nstrings)
+			return DC_STATUS_DATAFORMAT;
+
+		if (event.sample < first)
+			continue;
+
+		event.sample -= first;
+		event.name = name ? strings + name - 1 : NULL;
+
+		unsigned int idx = columns->nevents++;
+		if (idx < columns->maxevents && columns->events)
+			columns->events[idx] = event;
+	}
+
+	if (columns->nsamples > columns->capacity ||
+		columns->nevents > columns->maxevents)
+		return DC_STATUS_NOMEMORY;
+
+	return DC_STATUS_SUCCESS;
+}
@@ -0,0 +1,236 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "rbstream.h"
+#include "context-private.h"
+#include "device-private.h"
+
+struct dc_rbstream_t {
+	dc_device_t *device;
+	unsigned int pagesize;
+	unsigned int packetsize;
+	/* Real and virtual (page aligned) ringbuffer. */
+	unsigned int begin, end;
+	unsigned int vbegin, vend;
+	/* Address of the next packet, and of the next byte to return. */
+	unsigned int address;
+	unsigned int top;
+	/* Number of bytes not yet returned. */
+	unsigned int remaining;
+	/* Unused part of the last packet. */
+	unsigned int available;
+	unsigned char *cache;
+};
+
+static unsigned int
+ifloor (unsigned int x, unsigned int n)
+{
+	// Round down to next lower multiple.
+	return (x / n) * n;
+}
+
+static unsigned int
+iceil (unsigned int x, unsigned int n)
+{
+	// Round up to next higher multiple.
+	return ((x + n - 1) / n) * n;
+}
+
+dc_status_t
+dc_rbstream_new (dc_rbstream_t **out, dc_device_t *device, unsigned int pagesize, unsigned int packetsize, unsigned int begin, unsigned int end, unsigned int address, unsigned int total)
+{
+	dc_rbstream_t *rbstream = NULL;
+
+	if (out == NULL || device == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	// The packets must consist of whole pages, and the start address
+	// must be inside the ringbuffer.
+	if (pagesize == 0 || packetsize == 0 || packetsize % pagesize != 0 ||
+		begin >= end || address < begin || address >= end ||
+		total > end - begin) {
+		ERROR (device->context, "Invalid ringbuffer stream arguments.");
+		return DC_STATUS_INVALIDARGS;
+	}
+
+	rbstream = (dc_rbstream_t *) malloc (sizeof (dc_rbstream_t));
+	if (rbstream == NULL) {
+		ERROR (device->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	rbstream->cache = (unsigned char *) malloc (packetsize);
+	if (rbstream->cache == NULL) {
+		ERROR (device->context, "Failed to allocate memory.");
+		free (rbstream);
+		return DC_STATUS_NOMEMORY;
+	}
+
+	rbstream->device = device;
+	rbstream->pagesize = pagesize;
+	rbstream->packetsize = packetsize;
+	rbstream->begin = begin;
+	rbstream->end = end;
+	rbstream->vbegin = ifloor (begin, pagesize);
+	rbstream->vend = iceil (end, pagesize);
+	rbstream->address = iceil (address, pagesize);
+	rbstream->top = address;
+	rbstream->remaining = total;
+	rbstream->available = 0;
+
+	*out = rbstream;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_rbstream_fill (dc_rbstream_t *rbstream, dc_event_progress_t *progress)
+{
+	dc_device_t *device = rbstream->device;
+
+	// Wrap around at the start of the ringbuffer.
+	if (rbstream->address <= rbstream->begin) {
+		rbstream->address = rbstream->vend;
+		rbstream->top = rbstream->end;
+	}
+
+	unsigned int hi = rbstream->address;
+	unsigned int lo = hi - rbstream->vbegin < rbstream->packetsize ?
+		rbstream->vbegin : hi - rbstream->packetsize;
+
+	// Don't read further than the end of the stream.
+	unsigned int top = rbstream->top < hi ? rbstream->top : hi;
+	if (top >= rbstream->remaining && top - rbstream->remaining > lo)
+		lo = ifloor (top - rbstream->remaining, rbstream->pagesize);
+
+	dc_status_t rc = dc_device_read (device, lo, rbstream->cache, hi - lo);
+	if (rc != DC_STATUS_SUCCESS) {
+		ERROR (device->context, "Failed to read the memory page.");
+		return rc;
+	}
+
+	// Drop the bytes outside the real ringbuffer, or after the current
+	// position, by moving the useful part to the start of the cache.
+	unsigned int bottom = lo < rbstream->begin ? rbstream->begin : lo;
+	unsigned int length = top > bottom ? top - bottom : 0;
+	if (bottom > lo)
+		memmove (rbstream->cache, rbstream->cache + (bottom - lo), length);
+
+	rbstream->available = length;
+	rbstream->address = lo;
+	rbstream->top = bottom;
+
+	// The alignment bytes beyond the end of the stream are not counted.
+	if (progress) {
+		progress->current += length < rbstream->remaining ? length : rbstream->remaining;
+		device_event_emit (device, DC_EVENT_PROGRESS, progress);
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_rbstream_read (dc_rbstream_t *rbstream, dc_event_progress_t *progress, unsigned char data[], unsigned int size)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+
+	if (rbstream == NULL || (data == NULL && size))
+		return DC_STATUS_INVALIDARGS;
+
+	if (size > rbstream->remaining)
+		return DC_STATUS_INVALIDARGS;
+
+	unsigned int offset = size;
+	while (offset) {
+		if (rbstream->available == 0) {
+			// Read the whole packets directly into the output buffer,
+			// with a single call. Only the packets at the boundaries of
+			// the ringbuffer need to go through the cache.
+			unsigned int count = offset / rbstream->packetsize;
+			unsigned int max = 0;
+			if (rbstream->address > rbstream->begin)
+				max = (rbstream->address - rbstream->begin) / rbstream->packetsize;
+			if (count > max)
+				count = max;
+			if (count && rbstream->top == rbstream->address) {
+				unsigned int length = count * rbstream->packetsize;
+				unsigned int address = rbstream->address - length;
+				rc = dc_device_read (rbstream->device, address, data + offset - length, length);
+				if (rc != DC_STATUS_SUCCESS) {
+					ERROR (rbstream->device->context, "Failed to read the memory page.");
+					return rc;
+				}
+
+				rbstream->address = address;
+				rbstream->top = address;
+				rbstream->remaining -= length;
+				offset -= length;
+
+				if (progress) {
+					progress->current += length;
+					device_event_emit (rbstream->device, DC_EVENT_PROGRESS, progress);
+				}
+				continue;
+			}
+
+			rc = dc_rbstream_fill (rbstream, progress);
+			if (rc != DC_STATUS_SUCCESS)
+				return rc;
+			continue;
+		}
+
+		unsigned int length = rbstream->available;
+		if (length > offset)
+			length = offset;
+
+		rbstream->available -= length;
+		rbstream->remaining -= length;
+		offset -= length;
+
+		memcpy (data + offset, rbstream->cache + rbstream->available, length);
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+unsigned int
+dc_rbstream_available (dc_rbstream_t *rbstream)
+{
+	if (rbstream == NULL)
+		return 0;
+
+	return rbstream->available;
+}
+
+dc_status_t
+dc_rbstream_free (dc_rbstream_t *rbstream)
+{
+	if (rbstream == NULL)
+		return DC_STATUS_SUCCESS;
+
+	free (rbstream->cache);
+	free (rbstream);
+
+	return DC_STATUS_SUCCESS;
+}
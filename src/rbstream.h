@@ -0,0 +1,65 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_RBSTREAM_H
+#define DC_RBSTREAM_H
+
+#include <libdivecomputer/common.h>
+#include <libdivecomputer/device.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Backward stream over the profile ringbuffer of a device.
+ *
+ * The stream starts at the end of the most recent dive, and every read
+ * returns the size bytes immediately before the previous read, wrapping
+ * around at the start of the ringbuffer. The device is read in packets,
+ * aligned to pagesize in a virtual ringbuffer rounded outwards to whole
+ * pages. Bytes outside the real ringbuffer are dropped. The unused part
+ * of the last packet is kept for the next read, and consecutive whole
+ * packets are read with a single call. The total is the number of bytes
+ * that will be read from the stream, and no packet extends beyond it
+ * (except for the alignment).
+ */
+typedef struct dc_rbstream_t dc_rbstream_t;
+
+dc_status_t
+dc_rbstream_new (dc_rbstream_t **rbstream, dc_device_t *device, unsigned int pagesize, unsigned int packetsize, unsigned int begin, unsigned int end, unsigned int address, unsigned int total);
+
+dc_status_t
+dc_rbstream_read (dc_rbstream_t *rbstream, dc_event_progress_t *progress, unsigned char data[], unsigned int size);
+
+/*
+ * Number of bytes already downloaded, but not yet returned by a read.
+ */
+unsigned int
+dc_rbstream_available (dc_rbstream_t *rbstream);
+
+dc_status_t
+dc_rbstream_free (dc_rbstream_t *rbstream);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_RBSTREAM_H */
@@ -114,6 +114,10 @@ reefnet_sensus_device_open (dc_device_t **out, dc_context_t *context, const char
 		goto error_free;
 	}
 
+	// Interrupt the blocking reads when the download is cancelled, and
+	// measure the time spent waiting for the I/O.
+	device_set_port ((dc_device_t *) device, device->port);
+
 	// Set the serial communication protocol (19200 8N1).
 	status = dc_serial_configure (device->port, 19200, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -275,8 +279,8 @@ reefnet_sensus_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 	reefnet_sensus_device_t *device = (reefnet_sensus_device_t*) abstract;
 
 	// Erase the current contents of the buffer and
-	// pre-allocate the required amount of memory.
-	if (!dc_buffer_clear (buffer) || !dc_buffer_reserve (buffer, SZ_MEMORY)) {
+	// allocate the required amount of memory.
+	if (!dc_buffer_clear (buffer) || !dc_buffer_resize (buffer, SZ_MEMORY)) {
 		ERROR (abstract->context, "Insufficient buffer space available.");
 		return DC_STATUS_NOMEMORY;
 	}
@@ -302,20 +306,37 @@ reefnet_sensus_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 	// The device leaves the waiting state.
 	device->waiting = 0;
 
-	// Receive the answer from the device.
+	// Receive the header of the package.
+	unsigned char header[4] = {0};
+	status = dc_serial_read (device->port, header, sizeof (header), NULL);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (abstract->context, "Failed to receive the answer.");
+		return status;
+	}
+
+	// Update and emit a progress event.
+	progress.current += sizeof (header);
+	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
+
+	// Receive the memory data directly in the output buffer, and update
+	// the checksum while the data arrives.
+	unsigned char *data = dc_buffer_get_data (buffer);
+	unsigned short ccrc = 0x00;
+
 	unsigned int nbytes = 0;
-	unsigned char answer[4 + SZ_MEMORY + 2 + 3] = {0};
-	while (nbytes < sizeof (answer)) {
-		unsigned int len = sizeof (answer) - nbytes;
+	while (nbytes < SZ_MEMORY) {
+		unsigned int len = SZ_MEMORY - nbytes;
 		if (len > 128)
 			len = 128;
 
-		status = dc_serial_read (device->port, answer + nbytes, len, NULL);
+		status = dc_serial_read (device->port, data + nbytes, len, NULL);
 		if (status != DC_STATUS_SUCCESS) {
 			ERROR (abstract->context, "Failed to receive the answer.");
 			return status;
 		}
 
+		ccrc = checksum_add_uint16 (data + nbytes, len, ccrc);
+
 		// Update and emit a progress event.
 		progress.current += len;
 		device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
@@ -323,23 +344,32 @@ reefnet_sensus_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 		nbytes += len;
 	}
 
+	// Receive the checksum and trailer of the package.
+	unsigned char trailer[2 + 3] = {0};
+	status = dc_serial_read (device->port, trailer, sizeof (trailer), NULL);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (abstract->context, "Failed to receive the answer.");
+		return status;
+	}
+
+	// Update and emit a progress event.
+	progress.current += sizeof (trailer);
+	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
+
 	// Verify the headers of the package.
-	if (memcmp (answer, "DATA", 4) != 0 ||
-		memcmp (answer + sizeof (answer) - 3, "END", 3) != 0) {
+	if (memcmp (header, "DATA", 4) != 0 ||
+		memcmp (trailer + 2, "END", 3) != 0) {
 		ERROR (abstract->context, "Unexpected answer start or end byte(s).");
 		return DC_STATUS_PROTOCOL;
 	}
 
 	// Verify the checksum of the package.
-	unsigned short crc = array_uint16_le (answer + 4 + SZ_MEMORY);
-	unsigned short ccrc = checksum_add_uint16 (answer + 4, SZ_MEMORY, 0x00);
+	unsigned short crc = array_uint16_le (trailer);
 	if (crc != ccrc) {
 		ERROR (abstract->context, "Unexpected answer checksum.");
 		return DC_STATUS_PROTOCOL;
 	}
 
-	dc_buffer_append (buffer, answer + 4, SZ_MEMORY);
-
 	return DC_STATUS_SUCCESS;
 }
 
@@ -351,6 +381,8 @@ reefnet_sensus_device_foreach (dc_device_t *abstract, dc_dive_callback_t callbac
 	if (buffer == NULL)
 		return DC_STATUS_NOMEMORY;
 
+	device_phase (abstract, DC_PHASE_PROFILE);
+
 	dc_status_t rc = reefnet_sensus_device_dump (abstract, buffer);
 	if (rc != DC_STATUS_SUCCESS) {
 		dc_buffer_free (buffer);
@@ -19,7 +19,11 @@
  * MA 02110-1301 USA
  */
 
+#define DC_LOG_CATEGORY DC_LOGCATEGORY_PARSER
+
 #include <stdlib.h>	// malloc, free
+#include <limits.h>
+#include <math.h>
 
 #include <libdivecomputer/reefnet_sensus.h>
 #include <libdivecomputer/units.h>
@@ -46,12 +50,20 @@ struct reefnet_sensus_parser_t {
 	unsigned int cached;
 	unsigned int divetime;
 	unsigned int maxdepth;
+	// Sample layout.
+	unsigned int have_layout;
+	unsigned int offset;
+	unsigned int interval;
+	unsigned int nsamples;
 };
 
 static dc_status_t reefnet_sensus_parser_set_data (dc_parser_t *abstract, const unsigned char *data, unsigned int size);
 static dc_status_t reefnet_sensus_parser_get_datetime (dc_parser_t *abstract, dc_datetime_t *datetime);
 static dc_status_t reefnet_sensus_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsigned int flags, void *value);
 static dc_status_t reefnet_sensus_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata);
+static dc_status_t reefnet_sensus_parser_samples_extract (dc_parser_t *abstract, dc_sample_columns_t *columns);
+static dc_status_t reefnet_sensus_parser_samples_range (dc_parser_t *abstract, unsigned int first, unsigned int count, dc_sample_callback_t callback, void *userdata);
+static dc_status_t reefnet_sensus_parser_samples_seek (dc_parser_t *abstract, unsigned int time, unsigned int *index);
 
 static const dc_parser_vtable_t reefnet_sensus_parser_vtable = {
 	sizeof(reefnet_sensus_parser_t),
@@ -60,6 +72,14 @@ static const dc_parser_vtable_t reefnet_sensus_parser_vtable = {
 	reefnet_sensus_parser_get_datetime, /* datetime */
 	reefnet_sensus_parser_get_field, /* fields */
 	reefnet_sensus_parser_samples_foreach, /* samples_foreach */
+	reefnet_sensus_parser_samples_extract, /* samples_extract */
+	reefnet_sensus_parser_samples_range, /* samples_range */
+	reefnet_sensus_parser_samples_seek, /* samples_seek */
+	NULL, /* samples_index */
+	NULL, /* samples_split */
+	NULL, /* samples_chunk */
+	NULL, /* subdives */
+	NULL, /* samples_vendor */
 	NULL /* destroy */
 };
 
@@ -87,6 +107,10 @@ reefnet_sensus_parser_create (dc_parser_t **out, dc_context_t *context, unsigned
 	parser->cached = 0;
 	parser->divetime = 0;
 	parser->maxdepth = 0;
+	parser->have_layout = 0;
+	parser->offset = 0;
+	parser->interval = 0;
+	parser->nsamples = 0;
 
 	*out = (dc_parser_t*) parser;
 
@@ -103,6 +127,10 @@ reefnet_sensus_parser_set_data (dc_parser_t *abstract, const unsigned char *data
 	parser->cached = 0;
 	parser->divetime = 0;
 	parser->maxdepth = 0;
+	parser->have_layout = 0;
+	parser->offset = 0;
+	parser->interval = 0;
+	parser->nsamples = 0;
 
 	return DC_STATUS_SUCCESS;
 }
@@ -212,46 +240,37 @@ reefnet_sensus_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, un
 }
 
 
-static dc_status_t
-reefnet_sensus_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata)
+static void
+reefnet_sensus_parser_layout (reefnet_sensus_parser_t *parser)
 {
-	reefnet_sensus_parser_t *parser = (reefnet_sensus_parser_t*) abstract;
+	const unsigned char *data = parser->base.data;
+	unsigned int size = parser->base.size;
 
-	const unsigned char *data = abstract->data;
-	unsigned int size = abstract->size;
+	if (parser->have_layout)
+		return;
 
 	unsigned int offset = 0;
 	while (offset + 7 <= size) {
 		if (data[offset] == 0xFF && data[offset + 6] == 0xFE) {
-
-			unsigned int time = 0;
-			unsigned int interval = data[offset + 1];
-			unsigned int nsamples = 0, count = 0;
+			parser->interval = data[offset + 1];
 
 			offset += 7;
-			while (offset + 1 <= size) {
-				dc_sample_value_t sample = {0};
-
-				// Time (seconds)
-				time += interval;
-				sample.time = time;
-				if (callback) callback (DC_SAMPLE_TIME, sample, userdata);
+			parser->offset = offset;
 
-				// Depth (adjusted feet of seawater).
+			// Every sample has a depth byte, and every sixth sample
+			// a temperature byte. A sample with a missing temperature
+			// byte is still counted, and reported as an error.
+			unsigned int nsamples = 0, count = 0;
+			while (offset + 1 <= size) {
 				unsigned int depth = data[offset++];
-				sample.depth = ((depth + 33.0 - (double) SAMPLE_DEPTH_ADJUST) * FSW - parser->atmospheric) / parser->hydrostatic;
-				if (callback) callback (DC_SAMPLE_DEPTH, sample, userdata);
-
-				// Temperature (degrees Fahrenheit)
 				if ((nsamples % 6) == 0) {
-					if (offset + 1 > size)
-						return DC_STATUS_DATAFORMAT;
-					unsigned int temperature = data[offset++];
-					sample.temperature = (temperature - 32.0) * (5.0 / 9.0);
-					if (callback) callback (DC_SAMPLE_TEMPERATURE, sample, userdata);
+					if (offset + 1 > size) {
+						nsamples++;
+						break;
+					}
+					offset++;
 				}
 
-				// Current sample is complete.
 				nsamples++;
 
 				// The end of a dive is reached when 17 consecutive
@@ -265,11 +284,135 @@ reefnet_sensus_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback
 					count = 0;
 				}
 			}
+
+			parser->nsamples = nsamples;
 			break;
 		} else {
 			offset++;
 		}
 	}
 
+	parser->have_layout = 1;
+}
+
+
+static dc_status_t
+reefnet_sensus_parser_samples_range (dc_parser_t *abstract, unsigned int first, unsigned int count, dc_sample_callback_t callback, void *userdata)
+{
+	reefnet_sensus_parser_t *parser = (reefnet_sensus_parser_t*) abstract;
+
+	const unsigned char *data = abstract->data;
+	unsigned int size = abstract->size;
+
+	reefnet_sensus_parser_layout (parser);
+
+	unsigned int nsamples = parser->nsamples;
+	if (first > nsamples)
+		first = nsamples;
+	unsigned int last = nsamples;
+	if (count < last - first)
+		last = first + count;
+
+	// The samples have a fixed size, except for the temperature byte.
+	unsigned int offset = parser->offset + first + (first + 5) / 6;
+	for (unsigned int i = first; i < last; ++i) {
+		dc_sample_value_t sample = {0};
+
+		// Time (seconds)
+		sample.time = (i + 1) * parser->interval;
+		if (callback) callback (DC_SAMPLE_TIME, sample, userdata);
+
+		// Depth (adjusted feet of seawater).
+		unsigned int depth = data[offset++];
+		sample.depth = ((depth + 33.0 - (double) SAMPLE_DEPTH_ADJUST) * FSW - parser->atmospheric) / parser->hydrostatic;
+		if (callback) callback (DC_SAMPLE_DEPTH, sample, userdata);
+
+		// Temperature (degrees Fahrenheit)
+		if ((i % 6) == 0) {
+			if (offset + 1 > size)
+				return DC_STATUS_DATAFORMAT;
+			unsigned int temperature = data[offset++];
+			sample.temperature = (temperature - 32.0) * (5.0 / 9.0);
+			if (callback) callback (DC_SAMPLE_TEMPERATURE, sample, userdata);
+		}
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+static dc_status_t
+reefnet_sensus_parser_samples_seek (dc_parser_t *abstract, unsigned int time, unsigned int *index)
+{
+	reefnet_sensus_parser_t *parser = (reefnet_sensus_parser_t*) abstract;
+
+	reefnet_sensus_parser_layout (parser);
+
+	// The first sample is recorded after one interval.
+	unsigned int i = 0;
+	if (time && parser->interval == 0)
+		i = parser->nsamples;
+	else if (time)
+		i = (time - 1) / parser->interval;
+	if (i > parser->nsamples)
+		i = parser->nsamples;
+
+	*index = i;
+
 	return DC_STATUS_SUCCESS;
 }
+
+
+static dc_status_t
+reefnet_sensus_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata)
+{
+	return reefnet_sensus_parser_samples_range (abstract, 0, UINT_MAX, callback, userdata);
+}
+
+
+static dc_status_t
+reefnet_sensus_parser_samples_extract (dc_parser_t *abstract, dc_sample_columns_t *columns)
+{
+	reefnet_sensus_parser_t *parser = (reefnet_sensus_parser_t*) abstract;
+	dc_status_t rc = DC_STATUS_SUCCESS;
+
+	reefnet_sensus_parser_layout (parser);
+
+	// The samples are stored in groups of six depth bytes, with the
+	// temperature byte right after the first depth byte of each group.
+	unsigned int nsamples = parser->nsamples;
+	unsigned int n = sample_columns_interval (columns, nsamples, parser->interval);
+	const unsigned char *data = abstract->data + parser->offset;
+	unsigned int size = abstract->size - parser->offset;
+	const double atmospheric = parser->atmospheric;
+	const double hydrostatic = parser->hydrostatic;
+
+	// The temperature byte of the last sample may be missing, which is
+	// reported as an error after decoding all samples.
+	unsigned int ntemperatures = (nsamples + 5) / 6;
+	if (nsamples && (nsamples - 1) % 6 == 0 &&
+		nsamples + ntemperatures > size) {
+		ntemperatures--;
+		rc = DC_STATUS_DATAFORMAT;
+	}
+
+	if (columns->depth) {
+		double *depth = columns->depth;
+		for (unsigned int i = 0; i < n; ++i) {
+			unsigned int value = data[i + (i + 5) / 6];
+			depth[i] = ((value + 33.0 - (double) SAMPLE_DEPTH_ADJUST) * FSW - atmospheric) / hydrostatic;
+		}
+	}
+
+	if (columns->temperature) {
+		double *temperature = columns->temperature;
+		for (unsigned int i = 0; i < n; ++i)
+			temperature[i] = NAN;
+		for (unsigned int i = 0; i < ntemperatures && i * 6 < n; ++i) {
+			unsigned int value = data[i * 7 + 1];
+			temperature[i * 6] = (value - 32.0) * (5.0 / 9.0);
+		}
+	}
+
+	return rc;
+}
@@ -91,6 +91,10 @@ reefnet_sensuspro_device_open (dc_device_t **out, dc_context_t *context, const c
 		goto error_free;
 	}
 
+	// Interrupt the blocking reads when the download is cancelled, and
+	// measure the time spent waiting for the I/O.
+	device_set_port ((dc_device_t *) device, device->port);
+
 	// Set the serial communication protocol (19200 8N1).
 	status = dc_serial_configure (device->port, 19200, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -195,7 +199,7 @@ reefnet_sensuspro_handshake (reefnet_sensuspro_device_t *device)
 
 	// Verify the checksum of the handshake packet.
 	unsigned short crc = array_uint16_le (handshake + SZ_HANDSHAKE);
-	unsigned short ccrc = checksum_crc_ccitt_uint16 (handshake, SZ_HANDSHAKE);
+	unsigned short ccrc = checksum_crc_ccitt_uint16 (handshake, SZ_HANDSHAKE, 0xffff);
 	if (crc != ccrc) {
 		ERROR (abstract->context, "Unexpected answer checksum.");
 		return DC_STATUS_PROTOCOL;
@@ -262,8 +266,8 @@ reefnet_sensuspro_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 	reefnet_sensuspro_device_t *device = (reefnet_sensuspro_device_t*) abstract;
 
 	// Erase the current contents of the buffer and
-	// pre-allocate the required amount of memory.
-	if (!dc_buffer_clear (buffer) || !dc_buffer_reserve (buffer, SZ_MEMORY)) {
+	// allocate the required amount of memory.
+	if (!dc_buffer_clear (buffer) || !dc_buffer_resize (buffer, SZ_MEMORY)) {
 		ERROR (abstract->context, "Insufficient buffer space available.");
 		return DC_STATUS_NOMEMORY;
 	}
@@ -278,19 +282,25 @@ reefnet_sensuspro_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 	if (rc != DC_STATUS_SUCCESS)
 		return rc;
 
+	// Receive the memory data directly in the output buffer, and update
+	// the checksum while the data arrives.
+	unsigned char *data = dc_buffer_get_data (buffer);
+	unsigned short ccrc = 0xffff;
+
 	unsigned int nbytes = 0;
-	unsigned char answer[SZ_MEMORY + 2] = {0};
-	while (nbytes < sizeof (answer)) {
-		unsigned int len = sizeof (answer) - nbytes;
+	while (nbytes < SZ_MEMORY) {
+		unsigned int len = SZ_MEMORY - nbytes;
 		if (len > 256)
 			len = 256;
 
-		status = dc_serial_read (device->port, answer + nbytes, len, NULL);
+		status = dc_serial_read (device->port, data + nbytes, len, NULL);
 		if (status != DC_STATUS_SUCCESS) {
 			ERROR (abstract->context, "Failed to receive the answer.");
 			return status;
 		}
 
+		ccrc = checksum_crc_ccitt_uint16 (data + nbytes, len, ccrc);
+
 		// Update and emit a progress event.
 		progress.current += len;
 		device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
@@ -298,15 +308,24 @@ reefnet_sensuspro_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 		nbytes += len;
 	}
 
-	unsigned short crc = array_uint16_le (answer + SZ_MEMORY);
-	unsigned short ccrc = checksum_crc_ccitt_uint16 (answer, SZ_MEMORY);
+	// Receive the checksum.
+	unsigned char checksum[2] = {0};
+	status = dc_serial_read (device->port, checksum, sizeof (checksum), NULL);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (abstract->context, "Failed to receive the answer.");
+		return status;
+	}
+
+	// Update and emit a progress event.
+	progress.current += sizeof (checksum);
+	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
+
+	unsigned short crc = array_uint16_le (checksum);
 	if (crc != ccrc) {
 		ERROR (abstract->context, "Unexpected answer checksum.");
 		return DC_STATUS_PROTOCOL;
 	}
 
-	dc_buffer_append (buffer, answer, SZ_MEMORY);
-
 	return DC_STATUS_SUCCESS;
 }
 
@@ -318,6 +337,8 @@ reefnet_sensuspro_device_foreach (dc_device_t *abstract, dc_dive_callback_t call
 	if (buffer == NULL)
 		return DC_STATUS_NOMEMORY;
 
+	device_phase (abstract, DC_PHASE_PROFILE);
+
 	dc_status_t rc = reefnet_sensuspro_device_dump (abstract, buffer);
 	if (rc != DC_STATUS_SUCCESS) {
 		dc_buffer_free (buffer);
@@ -374,41 +395,37 @@ reefnet_sensuspro_extract_dives (dc_device_t *abstract, const unsigned char data
 	const unsigned char footer[2] = {0xFF, 0xFF};
 
 	// Search the entire data stream for start markers.
+	const unsigned char *marker = NULL;
 	unsigned int previous = size;
-	unsigned int current = (size >= 4 ? size - 4 : 0);
-	while (current > 0) {
-		current--;
-		if (memcmp (data + current, header, sizeof (header)) == 0) {
-			// Once a start marker is found, start searching
-			// for the corresponding stop marker. The search is
-			// now limited to the start of the previous dive.
-			int found = 0;
-			unsigned int offset = current + 10; // Skip non-sample data.
-			while (offset + 2 <= previous) {
-				if (memcmp (data + offset, footer, sizeof (footer)) == 0) {
-					found = 1;
-					break;
-				} else {
-					offset++;
-				}
-			}
-
-			// Report an error if no stop marker was found.
-			if (!found)
-				return DC_STATUS_DATAFORMAT;
-
-			// Automatically abort when a dive is older than the provided timestamp.
-			unsigned int timestamp = array_uint32_le (data + current + 6);
-			if (device && timestamp <= device->timestamp)
-				return DC_STATUS_SUCCESS;
-
-			if (callback && !callback (data + current, offset + 2 - current, data + current + 6, 4, userdata))
-				return DC_STATUS_SUCCESS;
-
-			// Prepare for the next dive.
-			previous = current;
-			current = (current >= 4 ? current - 4 : 0);
-		}
+	unsigned int limit = size;
+	while (limit > 0 && (marker = array_search_backward (data, limit - 1, header, sizeof (header))) != NULL) {
+		unsigned int current = marker - data - sizeof (header);
+
+		// Once a start marker is found, start searching
+		// for the corresponding stop marker. The search is
+		// now limited to the start of the previous dive.
+		const unsigned char *end = NULL;
+		unsigned int offset = current + 10; // Skip non-sample data.
+		if (offset <= previous)
+			end = array_search_forward (data + offset, previous - offset, footer, sizeof (footer));
+
+		// Report an error if no stop marker was found.
+		if (end == NULL)
+			return DC_STATUS_DATAFORMAT;
+
+		offset = end - data;
+
+		// Automatically abort when a dive is older than the provided timestamp.
+		unsigned int timestamp = array_uint32_le (data + current + 6);
+		if (device && timestamp <= device->timestamp)
+			return DC_STATUS_SUCCESS;
+
+		if (callback && !callback (data + current, offset + 2 - current, data + current + 6, 4, userdata))
+			return DC_STATUS_SUCCESS;
+
+		// Prepare for the next dive.
+		previous = current;
+		limit = current;
 	}
 
 	return DC_STATUS_SUCCESS;
@@ -19,8 +19,11 @@
  * MA 02110-1301 USA
  */
 
+#define DC_LOG_CATEGORY DC_LOGCATEGORY_PARSER
+
 #include <stdlib.h>
 #include <string.h>	// memcmp
+#include <limits.h>
 
 #include <libdivecomputer/reefnet_sensuspro.h>
 #include <libdivecomputer/units.h>
@@ -45,12 +48,20 @@ struct reefnet_sensuspro_parser_t {
 	unsigned int cached;
 	unsigned int divetime;
 	unsigned int maxdepth;
+	// Sample layout.
+	unsigned int have_layout;
+	unsigned int offset;
+	unsigned int interval;
+	unsigned int nsamples;
 };
 
 static dc_status_t reefnet_sensuspro_parser_set_data (dc_parser_t *abstract, const unsigned char *data, unsigned int size);
 static dc_status_t reefnet_sensuspro_parser_get_datetime (dc_parser_t *abstract, dc_datetime_t *datetime);
 static dc_status_t reefnet_sensuspro_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsigned int flags, void *value);
 static dc_status_t reefnet_sensuspro_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata);
+static dc_status_t reefnet_sensuspro_parser_samples_extract (dc_parser_t *abstract, dc_sample_columns_t *columns);
+static dc_status_t reefnet_sensuspro_parser_samples_range (dc_parser_t *abstract, unsigned int first, unsigned int count, dc_sample_callback_t callback, void *userdata);
+static dc_status_t reefnet_sensuspro_parser_samples_seek (dc_parser_t *abstract, unsigned int time, unsigned int *index);
 
 static const dc_parser_vtable_t reefnet_sensuspro_parser_vtable = {
 	sizeof(reefnet_sensuspro_parser_t),
@@ -59,6 +70,14 @@ static const dc_parser_vtable_t reefnet_sensuspro_parser_vtable = {
 	reefnet_sensuspro_parser_get_datetime, /* datetime */
 	reefnet_sensuspro_parser_get_field, /* fields */
 	reefnet_sensuspro_parser_samples_foreach, /* samples_foreach */
+	reefnet_sensuspro_parser_samples_extract, /* samples_extract */
+	reefnet_sensuspro_parser_samples_range, /* samples_range */
+	reefnet_sensuspro_parser_samples_seek, /* samples_seek */
+	NULL, /* samples_index */
+	NULL, /* samples_split */
+	NULL, /* samples_chunk */
+	NULL, /* subdives */
+	NULL, /* samples_vendor */
 	NULL /* destroy */
 };
 
@@ -86,6 +105,10 @@ reefnet_sensuspro_parser_create (dc_parser_t **out, dc_context_t *context, unsig
 	parser->cached = 0;
 	parser->divetime = 0;
 	parser->maxdepth = 0;
+	parser->have_layout = 0;
+	parser->offset = 0;
+	parser->interval = 0;
+	parser->nsamples = 0;
 
 	*out = (dc_parser_t*) parser;
 
@@ -102,6 +125,10 @@ reefnet_sensuspro_parser_set_data (dc_parser_t *abstract, const unsigned char *d
 	parser->cached = 0;
 	parser->divetime = 0;
 	parser->maxdepth = 0;
+	parser->have_layout = 0;
+	parser->offset = 0;
+	parser->interval = 0;
+	parser->nsamples = 0;
 
 	return DC_STATUS_SUCCESS;
 }
@@ -202,15 +229,16 @@ reefnet_sensuspro_parser_get_field (dc_parser_t *abstract, dc_field_type_t type,
 
 
 static dc_status_t
-reefnet_sensuspro_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata)
+reefnet_sensuspro_parser_layout (reefnet_sensuspro_parser_t *parser)
 {
-	reefnet_sensuspro_parser_t *parser = (reefnet_sensuspro_parser_t*) abstract;
-
 	const unsigned char header[4] = {0x00, 0x00, 0x00, 0x00};
 	const unsigned char footer[2] = {0xFF, 0xFF};
 
-	const unsigned char *data = abstract->data;
-	unsigned int size = abstract->size;
+	const unsigned char *data = parser->base.data;
+	unsigned int size = parser->base.size;
+
+	if (parser->have_layout)
+		return DC_STATUS_SUCCESS;
 
 	unsigned int offset = 0;
 	while (offset + sizeof (header) <= size) {
@@ -218,39 +246,142 @@ reefnet_sensuspro_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callb
 			if (offset + 10 > size)
 				return DC_STATUS_DATAFORMAT;
 
-			unsigned int time = 0;
-			unsigned int interval = array_uint16_le (data + offset + 4);
+			parser->interval = array_uint16_le (data + offset + 4);
 
 			offset += 10;
+			parser->offset = offset;
+
+			unsigned int nsamples = 0;
 			while (offset + sizeof (footer) <= size &&
 				memcmp (data + offset, footer, sizeof (footer)) != 0)
 			{
-				unsigned int value = array_uint16_le (data + offset);
-				unsigned int depth = (value & 0x01FF);
-				unsigned int temperature = (value & 0xFE00) >> 9;
-
-				dc_sample_value_t sample = {0};
-
-				// Time (seconds)
-				time += interval;
-				sample.time = time;
-				if (callback) callback (DC_SAMPLE_TIME, sample, userdata);
-
-				// Temperature (°F)
-				sample.temperature = (temperature - 32.0) * (5.0 / 9.0);
-				if (callback) callback (DC_SAMPLE_TEMPERATURE, sample, userdata);
-
-				// Depth (absolute pressure in fsw)
-				sample.depth = (depth * FSW - parser->atmospheric) / parser->hydrostatic;
-				if (callback) callback (DC_SAMPLE_DEPTH, sample, userdata);
-
+				nsamples++;
 				offset += 2;
 			}
+
+			parser->nsamples = nsamples;
 			break;
 		} else {
 			offset++;
 		}
 	}
 
+	parser->have_layout = 1;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+static dc_status_t
+reefnet_sensuspro_parser_samples_range (dc_parser_t *abstract, unsigned int first, unsigned int count, dc_sample_callback_t callback, void *userdata)
+{
+	reefnet_sensuspro_parser_t *parser = (reefnet_sensuspro_parser_t*) abstract;
+	dc_status_t rc = DC_STATUS_SUCCESS;
+
+	const unsigned char *data = abstract->data;
+
+	rc = reefnet_sensuspro_parser_layout (parser);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	unsigned int nsamples = parser->nsamples;
+	if (first > nsamples)
+		first = nsamples;
+	unsigned int last = nsamples;
+	if (count < last - first)
+		last = first + count;
+
+	for (unsigned int i = first; i < last; ++i) {
+		unsigned int offset = parser->offset + i * 2;
+
+		unsigned int value = array_uint16_le (data + offset);
+		unsigned int depth = (value & 0x01FF);
+		unsigned int temperature = (value & 0xFE00) >> 9;
+
+		dc_sample_value_t sample = {0};
+
+		// Time (seconds)
+		sample.time = (i + 1) * parser->interval;
+		if (callback) callback (DC_SAMPLE_TIME, sample, userdata);
+
+		// Temperature (°F)
+		sample.temperature = (temperature - 32.0) * (5.0 / 9.0);
+		if (callback) callback (DC_SAMPLE_TEMPERATURE, sample, userdata);
+
+		// Depth (absolute pressure in fsw)
+		sample.depth = (depth * FSW - parser->atmospheric) / parser->hydrostatic;
+		if (callback) callback (DC_SAMPLE_DEPTH, sample, userdata);
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+static dc_status_t
+reefnet_sensuspro_parser_samples_seek (dc_parser_t *abstract, unsigned int time, unsigned int *index)
+{
+	reefnet_sensuspro_parser_t *parser = (reefnet_sensuspro_parser_t*) abstract;
+	dc_status_t rc = DC_STATUS_SUCCESS;
+
+	rc = reefnet_sensuspro_parser_layout (parser);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	// The first sample is recorded after one interval.
+	unsigned int i = 0;
+	if (time && parser->interval == 0)
+		i = parser->nsamples;
+	else if (time)
+		i = (time - 1) / parser->interval;
+	if (i > parser->nsamples)
+		i = parser->nsamples;
+
+	*index = i;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+static dc_status_t
+reefnet_sensuspro_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata)
+{
+	return reefnet_sensuspro_parser_samples_range (abstract, 0, UINT_MAX, callback, userdata);
+}
+
+
+static dc_status_t
+reefnet_sensuspro_parser_samples_extract (dc_parser_t *abstract, dc_sample_columns_t *columns)
+{
+	reefnet_sensuspro_parser_t *parser = (reefnet_sensuspro_parser_t*) abstract;
+	dc_status_t rc = DC_STATUS_SUCCESS;
+
+	rc = reefnet_sensuspro_parser_layout (parser);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	// Every sample is a 16 bit word with the temperature in the upper 7
+	// bits and the pressure in the lower 9 bits. Each column is converted
+	// in a separate loop, simple enough for the compiler to vectorize.
+	unsigned int n = sample_columns_interval (columns, parser->nsamples, parser->interval);
+	const unsigned char *data = abstract->data + parser->offset;
+	const double atmospheric = parser->atmospheric;
+	const double hydrostatic = parser->hydrostatic;
+
+	if (columns->temperature) {
+		double *temperature = columns->temperature;
+		for (unsigned int i = 0; i < n; ++i) {
+			unsigned int value = data[i * 2 + 1] >> 1;
+			temperature[i] = (value - 32.0) * (5.0 / 9.0);
+		}
+	}
+
+	if (columns->depth) {
+		double *depth = columns->depth;
+		for (unsigned int i = 0; i < n; ++i) {
+			unsigned int value = (data[i * 2] | (data[i * 2 + 1] << 8)) & 0x01FF;
+			depth[i] = (value * FSW - atmospheric) / hydrostatic;
+		}
+	}
+
 	return DC_STATUS_SUCCESS;
 }
@@ -30,6 +30,7 @@
 #include "serial.h"
 #include "checksum.h"
 #include "array.h"
+#include "retry.h"
 
 #define ISINSTANCE(device) dc_device_isinstance((device), &reefnet_sensusultra_device_vtable)
 
@@ -100,6 +101,10 @@ reefnet_sensusultra_device_open (dc_device_t **out, dc_context_t *context, const
 		goto error_free;
 	}
 
+	// Interrupt the blocking reads when the download is cancelled, and
+	// measure the time spent waiting for the I/O.
+	device_set_port ((dc_device_t *) device, device->port);
+
 	// Set the serial communication protocol (115200 8N1).
 	status = dc_serial_configure (device->port, 115200, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -252,7 +257,7 @@ reefnet_sensusultra_packet (reefnet_sensusultra_device_t *device, unsigned char
 
 	// Verify the checksum of the packet.
 	unsigned short crc = array_uint16_le (data + size - 2);
-	unsigned short ccrc = checksum_crc_ccitt_uint16 (data + header, size - header - 2);
+	unsigned short ccrc = checksum_crc_ccitt_uint16 (data + header, size - header - 2, 0xffff);
 	if (crc != ccrc) {
 		ERROR (abstract->context, "Unexpected answer checksum.");
 		return DC_STATUS_PROTOCOL;
@@ -348,26 +353,21 @@ reefnet_sensusultra_send (reefnet_sensusultra_device_t *device, unsigned short c
 	// Flush the input and output buffers.
 	dc_serial_purge (device->port, DC_DIRECTION_ALL);
 
+	// According to the developers guide, a 250 ms delay is suggested to
+	// guarantee that the prompt byte sent after the handshake packet is
+	// not accidentally buffered by the host and (mis)interpreted as part
+	// of the next packet.
+	dc_retry_t retry;
+	dc_retry_init (&retry, MAXRETRIES, 250, 250, DC_DIRECTION_ALL);
+
 	// Wake-up the device and send the instruction code.
-	unsigned int nretries = 0;
 	dc_status_t rc = DC_STATUS_SUCCESS;
 	while ((rc = reefnet_sensusultra_handshake (device, command)) != DC_STATUS_SUCCESS) {
 		// Automatically discard a corrupted handshake packet,
 		// and wait for the next one.
-		if (rc != DC_STATUS_PROTOCOL && rc != DC_STATUS_TIMEOUT)
-			return rc;
-
-		// Abort if the maximum number of retries is reached.
-		if (nretries++ >= MAXRETRIES)
+		rc = dc_retry_failed (&retry, (dc_device_t *) device, device->port, rc);
+		if (rc != DC_STATUS_SUCCESS)
 			return rc;
-
-		// According to the developers guide, a 250 ms delay is suggested to
-		// guarantee that the prompt byte sent after the handshake packet is
-		// not accidentally buffered by the host and (mis)interpreted as part
-		// of the next packet.
-
-		dc_serial_sleep (device->port, 250);
-		dc_serial_purge (device->port, DC_DIRECTION_ALL);
 	}
 
 	return DC_STATUS_SUCCESS;
@@ -405,6 +405,12 @@ reefnet_sensusultra_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 		if (rc != DC_STATUS_SUCCESS)
 			return rc;
 
+		// Accept the packet. The device starts sending the next
+		// packet immediately, while this one is being processed.
+		rc = reefnet_sensusultra_send_uchar (device, ACCEPT);
+		if (rc != DC_STATUS_SUCCESS)
+			return rc;
+
 		// Update and emit a progress event.
 		progress.current += SZ_PACKET;
 		device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
@@ -415,11 +421,6 @@ reefnet_sensusultra_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 			return DC_STATUS_NOMEMORY;
 		}
 
-		// Accept the packet.
-		rc = reefnet_sensusultra_send_uchar (device, ACCEPT);
-		if (rc != DC_STATUS_SUCCESS)
-			return rc;
-
 		nbytes += SZ_PACKET;
 		npages++;
 	}
@@ -506,7 +507,7 @@ reefnet_sensusultra_device_write_user (dc_device_t *abstract, const unsigned cha
 	}
 
 	// Send the checksum to the device.
-	unsigned short crc = checksum_crc_ccitt_uint16 (data, SZ_USER);
+	unsigned short crc = checksum_crc_ccitt_uint16 (data, SZ_USER, 0xffff);
 	rc = reefnet_sensusultra_send_ushort (device, crc);
 	if (rc != DC_STATUS_SUCCESS)
 		return rc;
@@ -673,7 +674,9 @@ reefnet_sensusultra_device_foreach (dc_device_t *abstract, dc_dive_callback_t ca
 {
 	reefnet_sensusultra_device_t *device = (reefnet_sensusultra_device_t*) abstract;
 
-	dc_buffer_t *buffer = dc_buffer_new (SZ_MEMORY);
+	// Only the data of the dive that is currently being received is kept
+	// in the buffer, so a small initial size is sufficient.
+	dc_buffer_t *buffer = dc_buffer_new (16 * SZ_PACKET);
 	if (buffer == NULL) {
 		ERROR (abstract->context, "Failed to allocate memory.");
 		return DC_STATUS_NOMEMORY;
@@ -714,9 +717,20 @@ reefnet_sensusultra_device_foreach (dc_device_t *abstract, dc_dive_callback_t ca
 		if (array_isequal (packet + 2, SZ_PACKET, 0xFF) && nbytes != 0)
 			break;
 
+		// Accept the packet. The device starts sending the next
+		// packet immediately, while this one is being parsed. If the
+		// download is aborted, the unused packet is discarded when the
+		// input buffer is purged before the next command.
+		rc = reefnet_sensusultra_send_uchar (device, ACCEPT);
+		if (rc != DC_STATUS_SUCCESS) {
+			dc_buffer_free (buffer);
+			return rc;
+		}
+
 		// Prepend the packet to the buffer.
 		if (!dc_buffer_prepend (buffer, packet + 2, SZ_PACKET)) {
 			ERROR (abstract->context, "Insufficient buffer space available.");
+			dc_buffer_free (buffer);
 			return DC_STATUS_NOMEMORY;
 		}
 
@@ -735,12 +749,9 @@ reefnet_sensusultra_device_foreach (dc_device_t *abstract, dc_dive_callback_t ca
 		if (aborted)
 			break;
 
-		// Accept the packet.
-		rc = reefnet_sensusultra_send_uchar (device, ACCEPT);
-		if (rc != DC_STATUS_SUCCESS) {
-			dc_buffer_free (buffer);
-			return rc;
-		}
+		// Discard the data of the dives that have already been processed.
+		// The parser never looks past the start of the previous dive again.
+		dc_buffer_slice (buffer, 0, previous);
 
 		nbytes += SZ_PACKET;
 		npages++;
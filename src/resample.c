@@ -0,0 +1,192 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <math.h>
+
+#include <libdivecomputer/resample.h>
+
+typedef struct resample_grid_t {
+	unsigned int start;
+	unsigned int interval;
+	unsigned int count;
+} resample_grid_t;
+
+/*
+ * Get the number of grid points before the time.
+ */
+static unsigned int
+resample_before (const resample_grid_t *grid, unsigned int time)
+{
+	if (time <= grid->start)
+		return 0;
+
+	unsigned int n = (time - grid->start + grid->interval - 1) / grid->interval;
+	return n < grid->count ? n : grid->count;
+}
+
+/*
+ * Get the index of the first grid point at or after the time, clamped to
+ * the last grid point.
+ */
+static unsigned int
+resample_index (const resample_grid_t *grid, unsigned int time)
+{
+	unsigned int n = resample_before (grid, time);
+	return n < grid->count ? n : grid->count - 1;
+}
+
+/*
+ * Resample a single channel in one pass over the input. Each interval
+ * between two known values fills a contiguous run of grid points, with
+ * a loop the compiler can vectorize.
+ */
+static void
+resample_channel (const resample_grid_t *grid, const unsigned int *time, const double *values, unsigned int nsamples, int step, double *output)
+{
+	unsigned int k = 0;
+	unsigned int t0 = 0;
+	double v0 = NAN;
+	int have = 0;
+
+	for (unsigned int i = 0; i < nsamples; ++i) {
+		if (values == NULL || isnan (values[i]))
+			continue;
+
+		// Ignore samples going back in time.
+		unsigned int t = time[i];
+		if (have && t < t0)
+			continue;
+
+		unsigned int end = resample_before (grid, t);
+		if (!have || step) {
+			for (unsigned int j = k; j < end; ++j)
+				output[j] = v0;
+		} else if (end > k) {
+			double slope = (values[i] - v0) / (double) (t - t0);
+			for (unsigned int j = k; j < end; ++j)
+				output[j] = v0 + slope * ((double) (grid->start + j * grid->interval) - t0);
+		}
+		if (end > k)
+			k = end;
+
+		t0 = t;
+		v0 = values[i];
+		have = 1;
+	}
+
+	// Only a grid point at the time of the last value, or all remaining
+	// points for step interpolation, get the last value.
+	if (have && !step && k < grid->count && grid->start + k * grid->interval == t0)
+		output[k++] = v0;
+	for (unsigned int j = k; j < grid->count; ++j)
+		output[j] = step ? v0 : NAN;
+}
+
+dc_status_t
+dc_resample_columns (const dc_sample_columns_t *input, unsigned int interval, unsigned int flags, dc_sample_columns_t *output)
+{
+	if (input == NULL || output == NULL || interval == 0 ||
+		(input->nsamples && input->time == NULL))
+		return DC_STATUS_INVALIDARGS;
+
+	unsigned int nsamples = input->nsamples < input->capacity ? input->nsamples : input->capacity;
+	unsigned int nevents = input->nevents < input->maxevents ? input->nevents : input->maxevents;
+	if (input->events == NULL)
+		nevents = 0;
+
+	unsigned int last = 0;
+	for (unsigned int i = 0; i < nsamples; ++i) {
+		if (last < input->time[i])
+			last = input->time[i];
+	}
+
+	resample_grid_t grid = {0, interval, 0};
+	if (nsamples) {
+		grid.start = (input->time[0] + interval - 1) / interval * interval;
+		if (grid.start <= last)
+			grid.count = (last - grid.start) / interval + 1;
+	}
+
+	output->nsamples = grid.count;
+	output->nevents = 0;
+
+	// Fill only the part of the grid that fits in the output.
+	resample_grid_t fit = grid;
+	if (fit.count > output->capacity)
+		fit.count = output->capacity;
+
+	if (fit.count) {
+		if (output->time) {
+			for (unsigned int j = 0; j < fit.count; ++j)
+				output->time[j] = grid.start + j * interval;
+		}
+
+		if (output->depth)
+			resample_channel (&fit, input->time, input->depth, nsamples,
+				flags & DC_RESAMPLE_STEP_DEPTH, output->depth);
+
+		if (output->temperature)
+			resample_channel (&fit, input->time, input->temperature, nsamples,
+				flags & DC_RESAMPLE_STEP_TEMPERATURE, output->temperature);
+
+		for (unsigned int t = 0; t < output->ntanks; ++t) {
+			if (output->pressure[t] == NULL)
+				continue;
+			const double *values = NULL;
+			if (t < input->ntanks)
+				values = input->pressure[t];
+			resample_channel (&fit, input->time, values, nsamples,
+				flags & DC_RESAMPLE_STEP_PRESSURE, output->pressure[t]);
+		}
+
+		if (output->gasmix) {
+			for (unsigned int j = 0; j < fit.count; ++j)
+				output->gasmix[j] = DC_GASMIX_UNKNOWN;
+			if (input->gasmix) {
+				for (unsigned int i = 0; i < nsamples; ++i) {
+					if (input->gasmix[i] == DC_GASMIX_UNKNOWN)
+						continue;
+					unsigned int j = resample_index (&grid, input->time[i]);
+					if (j < fit.count)
+						output->gasmix[j] = input->gasmix[i];
+				}
+			}
+		}
+	}
+
+	if (grid.count) {
+		for (unsigned int i = 0; i < nevents; ++i) {
+			dc_sample_event_t event = input->events[i];
+			unsigned int sample = event.sample < nsamples ? event.sample : nsamples - 1;
+			event.sample = resample_index (&grid, input->time[sample]);
+			if (output->nevents < output->maxevents && output->events)
+				output->events[output->nevents] = event;
+			output->nevents++;
+		}
+	}
+
+	if (output->nsamples > output->capacity ||
+		output->nevents > output->maxevents)
+		return DC_STATUS_NOMEMORY;
+
+	return DC_STATUS_SUCCESS;
+}
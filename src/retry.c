@@ -0,0 +1,149 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2008 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include "retry.h"
+#include "device-private.h"
+
+void
+dc_retry_init (dc_retry_t *retry, unsigned int maxretries, unsigned int delay, unsigned int maxdelay, unsigned int purge)
+{
+	retry->maxretries = maxretries;
+	retry->delay = delay;
+	retry->maxdelay = maxdelay;
+	retry->purge = purge;
+	retry->minimum = 0;
+	retry->maximum = 0;
+	retry->timeout = 0;
+	retry->srtt = 0;
+	retry->rttvar = 0;
+	retry->nretries = 0;
+}
+
+
+static dc_status_t
+dc_retry_apply (dc_retry_t *retry, dc_serial_t *port, int timeout)
+{
+	if (timeout < retry->minimum)
+		timeout = retry->minimum;
+	if (timeout > retry->maximum)
+		timeout = retry->maximum;
+
+	if (timeout == retry->timeout)
+		return DC_STATUS_SUCCESS;
+
+	retry->timeout = timeout;
+
+	return dc_serial_set_timeout (port, timeout);
+}
+
+
+dc_status_t
+dc_retry_set_timeout (dc_retry_t *retry, dc_serial_t *port, int minimum, int maximum)
+{
+	if (minimum <= 0 || maximum < minimum)
+		return DC_STATUS_INVALIDARGS;
+
+	retry->minimum = minimum;
+	retry->maximum = maximum;
+	retry->timeout = 0;
+	retry->srtt = 0;
+	retry->rttvar = 0;
+
+	// Start with the maximum timeout, until the first round trip time
+	// has been measured.
+	return dc_retry_apply (retry, port, maximum);
+}
+
+
+void
+dc_retry_begin (dc_retry_t *retry)
+{
+	retry->nretries = 0;
+}
+
+
+dc_status_t
+dc_retry_failed (dc_retry_t *retry, dc_device_t *device, dc_serial_t *port, dc_status_t status)
+{
+	// Only a timeout or a corrupted packet is worth another attempt.
+	if (status != DC_STATUS_TIMEOUT && status != DC_STATUS_PROTOCOL)
+		return status;
+
+	// Abort if the maximum number of retries is reached.
+	if (retry->nretries >= retry->maxretries)
+		return status;
+
+	retry->nretries++;
+
+	device_stats_retry (device);
+
+	// Double the timeout after a timeout, because the round trip time
+	// may have been underestimated.
+	if (retry->maximum && status == DC_STATUS_TIMEOUT) {
+		dc_status_t rc = dc_retry_apply (retry, port, retry->timeout * 2);
+		if (rc != DC_STATUS_SUCCESS)
+			return rc;
+	}
+
+	// Delay the next attempt, a little longer after every retry.
+	unsigned int shift = retry->nretries - 1;
+	unsigned int delay = shift < 16 ? retry->delay << shift : retry->maxdelay;
+	if (delay > retry->maxdelay)
+		delay = retry->maxdelay;
+	if (delay)
+		dc_serial_sleep (port, delay);
+
+	// Discard any garbage bytes, including the late answer.
+	if (retry->purge)
+		dc_serial_purge (port, retry->purge);
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+void
+dc_retry_success (dc_retry_t *retry, dc_serial_t *port, unsigned long long begin)
+{
+	if (retry->maximum == 0)
+		return;
+
+	// A retried packet can't be matched to one specific attempt, so
+	// only the round trip time of the first attempt is measured.
+	if (retry->nretries)
+		return;
+
+	unsigned long long sample = device_timestamp () - begin;
+	if (retry->srtt == 0) {
+		retry->srtt = sample;
+		retry->rttvar = sample / 2;
+	} else {
+		unsigned long long delta = sample > retry->srtt ?
+			sample - retry->srtt : retry->srtt - sample;
+		retry->rttvar = (3 * retry->rttvar + delta) / 4;
+		retry->srtt = (7 * retry->srtt + sample) / 8;
+	}
+
+	unsigned long long timeout = (retry->srtt + 4 * retry->rttvar + 999) / 1000;
+	if (timeout > (unsigned long long) retry->maximum)
+		timeout = retry->maximum;
+
+	dc_retry_apply (retry, port, (int) timeout);
+}
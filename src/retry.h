@@ -0,0 +1,78 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2008 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_RETRY_H
+#define DC_RETRY_H
+
+#include <libdivecomputer/common.h>
+#include <libdivecomputer/device.h>
+
+#include "serial.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Retry and timeout policy for the packet transfers.
+ *
+ * A failed packet is retried with an exponential backoff, up to a
+ * maximum number of retries. When the adaptive timeout is enabled, the
+ * serial timeout follows the measured round trip time of the packets
+ * (with the same smoothing as TCP), but never exceeds the configured
+ * maximum.
+ */
+typedef struct dc_retry_t {
+	/* Retry budget and backoff (milliseconds). */
+	unsigned int maxretries;
+	unsigned int delay;
+	unsigned int maxdelay;
+	unsigned int purge;
+	/* Adaptive timeout (milliseconds). Disabled if the maximum is zero. */
+	int minimum;
+	int maximum;
+	int timeout;
+	/* Smoothed round trip time and its variation (microseconds). */
+	unsigned long long srtt;
+	unsigned long long rttvar;
+	/* Number of retries of the current packet. */
+	unsigned int nretries;
+} dc_retry_t;
+
+void
+dc_retry_init (dc_retry_t *retry, unsigned int maxretries, unsigned int delay, unsigned int maxdelay, unsigned int purge);
+
+dc_status_t
+dc_retry_set_timeout (dc_retry_t *retry, dc_serial_t *port, int minimum, int maximum);
+
+void
+dc_retry_begin (dc_retry_t *retry);
+
+dc_status_t
+dc_retry_failed (dc_retry_t *retry, dc_device_t *device, dc_serial_t *port, dc_status_t status);
+
+void
+dc_retry_success (dc_retry_t *retry, dc_serial_t *port, unsigned long long begin);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_RETRY_H */
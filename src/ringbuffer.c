@@ -20,6 +20,7 @@
  */
 
 #include <assert.h>
+#include <string.h>
 
 #include "ringbuffer.h"
 
@@ -100,3 +101,39 @@ ringbuffer_decrement (unsigned int a, unsigned int delta, unsigned int begin, un
 
 	return decrement (a - begin, delta, end - begin) + begin;
 }
+
+
+unsigned int
+ringbuffer_segments (unsigned int a, unsigned int size, unsigned int begin, unsigned int end, ringbuffer_segment_t segments[2])
+{
+	assert (end >= begin);
+	assert (a >= begin && a < end);
+	assert (size <= end - begin);
+
+	if (size <= end - a) {
+		segments[0].offset = a;
+		segments[0].size = size;
+		return 1;
+	}
+
+	segments[0].offset = a;
+	segments[0].size = end - a;
+	segments[1].offset = begin;
+	segments[1].size = size - (end - a);
+
+	return 2;
+}
+
+
+void
+ringbuffer_copy (unsigned char buffer[], const unsigned char data[], unsigned int a, unsigned int size, unsigned int begin, unsigned int end)
+{
+	ringbuffer_segment_t segments[2];
+	unsigned int count = ringbuffer_segments (a, size, begin, end, segments);
+
+	unsigned int offset = 0;
+	for (unsigned int i = 0; i < count; ++i) {
+		memcpy (buffer + offset, data + segments[i].offset, segments[i].size);
+		offset += segments[i].size;
+	}
+}
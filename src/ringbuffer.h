@@ -38,6 +38,17 @@ ringbuffer_increment (unsigned int a, unsigned int delta, unsigned int begin, un
 unsigned int
 ringbuffer_decrement (unsigned int a, unsigned int delta, unsigned int begin, unsigned int end);
 
+typedef struct ringbuffer_segment_t {
+	unsigned int offset;
+	unsigned int size;
+} ringbuffer_segment_t;
+
+unsigned int
+ringbuffer_segments (unsigned int a, unsigned int size, unsigned int begin, unsigned int end, ringbuffer_segment_t segments[2]);
+
+void
+ringbuffer_copy (unsigned char buffer[], const unsigned char data[], unsigned int a, unsigned int size, unsigned int begin, unsigned int end);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -0,0 +1,316 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <math.h>
+
+#include <libdivecomputer/sampleset.h>
+
+#include "parser-private.h"
+
+#define MINCAPACITY 256
+#define MINEVENTS   16
+#define MAXTANKS    64
+
+struct dc_sample_set_t {
+	/* The columns, with the arrays owned by the set. All ntanks
+	 * pressure columns are allocated. */
+	dc_sample_columns_t columns;
+	unsigned int *deco_type;
+	unsigned int *deco_time;
+	double *deco_depth;
+	/* Number of tanks in the current dive. */
+	unsigned int ntanks;
+	dc_status_t status;
+};
+
+static int
+sample_set_realloc (void **array, unsigned int count, size_t size)
+{
+	void *data = realloc (*array, count * size);
+	if (data == NULL)
+		return 0;
+
+	*array = data;
+
+	return 1;
+}
+
+static int
+sample_set_grow (dc_sample_set_t *set, unsigned int capacity)
+{
+	dc_sample_columns_t *columns = &set->columns;
+
+	// A failed reallocation leaves the already enlarged arrays in place,
+	// so only the capacity needs to stay unchanged.
+	if (!sample_set_realloc ((void **) &columns->time, capacity, sizeof (*columns->time)) ||
+		!sample_set_realloc ((void **) &columns->depth, capacity, sizeof (*columns->depth)) ||
+		!sample_set_realloc ((void **) &columns->temperature, capacity, sizeof (*columns->temperature)) ||
+		!sample_set_realloc ((void **) &columns->gasmix, capacity, sizeof (*columns->gasmix)) ||
+		!sample_set_realloc ((void **) &set->deco_type, capacity, sizeof (*set->deco_type)) ||
+		!sample_set_realloc ((void **) &set->deco_time, capacity, sizeof (*set->deco_time)) ||
+		!sample_set_realloc ((void **) &set->deco_depth, capacity, sizeof (*set->deco_depth)))
+		return 0;
+
+	for (unsigned int i = 0; i < columns->ntanks; ++i) {
+		if (!sample_set_realloc ((void **) &columns->pressure[i], capacity, sizeof (*columns->pressure[i])))
+			return 0;
+	}
+
+	columns->capacity = capacity;
+
+	return 1;
+}
+
+static int
+sample_set_add_tanks (dc_sample_set_t *set, unsigned int ntanks)
+{
+	dc_sample_columns_t *columns = &set->columns;
+
+	if (!sample_set_realloc ((void **) &columns->pressure, ntanks, sizeof (*columns->pressure)))
+		return 0;
+
+	while (columns->ntanks < ntanks) {
+		double *pressure = (double *) malloc (columns->capacity * sizeof (*pressure));
+		if (pressure == NULL)
+			return 0;
+
+		// The tank is not present in the previous samples.
+		for (unsigned int i = 0; i < columns->nsamples; ++i)
+			pressure[i] = NAN;
+
+		columns->pressure[columns->ntanks++] = pressure;
+	}
+
+	return 1;
+}
+
+static void
+sample_set_cb (dc_sample_type_t type, dc_sample_value_t value, void *userdata)
+{
+	dc_sample_set_t *set = (dc_sample_set_t *) userdata;
+	dc_sample_columns_t *columns = &set->columns;
+
+	// Make room for the value, before it is stored in the columns.
+	switch (type) {
+	case DC_SAMPLE_TIME:
+		if (columns->nsamples >= columns->capacity && set->status == DC_STATUS_SUCCESS) {
+			unsigned int capacity = columns->capacity ? columns->capacity * 2 : MINCAPACITY;
+			if (!sample_set_grow (set, capacity))
+				set->status = DC_STATUS_NOMEMORY;
+		}
+		if (columns->nsamples < columns->capacity) {
+			set->deco_type[columns->nsamples] = DC_SAMPLE_SET_UNKNOWN;
+			set->deco_time[columns->nsamples] = DC_SAMPLE_SET_UNKNOWN;
+			set->deco_depth[columns->nsamples] = NAN;
+		}
+		break;
+	case DC_SAMPLE_PRESSURE:
+		// A value before the first sample is discarded.
+		if (columns->nsamples == 0 || value.pressure.tank >= MAXTANKS)
+			break;
+		if (value.pressure.tank >= columns->ntanks && set->status == DC_STATUS_SUCCESS) {
+			if (!sample_set_add_tanks (set, value.pressure.tank + 1))
+				set->status = DC_STATUS_NOMEMORY;
+		}
+		if (value.pressure.tank < columns->ntanks && value.pressure.tank >= set->ntanks)
+			set->ntanks = value.pressure.tank + 1;
+		break;
+	case DC_SAMPLE_EVENT:
+		if (value.event.type == SAMPLE_EVENT_GASCHANGE ||
+			value.event.type == SAMPLE_EVENT_GASCHANGE2)
+			break;
+		if (columns->nevents >= columns->maxevents && set->status == DC_STATUS_SUCCESS) {
+			unsigned int maxevents = columns->maxevents ? columns->maxevents * 2 : MINEVENTS;
+			if (sample_set_realloc ((void **) &columns->events, maxevents, sizeof (*columns->events)))
+				columns->maxevents = maxevents;
+			else
+				set->status = DC_STATUS_NOMEMORY;
+		}
+		break;
+	case DC_SAMPLE_DECO:
+		if (columns->nsamples && columns->nsamples - 1 < columns->capacity) {
+			set->deco_type[columns->nsamples - 1] = value.deco.type;
+			set->deco_time[columns->nsamples - 1] = value.deco.time;
+			set->deco_depth[columns->nsamples - 1] = value.deco.depth;
+		}
+		break;
+	default:
+		break;
+	}
+
+	sample_columns_cb (type, value, columns);
+}
+
+dc_status_t
+dc_sample_set_new (dc_sample_set_t **out)
+{
+	dc_sample_set_t *set = NULL;
+
+	if (out == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	set = (dc_sample_set_t *) malloc (sizeof (dc_sample_set_t));
+	if (set == NULL)
+		return DC_STATUS_NOMEMORY;
+
+	set->columns.capacity = 0;
+	set->columns.time = NULL;
+	set->columns.depth = NULL;
+	set->columns.temperature = NULL;
+	set->columns.gasmix = NULL;
+	set->columns.ntanks = 0;
+	set->columns.pressure = NULL;
+	set->columns.maxevents = 0;
+	set->columns.events = NULL;
+	set->columns.nsamples = 0;
+	set->columns.nevents = 0;
+	set->deco_type = NULL;
+	set->deco_time = NULL;
+	set->deco_depth = NULL;
+	set->ntanks = 0;
+	set->status = DC_STATUS_SUCCESS;
+
+	*out = set;
+
+	return DC_STATUS_SUCCESS;
+}
+
+void
+dc_sample_set_free (dc_sample_set_t *set)
+{
+	if (set == NULL)
+		return;
+
+	for (unsigned int i = 0; i < set->columns.ntanks; ++i)
+		free (set->columns.pressure[i]);
+	free (set->columns.pressure);
+	free (set->columns.time);
+	free (set->columns.depth);
+	free (set->columns.temperature);
+	free (set->columns.gasmix);
+	free (set->columns.events);
+	free (set->deco_type);
+	free (set->deco_time);
+	free (set->deco_depth);
+	free (set);
+}
+
+void
+dc_sample_set_reset (dc_sample_set_t *set)
+{
+	if (set == NULL)
+		return;
+
+	set->columns.nsamples = 0;
+	set->columns.nevents = 0;
+	set->ntanks = 0;
+	set->status = DC_STATUS_SUCCESS;
+}
+
+unsigned int
+dc_sample_set_get_count (const dc_sample_set_t *set)
+{
+	if (set == NULL)
+		return 0;
+
+	// After a failed allocation, only the stored samples are available.
+	if (set->columns.nsamples > set->columns.capacity)
+		return set->columns.capacity;
+
+	return set->columns.nsamples;
+}
+
+unsigned int
+dc_sample_set_get_ntanks (const dc_sample_set_t *set)
+{
+	if (set == NULL)
+		return 0;
+
+	return set->ntanks;
+}
+
+const void *
+dc_sample_set_get_column (const dc_sample_set_t *set, dc_sample_column_t column, unsigned int tank)
+{
+	if (set == NULL)
+		return NULL;
+
+	switch (column) {
+	case DC_SAMPLE_COLUMN_TIME:
+		return set->columns.time;
+	case DC_SAMPLE_COLUMN_DEPTH:
+		return set->columns.depth;
+	case DC_SAMPLE_COLUMN_TEMPERATURE:
+		return set->columns.temperature;
+	case DC_SAMPLE_COLUMN_PRESSURE:
+		if (tank >= set->ntanks)
+			return NULL;
+		return set->columns.pressure[tank];
+	case DC_SAMPLE_COLUMN_GASMIX:
+		return set->columns.gasmix;
+	case DC_SAMPLE_COLUMN_DECO_TYPE:
+		return set->deco_type;
+	case DC_SAMPLE_COLUMN_DECO_TIME:
+		return set->deco_time;
+	case DC_SAMPLE_COLUMN_DECO_DEPTH:
+		return set->deco_depth;
+	default:
+		return NULL;
+	}
+}
+
+const dc_sample_event_t *
+dc_sample_set_get_events (const dc_sample_set_t *set, unsigned int *count)
+{
+	if (set == NULL) {
+		if (count)
+			*count = 0;
+		return NULL;
+	}
+
+	if (count) {
+		if (set->columns.nevents > set->columns.maxevents)
+			*count = set->columns.maxevents;
+		else
+			*count = set->columns.nevents;
+	}
+
+	return set->columns.events;
+}
+
+dc_status_t
+dc_parser_samples_extract_set (dc_parser_t *parser, dc_sample_set_t *set)
+{
+	if (parser == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (set == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_sample_set_reset (set);
+
+	dc_status_t rc = dc_parser_samples_foreach (parser, sample_set_cb, set);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	return set->status;
+}
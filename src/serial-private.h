@@ -0,0 +1,111 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_SERIAL_PRIVATE_H
+#define DC_SERIAL_PRIVATE_H
+
+#include "serial.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+typedef struct dc_serial_vtable_t dc_serial_vtable_t;
+
+struct dc_serial_t {
+	const dc_serial_vtable_t *vtable;
+	/* Library context. */
+	dc_context_t *context;
+	/* Cancellation support. */
+	dc_cancel_callback_t cancel_callback;
+	void *cancel_userdata;
+	/* Accumulated I/O time (microseconds). */
+	unsigned long long *iotime;
+};
+
+/*
+ * The I/O functions of a connection. The scatter/gather, poll and sleep
+ * functions are optional. The generic layer falls back to plain reads and
+ * writes when they are missing or return DC_STATUS_UNSUPPORTED, and to a
+ * plain sleep.
+ */
+struct dc_serial_vtable_t {
+	size_t size;
+
+	dc_status_t (*configure) (dc_serial_t *serial, unsigned int baudrate, unsigned int databits, dc_parity_t parity, dc_stopbits_t stopbits, dc_flowcontrol_t flowcontrol);
+
+	dc_status_t (*set_timeout) (dc_serial_t *serial, int timeout);
+
+	dc_status_t (*set_halfduplex) (dc_serial_t *serial, unsigned int value);
+
+	dc_status_t (*set_latency) (dc_serial_t *serial, unsigned int value);
+
+	dc_status_t (*read) (dc_serial_t *serial, void *data, size_t size, size_t *actual);
+
+	dc_status_t (*write) (dc_serial_t *serial, const void *data, size_t size, size_t *actual);
+
+	dc_status_t (*readv) (dc_serial_t *serial, const dc_iovec_t iov[], unsigned int count, size_t *actual);
+
+	dc_status_t (*writev) (dc_serial_t *serial, const dc_iovec_t iov[], unsigned int count, size_t *actual);
+
+	dc_status_t (*flush) (dc_serial_t *serial);
+
+	dc_status_t (*purge) (dc_serial_t *serial, dc_direction_t direction);
+
+	dc_status_t (*set_break) (dc_serial_t *serial, unsigned int value);
+
+	dc_status_t (*set_dtr) (dc_serial_t *serial, unsigned int value);
+
+	dc_status_t (*set_rts) (dc_serial_t *serial, unsigned int value);
+
+	dc_status_t (*get_available) (dc_serial_t *serial, size_t *value);
+
+	dc_status_t (*poll) (dc_serial_t *serial, int timeout);
+
+	dc_status_t (*get_lines) (dc_serial_t *serial, unsigned int *value);
+
+	dc_status_t (*sleep) (dc_serial_t *serial, unsigned int milliseconds);
+
+	dc_status_t (*close) (dc_serial_t *serial);
+};
+
+dc_serial_t *
+dc_serial_allocate (dc_context_t *context, const dc_serial_vtable_t *vtable);
+
+void
+dc_serial_deallocate (dc_serial_t *serial);
+
+int
+dc_serial_isinstance (dc_serial_t *serial, const dc_serial_vtable_t *vtable);
+
+int
+dc_serial_is_cancelled (dc_serial_t *serial);
+
+/*
+ * Sleep without logging, for the implementations that need to wait.
+ */
+dc_status_t
+dc_serial_msleep (unsigned int milliseconds);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_SERIAL_PRIVATE_H */
@@ -0,0 +1,422 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#define DC_LOG_CATEGORY DC_LOGCATEGORY_TRANSPORT
+
+#include <assert.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#define NOGDI
+#include <windows.h>
+#else
+#include <errno.h>
+#include <time.h>
+#endif
+
+#include "serial-private.h"
+#include "context-private.h"
+
+dc_serial_t *
+dc_serial_allocate (dc_context_t *context, const dc_serial_vtable_t *vtable)
+{
+	dc_serial_t *serial = NULL;
+
+	assert(vtable != NULL);
+	assert(vtable->size >= sizeof(dc_serial_t));
+
+	// Allocate memory.
+	serial = (dc_serial_t *) malloc (vtable->size);
+	if (serial == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return serial;
+	}
+
+	serial->vtable = vtable;
+	serial->context = context;
+	serial->cancel_callback = NULL;
+	serial->cancel_userdata = NULL;
+	serial->iotime = NULL;
+
+	return serial;
+}
+
+void
+dc_serial_deallocate (dc_serial_t *serial)
+{
+	free (serial);
+}
+
+int
+dc_serial_isinstance (dc_serial_t *serial, const dc_serial_vtable_t *vtable)
+{
+	if (serial == NULL)
+		return 0;
+
+	return serial->vtable == vtable;
+}
+
+int
+dc_serial_is_cancelled (dc_serial_t *serial)
+{
+	if (serial->cancel_callback == NULL)
+		return 0;
+
+	return serial->cancel_callback (serial->cancel_userdata);
+}
+
+dc_status_t
+dc_serial_msleep (unsigned int milliseconds)
+{
+#ifdef _WIN32
+	Sleep (milliseconds);
+#else
+	struct timespec ts;
+	ts.tv_sec  = (milliseconds / 1000);
+	ts.tv_nsec = (milliseconds % 1000) * 1000000;
+
+	while (nanosleep (&ts, &ts) != 0) {
+		if (errno != EINTR)
+			return DC_STATUS_IO;
+	}
+#endif
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_serial_close (dc_serial_t *serial)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (serial == NULL)
+		return DC_STATUS_SUCCESS;
+
+	if (serial->vtable->close) {
+		status = serial->vtable->close (serial);
+	}
+
+	dc_serial_deallocate (serial);
+
+	return status;
+}
+
+dc_status_t
+dc_serial_configure (dc_serial_t *serial, unsigned int baudrate, unsigned int databits, dc_parity_t parity, dc_stopbits_t stopbits, dc_flowcontrol_t flowcontrol)
+{
+	if (serial == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (serial->vtable->configure == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	return serial->vtable->configure (serial, baudrate, databits, parity, stopbits, flowcontrol);
+}
+
+dc_status_t
+dc_serial_set_timeout (dc_serial_t *serial, int timeout)
+{
+	if (serial == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (serial->vtable->set_timeout == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	return serial->vtable->set_timeout (serial, timeout);
+}
+
+dc_status_t
+dc_serial_set_cancel (dc_serial_t *serial, dc_cancel_callback_t callback, void *userdata)
+{
+	if (serial == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	serial->cancel_callback = callback;
+	serial->cancel_userdata = userdata;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_serial_set_iotime (dc_serial_t *serial, unsigned long long *iotime)
+{
+	if (serial == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	serial->iotime = iotime;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static void
+dc_serial_account (dc_serial_t *serial, unsigned long long begin)
+{
+	if (serial->iotime)
+		*serial->iotime += dc_context_clock () - begin;
+}
+
+dc_status_t
+dc_serial_set_halfduplex (dc_serial_t *serial, unsigned int value)
+{
+	if (serial == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (serial->vtable->set_halfduplex == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	return serial->vtable->set_halfduplex (serial, value);
+}
+
+dc_status_t
+dc_serial_set_latency (dc_serial_t *serial, unsigned int value)
+{
+	if (serial == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (serial->vtable->set_latency == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	return serial->vtable->set_latency (serial, value);
+}
+
+dc_status_t
+dc_serial_read (dc_serial_t *serial, void *data, size_t size, size_t *actual)
+{
+	if (serial == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (serial->vtable->read == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (serial->iotime == NULL)
+		return serial->vtable->read (serial, data, size, actual);
+
+	unsigned long long begin = dc_context_clock ();
+	dc_status_t status = serial->vtable->read (serial, data, size, actual);
+	dc_serial_account (serial, begin);
+
+	return status;
+}
+
+dc_status_t
+dc_serial_write (dc_serial_t *serial, const void *data, size_t size, size_t *actual)
+{
+	if (serial == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (serial->vtable->write == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (serial->iotime == NULL)
+		return serial->vtable->write (serial, data, size, actual);
+
+	unsigned long long begin = dc_context_clock ();
+	dc_status_t status = serial->vtable->write (serial, data, size, actual);
+	dc_serial_account (serial, begin);
+
+	return status;
+}
+
+dc_status_t
+dc_serial_readv (dc_serial_t *serial, const dc_iovec_t iov[], unsigned int count, size_t *actual)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	size_t nbytes = 0;
+
+	if (serial == NULL || (iov == NULL && count))
+		return DC_STATUS_INVALIDARGS;
+
+	if (serial->vtable->readv) {
+		unsigned long long begin = dc_context_clock ();
+		status = serial->vtable->readv (serial, iov, count, actual);
+		dc_serial_account (serial, begin);
+		if (status != DC_STATUS_UNSUPPORTED)
+			return status;
+		status = DC_STATUS_SUCCESS;
+	}
+
+	// Fill the buffers one by one, until a read comes up short.
+	for (unsigned int i = 0; i < count; ++i) {
+		size_t n = 0;
+		status = dc_serial_read (serial, iov[i].data, iov[i].size, &n);
+		nbytes += n;
+		if (status != DC_STATUS_SUCCESS)
+			break;
+	}
+
+	if (actual)
+		*actual = nbytes;
+
+	return status;
+}
+
+dc_status_t
+dc_serial_writev (dc_serial_t *serial, const dc_iovec_t iov[], unsigned int count, size_t *actual)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	size_t nbytes = 0;
+
+	if (serial == NULL || (iov == NULL && count))
+		return DC_STATUS_INVALIDARGS;
+
+	if (serial->vtable->writev) {
+		unsigned long long begin = dc_context_clock ();
+		status = serial->vtable->writev (serial, iov, count, actual);
+		dc_serial_account (serial, begin);
+		if (status != DC_STATUS_UNSUPPORTED)
+			return status;
+		status = DC_STATUS_SUCCESS;
+	}
+
+	for (unsigned int i = 0; i < count; ++i) {
+		size_t n = 0;
+		status = dc_serial_write (serial, iov[i].data, iov[i].size, &n);
+		nbytes += n;
+		if (status != DC_STATUS_SUCCESS)
+			break;
+	}
+
+	if (actual)
+		*actual = nbytes;
+
+	return status;
+}
+
+dc_status_t
+dc_serial_flush (dc_serial_t *serial)
+{
+	if (serial == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (serial->vtable->flush == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	return serial->vtable->flush (serial);
+}
+
+dc_status_t
+dc_serial_purge (dc_serial_t *serial, dc_direction_t direction)
+{
+	if (serial == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (serial->vtable->purge == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	return serial->vtable->purge (serial, direction);
+}
+
+dc_status_t
+dc_serial_set_break (dc_serial_t *serial, unsigned int value)
+{
+	if (serial == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (serial->vtable->set_break == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	return serial->vtable->set_break (serial, value);
+}
+
+dc_status_t
+dc_serial_set_dtr (dc_serial_t *serial, unsigned int value)
+{
+	if (serial == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (serial->vtable->set_dtr == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	return serial->vtable->set_dtr (serial, value);
+}
+
+dc_status_t
+dc_serial_set_rts (dc_serial_t *serial, unsigned int value)
+{
+	if (serial == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (serial->vtable->set_rts == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	return serial->vtable->set_rts (serial, value);
+}
+
+dc_status_t
+dc_serial_get_available (dc_serial_t *serial, size_t *value)
+{
+	if (serial == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (serial->vtable->get_available == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	return serial->vtable->get_available (serial, value);
+}
+
+dc_status_t
+dc_serial_poll (dc_serial_t *serial, int timeout)
+{
+	if (serial == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	// Without a poll function, report the data as available, and let the
+	// next read wait for it instead.
+	if (serial->vtable->poll == NULL)
+		return DC_STATUS_SUCCESS;
+
+	unsigned long long begin = dc_context_clock ();
+	dc_status_t status = serial->vtable->poll (serial, timeout);
+	dc_serial_account (serial, begin);
+
+	return status;
+}
+
+dc_status_t
+dc_serial_get_lines (dc_serial_t *serial, unsigned int *value)
+{
+	if (serial == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (serial->vtable->get_lines == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	return serial->vtable->get_lines (serial, value);
+}
+
+dc_status_t
+dc_serial_sleep (dc_serial_t *serial, unsigned int milliseconds)
+{
+	if (serial == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	unsigned long long begin = dc_context_clock ();
+	dc_status_t status = DC_STATUS_SUCCESS;
+	if (serial->vtable->sleep) {
+		status = serial->vtable->sleep (serial, milliseconds);
+	} else {
+		INFO (serial->context, "Sleep: value=%u", milliseconds);
+		status = dc_serial_msleep (milliseconds);
+	}
+	dc_serial_account (serial, begin);
+
+	return status;
+}
@@ -24,6 +24,8 @@
 
 #include <libdivecomputer/common.h>
 #include <libdivecomputer/context.h>
+#include <libdivecomputer/device.h>
+#include <libdivecomputer/custom.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -63,15 +65,6 @@ typedef enum dc_flowcontrol_t {
 	DC_FLOWCONTROL_SOFTWARE  /**< Software (XON/XOFF) flow control */
 } dc_flowcontrol_t;
 
-/**
- * The direction of the data transmission.
- */
-typedef enum dc_direction_t {
-	DC_DIRECTION_INPUT = 0x01,  /**< Input direction */
-	DC_DIRECTION_OUTPUT = 0x02, /**< Output direction */
-	DC_DIRECTION_ALL = DC_DIRECTION_INPUT | DC_DIRECTION_OUTPUT /**< All directions */
-} dc_direction_t;
-
 /**
  * The serial line signals.
  */
@@ -82,6 +75,16 @@ typedef enum dc_line_t {
 	DC_LINE_RNG = 0x08, /**< Ring indicator */
 } dc_line_t;
 
+/**
+ * The half duplex modes.
+ */
+typedef enum dc_halfduplex_t {
+	DC_HALFDUPLEX_NONE = 0,  /**< Full duplex */
+	DC_HALFDUPLEX_TIMED = 1, /**< Wait for the estimated transmit time */
+	DC_HALFDUPLEX_DRAIN = 2, /**< Wait until the driver reports the data as sent */
+	DC_HALFDUPLEX_RS485 = 3  /**< Hardware RS485 mode, with RTS during transmit */
+} dc_halfduplex_t;
+
 /**
  * Serial enumeration callback.
  *
@@ -113,6 +116,63 @@ dc_serial_enumerate (dc_serial_callback_t callback, void *userdata);
 dc_status_t
 dc_serial_open (dc_serial_t **serial, dc_context_t *context, const char *name);
 
+/**
+ * Open a virtual serial connection, which replays a transcript.
+ *
+ * All data returned by the read operations is taken from the
+ * transcript, and the data passed to the write operations is compared
+ * against it. The line settings, timeouts and delays are ignored, such
+ * that the transfer runs at full speed without any real I/O.
+ *
+ * @param[out]  serial    A location to store the serial connection.
+ * @param[in]   context   A valid context object.
+ * @param[in]   filename  The name of the transcript file.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_serial_replay_open (dc_serial_t **serial, dc_context_t *context, const char *filename);
+
+/**
+ * Open a virtual serial connection, which emulates a dive computer.
+ *
+ * The emulated device answers the requests of the backend for the given
+ * descriptor with data from the memory image, which is a dump of the
+ * entire memory of the device. The answers are available immediately,
+ * and the line settings, timeouts and delays are ignored. Only the
+ * Shearwater Predator protocol is emulated at the moment.
+ *
+ * @param[out]  serial      A location to store the serial connection.
+ * @param[in]   context     A valid context object.
+ * @param[in]   descriptor  The descriptor of the emulated device.
+ * @param[in]   data        The memory image.
+ * @param[in]   size        The size of the memory image.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_serial_emulator_open (dc_serial_t **serial, dc_context_t *context, dc_descriptor_t *descriptor, const unsigned char data[], unsigned int size);
+
+/**
+ * Open a serial connection over the network, to a serial port server
+ * like ser2net.
+ *
+ * The url is either "tcp://host:port" for a raw connection, which uses
+ * the line settings of the server, or "rfc2217://host:port" for a telnet
+ * connection with com port control (RFC 2217), which applies the line
+ * settings and control lines remotely. The names passed to
+ * dc_serial_open are recognized too, so every backend can be used
+ * remotely.
+ *
+ * @param[out]  serial   A location to store the serial connection.
+ * @param[in]   context  A valid context object.
+ * @param[in]   url      The url of the server.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_serial_tcp_open (dc_serial_t **serial, dc_context_t *context, const char *url);
+
 /**
  * Close the serial connection and free all resources.
  *
@@ -170,10 +230,43 @@ dc_status_t
 dc_serial_set_timeout (dc_serial_t *serial, int timeout);
 
 /**
- * Set the state of the half duplex emulation.
+ * Set the cancellation callback.
+ *
+ * While a read or poll is waiting for data, the callback is checked at
+ * least every 100 ms. When it returns a non-zero value, the wait is
+ * interrupted and #DC_STATUS_CANCELLED is returned.
+ *
+ * @param[in]  serial    A valid serial connection.
+ * @param[in]  callback  The cancellation callback, or NULL to disable.
+ * @param[in]  userdata  The user data pointer.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_serial_set_cancel (dc_serial_t *serial, dc_cancel_callback_t callback, void *userdata);
+
+/**
+ * Accumulate the time spent in the read, write, poll and sleep functions.
+ *
+ * @param[in]  serial  A valid serial connection.
+ * @param[in]  iotime  The counter (microseconds), or NULL to disable.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_serial_set_iotime (dc_serial_t *serial, unsigned long long *iotime);
+
+/**
+ * Set the half duplex mode.
+ *
+ * A write returns only after the data has been transmitted, so the
+ * line can be turned around immediately afterwards. The timed mode adds
+ * the estimated transmit time, because not all drivers wait until the
+ * data is really sent. The hardware RS485 mode falls back to the timed
+ * mode when the driver doesn't support it.
  *
  * @param[in]  serial  A valid serial connection.
- * @param[in]  value   The half duplex state.
+ * @param[in]  value   The half duplex mode (#dc_halfduplex_t).
  * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
  * on failure.
  */
@@ -224,6 +317,37 @@ dc_serial_read (dc_serial_t *serial, void *data, size_t size, size_t *actual);
 dc_status_t
 dc_serial_write (dc_serial_t *serial, const void *data, size_t size, size_t *actual);
 
+/**
+ * Read data into several buffers from the serial connection.
+ *
+ * The buffers are filled in order, as if a single read of the total size
+ * was done, but without copying the data afterwards.
+ *
+ * @param[in]  serial  A valid serial connection.
+ * @param[in]  iov     The memory buffers to store the data.
+ * @param[in]  count   The number of buffers.
+ * @param[out] actual  An (optional) location to store the actual
+ *                     number of bytes transferred.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_serial_readv (dc_serial_t *serial, const dc_iovec_t iov[], unsigned int count, size_t *actual);
+
+/**
+ * Write data from several buffers to the serial connection.
+ *
+ * @param[in]  serial  A valid serial connection.
+ * @param[in]  iov     The memory buffers to write the data from.
+ * @param[in]  count   The number of buffers.
+ * @param[out] actual  An (optional) location to store the actual
+ *                     number of bytes transferred.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_serial_writev (dc_serial_t *serial, const dc_iovec_t iov[], unsigned int count, size_t *actual);
+
 /**
  * Flush the internal output buffer and wait until the data has been
  * transmitted.
@@ -291,6 +415,22 @@ dc_serial_set_rts (dc_serial_t *serial, unsigned int value);
 dc_status_t
 dc_serial_get_available (dc_serial_t *serial, size_t *value);
 
+/**
+ * Wait until some data is available in the input buffer.
+ *
+ * This returns as soon as the first byte arrives, instead of sleeping
+ * for a fixed amount of time before reading the answer.
+ *
+ * @param[in]  serial   A valid serial connection.
+ * @param[in]  timeout  The timeout in milliseconds. A negative value
+ *                      waits forever, and zero only checks the input
+ *                      buffer without waiting.
+ * @returns #DC_STATUS_SUCCESS if data is available, #DC_STATUS_TIMEOUT
+ * if the timeout expired, or another #dc_status_t code on failure.
+ */
+dc_status_t
+dc_serial_poll (dc_serial_t *serial, int timeout);
+
 /**
  * Query the state of the line signals.
  *
@@ -0,0 +1,441 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#define DC_LOG_CATEGORY DC_LOGCATEGORY_TRANSPORT
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "serial-private.h"
+#include "common-private.h"
+#include "context-private.h"
+
+/* The ATT header of a notification or write. */
+#define ATT_HEADER 3
+
+/*
+ * The maximum time (in milliseconds) to wait for a notification, before
+ * checking the cancellation callback.
+ */
+#define SLICE 100
+
+/*
+ * The maximum time (in milliseconds) to wait for room in the transmit
+ * queue.
+ */
+#define FLOWCONTROL 1000
+
+typedef struct dc_serial_ble_t {
+	/* Base class. */
+	dc_serial_t base;
+	/* The GATT functions of the service. */
+	const dc_ble_io_t *io;
+	void *userdata;
+	int timeout;
+	/* The payload size of the packets. */
+	unsigned int payload;
+	/* The batched data, not sent yet. */
+	unsigned char tx[DC_BLE_MTU_MAXIMUM];
+	unsigned int txlen;
+	/* The last notification, not read completely yet. */
+	unsigned char rx[DC_BLE_MTU_MAXIMUM];
+	unsigned int rxpos;
+	unsigned int rxlen;
+} dc_serial_ble_t;
+
+static dc_status_t dc_serial_ble_configure (dc_serial_t *abstract, unsigned int baudrate, unsigned int databits, dc_parity_t parity, dc_stopbits_t stopbits, dc_flowcontrol_t flowcontrol);
+static dc_status_t dc_serial_ble_set_timeout (dc_serial_t *abstract, int timeout);
+static dc_status_t dc_serial_ble_set_value (dc_serial_t *abstract, unsigned int value);
+static dc_status_t dc_serial_ble_read (dc_serial_t *abstract, void *data, size_t size, size_t *actual);
+static dc_status_t dc_serial_ble_write (dc_serial_t *abstract, const void *data, size_t size, size_t *actual);
+static dc_status_t dc_serial_ble_flush (dc_serial_t *abstract);
+static dc_status_t dc_serial_ble_purge (dc_serial_t *abstract, dc_direction_t direction);
+static dc_status_t dc_serial_ble_get_available (dc_serial_t *abstract, size_t *value);
+static dc_status_t dc_serial_ble_poll (dc_serial_t *abstract, int timeout);
+static dc_status_t dc_serial_ble_get_lines (dc_serial_t *abstract, unsigned int *value);
+static dc_status_t dc_serial_ble_sleep (dc_serial_t *abstract, unsigned int milliseconds);
+static dc_status_t dc_serial_ble_close (dc_serial_t *abstract);
+
+static const dc_serial_vtable_t dc_serial_ble_vtable = {
+	sizeof(dc_serial_ble_t),
+	dc_serial_ble_configure, /* configure */
+	dc_serial_ble_set_timeout, /* set_timeout */
+	dc_serial_ble_set_value, /* set_halfduplex */
+	dc_serial_ble_set_value, /* set_latency */
+	dc_serial_ble_read, /* read */
+	dc_serial_ble_write, /* write */
+	NULL, /* readv */
+	NULL, /* writev */
+	dc_serial_ble_flush, /* flush */
+	dc_serial_ble_purge, /* purge */
+	dc_serial_ble_set_value, /* set_break */
+	dc_serial_ble_set_value, /* set_dtr */
+	dc_serial_ble_set_value, /* set_rts */
+	dc_serial_ble_get_available, /* get_available */
+	dc_serial_ble_poll, /* poll */
+	dc_serial_ble_get_lines, /* get_lines */
+	dc_serial_ble_sleep, /* sleep */
+	dc_serial_ble_close, /* close */
+};
+
+dc_status_t
+dc_serial_ble_open (dc_serial_t **out, dc_context_t *context, const dc_ble_io_t *io, void *userdata)
+{
+	if (out == NULL || io == NULL || io->read == NULL || io->write == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	// Allocate memory.
+	dc_serial_ble_t *device = (dc_serial_ble_t *) dc_serial_allocate (context, &dc_serial_ble_vtable);
+	if (device == NULL) {
+		return DC_STATUS_NOMEMORY;
+	}
+
+	device->io = io;
+	device->userdata = userdata;
+	device->timeout = -1;
+	device->txlen = 0;
+	device->rxpos = 0;
+	device->rxlen = 0;
+
+	// Negotiate the largest possible MTU. Every packet carries a three
+	// byte header, so small packets waste most of the connection events.
+	unsigned int mtu = DC_BLE_MTU_DEFAULT;
+	if (io->set_mtu) {
+		dc_status_t rc = io->set_mtu (userdata, DC_BLE_MTU_MAXIMUM, &mtu);
+		if (rc != DC_STATUS_SUCCESS) {
+			WARNING (context, "Failed to negotiate the MTU.");
+			mtu = DC_BLE_MTU_DEFAULT;
+		}
+	}
+	if (mtu < DC_BLE_MTU_DEFAULT)
+		mtu = DC_BLE_MTU_DEFAULT;
+	if (mtu > DC_BLE_MTU_MAXIMUM)
+		mtu = DC_BLE_MTU_MAXIMUM;
+	device->payload = mtu - ATT_HEADER;
+
+	INFO (context, "Open: ble, mtu=%u", mtu);
+
+	*out = (dc_serial_t *) device;
+
+	return DC_STATUS_SUCCESS;
+}
+
+/*
+ * Send the batched data. A full transmit queue is retried until it has
+ * room again.
+ */
+static dc_status_t
+dc_serial_ble_send (dc_serial_ble_t *device)
+{
+	if (device->txlen == 0)
+		return DC_STATUS_SUCCESS;
+
+	unsigned long long begin = dc_context_clock ();
+	while (1) {
+		dc_status_t rc = device->io->write (device->userdata, device->tx, device->txlen);
+		if (rc == DC_STATUS_SUCCESS)
+			break;
+		if (rc != DC_STATUS_TIMEOUT)
+			return rc;
+
+		if (dc_serial_is_cancelled (&device->base))
+			return DC_STATUS_CANCELLED;
+
+		if (dc_context_clock () - begin > FLOWCONTROL * 1000ULL) {
+			ERROR (device->base.context, "Transmit queue full.");
+			return DC_STATUS_TIMEOUT;
+		}
+
+		dc_serial_msleep (1);
+	}
+
+	device->txlen = 0;
+
+	return DC_STATUS_SUCCESS;
+}
+
+/*
+ * Wait for the next notification. The receive buffer must be empty.
+ */
+static dc_status_t
+dc_serial_ble_receive (dc_serial_ble_t *device, int timeout)
+{
+	unsigned long long begin = dc_context_clock ();
+	while (1) {
+		// Calculate the remaining timeout.
+		int remaining = timeout;
+		if (timeout > 0) {
+			unsigned long long elapsed = (dc_context_clock () - begin) / 1000;
+			remaining = elapsed < (unsigned int) timeout ? timeout - elapsed : 0;
+		}
+
+		// Wake up regularly to check for a cancellation.
+		int wait = remaining;
+		if (device->base.cancel_callback && (wait < 0 || wait > SLICE))
+			wait = SLICE;
+
+		size_t n = 0;
+		dc_status_t rc = device->io->read (device->userdata, device->rx, device->payload, &n, wait);
+		if (rc != DC_STATUS_SUCCESS && rc != DC_STATUS_TIMEOUT)
+			return rc;
+
+		if (rc == DC_STATUS_SUCCESS && n) {
+			device->rxpos = 0;
+			device->rxlen = n < device->payload ? n : device->payload;
+			return DC_STATUS_SUCCESS;
+		}
+
+		if (dc_serial_is_cancelled (&device->base))
+			return DC_STATUS_CANCELLED;
+
+		if (remaining >= 0 && wait == remaining)
+			return DC_STATUS_TIMEOUT;
+	}
+}
+
+static dc_status_t
+dc_serial_ble_close (dc_serial_t *abstract)
+{
+	dc_serial_ble_t *device = (dc_serial_ble_t *) abstract;
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	dc_status_set_error(&status, dc_serial_ble_send (device));
+
+	if (device->io->close) {
+		dc_status_set_error(&status, device->io->close (device->userdata));
+	}
+
+	return status;
+}
+
+static dc_status_t
+dc_serial_ble_configure (dc_serial_t *abstract, unsigned int baudrate, unsigned int databits, dc_parity_t parity, dc_stopbits_t stopbits, dc_flowcontrol_t flowcontrol)
+{
+	// The line settings do not apply to a bluetooth connection.
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_serial_ble_set_value (dc_serial_t *abstract, unsigned int value)
+{
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_serial_ble_set_timeout (dc_serial_t *abstract, int timeout)
+{
+	dc_serial_ble_t *device = (dc_serial_ble_t *) abstract;
+
+	INFO (abstract->context, "Timeout: value=%i", timeout);
+
+	device->timeout = timeout;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_serial_ble_read (dc_serial_t *abstract, void *data, size_t size, size_t *actual)
+{
+	dc_serial_ble_t *device = (dc_serial_ble_t *) abstract;
+	dc_status_t status = DC_STATUS_SUCCESS;
+	unsigned long long begin = 0;
+	size_t nbytes = 0;
+
+	if (dc_context_is_tracing (abstract->context))
+		begin = dc_context_clock ();
+
+	// The answer can only arrive after the batched data was sent.
+	status = dc_serial_ble_send (device);
+	if (status != DC_STATUS_SUCCESS)
+		goto out;
+
+	unsigned long long start = dc_context_clock ();
+	while (nbytes < size) {
+		if (device->rxpos == device->rxlen) {
+			// Calculate the remaining timeout.
+			int timeout = device->timeout;
+			if (timeout > 0) {
+				unsigned long long elapsed = (dc_context_clock () - start) / 1000;
+				timeout = elapsed < (unsigned int) device->timeout ? device->timeout - elapsed : 0;
+			}
+
+			status = dc_serial_ble_receive (device, timeout);
+			if (status == DC_STATUS_TIMEOUT)
+				break;
+			if (status != DC_STATUS_SUCCESS)
+				goto out;
+		}
+
+		size_t n = device->rxlen - device->rxpos;
+		if (n > size - nbytes)
+			n = size - nbytes;
+
+		memcpy ((unsigned char *) data + nbytes, device->rx + device->rxpos, n);
+		device->rxpos += n;
+		nbytes += n;
+	}
+
+	status = (nbytes == size) ? DC_STATUS_SUCCESS : DC_STATUS_TIMEOUT;
+
+out:
+	dc_context_trace (abstract->context, DC_TRACE_READ, status, begin, data, nbytes);
+
+	HEXDUMP (abstract->context, DC_LOGLEVEL_INFO, "Read", (unsigned char *) data, nbytes);
+
+	if (actual)
+		*actual = nbytes;
+
+	return status;
+}
+
+static dc_status_t
+dc_serial_ble_write (dc_serial_t *abstract, const void *data, size_t size, size_t *actual)
+{
+	dc_serial_ble_t *device = (dc_serial_ble_t *) abstract;
+	dc_status_t status = DC_STATUS_SUCCESS;
+	unsigned long long begin = 0;
+	size_t nbytes = 0;
+
+	if (dc_context_is_tracing (abstract->context))
+		begin = dc_context_clock ();
+
+	// Fill the packets completely. The last partial packet is kept, and
+	// sent together with the next write, or before the next read.
+	while (nbytes < size) {
+		size_t n = device->payload - device->txlen;
+		if (n > size - nbytes)
+			n = size - nbytes;
+
+		memcpy (device->tx + device->txlen, (const unsigned char *) data + nbytes, n);
+		device->txlen += n;
+		nbytes += n;
+
+		if (device->txlen == device->payload) {
+			status = dc_serial_ble_send (device);
+			if (status != DC_STATUS_SUCCESS) {
+				// The failed packet is lost.
+				nbytes = nbytes > device->txlen ? nbytes - device->txlen : 0;
+				device->txlen = 0;
+				break;
+			}
+		}
+	}
+
+	dc_context_trace (abstract->context, DC_TRACE_WRITE, status, begin, data, nbytes);
+
+	HEXDUMP (abstract->context, DC_LOGLEVEL_INFO, "Write", (const unsigned char *) data, nbytes);
+
+	if (actual)
+		*actual = nbytes;
+
+	return status;
+}
+
+static dc_status_t
+dc_serial_ble_flush (dc_serial_t *abstract)
+{
+	dc_serial_ble_t *device = (dc_serial_ble_t *) abstract;
+
+	return dc_serial_ble_send (device);
+}
+
+static dc_status_t
+dc_serial_ble_purge (dc_serial_t *abstract, dc_direction_t direction)
+{
+	dc_serial_ble_t *device = (dc_serial_ble_t *) abstract;
+
+	INFO (abstract->context, "Purge: direction=%u", direction);
+
+	if (direction & DC_DIRECTION_OUTPUT) {
+		device->txlen = 0;
+	}
+
+	if (direction & DC_DIRECTION_INPUT) {
+		// Discard the pending notifications too.
+		do {
+			device->rxpos = device->rxlen = 0;
+		} while (dc_serial_ble_receive (device, 0) == DC_STATUS_SUCCESS);
+		device->rxpos = device->rxlen = 0;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_serial_ble_get_available (dc_serial_t *abstract, size_t *value)
+{
+	dc_serial_ble_t *device = (dc_serial_ble_t *) abstract;
+
+	dc_status_t rc = dc_serial_ble_send (device);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	// Pick up a notification that already arrived.
+	if (device->rxpos == device->rxlen) {
+		rc = dc_serial_ble_receive (device, 0);
+		if (rc != DC_STATUS_SUCCESS && rc != DC_STATUS_TIMEOUT)
+			return rc;
+	}
+
+	if (value)
+		*value = device->rxlen - device->rxpos;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_serial_ble_poll (dc_serial_t *abstract, int timeout)
+{
+	dc_serial_ble_t *device = (dc_serial_ble_t *) abstract;
+
+	dc_status_t rc = dc_serial_ble_send (device);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	if (device->rxpos != device->rxlen)
+		return DC_STATUS_SUCCESS;
+
+	return dc_serial_ble_receive (device, timeout);
+}
+
+static dc_status_t
+dc_serial_ble_get_lines (dc_serial_t *abstract, unsigned int *value)
+{
+	if (value)
+		*value = 0;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_serial_ble_sleep (dc_serial_t *abstract, unsigned int milliseconds)
+{
+	dc_serial_ble_t *device = (dc_serial_ble_t *) abstract;
+
+	// The device can only react to data that was sent.
+	dc_status_t rc = dc_serial_ble_send (device);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	INFO (abstract->context, "Sleep: value=%u", milliseconds);
+
+	return dc_serial_msleep (milliseconds);
+}
@@ -0,0 +1,275 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#define DC_LOG_CATEGORY DC_LOGCATEGORY_TRANSPORT
+
+#include <stdlib.h>
+
+#include "serial-private.h"
+#include "common-private.h"
+#include "context-private.h"
+
+typedef struct dc_serial_custom_t {
+	/* Base class. */
+	dc_serial_t base;
+	/* The I/O functions of the transport. */
+	const dc_custom_io_t *io;
+	void *userdata;
+} dc_serial_custom_t;
+
+static dc_status_t dc_serial_custom_configure (dc_serial_t *abstract, unsigned int baudrate, unsigned int databits, dc_parity_t parity, dc_stopbits_t stopbits, dc_flowcontrol_t flowcontrol);
+static dc_status_t dc_serial_custom_set_timeout (dc_serial_t *abstract, int timeout);
+static dc_status_t dc_serial_custom_set_value (dc_serial_t *abstract, unsigned int value);
+static dc_status_t dc_serial_custom_read (dc_serial_t *abstract, void *data, size_t size, size_t *actual);
+static dc_status_t dc_serial_custom_write (dc_serial_t *abstract, const void *data, size_t size, size_t *actual);
+static dc_status_t dc_serial_custom_readv (dc_serial_t *abstract, const dc_iovec_t iov[], unsigned int count, size_t *actual);
+static dc_status_t dc_serial_custom_writev (dc_serial_t *abstract, const dc_iovec_t iov[], unsigned int count, size_t *actual);
+static dc_status_t dc_serial_custom_flush (dc_serial_t *abstract);
+static dc_status_t dc_serial_custom_purge (dc_serial_t *abstract, dc_direction_t direction);
+static dc_status_t dc_serial_custom_get_available (dc_serial_t *abstract, size_t *value);
+static dc_status_t dc_serial_custom_get_lines (dc_serial_t *abstract, unsigned int *value);
+static dc_status_t dc_serial_custom_close (dc_serial_t *abstract);
+
+static const dc_serial_vtable_t dc_serial_custom_vtable = {
+	sizeof(dc_serial_custom_t),
+	dc_serial_custom_configure, /* configure */
+	dc_serial_custom_set_timeout, /* set_timeout */
+	dc_serial_custom_set_value, /* set_halfduplex */
+	dc_serial_custom_set_value, /* set_latency */
+	dc_serial_custom_read, /* read */
+	dc_serial_custom_write, /* write */
+	dc_serial_custom_readv, /* readv */
+	dc_serial_custom_writev, /* writev */
+	dc_serial_custom_flush, /* flush */
+	dc_serial_custom_purge, /* purge */
+	dc_serial_custom_set_value, /* set_break */
+	dc_serial_custom_set_value, /* set_dtr */
+	dc_serial_custom_set_value, /* set_rts */
+	dc_serial_custom_get_available, /* get_available */
+	NULL, /* poll */
+	dc_serial_custom_get_lines, /* get_lines */
+	NULL, /* sleep */
+	dc_serial_custom_close, /* close */
+};
+
+dc_status_t
+dc_serial_custom_open (dc_serial_t **out, dc_context_t *context, const dc_custom_io_t *io, void *userdata)
+{
+	if (out == NULL || io == NULL || io->read == NULL || io->write == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	INFO (context, "Open: custom");
+
+	// Allocate memory.
+	dc_serial_custom_t *device = (dc_serial_custom_t *) dc_serial_allocate (context, &dc_serial_custom_vtable);
+	if (device == NULL) {
+		return DC_STATUS_NOMEMORY;
+	}
+
+	device->io = io;
+	device->userdata = userdata;
+
+	*out = (dc_serial_t *) device;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_serial_custom_close (dc_serial_t *abstract)
+{
+	dc_serial_custom_t *device = (dc_serial_custom_t *) abstract;
+
+	if (device->io->close == NULL)
+		return DC_STATUS_SUCCESS;
+
+	return device->io->close (device->userdata);
+}
+
+static dc_status_t
+dc_serial_custom_configure (dc_serial_t *abstract, unsigned int baudrate, unsigned int databits, dc_parity_t parity, dc_stopbits_t stopbits, dc_flowcontrol_t flowcontrol)
+{
+	// The line settings do not apply to a custom transport.
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_serial_custom_set_value (dc_serial_t *abstract, unsigned int value)
+{
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_serial_custom_set_timeout (dc_serial_t *abstract, int timeout)
+{
+	dc_serial_custom_t *device = (dc_serial_custom_t *) abstract;
+
+	INFO (abstract->context, "Timeout: value=%i", timeout);
+
+	if (device->io->set_timeout == NULL)
+		return DC_STATUS_SUCCESS;
+
+	return device->io->set_timeout (device->userdata, timeout);
+}
+
+static dc_status_t
+dc_serial_custom_read (dc_serial_t *abstract, void *data, size_t size, size_t *actual)
+{
+	dc_serial_custom_t *device = (dc_serial_custom_t *) abstract;
+	dc_status_t status = DC_STATUS_SUCCESS;
+	unsigned long long begin = 0;
+	size_t nbytes = 0;
+
+	if (dc_serial_is_cancelled (abstract)) {
+		status = DC_STATUS_CANCELLED;
+		goto out;
+	}
+
+	if (dc_context_is_tracing (abstract->context))
+		begin = dc_context_clock ();
+
+	status = device->io->read (device->userdata, data, size, &nbytes);
+
+	dc_context_trace (abstract->context, DC_TRACE_READ, status, begin, data, nbytes);
+
+out:
+	HEXDUMP (abstract->context, DC_LOGLEVEL_INFO, "Read", (unsigned char *) data, nbytes);
+
+	if (actual)
+		*actual = nbytes;
+
+	return status;
+}
+
+static dc_status_t
+dc_serial_custom_write (dc_serial_t *abstract, const void *data, size_t size, size_t *actual)
+{
+	dc_serial_custom_t *device = (dc_serial_custom_t *) abstract;
+	dc_status_t status = DC_STATUS_SUCCESS;
+	unsigned long long begin = 0;
+	size_t nbytes = 0;
+
+	if (dc_context_is_tracing (abstract->context))
+		begin = dc_context_clock ();
+
+	status = device->io->write (device->userdata, data, size, &nbytes);
+
+	dc_context_trace (abstract->context, DC_TRACE_WRITE, status, begin, data, nbytes);
+
+	HEXDUMP (abstract->context, DC_LOGLEVEL_INFO, "Write", (const unsigned char *) data, nbytes);
+
+	if (actual)
+		*actual = nbytes;
+
+	return status;
+}
+
+static dc_status_t
+dc_serial_custom_readv (dc_serial_t *abstract, const dc_iovec_t iov[], unsigned int count, size_t *actual)
+{
+	dc_serial_custom_t *device = (dc_serial_custom_t *) abstract;
+
+	// Fall back to the plain reads.
+	if (device->io->readv == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	if (dc_serial_is_cancelled (abstract))
+		return DC_STATUS_CANCELLED;
+
+	size_t nbytes = 0;
+	dc_status_t status = device->io->readv (device->userdata, iov, count, &nbytes);
+
+	// Dump the data that was received, buffer by buffer.
+	size_t remaining = nbytes;
+	for (unsigned int i = 0; i < count && remaining; ++i) {
+		size_t n = iov[i].size < remaining ? iov[i].size : remaining;
+		HEXDUMP (abstract->context, DC_LOGLEVEL_INFO, "Read", (unsigned char *) iov[i].data, n);
+		remaining -= n;
+	}
+
+	if (actual)
+		*actual = nbytes;
+
+	return status;
+}
+
+static dc_status_t
+dc_serial_custom_writev (dc_serial_t *abstract, const dc_iovec_t iov[], unsigned int count, size_t *actual)
+{
+	dc_serial_custom_t *device = (dc_serial_custom_t *) abstract;
+
+	// Fall back to the plain writes.
+	if (device->io->writev == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	size_t nbytes = 0;
+	dc_status_t status = device->io->writev (device->userdata, iov, count, &nbytes);
+
+	size_t remaining = nbytes;
+	for (unsigned int i = 0; i < count && remaining; ++i) {
+		size_t n = iov[i].size < remaining ? iov[i].size : remaining;
+		HEXDUMP (abstract->context, DC_LOGLEVEL_INFO, "Write", (unsigned char *) iov[i].data, n);
+		remaining -= n;
+	}
+
+	if (actual)
+		*actual = nbytes;
+
+	return status;
+}
+
+static dc_status_t
+dc_serial_custom_flush (dc_serial_t *abstract)
+{
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_serial_custom_purge (dc_serial_t *abstract, dc_direction_t direction)
+{
+	dc_serial_custom_t *device = (dc_serial_custom_t *) abstract;
+
+	INFO (abstract->context, "Purge: direction=%u", direction);
+
+	if (device->io->purge == NULL)
+		return DC_STATUS_SUCCESS;
+
+	return device->io->purge (device->userdata, direction);
+}
+
+static dc_status_t
+dc_serial_custom_get_available (dc_serial_t *abstract, size_t *value)
+{
+	dc_serial_custom_t *device = (dc_serial_custom_t *) abstract;
+
+	if (device->io->get_available == NULL)
+		return DC_STATUS_UNSUPPORTED;
+
+	return device->io->get_available (device->userdata, value);
+}
+
+static dc_status_t
+dc_serial_custom_get_lines (dc_serial_t *abstract, unsigned int *value)
+{
+	if (value)
+		*value = 0;
+
+	return DC_STATUS_SUCCESS;
+}
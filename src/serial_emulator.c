@@ -0,0 +1,489 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#define DC_LOG_CATEGORY DC_LOGCATEGORY_TRANSPORT
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include <libdivecomputer/buffer.h>
+#include <libdivecomputer/descriptor.h>
+
+#include "serial-private.h"
+#include "common-private.h"
+#include "context-private.h"
+#include "array.h"
+
+#ifdef _MSC_VER
+#define snprintf _snprintf
+#endif
+
+// SLIP special character codes
+#define END       0xC0
+#define ESC       0xDB
+#define ESC_END   0xDC
+#define ESC_ESC   0xDD
+
+#define SZ_PACKET 254
+
+typedef struct dc_serial_emulator_t dc_serial_emulator_t;
+
+typedef struct dc_emulator_backend_t {
+	dc_family_t type;
+	unsigned int size;
+	dc_status_t (*write) (dc_serial_emulator_t *emulator, const unsigned char data[], unsigned int size);
+} dc_emulator_backend_t;
+
+struct dc_serial_emulator_t {
+	/* Base class. */
+	dc_serial_t base;
+	/* The emulated device. */
+	const dc_emulator_backend_t *backend;
+	unsigned char *image;
+	unsigned int size;
+	/* The pending answers, and the partial request. */
+	dc_buffer_t *output;
+	unsigned int opos;
+	dc_buffer_t *input;
+	/* The active memory transfer. */
+	unsigned int address;
+	unsigned int length;
+	unsigned int block;
+	int transfer;
+};
+
+static dc_status_t dc_serial_emulator_configure (dc_serial_t *abstract, unsigned int baudrate, unsigned int databits, dc_parity_t parity, dc_stopbits_t stopbits, dc_flowcontrol_t flowcontrol);
+static dc_status_t dc_serial_emulator_set_value (dc_serial_t *abstract, unsigned int value);
+static dc_status_t dc_serial_emulator_set_timeout (dc_serial_t *abstract, int timeout);
+static dc_status_t dc_serial_emulator_read (dc_serial_t *abstract, void *data, size_t size, size_t *actual);
+static dc_status_t dc_serial_emulator_write (dc_serial_t *abstract, const void *data, size_t size, size_t *actual);
+static dc_status_t dc_serial_emulator_flush (dc_serial_t *abstract);
+static dc_status_t dc_serial_emulator_purge (dc_serial_t *abstract, dc_direction_t direction);
+static dc_status_t dc_serial_emulator_get_available (dc_serial_t *abstract, size_t *value);
+static dc_status_t dc_serial_emulator_poll (dc_serial_t *abstract, int timeout);
+static dc_status_t dc_serial_emulator_sleep (dc_serial_t *abstract, unsigned int milliseconds);
+static dc_status_t dc_serial_emulator_close (dc_serial_t *abstract);
+
+#ifdef ENABLE_BACKEND_SHEARWATER
+static dc_status_t shearwater_emulator_write (dc_serial_emulator_t *emulator, const unsigned char data[], unsigned int size);
+#endif
+
+static const dc_serial_vtable_t dc_serial_emulator_vtable = {
+	sizeof(dc_serial_emulator_t),
+	dc_serial_emulator_configure, /* configure */
+	dc_serial_emulator_set_timeout, /* set_timeout */
+	dc_serial_emulator_set_value, /* set_halfduplex */
+	dc_serial_emulator_set_value, /* set_latency */
+	dc_serial_emulator_read, /* read */
+	dc_serial_emulator_write, /* write */
+	NULL, /* readv */
+	NULL, /* writev */
+	dc_serial_emulator_flush, /* flush */
+	dc_serial_emulator_purge, /* purge */
+	dc_serial_emulator_set_value, /* set_break */
+	dc_serial_emulator_set_value, /* set_dtr */
+	dc_serial_emulator_set_value, /* set_rts */
+	dc_serial_emulator_get_available, /* get_available */
+	dc_serial_emulator_poll, /* poll */
+	NULL, /* get_lines */
+	dc_serial_emulator_sleep, /* sleep */
+	dc_serial_emulator_close, /* close */
+};
+
+static const dc_emulator_backend_t dc_emulator_backends[] = {
+#ifdef ENABLE_BACKEND_SHEARWATER
+	{DC_FAMILY_SHEARWATER_PREDATOR, 0x20080, shearwater_emulator_write},
+#endif
+	{DC_FAMILY_NULL, 0, NULL}
+};
+
+dc_status_t
+dc_serial_emulator_open (dc_serial_t **out, dc_context_t *context, dc_descriptor_t *descriptor, const unsigned char data[], unsigned int size)
+{
+	const dc_emulator_backend_t *backend = NULL;
+
+	if (out == NULL || descriptor == NULL || (data == NULL && size))
+		return DC_STATUS_INVALIDARGS;
+
+	dc_family_t type = dc_descriptor_get_type (descriptor);
+
+	INFO (context, "Emulator: family=%08x, size=%u", type, size);
+
+	// Find the emulated protocol.
+	for (unsigned int i = 0; dc_emulator_backends[i].write != NULL; ++i) {
+		if (dc_emulator_backends[i].type == type) {
+			backend = dc_emulator_backends + i;
+			break;
+		}
+	}
+	if (backend == NULL) {
+		ERROR (context, "No emulator available for this device.");
+		return DC_STATUS_UNSUPPORTED;
+	}
+
+	// The memory image is a dump of the entire device memory.
+	if (size != backend->size) {
+		ERROR (context, "Unexpected memory image size (%u).", size);
+		return DC_STATUS_DATAFORMAT;
+	}
+
+	// Allocate memory.
+	dc_serial_emulator_t *device = (dc_serial_emulator_t *) dc_serial_allocate (context, &dc_serial_emulator_vtable);
+	if (device == NULL) {
+		return DC_STATUS_NOMEMORY;
+	}
+
+	device->backend = backend;
+	device->size = size;
+	device->opos = 0;
+	device->address = 0;
+	device->length = 0;
+	device->block = 0;
+	device->transfer = 0;
+	device->image = (unsigned char *) malloc (size ? size : 1);
+	device->output = dc_buffer_new (0);
+	device->input = dc_buffer_new (0);
+	if (device->image == NULL || device->output == NULL || device->input == NULL) {
+		dc_serial_emulator_close ((dc_serial_t *) device);
+		dc_serial_deallocate ((dc_serial_t *) device);
+		return DC_STATUS_NOMEMORY;
+	}
+
+	if (size)
+		memcpy (device->image, data, size);
+
+	*out = (dc_serial_t *) device;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_serial_emulator_close (dc_serial_t *abstract)
+{
+	dc_serial_emulator_t *device = (dc_serial_emulator_t *) abstract;
+
+	dc_buffer_free (device->input);
+	dc_buffer_free (device->output);
+	free (device->image);
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_serial_emulator_configure (dc_serial_t *abstract, unsigned int baudrate, unsigned int databits, dc_parity_t parity, dc_stopbits_t stopbits, dc_flowcontrol_t flowcontrol)
+{
+	// The line settings do not apply to an emulated device.
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_serial_emulator_set_value (dc_serial_t *abstract, unsigned int value)
+{
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_serial_emulator_set_timeout (dc_serial_t *abstract, int timeout)
+{
+	INFO (abstract->context, "Timeout: value=%i", timeout);
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_serial_emulator_read (dc_serial_t *abstract, void *data, size_t size, size_t *actual)
+{
+	dc_serial_emulator_t *device = (dc_serial_emulator_t *) abstract;
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	// The emulated device answers every request immediately, so all the
+	// data that will ever arrive is already queued. Reading past the end
+	// of the queue is reported as a timeout, without actually waiting.
+	size_t available = dc_buffer_get_size (device->output) - device->opos;
+	size_t nbytes = size;
+	if (nbytes > available) {
+		nbytes = available;
+		status = DC_STATUS_TIMEOUT;
+	}
+
+	if (nbytes) {
+		memcpy (data, dc_buffer_get_data (device->output) + device->opos, nbytes);
+		device->opos += nbytes;
+	}
+
+	// Release the consumed data.
+	if (device->opos == dc_buffer_get_size (device->output)) {
+		dc_buffer_clear (device->output);
+		device->opos = 0;
+	}
+
+	HEXDUMP (abstract->context, DC_LOGLEVEL_INFO, "Read", (unsigned char *) data, nbytes);
+
+	if (actual)
+		*actual = nbytes;
+
+	return status;
+}
+
+static dc_status_t
+dc_serial_emulator_write (dc_serial_t *abstract, const void *data, size_t size, size_t *actual)
+{
+	dc_serial_emulator_t *device = (dc_serial_emulator_t *) abstract;
+
+	HEXDUMP (abstract->context, DC_LOGLEVEL_INFO, "Write", (const unsigned char *) data, size);
+
+	dc_status_t status = device->backend->write (device, (const unsigned char *) data, size);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	if (actual)
+		*actual = size;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_serial_emulator_flush (dc_serial_t *abstract)
+{
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_serial_emulator_purge (dc_serial_t *abstract, dc_direction_t direction)
+{
+	dc_serial_emulator_t *device = (dc_serial_emulator_t *) abstract;
+
+	INFO (abstract->context, "Purge: direction=%u", direction);
+
+	if (direction & DC_DIRECTION_INPUT) {
+		dc_buffer_clear (device->output);
+		device->opos = 0;
+	}
+
+	if (direction & DC_DIRECTION_OUTPUT) {
+		dc_buffer_clear (device->input);
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_serial_emulator_get_available (dc_serial_t *abstract, size_t *value)
+{
+	dc_serial_emulator_t *device = (dc_serial_emulator_t *) abstract;
+
+	if (value)
+		*value = dc_buffer_get_size (device->output) - device->opos;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_serial_emulator_poll (dc_serial_t *abstract, int timeout)
+{
+	dc_serial_emulator_t *device = (dc_serial_emulator_t *) abstract;
+
+	if (dc_buffer_get_size (device->output) == device->opos)
+		return DC_STATUS_TIMEOUT;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_serial_emulator_sleep (dc_serial_t *abstract, unsigned int milliseconds)
+{
+	// There is nothing to wait for, so the transfer runs at full speed.
+	INFO (abstract->context, "Sleep: value=%u", milliseconds);
+
+	return DC_STATUS_SUCCESS;
+}
+
+#ifdef ENABLE_BACKEND_SHEARWATER
+#define SHEARWATER_PREDATOR_BASE 0xDD000000
+#define SHEARWATER_BLOCK         (SZ_PACKET - 2)
+
+static dc_status_t
+shearwater_emulator_send (dc_serial_emulator_t *device, const unsigned char data[], unsigned int size)
+{
+	unsigned char header[] = {0x01, 0xFF, size + 1, 0x00};
+	const unsigned char end[] = {END};
+	const unsigned char esc_end[] = {ESC, ESC_END};
+	const unsigned char esc_esc[] = {ESC, ESC_ESC};
+
+	for (unsigned int i = 0; i < sizeof (header) + size; ++i) {
+		unsigned char c = i < sizeof (header) ? header[i] : data[i - sizeof (header)];
+		int success = 0;
+		if (c == END) {
+			success = dc_buffer_append (device->output, esc_end, sizeof (esc_end));
+		} else if (c == ESC) {
+			success = dc_buffer_append (device->output, esc_esc, sizeof (esc_esc));
+		} else {
+			success = dc_buffer_append (device->output, &c, 1);
+		}
+		if (!success)
+			return DC_STATUS_NOMEMORY;
+	}
+
+	if (!dc_buffer_append (device->output, end, sizeof (end)))
+		return DC_STATUS_NOMEMORY;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+shearwater_emulator_reject (dc_serial_emulator_t *device, unsigned char cmd, unsigned char code)
+{
+	const unsigned char response[] = {0x7F, cmd, code};
+
+	WARNING (device->base.context, "Rejected request (%02x).", cmd);
+
+	return shearwater_emulator_send (device, response, sizeof (response));
+}
+
+static dc_status_t
+shearwater_emulator_identifier (dc_serial_emulator_t *device, unsigned int id)
+{
+	unsigned char response[3 + 16] = {0x62, (id >> 8) & 0xFF, id & 0xFF};
+	int n = 0;
+
+	switch (id) {
+	case 0x8010:
+		// The serial number, as an hexadecimal string.
+		n = snprintf ((char *) response + 3, sizeof (response) - 3, "%08X",
+			array_uint32_le (device->image + 0x20002));
+		break;
+	case 0x8011:
+		// The firmware version, with a single byte prefix.
+		n = snprintf ((char *) response + 3, sizeof (response) - 3, "V%u",
+			device->image[0x2000A]);
+		break;
+	default:
+		return shearwater_emulator_reject (device, 0x22, 0x31);
+	}
+
+	return shearwater_emulator_send (device, response, 3 + n);
+}
+
+static dc_status_t
+shearwater_emulator_request (dc_serial_emulator_t *device, const unsigned char data[], unsigned int size)
+{
+	if (size < 1)
+		return DC_STATUS_SUCCESS;
+
+	unsigned char cmd = data[0];
+	if (cmd == 0x22 && size == 3) {
+		return shearwater_emulator_identifier (device, array_uint16_be (data + 1));
+	} else if (cmd == 0x35 && size == 10) {
+		unsigned int address = array_uint32_be (data + 3);
+		unsigned int length = array_uint24_be (data + 7);
+
+		// Only uncompressed transfers of the plain memory are available.
+		if (data[1] != 0x00 || address < SHEARWATER_PREDATOR_BASE ||
+			address - SHEARWATER_PREDATOR_BASE > device->size ||
+			length > device->size - (address - SHEARWATER_PREDATOR_BASE)) {
+			return shearwater_emulator_reject (device, cmd, 0x31);
+		}
+
+		device->address = address - SHEARWATER_PREDATOR_BASE;
+		device->length = length;
+		device->block = 1;
+		device->transfer = 1;
+
+		const unsigned char response[] = {0x75, 0x10, SHEARWATER_BLOCK};
+		return shearwater_emulator_send (device, response, sizeof (response));
+	} else if (cmd == 0x36 && size == 2) {
+		if (!device->transfer || data[1] != (device->block & 0xFF) || device->length == 0)
+			return shearwater_emulator_reject (device, cmd, 0x24);
+
+		unsigned int length = device->length;
+		if (length > SHEARWATER_BLOCK)
+			length = SHEARWATER_BLOCK;
+
+		unsigned char response[2 + SHEARWATER_BLOCK] = {0x76, data[1]};
+		memcpy (response + 2, device->image + device->address, length);
+		device->address += length;
+		device->length -= length;
+		device->block++;
+
+		return shearwater_emulator_send (device, response, 2 + length);
+	} else if (cmd == 0x37 && size == 1) {
+		device->transfer = 0;
+
+		const unsigned char response[] = {0x77, 0x00};
+		return shearwater_emulator_send (device, response, sizeof (response));
+	}
+
+	return shearwater_emulator_reject (device, cmd, 0x11);
+}
+
+static dc_status_t
+shearwater_emulator_write (dc_serial_emulator_t *device, const unsigned char data[], unsigned int size)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	for (unsigned int i = 0; i < size; ++i) {
+		if (data[i] != END) {
+			if (!dc_buffer_append (device->input, data + i, 1))
+				return DC_STATUS_NOMEMORY;
+			continue;
+		}
+
+		// Undo the escaping of the complete packet.
+		unsigned char *packet = dc_buffer_get_data (device->input);
+		unsigned int length = dc_buffer_get_size (device->input);
+		unsigned int n = 0;
+		for (unsigned int j = 0; j < length; ++j) {
+			unsigned char c = packet[j];
+			if (c == ESC && j + 1 < length) {
+				c = packet[++j];
+				if (c == ESC_END)
+					c = END;
+				else if (c == ESC_ESC)
+					c = ESC;
+			}
+			packet[n++] = c;
+		}
+
+		// Empty packets are ignored, like the real device does.
+		if (n) {
+			// Validate the packet header.
+			if (n < 4 || packet[0] != 0xFF || packet[1] != 0x01 ||
+				packet[3] != 0x00 || packet[2] != n - 3) {
+				WARNING (device->base.context, "Invalid request packet.");
+			} else {
+				status = shearwater_emulator_request (device, packet + 4, n - 4);
+			}
+		}
+
+		dc_buffer_clear (device->input);
+
+		if (status != DC_STATUS_SUCCESS)
+			return status;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+#endif
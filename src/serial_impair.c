@@ -0,0 +1,390 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#define DC_LOG_CATEGORY DC_LOGCATEGORY_TRANSPORT
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "serial-private.h"
+#include "common-private.h"
+#include "context-private.h"
+
+typedef struct dc_serial_impair_t {
+	/* Base class. */
+	dc_serial_t base;
+	/* The underlying connection. */
+	dc_serial_t *lower;
+	/* The simulated link. */
+	dc_impairment_t impairment;
+	unsigned int random;
+	int timeout;
+	/* Transmission time not slept yet (microseconds). */
+	unsigned long long debt;
+	/* Scratch buffer for the impaired writes. */
+	unsigned char *buffer;
+	size_t capacity;
+} dc_serial_impair_t;
+
+static dc_status_t dc_serial_impair_configure (dc_serial_t *abstract, unsigned int baudrate, unsigned int databits, dc_parity_t parity, dc_stopbits_t stopbits, dc_flowcontrol_t flowcontrol);
+static dc_status_t dc_serial_impair_set_timeout (dc_serial_t *abstract, int timeout);
+static dc_status_t dc_serial_impair_set_halfduplex (dc_serial_t *abstract, unsigned int value);
+static dc_status_t dc_serial_impair_set_latency (dc_serial_t *abstract, unsigned int value);
+static dc_status_t dc_serial_impair_read (dc_serial_t *abstract, void *data, size_t size, size_t *actual);
+static dc_status_t dc_serial_impair_write (dc_serial_t *abstract, const void *data, size_t size, size_t *actual);
+static dc_status_t dc_serial_impair_flush (dc_serial_t *abstract);
+static dc_status_t dc_serial_impair_purge (dc_serial_t *abstract, dc_direction_t direction);
+static dc_status_t dc_serial_impair_set_break (dc_serial_t *abstract, unsigned int value);
+static dc_status_t dc_serial_impair_set_dtr (dc_serial_t *abstract, unsigned int value);
+static dc_status_t dc_serial_impair_set_rts (dc_serial_t *abstract, unsigned int value);
+static dc_status_t dc_serial_impair_get_available (dc_serial_t *abstract, size_t *value);
+static dc_status_t dc_serial_impair_poll (dc_serial_t *abstract, int timeout);
+static dc_status_t dc_serial_impair_get_lines (dc_serial_t *abstract, unsigned int *value);
+static dc_status_t dc_serial_impair_sleep (dc_serial_t *abstract, unsigned int milliseconds);
+static dc_status_t dc_serial_impair_close (dc_serial_t *abstract);
+
+static const dc_serial_vtable_t dc_serial_impair_vtable = {
+	sizeof(dc_serial_impair_t),
+	dc_serial_impair_configure, /* configure */
+	dc_serial_impair_set_timeout, /* set_timeout */
+	dc_serial_impair_set_halfduplex, /* set_halfduplex */
+	dc_serial_impair_set_latency, /* set_latency */
+	dc_serial_impair_read, /* read */
+	dc_serial_impair_write, /* write */
+	NULL, /* readv */
+	NULL, /* writev */
+	dc_serial_impair_flush, /* flush */
+	dc_serial_impair_purge, /* purge */
+	dc_serial_impair_set_break, /* set_break */
+	dc_serial_impair_set_dtr, /* set_dtr */
+	dc_serial_impair_set_rts, /* set_rts */
+	dc_serial_impair_get_available, /* get_available */
+	dc_serial_impair_poll, /* poll */
+	dc_serial_impair_get_lines, /* get_lines */
+	dc_serial_impair_sleep, /* sleep */
+	dc_serial_impair_close, /* close */
+};
+
+dc_status_t
+dc_serial_impair_open (dc_serial_t **out, dc_context_t *context, dc_serial_t *lower, const dc_impairment_t *impairment)
+{
+	if (out == NULL || lower == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (impairment == NULL || impairment->drop > 1000000 || impairment->corrupt > 1000000) {
+		dc_serial_close (lower);
+		return DC_STATUS_INVALIDARGS;
+	}
+
+	INFO (context, "Impair: bandwidth=%u, latency=%u, jitter=%u, drop=%u, corrupt=%u, seed=%u",
+		impairment->bandwidth, impairment->latency, impairment->jitter,
+		impairment->drop, impairment->corrupt, impairment->seed);
+
+	// Allocate memory.
+	dc_serial_impair_t *device = (dc_serial_impair_t *) dc_serial_allocate (context, &dc_serial_impair_vtable);
+	if (device == NULL) {
+		dc_serial_close (lower);
+		return DC_STATUS_NOMEMORY;
+	}
+
+	device->lower = lower;
+	device->impairment = *impairment;
+	device->random = impairment->seed ? impairment->seed : 1;
+	device->timeout = -1;
+	device->debt = 0;
+	device->buffer = NULL;
+	device->capacity = 0;
+
+	*out = (dc_serial_t *) device;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static unsigned int
+dc_serial_impair_random (dc_serial_impair_t *device)
+{
+	// Xorshift generator, which is good enough for a simulation and
+	// produces the same sequence on every platform.
+	unsigned int x = device->random;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	device->random = x;
+
+	return x;
+}
+
+static int
+dc_serial_impair_chance (dc_serial_impair_t *device, unsigned int ppm)
+{
+	return ppm && dc_serial_impair_random (device) % 1000000 < ppm;
+}
+
+/*
+ * Apply the drops and the corruption to a block of data, in place, and
+ * return the number of remaining bytes.
+ */
+static size_t
+dc_serial_impair_apply (dc_serial_impair_t *device, unsigned char data[], size_t size)
+{
+	size_t n = 0;
+
+	if (device->impairment.drop == 0 && device->impairment.corrupt == 0)
+		return size;
+
+	for (size_t i = 0; i < size; ++i) {
+		if (dc_serial_impair_chance (device, device->impairment.drop))
+			continue;
+		unsigned char c = data[i];
+		if (dc_serial_impair_chance (device, device->impairment.corrupt))
+			c ^= 1 << (dc_serial_impair_random (device) % 8);
+		data[n++] = c;
+	}
+
+	return n;
+}
+
+/*
+ * Wait for the transmission of a number of bytes, with the limited
+ * bandwidth, plus an extra delay in milliseconds.
+ */
+static void
+dc_serial_impair_delay (dc_serial_impair_t *device, size_t size, unsigned int delay)
+{
+	if (device->impairment.bandwidth)
+		device->debt += (unsigned long long) size * 1000000 / device->impairment.bandwidth;
+	device->debt += (unsigned long long) delay * 1000;
+
+	// Sleep in whole milliseconds, and carry the remainder over to
+	// the next transfer.
+	if (device->debt >= 1000) {
+		dc_serial_msleep (device->debt / 1000);
+		device->debt %= 1000;
+	}
+}
+
+/*
+ * Wait for the remainder of the timeout, if the underlying connection
+ * gave up sooner, for example because it answers immediately.
+ */
+static void
+dc_serial_impair_expire (dc_serial_impair_t *device, int timeout, unsigned long long begin)
+{
+	if (timeout <= 0)
+		return;
+
+	unsigned long long elapsed = dc_context_clock () - begin;
+	if (elapsed < (unsigned long long) timeout * 1000)
+		dc_serial_msleep (timeout - elapsed / 1000);
+}
+
+static dc_status_t
+dc_serial_impair_close (dc_serial_t *abstract)
+{
+	dc_serial_impair_t *device = (dc_serial_impair_t *) abstract;
+
+	free (device->buffer);
+
+	return dc_serial_close (device->lower);
+}
+
+static dc_status_t
+dc_serial_impair_configure (dc_serial_t *abstract, unsigned int baudrate, unsigned int databits, dc_parity_t parity, dc_stopbits_t stopbits, dc_flowcontrol_t flowcontrol)
+{
+	dc_serial_impair_t *device = (dc_serial_impair_t *) abstract;
+
+	return dc_serial_configure (device->lower, baudrate, databits, parity, stopbits, flowcontrol);
+}
+
+static dc_status_t
+dc_serial_impair_set_timeout (dc_serial_t *abstract, int timeout)
+{
+	dc_serial_impair_t *device = (dc_serial_impair_t *) abstract;
+
+	dc_status_t status = dc_serial_set_timeout (device->lower, timeout);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	device->timeout = timeout;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_serial_impair_set_halfduplex (dc_serial_t *abstract, unsigned int value)
+{
+	dc_serial_impair_t *device = (dc_serial_impair_t *) abstract;
+
+	return dc_serial_set_halfduplex (device->lower, value);
+}
+
+static dc_status_t
+dc_serial_impair_set_latency (dc_serial_t *abstract, unsigned int value)
+{
+	dc_serial_impair_t *device = (dc_serial_impair_t *) abstract;
+
+	return dc_serial_set_latency (device->lower, value);
+}
+
+static dc_status_t
+dc_serial_impair_read (dc_serial_t *abstract, void *data, size_t size, size_t *actual)
+{
+	dc_serial_impair_t *device = (dc_serial_impair_t *) abstract;
+	dc_status_t status = DC_STATUS_SUCCESS;
+	unsigned char *p = (unsigned char *) data;
+	unsigned long long begin = dc_context_clock ();
+	size_t nbytes = 0;
+
+	// Keep reading until the dropped bytes are replaced, or the
+	// underlying connection runs out of data.
+	while (nbytes < size) {
+		size_t n = 0;
+		status = dc_serial_read (device->lower, p + nbytes, size - nbytes, &n);
+
+		dc_serial_impair_delay (device, n, 0);
+		nbytes += dc_serial_impair_apply (device, p + nbytes, n);
+
+		if (status != DC_STATUS_SUCCESS || n == 0)
+			break;
+	}
+
+	if (status == DC_STATUS_TIMEOUT)
+		dc_serial_impair_expire (device, device->timeout, begin);
+
+	if (actual)
+		*actual = nbytes;
+
+	return status;
+}
+
+static dc_status_t
+dc_serial_impair_write (dc_serial_t *abstract, const void *data, size_t size, size_t *actual)
+{
+	dc_serial_impair_t *device = (dc_serial_impair_t *) abstract;
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	// Make a copy of the data, to impair it without touching the
+	// buffer of the caller.
+	if (size > device->capacity) {
+		unsigned char *buffer = (unsigned char *) realloc (device->buffer, size);
+		if (buffer == NULL)
+			return DC_STATUS_NOMEMORY;
+		device->buffer = buffer;
+		device->capacity = size;
+	}
+
+	if (size)
+		memcpy (device->buffer, data, size);
+	size_t n = dc_serial_impair_apply (device, device->buffer, size);
+
+	unsigned int delay = device->impairment.latency;
+	if (device->impairment.jitter)
+		delay += dc_serial_impair_random (device) % (device->impairment.jitter + 1);
+	dc_serial_impair_delay (device, size, delay);
+
+	status = dc_serial_write (device->lower, device->buffer, n, NULL);
+	if (status != DC_STATUS_SUCCESS)
+		return status;
+
+	// The dropped bytes are lost on the link, without the sender being
+	// aware of it.
+	if (actual)
+		*actual = size;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_serial_impair_flush (dc_serial_t *abstract)
+{
+	dc_serial_impair_t *device = (dc_serial_impair_t *) abstract;
+
+	return dc_serial_flush (device->lower);
+}
+
+static dc_status_t
+dc_serial_impair_purge (dc_serial_t *abstract, dc_direction_t direction)
+{
+	dc_serial_impair_t *device = (dc_serial_impair_t *) abstract;
+
+	return dc_serial_purge (device->lower, direction);
+}
+
+static dc_status_t
+dc_serial_impair_set_break (dc_serial_t *abstract, unsigned int value)
+{
+	dc_serial_impair_t *device = (dc_serial_impair_t *) abstract;
+
+	return dc_serial_set_break (device->lower, value);
+}
+
+static dc_status_t
+dc_serial_impair_set_dtr (dc_serial_t *abstract, unsigned int value)
+{
+	dc_serial_impair_t *device = (dc_serial_impair_t *) abstract;
+
+	return dc_serial_set_dtr (device->lower, value);
+}
+
+static dc_status_t
+dc_serial_impair_set_rts (dc_serial_t *abstract, unsigned int value)
+{
+	dc_serial_impair_t *device = (dc_serial_impair_t *) abstract;
+
+	return dc_serial_set_rts (device->lower, value);
+}
+
+static dc_status_t
+dc_serial_impair_get_available (dc_serial_t *abstract, size_t *value)
+{
+	dc_serial_impair_t *device = (dc_serial_impair_t *) abstract;
+
+	return dc_serial_get_available (device->lower, value);
+}
+
+static dc_status_t
+dc_serial_impair_poll (dc_serial_t *abstract, int timeout)
+{
+	dc_serial_impair_t *device = (dc_serial_impair_t *) abstract;
+	unsigned long long begin = dc_context_clock ();
+
+	dc_status_t status = dc_serial_poll (device->lower, timeout);
+	if (status == DC_STATUS_TIMEOUT)
+		dc_serial_impair_expire (device, timeout, begin);
+
+	return status;
+}
+
+static dc_status_t
+dc_serial_impair_get_lines (dc_serial_t *abstract, unsigned int *value)
+{
+	dc_serial_impair_t *device = (dc_serial_impair_t *) abstract;
+
+	return dc_serial_get_lines (device->lower, value);
+}
+
+static dc_status_t
+dc_serial_impair_sleep (dc_serial_t *abstract, unsigned int milliseconds)
+{
+	dc_serial_impair_t *device = (dc_serial_impair_t *) abstract;
+
+	return dc_serial_sleep (device->lower, milliseconds);
+}
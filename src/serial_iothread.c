@@ -0,0 +1,482 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#define DC_LOG_CATEGORY DC_LOGCATEGORY_TRANSPORT
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "serial-private.h"
+#include "common-private.h"
+#include "context-private.h"
+#include "thread.h"
+
+/* The default size of the receive buffer. */
+#define CAPACITY 0x10000
+#define MAXCAPACITY 0x1000000
+
+/* The interval (in milliseconds) to check for new data, or free space. */
+#define INTERVAL 1
+
+/* The maximum time (in milliseconds) the I/O thread waits for new data,
+ * before checking whether it should stop. */
+#define POLLTIME 10
+
+typedef struct dc_serial_iothread_t {
+	/* Base class. */
+	dc_serial_t base;
+	/* The underlying connection. */
+	dc_serial_t *lower;
+	dc_iothread_t options;
+	dc_thread_t *thread;
+	/* Serializes the reads of the I/O thread with a purge. */
+	dc_mutex_t *mutex;
+	/*
+	 * The receive buffer, with a single producer (the I/O thread) and a
+	 * single consumer (the caller). The head is only advanced by the
+	 * producer, and the tail by the consumer. Both are free running, and
+	 * the size of the buffer is a power of two.
+	 */
+	unsigned char *ring;
+	unsigned int mask;
+	/* Accessed atomically. */
+	unsigned int head, tail;
+	unsigned int quit;
+	unsigned int failed;
+	/* The error of the I/O thread, published by the failed flag. */
+	dc_status_t status;
+	int timeout;
+} dc_serial_iothread_t;
+
+static dc_status_t dc_serial_iothread_configure (dc_serial_t *abstract, unsigned int baudrate, unsigned int databits, dc_parity_t parity, dc_stopbits_t stopbits, dc_flowcontrol_t flowcontrol);
+static dc_status_t dc_serial_iothread_set_timeout (dc_serial_t *abstract, int timeout);
+static dc_status_t dc_serial_iothread_set_halfduplex (dc_serial_t *abstract, unsigned int value);
+static dc_status_t dc_serial_iothread_set_latency (dc_serial_t *abstract, unsigned int value);
+static dc_status_t dc_serial_iothread_read (dc_serial_t *abstract, void *data, size_t size, size_t *actual);
+static dc_status_t dc_serial_iothread_write (dc_serial_t *abstract, const void *data, size_t size, size_t *actual);
+static dc_status_t dc_serial_iothread_flush (dc_serial_t *abstract);
+static dc_status_t dc_serial_iothread_purge (dc_serial_t *abstract, dc_direction_t direction);
+static dc_status_t dc_serial_iothread_set_break (dc_serial_t *abstract, unsigned int value);
+static dc_status_t dc_serial_iothread_set_dtr (dc_serial_t *abstract, unsigned int value);
+static dc_status_t dc_serial_iothread_set_rts (dc_serial_t *abstract, unsigned int value);
+static dc_status_t dc_serial_iothread_get_available (dc_serial_t *abstract, size_t *value);
+static dc_status_t dc_serial_iothread_poll (dc_serial_t *abstract, int timeout);
+static dc_status_t dc_serial_iothread_get_lines (dc_serial_t *abstract, unsigned int *value);
+static dc_status_t dc_serial_iothread_sleep (dc_serial_t *abstract, unsigned int milliseconds);
+static dc_status_t dc_serial_iothread_close (dc_serial_t *abstract);
+
+static const dc_serial_vtable_t dc_serial_iothread_vtable = {
+	sizeof(dc_serial_iothread_t),
+	dc_serial_iothread_configure, /* configure */
+	dc_serial_iothread_set_timeout, /* set_timeout */
+	dc_serial_iothread_set_halfduplex, /* set_halfduplex */
+	dc_serial_iothread_set_latency, /* set_latency */
+	dc_serial_iothread_read, /* read */
+	dc_serial_iothread_write, /* write */
+	NULL, /* readv */
+	NULL, /* writev */
+	dc_serial_iothread_flush, /* flush */
+	dc_serial_iothread_purge, /* purge */
+	dc_serial_iothread_set_break, /* set_break */
+	dc_serial_iothread_set_dtr, /* set_dtr */
+	dc_serial_iothread_set_rts, /* set_rts */
+	dc_serial_iothread_get_available, /* get_available */
+	dc_serial_iothread_poll, /* poll */
+	dc_serial_iothread_get_lines, /* get_lines */
+	dc_serial_iothread_sleep, /* sleep */
+	dc_serial_iothread_close, /* close */
+};
+
+static void
+dc_serial_iothread_fail (dc_serial_iothread_t *device, dc_status_t status)
+{
+	ERROR (device->base.context, "The I/O thread failed to read the data (%i).", status);
+
+	device->status = status;
+	dc_atomic_store_release (&device->failed, 1);
+}
+
+/*
+ * The I/O thread, which moves the received data into the ring buffer as
+ * soon as it arrives, until it is asked to stop.
+ */
+static void
+dc_serial_iothread_run (void *userdata)
+{
+	dc_serial_iothread_t *device = (dc_serial_iothread_t *) userdata;
+	dc_context_t *context = device->base.context;
+	unsigned int size = device->mask + 1;
+
+	if (device->options.priority > 0 &&
+		dc_thread_set_priority (device->options.priority) != DC_STATUS_SUCCESS)
+		WARNING (context, "Failed to raise the priority of the I/O thread.");
+
+	if (device->options.cpu >= 0 &&
+		dc_thread_set_affinity (device->options.cpu) != DC_STATUS_SUCCESS)
+		WARNING (context, "Failed to bind the I/O thread to processor %i.", device->options.cpu);
+
+	while (!dc_atomic_load_acquire (&device->quit)) {
+		// Wait for new data, without holding the lock.
+		dc_status_t status = dc_serial_poll (device->lower, POLLTIME);
+		if (status == DC_STATUS_TIMEOUT)
+			continue;
+		if (status != DC_STATUS_SUCCESS) {
+			dc_serial_iothread_fail (device, status);
+			break;
+		}
+
+		// When the buffer is full, the data stays in the buffer of the
+		// underlying connection, until the caller catches up.
+		unsigned int head = device->head;
+		unsigned int used = head - dc_atomic_load_acquire (&device->tail);
+		if (used == size) {
+			dc_thread_sleep (INTERVAL);
+			continue;
+		}
+
+		// Read into the contiguous free space only. The remainder
+		// follows in the next iteration.
+		unsigned int offset = head & device->mask;
+		unsigned int length = size - used;
+		if (length > size - offset)
+			length = size - offset;
+
+		// The timeout of the underlying connection is zero, so the
+		// read returns immediately with the data already received.
+		size_t nbytes = 0;
+		dc_mutex_lock (device->mutex);
+		status = dc_serial_read (device->lower, device->ring + offset, length, &nbytes);
+		if (nbytes)
+			dc_atomic_store_release (&device->head, head + nbytes);
+		dc_mutex_unlock (device->mutex);
+		if (status != DC_STATUS_SUCCESS && status != DC_STATUS_TIMEOUT) {
+			dc_serial_iothread_fail (device, status);
+			break;
+		}
+
+		// Without a poll function, the underlying connection is checked
+		// at regular intervals instead.
+		if (nbytes == 0)
+			dc_thread_sleep (INTERVAL);
+	}
+}
+
+dc_status_t
+dc_serial_iothread_open (dc_serial_t **out, dc_context_t *context, dc_serial_t *lower, const dc_iothread_t *options)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (out == NULL || lower == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	if (options == NULL || options->capacity > MAXCAPACITY) {
+		dc_serial_close (lower);
+		return DC_STATUS_INVALIDARGS;
+	}
+
+	// The size of the buffer is rounded up to a power of two.
+	unsigned int capacity = 1;
+	while (capacity < (options->capacity ? options->capacity : CAPACITY))
+		capacity *= 2;
+
+	INFO (context, "I/O thread: priority=%i, cpu=%i, capacity=%u",
+		options->priority, options->cpu, capacity);
+
+	// Allocate memory.
+	dc_serial_iothread_t *device = (dc_serial_iothread_t *) dc_serial_allocate (context, &dc_serial_iothread_vtable);
+	if (device == NULL) {
+		dc_serial_close (lower);
+		return DC_STATUS_NOMEMORY;
+	}
+
+	device->lower = lower;
+	device->options = *options;
+	device->thread = NULL;
+	device->mutex = NULL;
+	device->mask = capacity - 1;
+	device->head = 0;
+	device->tail = 0;
+	device->quit = 0;
+	device->failed = 0;
+	device->status = DC_STATUS_SUCCESS;
+	device->timeout = -1;
+
+	device->ring = (unsigned char *) malloc (capacity);
+	if (device->ring == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		status = DC_STATUS_NOMEMORY;
+		goto error_free;
+	}
+
+	status = dc_mutex_new (&device->mutex);
+	if (status != DC_STATUS_SUCCESS)
+		goto error_free;
+
+	// The I/O thread never waits inside a read.
+	status = dc_serial_set_timeout (lower, 0);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (context, "Failed to set the timeout of the underlying connection.");
+		goto error_free;
+	}
+
+	status = dc_thread_new (&device->thread, dc_serial_iothread_run, device);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (context, "Failed to start the I/O thread.");
+		goto error_free;
+	}
+
+	*out = (dc_serial_t *) device;
+
+	return DC_STATUS_SUCCESS;
+
+error_free:
+	dc_mutex_free (device->mutex);
+	free (device->ring);
+	dc_serial_deallocate ((dc_serial_t *) device);
+	dc_serial_close (lower);
+	return status;
+}
+
+static dc_status_t
+dc_serial_iothread_close (dc_serial_t *abstract)
+{
+	dc_serial_iothread_t *device = (dc_serial_iothread_t *) abstract;
+
+	dc_atomic_store_release (&device->quit, 1);
+	dc_thread_join (device->thread);
+
+	dc_mutex_free (device->mutex);
+	free (device->ring);
+
+	return dc_serial_close (device->lower);
+}
+
+/*
+ * Take up to size bytes from the ring buffer, without waiting.
+ */
+static size_t
+dc_serial_iothread_take (dc_serial_iothread_t *device, unsigned char data[], size_t size)
+{
+	unsigned int tail = device->tail;
+	unsigned int available = dc_atomic_load_acquire (&device->head) - tail;
+	if (available == 0)
+		return 0;
+
+	size_t n = available < size ? available : size;
+	unsigned int offset = tail & device->mask;
+	size_t first = device->mask + 1 - offset;
+	if (first > n)
+		first = n;
+	memcpy (data, device->ring + offset, first);
+	memcpy (data + first, device->ring, n - first);
+
+	// Hand the space back to the I/O thread.
+	dc_atomic_store_release (&device->tail, tail + n);
+
+	return n;
+}
+
+/*
+ * Wait until new data is available, or the timeout (in milliseconds,
+ * counted from the begin time) expires. A negative timeout waits forever.
+ */
+static dc_status_t
+dc_serial_iothread_wait (dc_serial_iothread_t *device, int timeout, unsigned long long begin)
+{
+	while (1) {
+		// Check the flag before the buffer, such that the data received
+		// before a failure is never missed.
+		unsigned int failed = dc_atomic_load_acquire (&device->failed);
+
+		if (dc_atomic_load_acquire (&device->head) != device->tail)
+			return DC_STATUS_SUCCESS;
+
+		if (failed)
+			return device->status;
+
+		if (timeout == 0 || (timeout > 0 && dc_context_clock () - begin >= (unsigned long long) timeout * 1000))
+			return DC_STATUS_TIMEOUT;
+
+		if (dc_serial_is_cancelled ((dc_serial_t *) device))
+			return DC_STATUS_CANCELLED;
+
+		dc_thread_sleep (INTERVAL);
+	}
+}
+
+static dc_status_t
+dc_serial_iothread_read (dc_serial_t *abstract, void *data, size_t size, size_t *actual)
+{
+	dc_serial_iothread_t *device = (dc_serial_iothread_t *) abstract;
+	dc_status_t status = DC_STATUS_SUCCESS;
+	unsigned char *p = (unsigned char *) data;
+	unsigned long long begin = dc_context_clock ();
+	size_t nbytes = 0;
+
+	while (nbytes < size) {
+		nbytes += dc_serial_iothread_take (device, p + nbytes, size - nbytes);
+		if (nbytes == size)
+			break;
+
+		status = dc_serial_iothread_wait (device, device->timeout, begin);
+		if (status != DC_STATUS_SUCCESS)
+			break;
+	}
+
+	if (actual)
+		*actual = nbytes;
+
+	return status;
+}
+
+static dc_status_t
+dc_serial_iothread_poll (dc_serial_t *abstract, int timeout)
+{
+	dc_serial_iothread_t *device = (dc_serial_iothread_t *) abstract;
+
+	return dc_serial_iothread_wait (device, timeout, dc_context_clock ());
+}
+
+static dc_status_t
+dc_serial_iothread_get_available (dc_serial_t *abstract, size_t *value)
+{
+	dc_serial_iothread_t *device = (dc_serial_iothread_t *) abstract;
+
+	size_t available = dc_atomic_load_acquire (&device->head) - device->tail;
+
+	// Include the data the I/O thread did not pick up yet.
+	size_t pending = 0;
+	if (dc_serial_get_available (device->lower, &pending) == DC_STATUS_SUCCESS)
+		available += pending;
+
+	if (value)
+		*value = available;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_serial_iothread_purge (dc_serial_t *abstract, dc_direction_t direction)
+{
+	dc_serial_iothread_t *device = (dc_serial_iothread_t *) abstract;
+
+	// The lock ensures the I/O thread is not halfway a read, which would
+	// otherwise store old data after the purge.
+	dc_mutex_lock (device->mutex);
+	dc_status_t status = dc_serial_purge (device->lower, direction);
+	if (status == DC_STATUS_SUCCESS && (direction & DC_DIRECTION_INPUT))
+		dc_atomic_store_release (&device->tail, dc_atomic_load_acquire (&device->head));
+	dc_mutex_unlock (device->mutex);
+
+	return status;
+}
+
+static dc_status_t
+dc_serial_iothread_set_timeout (dc_serial_t *abstract, int timeout)
+{
+	dc_serial_iothread_t *device = (dc_serial_iothread_t *) abstract;
+
+	// The timeout only applies to the reads from the ring buffer. The
+	// underlying connection keeps its zero timeout.
+	device->timeout = timeout;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_serial_iothread_configure (dc_serial_t *abstract, unsigned int baudrate, unsigned int databits, dc_parity_t parity, dc_stopbits_t stopbits, dc_flowcontrol_t flowcontrol)
+{
+	dc_serial_iothread_t *device = (dc_serial_iothread_t *) abstract;
+
+	return dc_serial_configure (device->lower, baudrate, databits, parity, stopbits, flowcontrol);
+}
+
+static dc_status_t
+dc_serial_iothread_set_halfduplex (dc_serial_t *abstract, unsigned int value)
+{
+	dc_serial_iothread_t *device = (dc_serial_iothread_t *) abstract;
+
+	return dc_serial_set_halfduplex (device->lower, value);
+}
+
+static dc_status_t
+dc_serial_iothread_set_latency (dc_serial_t *abstract, unsigned int value)
+{
+	dc_serial_iothread_t *device = (dc_serial_iothread_t *) abstract;
+
+	return dc_serial_set_latency (device->lower, value);
+}
+
+static dc_status_t
+dc_serial_iothread_write (dc_serial_t *abstract, const void *data, size_t size, size_t *actual)
+{
+	dc_serial_iothread_t *device = (dc_serial_iothread_t *) abstract;
+
+	return dc_serial_write (device->lower, data, size, actual);
+}
+
+static dc_status_t
+dc_serial_iothread_flush (dc_serial_t *abstract)
+{
+	dc_serial_iothread_t *device = (dc_serial_iothread_t *) abstract;
+
+	return dc_serial_flush (device->lower);
+}
+
+static dc_status_t
+dc_serial_iothread_set_break (dc_serial_t *abstract, unsigned int value)
+{
+	dc_serial_iothread_t *device = (dc_serial_iothread_t *) abstract;
+
+	return dc_serial_set_break (device->lower, value);
+}
+
+static dc_status_t
+dc_serial_iothread_set_dtr (dc_serial_t *abstract, unsigned int value)
+{
+	dc_serial_iothread_t *device = (dc_serial_iothread_t *) abstract;
+
+	return dc_serial_set_dtr (device->lower, value);
+}
+
+static dc_status_t
+dc_serial_iothread_set_rts (dc_serial_t *abstract, unsigned int value)
+{
+	dc_serial_iothread_t *device = (dc_serial_iothread_t *) abstract;
+
+	return dc_serial_set_rts (device->lower, value);
+}
+
+static dc_status_t
+dc_serial_iothread_get_lines (dc_serial_t *abstract, unsigned int *value)
+{
+	dc_serial_iothread_t *device = (dc_serial_iothread_t *) abstract;
+
+	return dc_serial_get_lines (device->lower, value);
+}
+
+static dc_status_t
+dc_serial_iothread_sleep (dc_serial_t *abstract, unsigned int milliseconds)
+{
+	dc_serial_iothread_t *device = (dc_serial_iothread_t *) abstract;
+
+	return dc_serial_sleep (device->lower, milliseconds);
+}
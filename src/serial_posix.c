@@ -19,6 +19,8 @@
  * MA 02110-1301 USA
  */
 
+#define DC_LOG_CATEGORY DC_LOGCATEGORY_TRANSPORT
+
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
@@ -47,19 +49,24 @@
 #define TIOCINQ FIONREAD
 #endif
 
+#if defined(TIOCGRS485) && defined(TIOCSRS485) && defined(SER_RS485_ENABLED)
+#define RS485
+#endif
+
 #ifdef ENABLE_PTY
 #define NOPTY (errno != EINVAL && errno != ENOTTY)
 #else
 #define NOPTY 1
 #endif
 
-#include "serial.h"
+#include "serial-private.h"
+#include "transcript.h"
 #include "common-private.h"
 #include "context-private.h"
 
-struct dc_serial_t {
-	/* Library context. */
-	dc_context_t *context;
+typedef struct dc_serial_posix_t {
+	/* Base class. */
+	dc_serial_t base;
 	/*
 	 * The file descriptor corresponding to the serial port.
 	 */
@@ -73,10 +80,82 @@ struct dc_serial_t {
 	struct termios tty;
 	/* Half-duplex settings */
 	int halfduplex;
+#ifdef RS485
+	/* The RS485 settings before the hardware mode was enabled. */
+	int rs485;
+	struct serial_rs485 rs485_saved;
+#endif
 	unsigned int baudrate;
 	unsigned int nbits;
+	/* Record and replay transcripts. */
+	dc_transcript_t *record;
+	dc_transcript_t *replay;
+} dc_serial_posix_t;
+
+static dc_status_t dc_serial_posix_configure (dc_serial_t *abstract, unsigned int baudrate, unsigned int databits, dc_parity_t parity, dc_stopbits_t stopbits, dc_flowcontrol_t flowcontrol);
+static dc_status_t dc_serial_posix_set_timeout (dc_serial_t *abstract, int timeout);
+static dc_status_t dc_serial_posix_set_halfduplex (dc_serial_t *abstract, unsigned int value);
+static dc_status_t dc_serial_posix_set_latency (dc_serial_t *abstract, unsigned int milliseconds);
+static dc_status_t dc_serial_posix_read (dc_serial_t *abstract, void *data, size_t size, size_t *actual);
+static dc_status_t dc_serial_posix_write (dc_serial_t *abstract, const void *data, size_t size, size_t *actual);
+static dc_status_t dc_serial_posix_flush (dc_serial_t *abstract);
+static dc_status_t dc_serial_posix_purge (dc_serial_t *abstract, dc_direction_t direction);
+static dc_status_t dc_serial_posix_set_break (dc_serial_t *abstract, unsigned int level);
+static dc_status_t dc_serial_posix_set_dtr (dc_serial_t *abstract, unsigned int level);
+static dc_status_t dc_serial_posix_set_rts (dc_serial_t *abstract, unsigned int level);
+static dc_status_t dc_serial_posix_get_available (dc_serial_t *abstract, size_t *value);
+static dc_status_t dc_serial_posix_poll (dc_serial_t *abstract, int timeout);
+static dc_status_t dc_serial_posix_get_lines (dc_serial_t *abstract, unsigned int *value);
+static dc_status_t dc_serial_posix_sleep (dc_serial_t *abstract, unsigned int timeout);
+static dc_status_t dc_serial_posix_close (dc_serial_t *abstract);
+
+static const dc_serial_vtable_t dc_serial_posix_vtable = {
+	sizeof(dc_serial_posix_t),
+	dc_serial_posix_configure, /* configure */
+	dc_serial_posix_set_timeout, /* set_timeout */
+	dc_serial_posix_set_halfduplex, /* set_halfduplex */
+	dc_serial_posix_set_latency, /* set_latency */
+	dc_serial_posix_read, /* read */
+	dc_serial_posix_write, /* write */
+	NULL, /* readv */
+	NULL, /* writev */
+	dc_serial_posix_flush, /* flush */
+	dc_serial_posix_purge, /* purge */
+	dc_serial_posix_set_break, /* set_break */
+	dc_serial_posix_set_dtr, /* set_dtr */
+	dc_serial_posix_set_rts, /* set_rts */
+	dc_serial_posix_get_available, /* get_available */
+	dc_serial_posix_poll, /* poll */
+	dc_serial_posix_get_lines, /* get_lines */
+	dc_serial_posix_sleep, /* sleep */
+	dc_serial_posix_close, /* close */
 };
 
+/*
+ * The maximum time (in milliseconds) to wait for data, before checking
+ * the cancellation callback.
+ */
+#define SLICE 100
+
+/*
+ * Limit the timeout of a select call, to check the cancellation callback
+ * regularly. Returns the timeout to pass to select, which points to the
+ * slice if the wait was shortened.
+ */
+static struct timeval *
+dc_serial_slice (dc_serial_posix_t *device, struct timeval *tvt, struct timeval *tvs)
+{
+	if (device->base.cancel_callback == NULL)
+		return tvt;
+
+	tvs->tv_sec  = (SLICE / 1000);
+	tvs->tv_usec = (SLICE % 1000) * 1000;
+	if (tvt != NULL && !timercmp (tvt, tvs, >))
+		return tvt;
+
+	return tvs;
+}
+
 static dc_status_t
 syserror(int errcode)
 {
@@ -147,26 +226,36 @@ dc_serial_open (dc_serial_t **out, dc_context_t *context, const char *name)
 	if (out == NULL)
 		return DC_STATUS_INVALIDARGS;
 
+	const char *replay = dc_context_get_replay (context);
+	if (replay)
+		return dc_serial_replay_open (out, context, replay);
+
+	// Serial port servers on the network.
+	if (name && (strncmp (name, "tcp://", 6) == 0 || strncmp (name, "rfc2217://", 10) == 0))
+		return dc_serial_tcp_open (out, context, name);
+
 	INFO (context, "Open: name=%s", name ? name : "");
 
 	// Allocate memory.
-	dc_serial_t *device = (dc_serial_t *) malloc (sizeof (dc_serial_t));
+	dc_serial_posix_t *device = (dc_serial_posix_t *) dc_serial_allocate (context, &dc_serial_posix_vtable);
 	if (device == NULL) {
-		SYSERROR (context, ENOMEM);
 		return DC_STATUS_NOMEMORY;
 	}
 
-	// Library context.
-	device->context = context;
-
 	// Default to blocking reads.
 	device->timeout = -1;
 
 	// Default to full-duplex.
-	device->halfduplex = 0;
+	device->halfduplex = DC_HALFDUPLEX_NONE;
+#ifdef RS485
+	device->rs485 = 0;
+#endif
 	device->baudrate = 0;
 	device->nbits = 0;
 
+	device->record = NULL;
+	device->replay = NULL;
+
 	// Open the device in non-blocking mode, to return immediately
 	// without waiting for the modem connection to complete.
 	device->fd = open (name, O_RDWR | O_NOCTTY | O_NONBLOCK);
@@ -198,29 +287,94 @@ dc_serial_open (dc_serial_t **out, dc_context_t *context, const char *name)
 		goto error_close;
 	}
 
-	*out = device;
+	// Start recording the transcript.
+	const char *record = dc_context_get_record (context);
+	if (record) {
+		status = dc_transcript_record (&device->record, context, record);
+		if (status != DC_STATUS_SUCCESS) {
+			goto error_close;
+		}
+	}
+
+	// Receive the data on a dedicated I/O thread. The transcript would
+	// record the reads of that thread instead of those of the protocol.
+	const dc_iothread_t *iothread = dc_context_get_iothread (context);
+	if (iothread && device->record == NULL)
+		return dc_serial_iothread_open (out, context, (dc_serial_t *) device, iothread);
+
+	*out = (dc_serial_t *) device;
 
 	return DC_STATUS_SUCCESS;
 
 error_close:
 	close (device->fd);
 error_free:
-	free (device);
+	dc_serial_deallocate ((dc_serial_t *) device);
 	return status;
 }
 
 dc_status_t
-dc_serial_close (dc_serial_t *device)
+dc_serial_replay_open (dc_serial_t **out, dc_context_t *context, const char *filename)
 {
 	dc_status_t status = DC_STATUS_SUCCESS;
 
-	if (device == NULL)
-		return DC_STATUS_SUCCESS;
+	if (out == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	INFO (context, "Replay: filename=%s", filename ? filename : "");
+
+	// Allocate memory.
+	dc_serial_posix_t *device = (dc_serial_posix_t *) dc_serial_allocate (context, &dc_serial_posix_vtable);
+	if (device == NULL) {
+		return DC_STATUS_NOMEMORY;
+	}
+
+	device->fd = -1;
+	device->timeout = -1;
+	device->halfduplex = DC_HALFDUPLEX_NONE;
+#ifdef RS485
+	device->rs485 = 0;
+#endif
+	device->baudrate = 0;
+	device->nbits = 0;
+	device->record = NULL;
+
+	status = dc_transcript_replay (&device->replay, context, filename);
+	if (status != DC_STATUS_SUCCESS) {
+		dc_serial_deallocate ((dc_serial_t *) device);
+		return status;
+	}
+
+	*out = (dc_serial_t *) device;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_serial_posix_close (dc_serial_t *abstract)
+{
+	dc_serial_posix_t *device = (dc_serial_posix_t *) abstract;
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (device->replay) {
+		return dc_transcript_close (device->replay);
+	}
+
+	dc_status_set_error(&status, dc_transcript_close (device->record));
+
+#ifdef RS485
+	// Restore the initial RS485 settings.
+	if (device->rs485 && ioctl (device->fd, TIOCSRS485, &device->rs485_saved) != 0) {
+		int errcode = errno;
+		SYSERROR (device->base.context, errcode);
+		dc_status_set_error(&status, syserror (errcode));
+	}
+#endif
 
 	// Restore the initial terminal attributes.
 	if (tcsetattr (device->fd, TCSANOW, &device->tty) != 0) {
 		int errcode = errno;
-		SYSERROR (device->context, errcode);
+		SYSERROR (device->base.context, errcode);
 		dc_status_set_error(&status, syserror (errcode));
 	}
 
@@ -232,23 +386,21 @@ dc_serial_close (dc_serial_t *device)
 	// Close the device.
 	if (close (device->fd) != 0) {
 		int errcode = errno;
-		SYSERROR (device->context, errcode);
+		SYSERROR (device->base.context, errcode);
 		dc_status_set_error(&status, syserror (errcode));
 	}
 
-	// Free memory.
-	free (device);
-
 	return status;
 }
 
-dc_status_t
-dc_serial_configure (dc_serial_t *device, unsigned int baudrate, unsigned int databits, dc_parity_t parity, dc_stopbits_t stopbits, dc_flowcontrol_t flowcontrol)
+static dc_status_t
+dc_serial_posix_configure (dc_serial_t *abstract, unsigned int baudrate, unsigned int databits, dc_parity_t parity, dc_stopbits_t stopbits, dc_flowcontrol_t flowcontrol)
 {
-	if (device == NULL)
-		return DC_STATUS_INVALIDARGS;
+	dc_serial_posix_t *device = (dc_serial_posix_t *) abstract;
+	if (device->replay)
+		return DC_STATUS_SUCCESS;
 
-	INFO (device->context, "Configure: baudrate=%i, databits=%i, parity=%i, stopbits=%i, flowcontrol=%i",
+	INFO (device->base.context, "Configure: baudrate=%i, databits=%i, parity=%i, stopbits=%i, flowcontrol=%i",
 		baudrate, databits, parity, stopbits, flowcontrol);
 
 	// Retrieve the current settings.
@@ -256,7 +408,7 @@ dc_serial_configure (dc_serial_t *device, unsigned int baudrate, unsigned int da
 	memset (&tty, 0, sizeof (tty));
 	if (tcgetattr (device->fd, &tty) != 0) {
 		int errcode = errno;
-		SYSERROR (device->context, errcode);
+		SYSERROR (device->base.context, errcode);
 		return syserror (errcode);
 	}
 
@@ -353,7 +505,7 @@ dc_serial_configure (dc_serial_t *device, unsigned int baudrate, unsigned int da
 	if (cfsetispeed (&tty, baud) != 0 ||
 		cfsetospeed (&tty, baud) != 0) {
 		int errcode = errno;
-		SYSERROR (device->context, errcode);
+		SYSERROR (device->base.context, errcode);
 		return syserror (errcode);
 	}
 
@@ -451,7 +603,7 @@ dc_serial_configure (dc_serial_t *device, unsigned int baudrate, unsigned int da
 	if (tcsetattr (device->fd, TCSANOW, &tty) != 0 && NOPTY) {
 #if 0 // who cares
 		int errcode = errno;
-		SYSERROR (device->context, errcode);
+		SYSERROR (device->base.context, errcode);
 		return syserror (errcode);
 #endif
 	}
@@ -463,7 +615,7 @@ dc_serial_configure (dc_serial_t *device, unsigned int baudrate, unsigned int da
 		struct serial_struct ss;
 		if (ioctl (device->fd, TIOCGSERIAL, &ss) != 0 && NOPTY) {
 			int errcode = errno;
-			SYSERROR (device->context, errcode);
+			SYSERROR (device->base.context, errcode);
 			return syserror (errcode);
 		}
 
@@ -475,14 +627,14 @@ dc_serial_configure (dc_serial_t *device, unsigned int baudrate, unsigned int da
 		// Apply the new settings.
 		if (ioctl (device->fd, TIOCSSERIAL, &ss) != 0 && NOPTY) {
 			int errcode = errno;
-			SYSERROR (device->context, errcode);
+			SYSERROR (device->base.context, errcode);
 			return syserror (errcode);
 		}
 #elif defined(IOSSIOSPEED)
 		speed_t speed = baudrate;
 		if (ioctl (device->fd, IOSSIOSPEED, &speed) != 0 && NOPTY) {
 			int errcode = errno;
-			SYSERROR (device->context, errcode);
+			SYSERROR (device->base.context, errcode);
 			return syserror (errcode);
 		}
 #else
@@ -497,42 +649,85 @@ dc_serial_configure (dc_serial_t *device, unsigned int baudrate, unsigned int da
 	return DC_STATUS_SUCCESS;
 }
 
-dc_status_t
-dc_serial_set_timeout (dc_serial_t *device, int timeout)
+static dc_status_t
+dc_serial_posix_set_timeout (dc_serial_t *abstract, int timeout)
 {
-	if (device == NULL)
-		return DC_STATUS_INVALIDARGS;
-
-	INFO (device->context, "Timeout: value=%i", timeout);
+	dc_serial_posix_t *device = (dc_serial_posix_t *) abstract;
+	INFO (device->base.context, "Timeout: value=%i", timeout);
 
 	device->timeout = timeout;
 
 	return DC_STATUS_SUCCESS;
 }
 
-dc_status_t
-dc_serial_set_halfduplex (dc_serial_t *device, unsigned int value)
+static dc_status_t
+dc_serial_posix_set_halfduplex (dc_serial_t *abstract, unsigned int value)
 {
-	if (device == NULL)
+	dc_serial_posix_t *device = (dc_serial_posix_t *) abstract;
+	if (value > DC_HALFDUPLEX_RS485)
 		return DC_STATUS_INVALIDARGS;
 
+	if (device->replay) {
+		device->halfduplex = value;
+		return DC_STATUS_SUCCESS;
+	}
+
+	INFO (device->base.context, "Halfduplex: value=%u", value);
+
+#ifdef RS485
+	// Restore the initial RS485 settings.
+	if (device->rs485 && value != DC_HALFDUPLEX_RS485) {
+		if (ioctl (device->fd, TIOCSRS485, &device->rs485_saved) != 0) {
+			int errcode = errno;
+			SYSERROR (device->base.context, errcode);
+			return syserror (errcode);
+		}
+		device->rs485 = 0;
+	}
+
+	// Let the driver switch the RTS line around each transmission.
+	if (!device->rs485 && value == DC_HALFDUPLEX_RS485) {
+		struct serial_rs485 rs485;
+		if (ioctl (device->fd, TIOCGRS485, &device->rs485_saved) == 0) {
+			rs485 = device->rs485_saved;
+			rs485.flags |= SER_RS485_ENABLED | SER_RS485_RTS_ON_SEND;
+			rs485.flags &= ~SER_RS485_RTS_AFTER_SEND;
+			rs485.delay_rts_before_send = 0;
+			rs485.delay_rts_after_send = 0;
+			if (ioctl (device->fd, TIOCSRS485, &rs485) == 0)
+				device->rs485 = 1;
+		}
+	}
+#endif
+
+	if (value == DC_HALFDUPLEX_RS485) {
+#ifdef RS485
+		if (!device->rs485)
+#endif
+		{
+			INFO (device->base.context, "RS485 mode not supported, using the timed emulation.");
+			value = DC_HALFDUPLEX_TIMED;
+		}
+	}
+
 	device->halfduplex = value;
 
 	return DC_STATUS_SUCCESS;
 }
 
-dc_status_t
-dc_serial_set_latency (dc_serial_t *device, unsigned int milliseconds)
+static dc_status_t
+dc_serial_posix_set_latency (dc_serial_t *abstract, unsigned int milliseconds)
 {
-	if (device == NULL)
-		return DC_STATUS_INVALIDARGS;
+	dc_serial_posix_t *device = (dc_serial_posix_t *) abstract;
+	if (device->replay)
+		return DC_STATUS_SUCCESS;
 
 #if defined(TIOCGSERIAL) && defined(TIOCSSERIAL) && !defined(__ANDROID__)
 	// Get the current settings.
 	struct serial_struct ss;
 	if (ioctl (device->fd, TIOCGSERIAL, &ss) != 0 && NOPTY) {
 		int errcode = errno;
-		SYSERROR (device->context, errcode);
+		SYSERROR (device->base.context, errcode);
 		return syserror (errcode);
 	}
 
@@ -546,7 +741,7 @@ dc_serial_set_latency (dc_serial_t *device, unsigned int milliseconds)
 	// Apply the new settings.
 	if (ioctl (device->fd, TIOCSSERIAL, &ss) != 0 && NOPTY) {
 		int errcode = errno;
-		SYSERROR (device->context, errcode);
+		SYSERROR (device->base.context, errcode);
 		return syserror (errcode);
 	}
 #elif defined(IOSSDATALAT)
@@ -556,7 +751,7 @@ dc_serial_set_latency (dc_serial_t *device, unsigned int milliseconds)
 	unsigned long usec = (milliseconds == 0 ? 1 : milliseconds * 1000);
 	if (ioctl (device->fd, IOSSDATALAT, &usec) != 0 && NOPTY) {
 		int errcode = errno;
-		SYSERROR (device->context, errcode);
+		SYSERROR (device->base.context, errcode);
 		return syserror (errcode);
 	}
 #endif
@@ -564,14 +759,19 @@ dc_serial_set_latency (dc_serial_t *device, unsigned int milliseconds)
 	return DC_STATUS_SUCCESS;
 }
 
-dc_status_t
-dc_serial_read (dc_serial_t *device, void *data, size_t size, size_t *actual)
+static dc_status_t
+dc_serial_posix_read (dc_serial_t *abstract, void *data, size_t size, size_t *actual)
 {
+	dc_serial_posix_t *device = (dc_serial_posix_t *) abstract;
 	dc_status_t status = DC_STATUS_SUCCESS;
+	unsigned long long begin = 0;
 	size_t nbytes = 0;
 
-	if (device == NULL) {
-		status = DC_STATUS_INVALIDARGS;
+	if (dc_context_is_tracing (device->base.context))
+		begin = dc_context_clock ();
+
+	if (device->replay) {
+		status = dc_transcript_read (device->replay, data, size, &nbytes);
 		goto out;
 	}
 
@@ -579,67 +779,91 @@ dc_serial_read (dc_serial_t *device, void *data, size_t size, size_t *actual)
 	int timeout = device->timeout;
 
 	// The absolute target time.
-	struct timeval tve;
+	struct timeval tve = {0};
 
 	int init = 1;
+	int wait = 0;
 	while (nbytes < size) {
-		fd_set fds;
-		FD_ZERO (&fds);
-		FD_SET (device->fd, &fds);
+		// Because the file descriptor is in non-blocking mode, the data
+		// that is already available in the input buffer can be read
+		// immediately. Only wait for new data when the input buffer has
+		// been drained, to avoid a select call for every single chunk.
+		if (wait) {
+			fd_set fds;
+			FD_ZERO (&fds);
+			FD_SET (device->fd, &fds);
+
+			struct timeval tvt;
+			if (timeout > 0) {
+				struct timeval now;
+				if (gettimeofday (&now, NULL) != 0) {
+					int errcode = errno;
+					SYSERROR (device->base.context, errcode);
+					status = syserror (errcode);
+					goto out;
+				}
 
-		struct timeval tvt;
-		if (timeout > 0) {
-			struct timeval now;
-			if (gettimeofday (&now, NULL) != 0) {
+				if (init) {
+					// Calculate the initial timeout.
+					tvt.tv_sec  = (timeout / 1000);
+					tvt.tv_usec = (timeout % 1000) * 1000;
+					// Calculate the target time.
+					timeradd (&now, &tvt, &tve);
+				} else {
+					// Calculate the remaining timeout.
+					if (timercmp (&now, &tve, <))
+						timersub (&tve, &now, &tvt);
+					else
+						timerclear (&tvt);
+				}
+				init = 0;
+			} else if (timeout == 0) {
+				timerclear (&tvt);
+			}
+
+			// Wake up regularly to check for a cancellation.
+			struct timeval tvs;
+			struct timeval *ptv = dc_serial_slice (device, timeout >= 0 ? &tvt : NULL, &tvs);
+
+			int rc = select (device->fd + 1, &fds, NULL, NULL, ptv);
+			if (rc < 0) {
 				int errcode = errno;
-				SYSERROR (device->context, errcode);
+				if (errcode == EINTR)
+					continue; // Retry.
+				SYSERROR (device->base.context, errcode);
 				status = syserror (errcode);
 				goto out;
+			} else if (rc == 0) {
+				if (ptv == &tvs) {
+					if (dc_serial_is_cancelled (&device->base)) {
+						status = DC_STATUS_CANCELLED;
+						goto out;
+					}
+					continue; // Wait again.
+				}
+				break; // Timeout.
 			}
-
-			if (init) {
-				// Calculate the initial timeout.
-				tvt.tv_sec  = (timeout / 1000);
-				tvt.tv_usec = (timeout % 1000) * 1000;
-				// Calculate the target time.
-				timeradd (&now, &tvt, &tve);
-			} else {
-				// Calculate the remaining timeout.
-				if (timercmp (&now, &tve, <))
-					timersub (&tve, &now, &tvt);
-				else
-					timerclear (&tvt);
-			}
-			init = 0;
-		} else if (timeout == 0) {
-			timerclear (&tvt);
-		}
-
-		int rc = select (device->fd + 1, &fds, NULL, NULL, timeout >= 0 ? &tvt : NULL);
-		if (rc < 0) {
-			int errcode = errno;
-			if (errcode == EINTR)
-				continue; // Retry.
-			SYSERROR (device->context, errcode);
-			status = syserror (errcode);
-			goto out;
-		} else if (rc == 0) {
-			break; // Timeout.
 		}
 
 		ssize_t n = read (device->fd, (char *) data + nbytes, size - nbytes);
 		if (n < 0) {
 			int errcode = errno;
-			if (errcode == EINTR || errcode == EAGAIN)
+			if (errcode == EINTR)
 				continue; // Retry.
-			SYSERROR (device->context, errcode);
+			if (errcode == EAGAIN) {
+				wait = 1;
+				continue; // Wait for new data.
+			}
+			SYSERROR (device->base.context, errcode);
 			status = syserror (errcode);
 			goto out;
 		} else if (n == 0) {
 			 break; // EOF.
 		}
 
+		// A short read means the input buffer is empty now.
 		nbytes += n;
+		wait = 1;
 	}
 
 	if (nbytes != size) {
@@ -647,7 +871,13 @@ dc_serial_read (dc_serial_t *device, void *data, size_t size, size_t *actual)
 	}
 
 out:
-	HEXDUMP (device->context, DC_LOGLEVEL_INFO, "Read", (unsigned char *) data, nbytes);
+	if (device->record) {
+		dc_transcript_append (device->record, DC_TRANSCRIPT_READ, status, data, nbytes);
+	}
+
+	dc_context_trace (device->base.context, DC_TRACE_READ, status, begin, data, nbytes);
+
+	HEXDUMP (device->base.context, DC_LOGLEVEL_INFO, "Read", (unsigned char *) data, nbytes);
 
 	if (actual)
 		*actual = nbytes;
@@ -655,23 +885,28 @@ out:
 	return status;
 }
 
-dc_status_t
-dc_serial_write (dc_serial_t *device, const void *data, size_t size, size_t *actual)
+static dc_status_t
+dc_serial_posix_write (dc_serial_t *abstract, const void *data, size_t size, size_t *actual)
 {
+	dc_serial_posix_t *device = (dc_serial_posix_t *) abstract;
 	dc_status_t status = DC_STATUS_SUCCESS;
+	unsigned long long begin = 0;
 	size_t nbytes = 0;
 
-	if (device == NULL) {
-		status = DC_STATUS_INVALIDARGS;
+	if (dc_context_is_tracing (device->base.context))
+		begin = dc_context_clock ();
+
+	if (device->replay) {
+		status = dc_transcript_write (device->replay, data, size, &nbytes);
 		goto out;
 	}
 
 	struct timeval tve, tvb;
-	if (device->halfduplex) {
+	if (device->halfduplex == DC_HALFDUPLEX_TIMED) {
 		// Get the current time.
 		if (gettimeofday (&tvb, NULL) != 0) {
 			int errcode = errno;
-			SYSERROR (device->context, errcode);
+			SYSERROR (device->base.context, errcode);
 			status = syserror (errcode);
 			goto out;
 		}
@@ -687,7 +922,7 @@ dc_serial_write (dc_serial_t *device, const void *data, size_t size, size_t *act
 			int errcode = errno;
 			if (errcode == EINTR)
 				continue; // Retry.
-			SYSERROR (device->context, errcode);
+			SYSERROR (device->base.context, errcode);
 			status = syserror (errcode);
 			goto out;
 		} else if (rc == 0) {
@@ -699,7 +934,7 @@ dc_serial_write (dc_serial_t *device, const void *data, size_t size, size_t *act
 			int errcode = errno;
 			if (errcode == EINTR || errcode == EAGAIN)
 				continue; // Retry.
-			SYSERROR (device->context, errcode);
+			SYSERROR (device->base.context, errcode);
 			status = syserror (errcode);
 			goto out;
 		} else if (n == 0) {
@@ -709,7 +944,9 @@ dc_serial_write (dc_serial_t *device, const void *data, size_t size, size_t *act
 		nbytes += n;
 	}
 
-	// Wait until all data has been transmitted.
+	// Wait until all data has been transmitted. In the drain and RS485
+	// half duplex modes, this is all that is needed before the line can
+	// be turned around.
 #ifdef __ANDROID__
 	/* Android is missing tcdrain, so use ioctl version instead */
 	while (ioctl (device->fd, TCSBRK, 1) != 0) {
@@ -718,17 +955,17 @@ dc_serial_write (dc_serial_t *device, const void *data, size_t size, size_t *act
 #endif
 		int errcode = errno;
 		if (errcode != EINTR ) {
-			SYSERROR (device->context, errcode);
+			SYSERROR (device->base.context, errcode);
 			status = syserror (errcode);
 			goto out;
 		}
 	}
 
-	if (device->halfduplex) {
+	if (device->halfduplex == DC_HALFDUPLEX_TIMED) {
 		// Get the current time.
 		if (gettimeofday (&tve, NULL) != 0) {
 			int errcode = errno;
-			SYSERROR (device->context, errcode);
+			SYSERROR (device->base.context, errcode);
 			status = syserror (errcode);
 			goto out;
 		}
@@ -749,12 +986,18 @@ dc_serial_write (dc_serial_t *device, const void *data, size_t size, size_t *act
 			// The remaining time is rounded up to the nearest millisecond to
 			// match the Windows implementation. The higher resolution is
 			// pointless anyway, since we already added a fudge factor above.
-			dc_serial_sleep (device, (remaining + 999) / 1000);
+			dc_serial_sleep (abstract, (remaining + 999) / 1000);
 		}
 	}
 
 out:
-	HEXDUMP (device->context, DC_LOGLEVEL_INFO, "Write", (unsigned char *) data, nbytes);
+	if (device->record) {
+		dc_transcript_append (device->record, DC_TRANSCRIPT_WRITE, status, data, nbytes);
+	}
+
+	dc_context_trace (device->base.context, DC_TRACE_WRITE, status, begin, data, nbytes);
+
+	HEXDUMP (device->base.context, DC_LOGLEVEL_INFO, "Write", (unsigned char *) data, nbytes);
 
 	if (actual)
 		*actual = nbytes;
@@ -762,13 +1005,14 @@ out:
 	return status;
 }
 
-dc_status_t
-dc_serial_purge (dc_serial_t *device, dc_direction_t direction)
+static dc_status_t
+dc_serial_posix_purge (dc_serial_t *abstract, dc_direction_t direction)
 {
-	if (device == NULL)
-		return DC_STATUS_INVALIDARGS;
+	dc_serial_posix_t *device = (dc_serial_posix_t *) abstract;
+	if (device->replay)
+		return DC_STATUS_SUCCESS;
 
-	INFO (device->context, "Purge: direction=%u", direction);
+	INFO (device->base.context, "Purge: direction=%u", direction);
 
 	int flags = 0;
 
@@ -788,93 +1032,98 @@ dc_serial_purge (dc_serial_t *device, dc_direction_t direction)
 
 	if (tcflush (device->fd, flags) != 0) {
 		int errcode = errno;
-		SYSERROR (device->context, errcode);
+		SYSERROR (device->base.context, errcode);
 		return syserror (errcode);
 	}
 
 	return DC_STATUS_SUCCESS;
 }
 
-dc_status_t
-dc_serial_flush (dc_serial_t *device)
+static dc_status_t
+dc_serial_posix_flush (dc_serial_t *abstract)
 {
-	if (device == NULL)
-		return DC_STATUS_INVALIDARGS;
-
-	INFO (device->context, "Flush: none");
+	dc_serial_posix_t *device = (dc_serial_posix_t *) abstract;
+	INFO (device->base.context, "Flush: none");
 
 	return DC_STATUS_SUCCESS;
 }
 
-dc_status_t
-dc_serial_set_break (dc_serial_t *device, unsigned int level)
+static dc_status_t
+dc_serial_posix_set_break (dc_serial_t *abstract, unsigned int level)
 {
-	if (device == NULL)
-		return DC_STATUS_INVALIDARGS;
+	dc_serial_posix_t *device = (dc_serial_posix_t *) abstract;
+	if (device->replay)
+		return DC_STATUS_SUCCESS;
 
-	INFO (device->context, "Break: value=%i", level);
+	INFO (device->base.context, "Break: value=%i", level);
 
 	unsigned long action = (level ? TIOCSBRK : TIOCCBRK);
 
 	if (ioctl (device->fd, action, NULL) != 0 && NOPTY) {
 		int errcode = errno;
-		SYSERROR (device->context, errcode);
+		SYSERROR (device->base.context, errcode);
 		return syserror (errcode);
 	}
 
 	return DC_STATUS_SUCCESS;
 }
 
-dc_status_t
-dc_serial_set_dtr (dc_serial_t *device, unsigned int level)
+static dc_status_t
+dc_serial_posix_set_dtr (dc_serial_t *abstract, unsigned int level)
 {
-	if (device == NULL)
-		return DC_STATUS_INVALIDARGS;
+	dc_serial_posix_t *device = (dc_serial_posix_t *) abstract;
+	if (device->replay)
+		return DC_STATUS_SUCCESS;
 
-	INFO (device->context, "DTR: value=%i", level);
+	INFO (device->base.context, "DTR: value=%i", level);
 
 	unsigned long action = (level ? TIOCMBIS : TIOCMBIC);
 
 	int value = TIOCM_DTR;
 	if (ioctl (device->fd, action, &value) != 0 && NOPTY) {
 		int errcode = errno;
-		SYSERROR (device->context, errcode);
+		SYSERROR (device->base.context, errcode);
 		return syserror (errcode);
 	}
 
 	return DC_STATUS_SUCCESS;
 }
 
-dc_status_t
-dc_serial_set_rts (dc_serial_t *device, unsigned int level)
+static dc_status_t
+dc_serial_posix_set_rts (dc_serial_t *abstract, unsigned int level)
 {
-	if (device == NULL)
-		return DC_STATUS_INVALIDARGS;
+	dc_serial_posix_t *device = (dc_serial_posix_t *) abstract;
+	if (device->replay)
+		return DC_STATUS_SUCCESS;
 
-	INFO (device->context, "RTS: value=%i", level);
+	INFO (device->base.context, "RTS: value=%i", level);
 
 	unsigned long action = (level ? TIOCMBIS : TIOCMBIC);
 
 	int value = TIOCM_RTS;
 	if (ioctl (device->fd, action, &value) != 0 && NOPTY) {
 		int errcode = errno;
-		SYSERROR (device->context, errcode);
+		SYSERROR (device->base.context, errcode);
 		return syserror (errcode);
 	}
 
 	return DC_STATUS_SUCCESS;
 }
 
-dc_status_t
-dc_serial_get_available (dc_serial_t *device, size_t *value)
+static dc_status_t
+dc_serial_posix_get_available (dc_serial_t *abstract, size_t *value)
 {
-	if (device == NULL)
-		return DC_STATUS_INVALIDARGS;
+	dc_serial_posix_t *device = (dc_serial_posix_t *) abstract;
+	if (device->replay) {
+		if (value)
+			*value = dc_transcript_available (device->replay);
+		return DC_STATUS_SUCCESS;
+	}
 
 	int bytes = 0;
 	if (ioctl (device->fd, TIOCINQ, &bytes) != 0) {
 		int errcode = errno;
-		SYSERROR (device->context, errcode);
+		SYSERROR (device->base.context, errcode);
 		return syserror (errcode);
 	}
 
@@ -884,18 +1133,93 @@ dc_serial_get_available (dc_serial_t *device, size_t *value)
 	return DC_STATUS_SUCCESS;
 }
 
-dc_status_t
-dc_serial_get_lines (dc_serial_t *device, unsigned int *value)
+static dc_status_t
+dc_serial_posix_poll (dc_serial_t *abstract, int timeout)
+{
+	dc_serial_posix_t *device = (dc_serial_posix_t *) abstract;
+	// The replayed answers are always available immediately.
+	if (device->replay)
+		return DC_STATUS_SUCCESS;
+
+	// The absolute target time.
+	struct timeval tve;
+	if (timeout > 0) {
+		struct timeval now;
+		if (gettimeofday (&now, NULL) != 0) {
+			int errcode = errno;
+			SYSERROR (device->base.context, errcode);
+			return syserror (errcode);
+		}
+
+		struct timeval tvt;
+		tvt.tv_sec  = (timeout / 1000);
+		tvt.tv_usec = (timeout % 1000) * 1000;
+		timeradd (&now, &tvt, &tve);
+	}
+
+	while (1) {
+		fd_set fds;
+		FD_ZERO (&fds);
+		FD_SET (device->fd, &fds);
+
+		struct timeval tvt;
+		if (timeout > 0) {
+			struct timeval now;
+			if (gettimeofday (&now, NULL) != 0) {
+				int errcode = errno;
+				SYSERROR (device->base.context, errcode);
+				return syserror (errcode);
+			}
+
+			// Calculate the remaining timeout.
+			if (timercmp (&now, &tve, <))
+				timersub (&tve, &now, &tvt);
+			else
+				timerclear (&tvt);
+		} else if (timeout == 0) {
+			timerclear (&tvt);
+		}
+
+		// Wake up regularly to check for a cancellation.
+		struct timeval tvs;
+		struct timeval *ptv = dc_serial_slice (device, timeout >= 0 ? &tvt : NULL, &tvs);
+
+		int rc = select (device->fd + 1, &fds, NULL, NULL, ptv);
+		if (rc < 0) {
+			int errcode = errno;
+			if (errcode == EINTR)
+				continue; // Retry.
+			SYSERROR (device->base.context, errcode);
+			return syserror (errcode);
+		} else if (rc == 0) {
+			if (ptv == &tvs) {
+				if (dc_serial_is_cancelled (&device->base))
+					return DC_STATUS_CANCELLED;
+				continue; // Wait again.
+			}
+			return DC_STATUS_TIMEOUT;
+		}
+
+		return DC_STATUS_SUCCESS;
+	}
+}
+
+static dc_status_t
+dc_serial_posix_get_lines (dc_serial_t *abstract, unsigned int *value)
 {
+	dc_serial_posix_t *device = (dc_serial_posix_t *) abstract;
 	unsigned int lines = 0;
 
-	if (device == NULL)
-		return DC_STATUS_INVALIDARGS;
+	if (device->replay) {
+		if (value)
+			*value = 0;
+		return DC_STATUS_SUCCESS;
+	}
 
 	int status = 0;
 	if (ioctl (device->fd, TIOCMGET, &status) != 0) {
 		int errcode = errno;
-		SYSERROR (device->context, errcode);
+		SYSERROR (device->base.context, errcode);
 		return syserror (errcode);
 	}
 
@@ -914,13 +1238,14 @@ dc_serial_get_lines (dc_serial_t *device, unsigned int *value)
 	return DC_STATUS_SUCCESS;
 }
 
-dc_status_t
-dc_serial_sleep (dc_serial_t *device, unsigned int timeout)
+static dc_status_t
+dc_serial_posix_sleep (dc_serial_t *abstract, unsigned int timeout)
 {
-	if (device == NULL)
-		return DC_STATUS_INVALIDARGS;
+	dc_serial_posix_t *device = (dc_serial_posix_t *) abstract;
+	if (device->replay)
+		return DC_STATUS_SUCCESS;
 
-	INFO (device->context, "Sleep: value=%u", timeout);
+	INFO (device->base.context, "Sleep: value=%u", timeout);
 
 	struct timespec ts;
 	ts.tv_sec  = (timeout / 1000);
@@ -929,7 +1254,7 @@ dc_serial_sleep (dc_serial_t *device, unsigned int timeout)
 	while (nanosleep (&ts, &ts) != 0) {
 		int errcode = errno;
 		if (errcode != EINTR ) {
-			SYSERROR (device->context, errcode);
+			SYSERROR (device->base.context, errcode);
 			return syserror (errcode);
 		}
 	}
@@ -0,0 +1,886 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#define DC_LOG_CATEGORY DC_LOGCATEGORY_TRANSPORT
+
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+	#define NOGDI
+	#include <winsock2.h>
+	#include <ws2tcpip.h>
+	#include <windows.h>
+#else
+	#include <errno.h>			// errno
+	#include <unistd.h>			// close
+	#include <sys/types.h>		// socket
+	#include <sys/socket.h>		// socket, setsockopt
+	#include <sys/select.h>		// select
+	#include <sys/ioctl.h>		// ioctl
+	#include <netinet/in.h>		// IPPROTO_TCP
+	#include <netinet/tcp.h>	// TCP_NODELAY
+	#include <netdb.h>			// getaddrinfo
+#endif
+
+#include "serial-private.h"
+#include "common-private.h"
+#include "context-private.h"
+
+#ifdef _WIN32
+typedef SOCKET s_socket_t;
+typedef int s_ssize_t;
+typedef DWORD s_errcode_t;
+#define S_ERRNO WSAGetLastError ()
+#define S_EINTR WSAEINTR
+#define S_ENOMEM WSA_NOT_ENOUGH_MEMORY
+#define S_EINVAL WSAEINVAL
+#define S_EACCES WSAEACCES
+#define S_ECONNREFUSED WSAECONNREFUSED
+#define S_INVALID INVALID_SOCKET
+#define S_CLOSE closesocket
+#else
+typedef int s_socket_t;
+typedef ssize_t s_ssize_t;
+typedef int s_errcode_t;
+#define S_ERRNO errno
+#define S_EINTR EINTR
+#define S_ENOMEM ENOMEM
+#define S_EINVAL EINVAL
+#define S_EACCES EACCES
+#define S_ECONNREFUSED ECONNREFUSED
+#define S_INVALID -1
+#define S_CLOSE close
+#endif
+
+/*
+ * The maximum time (in milliseconds) to wait for data, before checking
+ * the cancellation callback.
+ */
+#define SLICE 100
+
+/* Telnet commands (RFC 854). */
+#define IAC  255
+#define DONT 254
+#define DO   253
+#define WONT 252
+#define WILL 251
+#define SB   250
+#define SE   240
+
+/* Telnet options. */
+#define OPT_BINARY  0
+#define OPT_SGA     3
+#define OPT_COMPORT 44
+
+/* Com port control commands (RFC 2217). */
+#define COMPORT_SET_BAUDRATE 1
+#define COMPORT_SET_DATASIZE 2
+#define COMPORT_SET_PARITY   3
+#define COMPORT_SET_STOPSIZE 4
+#define COMPORT_SET_CONTROL  5
+#define COMPORT_PURGE_DATA   12
+
+/* Decoder states of the telnet stream. */
+#define STATE_DATA   0
+#define STATE_IAC    1
+#define STATE_OPTION 2
+#define STATE_SB     3
+#define STATE_SB_IAC 4
+
+typedef struct dc_serial_tcp_t {
+	/* Base class. */
+	dc_serial_t base;
+	s_socket_t fd;
+	int timeout;
+	/* Telnet with the com port control option, or a raw connection. */
+	int rfc2217;
+	int state;
+	unsigned char command;
+	/* The coalesced data, not sent yet. */
+	unsigned char tx[1024];
+	unsigned int txlen;
+	/* The received data, not read yet. */
+	unsigned char rx[1024];
+	unsigned int rxpos;
+	unsigned int rxlen;
+} dc_serial_tcp_t;
+
+static dc_status_t dc_serial_tcp_configure (dc_serial_t *abstract, unsigned int baudrate, unsigned int databits, dc_parity_t parity, dc_stopbits_t stopbits, dc_flowcontrol_t flowcontrol);
+static dc_status_t dc_serial_tcp_set_timeout (dc_serial_t *abstract, int timeout);
+static dc_status_t dc_serial_tcp_set_value (dc_serial_t *abstract, unsigned int value);
+static dc_status_t dc_serial_tcp_read (dc_serial_t *abstract, void *data, size_t size, size_t *actual);
+static dc_status_t dc_serial_tcp_write (dc_serial_t *abstract, const void *data, size_t size, size_t *actual);
+static dc_status_t dc_serial_tcp_flush (dc_serial_t *abstract);
+static dc_status_t dc_serial_tcp_purge (dc_serial_t *abstract, dc_direction_t direction);
+static dc_status_t dc_serial_tcp_set_break (dc_serial_t *abstract, unsigned int value);
+static dc_status_t dc_serial_tcp_set_dtr (dc_serial_t *abstract, unsigned int value);
+static dc_status_t dc_serial_tcp_set_rts (dc_serial_t *abstract, unsigned int value);
+static dc_status_t dc_serial_tcp_get_available (dc_serial_t *abstract, size_t *value);
+static dc_status_t dc_serial_tcp_poll (dc_serial_t *abstract, int timeout);
+static dc_status_t dc_serial_tcp_get_lines (dc_serial_t *abstract, unsigned int *value);
+static dc_status_t dc_serial_tcp_sleep (dc_serial_t *abstract, unsigned int milliseconds);
+static dc_status_t dc_serial_tcp_close (dc_serial_t *abstract);
+
+static const dc_serial_vtable_t dc_serial_tcp_vtable = {
+	sizeof(dc_serial_tcp_t),
+	dc_serial_tcp_configure, /* configure */
+	dc_serial_tcp_set_timeout, /* set_timeout */
+	dc_serial_tcp_set_value, /* set_halfduplex */
+	dc_serial_tcp_set_value, /* set_latency */
+	dc_serial_tcp_read, /* read */
+	dc_serial_tcp_write, /* write */
+	NULL, /* readv */
+	NULL, /* writev */
+	dc_serial_tcp_flush, /* flush */
+	dc_serial_tcp_purge, /* purge */
+	dc_serial_tcp_set_break, /* set_break */
+	dc_serial_tcp_set_dtr, /* set_dtr */
+	dc_serial_tcp_set_rts, /* set_rts */
+	dc_serial_tcp_get_available, /* get_available */
+	dc_serial_tcp_poll, /* poll */
+	dc_serial_tcp_get_lines, /* get_lines */
+	dc_serial_tcp_sleep, /* sleep */
+	dc_serial_tcp_close, /* close */
+};
+
+static dc_status_t
+syserror(s_errcode_t errcode)
+{
+	switch (errcode) {
+	case S_EINVAL:
+		return DC_STATUS_INVALIDARGS;
+	case S_ENOMEM:
+		return DC_STATUS_NOMEMORY;
+	case S_EACCES:
+		return DC_STATUS_NOACCESS;
+	case S_ECONNREFUSED:
+		return DC_STATUS_NODEVICE;
+	default:
+		return DC_STATUS_IO;
+	}
+}
+
+/*
+ * Send data to the socket immediately.
+ */
+static dc_status_t
+dc_serial_tcp_send (dc_serial_tcp_t *device, const unsigned char data[], size_t size)
+{
+	size_t nbytes = 0;
+	while (nbytes < size) {
+		s_ssize_t n = send (device->fd, (const char *) data + nbytes, size - nbytes, 0);
+		if (n < 0) {
+			s_errcode_t errcode = S_ERRNO;
+			if (errcode == S_EINTR)
+				continue; // Retry.
+			SYSERROR (device->base.context, errcode);
+			return syserror (errcode);
+		}
+
+		nbytes += n;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+/*
+ * Send the coalesced data, as a single segment.
+ */
+static dc_status_t
+dc_serial_tcp_push (dc_serial_tcp_t *device)
+{
+	if (device->txlen == 0)
+		return DC_STATUS_SUCCESS;
+
+	dc_status_t rc = dc_serial_tcp_send (device, device->tx, device->txlen);
+	device->txlen = 0;
+
+	return rc;
+}
+
+static dc_status_t
+dc_serial_tcp_option (dc_serial_tcp_t *device, unsigned char command, unsigned char option)
+{
+	const unsigned char packet[] = {IAC, command, option};
+	return dc_serial_tcp_send (device, packet, sizeof (packet));
+}
+
+/*
+ * Send a com port control command, with the value in big endian.
+ */
+static dc_status_t
+dc_serial_tcp_comport (dc_serial_tcp_t *device, unsigned char command, unsigned int value, unsigned int size)
+{
+	if (!device->rfc2217)
+		return DC_STATUS_SUCCESS;
+
+	// Keep the order with the data that is still waiting.
+	dc_status_t rc = dc_serial_tcp_push (device);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	unsigned char packet[4 + 2 * 4 + 2] = {IAC, SB, OPT_COMPORT, command};
+	unsigned int n = 4;
+	for (unsigned int i = 0; i < size; ++i) {
+		unsigned char byte = (value >> (8 * (size - i - 1))) & 0xFF;
+		packet[n++] = byte;
+		if (byte == IAC)
+			packet[n++] = IAC;
+	}
+	packet[n++] = IAC;
+	packet[n++] = SE;
+
+	return dc_serial_tcp_send (device, packet, n);
+}
+
+/*
+ * Wait until the socket is readable.
+ */
+static dc_status_t
+dc_serial_tcp_wait (dc_serial_tcp_t *device, int timeout)
+{
+	unsigned long long begin = dc_context_clock ();
+	while (1) {
+		// Calculate the remaining timeout.
+		int remaining = timeout;
+		if (timeout > 0) {
+			unsigned long long elapsed = (dc_context_clock () - begin) / 1000;
+			remaining = elapsed < (unsigned int) timeout ? timeout - elapsed : 0;
+		}
+
+		// Wake up regularly to check for a cancellation.
+		int wait = remaining;
+		if (device->base.cancel_callback && (wait < 0 || wait > SLICE))
+			wait = SLICE;
+
+		fd_set fds;
+		FD_ZERO (&fds);
+		FD_SET (device->fd, &fds);
+
+		struct timeval tv;
+		tv.tv_sec  = (wait / 1000);
+		tv.tv_usec = (wait % 1000) * 1000;
+
+		int rc = select (device->fd + 1, &fds, NULL, NULL, wait < 0 ? NULL : &tv);
+		if (rc < 0) {
+			s_errcode_t errcode = S_ERRNO;
+			if (errcode == S_EINTR)
+				continue; // Retry.
+			SYSERROR (device->base.context, errcode);
+			return syserror (errcode);
+		} else if (rc > 0) {
+			return DC_STATUS_SUCCESS;
+		}
+
+		if (dc_serial_is_cancelled (&device->base))
+			return DC_STATUS_CANCELLED;
+
+		if (remaining >= 0 && wait == remaining)
+			return DC_STATUS_TIMEOUT;
+	}
+}
+
+/*
+ * Receive the data that is available, and strip the telnet commands. The
+ * receive buffer must be empty.
+ */
+static dc_status_t
+dc_serial_tcp_receive (dc_serial_tcp_t *device)
+{
+	unsigned char buffer[sizeof (device->rx)];
+
+	s_ssize_t n = recv (device->fd, (char *) buffer, sizeof (buffer), 0);
+	if (n < 0) {
+		s_errcode_t errcode = S_ERRNO;
+		if (errcode == S_EINTR)
+			return DC_STATUS_SUCCESS;
+		SYSERROR (device->base.context, errcode);
+		return syserror (errcode);
+	} else if (n == 0) {
+		ERROR (device->base.context, "Connection closed by the server.");
+		return DC_STATUS_IO;
+	}
+
+	device->rxpos = 0;
+	device->rxlen = 0;
+
+	if (!device->rfc2217) {
+		memcpy (device->rx, buffer, n);
+		device->rxlen = n;
+		return DC_STATUS_SUCCESS;
+	}
+
+	for (s_ssize_t i = 0; i < n; ++i) {
+		unsigned char c = buffer[i];
+		switch (device->state) {
+		case STATE_DATA:
+			if (c == IAC)
+				device->state = STATE_IAC;
+			else
+				device->rx[device->rxlen++] = c;
+			break;
+		case STATE_IAC:
+			if (c == IAC) {
+				device->rx[device->rxlen++] = c;
+				device->state = STATE_DATA;
+			} else if (c == DO || c == DONT || c == WILL || c == WONT) {
+				device->command = c;
+				device->state = STATE_OPTION;
+			} else if (c == SB) {
+				device->state = STATE_SB;
+			} else {
+				device->state = STATE_DATA;
+			}
+			break;
+		case STATE_OPTION:
+			// Refuse the options that were not announced when connecting.
+			if (device->command == DO && c != OPT_BINARY && c != OPT_SGA && c != OPT_COMPORT)
+				dc_serial_tcp_option (device, WONT, c);
+			else if (device->command == WILL && c != OPT_BINARY && c != OPT_SGA)
+				dc_serial_tcp_option (device, DONT, c);
+			device->state = STATE_DATA;
+			break;
+		case STATE_SB:
+			// The answers to the com port commands are not needed.
+			if (c == IAC)
+				device->state = STATE_SB_IAC;
+			break;
+		case STATE_SB_IAC:
+			device->state = (c == SE) ? STATE_DATA : STATE_SB;
+			break;
+		}
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_serial_tcp_open (dc_serial_t **out, dc_context_t *context, const char *name)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (out == NULL || name == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	INFO (context, "Open: name=%s", name);
+
+	// Parse the url.
+	int rfc2217 = 0;
+	const char *address = NULL;
+	if (strncmp (name, "tcp://", 6) == 0) {
+		address = name + 6;
+	} else if (strncmp (name, "rfc2217://", 10) == 0) {
+		address = name + 10;
+		rfc2217 = 1;
+	} else {
+		ERROR (context, "Invalid url.");
+		return DC_STATUS_INVALIDARGS;
+	}
+
+	char host[256] = {0};
+	const char *separator = NULL;
+	if (address[0] == '[') {
+		// IPv6 address.
+		const char *end = strchr (address, ']');
+		if (end == NULL || end[1] != ':' || end - address - 1 >= (long) sizeof (host)) {
+			ERROR (context, "Invalid address.");
+			return DC_STATUS_INVALIDARGS;
+		}
+		memcpy (host, address + 1, end - address - 1);
+		separator = end + 1;
+	} else {
+		separator = strrchr (address, ':');
+		if (separator == NULL || separator - address >= (long) sizeof (host)) {
+			ERROR (context, "Invalid address.");
+			return DC_STATUS_INVALIDARGS;
+		}
+		memcpy (host, address, separator - address);
+	}
+	const char *port = separator + 1;
+
+	// Allocate memory.
+	dc_serial_tcp_t *device = (dc_serial_tcp_t *) dc_serial_allocate (context, &dc_serial_tcp_vtable);
+	if (device == NULL) {
+		return DC_STATUS_NOMEMORY;
+	}
+
+	device->fd = S_INVALID;
+	device->timeout = -1;
+	device->rfc2217 = rfc2217;
+	device->state = STATE_DATA;
+	device->command = 0;
+	device->txlen = 0;
+	device->rxpos = 0;
+	device->rxlen = 0;
+
+#ifdef _WIN32
+	// Initialize the winsock dll.
+	WSADATA wsaData;
+	WORD wVersionRequested = MAKEWORD (2, 2);
+	int rc = WSAStartup (wVersionRequested, &wsaData);
+	if (rc != 0) {
+		SYSERROR (context, rc);
+		status = DC_STATUS_UNSUPPORTED;
+		goto error_free;
+	}
+#endif
+
+	// Resolve the address.
+	struct addrinfo hints, *info = NULL;
+	memset (&hints, 0, sizeof (hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_protocol = IPPROTO_TCP;
+	if (getaddrinfo (host, port, &hints, &info) != 0) {
+		ERROR (context, "Failed to resolve the address.");
+		status = DC_STATUS_NODEVICE;
+		goto error_wsacleanup;
+	}
+
+	// Connect to the first address that works.
+	s_errcode_t errcode = 0;
+	for (struct addrinfo *ai = info; ai != NULL; ai = ai->ai_next) {
+		device->fd = socket (ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if (device->fd == S_INVALID) {
+			errcode = S_ERRNO;
+			continue;
+		}
+
+		if (connect (device->fd, ai->ai_addr, ai->ai_addrlen) == 0)
+			break;
+
+		errcode = S_ERRNO;
+		S_CLOSE (device->fd);
+		device->fd = S_INVALID;
+	}
+	freeaddrinfo (info);
+	if (device->fd == S_INVALID) {
+		SYSERROR (context, errcode);
+		status = syserror (errcode);
+		goto error_wsacleanup;
+	}
+
+	// Send every packet immediately. The small protocol writes are
+	// coalesced in the buffer instead, and sent as a single segment.
+	int nodelay = 1;
+	if (setsockopt (device->fd, IPPROTO_TCP, TCP_NODELAY, (const char *) &nodelay, sizeof (nodelay)) != 0) {
+		WARNING (context, "Failed to disable the Nagle algorithm.");
+	}
+
+	if (rfc2217) {
+		// Announce the binary transmission and the com port control.
+		const unsigned char negotiation[] = {
+			IAC, WILL, OPT_BINARY,
+			IAC, DO, OPT_BINARY,
+			IAC, WILL, OPT_SGA,
+			IAC, DO, OPT_SGA,
+			IAC, WILL, OPT_COMPORT};
+		status = dc_serial_tcp_send (device, negotiation, sizeof (negotiation));
+		if (status != DC_STATUS_SUCCESS) {
+			goto error_close;
+		}
+	}
+
+	*out = (dc_serial_t *) device;
+
+	return DC_STATUS_SUCCESS;
+
+error_close:
+	S_CLOSE (device->fd);
+error_wsacleanup:
+#ifdef _WIN32
+	WSACleanup ();
+error_free:
+#endif
+	dc_serial_deallocate ((dc_serial_t *) device);
+	return status;
+}
+
+static dc_status_t
+dc_serial_tcp_close (dc_serial_t *abstract)
+{
+	dc_serial_tcp_t *device = (dc_serial_tcp_t *) abstract;
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	dc_status_set_error(&status, dc_serial_tcp_push (device));
+
+	// Close the socket.
+	if (S_CLOSE (device->fd) != 0) {
+		s_errcode_t errcode = S_ERRNO;
+		SYSERROR (abstract->context, errcode);
+		dc_status_set_error(&status, syserror (errcode));
+	}
+
+#ifdef _WIN32
+	// Terminate the winsock dll.
+	if (WSACleanup () != 0) {
+		s_errcode_t errcode = S_ERRNO;
+		SYSERROR (abstract->context, errcode);
+		dc_status_set_error(&status, syserror (errcode));
+	}
+#endif
+
+	return status;
+}
+
+static dc_status_t
+dc_serial_tcp_configure (dc_serial_t *abstract, unsigned int baudrate, unsigned int databits, dc_parity_t parity, dc_stopbits_t stopbits, dc_flowcontrol_t flowcontrol)
+{
+	dc_serial_tcp_t *device = (dc_serial_tcp_t *) abstract;
+	dc_status_t rc = DC_STATUS_SUCCESS;
+
+	INFO (abstract->context, "Configure: baudrate=%i, databits=%i, parity=%i, stopbits=%i, flowcontrol=%i",
+		baudrate, databits, parity, stopbits, flowcontrol);
+
+	// A raw connection uses the settings of the server.
+	if (!device->rfc2217)
+		return DC_STATUS_SUCCESS;
+
+	unsigned int value = 0;
+	switch (parity) {
+	case DC_PARITY_NONE:
+		value = 1;
+		break;
+	case DC_PARITY_ODD:
+		value = 2;
+		break;
+	case DC_PARITY_EVEN:
+		value = 3;
+		break;
+	case DC_PARITY_MARK:
+		value = 4;
+		break;
+	case DC_PARITY_SPACE:
+		value = 5;
+		break;
+	default:
+		return DC_STATUS_INVALIDARGS;
+	}
+
+	unsigned int stopsize = 0;
+	switch (stopbits) {
+	case DC_STOPBITS_ONE:
+		stopsize = 1;
+		break;
+	case DC_STOPBITS_TWO:
+		stopsize = 2;
+		break;
+	case DC_STOPBITS_ONEPOINTFIVE:
+		stopsize = 3;
+		break;
+	default:
+		return DC_STATUS_INVALIDARGS;
+	}
+
+	unsigned int control = 0;
+	switch (flowcontrol) {
+	case DC_FLOWCONTROL_NONE:
+		control = 1;
+		break;
+	case DC_FLOWCONTROL_SOFTWARE:
+		control = 2;
+		break;
+	case DC_FLOWCONTROL_HARDWARE:
+		control = 3;
+		break;
+	default:
+		return DC_STATUS_INVALIDARGS;
+	}
+
+	if ((rc = dc_serial_tcp_comport (device, COMPORT_SET_BAUDRATE, baudrate, 4)) != DC_STATUS_SUCCESS ||
+		(rc = dc_serial_tcp_comport (device, COMPORT_SET_DATASIZE, databits, 1)) != DC_STATUS_SUCCESS ||
+		(rc = dc_serial_tcp_comport (device, COMPORT_SET_PARITY, value, 1)) != DC_STATUS_SUCCESS ||
+		(rc = dc_serial_tcp_comport (device, COMPORT_SET_STOPSIZE, stopsize, 1)) != DC_STATUS_SUCCESS ||
+		(rc = dc_serial_tcp_comport (device, COMPORT_SET_CONTROL, control, 1)) != DC_STATUS_SUCCESS)
+		return rc;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_serial_tcp_set_value (dc_serial_t *abstract, unsigned int value)
+{
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_serial_tcp_set_timeout (dc_serial_t *abstract, int timeout)
+{
+	dc_serial_tcp_t *device = (dc_serial_tcp_t *) abstract;
+
+	INFO (abstract->context, "Timeout: value=%i", timeout);
+
+	device->timeout = timeout;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_serial_tcp_read (dc_serial_t *abstract, void *data, size_t size, size_t *actual)
+{
+	dc_serial_tcp_t *device = (dc_serial_tcp_t *) abstract;
+	dc_status_t status = DC_STATUS_SUCCESS;
+	unsigned long long begin = 0;
+	size_t nbytes = 0;
+
+	if (dc_context_is_tracing (abstract->context))
+		begin = dc_context_clock ();
+
+	// The answer can only arrive after the request was sent.
+	status = dc_serial_tcp_push (device);
+	if (status != DC_STATUS_SUCCESS)
+		goto out;
+
+	unsigned long long start = dc_context_clock ();
+	while (nbytes < size) {
+		if (device->rxpos == device->rxlen) {
+			// Calculate the remaining timeout.
+			int timeout = device->timeout;
+			if (timeout > 0) {
+				unsigned long long elapsed = (dc_context_clock () - start) / 1000;
+				timeout = elapsed < (unsigned int) device->timeout ? device->timeout - elapsed : 0;
+			}
+
+			status = dc_serial_tcp_wait (device, timeout);
+			if (status == DC_STATUS_TIMEOUT)
+				break;
+			if (status != DC_STATUS_SUCCESS)
+				goto out;
+
+			status = dc_serial_tcp_receive (device);
+			if (status != DC_STATUS_SUCCESS)
+				goto out;
+
+			continue;
+		}
+
+		size_t n = device->rxlen - device->rxpos;
+		if (n > size - nbytes)
+			n = size - nbytes;
+
+		memcpy ((unsigned char *) data + nbytes, device->rx + device->rxpos, n);
+		device->rxpos += n;
+		nbytes += n;
+	}
+
+	status = (nbytes == size) ? DC_STATUS_SUCCESS : DC_STATUS_TIMEOUT;
+
+out:
+	dc_context_trace (abstract->context, DC_TRACE_READ, status, begin, data, nbytes);
+
+	HEXDUMP (abstract->context, DC_LOGLEVEL_INFO, "Read", (unsigned char *) data, nbytes);
+
+	if (actual)
+		*actual = nbytes;
+
+	return status;
+}
+
+static dc_status_t
+dc_serial_tcp_write (dc_serial_t *abstract, const void *data, size_t size, size_t *actual)
+{
+	dc_serial_tcp_t *device = (dc_serial_tcp_t *) abstract;
+	dc_status_t status = DC_STATUS_SUCCESS;
+	unsigned long long begin = 0;
+	size_t nbytes = 0;
+
+	if (dc_context_is_tracing (abstract->context))
+		begin = dc_context_clock ();
+
+	// Collect the data until the next read, to send a whole request in a
+	// single segment instead of one round trip per write.
+	const unsigned char *p = (const unsigned char *) data;
+	while (nbytes < size) {
+		if (device->txlen + 2 > sizeof (device->tx)) {
+			status = dc_serial_tcp_push (device);
+			if (status != DC_STATUS_SUCCESS)
+				break;
+		}
+
+		device->tx[device->txlen++] = p[nbytes];
+		if (device->rfc2217 && p[nbytes] == IAC)
+			device->tx[device->txlen++] = IAC;
+		nbytes++;
+	}
+
+	dc_context_trace (abstract->context, DC_TRACE_WRITE, status, begin, data, nbytes);
+
+	HEXDUMP (abstract->context, DC_LOGLEVEL_INFO, "Write", (const unsigned char *) data, nbytes);
+
+	if (actual)
+		*actual = nbytes;
+
+	return status;
+}
+
+static dc_status_t
+dc_serial_tcp_flush (dc_serial_t *abstract)
+{
+	dc_serial_tcp_t *device = (dc_serial_tcp_t *) abstract;
+
+	return dc_serial_tcp_push (device);
+}
+
+static dc_status_t
+dc_serial_tcp_purge (dc_serial_t *abstract, dc_direction_t direction)
+{
+	dc_serial_tcp_t *device = (dc_serial_tcp_t *) abstract;
+	dc_status_t rc = DC_STATUS_SUCCESS;
+
+	INFO (abstract->context, "Purge: direction=%u", direction);
+
+	unsigned int value = 0;
+	if (direction & DC_DIRECTION_INPUT)
+		value |= 1;
+	if (direction & DC_DIRECTION_OUTPUT)
+		value |= 2;
+
+	if (direction & DC_DIRECTION_OUTPUT) {
+		device->txlen = 0;
+	}
+
+	// Purge the buffers of the server too.
+	rc = dc_serial_tcp_comport (device, COMPORT_PURGE_DATA, value, 1);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	if (direction & DC_DIRECTION_INPUT) {
+		// Discard the data that is already in transit.
+		device->rxpos = device->rxlen = 0;
+		while ((rc = dc_serial_tcp_wait (device, 0)) == DC_STATUS_SUCCESS) {
+			rc = dc_serial_tcp_receive (device);
+			if (rc != DC_STATUS_SUCCESS)
+				return rc;
+		}
+		device->rxpos = device->rxlen = 0;
+	}
+
+	return (rc == DC_STATUS_TIMEOUT) ? DC_STATUS_SUCCESS : rc;
+}
+
+static dc_status_t
+dc_serial_tcp_set_break (dc_serial_t *abstract, unsigned int value)
+{
+	dc_serial_tcp_t *device = (dc_serial_tcp_t *) abstract;
+
+	INFO (abstract->context, "Break: value=%i", value);
+
+	return dc_serial_tcp_comport (device, COMPORT_SET_CONTROL, value ? 5 : 6, 1);
+}
+
+static dc_status_t
+dc_serial_tcp_set_dtr (dc_serial_t *abstract, unsigned int value)
+{
+	dc_serial_tcp_t *device = (dc_serial_tcp_t *) abstract;
+
+	INFO (abstract->context, "DTR: value=%i", value);
+
+	return dc_serial_tcp_comport (device, COMPORT_SET_CONTROL, value ? 8 : 9, 1);
+}
+
+static dc_status_t
+dc_serial_tcp_set_rts (dc_serial_t *abstract, unsigned int value)
+{
+	dc_serial_tcp_t *device = (dc_serial_tcp_t *) abstract;
+
+	INFO (abstract->context, "RTS: value=%i", value);
+
+	return dc_serial_tcp_comport (device, COMPORT_SET_CONTROL, value ? 11 : 12, 1);
+}
+
+static dc_status_t
+dc_serial_tcp_get_available (dc_serial_t *abstract, size_t *value)
+{
+	dc_serial_tcp_t *device = (dc_serial_tcp_t *) abstract;
+
+	dc_status_t rc = dc_serial_tcp_push (device);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	// Pick up the data that already arrived.
+	if (device->rxpos == device->rxlen) {
+		rc = dc_serial_tcp_wait (device, 0);
+		if (rc == DC_STATUS_SUCCESS)
+			rc = dc_serial_tcp_receive (device);
+		if (rc != DC_STATUS_SUCCESS && rc != DC_STATUS_TIMEOUT)
+			return rc;
+	}
+
+	if (value)
+		*value = device->rxlen - device->rxpos;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_serial_tcp_poll (dc_serial_t *abstract, int timeout)
+{
+	dc_serial_tcp_t *device = (dc_serial_tcp_t *) abstract;
+
+	dc_status_t rc = dc_serial_tcp_push (device);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	// Telnet commands arrive without any data, so wait until there is
+	// data left after stripping them.
+	unsigned long long begin = dc_context_clock ();
+	while (device->rxpos == device->rxlen) {
+		int remaining = timeout;
+		if (timeout > 0) {
+			unsigned long long elapsed = (dc_context_clock () - begin) / 1000;
+			remaining = elapsed < (unsigned int) timeout ? timeout - elapsed : 0;
+		}
+
+		rc = dc_serial_tcp_wait (device, remaining);
+		if (rc != DC_STATUS_SUCCESS)
+			return rc;
+
+		rc = dc_serial_tcp_receive (device);
+		if (rc != DC_STATUS_SUCCESS)
+			return rc;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_serial_tcp_get_lines (dc_serial_t *abstract, unsigned int *value)
+{
+	if (value)
+		*value = 0;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_serial_tcp_sleep (dc_serial_t *abstract, unsigned int milliseconds)
+{
+	dc_serial_tcp_t *device = (dc_serial_tcp_t *) abstract;
+
+	// The device can only react to data that was sent.
+	dc_status_t rc = dc_serial_tcp_push (device);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	INFO (abstract->context, "Sleep: value=%u", milliseconds);
+
+	return dc_serial_msleep (milliseconds);
+}
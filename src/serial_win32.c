@@ -19,22 +19,31 @@
  * MA 02110-1301 USA
  */
 
+#define DC_LOG_CATEGORY DC_LOGCATEGORY_TRANSPORT
+
 #include <stdlib.h>
 
 #define NOGDI
 #include <windows.h>
 
-#include "serial.h"
+#include "serial-private.h"
+#include "transcript.h"
 #include "common-private.h"
 #include "context-private.h"
 
-struct dc_serial_t {
-	/* Library context. */
-	dc_context_t *context;
+typedef struct dc_serial_win32_t {
+	/* Base class. */
+	dc_serial_t base;
 	/*
 	 * The file descriptor corresponding to the serial port.
 	 */
 	HANDLE hFile;
+	/*
+	 * The events used for waiting on the completion of the
+	 * overlapped read and write operations.
+	 */
+	HANDLE hReadEvent;
+	HANDLE hWriteEvent;
 	/*
 	 * Serial port settings are saved into this variables immediately
 	 * after the port is opened. These settings are restored when the
@@ -46,8 +55,86 @@ struct dc_serial_t {
 	int halfduplex;
 	unsigned int baudrate;
 	unsigned int nbits;
+	/* Record and replay transcripts. */
+	dc_transcript_t *record;
+	dc_transcript_t *replay;
+} dc_serial_win32_t;
+
+static dc_status_t dc_serial_win32_configure (dc_serial_t *abstract, unsigned int baudrate, unsigned int databits, dc_parity_t parity, dc_stopbits_t stopbits, dc_flowcontrol_t flowcontrol);
+static dc_status_t dc_serial_win32_set_timeout (dc_serial_t *abstract, int timeout);
+static dc_status_t dc_serial_win32_set_halfduplex (dc_serial_t *abstract, unsigned int value);
+static dc_status_t dc_serial_win32_set_latency (dc_serial_t *abstract, unsigned int value);
+static dc_status_t dc_serial_win32_read (dc_serial_t *abstract, void *data, size_t size, size_t *actual);
+static dc_status_t dc_serial_win32_write (dc_serial_t *abstract, const void *data, size_t size, size_t *actual);
+static dc_status_t dc_serial_win32_flush (dc_serial_t *abstract);
+static dc_status_t dc_serial_win32_purge (dc_serial_t *abstract, dc_direction_t direction);
+static dc_status_t dc_serial_win32_set_break (dc_serial_t *abstract, unsigned int level);
+static dc_status_t dc_serial_win32_set_dtr (dc_serial_t *abstract, unsigned int level);
+static dc_status_t dc_serial_win32_set_rts (dc_serial_t *abstract, unsigned int level);
+static dc_status_t dc_serial_win32_get_available (dc_serial_t *abstract, size_t *value);
+static dc_status_t dc_serial_win32_poll (dc_serial_t *abstract, int timeout);
+static dc_status_t dc_serial_win32_get_lines (dc_serial_t *abstract, unsigned int *value);
+static dc_status_t dc_serial_win32_sleep (dc_serial_t *abstract, unsigned int timeout);
+static dc_status_t dc_serial_win32_close (dc_serial_t *abstract);
+
+static const dc_serial_vtable_t dc_serial_win32_vtable = {
+	sizeof(dc_serial_win32_t),
+	dc_serial_win32_configure, /* configure */
+	dc_serial_win32_set_timeout, /* set_timeout */
+	dc_serial_win32_set_halfduplex, /* set_halfduplex */
+	dc_serial_win32_set_latency, /* set_latency */
+	dc_serial_win32_read, /* read */
+	dc_serial_win32_write, /* write */
+	NULL, /* readv */
+	NULL, /* writev */
+	dc_serial_win32_flush, /* flush */
+	dc_serial_win32_purge, /* purge */
+	dc_serial_win32_set_break, /* set_break */
+	dc_serial_win32_set_dtr, /* set_dtr */
+	dc_serial_win32_set_rts, /* set_rts */
+	dc_serial_win32_get_available, /* get_available */
+	dc_serial_win32_poll, /* poll */
+	dc_serial_win32_get_lines, /* get_lines */
+	dc_serial_win32_sleep, /* sleep */
+	dc_serial_win32_close, /* close */
 };
 
+/*
+ * The maximum time (in milliseconds) to wait for data, before checking
+ * the cancellation callback.
+ */
+#define SLICE 100
+
+/*
+ * Wait for an overlapped operation, checking the cancellation callback
+ * regularly. Returns non-zero if the operation was cancelled.
+ */
+static int
+dc_serial_wait (dc_serial_win32_t *device, HANDLE hEvent, DWORD timeout)
+{
+	if (device->base.cancel_callback == NULL) {
+		WaitForSingleObject (hEvent, timeout);
+		return 0;
+	}
+
+	DWORD remaining = timeout;
+	while (remaining) {
+		DWORD wait = remaining < SLICE ? remaining : SLICE;
+		if (WaitForSingleObject (hEvent, wait) != WAIT_TIMEOUT)
+			return 0;
+
+		if (remaining != INFINITE)
+			remaining -= wait;
+
+		if (dc_serial_is_cancelled (&device->base)) {
+			CancelIo (device->hFile);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
 static dc_status_t
 syserror(DWORD errcode)
 {
@@ -127,6 +214,14 @@ dc_serial_open (dc_serial_t **out, dc_context_t *context, const char *name)
 	if (out == NULL)
 		return DC_STATUS_INVALIDARGS;
 
+	const char *replay = dc_context_get_replay (context);
+	if (replay)
+		return dc_serial_replay_open (out, context, replay);
+
+	// Serial port servers on the network.
+	if (name && (strncmp (name, "tcp://", 6) == 0 || strncmp (name, "rfc2217://", 10) == 0))
+		return dc_serial_tcp_open (out, context, name);
+
 	INFO (context, "Open: name=%s", name ? name : "");
 
 	// Build the device name.
@@ -143,32 +238,41 @@ dc_serial_open (dc_serial_t **out, dc_context_t *context, const char *name)
 	}
 
 	// Allocate memory.
-	dc_serial_t *device = (dc_serial_t *) malloc (sizeof (dc_serial_t));
+	dc_serial_win32_t *device = (dc_serial_win32_t *) dc_serial_allocate (context, &dc_serial_win32_vtable);
 	if (device == NULL) {
-		SYSERROR (context, ERROR_OUTOFMEMORY);
 		return DC_STATUS_NOMEMORY;
 	}
 
-	// Library context.
-	device->context = context;
-
 	// Default to full-duplex.
-	device->halfduplex = 0;
+	device->halfduplex = DC_HALFDUPLEX_NONE;
 	device->baudrate = 0;
 	device->nbits = 0;
 
+	device->record = NULL;
+	device->replay = NULL;
+
+	// Create the events for the overlapped I/O.
+	device->hReadEvent = CreateEvent (NULL, TRUE, FALSE, NULL);
+	device->hWriteEvent = CreateEvent (NULL, TRUE, FALSE, NULL);
+	if (device->hReadEvent == NULL || device->hWriteEvent == NULL) {
+		DWORD errcode = GetLastError ();
+		SYSERROR (context, errcode);
+		status = syserror (errcode);
+		goto error_event;
+	}
+
 	// Open the device.
 	device->hFile = CreateFileA (devname,
 			GENERIC_READ | GENERIC_WRITE, 0,
 			NULL, // No security attributes.
 			OPEN_EXISTING,
-			0, // Non-overlapped I/O.
+			FILE_FLAG_OVERLAPPED,
 			NULL);
 	if (device->hFile == INVALID_HANDLE_VALUE) {
 		DWORD errcode = GetLastError ();
 		SYSERROR (context, errcode);
 		status = syserror (errcode);
-		goto error_free;
+		goto error_event;
 	}
 
 	// Retrieve the current communication settings and timeouts,
@@ -183,60 +287,123 @@ dc_serial_open (dc_serial_t **out, dc_context_t *context, const char *name)
 		goto error_close;
 	}
 
-	*out = device;
+	// Request larger driver buffers, so the driver can keep receiving
+	// the next packet while the previous one is still being processed.
+	// This is only a recommendation, and drivers are free to ignore it.
+	if (!SetupComm (device->hFile, 8192, 4096)) {
+		WARNING (context, "Failed to set the driver buffer sizes.");
+	}
+
+	// Start recording the transcript.
+	const char *record = dc_context_get_record (context);
+	if (record) {
+		status = dc_transcript_record (&device->record, context, record);
+		if (status != DC_STATUS_SUCCESS) {
+			goto error_close;
+		}
+	}
+
+	// Receive the data on a dedicated I/O thread. The transcript would
+	// record the reads of that thread instead of those of the protocol.
+	const dc_iothread_t *iothread = dc_context_get_iothread (context);
+	if (iothread && device->record == NULL)
+		return dc_serial_iothread_open (out, context, (dc_serial_t *) device, iothread);
+
+	*out = (dc_serial_t *) device;
 
 	return DC_STATUS_SUCCESS;
 
 error_close:
 	CloseHandle (device->hFile);
-error_free:
-	free (device);
+error_event:
+	if (device->hWriteEvent)
+		CloseHandle (device->hWriteEvent);
+	if (device->hReadEvent)
+		CloseHandle (device->hReadEvent);
+	dc_serial_deallocate ((dc_serial_t *) device);
 	return status;
 }
 
 dc_status_t
-dc_serial_close (dc_serial_t *device)
+dc_serial_replay_open (dc_serial_t **out, dc_context_t *context, const char *filename)
 {
 	dc_status_t status = DC_STATUS_SUCCESS;
 
-	if (device == NULL)
-		return DC_STATUS_SUCCESS;
+	if (out == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	INFO (context, "Replay: filename=%s", filename ? filename : "");
+
+	// Allocate memory.
+	dc_serial_win32_t *device = (dc_serial_win32_t *) dc_serial_allocate (context, &dc_serial_win32_vtable);
+	if (device == NULL) {
+		return DC_STATUS_NOMEMORY;
+	}
+
+	device->hFile = INVALID_HANDLE_VALUE;
+	device->hReadEvent = NULL;
+	device->hWriteEvent = NULL;
+	device->halfduplex = DC_HALFDUPLEX_NONE;
+	device->baudrate = 0;
+	device->nbits = 0;
+	device->record = NULL;
+
+	status = dc_transcript_replay (&device->replay, context, filename);
+	if (status != DC_STATUS_SUCCESS) {
+		dc_serial_deallocate ((dc_serial_t *) device);
+		return status;
+	}
+
+	*out = (dc_serial_t *) device;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+dc_serial_win32_close (dc_serial_t *abstract)
+{
+	dc_serial_win32_t *device = (dc_serial_win32_t *) abstract;
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (device->replay) {
+		return dc_transcript_close (device->replay);
+	}
+
+	dc_status_set_error(&status, dc_transcript_close (device->record));
 
 	// Restore the initial communication settings and timeouts.
 	if (!SetCommState (device->hFile, &device->dcb) ||
 		!SetCommTimeouts (device->hFile, &device->timeouts)) {
 		DWORD errcode = GetLastError ();
-		SYSERROR (device->context, errcode);
+		SYSERROR (device->base.context, errcode);
 		dc_status_set_error(&status, syserror (errcode));
 	}
 
 	// Close the device.
 	if (!CloseHandle (device->hFile)) {
 		DWORD errcode = GetLastError ();
-		SYSERROR (device->context, errcode);
+		SYSERROR (device->base.context, errcode);
 		dc_status_set_error(&status, syserror (errcode));
 	}
 
-	// Free memory.
-	free (device);
+	CloseHandle (device->hWriteEvent);
+	CloseHandle (device->hReadEvent);
 
 	return status;
 }
 
-dc_status_t
-dc_serial_configure (dc_serial_t *device, unsigned int baudrate, unsigned int databits, dc_parity_t parity, dc_stopbits_t stopbits, dc_flowcontrol_t flowcontrol)
+static dc_status_t
+dc_serial_win32_configure (dc_serial_t *abstract, unsigned int baudrate, unsigned int databits, dc_parity_t parity, dc_stopbits_t stopbits, dc_flowcontrol_t flowcontrol)
 {
-	if (device == NULL)
-		return DC_STATUS_INVALIDARGS;
-
-	INFO (device->context, "Configure: baudrate=%i, databits=%i, parity=%i, stopbits=%i, flowcontrol=%i",
+	dc_serial_win32_t *device = (dc_serial_win32_t *) abstract;
+	INFO (device->base.context, "Configure: baudrate=%i, databits=%i, parity=%i, stopbits=%i, flowcontrol=%i",
 		baudrate, databits, parity, stopbits, flowcontrol);
 
 	// Retrieve the current settings.
 	DCB dcb;
 	if (!GetCommState (device->hFile, &dcb)) {
 		DWORD errcode = GetLastError ();
-		SYSERROR (device->context, errcode);
+		SYSERROR (device->base.context, errcode);
 		return syserror (errcode);
 	}
 
@@ -326,7 +493,7 @@ dc_serial_configure (dc_serial_t *device, unsigned int baudrate, unsigned int da
 	// Apply the new settings.
 	if (!SetCommState (device->hFile, &dcb)) {
 		DWORD errcode = GetLastError ();
-		SYSERROR (device->context, errcode);
+		SYSERROR (device->base.context, errcode);
 		return syserror (errcode);
 	}
 
@@ -336,19 +503,20 @@ dc_serial_configure (dc_serial_t *device, unsigned int baudrate, unsigned int da
 	return DC_STATUS_SUCCESS;
 }
 
-dc_status_t
-dc_serial_set_timeout (dc_serial_t *device, int timeout)
+static dc_status_t
+dc_serial_win32_set_timeout (dc_serial_t *abstract, int timeout)
 {
-	if (device == NULL)
-		return DC_STATUS_INVALIDARGS;
+	dc_serial_win32_t *device = (dc_serial_win32_t *) abstract;
+	if (device->replay)
+		return DC_STATUS_SUCCESS;
 
-	INFO (device->context, "Timeout: value=%i", timeout);
+	INFO (device->base.context, "Timeout: value=%i", timeout);
 
 	// Retrieve the current timeouts.
 	COMMTIMEOUTS timeouts;
 	if (!GetCommTimeouts (device->hFile, &timeouts)) {
 		DWORD errcode = GetLastError ();
-		SYSERROR (device->context, errcode);
+		SYSERROR (device->base.context, errcode);
 		return syserror (errcode);
 	}
 
@@ -379,57 +547,102 @@ dc_serial_set_timeout (dc_serial_t *device, int timeout)
 	// Activate the new timeouts.
 	if (!SetCommTimeouts (device->hFile, &timeouts)) {
 		DWORD errcode = GetLastError ();
-		SYSERROR (device->context, errcode);
+		SYSERROR (device->base.context, errcode);
 		return syserror (errcode);
 	}
 
 	return DC_STATUS_SUCCESS;
 }
 
-dc_status_t
-dc_serial_set_halfduplex (dc_serial_t *device, unsigned int value)
+static dc_status_t
+dc_serial_win32_set_halfduplex (dc_serial_t *abstract, unsigned int value)
 {
-	if (device == NULL)
+	dc_serial_win32_t *device = (dc_serial_win32_t *) abstract;
+	if (value > DC_HALFDUPLEX_RS485)
 		return DC_STATUS_INVALIDARGS;
 
+	// There is no RS485 mode in the Windows serial API.
+	if (value == DC_HALFDUPLEX_RS485) {
+		if (!device->replay)
+			INFO (device->base.context, "RS485 mode not supported, using the timed emulation.");
+		value = DC_HALFDUPLEX_TIMED;
+	}
+
 	device->halfduplex = value;
 
 	return DC_STATUS_SUCCESS;
 }
 
-dc_status_t
-dc_serial_set_latency (dc_serial_t *device, unsigned int value)
+static dc_status_t
+dc_serial_win32_set_latency (dc_serial_t *abstract, unsigned int value)
 {
-	if (device == NULL)
-		return DC_STATUS_INVALIDARGS;
+	dc_serial_win32_t *device = (dc_serial_win32_t *) abstract;
+	if (device->replay)
+		return DC_STATUS_SUCCESS;
 
 	return DC_STATUS_SUCCESS;
 }
 
-dc_status_t
-dc_serial_read (dc_serial_t *device, void *data, size_t size, size_t *actual)
+static dc_status_t
+dc_serial_win32_read (dc_serial_t *abstract, void *data, size_t size, size_t *actual)
 {
+	dc_serial_win32_t *device = (dc_serial_win32_t *) abstract;
 	dc_status_t status = DC_STATUS_SUCCESS;
+	unsigned long long begin = 0;
 	DWORD dwRead = 0;
 
-	if (device == NULL) {
-		status = DC_STATUS_INVALIDARGS;
+	if (dc_context_is_tracing (device->base.context))
+		begin = dc_context_clock ();
+
+	if (device->replay) {
+		size_t nbytes = 0;
+		status = dc_transcript_read (device->replay, data, size, &nbytes);
+		dwRead = nbytes;
 		goto out;
 	}
 
-	if (!ReadFile (device->hFile, data, size, &dwRead, NULL)) {
+	// Start the overlapped read, and wait for its completion. The
+	// timeouts configured with SetCommTimeouts still apply.
+	OVERLAPPED overlapped = {0};
+	overlapped.hEvent = device->hReadEvent;
+	if (!ReadFile (device->hFile, data, size, NULL, &overlapped)) {
+		DWORD errcode = GetLastError ();
+		if (errcode != ERROR_IO_PENDING) {
+			SYSERROR (device->base.context, errcode);
+			status = syserror (errcode);
+			goto out;
+		}
+	}
+
+	// The timeouts of the driver end the read, so the wait itself only
+	// needs to check for a cancellation.
+	int cancelled = dc_serial_wait (device, overlapped.hEvent, INFINITE);
+
+	if (!GetOverlappedResult (device->hFile, &overlapped, &dwRead, TRUE)) {
 		DWORD errcode = GetLastError ();
-		SYSERROR (device->context, errcode);
+		if (cancelled && errcode == ERROR_OPERATION_ABORTED) {
+			status = DC_STATUS_CANCELLED;
+			goto out;
+		}
+		SYSERROR (device->base.context, errcode);
 		status = syserror (errcode);
 		goto out;
 	}
 
-	if (dwRead != size) {
+	if (cancelled) {
+		status = DC_STATUS_CANCELLED;
+	} else if (dwRead != size) {
 		status = DC_STATUS_TIMEOUT;
 	}
 
 out:
-	HEXDUMP (device->context, DC_LOGLEVEL_INFO, "Read", (unsigned char *) data, dwRead);
+	if (device->record) {
+		dc_transcript_append (device->record, DC_TRANSCRIPT_READ, status, data, dwRead);
+	}
+
+	dc_context_trace (device->base.context, DC_TRACE_READ, status, begin, data, dwRead);
+
+	HEXDUMP (device->base.context, DC_LOGLEVEL_INFO, "Read", (unsigned char *) data, dwRead);
 
 	if (actual)
 		*actual = dwRead;
@@ -437,47 +650,74 @@ out:
 	return status;
 }
 
-dc_status_t
-dc_serial_write (dc_serial_t *device, const void *data, size_t size, size_t *actual)
+static dc_status_t
+dc_serial_win32_write (dc_serial_t *abstract, const void *data, size_t size, size_t *actual)
 {
+	dc_serial_win32_t *device = (dc_serial_win32_t *) abstract;
 	dc_status_t status = DC_STATUS_SUCCESS;
+	unsigned long long begin = 0;
 	DWORD dwWritten = 0;
 
-	if (device == NULL) {
-		status = DC_STATUS_INVALIDARGS;
+	if (dc_context_is_tracing (device->base.context))
+		begin = dc_context_clock ();
+
+	if (device->replay) {
+		size_t nbytes = 0;
+		status = dc_transcript_write (device->replay, data, size, &nbytes);
+		dwWritten = nbytes;
 		goto out;
 	}
 
-	LARGE_INTEGER begin, end, freq;
-	if (device->halfduplex) {
+	LARGE_INTEGER tvb, tve, freq;
+	if (device->halfduplex == DC_HALFDUPLEX_TIMED) {
 		// Get the current time.
 		if (!QueryPerformanceFrequency(&freq) ||
-			!QueryPerformanceCounter(&begin)) {
+			!QueryPerformanceCounter(&tvb)) {
 			DWORD errcode = GetLastError ();
-			SYSERROR (device->context, errcode);
+			SYSERROR (device->base.context, errcode);
+			status = syserror (errcode);
+			goto out;
+		}
+	}
+
+	// Start the overlapped write, and wait for its completion.
+	OVERLAPPED overlapped = {0};
+	overlapped.hEvent = device->hWriteEvent;
+	if (!WriteFile (device->hFile, data, size, NULL, &overlapped)) {
+		DWORD errcode = GetLastError ();
+		if (errcode != ERROR_IO_PENDING) {
+			SYSERROR (device->base.context, errcode);
 			status = syserror (errcode);
 			goto out;
 		}
 	}
 
-	if (!WriteFile (device->hFile, data, size, &dwWritten, NULL)) {
+	if (!GetOverlappedResult (device->hFile, &overlapped, &dwWritten, TRUE)) {
 		DWORD errcode = GetLastError ();
-		SYSERROR (device->context, errcode);
+		SYSERROR (device->base.context, errcode);
 		status = syserror (errcode);
 		goto out;
 	}
 
-	if (device->halfduplex) {
+	if (device->halfduplex == DC_HALFDUPLEX_DRAIN) {
+		// Wait until all data has been transmitted.
+		if (!FlushFileBuffers (device->hFile)) {
+			DWORD errcode = GetLastError ();
+			SYSERROR (device->base.context, errcode);
+			status = syserror (errcode);
+			goto out;
+		}
+	} else if (device->halfduplex == DC_HALFDUPLEX_TIMED) {
 		// Get the current time.
-		if (!QueryPerformanceCounter(&end))  {
+		if (!QueryPerformanceCounter(&tve))  {
 			DWORD errcode = GetLastError ();
-			SYSERROR (device->context, errcode);
+			SYSERROR (device->base.context, errcode);
 			status = syserror (errcode);
 			goto out;
 		}
 
 		// Calculate the elapsed time (microseconds).
-		unsigned long elapsed = 1000000.0 * (end.QuadPart - begin.QuadPart) / freq.QuadPart + 0.5;
+		unsigned long elapsed = 1000000.0 * (tve.QuadPart - tvb.QuadPart) / freq.QuadPart + 0.5;
 
 		// Calculate the expected duration (microseconds). A 2 millisecond fudge
 		// factor is added because it improves the success rate significantly.
@@ -490,7 +730,7 @@ dc_serial_write (dc_serial_t *device, const void *data, size_t size, size_t *act
 			// The remaining time is rounded up to the nearest millisecond
 			// because the Windows Sleep() function doesn't have a higher
 			// resolution.
-			dc_serial_sleep (device, (remaining + 999) / 1000);
+			dc_serial_sleep (abstract, (remaining + 999) / 1000);
 		}
 	}
 
@@ -499,7 +739,13 @@ dc_serial_write (dc_serial_t *device, const void *data, size_t size, size_t *act
 	}
 
 out:
-	HEXDUMP (device->context, DC_LOGLEVEL_INFO, "Write", (unsigned char *) data, dwWritten);
+	if (device->record) {
+		dc_transcript_append (device->record, DC_TRANSCRIPT_WRITE, status, data, dwWritten);
+	}
+
+	dc_context_trace (device->base.context, DC_TRACE_WRITE, status, begin, data, dwWritten);
+
+	HEXDUMP (device->base.context, DC_LOGLEVEL_INFO, "Write", (unsigned char *) data, dwWritten);
 
 	if (actual)
 		*actual = dwWritten;
@@ -507,13 +753,14 @@ out:
 	return status;
 }
 
-dc_status_t
-dc_serial_purge (dc_serial_t *device, dc_direction_t direction)
+static dc_status_t
+dc_serial_win32_purge (dc_serial_t *abstract, dc_direction_t direction)
 {
-	if (device == NULL)
-		return DC_STATUS_INVALIDARGS;
+	dc_serial_win32_t *device = (dc_serial_win32_t *) abstract;
+	if (device->replay)
+		return DC_STATUS_SUCCESS;
 
-	INFO (device->context, "Purge: direction=%u", direction);
+	INFO (device->base.context, "Purge: direction=%u", direction);
 
 	DWORD flags = 0;
 
@@ -533,48 +780,47 @@ dc_serial_purge (dc_serial_t *device, dc_direction_t direction)
 
 	if (!PurgeComm (device->hFile, flags)) {
 		DWORD errcode = GetLastError ();
-		SYSERROR (device->context, errcode);
+		SYSERROR (device->base.context, errcode);
 		return syserror (errcode);
 	}
 
 	return DC_STATUS_SUCCESS;
 }
 
-dc_status_t
-dc_serial_flush (dc_serial_t *device)
+static dc_status_t
+dc_serial_win32_flush (dc_serial_t *abstract)
 {
-	if (device == NULL)
-		return DC_STATUS_INVALIDARGS;
-
-	INFO (device->context, "Flush: none");
+	dc_serial_win32_t *device = (dc_serial_win32_t *) abstract;
+	INFO (device->base.context, "Flush: none");
 
 	if (!FlushFileBuffers (device->hFile)) {
 		DWORD errcode = GetLastError ();
-		SYSERROR (device->context, errcode);
+		SYSERROR (device->base.context, errcode);
 		return syserror (errcode);
 	}
 
 	return DC_STATUS_SUCCESS;
 }
 
-dc_status_t
-dc_serial_set_break (dc_serial_t *device, unsigned int level)
+static dc_status_t
+dc_serial_win32_set_break (dc_serial_t *abstract, unsigned int level)
 {
-	if (device == NULL)
-		return DC_STATUS_INVALIDARGS;
+	dc_serial_win32_t *device = (dc_serial_win32_t *) abstract;
+	if (device->replay)
+		return DC_STATUS_SUCCESS;
 
-	INFO (device->context, "Break: value=%i", level);
+	INFO (device->base.context, "Break: value=%i", level);
 
 	if (level) {
 		if (!SetCommBreak (device->hFile)) {
 			DWORD errcode = GetLastError ();
-			SYSERROR (device->context, errcode);
+			SYSERROR (device->base.context, errcode);
 			return syserror (errcode);
 		}
 	} else {
 		if (!ClearCommBreak (device->hFile)) {
 			DWORD errcode = GetLastError ();
-			SYSERROR (device->context, errcode);
+			SYSERROR (device->base.context, errcode);
 			return syserror (errcode);
 		}
 	}
@@ -582,55 +828,61 @@ dc_serial_set_break (dc_serial_t *device, unsigned int level)
 	return DC_STATUS_SUCCESS;
 }
 
-dc_status_t
-dc_serial_set_dtr (dc_serial_t *device, unsigned int level)
+static dc_status_t
+dc_serial_win32_set_dtr (dc_serial_t *abstract, unsigned int level)
 {
-	if (device == NULL)
-		return DC_STATUS_INVALIDARGS;
+	dc_serial_win32_t *device = (dc_serial_win32_t *) abstract;
+	if (device->replay)
+		return DC_STATUS_SUCCESS;
 
-	INFO (device->context, "DTR: value=%i", level);
+	INFO (device->base.context, "DTR: value=%i", level);
 
 	int status = (level ? SETDTR : CLRDTR);
 
 	if (!EscapeCommFunction (device->hFile, status)) {
 		DWORD errcode = GetLastError ();
-		SYSERROR (device->context, errcode);
+		SYSERROR (device->base.context, errcode);
 		return syserror (errcode);
 	}
 
 	return DC_STATUS_SUCCESS;
 }
 
-dc_status_t
-dc_serial_set_rts (dc_serial_t *device, unsigned int level)
+static dc_status_t
+dc_serial_win32_set_rts (dc_serial_t *abstract, unsigned int level)
 {
-	if (device == NULL)
-		return DC_STATUS_INVALIDARGS;
+	dc_serial_win32_t *device = (dc_serial_win32_t *) abstract;
+	if (device->replay)
+		return DC_STATUS_SUCCESS;
 
-	INFO (device->context, "RTS: value=%i", level);
+	INFO (device->base.context, "RTS: value=%i", level);
 
 	int status = (level ? SETRTS : CLRRTS);
 
 	if (!EscapeCommFunction (device->hFile, status)) {
 		DWORD errcode = GetLastError ();
-		SYSERROR (device->context, errcode);
+		SYSERROR (device->base.context, errcode);
 		return syserror (errcode);
 	}
 
 	return DC_STATUS_SUCCESS;
 }
 
-dc_status_t
-dc_serial_get_available (dc_serial_t *device, size_t *value)
+static dc_status_t
+dc_serial_win32_get_available (dc_serial_t *abstract, size_t *value)
 {
-	if (device == NULL)
-		return DC_STATUS_INVALIDARGS;
+	dc_serial_win32_t *device = (dc_serial_win32_t *) abstract;
+	if (device->replay) {
+		if (value)
+			*value = dc_transcript_available (device->replay);
+		return DC_STATUS_SUCCESS;
+	}
 
 	COMSTAT stats;
 
 	if (!ClearCommError (device->hFile, NULL, &stats)) {
 		DWORD errcode = GetLastError ();
-		SYSERROR (device->context, errcode);
+		SYSERROR (device->base.context, errcode);
 		return syserror (errcode);
 	}
 
@@ -640,18 +892,85 @@ dc_serial_get_available (dc_serial_t *device, size_t *value)
 	return DC_STATUS_SUCCESS;
 }
 
-dc_status_t
-dc_serial_get_lines (dc_serial_t *device, unsigned int *value)
+static dc_status_t
+dc_serial_win32_poll (dc_serial_t *abstract, int timeout)
 {
+	dc_serial_win32_t *device = (dc_serial_win32_t *) abstract;
+	// The replayed answers are always available immediately.
+	if (device->replay)
+		return DC_STATUS_SUCCESS;
+
+	// Request a notification for every received character. The input
+	// buffer is checked only after enabling the notification, otherwise
+	// a character arriving in between would be missed.
+	if (!SetCommMask (device->hFile, EV_RXCHAR)) {
+		DWORD errcode = GetLastError ();
+		SYSERROR (device->base.context, errcode);
+		return syserror (errcode);
+	}
+
+	COMSTAT stats;
+	if (!ClearCommError (device->hFile, NULL, &stats)) {
+		DWORD errcode = GetLastError ();
+		SYSERROR (device->base.context, errcode);
+		return syserror (errcode);
+	}
+
+	if (stats.cbInQue)
+		return DC_STATUS_SUCCESS;
+
+	if (timeout == 0)
+		return DC_STATUS_TIMEOUT;
+
+	// Start the overlapped wait, and wait for its completion.
+	DWORD mask = 0;
+	OVERLAPPED overlapped = {0};
+	overlapped.hEvent = device->hReadEvent;
+	if (!WaitCommEvent (device->hFile, &mask, &overlapped)) {
+		DWORD errcode = GetLastError ();
+		if (errcode != ERROR_IO_PENDING) {
+			SYSERROR (device->base.context, errcode);
+			return syserror (errcode);
+		}
+
+		int cancelled = dc_serial_wait (device, overlapped.hEvent, timeout < 0 ? INFINITE : (DWORD) timeout);
+		if (WaitForSingleObject (overlapped.hEvent, 0) != WAIT_OBJECT_0) {
+			// Clearing the event mask completes the pending wait.
+			SetCommMask (device->hFile, 0);
+		}
+
+		DWORD dummy = 0;
+		if (!GetOverlappedResult (device->hFile, &overlapped, &dummy, TRUE)) {
+			DWORD errcode = GetLastError ();
+			if (cancelled && errcode == ERROR_OPERATION_ABORTED)
+				return DC_STATUS_CANCELLED;
+			SYSERROR (device->base.context, errcode);
+			return syserror (errcode);
+		}
+
+		if (cancelled)
+			return DC_STATUS_CANCELLED;
+	}
+
+	return (mask & EV_RXCHAR) ? DC_STATUS_SUCCESS : DC_STATUS_TIMEOUT;
+}
+
+static dc_status_t
+dc_serial_win32_get_lines (dc_serial_t *abstract, unsigned int *value)
+{
+	dc_serial_win32_t *device = (dc_serial_win32_t *) abstract;
 	unsigned int lines = 0;
 
-	if (device == NULL)
-		return DC_STATUS_INVALIDARGS;
+	if (device->replay) {
+		if (value)
+			*value = 0;
+		return DC_STATUS_SUCCESS;
+	}
 
 	DWORD stats = 0;
 	if (!GetCommModemStatus (device->hFile, &stats)) {
 		DWORD errcode = GetLastError ();
-		SYSERROR (device->context, errcode);
+		SYSERROR (device->base.context, errcode);
 		return syserror (errcode);
 	}
 
@@ -670,13 +989,14 @@ dc_serial_get_lines (dc_serial_t *device, unsigned int *value)
 	return DC_STATUS_SUCCESS;
 }
 
-dc_status_t
-dc_serial_sleep (dc_serial_t *device, unsigned int timeout)
+static dc_status_t
+dc_serial_win32_sleep (dc_serial_t *abstract, unsigned int timeout)
 {
-	if (device == NULL)
-		return DC_STATUS_INVALIDARGS;
+	dc_serial_win32_t *device = (dc_serial_win32_t *) abstract;
+	if (device->replay)
+		return DC_STATUS_SUCCESS;
 
-	INFO (device->context, "Sleep: value=%u", timeout);
+	INFO (device->base.context, "Sleep: value=%u", timeout);
 
 	Sleep (timeout);
 
@@ -0,0 +1,470 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <libdivecomputer/session.h>
+
+#include "context-private.h"
+#include "thread.h"
+
+#define PROGRESS_SCALE 1000
+
+typedef struct dc_session_entry_t {
+	dc_session_t *session;
+	unsigned int index;
+	dc_descriptor_t *descriptor;
+	char *name;
+	unsigned char *fingerprint;
+	unsigned int fsize;
+	dc_device_t *device;
+	/* Protected by the state mutex. */
+	dc_status_t status;
+	unsigned int current;
+	unsigned int finished;
+} dc_session_entry_t;
+
+struct dc_session_t {
+	dc_context_t *context;
+	unsigned int nthreads;
+	dc_syncstore_t *syncstore;
+	dc_session_entry_t *entries;
+	unsigned int count;
+	unsigned int running;
+	int cancelled;
+	/* Callbacks. */
+	unsigned int events;
+	dc_session_event_callback_t event_callback;
+	void *event_userdata;
+	dc_session_dive_callback_t dive_callback;
+	void *dive_userdata;
+	dc_session_device_callback_t device_callback;
+	void *device_userdata;
+	/* The state mutex protects the work queue and the status. */
+	dc_mutex_t *state;
+	unsigned int next;
+	/* The callback mutex serializes the application callbacks. */
+	dc_mutex_t *callback;
+};
+
+dc_status_t
+dc_session_new (dc_session_t **out, dc_context_t *context, unsigned int nthreads)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_session_t *session = NULL;
+
+	if (out == NULL || nthreads == 0) {
+		ERROR (context, "Invalid arguments.");
+		return DC_STATUS_INVALIDARGS;
+	}
+
+	session = (dc_session_t *) malloc (sizeof (dc_session_t));
+	if (session == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	memset (session, 0, sizeof (dc_session_t));
+	session->context = context;
+	session->nthreads = nthreads;
+
+	status = dc_mutex_new (&session->state);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (context, "Failed to create the mutex.");
+		goto error_free;
+	}
+
+	status = dc_mutex_new (&session->callback);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (context, "Failed to create the mutex.");
+		goto error_state_free;
+	}
+
+	*out = session;
+
+	return DC_STATUS_SUCCESS;
+
+error_state_free:
+	dc_mutex_free (session->state);
+error_free:
+	free (session);
+	return status;
+}
+
+dc_status_t
+dc_session_free (dc_session_t *session)
+{
+	if (session == NULL)
+		return DC_STATUS_SUCCESS;
+
+	if (session->running) {
+		ERROR (session->context, "The session is still running.");
+		return DC_STATUS_INVALIDARGS;
+	}
+
+	for (unsigned int i = 0; i < session->count; ++i) {
+		free (session->entries[i].name);
+		free (session->entries[i].fingerprint);
+	}
+	free (session->entries);
+
+	dc_mutex_free (session->callback);
+	dc_mutex_free (session->state);
+	free (session);
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_session_add (dc_session_t *session, dc_descriptor_t *descriptor, const char *name, const unsigned char fingerprint[], unsigned int fsize)
+{
+	if (session == NULL || descriptor == NULL || (fingerprint == NULL && fsize))
+		return DC_STATUS_INVALIDARGS;
+
+	if (session->running) {
+		ERROR (session->context, "The session is already running.");
+		return DC_STATUS_INVALIDARGS;
+	}
+
+	dc_session_entry_t *entries = (dc_session_entry_t *) realloc (session->entries, (session->count + 1) * sizeof (dc_session_entry_t));
+	if (entries == NULL) {
+		ERROR (session->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+	session->entries = entries;
+
+	dc_session_entry_t *entry = &session->entries[session->count];
+	memset (entry, 0, sizeof (dc_session_entry_t));
+	entry->descriptor = descriptor;
+
+	if (name) {
+		entry->name = strdup (name);
+		if (entry->name == NULL) {
+			ERROR (session->context, "Failed to allocate memory.");
+			return DC_STATUS_NOMEMORY;
+		}
+	}
+
+	if (fsize) {
+		entry->fingerprint = (unsigned char *) malloc (fsize);
+		if (entry->fingerprint == NULL) {
+			ERROR (session->context, "Failed to allocate memory.");
+			free (entry->name);
+			return DC_STATUS_NOMEMORY;
+		}
+		memcpy (entry->fingerprint, fingerprint, fsize);
+		entry->fsize = fsize;
+	}
+
+	session->count++;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_session_set_events (dc_session_t *session, unsigned int events, dc_session_event_callback_t callback, void *userdata)
+{
+	if (session == NULL || session->running)
+		return DC_STATUS_INVALIDARGS;
+
+	session->events = events;
+	session->event_callback = callback;
+	session->event_userdata = userdata;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_session_set_syncstore (dc_session_t *session, dc_syncstore_t *store)
+{
+	if (session == NULL || session->running)
+		return DC_STATUS_INVALIDARGS;
+
+	session->syncstore = store;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static int
+dc_session_cancel_cb (void *userdata)
+{
+	dc_session_entry_t *entry = (dc_session_entry_t *) userdata;
+
+	return dc_atomic_load (&entry->session->cancelled);
+}
+
+static void
+dc_session_event_cb (dc_device_t *device, dc_event_type_t event, const void *data, void *userdata)
+{
+	dc_session_entry_t *entry = (dc_session_entry_t *) userdata;
+	dc_session_t *session = entry->session;
+
+	if (event == DC_EVENT_PROGRESS) {
+		const dc_event_progress_t *progress = (const dc_event_progress_t *) data;
+		dc_mutex_lock (session->state);
+		entry->current = (unsigned long long) progress->current * PROGRESS_SCALE / progress->maximum;
+		dc_mutex_unlock (session->state);
+	}
+
+	if (session->event_callback && (session->events & event)) {
+		dc_mutex_lock (session->callback);
+		session->event_callback (entry->index, device, event, data, session->event_userdata);
+		dc_mutex_unlock (session->callback);
+	}
+}
+
+static int
+dc_session_dive_cb (const unsigned char *data, unsigned int size, const unsigned char *fingerprint, unsigned int fsize, void *userdata)
+{
+	dc_session_entry_t *entry = (dc_session_entry_t *) userdata;
+	dc_session_t *session = entry->session;
+	int rc = 1;
+
+	if (session->dive_callback) {
+		dc_mutex_lock (session->callback);
+		rc = session->dive_callback (entry->index, entry->device, data, size, fingerprint, fsize, session->dive_userdata);
+		dc_mutex_unlock (session->callback);
+	}
+
+	return rc;
+}
+
+static dc_status_t
+dc_session_process (dc_session_t *session, dc_session_entry_t *entry)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_device_t *device = NULL;
+
+	if (dc_atomic_load (&session->cancelled))
+		return DC_STATUS_CANCELLED;
+
+	status = dc_device_open (&device, session->context, entry->descriptor, entry->name);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (session->context, "Failed to open the device (%s).", entry->name ? entry->name : "null");
+		return status;
+	}
+
+	entry->device = device;
+
+	// The progress events are always needed for the aggregation.
+	dc_device_set_events (device, session->events | DC_EVENT_PROGRESS, dc_session_event_cb, entry);
+	dc_device_set_cancel (device, dc_session_cancel_cb, entry);
+
+	// A custom callback replaces the download.
+	if (session->device_callback) {
+		status = session->device_callback (entry->index, device, session->device_userdata);
+		goto cleanup;
+	}
+
+	if (entry->fsize) {
+		status = dc_device_set_fingerprint (device, entry->fingerprint, entry->fsize);
+		if (status != DC_STATUS_SUCCESS) {
+			ERROR (session->context, "Failed to register the fingerprint.");
+			goto cleanup;
+		}
+	} else if (session->syncstore) {
+		status = dc_device_set_syncstore (device, session->syncstore);
+		if (status != DC_STATUS_SUCCESS && status != DC_STATUS_UNSUPPORTED) {
+			ERROR (session->context, "Failed to register the sync store.");
+			goto cleanup;
+		}
+	}
+
+	status = dc_device_foreach (device, dc_session_dive_cb, entry);
+
+cleanup:
+	entry->device = NULL;
+	dc_device_close (device);
+	return status;
+}
+
+static void
+dc_session_worker (void *userdata)
+{
+	dc_session_t *session = (dc_session_t *) userdata;
+
+	while (1) {
+		// Take the next device from the queue.
+		dc_mutex_lock (session->state);
+		unsigned int index = session->next;
+		if (index < session->count)
+			session->next++;
+		dc_mutex_unlock (session->state);
+
+		if (index >= session->count)
+			break;
+
+		dc_session_entry_t *entry = &session->entries[index];
+		dc_status_t status = dc_session_process (session, entry);
+
+		dc_mutex_lock (session->state);
+		entry->status = status;
+		entry->current = PROGRESS_SCALE;
+		entry->finished = 1;
+		dc_mutex_unlock (session->state);
+	}
+}
+
+static dc_status_t
+dc_session_start (dc_session_t *session)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	session->running = 1;
+	session->cancelled = 0;
+	session->next = 0;
+
+	for (unsigned int i = 0; i < session->count; ++i) {
+		dc_session_entry_t *entry = &session->entries[i];
+		entry->session = session;
+		entry->index = i;
+		entry->device = NULL;
+		entry->status = DC_STATUS_SUCCESS;
+		entry->current = 0;
+		entry->finished = 0;
+	}
+
+	// Never start more threads than there are devices.
+	unsigned int nthreads = session->nthreads;
+	if (nthreads > session->count)
+		nthreads = session->count;
+
+	// The downloads block on the I/O for long periods, so they run on
+	// dedicated threads rather than on the thread pool of the context,
+	// which is reserved for the CPU bound work.
+	dc_thread_t **threads = NULL;
+	if (nthreads > 1) {
+		threads = (dc_thread_t **) calloc (nthreads - 1, sizeof (dc_thread_t *));
+		if (threads == NULL) {
+			ERROR (session->context, "Failed to allocate memory.");
+			session->running = 0;
+			return DC_STATUS_NOMEMORY;
+		}
+
+		// Start the additional worker threads. If a thread can't be
+		// created, the remaining work is simply shared by fewer threads.
+		for (unsigned int i = 0; i < nthreads - 1; ++i) {
+			if (dc_thread_new (&threads[i], dc_session_worker, session) != DC_STATUS_SUCCESS) {
+				WARNING (session->context, "Failed to create the thread.");
+				break;
+			}
+		}
+	}
+
+	// The calling thread is a worker too.
+	if (nthreads)
+		dc_session_worker (session);
+
+	if (threads) {
+		for (unsigned int i = 0; i < nthreads - 1; ++i) {
+			dc_thread_join (threads[i]);
+		}
+		free (threads);
+	}
+
+	for (unsigned int i = 0; i < session->count; ++i) {
+		if (session->entries[i].status != DC_STATUS_SUCCESS) {
+			status = session->entries[i].status;
+			break;
+		}
+	}
+
+	session->running = 0;
+
+	return status;
+}
+
+dc_status_t
+dc_session_run (dc_session_t *session, dc_session_dive_callback_t callback, void *userdata)
+{
+	if (session == NULL || session->running)
+		return DC_STATUS_INVALIDARGS;
+
+	session->dive_callback = callback;
+	session->dive_userdata = userdata;
+	session->device_callback = NULL;
+	session->device_userdata = NULL;
+
+	return dc_session_start (session);
+}
+
+dc_status_t
+dc_session_run_custom (dc_session_t *session, dc_session_device_callback_t callback, void *userdata)
+{
+	if (session == NULL || session->running || callback == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	session->dive_callback = NULL;
+	session->dive_userdata = NULL;
+	session->device_callback = callback;
+	session->device_userdata = userdata;
+
+	return dc_session_start (session);
+}
+
+dc_status_t
+dc_session_cancel (dc_session_t *session)
+{
+	if (session == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_atomic_store (&session->cancelled, 1);
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_session_get_status (dc_session_t *session, unsigned int index, dc_status_t *status)
+{
+	if (session == NULL || index >= session->count || status == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_mutex_lock (session->state);
+	*status = session->entries[index].status;
+	dc_mutex_unlock (session->state);
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_session_get_progress (dc_session_t *session, dc_event_progress_t *progress)
+{
+	if (session == NULL || progress == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	unsigned int current = 0;
+
+	dc_mutex_lock (session->state);
+	for (unsigned int i = 0; i < session->count; ++i) {
+		current += session->entries[i].current;
+	}
+	dc_mutex_unlock (session->state);
+
+	progress->current = current;
+	progress->maximum = session->count * PROGRESS_SCALE;
+	progress->version = 0;
+	progress->elapsed = 0;
+	progress->rate = 0;
+	progress->eta = 0;
+
+	return DC_STATUS_SUCCESS;
+}
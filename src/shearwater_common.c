@@ -48,6 +48,10 @@ shearwater_common_open (shearwater_common_device_t *device, dc_context_t *contex
 		return status;
 	}
 
+	// Interrupt the blocking reads when the download is cancelled, and
+	// measure the time spent waiting for the I/O.
+	device_set_port ((dc_device_t *) device, device->port);
+
 	// Set the serial communication protocol (115200 8N1).
 	status = dc_serial_configure (device->port, 115200, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -66,6 +70,7 @@ shearwater_common_open (shearwater_common_device_t *device, dc_context_t *contex
 	// Make sure everything is in a sane state.
 	dc_serial_sleep (device->port, 300);
 	dc_serial_purge (device->port, DC_DIRECTION_ALL);
+	device->rlen = device->rpos = 0;
 
 	return DC_STATUS_SUCCESS;
 
@@ -83,6 +88,10 @@ shearwater_common_custom_open (shearwater_common_device_t *device, dc_context_t
 	// Set the serial reference
 	device->port = port;
 
+	// Interrupt the blocking reads when the download is cancelled, and
+	// measure the time spent waiting for the I/O.
+	device_set_port ((dc_device_t *) device, device->port);
+
 //	if (port->type == DC_TRANSPORT_SERIAL) {
 	if (1) {
 		// Set the serial communication protocol (115200 8N1).
@@ -103,6 +112,7 @@ shearwater_common_custom_open (shearwater_common_device_t *device, dc_context_t
 	// Make sure everything is in a sane state.
 	dc_serial_sleep (device->port, 300);
 	dc_serial_purge (device->port, DC_DIRECTION_ALL);
+	device->rlen = device->rpos = 0;
 
 	return DC_STATUS_SUCCESS;
 
@@ -130,36 +140,63 @@ shearwater_common_decompress_lre (unsigned char *data, unsigned int size, dc_buf
 	if (nbits % 9 != 0)
 		return -1;
 
-	unsigned int offset = 0;
-	while (offset + 9 <= nbits) {
-		// Extract the 9 bit value.
-		unsigned int byte = offset / 8;
-		unsigned int bit  = offset % 8;
-		unsigned int shift = 16 - (bit + 9);
-		unsigned int value = (array_uint16_be (data + byte) >> shift) & 0x1FF;
-
-		// The 9th bit indicates whether the remaining 8 bits represent
-		// a run of zero bytes or not. If the bit is set, the value is
-		// not a run and doesn’t need expansion. If the bit is not set,
-		// the value contains the number of zero bytes in the run. A
-		// zero-length run indicates the end of the compressed stream.
-		if (value & 0x100) {
-			// Append the data byte directly.
-			unsigned char c = value & 0xFF;
-			if (!dc_buffer_append (buffer, &c, 1))
-				return -1;
-		} else if (value == 0) {
-			// Reached the end of the compressed stream.
-			if (isfinal)
-				*isfinal = 1;
-			break;
-		} else {
-			// Expand the run with zero bytes.
-			if (!dc_buffer_resize (buffer, dc_buffer_get_size (buffer) + value))
-				return -1;
+	unsigned char literals[8];
+	unsigned int nliterals = 0;
+
+	// Because 8 bits is coprime with 9 bits, the size is also a multiple
+	// of 9 bytes, and the stream consists of whole groups of eight values.
+	// Each group is unpacked from a single 64 bit word and one extra byte,
+	// rather than one value at a time.
+	for (unsigned int offset = 0; offset < size; offset += 9) {
+		const unsigned char *p = data + offset;
+		unsigned long long word =
+			((unsigned long long) array_uint32_be (p) << 32) |
+			array_uint32_be (p + 4);
+
+		unsigned int values[8];
+		for (unsigned int i = 0; i < 7; ++i)
+			values[i] = (word >> (55 - 9 * i)) & 0x1FF;
+		values[7] = ((word & 0x01) << 8) | p[8];
+
+		for (unsigned int i = 0; i < 8; ++i) {
+			unsigned int value = values[i];
+
+			// The 9th bit indicates whether the remaining 8 bits represent
+			// a run of zero bytes or not. If the bit is set, the value is
+			// not a run and doesn’t need expansion. If the bit is not set,
+			// the value contains the number of zero bytes in the run. A
+			// zero-length run indicates the end of the compressed stream.
+			if (value & 0x100) {
+				// Collect the data byte.
+				literals[nliterals++] = value & 0xFF;
+				continue;
+			}
+
+			// Flush the collected data bytes.
+			if (nliterals) {
+				if (!dc_buffer_append (buffer, literals, nliterals))
+					return -1;
+				nliterals = 0;
+			}
+
+			if (value == 0) {
+				// Reached the end of the compressed stream.
+				if (isfinal)
+					*isfinal = 1;
+				return 0;
+			} else {
+				// Expand the run with zero bytes.
+				if (!dc_buffer_resize (buffer, dc_buffer_get_size (buffer) + value))
+					return -1;
+			}
 		}
 
-		offset += 9;
+		// Flush the collected data bytes.
+		if (nliterals) {
+			if (!dc_buffer_append (buffer, literals, nliterals))
+				return -1;
+			nliterals = 0;
+		}
 	}
 
 	return 0;
@@ -167,11 +204,16 @@ shearwater_common_decompress_lre (unsigned char *data, unsigned int size, dc_buf
 
 
 static int
-shearwater_common_decompress_xor (unsigned char *data, unsigned int size)
+shearwater_common_decompress_xor (unsigned char *data, unsigned int offset, unsigned int size)
 {
 	// Each block of 32 bytes is XOR'ed (in-place) with the previous block,
-	// except for the first block, which is passed through unchanged.
-	for (unsigned int i = 32; i < size; ++i) {
+	// except for the first block, which is passed through unchanged. Every
+	// byte depends only on bytes that precede it, so the data can be
+	// processed incrementally, starting from the given offset.
+	if (offset < 32)
+		offset = 32;
+
+	for (unsigned int i = offset; i < size; ++i) {
 		data[i] ^= data[i - 32];
 	}
 
@@ -186,7 +228,10 @@ shearwater_common_slip_write (shearwater_common_device_t *device, const unsigned
 	const unsigned char end[] = {END};
 	const unsigned char esc_end[] = {ESC, ESC_END};
 	const unsigned char esc_esc[] = {ESC, ESC_ESC};
-	unsigned char buffer[32];
+	// Large enough for a fully escaped packet, such that every packet is
+	// sent with a single write. That matters on bluetooth serial links,
+	// where each write ends up in a separate packet.
+	unsigned char buffer[2 * (SZ_PACKET + 4) + 1];
 	unsigned int nbytes = 0;
 
 #if 0
@@ -248,6 +293,39 @@ shearwater_common_slip_write (shearwater_common_device_t *device, const unsigned
 }
 
 
+/*
+ * Get the next received character. Whatever has already arrived is pulled
+ * into the receive buffer at once, instead of reading one byte at a time.
+ */
+static dc_status_t
+shearwater_common_slip_getc (shearwater_common_device_t *device, unsigned char *c)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (device->rpos == device->rlen) {
+		size_t available = 0;
+		status = dc_serial_get_available (device->port, &available);
+		if (status != DC_STATUS_SUCCESS || available == 0)
+			available = 1;
+		if (available > sizeof (device->rbuf))
+			available = sizeof (device->rbuf);
+
+		size_t n = 0;
+		status = dc_serial_read (device->port, device->rbuf, available, &n);
+		if (status != DC_STATUS_SUCCESS) {
+			return status;
+		}
+
+		device->rlen = n;
+		device->rpos = 0;
+	}
+
+	*c = device->rbuf[device->rpos++];
+
+	return DC_STATUS_SUCCESS;
+}
+
+
 static dc_status_t
 shearwater_common_slip_read (shearwater_common_device_t *device, unsigned char data[], unsigned int size, unsigned int *actual)
 {
@@ -262,7 +340,7 @@ shearwater_common_slip_read (shearwater_common_device_t *device, unsigned char d
 		unsigned char c = 0;
 
 		// Get a single character to process.
-		status = dc_serial_read (device->port, &c, 1, NULL);
+		status = shearwater_common_slip_getc (device, &c);
 		if (status != DC_STATUS_SUCCESS) {
 			return status;
 		}
@@ -281,7 +359,7 @@ shearwater_common_slip_read (shearwater_common_device_t *device, unsigned char d
 		case ESC:
 			// If it's an ESC character, get another character and then
 			// figure out what to store in the packet based on that.
-			status = dc_serial_read (device->port, &c, 1, NULL);
+			status = shearwater_common_slip_getc (device, &c);
 			if (status != DC_STATUS_SUCCESS) {
 				return status;
 			}
@@ -317,15 +395,14 @@ done:
 }
 
 
-dc_status_t
-shearwater_common_transfer (shearwater_common_device_t *device, const unsigned char input[], unsigned int isize, unsigned char output[], unsigned int osize, unsigned int *actual)
+static dc_status_t
+shearwater_common_send (shearwater_common_device_t *device, const unsigned char input[], unsigned int isize)
 {
 	dc_status_t status = DC_STATUS_SUCCESS;
 	dc_device_t *abstract = (dc_device_t *) device;
 	unsigned char packet[SZ_PACKET + 4];
-	unsigned int n = 0;
 
-	if (isize > SZ_PACKET || osize > SZ_PACKET)
+	if (isize > SZ_PACKET)
 		return DC_STATUS_INVALIDARGS;
 
 	if (device_is_cancelled (abstract))
@@ -345,12 +422,20 @@ shearwater_common_transfer (shearwater_common_device_t *device, const unsigned c
 		return status;
 	}
 
-	// Return early if no response packet is requested.
-	if (osize == 0) {
-		if (actual)
-			*actual = 0;
-		return DC_STATUS_SUCCESS;
-	}
+	return DC_STATUS_SUCCESS;
+}
+
+
+static dc_status_t
+shearwater_common_receive (shearwater_common_device_t *device, unsigned char output[], unsigned int osize, unsigned int *actual)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_device_t *abstract = (dc_device_t *) device;
+	unsigned char packet[SZ_PACKET + 4];
+	unsigned int n = 0;
+
+	if (osize > SZ_PACKET)
+		return DC_STATUS_INVALIDARGS;
 
 	// Receive the response packet.
 	status = shearwater_common_slip_read (device, packet, sizeof (packet), &n);
@@ -381,12 +466,32 @@ shearwater_common_transfer (shearwater_common_device_t *device, const unsigned c
 
 
 dc_status_t
-shearwater_common_download (shearwater_common_device_t *device, dc_buffer_t *buffer, unsigned int address, unsigned int size, unsigned int compression)
+shearwater_common_transfer (shearwater_common_device_t *device, const unsigned char input[], unsigned int isize, unsigned char output[], unsigned int osize, unsigned int *actual)
 {
-	dc_device_t *abstract = (dc_device_t *) device;
-	dc_status_t rc = DC_STATUS_SUCCESS;
-	unsigned int n = 0;
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (isize > SZ_PACKET || osize > SZ_PACKET)
+		return DC_STATUS_INVALIDARGS;
 
+	status = shearwater_common_send (device, input, isize);
+	if (status != DC_STATUS_SUCCESS) {
+		return status;
+	}
+
+	// Return early if no response packet is requested.
+	if (osize == 0) {
+		if (actual)
+			*actual = 0;
+		return DC_STATUS_SUCCESS;
+	}
+
+	return shearwater_common_receive (device, output, osize, actual);
+}
+
+
+dc_status_t
+shearwater_common_download_init (shearwater_common_device_t *device, unsigned int address, unsigned int size, unsigned int compression)
+{
 	unsigned char req_init[] = {
 		0x35,
 		(compression ? 0x10 : 0x00),
@@ -398,23 +503,21 @@ shearwater_common_download (shearwater_common_device_t *device, dc_buffer_t *buf
 		(size >> 16) & 0xFF,
 		(size >>  8) & 0xFF,
 		(size      ) & 0xFF};
-	unsigned char req_block[] = {0x36, 0x00};
-	unsigned char req_quit[] = {0x37};
-	unsigned char response[SZ_PACKET];
 
-	// Erase the current contents of the buffer.
-	if (!dc_buffer_clear (buffer)) {
-		ERROR (abstract->context, "Insufficient buffer space available.");
-		return DC_STATUS_NOMEMORY;
-	}
+	return shearwater_common_send (device, req_init, sizeof (req_init));
+}
 
-	// Enable progress notifications.
-	dc_event_progress_t progress = EVENT_PROGRESS_INITIALIZER;
-	progress.maximum = 3 + size + 1;
-	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 
-	// Transfer the init request.
-	rc = shearwater_common_transfer (device, req_init, sizeof (req_init), response, 3, &n);
+dc_status_t
+shearwater_common_download_start (shearwater_common_device_t *device)
+{
+	dc_device_t *abstract = (dc_device_t *) device;
+	dc_status_t rc = DC_STATUS_SUCCESS;
+	unsigned char response[3];
+	unsigned int n = 0;
+
+	// Receive the init response.
+	rc = shearwater_common_receive (device, response, sizeof (response), &n);
 	if (rc != DC_STATUS_SUCCESS) {
 		return rc;
 	}
@@ -425,13 +528,30 @@ shearwater_common_download (shearwater_common_device_t *device, dc_buffer_t *buf
 		return DC_STATUS_PROTOCOL;
 	}
 
-	// Update and emit a progress event.
-	progress.current += 3;
-	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
+	return DC_STATUS_SUCCESS;
+}
+
+
+dc_status_t
+shearwater_common_download_blocks (shearwater_common_device_t *device, dc_buffer_t *buffer, unsigned int size, unsigned int compression, dc_event_progress_t *progress)
+{
+	dc_device_t *abstract = (dc_device_t *) device;
+	dc_status_t rc = DC_STATUS_SUCCESS;
+	unsigned char req_block[] = {0x36, 0x00};
+	unsigned char response[SZ_PACKET];
+	unsigned int n = 0;
+
+	// Erase the current contents of the buffer and
+	// pre-allocate the required amount of memory.
+	if (!dc_buffer_clear (buffer) || !dc_buffer_reserve (buffer, size)) {
+		ERROR (abstract->context, "Insufficient buffer space available.");
+		return DC_STATUS_NOMEMORY;
+	}
 
 	unsigned int done = 0;
 	unsigned char block = 1;
 	unsigned int nbytes = 0;
+	unsigned int decompressed = 0;
 	while (nbytes < size && !done) {
 		// Transfer the block request.
 		req_block[1] = block;
@@ -454,14 +574,25 @@ shearwater_common_download (shearwater_common_device_t *device, dc_buffer_t *buf
 		}
 
 		// Update and emit a progress event.
-		progress.current += length;
-		device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
+		if (progress) {
+			progress->current += length;
+			device_event_emit (abstract, DC_EVENT_PROGRESS, progress);
+		}
 
 		if (compression) {
 			if (shearwater_common_decompress_lre (response + 2, length, buffer, &done) != 0) {
 				ERROR (abstract->context, "Decompression error (LRE phase).");
 				return DC_STATUS_PROTOCOL;
 			}
+
+			// Undo the XOR on the newly decompressed data only, while
+			// it is still hot in the cache.
+			unsigned int total = dc_buffer_get_size (buffer);
+			if (shearwater_common_decompress_xor (dc_buffer_get_data (buffer), decompressed, total) != 0) {
+				ERROR (abstract->context, "Decompression error (XOR phase).");
+				return DC_STATUS_PROTOCOL;
+			}
+			decompressed = total;
 		} else {
 			if (!dc_buffer_append (buffer, response + 2, length)) {
 				ERROR (abstract->context, "Insufficient buffer space available.");
@@ -473,15 +604,29 @@ shearwater_common_download (shearwater_common_device_t *device, dc_buffer_t *buf
 		block++;
 	}
 
-	if (compression) {
-		if (shearwater_common_decompress_xor (dc_buffer_get_data (buffer), dc_buffer_get_size (buffer)) != 0) {
-			ERROR (abstract->context, "Decompression error (XOR phase).");
-			return DC_STATUS_PROTOCOL;
-		}
-	}
+	return DC_STATUS_SUCCESS;
+}
 
-	// Transfer the quit request.
-	rc = shearwater_common_transfer (device, req_quit, sizeof (req_quit), response, 2, &n);
+
+dc_status_t
+shearwater_common_download_quit (shearwater_common_device_t *device)
+{
+	unsigned char req_quit[] = {0x37};
+
+	return shearwater_common_send (device, req_quit, sizeof (req_quit));
+}
+
+
+dc_status_t
+shearwater_common_download_finish (shearwater_common_device_t *device)
+{
+	dc_device_t *abstract = (dc_device_t *) device;
+	dc_status_t rc = DC_STATUS_SUCCESS;
+	unsigned char response[2];
+	unsigned int n = 0;
+
+	// Receive the quit response.
+	rc = shearwater_common_receive (device, response, sizeof (response), &n);
 	if (rc != DC_STATUS_SUCCESS) {
 		return rc;
 	}
@@ -492,6 +637,53 @@ shearwater_common_download (shearwater_common_device_t *device, dc_buffer_t *buf
 		return DC_STATUS_PROTOCOL;
 	}
 
+	return DC_STATUS_SUCCESS;
+}
+
+
+dc_status_t
+shearwater_common_download (shearwater_common_device_t *device, dc_buffer_t *buffer, unsigned int address, unsigned int size, unsigned int compression)
+{
+	dc_device_t *abstract = (dc_device_t *) device;
+	dc_status_t rc = DC_STATUS_SUCCESS;
+
+	// Enable progress notifications.
+	dc_event_progress_t progress = EVENT_PROGRESS_INITIALIZER;
+	progress.maximum = 3 + size + 1;
+	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
+
+	// Transfer the init request.
+	rc = shearwater_common_download_init (device, address, size, compression);
+	if (rc != DC_STATUS_SUCCESS) {
+		return rc;
+	}
+
+	rc = shearwater_common_download_start (device);
+	if (rc != DC_STATUS_SUCCESS) {
+		return rc;
+	}
+
+	// Update and emit a progress event.
+	progress.current += 3;
+	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
+
+	// Transfer the data blocks.
+	rc = shearwater_common_download_blocks (device, buffer, size, compression, &progress);
+	if (rc != DC_STATUS_SUCCESS) {
+		return rc;
+	}
+
+	// Transfer the quit request.
+	rc = shearwater_common_download_quit (device);
+	if (rc != DC_STATUS_SUCCESS) {
+		return rc;
+	}
+
+	rc = shearwater_common_download_finish (device);
+	if (rc != DC_STATUS_SUCCESS) {
+		return rc;
+	}
+
 	// Update and emit a progress event.
 	progress.current += 1;
 	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
@@ -501,39 +693,58 @@ shearwater_common_download (shearwater_common_device_t *device, dc_buffer_t *buf
 
 
 dc_status_t
-shearwater_common_identifier (shearwater_common_device_t *device, dc_buffer_t *buffer, unsigned int id)
+shearwater_common_identifiers (shearwater_common_device_t *device, dc_buffer_t *buffers[], const unsigned int ids[], unsigned int count)
 {
 	dc_device_t *abstract = (dc_device_t *) device;
 	dc_status_t rc = DC_STATUS_SUCCESS;
 
-	// Erase the buffer.
-	if (!dc_buffer_clear (buffer)) {
-		ERROR (abstract->context, "Insufficient buffer space available.");
-		return DC_STATUS_NOMEMORY;
+	// Erase the buffers.
+	for (unsigned int i = 0; i < count; ++i) {
+		if (!dc_buffer_clear (buffers[i])) {
+			ERROR (abstract->context, "Insufficient buffer space available.");
+			return DC_STATUS_NOMEMORY;
+		}
 	}
 
-	// Transfer the request.
-	unsigned int n = 0;
-	unsigned char request[] = {0x22,
-		(id >> 8) & 0xFF,
-		(id     ) & 0xFF};
-	unsigned char response[SZ_PACKET];
-	rc = shearwater_common_transfer (device, request, sizeof (request), response, sizeof (response), &n);
-	if (rc != DC_STATUS_SUCCESS) {
-		return rc;
+	// Send all requests at once, and only then receive the responses,
+	// such that the identifiers take a single round trip together.
+	for (unsigned int i = 0; i < count; ++i) {
+		unsigned char request[] = {0x22,
+			(ids[i] >> 8) & 0xFF,
+			(ids[i]     ) & 0xFF};
+		rc = shearwater_common_send (device, request, sizeof (request));
+		if (rc != DC_STATUS_SUCCESS) {
+			return rc;
+		}
 	}
 
-	// Verify the response.
-	if (n < 3 || response[0] != 0x62 || response[1] != request[1] || response[2] != request[2]) {
-		ERROR (abstract->context, "Unexpected response packet.");
-		return DC_STATUS_PROTOCOL;
-	}
+	for (unsigned int i = 0; i < count; ++i) {
+		unsigned int n = 0;
+		unsigned char response[SZ_PACKET];
+		rc = shearwater_common_receive (device, response, sizeof (response), &n);
+		if (rc != DC_STATUS_SUCCESS) {
+			return rc;
+		}
 
-	// Append the packet to the output buffer.
-	if (!dc_buffer_append (buffer, response + 3, n - 3)) {
-		ERROR (abstract->context, "Insufficient buffer space available.");
-		return DC_STATUS_NOMEMORY;
+		// Verify the response.
+		if (n < 3 || response[0] != 0x62 || response[1] != ((ids[i] >> 8) & 0xFF) || response[2] != (ids[i] & 0xFF)) {
+			ERROR (abstract->context, "Unexpected response packet.");
+			return DC_STATUS_PROTOCOL;
+		}
+
+		// Append the packet to the output buffer.
+		if (!dc_buffer_append (buffers[i], response + 3, n - 3)) {
+			ERROR (abstract->context, "Insufficient buffer space available.");
+			return DC_STATUS_NOMEMORY;
+		}
 	}
 
 	return rc;
 }
+
+
+dc_status_t
+shearwater_common_identifier (shearwater_common_device_t *device, dc_buffer_t *buffer, unsigned int id)
+{
+	return shearwater_common_identifiers (device, &buffer, &id, 1);
+}
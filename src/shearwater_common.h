@@ -33,9 +33,14 @@ extern "C" {
 #define ID_SERIAL   0x8010
 #define ID_FIRMWARE 0x8011
 
+#define SZ_RBUF 512
+
 typedef struct shearwater_common_device_t {
 	dc_device_t base;
 	dc_serial_t *port;
+	// Receive buffer.
+	unsigned char rbuf[SZ_RBUF];
+	unsigned int rlen, rpos;
 } shearwater_common_device_t;
 
 dc_status_t
@@ -53,6 +58,33 @@ shearwater_common_transfer (shearwater_common_device_t *device, const unsigned c
 dc_status_t
 shearwater_common_download (shearwater_common_device_t *device, dc_buffer_t *buffer, unsigned int address, unsigned int size, unsigned int compression);
 
+/*
+ * The individual steps of a download, for callers that want to overlap
+ * the requests of consecutive downloads. The init and quit functions only
+ * send the request, the start and finish functions receive the matching
+ * response.
+ */
+dc_status_t
+shearwater_common_download_init (shearwater_common_device_t *device, unsigned int address, unsigned int size, unsigned int compression);
+
+dc_status_t
+shearwater_common_download_start (shearwater_common_device_t *device);
+
+dc_status_t
+shearwater_common_download_blocks (shearwater_common_device_t *device, dc_buffer_t *buffer, unsigned int size, unsigned int compression, dc_event_progress_t *progress);
+
+dc_status_t
+shearwater_common_download_quit (shearwater_common_device_t *device);
+
+dc_status_t
+shearwater_common_download_finish (shearwater_common_device_t *device);
+
+/*
+ * Read several identifiers with a single round trip.
+ */
+dc_status_t
+shearwater_common_identifiers (shearwater_common_device_t *device, dc_buffer_t *buffers[], const unsigned int ids[], unsigned int count);
+
 dc_status_t
 shearwater_common_identifier (shearwater_common_device_t *device, dc_buffer_t *buffer, unsigned int id);
 
@@ -195,10 +195,12 @@ shearwater_petrel_device_foreach (dc_device_t *abstract, dc_dive_callback_t call
 		return DC_STATUS_NOMEMORY;
 	}
 
-	// Read the serial number.
-	rc = shearwater_common_identifier (&device->base, buffer, ID_SERIAL);
+	// Read the serial number and the firmware version.
+	dc_buffer_t *buffers[] = {buffer, manifests};
+	const unsigned int ids[] = {ID_SERIAL, ID_FIRMWARE};
+	rc = shearwater_common_identifiers (&device->base, buffers, ids, 2);
 	if (rc != DC_STATUS_SUCCESS) {
-		ERROR (abstract->context, "Failed to read the serial number.");
+		ERROR (abstract->context, "Failed to read the serial number and firmware version.");
 		dc_buffer_free (buffer);
 		dc_buffer_free (manifests);
 		return rc;
@@ -215,17 +217,11 @@ shearwater_petrel_device_foreach (dc_device_t *abstract, dc_dive_callback_t call
 
 	}
 
-	// Read the firmware version.
-	rc = shearwater_common_identifier (&device->base, buffer, ID_FIRMWARE);
-	if (rc != DC_STATUS_SUCCESS) {
-		ERROR (abstract->context, "Failed to read the firmware version.");
-		dc_buffer_free (buffer);
-		dc_buffer_free (manifests);
-		return rc;
-	}
-
 	// Convert to a number.
-	unsigned int firmware = str2num (dc_buffer_get_data (buffer), dc_buffer_get_size (buffer), 1);
+	unsigned int firmware = str2num (dc_buffer_get_data (manifests), dc_buffer_get_size (manifests), 1);
+
+	// The manifests buffer was only borrowed for the firmware version.
+	dc_buffer_clear (manifests);
 
 	// Emit a device info event.
 	dc_event_devinfo_t devinfo;
@@ -234,6 +230,8 @@ shearwater_petrel_device_foreach (dc_device_t *abstract, dc_dive_callback_t call
 	devinfo.serial = array_uint32_be (serial);
 	device_event_emit (abstract, DC_EVENT_DEVINFO, &devinfo);
 
+	device_phase (abstract, DC_PHASE_LOGBOOK);
+
 	while (1) {
 		// Download a manifest.
 		rc = shearwater_common_download (&device->base, buffer, MANIFEST_ADDR, MANIFEST_SIZE, 0);
@@ -261,18 +259,20 @@ shearwater_petrel_device_foreach (dc_device_t *abstract, dc_dive_callback_t call
 			if (memcmp (data + offset + 4, device->fingerprint, sizeof (device->fingerprint)) == 0)
 				break;
 
+			// Append the manifest record to the main buffer, unless the
+			// dive is already known and its profile can be skipped.
+			if (!device_fingerprint_known (abstract, data + offset + 4, sizeof (device->fingerprint)) &&
+				!dc_buffer_append (manifests, data + offset, RECORD_SIZE)) {
+				ERROR (abstract->context, "Insufficient buffer space available.");
+				dc_buffer_free (buffer);
+				dc_buffer_free (manifests);
+				return DC_STATUS_NOMEMORY;
+			}
+
 			offset += RECORD_SIZE;
 			count++;
 		}
 
-		// Append the manifest records to the main buffer.
-		if (!dc_buffer_append (manifests, data, count * RECORD_SIZE)) {
-			ERROR (abstract->context, "Insufficient buffer space available.");
-			dc_buffer_free (buffer);
-			dc_buffer_free (manifests);
-			return DC_STATUS_NOMEMORY;
-		}
-
 		// Stop downloading manifest if there are no more records.
 		if (count != RECORD_COUNT)
 			break;
@@ -282,28 +282,95 @@ shearwater_petrel_device_foreach (dc_device_t *abstract, dc_dive_callback_t call
 	unsigned char *data = dc_buffer_get_data (manifests);
 	unsigned int size = dc_buffer_get_size (manifests);
 
+	device_phase (abstract, DC_PHASE_PROFILE);
+
+	// Request the first dive.
+	if (size) {
+		unsigned int address = array_uint32_be (data + 20);
+		rc = shearwater_common_download_init (&device->base, DIVE_ADDR + address, DIVE_SIZE, 1);
+		if (rc != DC_STATUS_SUCCESS) {
+			ERROR (abstract->context, "Failed to download the dive.");
+			goto error_free;
+		}
+	}
+
 	unsigned int offset = 0;
 	while (offset < size) {
-		// Get the address of the dive.
-		unsigned int address = array_uint32_be (data + offset + 20);
+		// Enable progress notifications.
+		dc_event_progress_t progress = EVENT_PROGRESS_INITIALIZER;
+		progress.maximum = 3 + DIVE_SIZE + 1;
+		device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 
 		// Download the dive.
-		rc = shearwater_common_download (&device->base, buffer, DIVE_ADDR + address, DIVE_SIZE, 1);
+		rc = shearwater_common_download_start (&device->base);
 		if (rc != DC_STATUS_SUCCESS) {
 			ERROR (abstract->context, "Failed to download the dive.");
-			dc_buffer_free (buffer);
-			dc_buffer_free (manifests);
-			return rc;
+			goto error_free;
+		}
+
+		// Update and emit a progress event.
+		progress.current += 3;
+		device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
+
+		rc = shearwater_common_download_blocks (&device->base, buffer, DIVE_SIZE, 1, &progress);
+		if (rc != DC_STATUS_SUCCESS) {
+			ERROR (abstract->context, "Failed to download the dive.");
+			goto error_free;
+		}
+
+		rc = shearwater_common_download_quit (&device->base);
+		if (rc != DC_STATUS_SUCCESS) {
+			ERROR (abstract->context, "Failed to download the dive.");
+			goto error_free;
+		}
+
+		// Request the next dive immediately after the quit request, without
+		// waiting for the response in between. The device processes both
+		// requests while the current dive is delivered to the application.
+		unsigned int next = offset + RECORD_SIZE;
+		if (next < size) {
+			unsigned int address = array_uint32_be (data + next + 20);
+			rc = shearwater_common_download_init (&device->base, DIVE_ADDR + address, DIVE_SIZE, 1);
+			if (rc != DC_STATUS_SUCCESS) {
+				ERROR (abstract->context, "Failed to download the dive.");
+				goto error_free;
+			}
 		}
 
 		unsigned char *buf = dc_buffer_get_data (buffer);
 		unsigned int len = dc_buffer_get_size (buffer);
-		if (callback && !callback (buf, len, buf + 12, sizeof (device->fingerprint), userdata))
+		int stop = callback && !callback (buf, len, buf + 12, sizeof (device->fingerprint), userdata);
+
+		rc = shearwater_common_download_finish (&device->base);
+		if (rc != DC_STATUS_SUCCESS) {
+			ERROR (abstract->context, "Failed to download the dive.");
+			goto error_free;
+		}
+
+		// Update and emit a progress event.
+		progress.current += 1;
+		device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
+
+		if (stop) {
+			// Close the pending request for the next dive again.
+			if (next < size) {
+				rc = shearwater_common_download_start (&device->base);
+				if (rc == DC_STATUS_SUCCESS)
+					rc = shearwater_common_download_quit (&device->base);
+				if (rc == DC_STATUS_SUCCESS)
+					rc = shearwater_common_download_finish (&device->base);
+				if (rc != DC_STATUS_SUCCESS) {
+					ERROR (abstract->context, "Failed to cancel the dive download.");
+					goto error_free;
+				}
+			}
 			break;
+		}
 
-		offset += RECORD_SIZE;
+		offset = next;
 	}
 
+error_free:
 	dc_buffer_free (manifests);
 	dc_buffer_free (buffer);
 
@@ -19,6 +19,8 @@
  * MA 02110-1301 USA
  */
 
+#define DC_LOG_CATEGORY DC_LOGCATEGORY_PARSER
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -53,6 +55,10 @@
 #define IMPERIAL 1
 
 #define NGASMIXES 10
+#define NGASHASH  32 // Power of two, above 2 * NGASMIXES
+
+#define HEADER  1
+#define PROFILE 2
 
 typedef struct shearwater_predator_parser_t shearwater_predator_parser_t;
 
@@ -67,6 +73,8 @@ struct shearwater_predator_parser_t {
 	unsigned int ngasmixes;
 	unsigned int oxygen[NGASMIXES];
 	unsigned int helium[NGASMIXES];
+	unsigned char gashash[NGASHASH];
+	unsigned int nsamples;
 	unsigned int serial;
 	dc_divemode_t mode;
 };
@@ -75,6 +83,9 @@ static dc_status_t shearwater_predator_parser_set_data (dc_parser_t *abstract, c
 static dc_status_t shearwater_predator_parser_get_datetime (dc_parser_t *abstract, dc_datetime_t *datetime);
 static dc_status_t shearwater_predator_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsigned int flags, void *value);
 static dc_status_t shearwater_predator_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata);
+static dc_status_t shearwater_predator_parser_samples_extract (dc_parser_t *abstract, dc_sample_columns_t *columns);
+static dc_status_t shearwater_predator_parser_samples_split (dc_parser_t *abstract, sample_chunk_t chunks[], unsigned int *count);
+static dc_status_t shearwater_predator_parser_samples_chunk (dc_parser_t *abstract, const sample_chunk_t *chunk, dc_sample_callback_t callback, void *userdata);
 
 static const dc_parser_vtable_t shearwater_predator_parser_vtable = {
 	sizeof(shearwater_predator_parser_t),
@@ -83,6 +94,14 @@ static const dc_parser_vtable_t shearwater_predator_parser_vtable = {
 	shearwater_predator_parser_get_datetime, /* datetime */
 	shearwater_predator_parser_get_field, /* fields */
 	shearwater_predator_parser_samples_foreach, /* samples_foreach */
+	shearwater_predator_parser_samples_extract, /* samples_extract */
+	NULL, /* samples_range */
+	NULL, /* samples_seek */
+	NULL, /* samples_index */
+	shearwater_predator_parser_samples_split, /* samples_split */
+	shearwater_predator_parser_samples_chunk, /* samples_chunk */
+	NULL, /* subdives */
+	NULL, /* samples_vendor */
 	NULL /* destroy */
 };
 
@@ -93,21 +112,97 @@ static const dc_parser_vtable_t shearwater_petrel_parser_vtable = {
 	shearwater_predator_parser_get_datetime, /* datetime */
 	shearwater_predator_parser_get_field, /* fields */
 	shearwater_predator_parser_samples_foreach, /* samples_foreach */
+	shearwater_predator_parser_samples_extract, /* samples_extract */
+	NULL, /* samples_range */
+	NULL, /* samples_seek */
+	NULL, /* samples_index */
+	shearwater_predator_parser_samples_split, /* samples_split */
+	shearwater_predator_parser_samples_chunk, /* samples_chunk */
+	NULL, /* subdives */
+	NULL, /* samples_vendor */
 	NULL /* destroy */
 };
 
 
+static void
+shearwater_predator_reset_gasmixes (shearwater_predator_parser_t *parser)
+{
+	parser->ngasmixes = 0;
+	for (unsigned int i = 0; i < NGASMIXES; ++i) {
+		parser->oxygen[i] = 0;
+		parser->helium[i] = 0;
+	}
+	memset (parser->gashash, 0, sizeof (parser->gashash));
+}
+
+/*
+ * The gas mixes are kept in a small open addressing hash table, with the
+ * index of the gas mix plus one in each used slot. With at most half of
+ * the slots in use, a lookup needs only a few probes.
+ */
+static unsigned int
+shearwater_predator_gashash (unsigned int o2, unsigned int he)
+{
+	return (o2 * 31 + he) & (NGASHASH - 1);
+}
+
 static unsigned int
 shearwater_predator_find_gasmix (shearwater_predator_parser_t *parser, unsigned int o2, unsigned int he)
 {
-	unsigned int i = 0;
-	while (i < parser->ngasmixes) {
+	unsigned int slot = shearwater_predator_gashash (o2, he);
+	while (parser->gashash[slot]) {
+		unsigned int i = parser->gashash[slot] - 1;
 		if (o2 == parser->oxygen[i] && he == parser->helium[i])
-			break;
-		i++;
+			return i;
+		slot = (slot + 1) & (NGASHASH - 1);
+	}
+
+	return parser->ngasmixes;
+}
+
+static unsigned int
+shearwater_predator_add_gasmix (shearwater_predator_parser_t *parser, unsigned int o2, unsigned int he)
+{
+	unsigned int idx = parser->ngasmixes;
+	if (idx >= NGASMIXES)
+		return idx;
+
+	unsigned int slot = shearwater_predator_gashash (o2, he);
+	while (parser->gashash[slot])
+		slot = (slot + 1) & (NGASHASH - 1);
+
+	parser->oxygen[idx] = o2;
+	parser->helium[idx] = he;
+	parser->gashash[slot] = idx + 1;
+	parser->ngasmixes = idx + 1;
+
+	return idx;
+}
+
+static double
+shearwater_predator_depth (unsigned int units, unsigned int depth)
+{
+	if (units == IMPERIAL)
+		return depth * FEET / 10.0;
+	else
+		return depth / 10.0;
+}
+
+static double
+shearwater_predator_temperature (unsigned int units, int temperature)
+{
+	if (temperature < 0) {
+		// Fix negative temperatures.
+		temperature += 102;
+		if (temperature > 0) {
+			temperature = 0;
+		}
 	}
 
-	return i;
+	if (units == IMPERIAL)
+		return (temperature - 32.0) * (5.0 / 9.0);
+	else
+		return temperature;
 }
 
 
@@ -149,11 +244,8 @@ shearwater_common_parser_create (dc_parser_t **out, dc_context_t *context, unsig
 	parser->cached = 0;
 	parser->headersize = 0;
 	parser->footersize = 0;
-	parser->ngasmixes = 0;
-	for (unsigned int i = 0; i < NGASMIXES; ++i) {
-		parser->oxygen[i] = 0;
-		parser->helium[i] = 0;
-	}
+	shearwater_predator_reset_gasmixes (parser);
+	parser->nsamples = 0;
 	parser->mode = DC_DIVEMODE_OC;
 
 	*out = (dc_parser_t *) parser;
@@ -185,11 +277,8 @@ shearwater_predator_parser_set_data (dc_parser_t *abstract, const unsigned char
 	parser->cached = 0;
 	parser->headersize = 0;
 	parser->footersize = 0;
-	parser->ngasmixes = 0;
-	for (unsigned int i = 0; i < NGASMIXES; ++i) {
-		parser->oxygen[i] = 0;
-		parser->helium[i] = 0;
-	}
+	shearwater_predator_reset_gasmixes (parser);
+	parser->nsamples = 0;
 	parser->mode = DC_DIVEMODE_OC;
 
 	return DC_STATUS_SUCCESS;
@@ -223,7 +312,7 @@ shearwater_predator_parser_cache (shearwater_predator_parser_t *parser)
 	const unsigned char *data = parser->base.data;
 	unsigned int size = parser->base.size;
 
-	if (parser->cached) {
+	if (parser->cached >= HEADER) {
 		return DC_STATUS_SUCCESS;
 	}
 
@@ -243,17 +332,40 @@ shearwater_predator_parser_cache (shearwater_predator_parser_t *parser)
 		}
 	}
 
+	// Cache the data for later use.
+	parser->headersize = headersize;
+	parser->footersize = footersize;
+	parser->cached = HEADER;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+shearwater_predator_parser_cache_profile (shearwater_predator_parser_t *parser)
+{
+	dc_parser_t *abstract = (dc_parser_t *) parser;
+	const unsigned char *data = parser->base.data;
+	unsigned int size = parser->base.size;
+
+	// Cache the header data.
+	dc_status_t rc = shearwater_predator_parser_cache (parser);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	if (parser->cached >= PROFILE) {
+		return DC_STATUS_SUCCESS;
+	}
+
 	// Default dive mode.
 	dc_divemode_t mode = DC_DIVEMODE_OC;
 
-	// Get the gas mixes.
-	unsigned int ngasmixes = 0;
-	unsigned int oxygen[NGASMIXES] = {0};
-	unsigned int helium[NGASMIXES] = {0};
+	// Get the gas mixes and the number of samples.
+	unsigned int nsamples = 0;
 	unsigned int o2_previous = 0, he_previous = 0;
+	shearwater_predator_reset_gasmixes (parser);
 
-	unsigned int offset = headersize;
-	unsigned int length = size - footersize;
+	unsigned int offset = parser->headersize;
+	unsigned int length = size - parser->footersize;
 	while (offset < length) {
 		// Ignore empty samples.
 		if (array_isequal (data + offset, parser->samplesize, 0x00)) {
@@ -261,6 +373,8 @@ shearwater_predator_parser_cache (shearwater_predator_parser_t *parser)
 			continue;
 		}
 
+		nsamples++;
+
 		// Status flags.
 		unsigned int status = data[offset + 11];
 		if ((status & OC) == 0) {
@@ -271,23 +385,14 @@ shearwater_predator_parser_cache (shearwater_predator_parser_t *parser)
 		unsigned int o2 = data[offset + 7];
 		unsigned int he = data[offset + 8];
 		if (o2 != o2_previous || he != he_previous) {
-			// Find the gasmix in the list.
-			unsigned int idx = 0;
-			while (idx < ngasmixes) {
-				if (o2 == oxygen[idx] && he == helium[idx])
-					break;
-				idx++;
-			}
-
-			// Add it to list if not found.
-			if (idx >= ngasmixes) {
+			// Find the gasmix in the list, and add it if not found.
+			unsigned int idx = shearwater_predator_find_gasmix (parser, o2, he);
+			if (idx >= parser->ngasmixes) {
+				idx = shearwater_predator_add_gasmix (parser, o2, he);
 				if (idx >= NGASMIXES) {
 					ERROR (abstract->context, "Maximum number of gas mixes reached.");
 					return DC_STATUS_NOMEMORY;
 				}
-				oxygen[idx] = o2;
-				helium[idx] = he;
-				ngasmixes = idx + 1;
 			}
 
 			o2_previous = o2;
@@ -298,15 +403,9 @@ shearwater_predator_parser_cache (shearwater_predator_parser_t *parser)
 	}
 
 	// Cache the data for later use.
-	parser->headersize = headersize;
-	parser->footersize = footersize;
-	parser->ngasmixes = ngasmixes;
-	for (unsigned int i = 0; i < ngasmixes; ++i) {
-		parser->oxygen[i] = oxygen[i];
-		parser->helium[i] = helium[i];
-	}
+	parser->nsamples = nsamples;
 	parser->mode = mode;
-	parser->cached = 1;
+	parser->cached = PROFILE;
 
 	return DC_STATUS_SUCCESS;
 }
@@ -319,8 +418,14 @@ shearwater_predator_parser_get_field (dc_parser_t *abstract, dc_field_type_t typ
 	const unsigned char *data = abstract->data;
 	unsigned int size = abstract->size;
 
-	// Cache the parser data.
-	dc_status_t rc = shearwater_predator_parser_cache (parser);
+	// Cache the parser data. The gas mixes and the dive mode are
+	// collected from the samples, so only those need the profile.
+	dc_status_t rc = DC_STATUS_SUCCESS;
+	if (type == DC_FIELD_GASMIX_COUNT || type == DC_FIELD_GASMIX ||
+		type == DC_FIELD_DIVEMODE)
+		rc = shearwater_predator_parser_cache_profile (parser);
+	else
+		rc = shearwater_predator_parser_cache (parser);
 	if (rc != DC_STATUS_SUCCESS)
 		return rc;
 
@@ -430,28 +535,28 @@ shearwater_predator_parser_get_field (dc_parser_t *abstract, dc_field_type_t typ
 
 
 static dc_status_t
-shearwater_predator_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata)
+shearwater_predator_parser_decode (shearwater_predator_parser_t *parser, unsigned int begin, unsigned int end, unsigned int first, unsigned int state, unsigned int discover, dc_divemode_t *mode, unsigned int *nsamples, dc_sample_callback_t callback, void *userdata)
 {
-	shearwater_predator_parser_t *parser = (shearwater_predator_parser_t *) abstract;
-
+	dc_parser_t *abstract = (dc_parser_t *) parser;
 	const unsigned char *data = abstract->data;
-	unsigned int size = abstract->size;
-
-	// Cache the parser data.
-	dc_status_t rc = shearwater_predator_parser_cache (parser);
-	if (rc != DC_STATUS_SUCCESS)
-		return rc;
 
 	// Get the unit system.
 	unsigned int units = data[8];
 
 	// Previous gas mix.
-	unsigned int o2_previous = 0, he_previous = 0;
-
-	unsigned int time = 0;
-	unsigned int offset = parser->headersize;
-	unsigned int length = size - parser->footersize;
-	while (offset < length) {
+	unsigned int o2_previous = state & 0xFF, he_previous = (state >> 8) & 0xFF;
+
+	// The sample types which aren't wanted by the application are not
+	// decoded at all.
+	unsigned int temperature = parser_sample_wanted (abstract, DC_SAMPLE_TEMPERATURE);
+	unsigned int ppo2 = parser_sample_wanted (abstract, DC_SAMPLE_PPO2);
+	unsigned int setpoint = parser_sample_wanted (abstract, DC_SAMPLE_SETPOINT);
+	unsigned int cns = parser_sample_wanted (abstract, DC_SAMPLE_CNS);
+	unsigned int deco = parser_sample_wanted (abstract, DC_SAMPLE_DECO);
+
+	unsigned int time = first * 10;
+	unsigned int offset = begin;
+	while (offset < end) {
 		dc_sample_value_t sample = {0};
 
 		// Ignore empty samples.
@@ -466,51 +571,44 @@ shearwater_predator_parser_samples_foreach (dc_parser_t *abstract, dc_sample_cal
 		if (callback) callback (DC_SAMPLE_TIME, sample, userdata);
 
 		// Depth (1/10 m or ft).
-		unsigned int depth = array_uint16_be (data + offset);
-		if (units == IMPERIAL)
-			sample.depth = depth * FEET / 10.0;
-		else
-			sample.depth = depth / 10.0;
+		sample.depth = shearwater_predator_depth (units, array_uint16_be (data + offset));
 		if (callback) callback (DC_SAMPLE_DEPTH, sample, userdata);
 
 		// Temperature (°C or °F).
-		int temperature = (signed char) data[offset + 13];
-		if (temperature < 0) {
-			// Fix negative temperatures.
-			temperature += 102;
-			if (temperature > 0) {
-				temperature = 0;
-			}
+		if (temperature) {
+			sample.temperature = shearwater_predator_temperature (units, (signed char) data[offset + 13]);
+			if (callback) callback (DC_SAMPLE_TEMPERATURE, sample, userdata);
 		}
-		if (units == IMPERIAL)
-			sample.temperature = (temperature - 32.0) * (5.0 / 9.0);
-		else
-			sample.temperature = temperature;
-		if (callback) callback (DC_SAMPLE_TEMPERATURE, sample, userdata);
 
 		// Status flags.
 		unsigned int status = data[offset + 11];
 
 		if ((status & OC) == 0) {
+			if (mode) *mode = DC_DIVEMODE_CC;
+
 			// PPO2 -- only return PPO2 if we are in closed circuit mode
-			sample.ppo2 = data[offset + 6] / 100.0;
-			if (callback) callback (DC_SAMPLE_PPO2, sample, userdata);
+			if (ppo2) {
+				sample.ppo2 = data[offset + 6] / 100.0;
+				if (callback) callback (DC_SAMPLE_PPO2, sample, userdata);
+			}
 
 			// Setpoint
-			if (parser->petrel) {
-				sample.setpoint = data[offset + 18] / 100.0;
-			} else {
-				if (status & SETPOINT_HIGH) {
-					sample.setpoint = data[18] / 100.0;
+			if (setpoint) {
+				if (parser->petrel) {
+					sample.setpoint = data[offset + 18] / 100.0;
 				} else {
-					sample.setpoint = data[17] / 100.0;
+					if (status & SETPOINT_HIGH) {
+						sample.setpoint = data[18] / 100.0;
+					} else {
+						sample.setpoint = data[17] / 100.0;
+					}
 				}
+				if (callback) callback (DC_SAMPLE_SETPOINT, sample, userdata);
 			}
-			if (callback) callback (DC_SAMPLE_SETPOINT, sample, userdata);
 		}
 
 		// CNS
-		if (parser->petrel) {
+		if (parser->petrel && cns) {
 			sample.cns = data[offset + 22] / 100.0;
 			if (callback) callback (DC_SAMPLE_CNS, sample, userdata);
 		}
@@ -520,6 +618,13 @@ shearwater_predator_parser_samples_foreach (dc_parser_t *abstract, dc_sample_cal
 		unsigned int he = data[offset + 8];
 		if (o2 != o2_previous || he != he_previous) {
 			unsigned int idx = shearwater_predator_find_gasmix (parser, o2, he);
+			if (idx >= parser->ngasmixes && discover) {
+				idx = shearwater_predator_add_gasmix (parser, o2, he);
+				if (idx >= NGASMIXES) {
+					ERROR (abstract->context, "Maximum number of gas mixes reached.");
+					return DC_STATUS_NOMEMORY;
+				}
+			}
 			if (idx >= parser->ngasmixes) {
 				ERROR (abstract->context, "Invalid gas mix.");
 				return DC_STATUS_DATAFORMAT;
@@ -539,22 +644,178 @@ shearwater_predator_parser_samples_foreach (dc_parser_t *abstract, dc_sample_cal
 		}
 
 		// Deco stop / NDL.
-		unsigned int decostop = array_uint16_be (data + offset + 2);
-		if (decostop) {
-			sample.deco.type = DC_DECO_DECOSTOP;
-			if (units == IMPERIAL)
-				sample.deco.depth = decostop * FEET;
-			else
-				sample.deco.depth = decostop;
-		} else {
-			sample.deco.type = DC_DECO_NDL;
-			sample.deco.depth = 0.0;
+		if (deco) {
+			unsigned int decostop = array_uint16_be (data + offset + 2);
+			if (decostop) {
+				sample.deco.type = DC_DECO_DECOSTOP;
+				if (units == IMPERIAL)
+					sample.deco.depth = decostop * FEET;
+				else
+					sample.deco.depth = decostop;
+			} else {
+				sample.deco.type = DC_DECO_NDL;
+				sample.deco.depth = 0.0;
+			}
+			sample.deco.time = data[offset + 9] * 60;
+			if (callback) callback (DC_SAMPLE_DECO, sample, userdata);
 		}
-		sample.deco.time = data[offset + 9] * 60;
-		if (callback) callback (DC_SAMPLE_DECO, sample, userdata);
 
 		offset += parser->samplesize;
 	}
 
+	if (nsamples) *nsamples = time / 10 - first;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+shearwater_predator_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata)
+{
+	shearwater_predator_parser_t *parser = (shearwater_predator_parser_t *) abstract;
+
+	// Cache the parser data.
+	dc_status_t rc = shearwater_predator_parser_cache (parser);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	// Without the profile data cached, the gas mixes and the dive mode
+	// are collected during this walk, instead of a separate pass. The
+	// gas mixes are found in the same order, so the indices match.
+	unsigned int discover = parser->cached < PROFILE;
+	dc_divemode_t mode = DC_DIVEMODE_OC;
+	unsigned int nsamples = 0;
+	if (discover) {
+		shearwater_predator_reset_gasmixes (parser);
+	}
+
+	rc = shearwater_predator_parser_decode (parser,
+		parser->headersize, abstract->size - parser->footersize, 0, 0,
+		discover, &mode, &nsamples, callback, userdata);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	if (discover) {
+		parser->nsamples = nsamples;
+		parser->mode = mode;
+		parser->cached = PROFILE;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+shearwater_predator_parser_samples_split (dc_parser_t *abstract, sample_chunk_t chunks[], unsigned int *count)
+{
+	shearwater_predator_parser_t *parser = (shearwater_predator_parser_t *) abstract;
+	const unsigned char *data = abstract->data;
+
+	// The chunks need all the gas mixes in advance.
+	dc_status_t rc = shearwater_predator_parser_cache_profile (parser);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	unsigned int begin = parser->headersize;
+	unsigned int end = abstract->size - parser->footersize;
+
+	unsigned int nsamples = parser->nsamples;
+	unsigned int nchunks = *count;
+	if (nchunks > nsamples / SAMPLE_CHUNK_MIN)
+		nchunks = nsamples / SAMPLE_CHUNK_MIN;
+	if (nchunks == 0)
+		nchunks = 1;
+	unsigned int size = (nsamples + nchunks - 1) / nchunks;
+
+	// Every record contains absolute values. The only state carried
+	// across records is the previous gas mix, to detect a gas change.
+	unsigned int n = 0, i = 0;
+	unsigned int o2 = 0, he = 0;
+	chunks[0].begin = begin;
+	chunks[0].first = 0;
+	chunks[0].state = 0;
+	for (unsigned int offset = begin; offset < end; offset += parser->samplesize) {
+		if (array_isequal (data + offset, parser->samplesize, 0x00))
+			continue;
+
+		if (n && (n % size) == 0) {
+			chunks[i].end = offset;
+			chunks[i].nsamples = n - chunks[i].first;
+			i++;
+			chunks[i].begin = offset;
+			chunks[i].first = n;
+			chunks[i].state = o2 | (he << 8);
+		}
+
+		o2 = data[offset + 7];
+		he = data[offset + 8];
+		n++;
+	}
+	chunks[i].end = end;
+	chunks[i].nsamples = n - chunks[i].first;
+
+	*count = i + 1;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+shearwater_predator_parser_samples_chunk (dc_parser_t *abstract, const sample_chunk_t *chunk, dc_sample_callback_t callback, void *userdata)
+{
+	shearwater_predator_parser_t *parser = (shearwater_predator_parser_t *) abstract;
+
+	return shearwater_predator_parser_decode (parser,
+		chunk->begin, chunk->end, chunk->first, chunk->state,
+		0, NULL, NULL, callback, userdata);
+}
+
+static dc_status_t
+shearwater_predator_parser_samples_extract (dc_parser_t *abstract, dc_sample_columns_t *columns)
+{
+	shearwater_predator_parser_t *parser = (shearwater_predator_parser_t *) abstract;
+	const unsigned char *data = abstract->data;
+
+	// The gas mixes and the number of samples are needed in advance.
+	dc_status_t rc = shearwater_predator_parser_cache_profile (parser);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	// Get the unit system.
+	unsigned int units = data[8];
+
+	// Only the empty records are skipped. The sample values all have
+	// their own column, except for the ppO2, setpoint, CNS and deco
+	// information, which are not decoded at all.
+	unsigned int n = sample_columns_interval (columns, parser->nsamples, 10);
+	double *depth = columns->depth;
+	double *temperature = columns->temperature;
+	unsigned int *gasmix = columns->gasmix;
+	unsigned int samplesize = parser->samplesize;
+	unsigned int o2_previous = 0, he_previous = 0;
+
+	unsigned int i = 0;
+	unsigned int end = abstract->size - parser->footersize;
+	for (unsigned int offset = parser->headersize; offset < end && i < n; offset += samplesize) {
+		const unsigned char *p = data + offset;
+
+		if (array_isequal (p, samplesize, 0x00))
+			continue;
+
+		if (depth)
+			depth[i] = shearwater_predator_depth (units, array_uint16_be (p));
+		if (temperature)
+			temperature[i] = shearwater_predator_temperature (units, (signed char) p[13]);
+
+		// All gas mixes are known, so only the index is needed.
+		unsigned int o2 = p[7];
+		unsigned int he = p[8];
+		if (o2 != o2_previous || he != he_previous) {
+			if (gasmix)
+				gasmix[i] = shearwater_predator_find_gasmix (parser, o2, he);
+			o2_previous = o2;
+			he_previous = he;
+		}
+
+		i++;
+	}
+
 	return DC_STATUS_SUCCESS;
 }
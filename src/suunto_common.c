@@ -87,11 +87,11 @@ suunto_common_extract_dives (suunto_common_device_t *device, const suunto_common
 		return DC_STATUS_DATAFORMAT;
 	}
 
-	// Memory buffer for the profile ringbuffer.
+	// Memory buffer for a dive that crosses the ringbuffer wrap point.
+	// All other dives are passed directly from the memory dump, so the
+	// buffer is only allocated when needed.
 	unsigned int length = layout->rb_profile_end - layout->rb_profile_begin;
-	unsigned char *buffer = (unsigned char *) malloc (length);
-	if (buffer == NULL)
-		return DC_STATUS_NOMEMORY;
+	unsigned char *buffer = NULL;
 
 	unsigned int current = eop;
 	unsigned int previous = eop;
@@ -110,21 +110,27 @@ suunto_common_extract_dives (suunto_common_device_t *device, const suunto_common
 		unsigned int idx = RB_PROFILE_PEEK (current, layout);
 		if (data[idx] == 0x80) {
 			unsigned int len = RB_PROFILE_DISTANCE (current, previous, layout);
-			if (current + len > layout->rb_profile_end) {
-				unsigned int a = layout->rb_profile_end - current;
-				unsigned int b = (current + len) - layout->rb_profile_end;
-				memcpy (buffer + 0, data + current, a);
-				memcpy (buffer + a, data + layout->rb_profile_begin,   b);
-			} else {
-				memcpy (buffer, data + current, len);
+			const unsigned char *dive = data + current;
+			if (current + len > layout->rb_profile_end ||
+				current + layout->fp_offset + sizeof (device->fingerprint) > layout->rb_profile_end)
+			{
+				if (buffer == NULL) {
+					buffer = (unsigned char *) malloc (length);
+					if (buffer == NULL)
+						return DC_STATUS_NOMEMORY;
+				}
+
+				ringbuffer_copy (buffer, data, current, len,
+					layout->rb_profile_begin, layout->rb_profile_end);
+				dive = buffer;
 			}
 
-			if (device && memcmp (buffer + layout->fp_offset, device->fingerprint, sizeof (device->fingerprint)) == 0) {
+			if (device && memcmp (dive + layout->fp_offset, device->fingerprint, sizeof (device->fingerprint)) == 0) {
 				free (buffer);
 				return DC_STATUS_SUCCESS;
 			}
 
-			if (callback && !callback (buffer, len, buffer + layout->fp_offset, sizeof (device->fingerprint), userdata)) {
+			if (callback && !callback (dive, len, dive + layout->fp_offset, sizeof (device->fingerprint), userdata)) {
 				free (buffer);
 				return DC_STATUS_SUCCESS;
 			}
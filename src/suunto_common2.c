@@ -28,6 +28,7 @@
 #include "ringbuffer.h"
 #include "checksum.h"
 #include "array.h"
+#include "retry.h"
 
 #define MAXRETRIES 2
 
@@ -48,6 +49,7 @@ suunto_common2_device_init (suunto_common2_device_t *device)
 	device->layout = NULL;
 	memset (device->version, 0, sizeof (device->version));
 	memset (device->fingerprint, 0, sizeof (device->fingerprint));
+	device->base.blocksize = SZ_PACKET;
 }
 
 
@@ -64,19 +66,26 @@ suunto_common2_transfer (dc_device_t *abstract, const unsigned char command[], u
 	// returning an error. Usually the dive computer will respond
 	// again during one of the retries.
 
-	unsigned int nretries = 0;
+	// The packet function of the backend already waits long enough
+	// before each command, so there is no extra delay or purge here.
+	dc_retry_t retry;
+	dc_retry_init (&retry, MAXRETRIES, 0, 0, 0);
+	unsigned long long begin = device_timestamp ();
 	dc_status_t rc = DC_STATUS_SUCCESS;
 	while ((rc = VTABLE (abstract)->packet (abstract, command, csize, answer, asize, size)) != DC_STATUS_SUCCESS) {
+		device_stats_packet (abstract, command, csize, 0, rc, begin);
+
 		// Automatically discard a corrupted packet,
 		// and request a new one.
-		if (rc != DC_STATUS_TIMEOUT && rc != DC_STATUS_PROTOCOL)
+		rc = dc_retry_failed (&retry, abstract, NULL, rc);
+		if (rc != DC_STATUS_SUCCESS)
 			return rc;
 
-		// Abort if the maximum number of retries is reached.
-		if (nretries++ >= MAXRETRIES)
-			return rc;
+		begin = device_timestamp ();
 	}
 
+	device_stats_packet (abstract, command, csize, asize, rc, begin);
+
 	return rc;
 }
 
@@ -270,6 +279,8 @@ suunto_common2_device_foreach (dc_device_t *abstract, dc_dive_callback_t callbac
 	}
 	device_event_emit (abstract, DC_EVENT_DEVINFO, &devinfo);
 
+	device_phase (abstract, DC_PHASE_LOGBOOK);
+
 	// Read the header bytes.
 	unsigned char header[8] = {0};
 	rc = suunto_common2_device_read (abstract, 0x0190, header, sizeof (header));
@@ -320,6 +331,8 @@ suunto_common2_device_foreach (dc_device_t *abstract, dc_dive_callback_t callbac
 
 	unsigned int available = 0;
 
+	device_phase (abstract, DC_PHASE_PROFILE);
+
 	// The ring buffer is traversed backwards to retrieve the most recent
 	// dives first. This allows us to download only the new dives.
 
@@ -104,6 +104,15 @@ suunto_d9_device_autodetect (suunto_d9_device_t *device, unsigned int model)
 		model == DX || model == VYPERNOVO || model == ZOOPNOVO)
 		hint = 1;
 
+	// Prefer the baudrate that worked the previous time, because every
+	// wrong guess costs a full timeout.
+	unsigned int baudrate = 0;
+	dc_context_get_hint (abstract->context, DC_FAMILY_SUUNTO_D9, model, "baudrate", &baudrate);
+	for (unsigned int i = 0; i < C_ARRAY_SIZE(baudrates); ++i) {
+		if ((unsigned int) baudrates[i] == baudrate)
+			hint = i;
+	}
+
 	for (unsigned int i = 0; i < C_ARRAY_SIZE(baudrates); ++i) {
 		// Use the baudrate array as circular array, starting from the hint.
 		unsigned int idx = (hint + i) % C_ARRAY_SIZE(baudrates);
@@ -117,8 +126,13 @@ suunto_d9_device_autodetect (suunto_d9_device_t *device, unsigned int model)
 
 		// Try reading the version info.
 		status = suunto_common2_device_version ((dc_device_t *) device, device->base.version, sizeof (device->base.version));
-		if (status == DC_STATUS_SUCCESS)
+		if (status == DC_STATUS_SUCCESS) {
+			if ((unsigned int) baudrates[idx] != baudrate &&
+				dc_context_set_hint (abstract->context, DC_FAMILY_SUUNTO_D9, model, "baudrate", baudrates[idx]) != DC_STATUS_SUCCESS) {
+				WARNING (abstract->context, "Failed to update the sync store.");
+			}
 			break;
+		}
 	}
 
 	return status;
@@ -154,6 +168,10 @@ suunto_d9_device_open (dc_device_t **out, dc_context_t *context, const char *nam
 		goto error_free;
 	}
 
+	// Interrupt the blocking reads when the download is cancelled, and
+	// measure the time spent waiting for the I/O.
+	device_set_port ((dc_device_t *) device, device->port);
+
 	// Set the serial communication protocol (9600 8N1).
 	status = dc_serial_configure (device->port, 9600, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -168,6 +186,11 @@ suunto_d9_device_open (dc_device_t **out, dc_context_t *context, const char *nam
 		goto error_close;
 	}
 
+	// Request the lowest receive latency. Each packet is a short command
+	// followed by a short answer, so the time to transfer the data is
+	// dominated by the turnaround time of the link.
+	dc_serial_set_latency (device->port, 0);
+
 	// Set the DTR line (power supply for the interface).
 	status = dc_serial_set_dtr (device->port, 1);
 	if (status != DC_STATUS_SUCCESS) {
@@ -19,7 +19,10 @@
  * MA 02110-1301 USA
  */
 
+#define DC_LOG_CATEGORY DC_LOGCATEGORY_PARSER
+
 #include <stdlib.h>
+#include <limits.h>	// UINT_MAX
 #include <string.h>	// memcmp, strdup
 #include <stdio.h>	// snprintf
 
@@ -68,6 +71,22 @@
 #define DECOSTOP     (1 << 1)
 #define DEEPSTOP     (1 << 2)
 
+#define HEADER  1
+#define PROFILE 2
+
+typedef enum sample_kind_t {
+	SAMPLE_DEPTH,
+	SAMPLE_PRESSURE,
+	SAMPLE_TEMPERATURE,
+} sample_kind_t;
+
+typedef struct sample_info_t {
+	sample_kind_t kind;
+	unsigned int size;
+	unsigned int interval;
+	double divisor;
+} sample_info_t;
+
 typedef struct suunto_d9_parser_t suunto_d9_parser_t;
 
 struct suunto_d9_parser_t {
@@ -82,14 +101,13 @@ struct suunto_d9_parser_t {
 	unsigned int helium[NGASMIXES];
 	unsigned int gasmix;
 	unsigned int config;
-};
-
-typedef struct sample_info_t {
-	unsigned int type;
-	unsigned int size;
+	// Cached profile layout.
+	unsigned int nparams;
+	sample_info_t info[MAXPARAMS];
+	unsigned int samplesize;
+	unsigned int profile;
 	unsigned int interval;
-	unsigned int divisor;
-} sample_info_t;
+};
 
 static dc_status_t suunto_d9_parser_set_data (dc_parser_t *abstract, const unsigned char *data, unsigned int size);
 static dc_status_t suunto_d9_parser_get_datetime (dc_parser_t *abstract, dc_datetime_t *datetime);
@@ -103,6 +121,14 @@ static const dc_parser_vtable_t suunto_d9_parser_vtable = {
 	suunto_d9_parser_get_datetime, /* datetime */
 	suunto_d9_parser_get_field, /* fields */
 	suunto_d9_parser_samples_foreach, /* samples_foreach */
+	NULL, /* samples_extract */
+	NULL, /* samples_range */
+	NULL, /* samples_seek */
+	NULL, /* samples_index */
+	NULL, /* samples_split */
+	NULL, /* samples_chunk */
+	NULL, /* subdives */
+	NULL, /* samples_vendor */
 	NULL /* destroy */
 };
 
@@ -126,7 +152,7 @@ suunto_d9_parser_cache (suunto_d9_parser_t *parser)
 	const unsigned char *data = parser->base.data;
 	unsigned int size = parser->base.size;
 
-	if (parser->cached) {
+	if (parser->cached >= HEADER) {
 		return DC_STATUS_SUCCESS;
 	}
 
@@ -226,7 +252,107 @@ suunto_d9_parser_cache (suunto_d9_parser_t *parser)
 		}
 	}
 	parser->config = config;
-	parser->cached = 1;
+	parser->cached = HEADER;
+
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+suunto_d9_parser_cache_profile (suunto_d9_parser_t *parser)
+{
+	dc_parser_t *abstract = (dc_parser_t *) parser;
+	const unsigned char *data = abstract->data;
+	unsigned int size = abstract->size;
+
+	if (parser->cached >= PROFILE) {
+		return DC_STATUS_SUCCESS;
+	}
+
+	// Cache the gas mix data.
+	dc_status_t rc = suunto_d9_parser_cache (parser);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	// Number of parameters in the configuration data.
+	unsigned int nparams = data[parser->config];
+	if (nparams == 0 || nparams > MAXPARAMS) {
+		ERROR (abstract->context, "Invalid number of parameters.");
+		return DC_STATUS_DATAFORMAT;
+	}
+
+	// Available divisor values.
+	const unsigned int divisors[] = {1, 2, 4, 5, 10, 50, 100, 1000};
+
+	// Get the sample configuration. When every parameter is present in
+	// each sample, the samples have a fixed size.
+	unsigned int samplesize = 0;
+	for (unsigned int i = 0; i < nparams; ++i) {
+		unsigned int idx = parser->config + 2 + i * 3;
+		unsigned int type = data[idx + 0];
+		sample_info_t *info = &parser->info[i];
+		info->interval = data[idx + 1];
+		info->divisor  = divisors[(data[idx + 2] & 0x1C) >> 2];
+		switch (type) {
+		case 0x64: // Depth
+			info->kind = SAMPLE_DEPTH;
+			info->size = 2;
+			break;
+		case 0x68: // Pressure
+			info->kind = SAMPLE_PRESSURE;
+			info->size = 2;
+			break;
+		case 0x74: // Temperature
+			info->kind = SAMPLE_TEMPERATURE;
+			info->size = 1;
+			break;
+		default: // Unknown sample type
+			ERROR (abstract->context, "Unknown sample type 0x%02x.", type);
+			return DC_STATUS_DATAFORMAT;
+		}
+		if (samplesize != UINT_MAX) {
+			if (info->interval == 1)
+				samplesize += info->size;
+			else
+				samplesize = UINT_MAX;
+		}
+	}
+
+	// Offset to the profile data.
+	unsigned int profile = parser->config + 2 + nparams * 3;
+	if (profile + 5 > size) {
+		ERROR (abstract->context, "Buffer overflow detected!");
+		return DC_STATUS_DATAFORMAT;
+	}
+
+	// HelO2 dives can have an additional data block.
+	const unsigned char sequence[] = {0x01, 0x00, 0x00};
+	if (parser->model == HELO2 && memcmp (data + profile, sequence, sizeof (sequence)) != 0)
+		profile += 12;
+	if (profile + 5 > size) {
+		ERROR (abstract->context, "Buffer overflow detected!");
+		return DC_STATUS_DATAFORMAT;
+	}
+
+	// Sample recording interval.
+	unsigned int interval_sample_offset = 0x18;
+	if (parser->model == HELO2 || parser->model == D4i ||
+		parser->model == D6i || parser->model == D9tx ||
+		parser->model == ZOOPNOVO || parser->model == VYPERNOVO)
+		interval_sample_offset = 0x1E;
+	else if (parser->model == DX)
+		interval_sample_offset = 0x22;
+	unsigned int interval_sample = data[interval_sample_offset];
+	if (interval_sample == 0) {
+		ERROR (abstract->context, "Invalid sample interval.");
+		return DC_STATUS_DATAFORMAT;
+	}
+
+	// Cache the data for later use.
+	parser->nparams = nparams;
+	parser->samplesize = samplesize == UINT_MAX ? 0 : samplesize;
+	parser->profile = profile;
+	parser->interval = interval_sample;
+	parser->cached = PROFILE;
 
 	return DC_STATUS_SUCCESS;
 }
@@ -411,6 +537,32 @@ suunto_d9_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsigne
 }
 
 
+static void
+suunto_d9_parser_sample (const sample_info_t *info, const unsigned char *data, dc_sample_value_t *sample, dc_sample_callback_t callback, void *userdata)
+{
+	unsigned int value = 0;
+
+	switch (info->kind) {
+	case SAMPLE_DEPTH:
+		value = array_uint16_le (data);
+		sample->depth = value / info->divisor;
+		if (callback) callback (DC_SAMPLE_DEPTH, *sample, userdata);
+		break;
+	case SAMPLE_PRESSURE:
+		value = array_uint16_le (data);
+		if (value != 0xFFFF) {
+			sample->pressure.tank = 0;
+			sample->pressure.value = value / info->divisor;
+			if (callback) callback (DC_SAMPLE_PRESSURE, *sample, userdata);
+		}
+		break;
+	case SAMPLE_TEMPERATURE:
+		sample->temperature = (signed char) data[0] / info->divisor;
+		if (callback) callback (DC_SAMPLE_TEMPERATURE, *sample, userdata);
+		break;
+	}
+}
+
 static dc_status_t
 suunto_d9_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata)
 {
@@ -419,71 +571,18 @@ suunto_d9_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t ca
 	const unsigned char *data = abstract->data;
 	unsigned int size = abstract->size;
 
-	// Cache the gas mix data.
-	dc_status_t rc = suunto_d9_parser_cache (parser);
+	// Cache the gas mix data and the sample configuration.
+	dc_status_t rc = suunto_d9_parser_cache_profile (parser);
 	if (rc != DC_STATUS_SUCCESS)
 		return rc;
 
-	// Number of parameters in the configuration data.
-	unsigned int nparams = data[parser->config];
-	if (nparams == 0 || nparams > MAXPARAMS) {
-		ERROR (abstract->context, "Invalid number of parameters.");
-		return DC_STATUS_DATAFORMAT;
-	}
-
-	// Available divisor values.
-	const unsigned int divisors[] = {1, 2, 4, 5, 10, 50, 100, 1000};
+	const sample_info_t *info = parser->info;
+	unsigned int nparams = parser->nparams;
+	unsigned int profile = parser->profile;
+	unsigned int interval_sample = parser->interval;
 
-	// Get the sample configuration.
-	sample_info_t info[MAXPARAMS] = {{0}};
-	for (unsigned int i = 0; i < nparams; ++i) {
-		unsigned int idx = parser->config + 2 + i * 3;
-		info[i].type     = data[idx + 0];
-		info[i].interval = data[idx + 1];
-		info[i].divisor  = divisors[(data[idx + 2] & 0x1C) >> 2];
-		switch (info[i].type) {
-		case 0x64: // Depth
-		case 0x68: // Pressure
-			info[i].size = 2;
-			break;
-		case 0x74: // Temperature
-			info[i].size = 1;
-			break;
-		default: // Unknown sample type
-			ERROR (abstract->context, "Unknown sample type 0x%02x.", info[i].type);
-			return DC_STATUS_DATAFORMAT;
-		}
-	}
-
-	// Offset to the profile data.
-	unsigned int profile = parser->config + 2 + nparams * 3;
-	if (profile + 5 > size) {
-		ERROR (abstract->context, "Buffer overflow detected!");
-		return DC_STATUS_DATAFORMAT;
-	}
-
-	// HelO2 dives can have an additional data block.
-	const unsigned char sequence[] = {0x01, 0x00, 0x00};
-	if (parser->model == HELO2 && memcmp (data + profile, sequence, sizeof (sequence)) != 0)
-		profile += 12;
-	if (profile + 5 > size) {
-		ERROR (abstract->context, "Buffer overflow detected!");
-		return DC_STATUS_DATAFORMAT;
-	}
-
-	// Sample recording interval.
-	unsigned int interval_sample_offset = 0x18;
-	if (parser->model == HELO2 || parser->model == D4i ||
-		parser->model == D6i || parser->model == D9tx ||
-		parser->model == ZOOPNOVO || parser->model == VYPERNOVO)
-		interval_sample_offset = 0x1E;
-	else if (parser->model == DX)
-		interval_sample_offset = 0x22;
-	unsigned int interval_sample = data[interval_sample_offset];
-	if (interval_sample == 0) {
-		ERROR (abstract->context, "Invalid sample interval.");
-		return DC_STATUS_DATAFORMAT;
-	}
+	// Number of samples remaining until the next value of each parameter.
+	unsigned int countdown[MAXPARAMS] = {0};
 
 	// Offset to the first marker position.
 	unsigned int marker = array_uint16_le (data + profile + 3);
@@ -500,37 +599,29 @@ suunto_d9_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t ca
 		if (callback) callback (DC_SAMPLE_TIME, sample, userdata);
 
 		// Sample data.
-		for (unsigned int i = 0; i < nparams; ++i) {
-			if (info[i].interval && (nsamples % info[i].interval) == 0) {
-				if (offset + info[i].size > size) {
-					ERROR (abstract->context, "Buffer overflow detected!");
-					return DC_STATUS_DATAFORMAT;
+		if (parser->samplesize && offset + parser->samplesize <= size) {
+			// Fast path: all parameters are present and available.
+			for (unsigned int i = 0; i < nparams; ++i) {
+				suunto_d9_parser_sample (&info[i], data + offset, &sample, callback, userdata);
+				offset += info[i].size;
+			}
+		} else {
+			for (unsigned int i = 0; i < nparams; ++i) {
+				if (info[i].interval == 0)
+					continue;
+
+				if (countdown[i]) {
+					countdown[i]--;
+					continue;
 				}
+				countdown[i] = info[i].interval - 1;
 
-				unsigned int value = 0;
-				switch (info[i].type) {
-				case 0x64: // Depth
-					value = array_uint16_le (data + offset);
-					sample.depth = value / (double) info[i].divisor;
-					if (callback) callback (DC_SAMPLE_DEPTH, sample, userdata);
-					break;
-				case 0x68: // Pressure
-					value = array_uint16_le (data + offset);
-					if (value != 0xFFFF) {
-						sample.pressure.tank = 0;
-						sample.pressure.value = value / (double) info[i].divisor;
-						if (callback) callback (DC_SAMPLE_PRESSURE, sample, userdata);
-					}
-					break;
-				case 0x74: // Temperature
-					sample.temperature = (signed char) data[offset] / (double) info[i].divisor;
-					if (callback) callback (DC_SAMPLE_TEMPERATURE, sample, userdata);
-					break;
-				default: // Unknown sample type
-					ERROR (abstract->context, "Unknown sample type 0x%02x.", info[i].type);
+				if (offset + info[i].size > size) {
+					ERROR (abstract->context, "Buffer overflow detected!");
 					return DC_STATUS_DATAFORMAT;
 				}
 
+				suunto_d9_parser_sample (&info[i], data + offset, &sample, callback, userdata);
 				offset += info[i].size;
 			}
 		}
@@ -19,7 +19,10 @@
  * MA 02110-1301 USA
  */
 
+#define DC_LOG_CATEGORY DC_LOGCATEGORY_PARSER
+
 #include <stdlib.h>
+#include <math.h>
 
 #include <libdivecomputer/suunto_eon.h>
 #include <libdivecomputer/units.h>
@@ -40,6 +43,7 @@ struct suunto_eon_parser_t {
 	unsigned int divetime;
 	unsigned int maxdepth;
 	unsigned int marker;
+	unsigned int nsamples;
 	unsigned int nitrox;
 };
 
@@ -47,6 +51,7 @@ static dc_status_t suunto_eon_parser_set_data (dc_parser_t *abstract, const unsi
 static dc_status_t suunto_eon_parser_get_datetime (dc_parser_t *abstract, dc_datetime_t *datetime);
 static dc_status_t suunto_eon_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsigned int flags, void *value);
 static dc_status_t suunto_eon_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata);
+static dc_status_t suunto_eon_parser_samples_extract (dc_parser_t *abstract, dc_sample_columns_t *columns);
 
 static const dc_parser_vtable_t suunto_eon_parser_vtable = {
 	sizeof(suunto_eon_parser_t),
@@ -55,6 +60,14 @@ static const dc_parser_vtable_t suunto_eon_parser_vtable = {
 	suunto_eon_parser_get_datetime, /* datetime */
 	suunto_eon_parser_get_field, /* fields */
 	suunto_eon_parser_samples_foreach, /* samples_foreach */
+	suunto_eon_parser_samples_extract, /* samples_extract */
+	NULL, /* samples_range */
+	NULL, /* samples_seek */
+	NULL, /* samples_index */
+	NULL, /* samples_split */
+	NULL, /* samples_chunk */
+	NULL, /* subdives */
+	NULL, /* samples_vendor */
 	NULL /* destroy */
 };
 
@@ -102,6 +115,7 @@ suunto_eon_parser_cache (suunto_eon_parser_t *parser)
 	parser->divetime = nsamples * interval;
 	parser->maxdepth = maxdepth;
 	parser->marker = marker;
+	parser->nsamples = nsamples;
 	parser->nitrox = nitrox;
 	parser->cached = 1;
 
@@ -129,6 +143,7 @@ suunto_eon_parser_create (dc_parser_t **out, dc_context_t *context, int spyder)
 	parser->divetime = 0;
 	parser->maxdepth = 0;
 	parser->marker = 0;
+	parser->nsamples = 0;
 	parser->nitrox = 0;
 
 	*out = (dc_parser_t*) parser;
@@ -147,6 +162,7 @@ suunto_eon_parser_set_data (dc_parser_t *abstract, const unsigned char *data, un
 	parser->divetime = 0;
 	parser->maxdepth = 0;
 	parser->marker = 0;
+	parser->nsamples = 0;
 	parser->nitrox = 0;
 
 	return DC_STATUS_SUCCESS;
@@ -343,3 +359,87 @@ suunto_eon_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t c
 
 	return DC_STATUS_SUCCESS;
 }
+
+
+static dc_status_t
+suunto_eon_parser_samples_extract (dc_parser_t *abstract, dc_sample_columns_t *columns)
+{
+	suunto_eon_parser_t *parser = (suunto_eon_parser_t *) abstract;
+	const unsigned char *data = abstract->data;
+
+	// Cache the data.
+	dc_status_t rc = suunto_eon_parser_cache (parser);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	// The depth samples are surrounded by a sample at the surface, at
+	// the start and at the end of the dive.
+	unsigned int interval = data[3];
+	unsigned int nsamples = parser->nsamples + 2;
+	unsigned int n = sample_columns_interval (columns, nsamples, interval);
+
+	if (columns->time) {
+		unsigned int *time = columns->time;
+		for (unsigned int i = 0; i < n; ++i)
+			time[i] = i * interval;
+	}
+
+	if (columns->temperature) {
+		double *temperature = columns->temperature;
+		for (unsigned int i = 0; i < n; ++i)
+			temperature[i] = NAN;
+	}
+
+	double *depth = columns->depth;
+	if (depth && n) {
+		depth[0] = 0.0;
+		if (n == nsamples)
+			depth[nsamples - 1] = 0.0;
+	}
+
+	// The cache pass already located the end marker. Each run of delta
+	// depths is accumulated in a tight loop, and the events are attached
+	// to the next depth sample.
+	unsigned int current = 0;
+	unsigned int i = 1;
+	unsigned int offset = 11;
+	while (offset < parser->marker) {
+		while (offset < parser->marker) {
+			unsigned char value = data[offset];
+			if (value >= 0x7d && value <= 0x82)
+				break;
+			current += (signed char) value;
+			if (depth && i < n)
+				depth[i] = current * FEET;
+			offset++;
+			i++;
+		}
+
+		if (offset >= parser->marker)
+			break;
+
+		unsigned int type = SAMPLE_EVENT_NONE;
+		switch (data[offset++]) {
+		case 0x7d: // Surface
+			type = SAMPLE_EVENT_SURFACE;
+			break;
+		case 0x7e: // Deco, ASC
+			type = SAMPLE_EVENT_DECOSTOP;
+			break;
+		case 0x7f: // Ceiling, ERR
+			type = SAMPLE_EVENT_CEILING;
+			break;
+		case 0x81: // Slow
+			type = SAMPLE_EVENT_ASCENT;
+			break;
+		default: // Unknown
+			WARNING (abstract->context, "Unknown event");
+			break;
+		}
+
+		if (type != SAMPLE_EVENT_NONE)
+			sample_columns_event_at (columns, i, type, 0, NULL, 0, 0);
+	}
+
+	return DC_STATUS_SUCCESS;
+}
@@ -48,6 +48,24 @@
 
 #include <libusb-1.0/libusb.h>
 
+#define PACKET_SIZE 64
+
+#if !(__APPLE__ && HAVE_HIDAPI)
+/*
+ * Number of IN transfers kept queued while streaming. With several
+ * transfers in flight, the host controller picks up every packet as soon
+ * as the device has it ready, instead of waiting for the next synchronous
+ * transfer to be submitted.
+ */
+#define NTRANSFERS 8
+
+typedef struct suunto_eonsteel_transfer_t {
+	struct libusb_transfer *transfer;
+	unsigned char buffer[PACKET_SIZE];
+	int completed;
+} suunto_eonsteel_transfer_t;
+#endif
+
 typedef struct suunto_eonsteel_device_t {
 	dc_device_t base;
 
@@ -56,6 +74,9 @@ typedef struct suunto_eonsteel_device_t {
 	hid_device *handle;
 #else
 	libusb_device_handle *handle;
+	suunto_eonsteel_transfer_t rx[NTRANSFERS];
+	unsigned int nrx;
+	unsigned int rxhead;
 #endif
 	unsigned int magic;
 	unsigned short seq;
@@ -70,10 +91,25 @@ typedef struct suunto_eonsteel_device_t {
 struct directory_entry {
 	struct directory_entry *next;
 	int type;
+	unsigned int time;
 	int namelen;
 	char name[1];
 };
 
+// The directory entries of a download are carved out of larger blocks,
+// and released all at once when the download is done.
+#define ARENA_BLOCKSIZE 4096
+
+struct arena_block {
+	struct arena_block *next;
+	size_t used, size;
+	// The data follows the header, suitably aligned.
+};
+
+struct dirent_arena {
+	struct arena_block *blocks;
+};
+
 // EON Steel command numbers and other magic field values
 #define INIT_CMD   0x00
 #define INIT_MAGIC 0x0001
@@ -107,14 +143,46 @@ static const dc_device_vtable_t suunto_eonsteel_device_vtable = {
 
 static const char dive_directory[] = "0:/dives";
 
-static struct directory_entry *alloc_dirent(int type, int len, const char *name)
+static void *arena_alloc(struct dirent_arena *arena, size_t size)
+{
+	const size_t align = sizeof(void *);
+	const size_t header = (sizeof(struct arena_block) + align - 1) & ~(align - 1);
+	struct arena_block *block = arena->blocks;
+
+	size = (size + align - 1) & ~(align - 1);
+	if (!block || size > block->size - block->used) {
+		size_t blocksize = size > ARENA_BLOCKSIZE ? size : ARENA_BLOCKSIZE;
+		block = (struct arena_block *) malloc(header + blocksize);
+		if (!block)
+			return NULL;
+		block->next = arena->blocks;
+		block->used = 0;
+		block->size = blocksize;
+		arena->blocks = block;
+	}
+
+	block->used += size;
+	return (unsigned char *) block + header + block->used - size;
+}
+
+static void arena_free(struct dirent_arena *arena)
+{
+	while (arena->blocks) {
+		struct arena_block *next = arena->blocks->next;
+		free(arena->blocks);
+		arena->blocks = next;
+	}
+}
+
+static struct directory_entry *alloc_dirent(struct dirent_arena *arena, int type, int len, const char *name)
 {
 	struct directory_entry *res;
 
-	res = (struct directory_entry *) malloc(offsetof(struct directory_entry, name) + len + 1);
+	res = (struct directory_entry *) arena_alloc(arena, offsetof(struct directory_entry, name) + len + 1);
 	if (res) {
 		res->next = NULL;
 		res->type = type;
+		res->time = 0;
 		res->namelen = len;
 		memcpy(res->name, name, len);
 		res->name[len] = 0;
@@ -146,7 +214,141 @@ static void put_le32(unsigned int val, unsigned char *p)
  *
  * The maximum payload is 62 bytes.
  */
-#define PACKET_SIZE 64
+#if !(__APPLE__ && HAVE_HIDAPI)
+static void LIBUSB_CALL stream_callback(struct libusb_transfer *transfer)
+{
+	suunto_eonsteel_transfer_t *rx = (suunto_eonsteel_transfer_t *) transfer->user_data;
+
+	rx->completed = 1;
+}
+
+static void stream_stop(suunto_eonsteel_device_t *eon)
+{
+	unsigned int i;
+
+	for (i = 0; i < eon->nrx; i++) {
+		if (!eon->rx[i].completed)
+			libusb_cancel_transfer(eon->rx[i].transfer);
+	}
+
+	for (i = 0; i < eon->nrx; i++) {
+		while (!eon->rx[i].completed) {
+			if (libusb_handle_events_completed(eon->ctx, &eon->rx[i].completed) < 0)
+				break;
+		}
+		libusb_free_transfer(eon->rx[i].transfer);
+		eon->rx[i].transfer = NULL;
+	}
+
+	eon->nrx = 0;
+	eon->rxhead = 0;
+}
+
+/*
+ * Queue all IN transfers. If this fails for whatever reason, we simply
+ * fall back to one synchronous transfer per packet.
+ */
+static void stream_start(suunto_eonsteel_device_t *eon)
+{
+	const int InEndpoint = 0x82;
+	unsigned int i;
+
+	eon->nrx = 0;
+	eon->rxhead = 0;
+
+	for (i = 0; i < NTRANSFERS; i++) {
+		suunto_eonsteel_transfer_t *rx = &eon->rx[i];
+
+		rx->transfer = libusb_alloc_transfer(0);
+		if (!rx->transfer)
+			break;
+
+		// No timeout: a queued transfer may legitimately stay idle
+		// between two commands. The timeout is handled while waiting.
+		libusb_fill_interrupt_transfer(rx->transfer, eon->handle, InEndpoint,
+			rx->buffer, PACKET_SIZE, stream_callback, rx, 0);
+
+		rx->completed = 0;
+		if (libusb_submit_transfer(rx->transfer) < 0) {
+			libusb_free_transfer(rx->transfer);
+			rx->transfer = NULL;
+			break;
+		}
+
+		eon->nrx++;
+	}
+
+	if (eon->nrx < NTRANSFERS) {
+		WARNING(eon->base.context, "unable to queue the read transfers, using synchronous reads");
+		stream_stop(eon);
+	}
+}
+
+/*
+ * Get the next packet from the queue. Transfers on the same endpoint
+ * complete in the order they were submitted, so the head of the queue
+ * always holds the oldest packet.
+ */
+static int stream_receive(suunto_eonsteel_device_t *eon, unsigned char *buf, int timeout, int *transferred)
+{
+	suunto_eonsteel_transfer_t *rx = &eon->rx[eon->rxhead];
+	int rc, elapsed = 0;
+
+	while (!rx->completed && elapsed < timeout) {
+		struct timeval tv = {0, 100000};
+		rc = libusb_handle_events_timeout_completed(eon->ctx, &tv, &rx->completed);
+		if (rc < 0)
+			return rc;
+		elapsed += 100;
+
+		// Stop waiting when the download is cancelled. The transfer
+		// stays queued, and is cancelled when the device is closed.
+		if (!rx->completed && device_is_cancelled(&eon->base))
+			return LIBUSB_ERROR_INTERRUPTED;
+	}
+
+	if (!rx->completed)
+		return LIBUSB_ERROR_TIMEOUT;
+
+	switch (rx->transfer->status) {
+	case LIBUSB_TRANSFER_COMPLETED:
+		rc = 0;
+		break;
+	case LIBUSB_TRANSFER_TIMED_OUT:
+		rc = LIBUSB_ERROR_TIMEOUT;
+		break;
+	case LIBUSB_TRANSFER_STALL:
+		rc = LIBUSB_ERROR_PIPE;
+		break;
+	case LIBUSB_TRANSFER_NO_DEVICE:
+		rc = LIBUSB_ERROR_NO_DEVICE;
+		break;
+	case LIBUSB_TRANSFER_OVERFLOW:
+		rc = LIBUSB_ERROR_OVERFLOW;
+		break;
+	default:
+		rc = LIBUSB_ERROR_IO;
+		break;
+	}
+	if (rc)
+		return rc;
+
+	*transferred = rx->transfer->actual_length;
+	memcpy(buf, rx->buffer, rx->transfer->actual_length);
+
+	// Queue the transfer again, at the tail of the queue.
+	rx->completed = 0;
+	rc = libusb_submit_transfer(rx->transfer);
+	if (rc < 0) {
+		rx->completed = 1;
+		return rc;
+	}
+	eon->rxhead = (eon->rxhead + 1) % eon->nrx;
+
+	return 0;
+}
+#endif
+
 static int receive_packet(suunto_eonsteel_device_t *eon, unsigned char *buffer, int size)
 {
 	unsigned char buf[64];
@@ -158,7 +360,10 @@ static int receive_packet(suunto_eonsteel_device_t *eon, unsigned char *buffer,
 	transferred = hid_read_timeout(eon->handle, buf, PACKET_SIZE, 5000);
 	rc = (transferred <= 0) ? -1 : 0;
 #else
-	rc = libusb_interrupt_transfer(eon->handle, InEndpoint, buf, PACKET_SIZE, &transferred, 5000);
+	if (eon->nrx)
+		rc = stream_receive(eon, buf, 5000, &transferred);
+	else
+		rc = libusb_interrupt_transfer(eon->handle, InEndpoint, buf, PACKET_SIZE, &transferred, 5000);
 #endif
 	if (rc) {
 		ERROR(eon->base.context, "read interrupt transfer failed (%s)", libusb_error_name(rc));
@@ -400,6 +605,12 @@ static int read_file(suunto_eonsteel_device_t *eon, const char *filename, dc_buf
 	size = array_uint32_le(result+4);
 	offset = 0;
 
+	// Pre-allocate the memory for the entire file.
+	if (!dc_buffer_reserve(buf, dc_buffer_get_size(buf) + size)) {
+		ERROR(eon->base.context, "out of memory reading %s", filename);
+		return -1;
+	}
+
 	while (size > 0) {
 		unsigned int ask, got, at;
 
@@ -460,7 +671,7 @@ static int read_file(suunto_eonsteel_device_t *eon, const char *filename, dc_buf
  * with the last dirent first. That's intentional: for dives,
  * we will want to look up the last dive first.
  */
-static struct directory_entry *parse_dirent(suunto_eonsteel_device_t *eon, int nr, const unsigned char *p, int len, struct directory_entry *old)
+static struct directory_entry *parse_dirent(suunto_eonsteel_device_t *eon, struct dirent_arena *arena, int nr, const unsigned char *p, int len, struct directory_entry *old)
 {
 	while (len > 8) {
 		unsigned int type = array_uint32_le(p);
@@ -476,7 +687,7 @@ static struct directory_entry *parse_dirent(suunto_eonsteel_device_t *eon, int n
 
 		p += 8 + namelen + 1;
 		len -= 8 + namelen + 1;
-		entry = alloc_dirent(type, namelen, (const char *) name);
+		entry = alloc_dirent(arena, type, namelen, (const char *) name);
 		if (!entry) {
 			ERROR(eon->base.context, "out of memory");
 			break;
@@ -487,7 +698,7 @@ static struct directory_entry *parse_dirent(suunto_eonsteel_device_t *eon, int n
 	return old;
 }
 
-static int get_file_list(suunto_eonsteel_device_t *eon, struct directory_entry **res)
+static int get_file_list(suunto_eonsteel_device_t *eon, struct dirent_arena *arena, struct directory_entry **res)
 {
 	struct directory_entry *de = NULL;
 	unsigned char cmd[64];
@@ -525,7 +736,7 @@ static int get_file_list(suunto_eonsteel_device_t *eon, struct directory_entry *
 		last = array_uint32_le(result+4);
 		HEXDUMP(eon->base.context, DC_LOGLEVEL_DEBUG, "dir packet", result, 8);
 
-		de = parse_dirent(eon, nr, result+8, rc-8, de);
+		de = parse_dirent(eon, arena, nr, result+8, rc-8, de);
 		if (last)
 			break;
 	}
@@ -564,6 +775,10 @@ static int initialize_eonsteel(suunto_eonsteel_device_t *eon)
 			break;
 	}
 
+#if !(__APPLE__ && HAVE_HIDAPI)
+	stream_start(eon);
+#endif
+
 	if (send_cmd(eon, INIT_CMD, sizeof(init), init)) {
 		ERROR(eon->base.context, "Failed to send initialization command");
 		return -1;
@@ -598,10 +813,14 @@ suunto_eonsteel_device_open(dc_device_t **out, dc_context_t *context, const char
 	eon->seq = INIT_SEQ;
 	memset (eon->version, 0, sizeof (eon->version));
 	memset (eon->fingerprint, 0, sizeof (eon->fingerprint));
+#if !(__APPLE__ && HAVE_HIDAPI)
+	eon->nrx = 0;
+	eon->rxhead = 0;
+#endif
 
 #if __APPLE__ && HAVE_HIDAPI
 
-	if (hid_init()) {
+	if (dc_context_hid_acquire(context) != DC_STATUS_SUCCESS) {
 		ERROR(context, "hid_init() failed");
 		status = DC_STATUS_IO;
 		goto error_free;
@@ -610,14 +829,13 @@ suunto_eonsteel_device_open(dc_device_t **out, dc_context_t *context, const char
 	eon->handle = hid_open(0x1493, 0x0030, NULL);
 	if (!eon->handle) {
 		ERROR(context, "unable to open device");
-		hid_exit();
 		status = DC_STATUS_IO;
 		goto error_usb_exit;
 	}
 
 #else
 
-	if (libusb_init(&eon->ctx)) {
+	if (dc_context_usb_acquire(context, &eon->ctx) != DC_STATUS_SUCCESS) {
 		ERROR(context, "libusb_init() failed");
 		status = DC_STATUS_IO;
 		goto error_free;
@@ -650,14 +868,15 @@ error_usb_close:
 #if __APPLE__ && HAVE_HIDAPI
 	hid_close(eon->handle);
 #else
+	stream_stop(eon);
 	libusb_close(eon->handle);
 #endif
 
 error_usb_exit:
 #if __APPLE__ && HAVE_HIDAPI
-	hid_exit();
+	dc_context_hid_release(context);
 #else
-	libusb_exit(eon->ctx);
+	dc_context_usb_release(context, eon->ctx);
 #endif
 
 error_free:
@@ -675,6 +894,75 @@ static int count_dir_entries(struct directory_entry *de)
 	return count;
 }
 
+static int compare_dive_entries(const void *a, const void *b)
+{
+	const struct directory_entry *x = *(const struct directory_entry * const *) a;
+	const struct directory_entry *y = *(const struct directory_entry * const *) b;
+
+	// Newest dive first.
+	if (x->time > y->time)
+		return -1;
+	if (x->time < y->time)
+		return 1;
+	return 0;
+}
+
+/*
+ * The dive filenames are the hexadecimal timestamp of the dive, which
+ * is also the fingerprint. That means we can pick the new dives from
+ * the directory listing alone, without reading any of the files.
+ *
+ * This drops everything that isn't a new dive, or that is already known
+ * to the application, and sorts the remaining ones with the newest dive
+ * first.
+ */
+static struct directory_entry *filter_dive_entries(suunto_eonsteel_device_t *eon, struct directory_entry *de, unsigned int *count)
+{
+	unsigned int fptime = array_uint32_le(eon->fingerprint);
+	struct directory_entry **array, *res = NULL;
+	unsigned int i, n = 0;
+
+	*count = 0;
+	if (!de)
+		return NULL;
+
+	array = (struct directory_entry **) malloc(count_dir_entries(de) * sizeof(*array));
+	if (!array) {
+		ERROR(eon->base.context, "out of memory");
+		return NULL;
+	}
+
+	while (de) {
+		struct directory_entry *next = de->next;
+		unsigned char fp[4];
+		int keep = 0;
+
+		if (de->type == DIRTYPE_FILE &&
+			sscanf(de->name, "%x.LOG", &de->time) == 1 &&
+			(fptime == 0 || de->time > fptime)) {
+			put_le32(de->time, fp);
+			keep = !device_fingerprint_known(&eon->base, fp, sizeof(fp));
+		}
+
+		if (keep)
+			array[n++] = de;
+
+		de = next;
+	}
+
+	qsort(array, n, sizeof(*array), compare_dive_entries);
+
+	for (i = n; i > 0; i--) {
+		array[i - 1]->next = res;
+		res = array[i - 1];
+	}
+
+	free(array);
+
+	*count = n;
+	return res;
+}
+
 static dc_status_t
 suunto_eonsteel_device_set_fingerprint (dc_device_t *abstract, const unsigned char data[], unsigned int size)
 {
@@ -696,15 +984,17 @@ suunto_eonsteel_device_foreach(dc_device_t *abstract, dc_dive_callback_t callbac
 {
 	int skip = 0, rc;
 	struct directory_entry *de;
+	struct dirent_arena arena = { NULL };
 	suunto_eonsteel_device_t *eon = (suunto_eonsteel_device_t *) abstract;
 	dc_buffer_t *file;
 	char pathname[64];
-	unsigned int time;
 	unsigned int count = 0;
 	dc_event_progress_t progress = EVENT_PROGRESS_INITIALIZER;
 
-	if (get_file_list(eon, &de) < 0)
+	if (get_file_list(eon, &arena, &de) < 0) {
+		arena_free(&arena);
 		return DC_STATUS_IO;
+	}
 
 	// Emit a device info event.
 	dc_event_devinfo_t devinfo;
@@ -713,8 +1003,9 @@ suunto_eonsteel_device_foreach(dc_device_t *abstract, dc_dive_callback_t callbac
 	devinfo.serial = array_convert_str2num(eon->version + 0x10, 16);
 	device_event_emit (abstract, DC_EVENT_DEVINFO, &devinfo);
 
-	count = count_dir_entries(de);
+	de = filter_dive_entries(eon, de, &count);
 	if (count == 0)  {
+		arena_free(&arena);
 		return DC_STATUS_SUCCESS;
 	}
 
@@ -733,22 +1024,16 @@ suunto_eonsteel_device_foreach(dc_device_t *abstract, dc_dive_callback_t callbac
 		if (device_is_cancelled(abstract))
 			skip = 1;
 
-		switch (de->type) {
-		case DIRTYPE_DIR:
-			/* Ignore subdirectories in the dive directory */
-			break;
-		case DIRTYPE_FILE:
+		do {
 			if (skip)
 				break;
-			if (sscanf(de->name, "%x.LOG", &time) != 1)
-				break;
 			len = snprintf(pathname, sizeof(pathname), "%s/%s", dive_directory, de->name);
 			if (len >= sizeof(pathname))
 				break;
 
 			// Reset the membuffer, put the 4-byte length at the head.
 			dc_buffer_clear(file);
-			put_le32(time, buf);
+			put_le32(de->time, buf);
 			dc_buffer_append(file, buf, 4);
 
 			// Then read the filename into the rest of the buffer
@@ -759,21 +1044,16 @@ suunto_eonsteel_device_foreach(dc_device_t *abstract, dc_dive_callback_t callbac
 			data = dc_buffer_get_data(file);
 			size = dc_buffer_get_size(file);
 
-			if (memcmp (data, eon->fingerprint, sizeof (eon->fingerprint)) == 0) {
-				skip = 1;
-				break;
-			}
-
 			if (callback && !callback(data, size, data, sizeof(eon->fingerprint), userdata))
 				skip = 1;
-		}
+		} while (0);
 		progress.current++;
 		device_event_emit(abstract, DC_EVENT_PROGRESS, &progress);
 
-		free(de);
 		de = next;
 	}
 	dc_buffer_free(file);
+	arena_free(&arena);
 
 	return device_is_cancelled(abstract) ? DC_STATUS_CANCELLED : DC_STATUS_SUCCESS;
 }
@@ -786,10 +1066,11 @@ suunto_eonsteel_device_close(dc_device_t *abstract)
 
 #if __APPLE__ && HAVE_HIDAPI
 	hid_close(eon->handle);
-	hid_exit();
+	dc_context_hid_release(abstract->context);
 #else
+	stream_stop(eon);
 	libusb_close(eon->handle);
-	libusb_exit(eon->ctx);
+	dc_context_usb_release(abstract->context, eon->ctx);
 #endif
 
 	return DC_STATUS_SUCCESS;
@@ -19,7 +19,10 @@
  * MA 02110-1301 USA
  */
 
+#define DC_LOG_CATEGORY DC_LOGCATEGORY_PARSER
+
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <stdio.h>
 #include <ctype.h>
@@ -73,19 +76,43 @@ enum eon_sample {
 #define EON_MAX_GROUP 16
 
 struct type_desc {
+	unsigned int id;
 	const char *desc, *format, *mod;
 	unsigned int size;
 	enum eon_sample type[EON_MAX_GROUP];
 };
 
+// Interned descriptor string, with the cached result of resolving it
+// as a sample name or as a format.
+struct type_string {
+	struct type_string *next;
+	unsigned int have_type, have_size;
+	enum eon_sample type;
+	unsigned int size;
+	unsigned int len;
+	char str[1];
+};
+
 #define MAXTYPE 512
 #define MAXGASES 16
 #define MAXSTRINGS 32
+#define TEXTSIZE   2048
+#define NSTRINGBUCKETS 64
 
 typedef struct suunto_eonsteel_parser_t {
 	dc_parser_t base;
-	struct type_desc type_desc[MAXTYPE];
-	// field cache
+	// The descriptors of the current dive, densely packed in the order
+	// they are seen. The index maps a type number to its slot plus one,
+	// or zero if the type has not been described.
+	unsigned short type_index[MAXTYPE];
+	struct type_desc *type_desc;
+	unsigned int ntypes, maxtypes;
+	// The descriptor strings. Suunto uses the same schema for every
+	// dive, so they are kept for the lifetime of the parser.
+	struct type_string *strings[NSTRINGBUCKETS];
+	// field cache, filled on first use, together with the samples if
+	// those are requested first
+	unsigned int cache_valid, cache_busy;
 	struct {
 		unsigned int initialized;
 		unsigned int divetime;
@@ -104,47 +131,75 @@ typedef struct suunto_eonsteel_parser_t {
 		double tanksize[MAXGASES];
 		double tankworkingpressure[MAXGASES];
 	} cache;
+	// The text of the string fields, which remains valid until the
+	// field cache is filled again for the next dive.
+	char text[TEXTSIZE];
+	unsigned int textsize;
 } suunto_eonsteel_parser_t;
 
 typedef int (*eon_data_cb_t)(unsigned short type, const struct type_desc *desc, const unsigned char *data, int len, void *user);
 
-static const struct {
+// Sorted by name, for the binary search in lookup_descriptor_type().
+static const struct type_translation_t {
 	const char *name;
 	enum eon_sample type;
 } type_translation[] = {
 	{ "+Time",				ES_dtime },
-	{ "Depth",				ES_depth },
-	{ "Temperature",			ES_temp },
-	{ "NoDecTime",				ES_ndl },
 	{ "Ceiling",				ES_ceiling },
-	{ "TimeToSurface",			ES_tts },
-	{ "Heading",				ES_heading },
-	{ "DeviceInternalAbsPressure",		ES_abspressure },
-	{ "GasTime",				ES_gastime },
-	{ "Ventilation",			ES_ventilation },
 	{ "Cylinders+Cylinder.GasNumber",	ES_gasnr },
 	{ "Cylinders.Cylinder.Pressure",	ES_pressure },
-	{ "Events+State.Type",			ES_state },
-	{ "Events.State.Active",		ES_state_active },
+	{ "Depth",				ES_depth },
+	{ "DeviceInternalAbsPressure",		ES_abspressure },
+	{ "Events+Alarm.Type",			ES_alarm },
 	{ "Events+Notify.Type",			ES_notify },
-	{ "Events.Notify.Active",		ES_notify_active },
+	{ "Events+State.Type",			ES_state },
 	{ "Events+Warning.Type",		ES_warning },
-	{ "Events.Warning.Active",		ES_warning_active },
-	{ "Events+Alarm.Type",			ES_alarm },
 	{ "Events.Alarm.Active",		ES_alarm_active },
 	{ "Events.Bookmark.Name",		ES_bookmark },
-	{ "Events.GasSwitch.GasNumber",		ES_gasswitch },
-	{ "Events.SetPoint.Type",		ES_setpoint_type },
-	{ "Events.Events.SetPoint.PO2",		ES_setpoint_po2 },
-	{ "Events.SetPoint.Automatic",		ES_setpoint_automatic },
 	{ "Events.DiveTimer.Active",		ES_none },
 	{ "Events.DiveTimer.Time",		ES_none },
+	{ "Events.Events.SetPoint.PO2",		ES_setpoint_po2 },
+	{ "Events.GasSwitch.GasNumber",		ES_gasswitch },
+	{ "Events.Notify.Active",		ES_notify_active },
+	{ "Events.SetPoint.Automatic",		ES_setpoint_automatic },
+	{ "Events.SetPoint.Type",		ES_setpoint_type },
+	{ "Events.State.Active",		ES_state_active },
+	{ "Events.Warning.Active",		ES_warning_active },
+	{ "GasTime",				ES_gastime },
+	{ "Heading",				ES_heading },
+	{ "NoDecTime",				ES_ndl },
+	{ "Temperature",			ES_temp },
+	{ "TimeToSurface",			ES_tts },
+	{ "Ventilation",			ES_ventilation },
 };
 
-static enum eon_sample lookup_descriptor_type(suunto_eonsteel_parser_t *eon, struct type_desc *desc)
+static struct type_desc *lookup_type_desc(suunto_eonsteel_parser_t *eon, unsigned int type)
 {
-	int i;
-	const char *name = desc->desc;
+	unsigned int slot;
+
+	if (type >= MAXTYPE)
+		return NULL;
+
+	slot = eon->type_index[type];
+	if (!slot)
+		return NULL;
+
+	return eon->type_desc + slot - 1;
+}
+
+static int compare_type_translation(const void *key, const void *entry)
+{
+	return strcmp((const char *) key, ((const struct type_translation_t *) entry)->name);
+}
+
+static struct type_string *string_entry(const char *str)
+{
+	return (struct type_string *) (str - offsetof(struct type_string, str));
+}
+
+static enum eon_sample resolve_descriptor_type(const char *name)
+{
+	const struct type_translation_t *entry;
 
 	// Not a sample type? Skip it
 	if (strncmp(name, "sml.DeviceLog.Samples", 21))
@@ -166,11 +221,29 @@ static enum eon_sample lookup_descriptor_type(suunto_eonsteel_parser_t *eon, str
 	name += 8;
 
 	// .. and look it up in the table of sample type strings
-	for (i = 0; i < C_ARRAY_SIZE(type_translation); i++) {
-		if (!strcmp(name, type_translation[i].name))
-			return type_translation[i].type;
+	entry = (const struct type_translation_t *) bsearch(name, type_translation,
+		C_ARRAY_SIZE(type_translation), sizeof(type_translation[0]),
+		compare_type_translation);
+	if (!entry)
+		return ES_none;
+
+	return entry->type;
+}
+
+/*
+ * The descriptor strings are interned, so the sample type is resolved
+ * only once per distinct string, and not again for every dive.
+ */
+static enum eon_sample lookup_descriptor_type(suunto_eonsteel_parser_t *eon, struct type_desc *desc)
+{
+	struct type_string *entry = string_entry(desc->desc);
+
+	if (!entry->have_type) {
+		entry->type = resolve_descriptor_type(desc->desc);
+		entry->have_type = 1;
 	}
-	return ES_none;
+
+	return entry->type;
 }
 
 static const char *desc_type_name(enum eon_sample type)
@@ -183,14 +256,10 @@ static const char *desc_type_name(enum eon_sample type)
 	return "Unknown";
 }
 
-static int lookup_descriptor_size(suunto_eonsteel_parser_t *eon, struct type_desc *desc)
+static int resolve_descriptor_size(const char *format)
 {
-	const char *format = desc->format;
 	unsigned char c;
 
-	if (!format)
-		return 0;
-
 	if (!strncmp(format, "bool", 4))
 		return 1;
 	if (!strncmp(format, "enum", 4))
@@ -207,6 +276,22 @@ static int lookup_descriptor_size(suunto_eonsteel_parser_t *eon, struct type_des
 	return 0;
 }
 
+static int lookup_descriptor_size(suunto_eonsteel_parser_t *eon, struct type_desc *desc)
+{
+	struct type_string *entry;
+
+	if (!desc->format)
+		return 0;
+
+	entry = string_entry(desc->format);
+	if (!entry->have_size) {
+		entry->size = resolve_descriptor_size(desc->format);
+		entry->have_size = 1;
+	}
+
+	return entry->size;
+}
+
 static int fill_in_group_details(suunto_eonsteel_parser_t *eon, struct type_desc *desc)
 {
 	int subtype = 0;
@@ -218,12 +303,12 @@ static int fill_in_group_details(suunto_eonsteel_parser_t *eon, struct type_desc
 		long index;
 
 		index = strtol(grp, &end, 10);
-		if (index < 0 || index > MAXTYPE || end == grp) {
+		if (index < 0 || index >= MAXTYPE || end == grp) {
 			ERROR(eon->base.context, "Group type descriptor '%s' does not parse", desc->desc);
 			break;
 		}
-		base = eon->type_desc + index;
-		if (!base->desc) {
+		base = lookup_type_desc(eon, index);
+		if (!base || !base->desc) {
 			ERROR(eon->base.context, "Group type descriptor '%s' has undescribed index %d", desc->desc, index);
 			break;
 		}
@@ -282,13 +367,48 @@ static int fill_in_desc_details(suunto_eonsteel_parser_t *eon, struct type_desc
 	return 0;
 }
 
-static void
-desc_free (struct type_desc desc[], unsigned int count)
+static const char *intern_string(suunto_eonsteel_parser_t *eon, const char *str, unsigned int len)
 {
-	for (unsigned int i = 0; i < count; ++i) {
-		free((void *)desc[i].desc);
-		free((void *)desc[i].format);
-		free((void *)desc[i].mod);
+	struct type_string *entry;
+	unsigned int i, hash = 2166136261u;
+
+	// FNV-1a
+	for (i = 0; i < len; i++)
+		hash = (hash ^ (unsigned char) str[i]) * 16777619u;
+	hash %= NSTRINGBUCKETS;
+
+	for (entry = eon->strings[hash]; entry; entry = entry->next) {
+		if (entry->len == len && !memcmp(entry->str, str, len))
+			return entry->str;
+	}
+
+	entry = (struct type_string *) malloc(offsetof(struct type_string, str) + len + 1);
+	if (!entry)
+		return NULL;
+	parser_memory_add(&eon->base, offsetof(struct type_string, str) + len + 1);
+	entry->have_type = 0;
+	entry->have_size = 0;
+	entry->type = ES_none;
+	entry->size = 0;
+	entry->len = len;
+	memcpy(entry->str, str, len);
+	entry->str[len] = 0;
+	entry->next = eon->strings[hash];
+	eon->strings[hash] = entry;
+
+	return entry->str;
+}
+
+static void strings_free(suunto_eonsteel_parser_t *eon)
+{
+	for (unsigned int i = 0; i < NSTRINGBUCKETS; ++i) {
+		struct type_string *entry = eon->strings[i];
+		while (entry) {
+			struct type_string *next = entry->next;
+			free(entry);
+			entry = next;
+		}
+		eon->strings[i] = NULL;
 	}
 }
 
@@ -300,7 +420,7 @@ static int record_type(suunto_eonsteel_parser_t *eon, unsigned short type, const
 	memset(&desc, 0, sizeof(desc));
 	do {
 		int len;
-		char *p;
+		const char *p;
 
 		next = strchr(name, '\n');
 		if (next) {
@@ -316,14 +436,11 @@ static int record_type(suunto_eonsteel_parser_t *eon, unsigned short type, const
 			ERROR(eon->base.context, "Unexpected type description: %.*s", len, name);
 			return -1;
 		}
-		p = (char *) malloc(len-4);
+		p = intern_string(eon, name+5, len-5);
 		if (!p) {
 			ERROR(eon->base.context, "out of memory");
-			desc_free(&desc, 1);
 			return -1;
 		}
-		memcpy(p, name+5, len-5);
-		p[len-5] = 0;
 
 		// PTH, GRP, FRM, MOD
 		switch (name[1]) {
@@ -339,26 +456,37 @@ static int record_type(suunto_eonsteel_parser_t *eon, unsigned short type, const
 			break;
 		default:
 			ERROR(eon->base.context, "Unknown type descriptor: %.*s", len, name);
-			desc_free(&desc, 1);
-			free(p);
 			return -1;
 		}
 	} while ((name = next) != NULL);
 
-	if (type > MAXTYPE) {
+	if (type >= MAXTYPE) {
 		ERROR(eon->base.context, "Type out of range (%04x: '%s' '%s' '%s')",
 			type,
 			desc.desc ? desc.desc : "",
 			desc.format ? desc.format : "",
 			desc.mod ? desc.mod : "");
-		desc_free(&desc, 1);
 		return -1;
 	}
 
+	desc.id = type;
 	fill_in_desc_details(eon, &desc);
 
-	desc_free(eon->type_desc + type, 1);
-	eon->type_desc[type] = desc;
+	if (!eon->type_index[type]) {
+		if (eon->ntypes == eon->maxtypes) {
+			unsigned int maxtypes = eon->maxtypes ? eon->maxtypes * 2 : 32;
+			struct type_desc *table = (struct type_desc *) realloc(eon->type_desc, maxtypes * sizeof(*table));
+			if (!table) {
+				ERROR(eon->base.context, "out of memory");
+				return -1;
+			}
+			parser_memory_add(&eon->base, (maxtypes - eon->maxtypes) * sizeof(*table));
+			eon->type_desc = table;
+			eon->maxtypes = maxtypes;
+		}
+		eon->type_index[type] = ++eon->ntypes;
+	}
+	eon->type_desc[eon->type_index[type] - 1] = desc;
 	return 0;
 }
 
@@ -400,6 +528,7 @@ static int traverse_entry(suunto_eonsteel_parser_t *eon, const unsigned char *p,
 		const unsigned char *begin = end;
 		unsigned int type = *end++;
 		unsigned int len;
+		const struct type_desc *desc;
 		if (type == 0xff) {
 			type = array_uint16_le(end);
 			end += 2;
@@ -414,11 +543,12 @@ static int traverse_entry(suunto_eonsteel_parser_t *eon, const unsigned char *p,
 			end += 4;
 		}
 
-		if (type > MAXTYPE || !eon->type_desc[type].desc) {
+		desc = lookup_type_desc(eon, type);
+		if (!desc || !desc->desc) {
 			HEXDUMP(eon->base.context, DC_LOGLEVEL_DEBUG, "last", last, 16);
 			HEXDUMP(eon->base.context, DC_LOGLEVEL_DEBUG, "this", begin, 16);
 		} else {
-			rc = callback(type, eon->type_desc+type, end, len, user);
+			rc = callback(type, desc, end, len, user);
 			if (rc < 0)
 				return rc;
 		}
@@ -458,6 +588,7 @@ struct sample_data {
 	suunto_eonsteel_parser_t *eon;
 	dc_sample_callback_t callback;
 	void *userdata;
+	dc_sample_columns_t *columns;
 	unsigned int time;
 	const char *state_type, *notify_type;
 	const char *warning_type, *alarm_type;
@@ -474,6 +605,7 @@ static void sample_time(struct sample_data *info, unsigned short time_delta)
 
 	info->time += time_delta;
 	sample.time = info->time / 1000;
+	if (info->columns) sample_columns_time(info->columns, sample.time);
 	if (info->callback) info->callback(DC_SAMPLE_TIME, sample, info->userdata);
 }
 
@@ -485,6 +617,7 @@ static void sample_depth(struct sample_data *info, unsigned short depth)
 		return;
 
 	sample.depth = depth / 100.0;
+	if (info->columns) sample_columns_depth(info->columns, sample.depth);
 	if (info->callback) info->callback(DC_SAMPLE_DEPTH, sample, info->userdata);
 }
 
@@ -496,6 +629,7 @@ static void sample_temp(struct sample_data *info, short temp)
 		return;
 
 	sample.temperature = temp / 10.0;
+	if (info->columns) sample_columns_temperature(info->columns, sample.temperature);
 	if (info->callback) info->callback(DC_SAMPLE_TEMPERATURE, sample, info->userdata);
 }
 
@@ -533,6 +667,7 @@ static void sample_heading(struct sample_data *info, unsigned short heading)
 
 	sample.event.type = SAMPLE_EVENT_HEADING;
 	sample.event.value = heading;
+	if (info->columns) sample_columns_event(info->columns, SAMPLE_EVENT_HEADING, 0, NULL, 0, heading);
 	if (info->callback) info->callback(DC_SAMPLE_EVENT, sample, info->userdata);
 }
 
@@ -575,6 +710,7 @@ static void sample_pressure(struct sample_data *info, unsigned short pressure)
 
 	sample.pressure.tank = info->gasnr-1;
 	sample.pressure.value = pressure / 100.0;
+	if (info->columns) sample_columns_pressure(info->columns, sample.pressure.tank, sample.pressure.value);
 	if (info->callback) info->callback(DC_SAMPLE_PRESSURE, sample, info->userdata);
 }
 
@@ -585,6 +721,7 @@ static void sample_bookmark_event(struct sample_data *info, unsigned short idx)
 	sample.event.type = SAMPLE_EVENT_BOOKMARK;
 	sample.event.value = idx;
 
+	if (info->columns) sample_columns_event(info->columns, SAMPLE_EVENT_BOOKMARK, 0, NULL, 0, idx);
 	if (info->callback) info->callback(DC_SAMPLE_EVENT, sample, info->userdata);
 }
 
@@ -597,6 +734,7 @@ static void sample_gas_switch_event(struct sample_data *info, unsigned short idx
 		return;
 
 	sample.gasmix = idx - 1;
+	if (info->columns) sample_columns_gasmix(info->columns, sample.gasmix);
 	if (info->callback) info->callback(DC_SAMPLE_GASMIX, sample, info->userdata);
 
 #ifdef ENABLE_DEPRECATED
@@ -698,6 +836,7 @@ static void sample_event_state_value(const struct type_desc *desc, struct sample
 	sample.event.flags = value ? SAMPLE_FLAGS_BEGIN : SAMPLE_FLAGS_END;
 	sample.event.flags |= 1 << SAMPLE_FLAGS_SEVERITY_SHIFT;
 
+	if (info->columns) sample_columns_event(info->columns, sample.event.type, 0, name, sample.event.flags, 0);
 	if (info->callback) info->callback(DC_SAMPLE_EVENT, sample, info->userdata);
 }
 
@@ -722,6 +861,7 @@ static void sample_event_notify_value(const struct type_desc *desc, struct sampl
 	sample.event.flags = value ? SAMPLE_FLAGS_BEGIN : SAMPLE_FLAGS_END;
 	sample.event.flags |= 2 << SAMPLE_FLAGS_SEVERITY_SHIFT;
 
+	if (info->columns) sample_columns_event(info->columns, sample.event.type, 0, name, sample.event.flags, 0);
 	if (info->callback) info->callback(DC_SAMPLE_EVENT, sample, info->userdata);
 }
 
@@ -745,6 +885,7 @@ static void sample_event_warning_value(const struct type_desc *desc, struct samp
 	sample.event.flags = value ? SAMPLE_FLAGS_BEGIN : SAMPLE_FLAGS_END;
 	sample.event.flags |= 3 << SAMPLE_FLAGS_SEVERITY_SHIFT;
 
+	if (info->columns) sample_columns_event(info->columns, sample.event.type, 0, name, sample.event.flags, 0);
 	if (info->callback) info->callback(DC_SAMPLE_EVENT, sample, info->userdata);
 }
 
@@ -769,6 +910,7 @@ static void sample_event_alarm_value(const struct type_desc *desc, struct sample
 	sample.event.flags = value ? SAMPLE_FLAGS_BEGIN : SAMPLE_FLAGS_END;
 	sample.event.flags |= 4 << SAMPLE_FLAGS_SEVERITY_SHIFT;
 
+	if (info->columns) sample_columns_event(info->columns, sample.event.type, 0, name, sample.event.flags, 0);
 	if (info->callback) info->callback(DC_SAMPLE_EVENT, sample, info->userdata);
 }
 
@@ -961,13 +1103,54 @@ static int traverse_samples(unsigned short type, const struct type_desc *desc, c
 	return 0;
 }
 
+static void begin_field_caches(suunto_eonsteel_parser_t *eon);
+static void end_field_caches(suunto_eonsteel_parser_t *eon);
+static int traverse_fields(unsigned short type, const struct type_desc *desc, const unsigned char *data, int len, void *user);
+
+static int traverse_samples_and_fields(unsigned short type, const struct type_desc *desc, const unsigned char *data, int len, void *user)
+{
+	struct sample_data *info = (struct sample_data *) user;
+
+	traverse_fields(type, desc, data, len, info->eon);
+	return traverse_samples(type, desc, data, len, user);
+}
+
+/*
+ * Walk the samples. If the field cache hasn't been filled yet, it is
+ * filled in the same pass, so getting all the samples and then the
+ * summary only decodes the dive once.
+ */
+static void traverse_all_samples(suunto_eonsteel_parser_t *eon, struct sample_data *info)
+{
+	if (eon->cache_valid) {
+		traverse_data(eon, traverse_samples, info);
+		return;
+	}
+
+	begin_field_caches(eon);
+	eon->cache_busy = 1;
+	traverse_data(eon, traverse_samples_and_fields, info);
+	eon->cache_busy = 0;
+	end_field_caches(eon);
+}
+
 static dc_status_t
 suunto_eonsteel_parser_samples_foreach(dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata)
 {
 	suunto_eonsteel_parser_t *eon = (suunto_eonsteel_parser_t *) abstract;
-	struct sample_data data = { eon, callback, userdata, 0 };
+	struct sample_data data = { eon, callback, userdata, NULL, 0 };
+
+	traverse_all_samples(eon, &data);
+	return DC_STATUS_SUCCESS;
+}
+
+static dc_status_t
+suunto_eonsteel_parser_samples_extract(dc_parser_t *abstract, dc_sample_columns_t *columns)
+{
+	suunto_eonsteel_parser_t *eon = (suunto_eonsteel_parser_t *) abstract;
+	struct sample_data data = { eon, NULL, NULL, columns, 0 };
 
-	traverse_data(eon, traverse_samples, &data);
+	traverse_all_samples(eon, &data);
 	return DC_STATUS_SUCCESS;
 }
 
@@ -989,6 +1172,8 @@ static dc_status_t get_string_field(suunto_eonsteel_parser_t *eon, unsigned idx,
 #define field_value(p, set) \
 	memcpy((p), &(set), sizeof(set))
 
+static void initialize_field_caches(suunto_eonsteel_parser_t *eon);
+
 static dc_status_t
 suunto_eonsteel_parser_get_field(dc_parser_t *parser, dc_field_type_t type, unsigned int flags, void *value)
 {
@@ -996,6 +1181,14 @@ suunto_eonsteel_parser_get_field(dc_parser_t *parser, dc_field_type_t type, unsi
 
 	suunto_eonsteel_parser_t *eon = (suunto_eonsteel_parser_t *)parser;
 
+	if (!eon->cache_valid) {
+		// The cache is still being filled, by the sample walk that
+		// called us back.
+		if (eon->cache_busy)
+			return DC_STATUS_UNSUPPORTED;
+		initialize_field_caches(eon);
+	}
+
 	if (!(eon->cache.initialized & (1 << type)))
 		return DC_STATUS_UNSUPPORTED;
 
@@ -1178,28 +1371,49 @@ static int add_gas_workpressure(suunto_eonsteel_parser_t *eon, float wp)
 	return 0;
 }
 
-static int add_string(suunto_eonsteel_parser_t *eon, const char *desc, const char *value)
+/*
+ * Claim the next free string field for the text at the end of the text
+ * area, which the caller has just written there.
+ */
+static int commit_string(suunto_eonsteel_parser_t *eon, const char *desc, unsigned int len)
 {
 	int i;
 
-	eon->cache.initialized |= 1 << DC_FIELD_STRING;
 	for (i = 0; i < MAXSTRINGS; i++) {
 		dc_field_string_t *str = eon->cache.strings+i;
 		if (str->desc)
 			continue;
+		eon->cache.initialized |= 1 << DC_FIELD_STRING;
 		str->desc = desc;
-		str->value = strdup(value);
+		str->value = eon->text + eon->textsize;
+		eon->textsize += len + 1;
 		break;
 	}
 	return 0;
 }
 
+static int add_string(suunto_eonsteel_parser_t *eon, const char *desc, const char *value)
+{
+	unsigned int len = strlen(value);
+
+	if (len + 1 > TEXTSIZE - eon->textsize)
+		return 0;
+
+	memcpy(eon->text + eon->textsize, value, len + 1);
+	return commit_string(eon, desc, len);
+}
+
 static int add_string_fmt(suunto_eonsteel_parser_t *eon, const char *desc, const char *fmt, ...)
 {
-	char buffer[256];
+	char *buffer = eon->text + eon->textsize;
+	unsigned int avail = TEXTSIZE - eon->textsize;
 	va_list ap;
 
+	if (avail < 2)
+		return 0;
+
 	/*
+	 * The text is formatted in place, at the end of the text area.
 	 * We ignore the return value from vsnprintf, and we
 	 * always NUL-terminate the destination buffer ourselves.
 	 *
@@ -1207,11 +1421,11 @@ static int add_string_fmt(suunto_eonsteel_parser_t *eon, const char *desc, const
 	 * implementations.
 	 */
 	va_start(ap, fmt);
-	buffer[sizeof(buffer)-1] = 0;
-	(void) vsnprintf(buffer, sizeof(buffer)-1, fmt, ap);
+	buffer[avail-1] = 0;
+	(void) vsnprintf(buffer, avail-1, fmt, ap);
 	va_end(ap);
 
-	return add_string(eon, desc, buffer);
+	return commit_string(eon, desc, strlen(buffer));
 }
 
 static float get_le32_float(const unsigned char *src)
@@ -1490,16 +1704,30 @@ static int traverse_fields(unsigned short type, const struct type_desc *desc, co
 }
 
 
-static void initialize_field_caches(suunto_eonsteel_parser_t *eon)
+static void begin_field_caches(suunto_eonsteel_parser_t *eon)
 {
 	memset(&eon->cache, 0, sizeof(eon->cache));
 	eon->cache.initialized = 1 << DC_FIELD_DIVETIME;
+	eon->textsize = 0;
+}
 
-	traverse_data(eon, traverse_fields, eon);
+static void show_all_descriptors(suunto_eonsteel_parser_t *eon);
 
+static void end_field_caches(suunto_eonsteel_parser_t *eon)
+{
 	// The internal time fields are in ms and have to be added up
 	// like that. At the end, we translate it back to seconds.
 	eon->cache.divetime /= 1000;
+	eon->cache_valid = 1;
+
+	show_all_descriptors(eon);
+}
+
+static void initialize_field_caches(suunto_eonsteel_parser_t *eon)
+{
+	begin_field_caches(eon);
+	traverse_data(eon, traverse_fields, eon);
+	end_field_caches(eon);
 }
 
 static void show_descriptor(suunto_eonsteel_parser_t *eon, int nr, struct type_desc *desc)
@@ -1523,8 +1751,8 @@ static void show_descriptor(suunto_eonsteel_parser_t *eon, int nr, struct type_d
 
 static void show_all_descriptors(suunto_eonsteel_parser_t *eon)
 {
-	for (unsigned int i = 0; i < MAXTYPE; ++i)
-		show_descriptor(eon, i, eon->type_desc+i);
+	for (unsigned int i = 0; i < eon->ntypes; ++i)
+		show_descriptor(eon, eon->type_desc[i].id, eon->type_desc+i);
 }
 
 static dc_status_t
@@ -1532,10 +1760,14 @@ suunto_eonsteel_parser_set_data(dc_parser_t *parser, const unsigned char *data,
 {
 	suunto_eonsteel_parser_t *eon = (suunto_eonsteel_parser_t *) parser;
 
-	desc_free(eon->type_desc, MAXTYPE);
-	memset(eon->type_desc, 0, sizeof(eon->type_desc));
-	initialize_field_caches(eon);
-	show_all_descriptors(eon);
+	// Only the descriptors of the previous dive need to be forgotten,
+	// which keeps re-using the parser for the next dive cheap.
+	for (unsigned int i = 0; i < eon->ntypes; ++i)
+		eon->type_index[eon->type_desc[i].id] = 0;
+	eon->ntypes = 0;
+	// The dive is only decoded once the fields or the samples are
+	// requested, so both can be collected in a single pass.
+	eon->cache_valid = 0;
 	return DC_STATUS_SUCCESS;
 }
 
@@ -1544,7 +1776,8 @@ suunto_eonsteel_parser_destroy(dc_parser_t *parser)
 {
 	suunto_eonsteel_parser_t *eon = (suunto_eonsteel_parser_t *) parser;
 
-	desc_free(eon->type_desc, MAXTYPE);
+	free(eon->type_desc);
+	strings_free(eon);
 
 	return DC_STATUS_SUCCESS;
 }
@@ -1556,6 +1789,14 @@ static const dc_parser_vtable_t suunto_eonsteel_parser_vtable = {
 	suunto_eonsteel_parser_get_datetime, /* datetime */
 	suunto_eonsteel_parser_get_field, /* fields */
 	suunto_eonsteel_parser_samples_foreach, /* samples_foreach */
+	suunto_eonsteel_parser_samples_extract, /* samples_extract */
+	NULL, /* samples_range */
+	NULL, /* samples_seek */
+	NULL, /* samples_index */
+	NULL, /* samples_split */
+	NULL, /* samples_chunk */
+	NULL, /* subdives */
+	NULL, /* samples_vendor */
 	suunto_eonsteel_parser_destroy /* destroy */
 };
 
@@ -1573,8 +1814,15 @@ suunto_eonsteel_parser_create(dc_parser_t **out, dc_context_t *context, unsigned
 		return DC_STATUS_NOMEMORY;
 	}
 
-	memset(&parser->type_desc, 0, sizeof(parser->type_desc));
+	memset(parser->type_index, 0, sizeof(parser->type_index));
+	parser->type_desc = NULL;
+	parser->ntypes = 0;
+	parser->maxtypes = 0;
+	memset(parser->strings, 0, sizeof(parser->strings));
+	parser->cache_valid = 0;
+	parser->cache_busy = 0;
 	memset(&parser->cache, 0, sizeof(parser->cache));
+	parser->textsize = 0;
 
 	*out = (dc_parser_t *) parser;
 
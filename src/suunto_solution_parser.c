@@ -19,7 +19,10 @@
  * MA 02110-1301 USA
  */
 
+#define DC_LOG_CATEGORY DC_LOGCATEGORY_PARSER
+
 #include <stdlib.h>
+#include <math.h>
 
 #include <libdivecomputer/suunto_solution.h>
 #include <libdivecomputer/units.h>
@@ -42,6 +45,7 @@ struct suunto_solution_parser_t {
 static dc_status_t suunto_solution_parser_set_data (dc_parser_t *abstract, const unsigned char *data, unsigned int size);
 static dc_status_t suunto_solution_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsigned int flags, void *value);
 static dc_status_t suunto_solution_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata);
+static dc_status_t suunto_solution_parser_samples_extract (dc_parser_t *abstract, dc_sample_columns_t *columns);
 
 static const dc_parser_vtable_t suunto_solution_parser_vtable = {
 	sizeof(suunto_solution_parser_t),
@@ -50,6 +54,14 @@ static const dc_parser_vtable_t suunto_solution_parser_vtable = {
 	NULL, /* datetime */
 	suunto_solution_parser_get_field, /* fields */
 	suunto_solution_parser_samples_foreach, /* samples_foreach */
+	suunto_solution_parser_samples_extract, /* samples_extract */
+	NULL, /* samples_range */
+	NULL, /* samples_seek */
+	NULL, /* samples_index */
+	NULL, /* samples_split */
+	NULL, /* samples_chunk */
+	NULL, /* subdives */
+	NULL, /* samples_vendor */
 	NULL /* destroy */
 };
 
@@ -220,8 +232,92 @@ suunto_solution_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callbac
 		}
 	}
 
-	if (data[offset] != 0x80)
+	if (offset >= size || data[offset] != 0x80)
 		return DC_STATUS_DATAFORMAT;
 
 	return DC_STATUS_SUCCESS;
 }
+
+
+static dc_status_t
+suunto_solution_parser_samples_extract (dc_parser_t *abstract, dc_sample_columns_t *columns)
+{
+	const unsigned char *data = abstract->data;
+	unsigned int size = abstract->size;
+
+	if (size < 4)
+		return DC_STATUS_DATAFORMAT;
+
+	// Locate the end marker, and count the depth samples. A delta with
+	// the extension byte is a single sample.
+	unsigned int nsamples = 0;
+	unsigned int offset = 3;
+	while (offset < size && data[offset] != 0x80) {
+		unsigned char value = data[offset++];
+		if (value < 0x7e || value > 0x82) {
+			if (value == 0x7D || value == 0x83) {
+				if (offset + 1 > size)
+					return DC_STATUS_DATAFORMAT;
+				offset++;
+			}
+			nsamples++;
+		}
+	}
+
+	unsigned int marker = offset;
+	if (marker >= size || data[marker] != 0x80)
+		return DC_STATUS_DATAFORMAT;
+
+	unsigned int n = sample_columns_interval (columns, nsamples, 3 * 60);
+
+	if (columns->temperature) {
+		double *temperature = columns->temperature;
+		for (unsigned int i = 0; i < n; ++i)
+			temperature[i] = NAN;
+	}
+
+	// Each run of delta depths is accumulated in a tight loop, and the
+	// events are attached to the previous depth sample.
+	double *depth = columns->depth;
+	unsigned int current = 0;
+	unsigned int i = 0;
+	offset = 3;
+	while (offset < marker) {
+		while (offset < marker) {
+			unsigned char value = data[offset];
+			if (value >= 0x7e && value <= 0x82)
+				break;
+			current += (signed char) value;
+			offset++;
+			if (value == 0x7D || value == 0x83)
+				current += (signed char) data[offset++];
+			if (depth && i < n)
+				depth[i] = current * FEET;
+			i++;
+		}
+
+		if (offset >= marker)
+			break;
+
+		unsigned int type = SAMPLE_EVENT_NONE;
+		switch (data[offset++]) {
+		case 0x7e: // Deco, ASC
+			type = SAMPLE_EVENT_DECOSTOP;
+			break;
+		case 0x7f: // Ceiling, ERR
+			type = SAMPLE_EVENT_CEILING;
+			break;
+		case 0x81: // Slow
+			type = SAMPLE_EVENT_ASCENT;
+			break;
+		default: // Unknown
+			WARNING (abstract->context, "Unknown event");
+			break;
+		}
+
+		if (type != SAMPLE_EVENT_NONE)
+			sample_columns_event_at (columns, i ? i - 1 : 0, type, 0, NULL, 0, 0);
+	}
+
+	return DC_STATUS_SUCCESS;
+}
@@ -105,6 +105,7 @@ suunto_vyper_device_open (dc_device_t **out, dc_context_t *context, const char *
 
 	// Set the default values.
 	device->port = NULL;
+	device->base.base.blocksize = SZ_PACKET;
 
 	// Open the device.
 	status = dc_serial_open (&device->port, context, name);
@@ -113,6 +114,10 @@ suunto_vyper_device_open (dc_device_t **out, dc_context_t *context, const char *
 		goto error_free;
 	}
 
+	// Interrupt the blocking reads when the download is cancelled, and
+	// measure the time spent waiting for the I/O.
+	device_set_port ((dc_device_t *) device, device->port);
+
 	// Set the serial communication protocol (2400 8O1).
 	status = dc_serial_configure (device->port, 2400, 8, DC_PARITY_ODD, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -519,6 +524,14 @@ suunto_vyper_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback,
 	if (buffer == NULL)
 		return DC_STATUS_NOMEMORY;
 
+	// The dives are downloaded with the dive commands, and not by reading
+	// the profile ringbuffer with the memory read command. A memory read
+	// returns at most $SZ_PACKET bytes and needs a new command every time.
+	// Every command costs at least 700 ms of fixed delays (see
+	// suunto_vyper_send), so reading the ringbuffer takes several minutes.
+	// A dive command streams the entire dive in response to a single
+	// command, and the download can stop at the first dive that is
+	// already known.
 	unsigned int ndives = 0;
 	unsigned int remaining = layout->rb_profile_end - layout->rb_profile_begin;
 	while ((rc = suunto_vyper_read_dive (abstract, buffer, (ndives == 0), &progress)) == DC_STATUS_SUCCESS) {
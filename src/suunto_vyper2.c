@@ -102,6 +102,10 @@ suunto_vyper2_device_open (dc_device_t **out, dc_context_t *context, const char
 		goto error_free;
 	}
 
+	// Interrupt the blocking reads when the download is cancelled, and
+	// measure the time spent waiting for the I/O.
+	device_set_port ((dc_device_t *) device, device->port);
+
 	// Set the serial communication protocol (9600 8N1).
 	status = dc_serial_configure (device->port, 9600, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -116,6 +120,11 @@ suunto_vyper2_device_open (dc_device_t **out, dc_context_t *context, const char
 		goto error_close;
 	}
 
+	// Request the lowest receive latency. Each packet is a short command
+	// followed by a short answer, so the time to transfer the data is
+	// dominated by the turnaround time of the link.
+	dc_serial_set_latency (device->port, 0);
+
 	// Set the DTR line (power supply for the interface).
 	status = dc_serial_set_dtr (device->port, 1);
 	if (status != DC_STATUS_SUCCESS) {
@@ -129,8 +138,10 @@ suunto_vyper2_device_open (dc_device_t **out, dc_context_t *context, const char
 	// Make sure everything is in a sane state.
 	dc_serial_purge (device->port, DC_DIRECTION_ALL);
 
-	// Enable half-duplex emulation.
-	dc_serial_set_halfduplex (device->port, 1);
+	// Enable half-duplex mode. Where the serial driver supports the
+	// hardware RS485 mode, the line is turned around as soon as the last
+	// byte is sent, otherwise the transmit time is emulated.
+	dc_serial_set_halfduplex (device->port, DC_HALFDUPLEX_RS485);
 
 	// Read the version info.
 	status = suunto_common2_device_version ((dc_device_t *) device, device->base.version, sizeof (device->base.version));
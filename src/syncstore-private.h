@@ -0,0 +1,48 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_SYNCSTORE_PRIVATE_H
+#define DC_SYNCSTORE_PRIVATE_H
+
+#include <libdivecomputer/syncstore.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Retrieve a tuning hint, identified by its name, for a model of the
+ * given family. If no hint is stored, the value is left unchanged and
+ * DC_STATUS_SUCCESS is returned.
+ */
+dc_status_t
+dc_syncstore_get_hint (dc_syncstore_t *store, dc_family_t family, unsigned int model, const char *name, unsigned int *value);
+
+/*
+ * Store a tuning hint for a model of the given family.
+ */
+dc_status_t
+dc_syncstore_set_hint (dc_syncstore_t *store, dc_family_t family, unsigned int model, const char *name, unsigned int value);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_SYNCSTORE_PRIVATE_H */
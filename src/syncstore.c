@@ -0,0 +1,242 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <libdivecomputer/syncstore.h>
+
+#include "syncstore-private.h"
+#include "context-private.h"
+
+struct dc_syncstore_t {
+	dc_context_t *context;
+	char *dirname;
+};
+
+dc_status_t
+dc_syncstore_new (dc_syncstore_t **out, dc_context_t *context, const char *dirname)
+{
+	dc_syncstore_t *store = NULL;
+
+	if (out == NULL || dirname == NULL) {
+		ERROR (context, "Invalid arguments.");
+		return DC_STATUS_INVALIDARGS;
+	}
+
+	store = (dc_syncstore_t *) malloc (sizeof (dc_syncstore_t));
+	if (store == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	store->context = context;
+	store->dirname = strdup (dirname);
+	if (store->dirname == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		free (store);
+		return DC_STATUS_NOMEMORY;
+	}
+
+	*out = store;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_syncstore_free (dc_syncstore_t *store)
+{
+	if (store == NULL)
+		return DC_STATUS_SUCCESS;
+
+	free (store->dirname);
+	free (store);
+
+	return DC_STATUS_SUCCESS;
+}
+
+static void
+dc_syncstore_filename (dc_syncstore_t *store, char filename[], size_t size, dc_family_t family, unsigned int serial, const char *suffix)
+{
+	snprintf (filename, size, "%s/%08x-%08x.fp%s", store->dirname, family, serial, suffix);
+}
+
+dc_status_t
+dc_syncstore_get (dc_syncstore_t *store, dc_family_t family, unsigned int serial, dc_buffer_t *fingerprint)
+{
+	char filename[1024];
+	unsigned char data[64];
+
+	if (store == NULL || fingerprint == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_buffer_clear (fingerprint);
+
+	dc_syncstore_filename (store, filename, sizeof (filename), family, serial, "");
+
+	FILE *fp = fopen (filename, "rb");
+	if (fp == NULL)
+		return DC_STATUS_SUCCESS; // No fingerprint stored yet.
+
+	size_t n = 0;
+	while ((n = fread (data, 1, sizeof (data), fp)) > 0) {
+		if (!dc_buffer_append (fingerprint, data, n)) {
+			ERROR (store->context, "Insufficient buffer space available.");
+			fclose (fp);
+			return DC_STATUS_NOMEMORY;
+		}
+	}
+
+	if (ferror (fp)) {
+		ERROR (store->context, "Failed to read the fingerprint.");
+		dc_buffer_clear (fingerprint);
+		fclose (fp);
+		return DC_STATUS_IO;
+	}
+
+	fclose (fp);
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_syncstore_set (dc_syncstore_t *store, dc_family_t family, unsigned int serial, const unsigned char data[], unsigned int size)
+{
+	char filename[1024], tmpname[1024];
+
+	if (store == NULL || (data == NULL && size))
+		return DC_STATUS_INVALIDARGS;
+
+	dc_syncstore_filename (store, filename, sizeof (filename), family, serial, "");
+	dc_syncstore_filename (store, tmpname, sizeof (tmpname), family, serial, ".tmp");
+
+	// Write to a temporary file first, and replace the previous
+	// fingerprint only when everything has been written successfully.
+	FILE *fp = fopen (tmpname, "wb");
+	if (fp == NULL) {
+		ERROR (store->context, "Failed to open the file.");
+		return DC_STATUS_IO;
+	}
+
+	if (fwrite (data, 1, size, fp) != size) {
+		ERROR (store->context, "Failed to write the file.");
+		fclose (fp);
+		remove (tmpname);
+		return DC_STATUS_IO;
+	}
+
+	if (fclose (fp) != 0) {
+		ERROR (store->context, "Failed to close the file.");
+		remove (tmpname);
+		return DC_STATUS_IO;
+	}
+
+#ifdef _WIN32
+	// On Windows, rename fails if the destination already exists.
+	remove (filename);
+#endif
+	if (rename (tmpname, filename) != 0) {
+		ERROR (store->context, "Failed to rename the file.");
+		remove (tmpname);
+		return DC_STATUS_IO;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+static void
+dc_syncstore_hintname (dc_syncstore_t *store, char filename[], size_t size, dc_family_t family, unsigned int model, const char *name, const char *suffix)
+{
+	snprintf (filename, size, "%s/%08x-m%08x.%s%s", store->dirname, family, model, name, suffix);
+}
+
+dc_status_t
+dc_syncstore_get_hint (dc_syncstore_t *store, dc_family_t family, unsigned int model, const char *name, unsigned int *value)
+{
+	char filename[1024];
+
+	if (store == NULL || name == NULL || value == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_syncstore_hintname (store, filename, sizeof (filename), family, model, name, "");
+
+	FILE *fp = fopen (filename, "r");
+	if (fp == NULL)
+		return DC_STATUS_SUCCESS; // No hint stored yet.
+
+	unsigned int hint = 0;
+	int n = fscanf (fp, "%u", &hint);
+
+	fclose (fp);
+
+	if (n != 1) {
+		WARNING (store->context, "Ignoring the damaged '%s' hint.", name);
+		return DC_STATUS_SUCCESS;
+	}
+
+	*value = hint;
+
+	return DC_STATUS_SUCCESS;
+}
+
+dc_status_t
+dc_syncstore_set_hint (dc_syncstore_t *store, dc_family_t family, unsigned int model, const char *name, unsigned int value)
+{
+	char filename[1024], tmpname[1024];
+
+	if (store == NULL || name == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_syncstore_hintname (store, filename, sizeof (filename), family, model, name, "");
+	dc_syncstore_hintname (store, tmpname, sizeof (tmpname), family, model, name, ".tmp");
+
+	FILE *fp = fopen (tmpname, "w");
+	if (fp == NULL) {
+		ERROR (store->context, "Failed to open the file.");
+		return DC_STATUS_IO;
+	}
+
+	if (fprintf (fp, "%u\n", value) < 0) {
+		ERROR (store->context, "Failed to write the file.");
+		fclose (fp);
+		remove (tmpname);
+		return DC_STATUS_IO;
+	}
+
+	if (fclose (fp) != 0) {
+		ERROR (store->context, "Failed to close the file.");
+		remove (tmpname);
+		return DC_STATUS_IO;
+	}
+
+#ifdef _WIN32
+	// On Windows, rename fails if the destination already exists.
+	remove (filename);
+#endif
+	if (rename (tmpname, filename) != 0) {
+		ERROR (store->context, "Failed to rename the file.");
+		remove (tmpname);
+		return DC_STATUS_IO;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
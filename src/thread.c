@@ -0,0 +1,371 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#if defined(HAVE_PTHREAD_SETAFFINITY_NP) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <stdlib.h>
+
+#ifdef _WIN32
+#define NOGDI
+#include <windows.h>
+#else
+#include <time.h>
+#include <errno.h>
+#include <sched.h>
+#endif
+
+#include "thread.h"
+
+struct dc_mutex_t {
+#ifdef _WIN32
+	CRITICAL_SECTION cs;
+#else
+	pthread_mutex_t mutex;
+#endif
+};
+
+struct dc_cond_t {
+#ifdef _WIN32
+	CONDITION_VARIABLE cv;
+#else
+	pthread_cond_t cond;
+#endif
+};
+
+struct dc_thread_t {
+#ifdef _WIN32
+	HANDLE handle;
+#else
+	pthread_t thread;
+#endif
+	void (*func) (void *userdata);
+	void *userdata;
+};
+
+dc_status_t
+dc_mutex_new (dc_mutex_t **out)
+{
+	dc_mutex_t *mutex = NULL;
+
+	if (out == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	// Allocate memory.
+	mutex = (dc_mutex_t *) malloc (sizeof (dc_mutex_t));
+	if (mutex == NULL)
+		return DC_STATUS_NOMEMORY;
+
+#ifdef _WIN32
+	InitializeCriticalSection (&mutex->cs);
+#else
+	if (pthread_mutex_init (&mutex->mutex, NULL) != 0) {
+		free (mutex);
+		return DC_STATUS_NOMEMORY;
+	}
+#endif
+
+	*out = mutex;
+
+	return DC_STATUS_SUCCESS;
+}
+
+void
+dc_mutex_free (dc_mutex_t *mutex)
+{
+	if (mutex == NULL)
+		return;
+
+#ifdef _WIN32
+	DeleteCriticalSection (&mutex->cs);
+#else
+	pthread_mutex_destroy (&mutex->mutex);
+#endif
+
+	free (mutex);
+}
+
+void
+dc_mutex_lock (dc_mutex_t *mutex)
+{
+#ifdef _WIN32
+	EnterCriticalSection (&mutex->cs);
+#else
+	pthread_mutex_lock (&mutex->mutex);
+#endif
+}
+
+void
+dc_mutex_unlock (dc_mutex_t *mutex)
+{
+#ifdef _WIN32
+	LeaveCriticalSection (&mutex->cs);
+#else
+	pthread_mutex_unlock (&mutex->mutex);
+#endif
+}
+
+dc_status_t
+dc_cond_new (dc_cond_t **out)
+{
+	dc_cond_t *cond = NULL;
+
+	if (out == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	// Allocate memory.
+	cond = (dc_cond_t *) malloc (sizeof (dc_cond_t));
+	if (cond == NULL)
+		return DC_STATUS_NOMEMORY;
+
+#ifdef _WIN32
+	InitializeConditionVariable (&cond->cv);
+#else
+	if (pthread_cond_init (&cond->cond, NULL) != 0) {
+		free (cond);
+		return DC_STATUS_NOMEMORY;
+	}
+#endif
+
+	*out = cond;
+
+	return DC_STATUS_SUCCESS;
+}
+
+void
+dc_cond_free (dc_cond_t *cond)
+{
+	if (cond == NULL)
+		return;
+
+#ifndef _WIN32
+	pthread_cond_destroy (&cond->cond);
+#endif
+
+	free (cond);
+}
+
+void
+dc_cond_wait (dc_cond_t *cond, dc_mutex_t *mutex)
+{
+#ifdef _WIN32
+	SleepConditionVariableCS (&cond->cv, &mutex->cs, INFINITE);
+#else
+	pthread_cond_wait (&cond->cond, &mutex->mutex);
+#endif
+}
+
+void
+dc_cond_broadcast (dc_cond_t *cond)
+{
+#ifdef _WIN32
+	WakeAllConditionVariable (&cond->cv);
+#else
+	pthread_cond_broadcast (&cond->cond);
+#endif
+}
+
+void
+dc_once (dc_once_t *once, void (*init) (void))
+{
+#ifdef _WIN32
+	// 0 = not started, 1 = in progress, 2 = done.
+	if (InterlockedCompareExchange (once, 1, 0) == 0) {
+		init ();
+		InterlockedExchange (once, 2);
+	} else {
+		while (InterlockedCompareExchange (once, 2, 2) != 2)
+			Sleep (0);
+	}
+#else
+	pthread_once (once, init);
+#endif
+}
+
+int
+dc_atomic_cas (volatile unsigned int *ptr, unsigned int expected, unsigned int desired)
+{
+#if defined(__GNUC__)
+	return __atomic_compare_exchange_n (ptr, &expected, desired, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+#else
+	return InterlockedCompareExchange ((volatile LONG *) ptr, desired, expected) == (LONG) expected;
+#endif
+}
+
+unsigned int
+dc_atomic_add (volatile unsigned int *ptr, unsigned int value)
+{
+#if defined(__GNUC__)
+	return __atomic_add_fetch (ptr, value, __ATOMIC_SEQ_CST);
+#else
+	return InterlockedExchangeAdd ((volatile LONG *) ptr, value) + value;
+#endif
+}
+
+#ifdef _WIN32
+static DWORD WINAPI
+dc_thread_main (LPVOID arg)
+#else
+static void *
+dc_thread_main (void *arg)
+#endif
+{
+	dc_thread_t *thread = (dc_thread_t *) arg;
+
+	thread->func (thread->userdata);
+
+	return 0;
+}
+
+dc_status_t
+dc_thread_new (dc_thread_t **out, void (*func) (void *userdata), void *userdata)
+{
+	dc_thread_t *thread = NULL;
+
+	if (out == NULL || func == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	// Allocate memory.
+	thread = (dc_thread_t *) malloc (sizeof (dc_thread_t));
+	if (thread == NULL)
+		return DC_STATUS_NOMEMORY;
+
+	thread->func = func;
+	thread->userdata = userdata;
+
+#ifdef _WIN32
+	thread->handle = CreateThread (NULL, 0, dc_thread_main, thread, 0, NULL);
+	if (thread->handle == NULL) {
+		free (thread);
+		return DC_STATUS_NOMEMORY;
+	}
+#else
+	if (pthread_create (&thread->thread, NULL, dc_thread_main, thread) != 0) {
+		free (thread);
+		return DC_STATUS_NOMEMORY;
+	}
+#endif
+
+	*out = thread;
+
+	return DC_STATUS_SUCCESS;
+}
+
+void
+dc_thread_join (dc_thread_t *thread)
+{
+	if (thread == NULL)
+		return;
+
+#ifdef _WIN32
+	WaitForSingleObject (thread->handle, INFINITE);
+	CloseHandle (thread->handle);
+#else
+	pthread_join (thread->thread, NULL);
+#endif
+
+	free (thread);
+}
+
+void
+dc_thread_sleep (unsigned int milliseconds)
+{
+#ifdef _WIN32
+	Sleep (milliseconds);
+#else
+	struct timespec ts;
+	ts.tv_sec  = (milliseconds / 1000);
+	ts.tv_nsec = (milliseconds % 1000) * 1000000;
+
+	while (nanosleep (&ts, &ts) != 0 && errno == EINTR);
+#endif
+}
+
+dc_status_t
+dc_thread_set_priority (int priority)
+{
+	if (priority <= 0)
+		return DC_STATUS_INVALIDARGS;
+
+#ifdef _WIN32
+	if (!SetThreadPriority (GetCurrentThread (), THREAD_PRIORITY_TIME_CRITICAL))
+		return DC_STATUS_NOACCESS;
+
+	return DC_STATUS_SUCCESS;
+#elif defined(HAVE_PTHREAD_SETSCHEDPARAM)
+	// Clamp the priority to the range of the real-time scheduler.
+	int minimum = sched_get_priority_min (SCHED_FIFO);
+	int maximum = sched_get_priority_max (SCHED_FIFO);
+	if (minimum < 0 || maximum < 0)
+		return DC_STATUS_UNSUPPORTED;
+	if (priority < minimum)
+		priority = minimum;
+	if (priority > maximum)
+		priority = maximum;
+
+	struct sched_param param;
+	param.sched_priority = priority;
+	int errcode = pthread_setschedparam (pthread_self (), SCHED_FIFO, &param);
+	if (errcode == EPERM)
+		return DC_STATUS_NOACCESS;
+	if (errcode != 0)
+		return DC_STATUS_UNSUPPORTED;
+
+	return DC_STATUS_SUCCESS;
+#else
+	return DC_STATUS_UNSUPPORTED;
+#endif
+}
+
+dc_status_t
+dc_thread_set_affinity (int cpu)
+{
+	if (cpu < 0)
+		return DC_STATUS_INVALIDARGS;
+
+#ifdef _WIN32
+	if (cpu >= (int) (sizeof (DWORD_PTR) * 8))
+		return DC_STATUS_INVALIDARGS;
+
+	if (SetThreadAffinityMask (GetCurrentThread (), (DWORD_PTR) 1 << cpu) == 0)
+		return DC_STATUS_INVALIDARGS;
+
+	return DC_STATUS_SUCCESS;
+#elif defined(HAVE_PTHREAD_SETAFFINITY_NP)
+	if (cpu >= CPU_SETSIZE)
+		return DC_STATUS_INVALIDARGS;
+
+	cpu_set_t set;
+	CPU_ZERO (&set);
+	CPU_SET (cpu, &set);
+	if (pthread_setaffinity_np (pthread_self (), sizeof (set), &set) != 0)
+		return DC_STATUS_INVALIDARGS;
+
+	return DC_STATUS_SUCCESS;
+#else
+	return DC_STATUS_UNSUPPORTED;
+#endif
+}
@@ -0,0 +1,247 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_THREAD_H
+#define DC_THREAD_H
+
+#include <libdivecomputer/common.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/**
+ * Opaque object representing a mutex.
+ */
+typedef struct dc_mutex_t dc_mutex_t;
+
+/**
+ * Opaque object representing a condition variable.
+ */
+typedef struct dc_cond_t dc_cond_t;
+
+/**
+ * Opaque object representing a thread.
+ */
+typedef struct dc_thread_t dc_thread_t;
+
+/**
+ * One-time initialization control.
+ *
+ * A variable of this type must have static storage duration and be
+ * initialized with #DC_ONCE_INIT.
+ */
+#ifdef _WIN32
+typedef volatile long dc_once_t;
+#define DC_ONCE_INIT 0
+#else
+typedef pthread_once_t dc_once_t;
+#define DC_ONCE_INIT PTHREAD_ONCE_INIT
+#endif
+
+/**
+ * Atomic load and store of a naturally aligned integer.
+ *
+ * Only the atomicity of the access is guaranteed, not the ordering
+ * with respect to other memory operations.
+ */
+#if defined(__GNUC__)
+#define dc_atomic_load(ptr) __atomic_load_n ((ptr), __ATOMIC_RELAXED)
+#define dc_atomic_store(ptr, value) __atomic_store_n ((ptr), (value), __ATOMIC_RELAXED)
+#else
+#define dc_atomic_load(ptr) (*(ptr))
+#define dc_atomic_store(ptr, value) (*(ptr) = (value))
+#endif
+
+/**
+ * Atomic load with acquire, and store with release ordering.
+ *
+ * Everything written before the release store by one thread, is visible
+ * to another thread after an acquire load returning the stored value.
+ */
+#if defined(__GNUC__)
+#define dc_atomic_load_acquire(ptr) __atomic_load_n ((ptr), __ATOMIC_ACQUIRE)
+#define dc_atomic_store_release(ptr, value) __atomic_store_n ((ptr), (value), __ATOMIC_RELEASE)
+#else
+#define dc_atomic_load_acquire(ptr) (*(volatile unsigned int *) (ptr))
+#define dc_atomic_store_release(ptr, value) (*(volatile unsigned int *) (ptr) = (value))
+#endif
+
+/**
+ * Atomically replace the value with the desired value, if it is equal to
+ * the expected value. Sequentially consistent.
+ *
+ * @param[in]  ptr       A naturally aligned integer.
+ * @param[in]  expected  The expected value.
+ * @param[in]  desired   The new value.
+ * @returns Non-zero if the value was replaced, zero otherwise.
+ */
+int
+dc_atomic_cas (volatile unsigned int *ptr, unsigned int expected, unsigned int desired);
+
+/**
+ * Atomically add to the value, and return the new value. The value is
+ * subtracted by adding its two's complement. Sequentially consistent.
+ *
+ * @param[in]  ptr    A naturally aligned integer.
+ * @param[in]  value  The value to add.
+ * @returns The new value.
+ */
+unsigned int
+dc_atomic_add (volatile unsigned int *ptr, unsigned int value);
+
+/**
+ * Create a new mutex.
+ *
+ * @param[out]  mutex  A location to store the mutex.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_mutex_new (dc_mutex_t **mutex);
+
+/**
+ * Destroy the mutex and free all resources.
+ *
+ * @param[in]  mutex  A valid mutex, which is not locked.
+ */
+void
+dc_mutex_free (dc_mutex_t *mutex);
+
+/**
+ * Lock the mutex.
+ *
+ * @param[in]  mutex  A valid mutex.
+ */
+void
+dc_mutex_lock (dc_mutex_t *mutex);
+
+/**
+ * Unlock the mutex.
+ *
+ * @param[in]  mutex  A valid mutex, locked by the calling thread.
+ */
+void
+dc_mutex_unlock (dc_mutex_t *mutex);
+
+/**
+ * Create a new condition variable.
+ *
+ * @param[out]  cond  A location to store the condition variable.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_cond_new (dc_cond_t **cond);
+
+/**
+ * Destroy the condition variable and free all resources.
+ *
+ * @param[in]  cond  A valid condition variable, without waiting threads.
+ */
+void
+dc_cond_free (dc_cond_t *cond);
+
+/**
+ * Unlock the mutex, wait until the condition variable is signalled, and
+ * lock the mutex again. Spurious wakeups are possible, so the caller must
+ * check its condition in a loop.
+ *
+ * @param[in]  cond   A valid condition variable.
+ * @param[in]  mutex  A valid mutex, locked by the calling thread.
+ */
+void
+dc_cond_wait (dc_cond_t *cond, dc_mutex_t *mutex);
+
+/**
+ * Wake up all threads waiting on the condition variable.
+ *
+ * @param[in]  cond  A valid condition variable.
+ */
+void
+dc_cond_broadcast (dc_cond_t *cond);
+
+/**
+ * Call the initialization function exactly once.
+ *
+ * If multiple threads call this function concurrently with the same
+ * control variable, only one of them executes the initialization
+ * function, and the others wait until it has finished.
+ *
+ * @param[in]  once  A valid control variable.
+ * @param[in]  init  The initialization function.
+ */
+void
+dc_once (dc_once_t *once, void (*init) (void));
+
+/**
+ * Create a new thread.
+ *
+ * @param[out]  thread    A location to store the thread.
+ * @param[in]   func      The function to run in the new thread.
+ * @param[in]   userdata  The argument passed to the function.
+ * @returns #DC_STATUS_SUCCESS on success, or another #dc_status_t code
+ * on failure.
+ */
+dc_status_t
+dc_thread_new (dc_thread_t **thread, void (*func) (void *userdata), void *userdata);
+
+/**
+ * Wait for the thread to finish and free all resources.
+ *
+ * @param[in]  thread  A valid thread.
+ */
+void
+dc_thread_join (dc_thread_t *thread);
+
+/**
+ * Suspend the calling thread.
+ *
+ * @param[in]  milliseconds  The time to sleep.
+ */
+void
+dc_thread_sleep (unsigned int milliseconds);
+
+/*
+ * Move the calling thread to the real-time scheduler (SCHED_FIFO) with
+ * the given priority, clamped to the supported range. On Windows, every
+ * priority selects the time critical priority. Returns DC_STATUS_NOACCESS
+ * if the process is not permitted to, and DC_STATUS_UNSUPPORTED if the
+ * system has no real-time scheduler.
+ */
+dc_status_t
+dc_thread_set_priority (int priority);
+
+/*
+ * Bind the calling thread to a single processor. Returns
+ * DC_STATUS_UNSUPPORTED if the system doesn't support it.
+ */
+dc_status_t
+dc_thread_set_affinity (int cpu);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_THREAD_H */
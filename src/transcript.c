@@ -0,0 +1,411 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#define DC_LOG_CATEGORY DC_LOGCATEGORY_TRANSPORT
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define NOGDI
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
+
+#include "transcript.h"
+#include "context-private.h"
+#include "array.h"
+
+#define TRANSCRIPT_MAGIC   0x52544344 /* DCTR */
+#define TRANSCRIPT_VERSION 1
+
+#define SZ_HEADER 8
+#define SZ_ENTRY  16
+
+struct dc_transcript_t {
+	dc_context_t *context;
+	/* Record mode. */
+	FILE *fp;
+#ifdef _WIN32
+	LARGE_INTEGER timestamp, frequency;
+#else
+	struct timeval timestamp;
+#endif
+	/* Replay mode. */
+	unsigned char *data;
+	size_t size;
+	size_t offset;
+	size_t consumed;
+};
+
+typedef struct dc_transcript_entry_t {
+	unsigned int type;
+	dc_status_t status;
+	const unsigned char *data;
+	size_t size;
+} dc_transcript_entry_t;
+
+static dc_transcript_t *
+dc_transcript_allocate (dc_context_t *context)
+{
+	dc_transcript_t *transcript = (dc_transcript_t *) malloc (sizeof (dc_transcript_t));
+	if (transcript == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return NULL;
+	}
+
+	transcript->context = context;
+	transcript->fp = NULL;
+	transcript->data = NULL;
+	transcript->size = 0;
+	transcript->offset = SZ_HEADER;
+	transcript->consumed = 0;
+
+	return transcript;
+}
+
+dc_status_t
+dc_transcript_record (dc_transcript_t **out, dc_context_t *context, const char *filename)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_transcript_t *transcript = NULL;
+	unsigned char header[SZ_HEADER] = {0};
+
+	if (out == NULL || filename == NULL) {
+		ERROR (context, "Invalid arguments.");
+		return DC_STATUS_INVALIDARGS;
+	}
+
+	transcript = dc_transcript_allocate (context);
+	if (transcript == NULL)
+		return DC_STATUS_NOMEMORY;
+
+	transcript->fp = fopen (filename, "wb");
+	if (transcript->fp == NULL) {
+		ERROR (context, "Failed to open the file.");
+		status = DC_STATUS_IO;
+		goto error_free;
+	}
+
+	array_uint32_le_set (header + 0, TRANSCRIPT_MAGIC);
+	array_uint32_le_set (header + 4, TRANSCRIPT_VERSION);
+	if (fwrite (header, 1, sizeof (header), transcript->fp) != sizeof (header)) {
+		ERROR (context, "Failed to write the header.");
+		status = DC_STATUS_IO;
+		goto error_close;
+	}
+
+#ifdef _WIN32
+	QueryPerformanceFrequency (&transcript->frequency);
+	QueryPerformanceCounter (&transcript->timestamp);
+#else
+	gettimeofday (&transcript->timestamp, NULL);
+#endif
+
+	*out = transcript;
+
+	return DC_STATUS_SUCCESS;
+
+error_close:
+	fclose (transcript->fp);
+error_free:
+	free (transcript);
+	return status;
+}
+
+dc_status_t
+dc_transcript_replay (dc_transcript_t **out, dc_context_t *context, const char *filename)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_transcript_t *transcript = NULL;
+	FILE *fp = NULL;
+
+	if (out == NULL || filename == NULL) {
+		ERROR (context, "Invalid arguments.");
+		return DC_STATUS_INVALIDARGS;
+	}
+
+	transcript = dc_transcript_allocate (context);
+	if (transcript == NULL)
+		return DC_STATUS_NOMEMORY;
+
+	fp = fopen (filename, "rb");
+	if (fp == NULL) {
+		ERROR (context, "Failed to open the file.");
+		status = DC_STATUS_IO;
+		goto error_free;
+	}
+
+	// Load the entire file into memory.
+	size_t capacity = 0;
+	while (1) {
+		if (transcript->size == capacity) {
+			size_t n = (capacity ? capacity * 2 : 4096);
+			unsigned char *data = (unsigned char *) realloc (transcript->data, n);
+			if (data == NULL) {
+				ERROR (context, "Failed to allocate memory.");
+				status = DC_STATUS_NOMEMORY;
+				goto error_close;
+			}
+			transcript->data = data;
+			capacity = n;
+		}
+
+		size_t n = fread (transcript->data + transcript->size, 1, capacity - transcript->size, fp);
+		if (n == 0) {
+			if (ferror (fp)) {
+				ERROR (context, "Failed to read the file.");
+				status = DC_STATUS_IO;
+				goto error_close;
+			}
+			break;
+		}
+
+		transcript->size += n;
+	}
+
+	fclose (fp);
+
+	if (transcript->size < SZ_HEADER ||
+		array_uint32_le (transcript->data + 0) != TRANSCRIPT_MAGIC ||
+		array_uint32_le (transcript->data + 4) != TRANSCRIPT_VERSION) {
+		ERROR (context, "Invalid transcript header.");
+		status = DC_STATUS_DATAFORMAT;
+		goto error_free;
+	}
+
+	*out = transcript;
+
+	return DC_STATUS_SUCCESS;
+
+error_close:
+	fclose (fp);
+error_free:
+	free (transcript->data);
+	free (transcript);
+	return status;
+}
+
+dc_status_t
+dc_transcript_close (dc_transcript_t *transcript)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+
+	if (transcript == NULL)
+		return DC_STATUS_SUCCESS;
+
+	if (transcript->fp && fclose (transcript->fp) != 0) {
+		ERROR (transcript->context, "Failed to close the file.");
+		status = DC_STATUS_IO;
+	}
+
+	free (transcript->data);
+	free (transcript);
+
+	return status;
+}
+
+dc_status_t
+dc_transcript_append (dc_transcript_t *transcript, dc_transcript_type_t type, dc_status_t status, const void *data, size_t size)
+{
+	unsigned char header[SZ_ENTRY] = {0};
+	unsigned long seconds = 0, microseconds = 0;
+
+	if (transcript == NULL || transcript->fp == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+#ifdef _WIN32
+	LARGE_INTEGER now, delta;
+	QueryPerformanceCounter (&now);
+	delta.QuadPart = now.QuadPart - transcript->timestamp.QuadPart;
+	delta.QuadPart *= 1000000;
+	delta.QuadPart /= transcript->frequency.QuadPart;
+	seconds = delta.QuadPart / 1000000;
+	microseconds = delta.QuadPart % 1000000;
+#else
+	struct timeval now, delta;
+	gettimeofday (&now, NULL);
+	timersub (&now, &transcript->timestamp, &delta);
+	seconds = delta.tv_sec;
+	microseconds = delta.tv_usec;
+#endif
+
+	header[0] = type;
+	header[1] = -status;
+	array_uint32_le_set (header + 4, seconds);
+	array_uint32_le_set (header + 8, microseconds);
+	array_uint32_le_set (header + 12, size);
+
+	if (fwrite (header, 1, sizeof (header), transcript->fp) != sizeof (header) ||
+		fwrite (data, 1, size, transcript->fp) != size) {
+		ERROR (transcript->context, "Failed to write the transcript entry.");
+		return DC_STATUS_IO;
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+/*
+ * Decode the entry at the current position. Returns zero at the end of the
+ * transcript, or if the last entry is truncated.
+ */
+static int
+dc_transcript_entry (dc_transcript_t *transcript, dc_transcript_entry_t *entry)
+{
+	if (transcript->offset + SZ_ENTRY > transcript->size)
+		return 0;
+
+	const unsigned char *p = transcript->data + transcript->offset;
+	size_t size = array_uint32_le (p + 12);
+	if (size > transcript->size - transcript->offset - SZ_ENTRY) {
+		WARNING (transcript->context, "Truncated transcript entry.");
+		return 0;
+	}
+
+	entry->type = p[0];
+	entry->status = -(int) p[1];
+	entry->data = p + SZ_ENTRY;
+	entry->size = size;
+
+	return 1;
+}
+
+static void
+dc_transcript_next (dc_transcript_t *transcript, const dc_transcript_entry_t *entry)
+{
+	transcript->offset += SZ_ENTRY + entry->size;
+	transcript->consumed = 0;
+}
+
+dc_status_t
+dc_transcript_read (dc_transcript_t *transcript, void *data, size_t size, size_t *actual)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	dc_transcript_entry_t entry;
+	size_t nbytes = 0;
+
+	if (transcript == NULL || transcript->data == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	while (nbytes < size && dc_transcript_entry (transcript, &entry)) {
+		// The device doesn't send any data before the next write.
+		if (entry.type != DC_TRANSCRIPT_READ)
+			break;
+
+		size_t available = entry.size - transcript->consumed;
+		size_t n = (available < size - nbytes ? available : size - nbytes);
+		memcpy ((unsigned char *) data + nbytes, entry.data + transcript->consumed, n);
+		transcript->consumed += n;
+		nbytes += n;
+
+		if (transcript->consumed == entry.size) {
+			dc_transcript_next (transcript, &entry);
+
+			// End of a read operation that failed in the original session.
+			if (entry.status != DC_STATUS_SUCCESS && nbytes < size) {
+				status = entry.status;
+				break;
+			}
+		}
+	}
+
+	if (nbytes != size && status == DC_STATUS_SUCCESS) {
+		status = DC_STATUS_TIMEOUT;
+	}
+
+	if (actual)
+		*actual = nbytes;
+
+	return status;
+}
+
+dc_status_t
+dc_transcript_write (dc_transcript_t *transcript, const void *data, size_t size, size_t *actual)
+{
+	dc_transcript_entry_t entry;
+	size_t nbytes = 0;
+	unsigned int skipped = 0, mismatch = 0;
+
+	if (transcript == NULL || transcript->data == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	// Discard the data that was never read.
+	while (dc_transcript_entry (transcript, &entry) && entry.type == DC_TRANSCRIPT_READ) {
+		skipped += entry.size - transcript->consumed;
+		dc_transcript_next (transcript, &entry);
+	}
+
+	if (skipped) {
+		WARNING (transcript->context, "Replay: %u bytes of unread data discarded.", skipped);
+	}
+
+	while (nbytes < size && dc_transcript_entry (transcript, &entry)) {
+		if (entry.type != DC_TRANSCRIPT_WRITE)
+			break;
+
+		size_t available = entry.size - transcript->consumed;
+		size_t n = (available < size - nbytes ? available : size - nbytes);
+		if (memcmp ((const unsigned char *) data + nbytes, entry.data + transcript->consumed, n) != 0)
+			mismatch = 1;
+		transcript->consumed += n;
+		nbytes += n;
+
+		if (transcript->consumed == entry.size) {
+			dc_transcript_next (transcript, &entry);
+		}
+	}
+
+	if (mismatch || nbytes != size) {
+		WARNING (transcript->context, "Replay: the written data does not match the transcript.");
+	}
+
+	if (actual)
+		*actual = size;
+
+	return DC_STATUS_SUCCESS;
+}
+
+size_t
+dc_transcript_available (dc_transcript_t *transcript)
+{
+	size_t available = 0;
+
+	if (transcript == NULL || transcript->data == NULL)
+		return 0;
+
+	size_t offset = transcript->offset;
+	size_t consumed = transcript->consumed;
+
+	dc_transcript_entry_t entry;
+	while (dc_transcript_entry (transcript, &entry) && entry.type == DC_TRANSCRIPT_READ) {
+		available += entry.size - transcript->consumed;
+		dc_transcript_next (transcript, &entry);
+		if (entry.status != DC_STATUS_SUCCESS)
+			break;
+	}
+
+	transcript->offset = offset;
+	transcript->consumed = consumed;
+
+	return available;
+}
@@ -0,0 +1,79 @@
+/*
+ * libdivecomputer
+ *
+ * Copyright (C) 2016 Jef Driesen
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA 02110-1301 USA
+ */
+
+#ifndef DC_TRANSCRIPT_H
+#define DC_TRANSCRIPT_H
+
+#include <libdivecomputer/common.h>
+#include <libdivecomputer/context.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * A transcript is a file with a timestamped copy of all the data
+ * transferred over a serial connection. It is either created while
+ * talking to a real device (record mode), or used as the data source for
+ * a virtual connection (replay mode).
+ *
+ * The file starts with a 8 byte header (the "DCTR" magic and a 32 bit
+ * version number), followed by one entry per read or write operation:
+ *
+ *   type (1 byte), status (1 byte), reserved (2 bytes),
+ *   seconds (4 bytes), microseconds (4 bytes), size (4 bytes), data
+ *
+ * All values are stored in little endian byte order, and the timestamps
+ * are relative to the creation of the transcript.
+ */
+
+typedef struct dc_transcript_t dc_transcript_t;
+
+typedef enum dc_transcript_type_t {
+	DC_TRANSCRIPT_READ = 'R',
+	DC_TRANSCRIPT_WRITE = 'W'
+} dc_transcript_type_t;
+
+dc_status_t
+dc_transcript_record (dc_transcript_t **transcript, dc_context_t *context, const char *filename);
+
+dc_status_t
+dc_transcript_replay (dc_transcript_t **transcript, dc_context_t *context, const char *filename);
+
+dc_status_t
+dc_transcript_close (dc_transcript_t *transcript);
+
+dc_status_t
+dc_transcript_append (dc_transcript_t *transcript, dc_transcript_type_t type, dc_status_t status, const void *data, size_t size);
+
+dc_status_t
+dc_transcript_read (dc_transcript_t *transcript, void *data, size_t size, size_t *actual);
+
+dc_status_t
+dc_transcript_write (dc_transcript_t *transcript, const void *data, size_t size, size_t *actual);
+
+size_t
+dc_transcript_available (dc_transcript_t *transcript);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* DC_TRANSCRIPT_H */
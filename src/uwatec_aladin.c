@@ -28,7 +28,6 @@
 #include "device-private.h"
 #include "serial.h"
 #include "ringbuffer.h"
-#include "checksum.h"
 #include "array.h"
 
 #define ISINSTANCE(device) dc_device_isinstance((device), &uwatec_aladin_device_vtable)
@@ -96,6 +95,10 @@ uwatec_aladin_device_open (dc_device_t **out, dc_context_t *context, const char
 		goto error_free;
 	}
 
+	// Interrupt the blocking reads when the download is cancelled, and
+	// measure the time spent waiting for the I/O.
+	device_set_port ((dc_device_t *) device, device->port);
+
 	// Set the serial communication protocol (19200 8N1).
 	status = dc_serial_configure (device->port, 19200, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -226,12 +229,14 @@ uwatec_aladin_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 	progress.current += sizeof (answer) - 4;
 	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 
-	// Reverse the bit order.
-	array_reverse_bits (answer, sizeof (answer));
+	// Reverse the bit order, and calculate the checksum of the data in
+	// the same pass.
+	unsigned short ccrc = 0x0000;
+	array_reverse_bits_sum (answer, SZ_MEMORY, &ccrc);
+	array_reverse_bits (answer + SZ_MEMORY, sizeof (answer) - SZ_MEMORY);
 
 	// Verify the checksum of the package.
 	unsigned short crc = array_uint16_le (answer + SZ_MEMORY);
-	unsigned short ccrc = checksum_add_uint16 (answer, SZ_MEMORY, 0x0000);
 	if (ccrc != crc) {
 		ERROR (abstract->context, "Unexpected answer checksum.");
 		return DC_STATUS_PROTOCOL;
@@ -260,6 +265,8 @@ uwatec_aladin_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback
 	if (buffer == NULL)
 		return DC_STATUS_NOMEMORY;
 
+	device_phase (abstract, DC_PHASE_PROFILE);
+
 	dc_status_t rc = uwatec_aladin_device_dump (abstract, buffer);
 	if (rc != DC_STATUS_SUCCESS) {
 		dc_buffer_free (buffer);
@@ -364,14 +371,8 @@ uwatec_aladin_extract_dives (dc_device_t *abstract, const unsigned char* data, u
 				buffer[16] = (len     ) & 0xFF;
 				buffer[17] = (len >> 8) & 0xFF;
 				// Copy the profile data.
-				if (begin + len > RB_PROFILE_END) {
-					unsigned int a = RB_PROFILE_END - begin;
-					unsigned int b = (begin + len) - RB_PROFILE_END;
-					memcpy (buffer + 18 + 0, data + HEADER + begin, a);
-					memcpy (buffer + 18 + a, data + HEADER,         b);
-				} else {
-					memcpy (buffer + 18, data + HEADER + begin, len);
-				}
+				ringbuffer_copy (buffer + 18, data + HEADER, begin, len,
+					RB_PROFILE_BEGIN, RB_PROFILE_END);
 			}
 
 			// Since the size of the profile ringbuffer is limited,
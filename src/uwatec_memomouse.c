@@ -92,6 +92,10 @@ uwatec_memomouse_device_open (dc_device_t **out, dc_context_t *context, const ch
 		goto error_free;
 	}
 
+	// Interrupt the blocking reads when the download is cancelled, and
+	// measure the time spent waiting for the I/O.
+	device_set_port ((dc_device_t *) device, device->port);
+
 	// Set the serial communication protocol (9600 8N1).
 	status = dc_serial_configure (device->port, 9600, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -253,7 +257,11 @@ uwatec_memomouse_read_packet_inner (uwatec_memomouse_device_t *device, dc_buffer
 	dc_status_t status = DC_STATUS_SUCCESS;
 	dc_device_t *abstract = (dc_device_t *) device;
 
-	// Erase the current contents of the buffer.
+	// The outer packets are received directly into the buffer. Each packet
+	// starts with a length byte, which overlaps with the last data byte of
+	// the previous packet. That byte is saved and restored afterwards. The
+	// first byte of the buffer is a placeholder for the length byte of the
+	// first packet.
 	if (!dc_buffer_clear (buffer)) {
 		ERROR (abstract->context, "Insufficient buffer space available.");
 		return DC_STATUS_NOMEMORY;
@@ -267,8 +275,14 @@ uwatec_memomouse_read_packet_inner (uwatec_memomouse_device_t *device, dc_buffer
 		if (length > PACKETSIZE)
 			length = PACKETSIZE;
 
+		if (!dc_buffer_resize (buffer, 1 + nbytes + length + 2)) {
+			ERROR (abstract->context, "Insufficient buffer space available.");
+			return DC_STATUS_NOMEMORY;
+		}
+
 		// Read the packet.
-		unsigned char packet[PACKETSIZE + 2] = {0};
+		unsigned char *packet = dc_buffer_get_data (buffer) + nbytes;
+		unsigned char saved = packet[0];
 		dc_status_t rc = uwatec_memomouse_read_packet_outer (device, packet, length + 2, &length);
 		if (rc != DC_STATUS_SUCCESS)
 			return rc;
@@ -293,10 +307,12 @@ uwatec_memomouse_read_packet_inner (uwatec_memomouse_device_t *device, dc_buffer
 			total = array_uint16_le (packet + 1) + 3;
 
 			// Pre-allocate the required amount of memory.
-			if (!dc_buffer_reserve (buffer, total)) {
+			if (!dc_buffer_reserve (buffer, 1 + total + 2)) {
 				ERROR (abstract->context, "Insufficient buffer space available.");
 				return DC_STATUS_NOMEMORY;
 			}
+		} else {
+			packet[0] = saved;
 		}
 
 		// Update and emit a progress event.
@@ -306,14 +322,11 @@ uwatec_memomouse_read_packet_inner (uwatec_memomouse_device_t *device, dc_buffer
 			device_event_emit (&device->base, DC_EVENT_PROGRESS, progress);
 		}
 
-		// Append the packet to the buffer.
-		dc_buffer_append (buffer, packet + 1, length);
-
 		nbytes += length;
 	}
 
 	// Obtain the pointer to the buffer contents.
-	unsigned char *data = dc_buffer_get_data (buffer);
+	unsigned char *data = dc_buffer_get_data (buffer) + 1;
 
 	// Verify the checksum.
 	unsigned char crc = data[total - 1];
@@ -323,8 +336,8 @@ uwatec_memomouse_read_packet_inner (uwatec_memomouse_device_t *device, dc_buffer
 		return DC_STATUS_PROTOCOL;
 	}
 
-	// Discard the header and checksum bytes.
-	dc_buffer_slice (buffer, 2, total - 3);
+	// Discard the placeholder, header and checksum bytes.
+	dc_buffer_slice (buffer, 3, total - 3);
 
 	return DC_STATUS_SUCCESS;
 }
@@ -335,14 +348,13 @@ uwatec_memomouse_dump_internal (uwatec_memomouse_device_t *device, dc_buffer_t *
 {
 	dc_status_t status = DC_STATUS_SUCCESS;
 	dc_device_t *abstract = (dc_device_t *) device;
-	size_t available = 0;
 
 	// Enable progress notifications.
 	dc_event_progress_t progress = EVENT_PROGRESS_INITIALIZER;
 	device_event_emit (&device->base, DC_EVENT_PROGRESS, &progress);
 
 	// Waiting for greeting message.
-	while (dc_serial_get_available (device->port, &available) == DC_STATUS_SUCCESS && available == 0) {
+	while (dc_serial_poll (device->port, 0) == DC_STATUS_TIMEOUT) {
 		if (device_is_cancelled (abstract))
 			return DC_STATUS_CANCELLED;
 
@@ -357,7 +369,8 @@ uwatec_memomouse_dump_internal (uwatec_memomouse_device_t *device, dc_buffer_t *
 			return status;
 		}
 
-		dc_serial_sleep (device->port, 300);
+		// Wait for the next packet.
+		dc_serial_poll (device->port, 300);
 	}
 
 	// Read the ID string.
@@ -411,12 +424,11 @@ uwatec_memomouse_dump_internal (uwatec_memomouse_device_t *device, dc_buffer_t *
 	}
 
 	// Wait for the data packet.
-	while (dc_serial_get_available (device->port, &available) == DC_STATUS_SUCCESS && available == 0) {
+	while (dc_serial_poll (device->port, 100) == DC_STATUS_TIMEOUT) {
 		if (device_is_cancelled (abstract))
 			return DC_STATUS_CANCELLED;
 
 		device_event_emit (&device->base, DC_EVENT_WAITING, NULL);
-		dc_serial_sleep (device->port, 100);
 	}
 
 	// Fetch the current system time.
@@ -486,6 +498,8 @@ uwatec_memomouse_device_foreach (dc_device_t *abstract, dc_dive_callback_t callb
 	if (buffer == NULL)
 		return DC_STATUS_NOMEMORY;
 
+	device_phase (abstract, DC_PHASE_PROFILE);
+
 	dc_status_t rc = uwatec_memomouse_device_dump (abstract, buffer);
 	if (rc != DC_STATUS_SUCCESS) {
 		dc_buffer_free (buffer);
@@ -548,28 +562,35 @@ uwatec_memomouse_extract_dives (dc_device_t *abstract, const unsigned char data[
 		ndives++;
 	}
 
-	// Parse the data stream again to return each dive in reverse order
-	// (newest dive first). This is less efficient, since the data stream
-	// needs to be scanned multiple times, but it makes the behaviour
-	// consistent with the equivalent function for the Uwatec Aladin.
+	if (ndives == 0)
+		return DC_STATUS_SUCCESS;
+
+	// Remember the offset of each dive, to return them in reverse order
+	// (newest dive first), consistent with the equivalent function for
+	// the Uwatec Aladin, without scanning the data stream again for
+	// every dive.
+	unsigned int *offsets = (unsigned int *) malloc (ndives * sizeof (unsigned int));
+	if (offsets == NULL) {
+		if (abstract)
+			ERROR (abstract->context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	unsigned int offset = 5;
 	for (unsigned int i = 0; i < ndives; ++i) {
-		// Skip the older dives.
-		unsigned int offset = 5;
-		unsigned int skip = ndives - i - 1;
-		while (skip) {
-			// Get the length of the profile data.
-			unsigned int len = array_uint16_le (data + offset + 16);
-			// Move to the next dive.
-			offset += len + 18;
-			skip--;
-		}
+		offsets[i] = offset;
+		offset += array_uint16_le (data + offset + 16) + 18;
+	}
 
+	for (unsigned int i = ndives; i > 0; --i) {
 		// Get the length of the profile data.
-		unsigned int length = array_uint16_le (data + offset + 16);
+		unsigned int length = array_uint16_le (data + offsets[i - 1] + 16);
 
-		if (callback && !callback (data + offset, length + 18, data + offset + 11, 4, userdata))
-			return DC_STATUS_SUCCESS;
+		if (callback && !callback (data + offsets[i - 1], length + 18, data + offsets[i - 1] + 11, 4, userdata))
+			break;
 	}
 
+	free (offsets);
+
 	return DC_STATUS_SUCCESS;
 }
@@ -19,7 +19,11 @@
  * MA 02110-1301 USA
  */
 
+#define DC_LOG_CATEGORY DC_LOGCATEGORY_PARSER
+
 #include <stdlib.h>
+#include <limits.h>
+#include <math.h>
 
 #include <libdivecomputer/uwatec_memomouse.h>
 #include <libdivecomputer/units.h>
@@ -30,6 +34,17 @@
 
 #define ISINSTANCE(parser) dc_parser_isinstance((parser), &uwatec_memomouse_parser_vtable)
 
+#define INTERVAL 20
+
+static const unsigned int warnings_events[] = {
+	SAMPLE_EVENT_DECOSTOP,    // Deco stop
+	SAMPLE_EVENT_RBT,         // Remaining bottom time too short (Air series only)
+	SAMPLE_EVENT_ASCENT,      // Ascent too fast
+	SAMPLE_EVENT_CEILING,     // Ceiling violation of deco stop
+	SAMPLE_EVENT_WORKLOAD,    // Work too hard (Air series only)
+	SAMPLE_EVENT_TRANSMITTER, // Transmit error of air pressure (always 1 unless Air series)
+};
+
 typedef struct uwatec_memomouse_parser_t uwatec_memomouse_parser_t;
 
 struct uwatec_memomouse_parser_t {
@@ -38,10 +53,20 @@ struct uwatec_memomouse_parser_t {
 	dc_ticks_t systime;
 };
 
+typedef struct uwatec_memomouse_layout_t {
+	unsigned int is_oxygen;
+	unsigned int offset;
+	unsigned int extra;
+	unsigned int nsamples;
+} uwatec_memomouse_layout_t;
+
 static dc_status_t uwatec_memomouse_parser_set_data (dc_parser_t *abstract, const unsigned char *data, unsigned int size);
 static dc_status_t uwatec_memomouse_parser_get_datetime (dc_parser_t *abstract, dc_datetime_t *datetime);
 static dc_status_t uwatec_memomouse_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsigned int flags, void *value);
 static dc_status_t uwatec_memomouse_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata);
+static dc_status_t uwatec_memomouse_parser_samples_extract (dc_parser_t *abstract, dc_sample_columns_t *columns);
+static dc_status_t uwatec_memomouse_parser_samples_range (dc_parser_t *abstract, unsigned int first, unsigned int count, dc_sample_callback_t callback, void *userdata);
+static dc_status_t uwatec_memomouse_parser_samples_seek (dc_parser_t *abstract, unsigned int time, unsigned int *index);
 
 static const dc_parser_vtable_t uwatec_memomouse_parser_vtable = {
 	sizeof(uwatec_memomouse_parser_t),
@@ -50,6 +75,14 @@ static const dc_parser_vtable_t uwatec_memomouse_parser_vtable = {
 	uwatec_memomouse_parser_get_datetime, /* datetime */
 	uwatec_memomouse_parser_get_field, /* fields */
 	uwatec_memomouse_parser_samples_foreach, /* samples_foreach */
+	uwatec_memomouse_parser_samples_extract, /* samples_extract */
+	uwatec_memomouse_parser_samples_range, /* samples_range */
+	uwatec_memomouse_parser_samples_seek, /* samples_seek */
+	NULL, /* samples_index */
+	NULL, /* samples_split */
+	NULL, /* samples_chunk */
+	NULL, /* subdives */
+	NULL, /* samples_vendor */
 	NULL /* destroy */
 };
 
@@ -190,7 +223,7 @@ uwatec_memomouse_parser_get_field (dc_parser_t *abstract, dc_field_type_t type,
 
 
 static dc_status_t
-uwatec_memomouse_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata)
+uwatec_memomouse_parser_layout (dc_parser_t *abstract, uwatec_memomouse_layout_t *layout)
 {
 	const unsigned char *data = abstract->data;
 	unsigned int size = abstract->size;
@@ -200,13 +233,11 @@ uwatec_memomouse_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callba
 
 	unsigned int model = data[3];
 
-	int is_nitrox = 0, is_oxygen = 0, is_air = 0;
+	int is_nitrox = 0, is_oxygen = 0;
 	if ((model & 0xF0) == 0xF0)
 		is_nitrox = 1;
 	if ((model & 0xF0) == 0xA0)
 		is_oxygen = 1;
-	if ((model & 0xF0) % 4 == 0)
-		is_air = 1;
 
 	unsigned int header = 22;
 	if (is_nitrox)
@@ -214,10 +245,50 @@ uwatec_memomouse_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callba
 	if (is_oxygen)
 		header += 3;
 
-	unsigned int time = 20;
-
+	// Every sample has two bytes, and every third sample (once per
+	// minute) has the extra decompression and oxygen bytes. A sample
+	// with missing extra bytes is still counted, and reported as an
+	// error.
+	unsigned int extra = is_oxygen ? 2 : 1;
 	unsigned int offset = header + 18;
-	while (offset + 2 <= size) {
+	unsigned int nsamples = 0;
+	if (offset < size) {
+		unsigned int groups = (size - offset) / (6 + extra);
+		unsigned int remainder = (size - offset) % (6 + extra);
+		nsamples = groups * 3 + (remainder / 2 < 3 ? remainder / 2 : 3);
+	}
+
+	layout->is_oxygen = is_oxygen;
+	layout->offset = offset;
+	layout->extra = extra;
+	layout->nsamples = nsamples;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+static dc_status_t
+uwatec_memomouse_parser_samples_range (dc_parser_t *abstract, unsigned int first, unsigned int count, dc_sample_callback_t callback, void *userdata)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+
+	const unsigned char *data = abstract->data;
+	unsigned int size = abstract->size;
+
+	uwatec_memomouse_layout_t layout;
+	rc = uwatec_memomouse_parser_layout (abstract, &layout);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	unsigned int nsamples = layout.nsamples;
+	if (first > nsamples)
+		first = nsamples;
+	unsigned int last = nsamples;
+	if (count < last - first)
+		last = first + count;
+
+	unsigned int offset = layout.offset + first * 2 + (first / 3) * layout.extra;
+	for (unsigned int i = first; i < last; ++i) {
 		dc_sample_value_t sample = {0};
 
 		unsigned int value = array_uint16_be (data + offset);
@@ -226,7 +297,7 @@ uwatec_memomouse_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callba
 		offset += 2;
 
 		// Time (seconds)
-		sample.time = time;
+		sample.time = (i + 1) * INTERVAL;
 		if (callback) callback (DC_SAMPLE_TIME, sample, userdata);
 
 		// Depth (meters)
@@ -263,7 +334,7 @@ uwatec_memomouse_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callba
 			}
 		}
 
-		if (time % 60 == 0) {
+		if ((i % 3) == 2) {
 			sample.vendor.type = SAMPLE_VENDOR_UWATEC_ALADIN;
 			sample.vendor.size = 0;
 			sample.vendor.data = data + offset;
@@ -275,7 +346,7 @@ uwatec_memomouse_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callba
 			offset++;
 
 			// Oxygen percentage (O2 series only).
-			if (is_oxygen) {
+			if (layout.is_oxygen) {
 				if (offset + 1 > size)
 					return DC_STATUS_DATAFORMAT;
 				sample.vendor.size++;
@@ -284,9 +355,87 @@ uwatec_memomouse_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callba
 
 			if (callback) callback (DC_SAMPLE_VENDOR, sample, userdata);
 		}
+	}
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+static dc_status_t
+uwatec_memomouse_parser_samples_extract (dc_parser_t *abstract, dc_sample_columns_t *columns)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+
+	const unsigned char *data = abstract->data;
+	unsigned int size = abstract->size;
+
+	uwatec_memomouse_layout_t layout;
+	rc = uwatec_memomouse_parser_layout (abstract, &layout);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	// Only the extra bytes of the last group can be missing.
+	unsigned int nsamples = layout.nsamples;
+	if (nsamples && nsamples % 3 == 0 &&
+		layout.offset + nsamples * 2 + (nsamples / 3) * layout.extra > size)
+		return DC_STATUS_DATAFORMAT;
+
+	unsigned int n = sample_columns_interval (columns, nsamples, INTERVAL);
+
+	// The depth is stored as an absolute value in every sample, and not
+	// as a difference with the previous sample.
+	if (columns->depth) {
+		double *depth = columns->depth;
+		for (unsigned int i = 0; i < n; ++i) {
+			unsigned int offset = layout.offset + i * 2 + (i / 3) * layout.extra;
+			depth[i] = (data[offset] << 2 | data[offset + 1] >> 6) * 10.0 / 64.0;
+		}
+	}
 
-		time += 20;
+	if (columns->temperature) {
+		double *temperature = columns->temperature;
+		for (unsigned int i = 0; i < n; ++i)
+			temperature[i] = NAN;
+	}
+
+	// The warnings are checked for all samples, to report the same
+	// number of events as the sample callback.
+	for (unsigned int i = 0; i < nsamples; ++i) {
+		unsigned int offset = layout.offset + i * 2 + (i / 3) * layout.extra;
+		unsigned int warnings = data[offset + 1] & 0x3F;
+		for (unsigned int j = 0; warnings; ++j, warnings >>= 1) {
+			if (warnings & 0x01)
+				sample_columns_event_at (columns, i, warnings_events[j], 0, NULL, 0, 0);
+		}
 	}
 
 	return DC_STATUS_SUCCESS;
 }
+
+
+static dc_status_t
+uwatec_memomouse_parser_samples_seek (dc_parser_t *abstract, unsigned int time, unsigned int *index)
+{
+	dc_status_t rc = DC_STATUS_SUCCESS;
+
+	uwatec_memomouse_layout_t layout;
+	rc = uwatec_memomouse_parser_layout (abstract, &layout);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	// The first sample is recorded after one interval.
+	unsigned int i = time ? (time - 1) / INTERVAL : 0;
+	if (i > layout.nsamples)
+		i = layout.nsamples;
+
+	*index = i;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+static dc_status_t
+uwatec_memomouse_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata)
+{
+	return uwatec_memomouse_parser_samples_range (abstract, 0, UINT_MAX, callback, userdata);
+}
@@ -209,6 +209,10 @@ uwatec_meridian_device_open (dc_device_t **out, dc_context_t *context, const cha
 		goto error_free;
 	}
 
+	// Interrupt the blocking reads when the download is cancelled, and
+	// measure the time spent waiting for the I/O.
+	device_set_port ((dc_device_t *) device, device->port);
+
 	// Set the serial communication protocol (57600 8N1).
 	status = dc_serial_configure (device->port, 57600, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -387,8 +391,14 @@ uwatec_meridian_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 		return DC_STATUS_PROTOCOL;
 	}
 
+	// The device only sends the dives that are newer than the timestamp of
+	// the fingerprint, so the transfer already ends at the last new dive.
+	// The dives are stored oldest first, and can only be returned (newest
+	// first) once everything has been received.
 	unsigned int nbytes = 0;
 	while (nbytes < length) {
+		if (device_is_cancelled (abstract))
+			return DC_STATUS_CANCELLED;
 
 		// Read the header.
 		unsigned char header[5];
@@ -448,6 +458,8 @@ uwatec_meridian_device_foreach (dc_device_t *abstract, dc_dive_callback_t callba
 	if (buffer == NULL)
 		return DC_STATUS_NOMEMORY;
 
+	device_phase (abstract, DC_PHASE_PROFILE);
+
 	dc_status_t rc = uwatec_meridian_device_dump (abstract, buffer);
 	if (rc != DC_STATUS_SUCCESS) {
 		dc_buffer_free (buffer);
@@ -27,10 +27,16 @@
 #include "context-private.h"
 #include "device-private.h"
 #include "irda.h"
+#include "thread.h"
 #include "array.h"
 
 #define ISINSTANCE(device) dc_device_isinstance((device), &uwatec_smart_device_vtable)
 
+#define SZ_MINPACKET 32
+#define SZ_MAXPACKET 1024
+
+#define SZ_HEADER 12
+
 typedef struct uwatec_smart_device_t {
 	dc_device_t base;
 	dc_irda_t *socket;
@@ -45,6 +51,8 @@ static dc_status_t uwatec_smart_device_dump (dc_device_t *abstract, dc_buffer_t
 static dc_status_t uwatec_smart_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void *userdata);
 static dc_status_t uwatec_smart_device_close (dc_device_t *abstract);
 
+static const unsigned char uwatec_smart_header[4] = {0xa5, 0xa5, 0x5a, 0x5a};
+
 static const dc_device_vtable_t uwatec_smart_device_vtable = {
 	sizeof(uwatec_smart_device_t),
 	DC_FAMILY_UWATEC_SMART,
@@ -57,11 +65,23 @@ static const dc_device_vtable_t uwatec_smart_device_vtable = {
 };
 
 
+struct uwatec_smart_discover_t {
+	dc_context_t *context;
+	dc_thread_t *thread;
+	dc_status_t status;
+};
+
+/*
+ * The address of the last device that was found is kept for the lifetime
+ * of the process, to skip the slow discovery on the next download.
+ */
+static unsigned int g_address = 0;
+
 static void
 uwatec_smart_discovery (unsigned int address, const char *name, unsigned int charset, unsigned int hints, void *userdata)
 {
-	uwatec_smart_device_t *device = (uwatec_smart_device_t*) userdata;
-	if (device == NULL)
+	unsigned int *result = (unsigned int *) userdata;
+	if (result == NULL)
 		return;
 
 	if (strncmp (name, "UWATEC Galileo Sol", 18) == 0 ||
@@ -75,8 +95,99 @@ uwatec_smart_discovery (unsigned int address, const char *name, unsigned int cha
 		strstr (name, "Galileo") != NULL ||
 		strstr (name, "GALILEO") != NULL)
 	{
-		device->address = address;
+		*result = address;
+	}
+}
+
+
+static dc_status_t
+uwatec_smart_discover_address (dc_context_t *context, dc_irda_t *socket, unsigned int *address)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	unsigned int result = 0;
+
+	status = dc_irda_discover (socket, uwatec_smart_discovery, &result);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (context, "Failed to discover the device.");
+		return status;
+	}
+
+	if (result == 0) {
+		ERROR (context, "No dive computer found.");
+		return DC_STATUS_IO;
+	}
+
+	dc_atomic_store (&g_address, result);
+
+	*address = result;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+static void
+uwatec_smart_discover_run (void *userdata)
+{
+	uwatec_smart_discover_t *discover = (uwatec_smart_discover_t *) userdata;
+	dc_irda_t *socket = NULL;
+	unsigned int address = 0;
+
+	discover->status = dc_irda_open (&socket, discover->context);
+	if (discover->status != DC_STATUS_SUCCESS) {
+		ERROR (discover->context, "Failed to open the irda socket.");
+		return;
+	}
+
+	discover->status = uwatec_smart_discover_address (discover->context, socket, &address);
+
+	dc_irda_close (socket);
+}
+
+
+dc_status_t
+uwatec_smart_discover_start (uwatec_smart_discover_t **out, dc_context_t *context)
+{
+	dc_status_t status = DC_STATUS_SUCCESS;
+	uwatec_smart_discover_t *discover = NULL;
+
+	if (out == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	discover = (uwatec_smart_discover_t *) malloc (sizeof (uwatec_smart_discover_t));
+	if (discover == NULL) {
+		ERROR (context, "Failed to allocate memory.");
+		return DC_STATUS_NOMEMORY;
+	}
+
+	discover->context = context;
+	discover->status = DC_STATUS_SUCCESS;
+
+	status = dc_thread_new (&discover->thread, uwatec_smart_discover_run, discover);
+	if (status != DC_STATUS_SUCCESS) {
+		ERROR (context, "Failed to create the thread.");
+		free (discover);
+		return status;
 	}
+
+	*out = discover;
+
+	return DC_STATUS_SUCCESS;
+}
+
+
+dc_status_t
+uwatec_smart_discover_finish (uwatec_smart_discover_t *discover)
+{
+	if (discover == NULL)
+		return DC_STATUS_INVALIDARGS;
+
+	dc_thread_join (discover->thread);
+
+	dc_status_t status = discover->status;
+
+	free (discover);
+
+	return status;
 }
 
 
@@ -102,6 +213,80 @@ uwatec_smart_transfer (uwatec_smart_device_t *device, const unsigned char comman
 }
 
 
+static dc_status_t
+uwatec_smart_receive (uwatec_smart_device_t *device, dc_event_progress_t *progress, unsigned char data[], unsigned int size, dc_buffer_t *index)
+{
+	dc_device_t *abstract = (dc_device_t *) device;
+	dc_status_t rc = DC_STATUS_SUCCESS;
+
+	// The dives are stored back to back, and each dive header contains
+	// the length of the dive. The start of each dive is recorded in the
+	// index while the data is being received. If the data does not match
+	// that layout, the index is discarded.
+	unsigned int next = 0;
+	if (index && !dc_buffer_clear (index))
+		return DC_STATUS_NOMEMORY;
+
+	unsigned int nbytes = 0;
+	while (nbytes < size) {
+		if (device_is_cancelled (abstract))
+			return DC_STATUS_CANCELLED;
+
+		// Set the minimum packet size.
+		unsigned int len = SZ_MINPACKET;
+
+		// Increase the packet size if more data is immediately available,
+		// but never beyond the maximum, to keep the progress events at a
+		// regular interval.
+		size_t available = 0;
+		rc = dc_irda_get_available (device->socket, &available);
+		if (rc == DC_STATUS_SUCCESS && available > len)
+			len = available > SZ_MAXPACKET ? SZ_MAXPACKET : available;
+
+		// Limit the packet size to the total size.
+		if (nbytes + len > size)
+			len = size - nbytes;
+
+		rc = dc_irda_read (device->socket, data + nbytes, len, NULL);
+		if (rc != DC_STATUS_SUCCESS) {
+			ERROR (abstract->context, "Failed to receive the answer.");
+			return rc;
+		}
+
+		// Update and emit a progress event.
+		progress->current += len;
+		device_event_emit (abstract, DC_EVENT_PROGRESS, progress);
+
+		nbytes += len;
+
+		// Locate the dives with a complete header.
+		while (index && next + 8 <= nbytes) {
+			unsigned int length = array_uint32_le (data + next + 4);
+			if (memcmp (data + next, uwatec_smart_header, sizeof (uwatec_smart_header)) != 0 ||
+				length < SZ_HEADER || length > size - next)
+			{
+				WARNING (abstract->context, "Unexpected dive header at offset %u.", next);
+				dc_buffer_clear (index);
+				index = NULL;
+				break;
+			}
+
+			unsigned char offset[4] = {0};
+			array_uint32_le_set (offset, next);
+			if (!dc_buffer_append (index, offset, sizeof (offset)))
+				return DC_STATUS_NOMEMORY;
+
+			next += length;
+		}
+	}
+
+	if (index && next != size)
+		dc_buffer_clear (index);
+
+	return DC_STATUS_SUCCESS;
+}
+
+
 static dc_status_t
 uwatec_smart_handshake (uwatec_smart_device_t *device)
 {
@@ -169,24 +354,40 @@ uwatec_smart_device_open (dc_device_t **out, dc_context_t *context)
 		goto error_free;
 	}
 
-	// Discover the device.
-	status = dc_irda_discover (device->socket, uwatec_smart_discovery, device);
-	if (status != DC_STATUS_SUCCESS) {
-		ERROR (context, "Failed to discover the device.");
-		goto error_close;
+	// Connect to the cached address directly. A device that is no longer
+	// reachable at that address is discovered again.
+	unsigned int address = dc_atomic_load (&g_address);
+	if (address != 0) {
+		status = dc_irda_connect_lsap (device->socket, address, 1);
+		if (status == DC_STATUS_SUCCESS) {
+			device->address = address;
+		} else {
+			WARNING (context, "Failed to connect the cached address %08x.", address);
+			dc_atomic_store (&g_address, 0);
+
+			// Start over with a new socket.
+			dc_irda_close (device->socket);
+			device->socket = NULL;
+			status = dc_irda_open (&device->socket, context);
+			if (status != DC_STATUS_SUCCESS) {
+				ERROR (context, "Failed to open the irda socket.");
+				goto error_free;
+			}
+		}
 	}
 
 	if (device->address == 0) {
-		ERROR (context, "No dive computer found.");
-		status = DC_STATUS_IO;
-		goto error_close;
-	}
-
-	// Connect the device.
-	status = dc_irda_connect_lsap (device->socket, device->address, 1);
-	if (status != DC_STATUS_SUCCESS) {
-		ERROR (context, "Failed to connect the device.");
-		goto error_close;
+		// Discover the device.
+		status = uwatec_smart_discover_address (context, device->socket, &device->address);
+		if (status != DC_STATUS_SUCCESS)
+			goto error_close;
+
+		// Connect the device.
+		status = dc_irda_connect_lsap (device->socket, device->address, 1);
+		if (status != DC_STATUS_SUCCESS) {
+			ERROR (context, "Failed to connect the device.");
+			goto error_close;
+		}
 	}
 
 	// Perform the handshaking.
@@ -239,7 +440,7 @@ uwatec_smart_device_set_fingerprint (dc_device_t *abstract, const unsigned char
 
 
 static dc_status_t
-uwatec_smart_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
+uwatec_smart_device_download (dc_device_t *abstract, dc_buffer_t *buffer, dc_buffer_t *index)
 {
 	uwatec_smart_device_t *device = (uwatec_smart_device_t*) abstract;
 	dc_status_t rc = DC_STATUS_SUCCESS;
@@ -349,35 +550,18 @@ uwatec_smart_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
 		return DC_STATUS_PROTOCOL;
 	}
 
-	unsigned int nbytes = 0;
-	while (nbytes < length) {
-		// Set the minimum packet size.
-		unsigned int len = 32;
-
-		// Increase the packet size if more data is immediately available.
-		size_t available = 0;
-		rc = dc_irda_get_available (device->socket, &available);
-		if (rc == DC_STATUS_SUCCESS && available > len)
-			len = available;
-
-		// Limit the packet size to the total size.
-		if (nbytes + len > length)
-			len = length - nbytes;
-
-		rc = dc_irda_read (device->socket, data + nbytes, len, NULL);
-		if (rc != DC_STATUS_SUCCESS) {
-			ERROR (abstract->context, "Failed to receive the answer.");
-			return rc;
-		}
+	rc = uwatec_smart_receive (device, &progress, data, length, index);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
 
-		// Update and emit a progress event.
-		progress.current += len;
-		device_event_emit (&device->base, DC_EVENT_PROGRESS, &progress);
+	return DC_STATUS_SUCCESS;
+}
 
-		nbytes += len;
-	}
 
-	return DC_STATUS_SUCCESS;
+static dc_status_t
+uwatec_smart_device_dump (dc_device_t *abstract, dc_buffer_t *buffer)
+{
+	return uwatec_smart_device_download (abstract, buffer, NULL);
 }
 
 
@@ -385,18 +569,42 @@ static dc_status_t
 uwatec_smart_device_foreach (dc_device_t *abstract, dc_dive_callback_t callback, void *userdata)
 {
 	dc_buffer_t *buffer = dc_buffer_new (0);
-	if (buffer == NULL)
+	dc_buffer_t *index = dc_buffer_new (0);
+	if (buffer == NULL || index == NULL) {
+		dc_buffer_free (index);
+		dc_buffer_free (buffer);
 		return DC_STATUS_NOMEMORY;
+	}
 
-	dc_status_t rc = uwatec_smart_device_dump (abstract, buffer);
+	device_phase (abstract, DC_PHASE_PROFILE);
+
+	dc_status_t rc = uwatec_smart_device_download (abstract, buffer, index);
 	if (rc != DC_STATUS_SUCCESS) {
+		dc_buffer_free (index);
 		dc_buffer_free (buffer);
 		return rc;
 	}
 
-	rc = uwatec_smart_extract_dives (abstract,
-		dc_buffer_get_data (buffer), dc_buffer_get_size (buffer), callback, userdata);
+	const unsigned char *data = dc_buffer_get_data (buffer);
+	const unsigned char *offsets = dc_buffer_get_data (index);
+	unsigned int count = dc_buffer_get_size (index) / 4;
+
+	if (count) {
+		// The dives are already located during the transfer, and
+		// only need to be returned in reverse order.
+		while (count) {
+			count--;
+			unsigned int offset = array_uint32_le (offsets + count * 4);
+			unsigned int length = array_uint32_le (data + offset + 4);
+			if (callback && !callback (data + offset, length, data + offset + 8, 4, userdata))
+				break;
+		}
+	} else {
+		rc = uwatec_smart_extract_dives (abstract,
+			data, dc_buffer_get_size (buffer), callback, userdata);
+	}
 
+	dc_buffer_free (index);
 	dc_buffer_free (buffer);
 
 	return rc;
@@ -409,14 +617,12 @@ uwatec_smart_extract_dives (dc_device_t *abstract, const unsigned char data[], u
 	if (abstract && !ISINSTANCE (abstract))
 		return DC_STATUS_INVALIDARGS;
 
-	const unsigned char header[4] = {0xa5, 0xa5, 0x5a, 0x5a};
-
 	// Search the data stream for start markers.
 	unsigned int previous = size;
 	unsigned int current = (size >= 4 ? size - 4 : 0);
 	while (current > 0) {
 		current--;
-		if (memcmp (data + current, header, sizeof (header)) == 0) {
+		if (memcmp (data + current, uwatec_smart_header, sizeof (uwatec_smart_header)) == 0) {
 			// Get the length of the profile data.
 			unsigned int len = array_uint32_le (data + current + 4);
 
@@ -19,6 +19,8 @@
  * MA 02110-1301 USA
  */
 
+#define DC_LOG_CATEGORY DC_LOGCATEGORY_PARSER
+
 #include <stdlib.h>
 #include <string.h>	// memcmp
 
@@ -50,12 +52,19 @@
 
 #define UNSUPPORTED 0xFFFFFFFF
 
+#define ID_INVALID  0xFE
+#define ID_EXTENDED 0xFF
+
 #define NEVENTS   3
 #define NGASMIXES 10
 
 #define HEADER  1
 #define PROFILE 2
 
+#define UNVALIDATED 0
+#define VALID       1
+#define INVALID     2
+
 #define FRESH 1.000
 #define SALT  1.025
 
@@ -140,6 +149,7 @@ struct uwatec_smart_parser_t {
 	const uwatec_smart_header_info_t *header;
 	unsigned int headersize;
 	unsigned int nsamples;
+	unsigned char identify[256];
 	const uwatec_smart_event_info_t *events[NEVENTS];
 	unsigned int nevents[NEVENTS];
 	// Cached fields.
@@ -151,12 +161,15 @@ struct uwatec_smart_parser_t {
 	uwatec_smart_tank_t tank[NGASMIXES];
 	dc_water_t watertype;
 	dc_divemode_t divemode;
+	unsigned int validated;
 };
 
 static dc_status_t uwatec_smart_parser_set_data (dc_parser_t *abstract, const unsigned char *data, unsigned int size);
 static dc_status_t uwatec_smart_parser_get_datetime (dc_parser_t *abstract, dc_datetime_t *datetime);
 static dc_status_t uwatec_smart_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsigned int flags, void *value);
 static dc_status_t uwatec_smart_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata);
+static dc_status_t uwatec_smart_parser_samples_extract (dc_parser_t *abstract, dc_sample_columns_t *columns);
+static void uwatec_smart_parser_identify_init (uwatec_smart_parser_t *parser);
 
 static const dc_parser_vtable_t uwatec_smart_parser_vtable = {
 	sizeof(uwatec_smart_parser_t),
@@ -165,6 +178,14 @@ static const dc_parser_vtable_t uwatec_smart_parser_vtable = {
 	uwatec_smart_parser_get_datetime, /* datetime */
 	uwatec_smart_parser_get_field, /* fields */
 	uwatec_smart_parser_samples_foreach, /* samples_foreach */
+	uwatec_smart_parser_samples_extract, /* samples_extract */
+	NULL, /* samples_range */
+	NULL, /* samples_seek */
+	NULL, /* samples_index */
+	NULL, /* samples_split */
+	NULL, /* samples_chunk */
+	NULL, /* subdives */
+	NULL, /* samples_vendor */
 	NULL /* destroy */
 };
 
@@ -633,8 +654,10 @@ uwatec_smart_parser_create (dc_parser_t **out, dc_context_t *context, unsigned i
 		status = DC_STATUS_INVALIDARGS;
 		goto error_free;
 	}
+	uwatec_smart_parser_identify_init (parser);
 
 	parser->cached = 0;
+	parser->validated = UNVALIDATED;
 	parser->trimix = 0;
 	parser->ngasmixes = 0;
 	parser->ntanks = 0;
@@ -667,6 +690,7 @@ uwatec_smart_parser_set_data (dc_parser_t *abstract, const unsigned char *data,
 
 	// Reset the cache.
 	parser->cached = 0;
+	parser->validated = UNVALIDATED;
 	parser->trimix = 0;
 	parser->ngasmixes = 0;
 	parser->ntanks = 0;
@@ -734,8 +758,11 @@ uwatec_smart_parser_get_field (dc_parser_t *abstract, dc_field_type_t type, unsi
 	if (rc != DC_STATUS_SUCCESS)
 		return rc;
 
-	// Cache the profile data.
-	if (parser->cached < PROFILE) {
+	// Cache the profile data. Only the gas mixes and tanks can be
+	// extended from the samples, so the other fields never need it.
+	if (parser->cached < PROFILE &&
+		(type == DC_FIELD_GASMIX_COUNT || type == DC_FIELD_GASMIX ||
+		type == DC_FIELD_TANK_COUNT || type == DC_FIELD_TANK)) {
 		rc = uwatec_smart_parser_samples_foreach (abstract, NULL, NULL);
 		if (rc != DC_STATUS_SUCCESS)
 			return rc;
@@ -849,6 +876,39 @@ uwatec_galileo_identify (unsigned char value)
 }
 
 
+/*
+ * Precompute the sample type for every possible value of the first
+ * byte, such that identifying a sample is a single table lookup. Only
+ * the Smart type bits can continue past the first byte (all bits set),
+ * and those rare samples are marked for the bitwise scan.
+ */
+static void
+uwatec_smart_parser_identify_init (uwatec_smart_parser_t *parser)
+{
+	unsigned int galileo =
+		parser->model == GALILEO || parser->model == GALILEOTRIMIX ||
+		parser->model == ALADIN2G || parser->model == MERIDIAN ||
+		parser->model == CHROMIS || parser->model == MANTIS2;
+
+	for (unsigned int i = 0; i < 256; ++i) {
+		unsigned char value = i;
+		unsigned int id = 0;
+		if (galileo) {
+			id = uwatec_galileo_identify (value);
+		} else if (value == 0xFF) {
+			parser->identify[i] = ID_EXTENDED;
+			continue;
+		} else {
+			id = uwatec_smart_identify (&value, 1);
+		}
+
+		if (id >= parser->nsamples)
+			id = ID_INVALID;
+		parser->identify[i] = id;
+	}
+}
+
+
 static unsigned int
 uwatec_smart_fixsignbit (unsigned int x, unsigned int n)
 {
@@ -868,25 +928,93 @@ uwatec_smart_fixsignbit (unsigned int x, unsigned int n)
 }
 
 
+static unsigned int
+uwatec_smart_parser_profile (uwatec_smart_parser_t *parser)
+{
+	if (parser->trimix)
+		return 0xB1;
+
+	return parser->headersize;
+}
+
+
+/*
+ * Check once whether every sample record of the dive is within the
+ * bounds of the data. This only steps over the records, which is much
+ * cheaper than decoding them, and allows all further passes over the
+ * samples to skip the bounds checks.
+ */
+static unsigned int
+uwatec_smart_parser_validate (uwatec_smart_parser_t *parser)
+{
+	const unsigned char *data = parser->base.data;
+	unsigned int size = parser->base.size;
+	const uwatec_smart_sample_info_t *table = parser->samples;
+
+	unsigned int offset = uwatec_smart_parser_profile (parser);
+	while (offset < size) {
+		unsigned int id = parser->identify[data[offset]];
+		if (id == ID_EXTENDED) {
+			id = uwatec_smart_identify (data + offset, size - offset);
+		}
+		if (id >= parser->nsamples)
+			return INVALID;
+
+		offset += table[id].ntypebits / NBITS;
+
+		unsigned int value = 0;
+		unsigned int n = table[id].ntypebits % NBITS;
+		if (n > 0) {
+			if (offset >= size)
+				return INVALID;
+			if (!table[id].ignoretype)
+				value = data[offset] & (0xFF >> n);
+			offset++;
+		}
+
+		if (offset > size || table[id].extrabytes > size - offset)
+			return INVALID;
+
+		for (unsigned int i = 0; i < table[id].extrabytes; ++i) {
+			value <<= NBITS;
+			value += data[offset];
+			offset++;
+		}
+
+		if (table[id].type == UNKNOWN1) {
+			if (8 > size - offset)
+				return INVALID;
+			offset += 8;
+		} else if (table[id].type == UNKNOWN2) {
+			if (value < 1 || offset >= size || value - 1 > size - offset)
+				return INVALID;
+			unsigned int subtype = data[offset];
+			if (subtype >= 32 && subtype <= 41 && value < 16)
+				return INVALID;
+			offset += value - 1;
+		}
+	}
+
+	return VALID;
+}
+
+
+/*
+ * Walk the samples. With the checked flag cleared, the bounds checks are
+ * skipped, which is only allowed for validated data. The function is
+ * called with a constant flag, so the compiler can specialize both loops.
+ */
 static dc_status_t
-uwatec_smart_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata)
+uwatec_smart_parser_samples_walk (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata, dc_sample_columns_t *columns, const int checked)
 {
 	uwatec_smart_parser_t *parser = (uwatec_smart_parser_t*) abstract;
 
 	const unsigned char *data = abstract->data;
 	unsigned int size = abstract->size;
 
-	// Cache the parser data.
-	dc_status_t rc = uwatec_smart_parser_cache (parser);
-	if (rc != DC_STATUS_SUCCESS)
-		return rc;
-
 	const uwatec_smart_sample_info_t *table = parser->samples;
 	unsigned int entries = parser->nsamples;
-	unsigned int header = parser->headersize;
-	if (parser->trimix) {
-		header = 0xB1;
-	}
+	unsigned int header = uwatec_smart_parser_profile (parser);
 
 	// Get the maximum number of alarm bytes.
 	unsigned int nalarms = 0;
@@ -925,22 +1053,20 @@ uwatec_smart_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t
 	int have_depth = 0, have_temperature = 0, have_pressure = 0, have_rbt = 0,
 		have_heartrate = 0, have_bearing = 0;
 
+	unsigned int count = 0;
 	unsigned int offset = header;
 	while (offset < size) {
 		dc_sample_value_t sample = {0};
 
+		if (++count % PARSER_CANCEL_INTERVAL == 0 && parser_is_cancelled (abstract))
+			return DC_STATUS_CANCELLED;
+
 		// Process the type bits in the bitstream.
-		unsigned int id = 0;
-		if (parser->model == GALILEO || parser->model == GALILEOTRIMIX ||
-			parser->model == ALADIN2G || parser->model == MERIDIAN ||
-			parser->model == CHROMIS || parser->model == MANTIS2) {
-			// Uwatec Galileo
-			id = uwatec_galileo_identify (data[offset]);
-		} else {
-			// Uwatec Smart
+		unsigned int id = parser->identify[data[offset]];
+		if (id == ID_EXTENDED) {
 			id = uwatec_smart_identify (data + offset, size - offset);
 		}
-		if (id >= entries) {
+		if (checked && id >= entries) {
 			ERROR (abstract->context, "Invalid type bits.");
 			return DC_STATUS_DATAFORMAT;
 		}
@@ -965,7 +1091,7 @@ uwatec_smart_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t
 		}
 
 		// Check for buffer overflows.
-		if (offset + table[id].extrabytes > size) {
+		if (checked && offset + table[id].extrabytes > size) {
 			ERROR (abstract->context, "Incomplete sample data.");
 			return DC_STATUS_DATAFORMAT;
 		}
@@ -1077,21 +1203,21 @@ uwatec_smart_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t
 			complete = value;
 			break;
 		case UNKNOWN1:
-			if (offset + 8 > size) {
+			if (checked && offset + 8 > size) {
 				ERROR (abstract->context, "Incomplete sample data.");
 				return DC_STATUS_DATAFORMAT;
 			}
 			offset += 8;
 			break;
 		case UNKNOWN2:
-			if (value < 1 || offset + value - 1 > size) {
+			if (checked && (value < 1 || offset + value - 1 > size)) {
 				ERROR (abstract->context, "Incomplete sample data.");
 				return DC_STATUS_DATAFORMAT;
 			}
 
 			subtype = data[offset];
 			if (subtype >= 32 && subtype <= 41) {
-				if (value < 16) {
+				if (checked && value < 16) {
 					ERROR (abstract->context, "Incomplete sample data.");
 					return DC_STATUS_DATAFORMAT;
 				}
@@ -1143,6 +1269,7 @@ uwatec_smart_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t
 
 		while (complete) {
 			sample.time = time;
+			if (columns) sample_columns_time (columns, time);
 			if (callback) callback (DC_SAMPLE_TIME, sample, userdata);
 
 			if (parser->ngasmixes && gasmix != gasmix_previous) {
@@ -1152,6 +1279,7 @@ uwatec_smart_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t
 					return DC_STATUS_DATAFORMAT;
 				}
 				sample.gasmix = idx;
+				if (columns) sample_columns_gasmix (columns, idx);
 				if (callback) callback (DC_SAMPLE_GASMIX, sample, userdata);
 #ifdef ENABLE_DEPRECATED
 				unsigned int o2 = parser->gasmix[idx].oxygen;
@@ -1167,6 +1295,7 @@ uwatec_smart_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t
 
 			if (have_temperature) {
 				sample.temperature = temperature;
+				if (columns) sample_columns_temperature (columns, temperature);
 				if (callback) callback (DC_SAMPLE_TEMPERATURE, sample, userdata);
 			}
 
@@ -1175,6 +1304,7 @@ uwatec_smart_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t
 				sample.event.time = 0;
 				sample.event.flags = 0;
 				sample.event.value = 0;
+				if (columns) sample_columns_event (columns, SAMPLE_EVENT_BOOKMARK, 0, NULL, 0, 0);
 				if (callback) callback (DC_SAMPLE_EVENT, sample, userdata);
 			}
 
@@ -1188,6 +1318,7 @@ uwatec_smart_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t
 				if (idx < parser->ntanks) {
 					sample.pressure.tank = idx;
 					sample.pressure.value = pressure;
+					if (columns) sample_columns_pressure (columns, idx, pressure);
 					if (callback) callback (DC_SAMPLE_PRESSURE, sample, userdata);
 				}
 			}
@@ -1205,6 +1336,7 @@ uwatec_smart_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t
 
 			if (have_depth) {
 				sample.depth = (depth - depth_calibration) / salinity;
+				if (columns) sample_columns_depth (columns, sample.depth);
 				if (callback) callback (DC_SAMPLE_DEPTH, sample, userdata);
 			}
 
@@ -1217,3 +1349,37 @@ uwatec_smart_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t
 
 	return DC_STATUS_SUCCESS;
 }
+
+static dc_status_t
+uwatec_smart_parser_samples_internal (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata, dc_sample_columns_t *columns)
+{
+	uwatec_smart_parser_t *parser = (uwatec_smart_parser_t*) abstract;
+
+	// Cache the parser data.
+	dc_status_t rc = uwatec_smart_parser_cache (parser);
+	if (rc != DC_STATUS_SUCCESS)
+		return rc;
+
+	if (parser->validated == UNVALIDATED) {
+		parser->validated = uwatec_smart_parser_validate (parser);
+	}
+
+	// Malformed data takes the checked path, to report the error at the
+	// same point as before.
+	if (parser->validated == VALID)
+		return uwatec_smart_parser_samples_walk (abstract, callback, userdata, columns, 0);
+	else
+		return uwatec_smart_parser_samples_walk (abstract, callback, userdata, columns, 1);
+}
+
+static dc_status_t
+uwatec_smart_parser_samples_foreach (dc_parser_t *abstract, dc_sample_callback_t callback, void *userdata)
+{
+	return uwatec_smart_parser_samples_internal (abstract, callback, userdata, NULL);
+}
+
+static dc_status_t
+uwatec_smart_parser_samples_extract (dc_parser_t *abstract, dc_sample_columns_t *columns)
+{
+	return uwatec_smart_parser_samples_internal (abstract, NULL, NULL, columns);
+}
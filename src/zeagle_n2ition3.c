@@ -31,6 +31,8 @@
 #include "checksum.h"
 #include "array.h"
 #include "ringbuffer.h"
+#include "rbstream.h"
+#include "packet.h"
 
 #define ISINSTANCE(device) dc_device_isinstance((device), &zeagle_n2ition3_device_vtable)
 
@@ -67,6 +69,14 @@ static const dc_device_vtable_t zeagle_n2ition3_device_vtable = {
 	zeagle_n2ition3_device_close /* close */
 };
 
+static const dc_packet_framing_t zeagle_n2ition3_framing = {
+	DC_PACKET_ECHO_ANSWER, /* flags */
+	0, /* delay */
+	0, 0, 0, /* ack, header, trailer */
+	0, 0, /* start, minimum */
+	DC_PACKET_CHECKSUM_NEG_UINT8, 0x00, 3, 1, /* checksum */
+};
+
 
 static dc_status_t
 zeagle_n2ition3_packet (zeagle_n2ition3_device_t *device, const unsigned char command[], unsigned int csize, unsigned char answer[], unsigned int asize)
@@ -76,28 +86,10 @@ zeagle_n2ition3_packet (zeagle_n2ition3_device_t *device, const unsigned char co
 
 	assert (asize >= csize + 5);
 
-	if (device_is_cancelled (abstract))
-		return DC_STATUS_CANCELLED;
-
-	// Send the command to the device.
-	status = dc_serial_write (device->port, command, csize, NULL);
-	if (status != DC_STATUS_SUCCESS) {
-		ERROR (abstract->context, "Failed to send the command.");
-		return status;
-	}
-
-	// Receive the answer of the device.
-	status = dc_serial_read (device->port, answer, asize, NULL);
-	if (status != DC_STATUS_SUCCESS) {
-		ERROR (abstract->context, "Failed to receive the answer.");
+	// Send the command, and receive and verify the answer.
+	status = dc_packet_transfer (abstract, device->port, &zeagle_n2ition3_framing, command, csize, answer, asize);
+	if (status != DC_STATUS_SUCCESS)
 		return status;
-	}
-
-	// Verify the echo.
-	if (memcmp (answer, command, csize) != 0) {
-		ERROR (abstract->context, "Unexpected echo.");
-		return DC_STATUS_PROTOCOL;
-	}
 
 	// Verify the header and trailer of the packet.
 	if (answer[csize] != 0x02 && answer[asize - 1] != 0x03) {
@@ -111,14 +103,6 @@ zeagle_n2ition3_packet (zeagle_n2ition3_device_t *device, const unsigned char co
 		return DC_STATUS_PROTOCOL;
 	}
 
-	// Verify the checksum of the packet.
-	unsigned char crc = answer[asize - 2];
-	unsigned char ccrc = ~checksum_add_uint8 (answer + csize + 3, asize - csize - 5, 0x00) + 1;
-	if (crc != ccrc) {
-		ERROR (abstract->context, "Unexpected answer checksum.");
-		return DC_STATUS_PROTOCOL;
-	}
-
 	return DC_STATUS_SUCCESS;
 }
 
@@ -149,6 +133,7 @@ zeagle_n2ition3_device_open (dc_device_t **out, dc_context_t *context, const cha
 
 	// Set the default values.
 	device->port = NULL;
+	device->base.blocksize = SZ_PACKET;
 	memset (device->fingerprint, 0, sizeof (device->fingerprint));
 
 	// Open the device.
@@ -158,6 +143,10 @@ zeagle_n2ition3_device_open (dc_device_t **out, dc_context_t *context, const cha
 		goto error_free;
 	}
 
+	// Interrupt the blocking reads when the download is cancelled, and
+	// measure the time spent waiting for the I/O.
+	device_set_port ((dc_device_t *) device, device->port);
+
 	// Set the serial communication protocol (4800 8N1).
 	status = dc_serial_configure (device->port, 4800, 8, DC_PARITY_NONE, DC_STOPBITS_ONE, DC_FLOWCONTROL_NONE);
 	if (status != DC_STATUS_SUCCESS) {
@@ -352,16 +341,20 @@ zeagle_n2ition3_device_foreach (dc_device_t *abstract, dc_dive_callback_t callba
 	progress.maximum = (RB_LOGBOOK_END - RB_LOGBOOK_BEGIN) * 2 + 8 + total;
 	device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
 
+	// Create the ringbuffer stream.
+	dc_rbstream_t *rbstream = NULL;
+	rc = dc_rbstream_new (&rbstream, abstract, 1, SZ_PACKET,
+		RB_PROFILE_BEGIN, RB_PROFILE_END, eop, total);
+	if (rc != DC_STATUS_SUCCESS) {
+		ERROR (abstract->context, "Failed to create the ringbuffer stream.");
+		return rc;
+	}
+
 	// Memory buffer for the profile data.
 	unsigned char buffer[RB_PROFILE_END - RB_PROFILE_BEGIN] = {0};
 
-	unsigned int available = 0;
-	unsigned int remaining = total;
-	unsigned int offset = RB_PROFILE_END - RB_PROFILE_BEGIN;
-
 	idx = last;
 	previous = eop;
-	unsigned int address = previous;
 	for (unsigned int i = 0; i < count; ++i) {
 		// Get the pointer to the profile data.
 		unsigned int current = array_uint16_le (config + 2 * idx);
@@ -369,50 +362,45 @@ zeagle_n2ition3_device_foreach (dc_device_t *abstract, dc_dive_callback_t callba
 		// Get the profile length.
 		unsigned int length = ringbuffer_distance (current, previous, 1, RB_PROFILE_BEGIN, RB_PROFILE_END);
 
-		unsigned nbytes = available;
-		while (nbytes < length) {
-			if (address == RB_PROFILE_BEGIN)
-				address = RB_PROFILE_END;
-
-			unsigned int len = SZ_PACKET;
-			if (RB_PROFILE_BEGIN + len > address)
-				len = address - RB_PROFILE_BEGIN; // End of ringbuffer.
-			if (nbytes + len > remaining)
-				len = remaining - nbytes; // End of profile.
-
-			address -= len;
-			offset -= len;
-
-			// Read the memory page.
-			rc = zeagle_n2ition3_device_read (abstract, address, buffer + offset, len);
+		// The fingerprint is stored at the start of the dive, which is the
+		// last part to be downloaded. Check it first with a small read, to
+		// avoid downloading the full profile of an already known dive.
+		if (dc_rbstream_available (rbstream) < length && current + sizeof (device->fingerprint) <= RB_PROFILE_END &&
+			!array_isequal (device->fingerprint, sizeof (device->fingerprint), 0x00)) {
+			unsigned char fingerprint[sizeof (device->fingerprint)] = {0};
+			rc = zeagle_n2ition3_device_read (abstract, current, fingerprint, sizeof (fingerprint));
 			if (rc != DC_STATUS_SUCCESS) {
 				ERROR (abstract->context, "Failed to read the memory page.");
-				return rc;
+				break;
 			}
 
-			// Update and emit a progress event.
-			progress.current += len;
-			device_event_emit (abstract, DC_EVENT_PROGRESS, &progress);
+			if (memcmp (fingerprint, device->fingerprint, sizeof (device->fingerprint)) == 0)
+				break;
+		}
 
-			nbytes += len;
+		// Read the profile data.
+		rc = dc_rbstream_read (rbstream, &progress, buffer, length);
+		if (rc != DC_STATUS_SUCCESS) {
+			ERROR (abstract->context, "Failed to read the dive.");
+			break;
 		}
 
-		remaining -= length;
-		available = nbytes - length;
 		previous = current;
 
-		unsigned char *p = buffer + offset + available;
+		unsigned char *p = buffer;
 
 		if (memcmp (p, device->fingerprint, sizeof (device->fingerprint)) == 0)
-			return DC_STATUS_SUCCESS;
+			break;
 
 		if (callback && !callback (p, length, p, sizeof (device->fingerprint), userdata))
-			return DC_STATUS_SUCCESS;
+			break;
 
 		if (idx == RB_LOGBOOK_BEGIN)
 			idx = RB_LOGBOOK_END;
 		idx--;
 	}
 
-	return DC_STATUS_SUCCESS;
+	dc_rbstream_free (rbstream);
+
+	return rc;
 }